@@ -0,0 +1,555 @@
+/***************************************************************************
+ * Benchmark harness
+ *
+ * Copyright (c) 2017 Joshua Ogunyinka
+ * All rights reserved.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/****************************
+ * Runs each benchmark a number
+ * of times in its own process
+ * and reports the median wall
+ * time, the throughput that
+ * gives, the peak resident size
+ * and, from one more run with
+ * '--gc-stats', the collector's
+ * pauses. The scripts in the
+ * benchmark directory say how
+ * many operations they do in a
+ * first line '// operations: <n>';
+ * the front end's are sources
+ * generated here, counted in
+ * lines. Results are compared
+ * with a baseline file, and the
+ * harness fails if any is slower
+ * or bigger by more than the
+ * threshold. A script's header may
+ * also name options it must run
+ * no slower with, as in
+ * '// not slower with: --jit'; it
+ * is timed again with each, and
+ * the harness fails if it is
+ * slower with one
+ ****************************/
+struct Benchmark {
+	std::string name;
+	std::vector<std::string> arguments;			// to the compiler, after its path
+	double operations;
+	std::string unit;
+	bool has_heap;								// runs a program, so the collector can be measured
+	std::vector<std::string> not_slower_with;	// options each compared with running without them
+};
+
+struct Result {
+	double wall_ms;
+	long peak_kb;
+	size_t collections;
+	double pause_us;
+	double longest_us;
+};
+
+struct Run {
+	bool is_ok;
+	double wall_ms;
+	long peak_kb;
+};
+
+// the metrics kept in a baseline, and how much they may grow before it's a regression
+static const char* BASELINE_HEADER = "# benchmark wall_ms peak_kb pause_us";
+// pauses shorter than this in total are noise
+static const double PAUSE_FLOOR_US = 500;
+
+static Run Execute( std::vector<std::string> const &arguments, std::string const &error_file )
+{
+	Run run{ false, 0, 0 };
+	std::vector<char*> argv;
+	for ( auto &argument : arguments ) {
+		argv.push_back( const_cast< char* >( argument.c_str() ) );
+	}
+	argv.push_back( nullptr );
+
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	const pid_t pid = fork();
+	if ( pid < 0 ) {
+		return run;
+	}
+	if ( pid == 0 ) {
+		// the program's output isn't measured; its error stream is kept for the collector's report
+		const int out = open( "/dev/null", O_WRONLY );
+		const int err = open( error_file.empty() ? "/dev/null" : error_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+		dup2( out, STDOUT_FILENO );
+		dup2( err, STDERR_FILENO );
+		execv( argv[ 0 ], argv.data() );
+		_exit( 127 );
+	}
+
+	int status = 0;
+	struct rusage usage;
+	memset( &usage, 0, sizeof( usage ) );
+	if ( wait4( pid, &status, 0, &usage ) != pid ) {
+		return run;
+	}
+	run.wall_ms = std::chrono::duration< double, std::milli >( std::chrono::steady_clock::now() - start ).count();
+#ifdef __APPLE__
+	run.peak_kb = usage.ru_maxrss / 1024;
+#else
+	run.peak_kb = usage.ru_maxrss;
+#endif
+	run.is_ok = WIFEXITED( status ) && WEXITSTATUS( status ) == 0;
+
+	return run;
+}
+
+// the median wall time of 'runs' runs, after one to warm the file cache, and their peak resident size
+static bool Measure( std::vector<std::string> const &arguments, int runs, std::string const &error_file, double &wall_ms, long &peak_kb )
+{
+	std::vector<double> times;
+	bool is_ok = Execute( arguments, error_file ).is_ok;
+	for ( int i = 0; i < runs && is_ok; ++i ) {
+		const Run run = Execute( arguments, "" );
+		is_ok = run.is_ok;
+		times.push_back( run.wall_ms );
+		peak_kb = std::max( peak_kb, run.peak_kb );
+	}
+	if ( !is_ok ) {
+		return false;
+	}
+
+	std::sort( times.begin(), times.end() );
+	wall_ms = times[ times.size() / 2 ];
+	return true;
+}
+
+// the collections and pauses of a '--gc-stats' report
+static void ReadHeapStats( std::string const &error_file, Result &result )
+{
+	std::ifstream in( error_file );
+	std::string line;
+	while ( std::getline( in, line ) ) {
+		if ( line.compare( 0, 17, "---------- heap: " ) == 0 ) {
+			result.collections = strtoul( line.c_str() + 17, nullptr, 10 );
+		}
+		else if ( line.compare( 0, 7, "pauses\t" ) == 0 ) {
+			result.pause_us = strtod( line.c_str() + 7, nullptr );
+			const size_t longest = line.find( "longest " );
+			if ( longest != std::string::npos ) {
+				result.longest_us = strtod( line.c_str() + longest + 8, nullptr );
+			}
+		}
+	}
+}
+
+static bool WriteFile( std::string const &file_name, std::string const &text )
+{
+	std::ofstream out( file_name );
+	out << text;
+	out.close();
+
+	return !out.fail();
+}
+
+/****************************
+ * Global functions, each calling
+ * the one before it, with loops,
+ * conditions, literals of every
+ * kind and comments for the
+ * scanner. 'prefix' keeps the
+ * names of separate files apart
+ ****************************/
+static std::string Functions( std::string const &prefix, int count, size_t &lines )
+{
+	std::ostringstream source;
+	for ( int k = 0; k < count; ++k ) {
+		const std::string name = prefix + std::to_string( k );
+		source << "// " << name << " sums a series, then hands on to the function before it\n";
+		source << "function " << name << "( a, b ) {\n";
+		source << "\ts = 0;\n";
+		source << "\tf = " << k << ".25;\n";
+		source << "\ti = 0;\n";
+		source << "\twhile ( i < a && s >= 0 ) {\n";
+		source << "\t\tif ( i % 3 == 0 || i > b ) {\n";
+		source << "\t\t\ts = s + i * b - ( a / 2 );\n";
+		source << "\t\t}\n";
+		source << "\t\telse {\n";
+		source << "\t\t\tf = f * 1.5 - " << k % 7 << ";\n";
+		source << "\t\t}\n";
+		source << "\t\ti = i + 1;\n";
+		source << "\t}\n";
+		source << "\tt = \"" << name << " done\";\n";
+		source << "\t/* the first function ends the chain */\n";
+		if ( k ) {
+			source << "\treturn s + " << prefix << k - 1 << "( b, a );\n";
+		}
+		else {
+			source << "\treturn s;\n";
+		}
+		source << "}\n";
+		lines += 18;
+	}
+
+	return source.str();
+}
+
+// classes with fields, a constructor and methods, and global code making and using them
+static std::string Classes( int count, size_t &lines )
+{
+	std::ostringstream source;
+	source << "t = 0;\n";
+	++lines;
+	for ( int k = 0; k < count; ++k ) {
+		source << "class C" << k << " {\n";
+		source << "\tvar a;\n";
+		source << "\tvar b;\n";
+		source << "\tvar c;\n";
+		source << "\tconstruct C" << k << "( x ) { a = x; b = x * 2; c = \"c" << k << "\"; }\n";
+		source << "\tfunction get() { return a + b; }\n";
+		source << "\tfunction put( x ) { a = x; return a; }\n";
+		source << "\tfunction scale( x, y ) {\n";
+		source << "\t\tif ( x > y ) {\n";
+		source << "\t\t\treturn a * x;\n";
+		source << "\t\t}\n";
+		source << "\t\treturn b * y + " << k << ";\n";
+		source << "\t}\n";
+		source << "}\n";
+		source << "v" << k << " = new C" << k << "( " << k << " );\n";
+		source << "t = t + v" << k << ".get() + v" << k << ".scale( 2, 3 );\n";
+		lines += 16;
+	}
+
+	return source.str();
+}
+
+static std::vector<Benchmark> Scripts( std::string const &directory )
+{
+	std::vector<Benchmark> benchmarks;
+	DIR* dir = opendir( directory.c_str() );
+	if ( !dir ) {
+		return benchmarks;
+	}
+
+	while ( struct dirent* entry = readdir( dir ) ) {
+		const std::string file_name = entry->d_name;
+		if ( file_name.size() <= 5 || file_name.compare( file_name.size() - 5, 5, ".subs" ) != 0 ) {
+			continue;
+		}
+
+		const std::string path = directory + "/" + file_name;
+		std::ifstream in( path );
+		std::string line;
+		std::getline( in, line );
+		const std::string marker = "// operations: ";
+		const double operations = line.compare( 0, marker.size(), marker ) == 0 ? strtod( line.c_str() + marker.size(), nullptr ) : 0;
+		benchmarks.push_back( { file_name.substr( 0, file_name.size() - 5 ), { path }, operations, "op", true } );
+
+		// the options are in the comments heading the script
+		const std::string options_marker = "// not slower with: ";
+		while ( std::getline( in, line ) && line.compare( 0, 2, "//" ) == 0 ) {
+			if ( line.compare( 0, options_marker.size(), options_marker ) == 0 ) {
+				std::istringstream options( line.substr( options_marker.size() ) );
+				std::string option;
+				while ( options >> option ) {
+					benchmarks.back().not_slower_with.push_back( option );
+				}
+			}
+		}
+	}
+	closedir( dir );
+
+	std::sort( benchmarks.begin(), benchmarks.end(), []( Benchmark const &a, Benchmark const &b ) {
+		return a.name < b.name;
+	} );
+
+	return benchmarks;
+}
+
+// false if a source couldn't be written
+static bool FrontEndBenchmarks( std::string const &directory, std::vector<Benchmark> &benchmarks )
+{
+	size_t lines = 0;
+	const std::string functions = directory + "/functions.subs";
+	if ( !WriteFile( functions, Functions( "f", 4000, lines ) ) ) {
+		return false;
+	}
+	benchmarks.push_back( { "parse_functions", { "--parse-only", functions }, static_cast< double >( lines ), "line", false } );
+	benchmarks.push_back( { "compile_functions", { "-O2", "--compile=" + directory + "/functions.subc", functions }, static_cast< double >( lines ),
+		"line", false } );
+
+	lines = 0;
+	const std::string classes = directory + "/classes.subs";
+	if ( !WriteFile( classes, Classes( 2000, lines ) ) ) {
+		return false;
+	}
+	benchmarks.push_back( { "parse_classes", { "--parse-only", classes }, static_cast< double >( lines ), "line", false } );
+
+	// files are parsed in parallel
+	lines = 0;
+	std::vector<std::string> files;
+	for ( int i = 0; i < 8; ++i ) {
+		files.push_back( directory + "/part" + std::to_string( i ) + ".subs" );
+		if ( !WriteFile( files.back(), Functions( "p" + std::to_string( i ) + "_", 1000, lines ) ) ) {
+			return false;
+		}
+	}
+	files.insert( files.begin(), "--parse-only" );
+	benchmarks.push_back( { "parse_files", files, static_cast< double >( lines ), "line", false } );
+
+	return true;
+}
+
+static std::map<std::string, Result> ReadBaseline( std::string const &file_name )
+{
+	std::map<std::string, Result> baseline;
+	std::ifstream in( file_name );
+	std::string line;
+	while ( std::getline( in, line ) ) {
+		if ( line.empty() || line[ 0 ] == '#' ) {
+			continue;
+		}
+		std::istringstream fields( line );
+		std::string name;
+		Result result{ 0, 0, 0, 0, 0 };
+		if ( fields >> name >> result.wall_ms >> result.peak_kb >> result.pause_us ) {
+			baseline[ name ] = result;
+		}
+	}
+
+	return baseline;
+}
+
+static bool WriteBaseline( std::string const &file_name, std::map<std::string, Result> const &results )
+{
+	std::ostringstream text;
+	text << BASELINE_HEADER << "\n";
+	for ( auto &result : results ) {
+		text << result.first << " " << result.second.wall_ms << " " << result.second.peak_kb << " " << result.second.pause_us << "\n";
+	}
+
+	return WriteFile( file_name, text.str() );
+}
+
+// percent change from the baseline; "new" when there is none
+static std::string Change( double now, double base, double threshold, bool &is_regression )
+{
+	if ( base <= 0 ) {
+		return now > 0 ? "new" : "";
+	}
+
+	const double change = ( now - base ) * 100 / base;
+	if ( change > threshold ) {
+		is_regression = true;
+	}
+	char text[ 32 ];
+	snprintf( text, sizeof( text ), "%+.1f%%%s", change, change > threshold ? "!" : "" );
+
+	return text;
+}
+
+static std::string Throughput( double operations, std::string const &unit, double wall_ms )
+{
+	if ( operations <= 0 || wall_ms <= 0 ) {
+		return "-";
+	}
+
+	double rate = operations * 1000 / wall_ms;
+	const char* scale = "";
+	if ( rate >= 1e6 ) {
+		rate /= 1e6;
+		scale = "M";
+	}
+	else if ( rate >= 1e3 ) {
+		rate /= 1e3;
+		scale = "k";
+	}
+	char text[ 48 ];
+	snprintf( text, sizeof( text ), "%.2f%s %s/s", rate, scale, unit.c_str() );
+
+	return text;
+}
+
+static void Usage()
+{
+	std::cerr << "usage: harness [--runs=<n>] [--threshold=<percent>] [--baseline=<file>] [--save] <compiler> <benchmark directory> [<benchmark>...]"
+		<< std::endl;
+}
+
+int main( int argc, const char* argv[] )
+{
+	int runs = 5;
+	double threshold = 10;
+	bool save = false;
+	std::string baseline_file;
+	std::vector<std::string> paths;
+	std::vector<std::string> chosen;
+	for ( int i = 1; i < argc; ++i ) {
+		const std::string argument = argv[ i ];
+		if ( argument.compare( 0, 7, "--runs=" ) == 0 ) {
+			runs = atoi( argument.c_str() + 7 );
+		}
+		else if ( argument.compare( 0, 12, "--threshold=" ) == 0 ) {
+			threshold = strtod( argument.c_str() + 12, nullptr );
+		}
+		else if ( argument.compare( 0, 11, "--baseline=" ) == 0 ) {
+			baseline_file = argument.substr( 11 );
+		}
+		else if ( argument == "--save" ) {
+			save = true;
+		}
+		else if ( paths.size() < 2 ) {
+			paths.push_back( argument );
+		}
+		else {
+			chosen.push_back( argument );
+		}
+	}
+	if ( paths.size() < 2 || runs < 1 ) {
+		Usage();
+		return 2;
+	}
+
+	const std::string compiler = paths[ 0 ];
+	const std::string directory = paths[ 1 ];
+	if ( baseline_file.empty() ) {
+		baseline_file = directory + "/baseline.txt";
+	}
+
+	char temporary[] = "/tmp/subc-benchmark-XXXXXX";
+	if ( !mkdtemp( temporary ) ) {
+		std::cerr << "Unable to make a temporary directory" << std::endl;
+		return 2;
+	}
+	const std::string work = temporary;
+	const std::string error_file = work + "/stderr.txt";
+
+	std::vector<Benchmark> benchmarks = Scripts( directory );
+	if ( !FrontEndBenchmarks( work, benchmarks ) ) {
+		std::cerr << "Unable to write generated sources to " << work << std::endl;
+		return 2;
+	}
+	if ( !chosen.empty() ) {
+		benchmarks.erase( std::remove_if( benchmarks.begin(), benchmarks.end(), [&chosen]( Benchmark const &benchmark ) {
+			return std::find( chosen.begin(), chosen.end(), benchmark.name ) == chosen.end();
+		} ), benchmarks.end() );
+	}
+
+	const std::map<std::string, Result> baseline = ReadBaseline( baseline_file );
+	if ( baseline.empty() && !save ) {
+		std::cout << "No baseline in " << baseline_file << ": run with --save to store one" << std::endl;
+	}
+
+	printf( "%-18s %10s %8s %16s %10s %8s %11s %8s %10s %8s\n", "benchmark", "time ms", "change", "throughput", "peak KB", "change", "collections",
+		"pause us", "longest us", "change" );
+	std::vector<std::pair<std::string, Result>> results;
+	bool has_failed = false;
+	bool has_regressed = false;
+	bool has_slowed = false;
+	for ( Benchmark const &benchmark : benchmarks ) {
+		std::vector<std::string> arguments{ compiler };
+		arguments.insert( arguments.end(), benchmark.arguments.begin(), benchmark.arguments.end() );
+
+		Result result{ 0, 0, 0, 0, 0 };
+		bool is_ok = Measure( arguments, runs, error_file, result.wall_ms, result.peak_kb );
+		if ( is_ok && benchmark.has_heap ) {
+			// sampling one allocation in many keeps the report's own cost out of the pauses
+			std::vector<std::string> stats_arguments{ compiler, "--gc-stats=1000" };
+			stats_arguments.insert( stats_arguments.end(), benchmark.arguments.begin(), benchmark.arguments.end() );
+			is_ok = Execute( stats_arguments, error_file ).is_ok;
+			ReadHeapStats( error_file, result );
+		}
+		if ( !is_ok ) {
+			printf( "%-18s failed: %s\n", benchmark.name.c_str(), arguments.back().c_str() );
+			has_failed = true;
+			continue;
+		}
+
+		results.push_back( { benchmark.name, result } );
+
+		auto base = baseline.find( benchmark.name );
+		const Result none{ 0, 0, 0, 0, 0 };
+		Result const &before = base != baseline.end() ? base->second : none;
+		bool is_regression = false;
+		const std::string time_change = Change( result.wall_ms, before.wall_ms, threshold, is_regression );
+		const std::string peak_change = Change( static_cast< double >( result.peak_kb ), static_cast< double >( before.peak_kb ), threshold,
+			is_regression );
+		std::string pause_change;
+		if ( benchmark.has_heap && ( result.pause_us >= PAUSE_FLOOR_US || before.pause_us >= PAUSE_FLOOR_US ) ) {
+			pause_change = Change( result.pause_us, before.pause_us, threshold, is_regression );
+		}
+		has_regressed = has_regressed || is_regression;
+
+		char collections[ 24 ] = "-";
+		char pause[ 24 ] = "-";
+		char longest[ 24 ] = "-";
+		if ( benchmark.has_heap ) {
+			snprintf( collections, sizeof( collections ), "%zu", result.collections );
+			snprintf( pause, sizeof( pause ), "%.0f", result.pause_us );
+			snprintf( longest, sizeof( longest ), "%.1f", result.longest_us );
+		}
+		printf( "%-18s %10.1f %8s %16s %10ld %8s %11s %8s %10s %8s\n", benchmark.name.c_str(), result.wall_ms, time_change.c_str(),
+			Throughput( benchmark.operations, benchmark.unit, result.wall_ms ).c_str(), result.peak_kb, peak_change.c_str(), collections, pause, longest,
+			pause_change.c_str() );
+
+		// the change is from the run without the option, and any slowdown is one
+		for ( std::string const &option : benchmark.not_slower_with ) {
+			std::vector<std::string> option_arguments{ compiler, option };
+			option_arguments.insert( option_arguments.end(), benchmark.arguments.begin(), benchmark.arguments.end() );
+			double wall_ms = 0;
+			long peak_kb = 0;
+			if ( !Measure( option_arguments, runs, error_file, wall_ms, peak_kb ) ) {
+				printf( "%-18s failed: %s %s\n", benchmark.name.c_str(), option.c_str(), arguments.back().c_str() );
+				has_failed = true;
+				continue;
+			}
+			const std::string option_change = Change( wall_ms, result.wall_ms, 0, has_slowed );
+			printf( "%-18s %10.1f %8s %16s\n", ( "  " + option ).c_str(), wall_ms, option_change.c_str(),
+				Throughput( benchmark.operations, benchmark.unit, wall_ms ).c_str() );
+		}
+	}
+
+	for ( const char* file_name : { "functions.subs", "functions.subc", "classes.subs", "stderr.txt" } ) {
+		unlink( ( work + "/" + file_name ).c_str() );
+	}
+	for ( int i = 0; i < 8; ++i ) {
+		unlink( ( work + "/part" + std::to_string( i ) + ".subs" ).c_str() );
+	}
+	rmdir( work.c_str() );
+
+	if ( save ) {
+		// benchmarks not run keep the results they had
+		std::map<std::string, Result> saved = baseline;
+		for ( auto &result : results ) {
+			saved[ result.first ] = result.second;
+		}
+		if ( !WriteBaseline( baseline_file, saved ) ) {
+			std::cerr << "Unable to write baseline file: " << baseline_file << std::endl;
+			return 2;
+		}
+		std::cout << "Baseline written to " << baseline_file << std::endl;
+	}
+	else if ( has_regressed ) {
+		std::cout << "Slower or bigger than the baseline by more than " << threshold << "%, marked '!'" << std::endl;
+	}
+	if ( has_slowed ) {
+		std::cout << "Slower with an option than without it, marked '!'" << std::endl;
+	}
+
+	return has_failed || has_slowed || ( has_regressed && !save ) ? 1 : 0;
+}
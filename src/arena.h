@@ -0,0 +1,197 @@
+/***************************************************************************
+ * Parse tree arena
+ *
+ * Copyright (c) 2017 Joshua Ogunyinka
+ * All rights reserved.
+ */
+
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+namespace compiler {
+	/****************************
+	 * Region allocator owning every node of one compilation. Nodes are
+	 * bump-allocated from large blocks and never freed individually; the
+	 * whole region goes away with the arena. Only objects holding strings
+	 * or containers are registered for (shallow) destruction.
+	 ****************************/
+	class ParseArena {
+		static const size_t BLOCK_SIZE = 64 * 1024;
+
+		struct Block {
+			Block*	next;
+			size_t	size;
+			size_t	used;
+		};
+
+		struct Finalizer {
+			Finalizer*	next;
+			void		( *destroy )( void* );
+			void*		object;
+		};
+
+		Block*		blocks;
+		Finalizer*	finalizers;
+		size_t		bytes_allocated;
+		std::wstring const*	file_name;	// the source parsed into this arena, if any
+
+		template<typename T>
+		static void Destroy( void* object ) {
+			static_cast< T* >( object )->~T();
+		}
+
+		// nodes that record where they were parsed get the arena's source
+		template<typename T>
+		static auto Locate( T* object, std::wstring const* name, int ) -> decltype( object->SetFileName( name ), void() ) {
+			object->SetFileName( name );
+		}
+
+		template<typename T>
+		static void Locate( T*, std::wstring const*, long ) {
+		}
+
+		static size_t BlockHeader() {
+			return ( sizeof( Block ) + alignof( std::max_align_t ) - 1 ) & ~( alignof( std::max_align_t ) - 1 );
+		}
+
+		Block* NewBlock( size_t size ) {
+			Block* block = static_cast< Block* >( malloc( BlockHeader() + size ) );
+			if ( !block ) {
+				throw std::bad_alloc();
+			}
+			block->size = size;
+			block->used = 0;
+			return block;
+		}
+
+	public:
+		ParseArena() : blocks( nullptr ), finalizers( nullptr ), bytes_allocated( 0 ), file_name( nullptr ) {
+		}
+
+		ParseArena( ParseArena const & ) = delete;
+		ParseArena& operator=( ParseArena const & ) = delete;
+
+		~ParseArena() {
+			// finalizers are chained newest first, so children go before parents
+			for ( Finalizer* finalizer = finalizers; finalizer; finalizer = finalizer->next ) {
+				finalizer->destroy( finalizer->object );
+			}
+			finalizers = nullptr;
+
+			while ( blocks ) {
+				Block* next = blocks->next;
+				free( blocks );
+				blocks = next;
+			}
+		}
+
+		void* Allocate( size_t size, size_t align = alignof( std::max_align_t ) ) {
+			bytes_allocated += size;
+
+			// large requests get a block of their own, kept behind the current one
+			if ( size > BLOCK_SIZE / 4 ) {
+				Block* block = NewBlock( size );
+				block->used = size;
+				if ( blocks ) {
+					block->next = blocks->next;
+					blocks->next = block;
+				}
+				else {
+					block->next = nullptr;
+					blocks = block;
+				}
+				return reinterpret_cast< char* >( block ) + BlockHeader();
+			}
+
+			size_t offset = 0;
+			if ( blocks ) {
+				offset = ( blocks->used + align - 1 ) & ~( align - 1 );
+			}
+			if ( !blocks || offset + size > blocks->size ) {
+				Block* block = NewBlock( BLOCK_SIZE );
+				block->next = blocks;
+				blocks = block;
+				offset = 0;
+			}
+			blocks->used = offset + size;
+			return reinterpret_cast< char* >( blocks ) + BlockHeader() + offset;
+		}
+
+		template<typename T, typename ...Args>
+		T* Make( Args &&...args ) {
+			void* memory = Allocate( sizeof( T ), alignof( T ) );
+			T* object = new ( memory ) T( std::forward<Args>( args )... );
+			if ( file_name ) {
+				Locate( object, file_name, 0 );
+			}
+			if ( !std::is_trivially_destructible<T>::value ) {
+				Finalizer* finalizer = static_cast< Finalizer* >( Allocate( sizeof( Finalizer ), alignof( Finalizer ) ) );
+				finalizer->destroy = &Destroy<T>;
+				finalizer->object = object;
+				finalizer->next = finalizers;
+				finalizers = finalizer;
+			}
+			return object;
+		}
+
+		size_t BytesAllocated() const {
+			return bytes_allocated;
+		}
+
+		// 'name' outlives the arena's nodes
+		void SetFileName( std::wstring const* name ) {
+			file_name = name;
+		}
+	};
+
+	/****************************
+	 * STL allocator drawing from a
+	 * ParseArena; deallocation is a
+	 * no-op until the arena dies.
+	 ****************************/
+	template<typename T>
+	class ArenaAllocator {
+		template<typename U> friend class ArenaAllocator;
+		ParseArena* arena;
+
+	public:
+		using value_type = T;
+
+		ArenaAllocator( ParseArena &a ) : arena( &a ) {
+		}
+
+		template<typename U>
+		ArenaAllocator( ArenaAllocator<U> const & other ) : arena( other.arena ) {
+		}
+
+		T* allocate( size_t n ) {
+			return static_cast< T* >( arena->Allocate( n * sizeof( T ), alignof( T ) ) );
+		}
+
+		void deallocate( T*, size_t ) {
+		}
+
+		ParseArena& GetArena() const {
+			return *arena;
+		}
+
+		template<typename U>
+		bool operator==( ArenaAllocator<U> const & other ) const {
+			return arena == other.arena;
+		}
+
+		template<typename U>
+		bool operator!=( ArenaAllocator<U> const & other ) const {
+			return arena != other.arena;
+		}
+	};
+}
+
+#endif
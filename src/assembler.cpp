@@ -0,0 +1,396 @@
+/***************************************************************************
+ * x86-64 machine code
+ *
+ * Copyright (c) 2017 Joshua Ogunyinka
+ * All rights reserved.
+*/
+
+#include "assembler.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace runtime;
+
+/****************************
+ * Encoding
+ ****************************/
+void Assembler::Int32( int32_t value )
+{
+	for ( int i = 0; i < 4; ++i ) {
+		Byte( ( static_cast< uint32_t >( value ) >> ( i * 8 ) ) & 0xff );
+	}
+}
+
+void Assembler::Int64( int64_t value )
+{
+	for ( int i = 0; i < 8; ++i ) {
+		Byte( ( static_cast< uint64_t >( value ) >> ( i * 8 ) ) & 0xff );
+	}
+}
+
+// prefix for 64-bit operands and the upper eight registers; 'force' also reaches the low bytes of rsi and rdi
+void Assembler::Rex( bool wide, int reg, int base, bool force )
+{
+	const unsigned rex = 0x40 | ( wide ? 0x8 : 0 ) | ( reg & 0x8 ? 0x4 : 0 ) | ( base & 0x8 ? 0x1 : 0 );
+	if ( rex != 0x40 || force ) {
+		Byte( rex );
+	}
+}
+
+// [base + displacement], always with a 32-bit displacement
+void Assembler::Memory( int reg, Register base, int32_t displacement )
+{
+	Byte( 0x80 | ( ( reg & 0x7 ) << 3 ) | ( base & 0x7 ) );
+	if ( ( base & 0x7 ) == RSP ) {
+		Byte( 0x24 );
+	}
+	Int32( displacement );
+}
+
+// 'opcode' above 0xff is a two byte one
+void Assembler::RegisterOperation( unsigned opcode, int reg, int rm, bool wide )
+{
+	Rex( wide, reg, rm );
+	if ( opcode > 0xff ) {
+		Byte( opcode >> 8 );
+	}
+	Byte( opcode & 0xff );
+	Byte( 0xc0 | ( ( reg & 0x7 ) << 3 ) | ( rm & 0x7 ) );
+}
+
+void Assembler::FloatOperation( unsigned prefix, unsigned opcode, int reg, int rm, bool wide )
+{
+	Byte( prefix );
+	Rex( wide, reg, rm );
+	Byte( 0x0f );
+	Byte( opcode );
+	Byte( 0xc0 | ( ( reg & 0x7 ) << 3 ) | ( rm & 0x7 ) );
+}
+
+void Assembler::FloatMemory( unsigned opcode, FloatRegister reg, Register base, int32_t displacement )
+{
+	Byte( 0xf2 );
+	Rex( false, reg, base );
+	Byte( 0x0f );
+	Byte( opcode );
+	Memory( reg, base, displacement );
+}
+
+/****************************
+ * Frames
+ ****************************/
+void Assembler::Push( Register reg )
+{
+	Rex( false, 0, reg );
+	Byte( 0x50 + ( reg & 0x7 ) );
+}
+
+void Assembler::Pop( Register reg )
+{
+	Rex( false, 0, reg );
+	Byte( 0x58 + ( reg & 0x7 ) );
+}
+
+void Assembler::Return()
+{
+	Byte( 0xc3 );
+}
+
+/****************************
+ * Moves
+ ****************************/
+void Assembler::Move( Register to, Register from )
+{
+	RegisterOperation( 0x89, from, to, true );
+}
+
+void Assembler::MoveImmediate( Register to, int64_t value, bool wide )
+{
+	if ( value >= INT32_MIN && value <= INT32_MAX ) {
+		Rex( wide, 0, to );
+		Byte( 0xc7 );
+		Byte( 0xc0 | ( to & 0x7 ) );
+		Int32( static_cast< int32_t >( value ) );
+	}
+	else {
+		Rex( true, 0, to );
+		Byte( 0xb8 + ( to & 0x7 ) );
+		Int64( value );
+	}
+}
+
+void Assembler::Load( Register to, Register base, int32_t displacement, bool wide )
+{
+	Rex( wide, to, base );
+	Byte( 0x8b );
+	Memory( to, base, displacement );
+}
+
+void Assembler::Store( Register base, int32_t displacement, Register from, bool wide )
+{
+	Rex( wide, from, base );
+	Byte( 0x89 );
+	Memory( from, base, displacement );
+}
+
+// a 64-bit store sign-extends the value
+void Assembler::StoreImmediate( Register base, int32_t displacement, int32_t value, bool wide )
+{
+	Rex( wide, 0, base );
+	Byte( 0xc7 );
+	Memory( 0, base, displacement );
+	Int32( value );
+}
+
+// 'to' is base + displacement; flags are left as they are
+void Assembler::LoadAddress( Register to, Register base, int32_t displacement )
+{
+	Rex( true, to, base );
+	Byte( 0x8d );
+	Memory( to, base, displacement );
+}
+
+/****************************
+ * Integers
+ ****************************/
+void Assembler::Add( Register to, Register from, bool wide )
+{
+	RegisterOperation( 0x01, from, to, wide );
+}
+
+void Assembler::Subtract( Register to, Register from, bool wide )
+{
+	RegisterOperation( 0x29, from, to, wide );
+}
+
+void Assembler::Multiply( Register to, Register from, bool wide )
+{
+	RegisterOperation( 0x0faf, to, from, wide );
+}
+
+void Assembler::ShiftLeft( Register reg, int bits, bool wide )
+{
+	RegisterOperation( 0xc1, 4, reg, wide );
+	Byte( bits );
+}
+
+void Assembler::AddImmediate( Register base, int32_t displacement, int32_t value, bool wide )
+{
+	Rex( wide, 0, base );
+	Byte( 0x81 );
+	Memory( 0, base, displacement );
+	Int32( value );
+}
+
+// flags of 'left - right'
+void Assembler::Compare( Register left, Register right, bool wide )
+{
+	RegisterOperation( 0x39, right, left, wide );
+}
+
+// a 32-bit field, such as a value's type
+void Assembler::CompareImmediate( Register base, int32_t displacement, int32_t value )
+{
+	Rex( false, 0, base );
+	Byte( 0x81 );
+	Memory( 7, base, displacement );
+	Int32( value );
+}
+
+void Assembler::Test( Register left, Register right, bool wide )
+{
+	RegisterOperation( 0x85, right, left, wide );
+}
+
+// 'to' is 1 if the condition holds, else 0
+void Assembler::SetCondition( Condition condition, Register to )
+{
+	Rex( false, 0, to, true );
+	Byte( 0x0f );
+	Byte( 0x90 + condition );
+	Byte( 0xc0 | ( to & 0x7 ) );
+
+	Rex( false, to, to, true );
+	Byte( 0x0f );
+	Byte( 0xb6 );
+	Byte( 0xc0 | ( ( to & 0x7 ) << 3 ) | ( to & 0x7 ) );
+}
+
+/****************************
+ * Floats
+ ****************************/
+void Assembler::LoadFloat( FloatRegister to, Register base, int32_t displacement )
+{
+	FloatMemory( 0x10, to, base, displacement );
+}
+
+void Assembler::StoreFloat( Register base, int32_t displacement, FloatRegister from )
+{
+	FloatMemory( 0x11, from, base, displacement );
+}
+
+void Assembler::MoveFloat( FloatRegister to, FloatRegister from )
+{
+	FloatOperation( 0xf2, 0x10, to, from );
+}
+
+// the bits of 'from'
+void Assembler::MoveToFloat( FloatRegister to, Register from )
+{
+	FloatOperation( 0x66, 0x6e, to, from, true );
+}
+
+void Assembler::ConvertToFloat( FloatRegister to, Register from, bool wide )
+{
+	FloatOperation( 0xf2, 0x2a, to, from, wide );
+}
+
+void Assembler::AddFloat( FloatRegister to, FloatRegister from )
+{
+	FloatOperation( 0xf2, 0x58, to, from );
+}
+
+void Assembler::SubtractFloat( FloatRegister to, FloatRegister from )
+{
+	FloatOperation( 0xf2, 0x5c, to, from );
+}
+
+void Assembler::MultiplyFloat( FloatRegister to, FloatRegister from )
+{
+	FloatOperation( 0xf2, 0x59, to, from );
+}
+
+void Assembler::DivideFloat( FloatRegister to, FloatRegister from )
+{
+	FloatOperation( 0xf2, 0x5e, to, from );
+}
+
+// unsigned conditions: 'left' above 'right' and so on; unordered sets the carry
+void Assembler::CompareFloat( FloatRegister left, FloatRegister right )
+{
+	FloatOperation( 0x66, 0x2e, left, right );
+}
+
+/****************************
+ * Jumps
+ ****************************/
+size_t Assembler::Jump()
+{
+	Byte( 0xe9 );
+	const size_t jump = code.size();
+	Int32( 0 );
+	return jump;
+}
+
+size_t Assembler::JumpIf( Condition condition )
+{
+	Byte( 0x0f );
+	Byte( 0x80 + condition );
+	const size_t jump = code.size();
+	Int32( 0 );
+	return jump;
+}
+
+void Assembler::JumpTo( size_t target )
+{
+	Patch( Jump(), target );
+}
+
+void Assembler::JumpIfTo( Condition condition, size_t target )
+{
+	Patch( JumpIf( condition ), target );
+}
+
+// to the address at [table + index * 8]; 'table' may not be rbp or r13
+void Assembler::JumpIndirect( Register table, Register index )
+{
+	const unsigned rex = 0x40 | ( index & 0x8 ? 0x2 : 0 ) | ( table & 0x8 ? 0x1 : 0 );
+	if ( rex != 0x40 ) {
+		Byte( rex );
+	}
+	Byte( 0xff );
+	Byte( 0x24 );
+	Byte( 0xc0 | ( ( index & 0x7 ) << 3 ) | ( table & 0x7 ) );
+}
+
+void Assembler::Call( Register target )
+{
+	Rex( false, 0, target );
+	Byte( 0xff );
+	Byte( 0xd0 | ( target & 0x7 ) );
+}
+
+// offsets are from the end of the jump
+void Assembler::Patch( size_t jump, size_t target )
+{
+	Fill( jump, static_cast< int32_t >( static_cast< int64_t >( target ) - static_cast< int64_t >( jump + 4 ) ) );
+}
+
+// a 32-bit value written earlier, such as a displacement, known only now
+void Assembler::Fill( size_t position, int32_t value )
+{
+	for ( int i = 0; i < 4; ++i ) {
+		code[ position + i ] = static_cast< unsigned char >( ( static_cast< uint32_t >( value ) >> ( i * 8 ) ) & 0xff );
+	}
+}
+
+/****************************
+ * Memory that runs: written,
+ * then made read-only
+ ****************************/
+void* Assembler::Finish( size_t &size )
+{
+	if ( !IsAvailable() || code.empty() ) {
+		return nullptr;
+	}
+
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo( &info );
+	const size_t page = info.dwPageSize;
+#else
+	const size_t page = static_cast< size_t >( sysconf( _SC_PAGESIZE ) );
+#endif
+	size = ( code.size() + page - 1 ) / page * page;
+
+#ifdef _WIN32
+	void* memory = VirtualAlloc( NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE );
+	if ( !memory ) {
+		return nullptr;
+	}
+	memcpy( memory, code.data(), code.size() );
+	DWORD protection;
+	if ( !VirtualProtect( memory, size, PAGE_EXECUTE_READ, &protection ) ) {
+		VirtualFree( memory, 0, MEM_RELEASE );
+		return nullptr;
+	}
+#else
+	void* memory = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0 );
+	if ( memory == MAP_FAILED ) {
+		return nullptr;
+	}
+	memcpy( memory, code.data(), code.size() );
+	if ( mprotect( memory, size, PROT_READ | PROT_EXEC ) ) {
+		munmap( memory, size );
+		return nullptr;
+	}
+#endif
+
+	return memory;
+}
+
+void Assembler::Release( void* memory, size_t size )
+{
+	if ( !memory ) {
+		return;
+	}
+
+#ifdef _WIN32
+	VirtualFree( memory, 0, MEM_RELEASE );
+#else
+	munmap( memory, size );
+#endif
+}
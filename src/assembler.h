@@ -0,0 +1,128 @@
+/***************************************************************************
+ * x86-64 machine code
+ *
+ * Copyright (c) 2017 Joshua Ogunyinka
+ * All rights reserved.
+*/
+
+#ifndef __ASSEMBLER_H__
+#define __ASSEMBLER_H__
+
+#include <cstdint>
+#include "common.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define _X64
+#endif
+
+namespace runtime {
+	enum Register {
+		RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+		R8, R9, R10, R11, R12, R13, R14, R15
+	};
+
+	enum FloatRegister {
+		XMM0, XMM1, XMM2, XMM3, XMM4, XMM5, XMM6, XMM7
+	};
+
+	// condition codes; one's negation differs only in the lowest bit
+	enum Condition {
+		CC_B = 0x2, CC_AE, CC_E, CC_NE, CC_BE, CC_A,
+		CC_L = 0xc, CC_GE, CC_LE, CC_G
+	};
+
+	inline Condition Negate( Condition condition ) {
+		return static_cast< Condition >( condition ^ 1 );
+	}
+
+	/****************************
+	 * Emits the instructions compiled
+	 * code is made of into a buffer,
+	 * then copies it to memory that
+	 * may run. Operands in memory are
+	 * [base + displacement]; integer
+	 * operations are 64 bits wide only
+	 * when asked to be, pointers always
+	 ****************************/
+	class Assembler {
+		std::vector<unsigned char> code;
+
+		void Byte( unsigned value ) {
+			code.push_back( static_cast< unsigned char >( value ) );
+		}
+
+		void Int32( int32_t value );
+		void Int64( int64_t value );
+		void Rex( bool wide, int reg, int base, bool force = false );
+		void Memory( int reg, Register base, int32_t displacement );
+		void RegisterOperation( unsigned opcode, int reg, int rm, bool wide );
+		void FloatOperation( unsigned prefix, unsigned opcode, int reg, int rm, bool wide = false );
+		void FloatMemory( unsigned opcode, FloatRegister reg, Register base, int32_t displacement );
+
+	public:
+		// compiled code runs only on x86-64
+		static bool IsAvailable() {
+#ifdef _X64
+			return true;
+#else
+			return false;
+#endif
+		}
+
+		size_t Position() {
+			return code.size();
+		}
+
+		// frames
+		void Push( Register reg );
+		void Pop( Register reg );
+		void Return();
+
+		// moves
+		void Move( Register to, Register from );
+		void MoveImmediate( Register to, int64_t value, bool wide );
+		void Load( Register to, Register base, int32_t displacement, bool wide );
+		void Store( Register base, int32_t displacement, Register from, bool wide );
+		void StoreImmediate( Register base, int32_t displacement, int32_t value, bool wide );
+		void LoadAddress( Register to, Register base, int32_t displacement );
+
+		// integers
+		void Add( Register to, Register from, bool wide );
+		void Subtract( Register to, Register from, bool wide );
+		void Multiply( Register to, Register from, bool wide );
+		void ShiftLeft( Register reg, int bits, bool wide );
+		void AddImmediate( Register base, int32_t displacement, int32_t value, bool wide );
+		void Compare( Register left, Register right, bool wide );
+		void CompareImmediate( Register base, int32_t displacement, int32_t value );
+		void Test( Register left, Register right, bool wide );
+		void SetCondition( Condition condition, Register to );
+
+		// floats
+		void LoadFloat( FloatRegister to, Register base, int32_t displacement );
+		void StoreFloat( Register base, int32_t displacement, FloatRegister from );
+		void MoveFloat( FloatRegister to, FloatRegister from );
+		void MoveToFloat( FloatRegister to, Register from );
+		void ConvertToFloat( FloatRegister to, Register from, bool wide );
+		void AddFloat( FloatRegister to, FloatRegister from );
+		void SubtractFloat( FloatRegister to, FloatRegister from );
+		void MultiplyFloat( FloatRegister to, FloatRegister from );
+		void DivideFloat( FloatRegister to, FloatRegister from );
+		void CompareFloat( FloatRegister left, FloatRegister right );
+
+		// jumps; a forward one is patched once its target is known
+		size_t Jump();
+		size_t JumpIf( Condition condition );
+		void JumpTo( size_t target );
+		void JumpIfTo( Condition condition, size_t target );
+		void JumpIndirect( Register table, Register index );
+		void Call( Register target );
+		void Patch( size_t jump, size_t target );
+		void Fill( size_t position, int32_t value );
+
+		// copies the code to memory that may run it; null if it can't
+		void* Finish( size_t &size );
+		static void Release( void* memory, size_t size );
+	};
+}
+
+#endif
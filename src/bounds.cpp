@@ -0,0 +1,570 @@
+/***************************************************************************
+ * Bounds check elimination
+ *
+ * Copyright (c) 2017 Joshua Ogunyinka
+ * All rights reserved.
+*/
+
+#include <limits.h>
+#include "bounds.h"
+#include "types.hpp"
+
+using namespace compiler;
+
+/****************************
+ * The first walk finds the counters
+ * of the whole program, as any code
+ * may store to the program's; the
+ * second marks the loops
+ ****************************/
+bool BoundsAnalysis::Visit( ParsedProgram* program )
+{
+	pass = Pass::COUNT;
+	WalkScope( program->GetGlobalScope() );
+
+	pass = Pass::MARK;
+	WalkScope( program->GetGlobalScope() );
+	return true;
+}
+
+void BoundsAnalysis::Walk( Statement* statement )
+{
+	if ( statement ) {
+		Dispatch( statement );
+	}
+}
+
+void BoundsAnalysis::Walk( Expression* expression )
+{
+	if ( expression ) {
+		Dispatch( expression );
+	}
+}
+
+void BoundsAnalysis::WalkScope( Scope* scope )
+{
+	if ( pass == Pass::MARK && in_function ) {
+		for ( auto &symbol : scope->GetSymbols() ) {
+			if ( symbol.second->GetStatementType() == StatementType::VARIABLE_DECL_STMT ) {
+				locals.insert( symbol.second );
+			}
+		}
+	}
+	for ( Statement* statement : scope->GetStatements() ) {
+		Walk( statement );
+	}
+}
+
+/****************************
+ * Parameters hold whatever they are
+ * passed. The elements of a closure
+ * or nested function are read when
+ * it is called, not where it is made
+ ****************************/
+void BoundsAnalysis::WalkFunction( ExpressionList* parameters, Scope* scope )
+{
+	if ( pass == Pass::COUNT && parameters ) {
+		for ( Expression* parameter : parameters->GetExpressions() ) {
+			if ( Variable* variable = NodeCast<Variable>( parameter ) ) {
+				non_counters.insert( variable->GetDeclaration() );
+			}
+		}
+	}
+
+	if ( pass != Pass::MARK ) {
+		++function_depth;
+		WalkScope( scope );
+		--function_depth;
+		return;
+	}
+
+	std::unordered_set<Declaration*> saved_locals;
+	saved_locals.swap( locals );
+	const bool saved_in_function = in_function;
+	in_function = true;
+	WalkScope( scope );
+	locals.swap( saved_locals );
+	in_function = saved_in_function;
+}
+
+template<typename Node>
+BoundsAnalysis::Effects BoundsAnalysis::Scan( Node* node )
+{
+	const Pass saved_pass = pass;
+	const int saved_depth = function_depth;
+	Effects saved_effects{ {}, {}, {}, false };
+	std::swap( effects, saved_effects );
+
+	pass = Pass::SCAN;
+	function_depth = 0;
+	Walk( node );
+
+	pass = saved_pass;
+	function_depth = saved_depth;
+	std::swap( effects, saved_effects );
+	return saved_effects;
+}
+
+// a store to an object may be to a field or static variable, as if by a call
+void BoundsAnalysis::Store( Expression* target, bool keeps_counter )
+{
+	Variable* variable = NodeCast<Variable>( target );
+	if ( !variable ) {
+		if ( NodeCast<DotExpression>( target ) ) {
+			effects.calls = true;
+		}
+		return;
+	}
+
+	Declaration* decl = variable->GetDeclaration();
+	switch ( pass ) {
+	case Pass::COUNT:
+		if ( !decl ) {
+			unresolved_stores.insert( variable->GetName() );
+		}
+		else if ( keeps_counter ) {
+			counters.insert( decl );
+		}
+		else {
+			non_counters.insert( decl );
+		}
+		break;
+
+	case Pass::SCAN:
+		if ( !decl ) {
+			effects.unresolved_stores.insert( variable->GetName() );
+		}
+		else {
+			effects.stores.insert( decl );
+		}
+		break;
+
+	default:
+		break;
+	}
+}
+
+// an operation type inference couldn't type may be an object's operator
+void BoundsAnalysis::MayCall( Expression* expression )
+{
+	if ( !expression->type ) {
+		effects.calls = true;
+	}
+}
+
+/****************************
+ * Picks the first condition that
+ * bounds a counter by the size of
+ * an array, and marks the elements
+ * at the counter the test is still
+ * good for
+ ****************************/
+void BoundsAnalysis::MarkLoop( WhileStatement* statement )
+{
+	std::vector<Expression*> conditions;
+	Conditions( statement->GetExpression(), conditions );
+
+	for ( size_t bound = 0; bound < conditions.size(); ++bound ) {
+		Variable* index;
+		Variable* array;
+		if ( !IsBound( conditions[ bound ], index, array ) || !IsCounter( index->GetDeclaration() ) ) {
+			continue;
+		}
+		const bool is_own = locals.count( index->GetDeclaration() ) && locals.count( array->GetDeclaration() );
+
+		// the conditions after the bound are tested before the body
+		bool is_kept = true;
+		for ( size_t i = bound + 1; i < conditions.size() && is_kept; ++i ) {
+			const Effects condition = Scan( conditions[ i ] );
+			is_kept = !Changes( condition, index ) && !Changes( condition, array ) && ( is_own || !condition.calls );
+		}
+		if ( !is_kept ) {
+			continue;
+		}
+
+		for ( Statement* body_statement : Body( statement ) ) {
+			const Effects step = Scan( body_statement );
+			if ( Changes( step, index ) || Changes( step, array ) || ( !is_own && step.calls ) ) {
+				break;
+			}
+			for ( SubscriptExpression* element : step.elements ) {
+				Variable* element_array = static_cast< Variable* >( element->GetExpression() );
+				Variable* element_index = static_cast< Variable* >( element->GetIndex() );
+				if ( element_array->GetDeclaration() == array->GetDeclaration()
+					&& element_index->GetDeclaration() == index->GetDeclaration() ) {
+					element->in_bounds = true;
+				}
+			}
+		}
+		return;
+	}
+}
+
+bool BoundsAnalysis::IsCounter( Declaration* decl )
+{
+	return decl && counters.count( decl ) && !non_counters.count( decl )
+		&& !unresolved_stores.count( static_cast< VariableDeclaration* >( decl )->GetName() );
+}
+
+bool BoundsAnalysis::Changes( Effects const &effects, Variable* variable )
+{
+	return effects.stores.count( variable->GetDeclaration() ) || effects.unresolved_stores.count( variable->GetName() );
+}
+
+// small enough that adding it to an index below the size of an array can't overflow
+bool BoundsAnalysis::IsCount( Expression* value, bool is_increase )
+{
+	IntegerLiteral* literal = NodeCast<IntegerLiteral>( value );
+	return literal && literal->GetValue() >= 0 && ( !is_increase || literal->GetValue() <= INT_MAX );
+}
+
+// the operands of '&&', in the order they are tested
+void BoundsAnalysis::Conditions( Expression* expression, std::vector<Expression*> &conditions )
+{
+	BinaryExpression* binary = NodeCast<BinaryExpression>( expression );
+	if ( binary && binary->GetToken().GetType() == ScannerTokenType::TOKEN_LAND ) {
+		Conditions( binary->GetLHSExpression(), conditions );
+		Conditions( binary->GetRHSExpression(), conditions );
+	}
+	else {
+		conditions.push_back( expression );
+	}
+}
+
+std::vector<Statement*> BoundsAnalysis::Body( WhileStatement* statement )
+{
+	std::vector<Statement*> body;
+	if ( CompoundStatement* block = NodeCast<CompoundStatement>( statement->GetStatement() ) ) {
+		for ( Statement* block_statement : block->GetStatementList() ) {
+			body.push_back( block_statement );
+		}
+	}
+	else if ( statement->GetStatement() ) {
+		body.push_back( statement->GetStatement() );
+	}
+	return body;
+}
+
+// 'index < array.size()' or 'array.size() > index'
+bool BoundsAnalysis::IsBound( Expression* condition, Variable* &index, Variable* &array )
+{
+	BinaryExpression* compare = NodeCast<BinaryExpression>( condition );
+	if ( !compare ) {
+		return false;
+	}
+
+	Expression* size;
+	switch ( compare->GetToken().GetType() ) {
+	case ScannerTokenType::TOKEN_LES:
+		index = NodeCast<Variable>( compare->GetLHSExpression() );
+		size = compare->GetRHSExpression();
+		break;
+
+	case ScannerTokenType::TOKEN_GTR:
+		index = NodeCast<Variable>( compare->GetRHSExpression() );
+		size = compare->GetLHSExpression();
+		break;
+
+	default:
+		return false;
+	}
+
+	FunctionCall* call = NodeCast<FunctionCall>( size );
+	DotExpression* method = call ? NodeCast<DotExpression>( call->GetFunctionExpression() ) : nullptr;
+	if ( !method || method->GetIdentifier() != L"size" || ( call->GetArgumentList() && call->GetArgumentList()->Length() ) ) {
+		return false;
+	}
+	array = NodeCast<Variable>( method->GetExpression() );
+	return index && array && array->GetDeclaration()
+		&& array->GetDeclaration()->GetStatementType() == StatementType::VARIABLE_DECL_STMT;
+}
+
+/****************************
+ * Statements
+ ****************************/
+void BoundsAnalysis::VisitExpressionStatement( ExpressionStatement* statement )
+{
+	Walk( statement->GetExpression() );
+}
+
+void BoundsAnalysis::VisitDumpStatement( DumpStatement* statement )
+{
+	Walk( statement->GetExpression() );
+}
+
+void BoundsAnalysis::VisitReturnStatement( ReturnStatement* statement )
+{
+	Walk( statement->GetExpression() );
+}
+
+void BoundsAnalysis::VisitCompoundStatement( CompoundStatement* statement )
+{
+	WalkScope( statement->GetScope() );
+}
+
+void BoundsAnalysis::VisitIfStatement( IfStatement* statement )
+{
+	Walk( statement->GetExpression() );
+	Walk( statement->GetIfBlock() );
+	Walk( statement->GetElseBlock() );
+}
+
+void BoundsAnalysis::VisitWhileStatement( WhileStatement* statement )
+{
+	if ( pass == Pass::MARK ) {
+		MarkLoop( statement );
+	}
+	Walk( statement->GetExpression() );
+	Walk( statement->GetStatement() );
+}
+
+void BoundsAnalysis::VisitDoWhileStatement( DoWhileStatement* statement )
+{
+	Walk( statement->GetStatement() );
+	Walk( statement->GetExpression() );
+}
+
+void BoundsAnalysis::VisitLoopStatement( LoopStatement* statement )
+{
+	VisitCompoundStatement( statement->GetLoopBody() );
+}
+
+void BoundsAnalysis::VisitForEachStatement( ForEachStatement* statement )
+{
+	if ( BinaryExpression* in_expression = NodeCast<BinaryExpression>( statement->GetExpression() ) ) {
+		Walk( in_expression->GetRHSExpression() );
+	}
+	if ( statement->decl ) {
+		if ( pass == Pass::COUNT ) {
+			non_counters.insert( statement->decl );
+		}
+		else if ( pass == Pass::SCAN ) {
+			effects.stores.insert( statement->decl );
+		}
+		else if ( pass == Pass::MARK && in_function ) {
+			locals.insert( statement->decl );
+		}
+	}
+	Walk( statement->GetStatement() );
+}
+
+void BoundsAnalysis::VisitSwitchStatement( SwitchStatement* statement )
+{
+	Walk( statement->GetExpression() );
+	Walk( statement->GetSwitchBlock() );
+}
+
+void BoundsAnalysis::VisitCaseStatement( CaseStatement* statement )
+{
+	Walk( statement->GetExpression() );
+	Walk( statement->GetStatement() );
+}
+
+void BoundsAnalysis::VisitLabelledStatement( LabelledStatement* statement )
+{
+	Walk( statement->GetStatement() );
+}
+
+/****************************
+ * Declarations
+ ****************************/
+void BoundsAnalysis::VisitDeclarationList( DeclarationList* decl_list )
+{
+	for ( auto &list_decl : decl_list->GetDeclarations() ) {
+		Walk( list_decl.second );
+	}
+}
+
+// a variable without an initializer is set to nil
+void BoundsAnalysis::VisitVariableDeclaration( VariableDeclaration* decl )
+{
+	Walk( decl->GetExpression() );
+	if ( pass == Pass::COUNT ) {
+		if ( IsCount( decl->GetExpression(), false ) ) {
+			counters.insert( decl );
+		}
+		else {
+			non_counters.insert( decl );
+		}
+	}
+	else if ( pass == Pass::SCAN ) {
+		effects.stores.insert( decl );
+	}
+}
+
+void BoundsAnalysis::VisitFunctionDeclaration( FunctionDeclaration* decl )
+{
+	if ( decl->GetFunctionBody() ) {
+		WalkFunction( decl->GetParameters(), decl->GetFunctionBody()->GetScope() );
+	}
+}
+
+// any object's fields may be stored to from outside
+void BoundsAnalysis::VisitClassDeclaration( ClassDeclaration* decl )
+{
+	for ( Declaration* member : decl->GetDeclList() ) {
+		if ( pass == Pass::COUNT ) {
+			if ( member->GetStatementType() == StatementType::VARIABLE_DECL_STMT ) {
+				non_counters.insert( member );
+			}
+			else if ( DeclarationList* decl_list = NodeCast<DeclarationList>( static_cast< Statement* >( member ) ) ) {
+				for ( auto &list_decl : decl_list->GetDeclarations() ) {
+					non_counters.insert( list_decl.second );
+				}
+			}
+		}
+		Walk( member );
+	}
+}
+
+/****************************
+ * Expressions
+ ****************************/
+void BoundsAnalysis::VisitBinaryExpression( BinaryExpression* expression )
+{
+	Walk( expression->GetLHSExpression() );
+	Walk( expression->GetRHSExpression() );
+
+	const ScannerTokenType operation = expression->GetToken().GetType();
+	if ( operation != ScannerTokenType::TOKEN_LAND && operation != ScannerTokenType::TOKEN_LOR ) {
+		MayCall( expression );
+	}
+}
+
+void BoundsAnalysis::VisitAssignmentExpression( AssignmentExpression* expression )
+{
+	Expression* target = expression->GetLHSExpression();
+	Expression* value = expression->GetRHSExpression();
+	if ( !NodeCast<Variable>( target ) ) {
+		Walk( target );
+	}
+	Walk( value );
+
+	switch ( expression->GetAssignmentType() ) {
+	case ScannerTokenType::TOKEN_ASSIGN:
+		Store( target, IsCount( value, false ) );
+		break;
+
+	case ScannerTokenType::TOKEN_ADD_EQL:
+		Store( target, IsCount( value, true ) );
+		MayCall( expression );
+		break;
+
+	default:
+		Store( target, false );
+		MayCall( expression );
+		break;
+	}
+}
+
+void BoundsAnalysis::VisitUnaryOperation( UnaryOperation* expression )
+{
+	Walk( expression->GetExpression() );
+	if ( expression->OperationType() != ScannerTokenType::TOKEN_NOT ) {
+		MayCall( expression );
+	}
+}
+
+void BoundsAnalysis::VisitConditionalExpression( ConditionalExpression* expression )
+{
+	Walk( expression->GetConditionalExpression() );
+	Walk( expression->GetLhsExpression() );
+	Walk( expression->GetRhsExpression() );
+}
+
+void BoundsAnalysis::VisitFunctionCall( FunctionCall* expression )
+{
+	if ( ExpressionList* arguments = expression->GetArgumentList() ) {
+		for ( Expression* argument : arguments->GetExpressions() ) {
+			Walk( argument );
+		}
+	}
+	Walk( expression->GetFunctionExpression() );
+	MayCall( expression );
+}
+
+void BoundsAnalysis::VisitSubscriptExpression( SubscriptExpression* expression )
+{
+	Walk( expression->GetExpression() );
+	Walk( expression->GetIndex() );
+	if ( pass == Pass::SCAN && !function_depth && NodeCast<Variable>( expression->GetExpression() )
+		&& NodeCast<Variable>( expression->GetIndex() ) ) {
+		effects.elements.push_back( expression );
+	}
+}
+
+void BoundsAnalysis::VisitDotExpression( DotExpression* expression )
+{
+	Walk( expression->GetExpression() );
+}
+
+// only a number is sure to be changed without a call
+void BoundsAnalysis::VisitPreIncrExpression( PreIncrExpression* expression )
+{
+	if ( !NodeCast<Variable>( expression->GetExpression() ) ) {
+		Walk( expression->GetExpression() );
+	}
+	Store( expression->GetExpression(), true );
+	MayCall( expression );
+}
+
+void BoundsAnalysis::VisitPreDecrExpression( PreDecrExpression* expression )
+{
+	if ( !NodeCast<Variable>( expression->GetExpression() ) ) {
+		Walk( expression->GetExpression() );
+	}
+	Store( expression->GetExpression(), false );
+	MayCall( expression );
+}
+
+void BoundsAnalysis::VisitPostIncrExpression( PostIncrExpression* expression )
+{
+	if ( !NodeCast<Variable>( expression->GetExpression() ) ) {
+		Walk( expression->GetExpression() );
+	}
+	Store( expression->GetExpression(), true );
+	if ( !expression->type || !expression->type->IsNumeric() ) {
+		effects.calls = true;
+	}
+}
+
+void BoundsAnalysis::VisitPostDecrExpression( PostDecrExpression* expression )
+{
+	if ( !NodeCast<Variable>( expression->GetExpression() ) ) {
+		Walk( expression->GetExpression() );
+	}
+	Store( expression->GetExpression(), false );
+	if ( !expression->type || !expression->type->IsNumeric() ) {
+		effects.calls = true;
+	}
+}
+
+void BoundsAnalysis::VisitLambdaExpression( LambdaExpression* expression )
+{
+	if ( CompoundStatement* body = NodeCast<CompoundStatement>( expression->GetLambdaBody() ) ) {
+		WalkFunction( expression->GetParamaters(), body->GetScope() );
+	}
+}
+
+void BoundsAnalysis::VisitListExpression( ListExpression* expression )
+{
+	if ( ExpressionList* elements = expression->GetExpressionList() ) {
+		for ( Expression* element : elements->GetExpressions() ) {
+			Walk( element );
+		}
+	}
+}
+
+void BoundsAnalysis::VisitMapExpression( MapExpression* expression )
+{
+	for ( auto &pair : *expression ) {
+		Walk( pair.first );
+		Walk( pair.second );
+	}
+}
+
+void BoundsAnalysis::VisitNewExpression( NewExpression* expression )
+{
+	Walk( expression->GetExpression() );
+	effects.calls = true;
+}
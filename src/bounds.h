@@ -0,0 +1,135 @@
+/***************************************************************************
+ * Bounds check elimination
+ *
+ * Copyright (c) 2017 Joshua Ogunyinka
+ * All rights reserved.
+*/
+
+#ifndef __BOUNDS_H__
+#define __BOUNDS_H__
+
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "common.h"
+#include "visitor.h"
+
+/****************************
+ * Marks the elements a 'while'
+ * reads or stores at an index its
+ * condition keeps below the size of
+ * the array:
+ *
+ *   while ( i < a.size() ) { ... a[ i ] ... i++; }
+ *
+ * The index must be a counter, a
+ * variable only ever set to a
+ * literal that isn't negative,
+ * incremented or increased by one,
+ * so it is always a whole number no
+ * less than zero. Elements are
+ * marked in the body up to the first
+ * statement that stores to the
+ * counter or to the array, and not
+ * at all if the rest of the
+ * condition does. Called code may
+ * change the program's variables
+ * but not a function's own, so
+ * unless both are the function's
+ * own those statements must not
+ * call anything either. Runs after
+ * type inference, which tells the
+ * operators that may call
+ ****************************/
+
+namespace compiler {
+	class BoundsAnalysis : public TreeVisitor<BoundsAnalysis>
+	{
+		friend class TreeVisitor<BoundsAnalysis>;
+
+		enum class Pass {
+			COUNT,		// finding the counters in the whole program
+			SCAN,		// what a piece of code may do
+			MARK		// the loops, with the function's own variables known
+		};
+
+		struct Effects {
+			std::unordered_set<Declaration*> stores;
+			std::unordered_set<std::wstring> unresolved_stores;		// names resolved only when emitted
+			std::vector<SubscriptExpression*> elements;				// 'array[ index ]', both variables
+			bool calls;
+		};
+
+		Pass pass;
+		std::unordered_set<Declaration*> counters;
+		std::unordered_set<Declaration*> non_counters;
+		std::unordered_set<std::wstring> unresolved_stores;
+		std::unordered_set<Declaration*> locals;
+		bool in_function;
+		Effects effects;
+		int function_depth;											// of the code being scanned
+
+		void Walk( Statement* statement );
+		void Walk( Expression* expression );
+		void WalkScope( Scope* scope );
+		void WalkFunction( ExpressionList* parameters, Scope* scope );
+		template<typename Node>
+		Effects Scan( Node* node );
+		void Store( Expression* target, bool keeps_counter );
+		void MayCall( Expression* expression );
+		void MarkLoop( WhileStatement* statement );
+
+		bool IsCounter( Declaration* decl );
+		static bool Changes( Effects const &effects, Variable* variable );
+		static bool IsCount( Expression* value, bool is_increase );
+		static void Conditions( Expression* expression, std::vector<Expression*> &conditions );
+		static std::vector<Statement*> Body( WhileStatement* statement );
+		static bool IsBound( Expression* condition, Variable* &index, Variable* &array );
+
+		// statements
+		void VisitExpressionStatement( ExpressionStatement* statement );
+		void VisitDumpStatement( DumpStatement* statement );
+		void VisitReturnStatement( ReturnStatement* statement );
+		void VisitCompoundStatement( CompoundStatement* statement );
+		void VisitIfStatement( IfStatement* statement );
+		void VisitWhileStatement( WhileStatement* statement );
+		void VisitDoWhileStatement( DoWhileStatement* statement );
+		void VisitLoopStatement( LoopStatement* statement );
+		void VisitForEachStatement( ForEachStatement* statement );
+		void VisitSwitchStatement( SwitchStatement* statement );
+		void VisitCaseStatement( CaseStatement* statement );
+		void VisitLabelledStatement( LabelledStatement* statement );
+
+		// declarations
+		void VisitDeclarationList( DeclarationList* decl_list );
+		void VisitVariableDeclaration( VariableDeclaration* decl );
+		void VisitFunctionDeclaration( FunctionDeclaration* decl );
+		void VisitClassDeclaration( ClassDeclaration* decl );
+
+		// expressions
+		void VisitBinaryExpression( BinaryExpression* expression );
+		void VisitAssignmentExpression( AssignmentExpression* expression );
+		void VisitUnaryOperation( UnaryOperation* expression );
+		void VisitConditionalExpression( ConditionalExpression* expression );
+		void VisitFunctionCall( FunctionCall* expression );
+		void VisitSubscriptExpression( SubscriptExpression* expression );
+		void VisitDotExpression( DotExpression* expression );
+		void VisitPreIncrExpression( PreIncrExpression* expression );
+		void VisitPreDecrExpression( PreDecrExpression* expression );
+		void VisitPostIncrExpression( PostIncrExpression* expression );
+		void VisitPostDecrExpression( PostDecrExpression* expression );
+		void VisitLambdaExpression( LambdaExpression* expression );
+		void VisitListExpression( ListExpression* expression );
+		void VisitMapExpression( MapExpression* expression );
+		void VisitNewExpression( NewExpression* expression );
+
+	public:
+		BoundsAnalysis() : pass( Pass::COUNT ), in_function( false ), effects{ {}, {}, {}, false }, function_depth( 0 ) {
+		}
+
+		bool Visit( ParsedProgram* program );
+	};
+}
+
+#endif
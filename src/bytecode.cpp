@@ -0,0 +1,754 @@
+/***************************************************************************
+ * Bytecode files
+ *
+ * Copyright (c) 2017 Joshua Ogunyinka
+ * All rights reserved.
+*/
+
+#include "bytecode.h"
+#include "emitter.h"
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace compiler;
+
+static const char MAGIC[] = { 'S', 'U', 'B', 'C' };
+
+// the compiler that wrote a cached program; a rebuilt one may emit different code for the same sources
+static const char BUILD[] = __DATE__ " " __TIME__;
+
+// more locals or fields than any function or class is compiled with; frames and instances are allocated at their size
+static const int MAX_LOCALS = 1 << 20;
+
+// FNV-1a, 64 bits
+static const uint64_t HASH_BASIS = 14695981039346656037ULL;
+static const uint64_t HASH_PRIME = 1099511628211ULL;
+
+static uint64_t Hash( uint64_t hash, const unsigned char* bytes, size_t size )
+{
+	for ( size_t i = 0; i < size; ++i ) {
+		hash = ( hash ^ bytes[ i ] ) * HASH_PRIME;
+	}
+
+	return hash;
+}
+
+static uint64_t Hash( uint64_t hash, uint64_t value )
+{
+	for ( int i = 0; i < 8; ++i ) {
+		hash = ( hash ^ ( ( value >> ( i * 8 ) ) & 0xff ) ) * HASH_PRIME;
+	}
+
+	return hash;
+}
+
+/****************************
+ * Writing
+ ****************************/
+void BytecodeWriter::Int32( int32_t value )
+{
+	for ( int i = 0; i < 4; ++i ) {
+		bytes.push_back( static_cast< char >( ( static_cast< uint32_t >( value ) >> ( i * 8 ) ) & 0xff ) );
+	}
+}
+
+void BytecodeWriter::Int64( int64_t value )
+{
+	for ( int i = 0; i < 8; ++i ) {
+		bytes.push_back( static_cast< char >( ( static_cast< uint64_t >( value ) >> ( i * 8 ) ) & 0xff ) );
+	}
+}
+
+void BytecodeWriter::Float( FLOAT_T value )
+{
+	int64_t bits;
+	memcpy( &bits, &value, sizeof( bits ) );
+	Int64( bits );
+}
+
+void BytecodeWriter::String( std::wstring const &value )
+{
+	Int64( static_cast< int64_t >( value.size() ) );
+	for ( wchar_t character : value ) {
+		Int32( static_cast< int32_t >( character ) );
+	}
+}
+
+// labels are written in order, so the same program writes the same bytes
+void BytecodeWriter::Function( ExecutableFunction* function )
+{
+	String( function->GetName() );
+	Int32( function->GetOperation() );
+	Int32( function->GetLocalCount() );
+	Int32( function->GetParameterCount() );
+	Int32( function->ReturnsValue() ? 1 : 0 );
+
+	std::vector<Instruction*> &instructions = function->GetInstructions();
+	Int64( static_cast< int64_t >( instructions.size() ) );
+	for ( Instruction* instruction : instructions ) {
+		Int32( instruction->type );
+		Int64( instruction->operand1 );
+		Int64( instruction->operand2 );
+		Int64( instruction->operand3 );
+		Float( instruction->operand4 );
+		String( instruction->operand5 );
+		String( instruction->operand6 );
+		Int32( instruction->line );
+	}
+
+	std::map<long, size_t> jump_table( function->GetJumpTable().begin(), function->GetJumpTable().end() );
+	Int64( static_cast< int64_t >( jump_table.size() ) );
+	for ( auto &label : jump_table ) {
+		Int64( label.first );
+		Int64( static_cast< int64_t >( label.second ) );
+	}
+
+	std::set<size_t> &leaders = function->GetLeaders();
+	Int64( static_cast< int64_t >( leaders.size() ) );
+	for ( size_t leader : leaders ) {
+		Int64( static_cast< int64_t >( leader ) );
+	}
+}
+
+// already written by another writer
+void BytecodeWriter::Bytes( std::string const &value )
+{
+	bytes.append( value );
+}
+
+bool BytecodeWriter::Save( std::wstring const &file_name, const char* magic )
+{
+#ifdef _WIN32
+	std::ofstream out( file_name.c_str(), std::ios_base::out | std::ios_base::binary | std::ios_base::trunc );
+#else
+	std::ofstream out( UnicodeToBytes( file_name ), std::ios_base::out | std::ios_base::binary | std::ios_base::trunc );
+#endif
+	if ( !out ) {
+		return false;
+	}
+	out.write( magic, 4 );
+	out.write( bytes.data(), bytes.size() );
+	out.close();
+
+	return !out.fail();
+}
+
+/****************************
+ * Reading
+ ****************************/
+bool BytecodeReader::Has( size_t size )
+{
+	if ( is_valid && static_cast< size_t >( end - position ) < size ) {
+		is_valid = false;
+	}
+
+	return is_valid;
+}
+
+bool BytecodeReader::Checks( uint64_t checksum )
+{
+	const size_t size = Count( 1 );
+	if ( !is_valid || Hash( HASH_BASIS, position, size ) != checksum ) {
+		is_valid = false;
+	}
+
+	return is_valid;
+}
+
+int32_t BytecodeReader::Int32()
+{
+	if ( !Has( 4 ) ) {
+		return 0;
+	}
+
+	uint32_t value = 0;
+	for ( int i = 0; i < 4; ++i ) {
+		value |= static_cast< uint32_t >( *position++ ) << ( i * 8 );
+	}
+
+	return static_cast< int32_t >( value );
+}
+
+int64_t BytecodeReader::Int64()
+{
+	if ( !Has( 8 ) ) {
+		return 0;
+	}
+
+	uint64_t value = 0;
+	for ( int i = 0; i < 8; ++i ) {
+		value |= static_cast< uint64_t >( *position++ ) << ( i * 8 );
+	}
+
+	return static_cast< int64_t >( value );
+}
+
+FLOAT_T BytecodeReader::Float()
+{
+	const int64_t bits = Int64();
+	FLOAT_T value;
+	memcpy( &value, &bits, sizeof( value ) );
+
+	return value;
+}
+
+std::wstring BytecodeReader::String()
+{
+	std::wstring value;
+	const size_t size = Count( 4 );
+	value.reserve( size );
+	for ( size_t i = 0; i < size; ++i ) {
+		value.push_back( static_cast< wchar_t >( Int32() ) );
+	}
+
+	return value;
+}
+
+// of items at least 'item_size' bytes each, so a bad count can't ask for more than the file holds
+size_t BytecodeReader::Count( size_t item_size )
+{
+	const int64_t count = Int64();
+	if ( !is_valid || count < 0 || static_cast< uint64_t >( count ) > static_cast< uint64_t >( end - position ) / item_size ) {
+		is_valid = false;
+		return 0;
+	}
+
+	return static_cast< size_t >( count );
+}
+
+// instructions are made as the emitter makes them, and freed with them
+ExecutableFunction* BytecodeReader::Function()
+{
+	const std::wstring name = String();
+	const InstructionType operation = static_cast< InstructionType >( Int32() );
+	const int local_count = Int32();
+	const int parameter_count = Int32();
+	const bool returns_value = Int32() != 0;
+
+	std::vector<Instruction*> instructions;
+	const size_t instruction_count = Count( 4 + 8 * 4 + 8 * 2 );
+	for ( size_t i = 0; i < instruction_count && is_valid; ++i ) {
+		const InstructionType type = static_cast< InstructionType >( Int32() );
+		if ( type < LOAD_TRUE_LIT || type > NO_OP ) {
+			is_valid = false;
+			break;
+		}
+		Instruction* instruction = Emitter::MakeInstruction( type );
+		instruction->operand1 = static_cast< INT_T >( Int64() );
+		instruction->operand2 = static_cast< INT_T >( Int64() );
+		instruction->operand3 = static_cast< INT_T >( Int64() );
+		instruction->operand4 = Float();
+		instruction->operand5 = String();
+		instruction->operand6 = String();
+		instruction->line = Int32();
+		instructions.push_back( instruction );
+	}
+
+	std::unordered_map<long, size_t> jump_table;
+	const size_t label_count = Count( 8 * 2 );
+	for ( size_t i = 0; i < label_count; ++i ) {
+		const long label = static_cast< long >( Int64() );
+		const int64_t index = Int64();
+		if ( index < 0 || static_cast< size_t >( index ) >= instructions.size() ) {
+			is_valid = false;
+			break;
+		}
+		jump_table.insert( { label, static_cast< size_t >( index ) } );
+	}
+
+	std::set<size_t> leaders;
+	const size_t leader_count = Count( 8 );
+	for ( size_t i = 0; i < leader_count; ++i ) {
+		leaders.insert( static_cast< size_t >( Int64() ) );
+	}
+
+	if ( !is_valid ) {
+		return nullptr;
+	}
+
+	return new ExecutableFunction( name, operation, local_count, parameter_count, std::move( instructions ), std::move( jump_table ), leaders,
+		returns_value );
+}
+
+/****************************
+ * Mapping
+ ****************************/
+MappedFile::MappedFile( std::wstring const &file_name ) : bytes( nullptr ), size( 0 ), is_open( false )
+{
+#ifdef _WIN32
+	mapping = NULL;
+	file = CreateFileW( file_name.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+	if ( file == INVALID_HANDLE_VALUE ) {
+		return;
+	}
+
+	LARGE_INTEGER file_size;
+	if ( !GetFileSizeEx( file, &file_size ) ) {
+		return;
+	}
+	size = static_cast< size_t >( file_size.QuadPart );
+
+	// an empty file can't be mapped
+	if ( size ) {
+		mapping = CreateFileMappingW( file, NULL, PAGE_READONLY, 0, 0, NULL );
+		if ( !mapping ) {
+			return;
+		}
+		bytes = static_cast< const unsigned char* >( MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 ) );
+		if ( !bytes ) {
+			return;
+		}
+	}
+#else
+	const int file = open( UnicodeToBytes( file_name ).c_str(), O_RDONLY );
+	if ( file < 0 ) {
+		return;
+	}
+
+	struct stat status;
+	if ( fstat( file, &status ) ) {
+		close( file );
+		return;
+	}
+	size = static_cast< size_t >( status.st_size );
+
+	// an empty file can't be mapped
+	if ( size ) {
+		void* memory = mmap( NULL, size, PROT_READ, MAP_PRIVATE, file, 0 );
+		if ( memory == MAP_FAILED ) {
+			close( file );
+			return;
+		}
+		bytes = static_cast< const unsigned char* >( memory );
+	}
+	close( file );
+#endif
+
+	is_open = true;
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef _WIN32
+	if ( bytes ) {
+		UnmapViewOfFile( bytes );
+	}
+	if ( mapping ) {
+		CloseHandle( mapping );
+	}
+	if ( file != INVALID_HANDLE_VALUE ) {
+		CloseHandle( file );
+	}
+#else
+	if ( bytes ) {
+		munmap( const_cast< unsigned char* >( bytes ), size );
+	}
+#endif
+}
+
+/****************************
+ * Programs
+ ****************************/
+uint64_t Bytecode::Key( std::vector<std::wstring> const &source_files, BytecodeOptions const &options )
+{
+	uint64_t hash = Hash( HASH_BASIS, VERSION );
+	hash = Hash( hash, reinterpret_cast< const unsigned char* >( BUILD ), sizeof( BUILD ) );
+	hash = Hash( hash, static_cast< uint64_t >( NO_OP ) );
+	hash = Hash( hash, static_cast< uint64_t >( options.optimize_level ) );
+	hash = Hash( hash, options.for_registers ? 1 : 0 );
+	hash = Hash( hash, source_files.size() );
+	for ( std::wstring const &source_file : source_files ) {
+		MappedFile source{ source_file };
+		if ( !source.IsOpen() ) {
+			return 0;
+		}
+		hash = Hash( hash, source.GetSize() );
+		hash = Hash( hash, source.GetBytes(), source.GetSize() );
+	}
+
+	// zero is no key
+	return hash ? hash : 1;
+}
+
+bool Bytecode::IsBytecode( std::wstring const &file_name )
+{
+	MappedFile file{ file_name };
+	return file.IsOpen() && file.GetSize() >= sizeof( MAGIC ) && !memcmp( file.GetBytes(), MAGIC, sizeof( MAGIC ) );
+}
+
+std::vector<ExecutableFunction*> Bytecode::Functions( ExecutableProgram* program )
+{
+	std::vector<ExecutableFunction*> all_functions{ program->GetGlobal() };
+
+	std::map<std::wstring, ExecutableFunction*> functions( program->GetFunctions().begin(), program->GetFunctions().end() );
+	for ( auto &function : functions ) {
+		all_functions.push_back( function.second );
+	}
+
+	std::map<std::wstring, ExecutableClass*> classes( program->GetClasses().begin(), program->GetClasses().end() );
+	for ( auto &klass : classes ) {
+		std::map<std::wstring, ExecutableFunction*> methods( klass.second->GetFunctions().begin(), klass.second->GetFunctions().end() );
+		std::map<long, ExecutableFunction*> operations( klass.second->GetOperations().begin(), klass.second->GetOperations().end() );
+		for ( auto &method : methods ) {
+			all_functions.push_back( method.second );
+		}
+		for ( auto &operation : operations ) {
+			all_functions.push_back( operation.second );
+		}
+	}
+
+	return all_functions;
+}
+
+// the version, then the hash and size of the rest
+void Bytecode::WriteProgram( BytecodeWriter &output, ExecutableProgram* program, INT_T last_label_id, uint64_t key,
+	BytecodeOptions const &options )
+{
+	BytecodeWriter writer;
+	writer.Int64( static_cast< int64_t >( key ) );
+	writer.Int32( options.optimize_level );
+	writer.Int32( options.for_registers ? 1 : 0 );
+	writer.Int64( last_label_id );
+
+	writer.Function( program->GetGlobal() );
+
+	std::map<std::wstring, ExecutableFunction*> functions( program->GetFunctions().begin(), program->GetFunctions().end() );
+	writer.Int64( static_cast< int64_t >( functions.size() ) );
+	for ( auto &function : functions ) {
+		writer.Function( function.second );
+	}
+
+	std::map<std::wstring, ExecutableClass*> classes( program->GetClasses().begin(), program->GetClasses().end() );
+	writer.Int64( static_cast< int64_t >( classes.size() ) );
+	for ( auto &klass : classes ) {
+		writer.String( klass.second->GetName() );
+		writer.Int32( klass.second->GetInstanceCount() );
+
+		std::map<std::wstring, ExecutableFunction*> methods( klass.second->GetFunctions().begin(), klass.second->GetFunctions().end() );
+		std::map<long, ExecutableFunction*> operations( klass.second->GetOperations().begin(), klass.second->GetOperations().end() );
+		writer.Int64( static_cast< int64_t >( methods.size() + operations.size() ) );
+		for ( auto &method : methods ) {
+			writer.Function( method.second );
+		}
+		for ( auto &operation : operations ) {
+			writer.Function( operation.second );
+		}
+	}
+
+	std::string const &bytes = writer.GetBytes();
+	output.Int32( VERSION );
+	output.Int64( static_cast< int64_t >( Hash( HASH_BASIS, reinterpret_cast< const unsigned char* >( bytes.data() ), bytes.size() ) ) );
+	output.Int64( static_cast< int64_t >( bytes.size() ) );
+	output.Bytes( bytes );
+}
+
+std::unique_ptr<ExecutableProgram> Bytecode::ReadProgram( BytecodeReader &reader, uint64_t key, INT_T &last_label_id,
+	BytecodeOptions &options )
+{
+	if ( static_cast< uint32_t >( reader.Int32() ) != VERSION ) {
+		return nullptr;
+	}
+	const uint64_t checksum = static_cast< uint64_t >( reader.Int64() );
+	if ( !reader.Checks( checksum ) ) {
+		return nullptr;
+	}
+	const uint64_t file_key = static_cast< uint64_t >( reader.Int64() );
+	if ( key && file_key != key ) {
+		return nullptr;
+	}
+	options.optimize_level = reader.Int32();
+	options.for_registers = reader.Int32() != 0;
+	last_label_id = static_cast< INT_T >( reader.Int64() );
+
+	std::unique_ptr<ExecutableProgram> program{ new ExecutableProgram };
+	ExecutableFunction* global = reader.Function();
+	if ( !global ) {
+		return nullptr;
+	}
+	program->SetMain( global );
+
+	const size_t function_count = reader.Count( 1 );
+	for ( size_t i = 0; i < function_count; ++i ) {
+		ExecutableFunction* function = reader.Function();
+		if ( !function ) {
+			return nullptr;
+		}
+		program->AddFunction( function );
+	}
+
+	const size_t class_count = reader.Count( 1 );
+	for ( size_t i = 0; i < class_count; ++i ) {
+		const std::wstring name = reader.String();
+		ExecutableClass* klass = new ExecutableClass( name, reader.Int32() );
+		program->AddClass( klass );
+
+		const size_t method_count = reader.Count( 1 );
+		for ( size_t j = 0; j < method_count; ++j ) {
+			ExecutableFunction* method = reader.Function();
+			if ( !method ) {
+				return nullptr;
+			}
+			klass->AddFunction( method );
+		}
+	}
+
+	if ( !reader.IsValid() ) {
+		return nullptr;
+	}
+
+	// a method reaches its class's fields; a function any class's, or the captures its closures carry after it
+	INT_T any_fields = 0;
+	for ( auto &klass : program->GetClasses() ) {
+		if ( klass.second->GetInstanceCount() < 0 || klass.second->GetInstanceCount() > MAX_LOCALS ) {
+			return nullptr;
+		}
+		any_fields = std::max<INT_T>( any_fields, klass.second->GetInstanceCount() );
+	}
+	std::unordered_map<std::wstring, INT_T> closure_fields;
+	for ( ExecutableFunction* function : Functions( program.get() ) ) {
+		for ( Instruction* instruction : function->GetInstructions() ) {
+			if ( instruction->type == NEW_FUNC ) {
+				INT_T &fields = closure_fields[ instruction->operand5 ];
+				fields = std::max( fields, instruction->operand1 + 1 );
+			}
+		}
+	}
+
+	if ( !Validate( program.get(), global, any_fields ) ) {
+		return nullptr;
+	}
+	for ( auto &function : program->GetFunctions() ) {
+		auto closure = closure_fields.find( function.first );
+		if ( !Validate( program.get(), function.second, closure != closure_fields.end() ? std::max( any_fields, closure->second ) : any_fields ) ) {
+			return nullptr;
+		}
+	}
+	for ( auto &klass : program->GetClasses() ) {
+		for ( auto &method : klass.second->GetFunctions() ) {
+			if ( !Validate( program.get(), method.second, klass.second->GetInstanceCount() ) ) {
+				return nullptr;
+			}
+		}
+		for ( auto &operation : klass.second->GetOperations() ) {
+			if ( !Validate( program.get(), operation.second, klass.second->GetInstanceCount() ) ) {
+				return nullptr;
+			}
+		}
+	}
+
+	return program;
+}
+
+/****************************
+ * Whether a function read from a
+ * file can be run: its frame is a
+ * size it could have been given,
+ * every variable is inside it, the
+ * program or the instance, every
+ * label, class and function it
+ * names exists, the sequences that
+ * superinstructions and jump tables
+ * skip are there, and it ends by
+ * returning
+ ****************************/
+bool Bytecode::Validate( ExecutableProgram* program, ExecutableFunction* function, INT_T field_count )
+{
+	std::vector<Instruction*> &instructions = function->GetInstructions();
+	if ( instructions.empty() || instructions.back()->type != RTRN ) {
+		return false;
+	}
+	if ( function->GetLocalCount() < 0 || function->GetLocalCount() > MAX_LOCALS || function->GetParameterCount() < 0 ||
+		function->GetParameterCount() > function->GetLocalCount() ) {
+		return false;
+	}
+
+	const INT_T local_count = function->GetLocalCount();
+	const INT_T global_count = program->GetGlobal()->GetLocalCount();
+	auto is_local = [&]( INT_T slot ) { return slot >= 0 && slot <= local_count; };
+	auto is_label = [&]( INT_T label ) { return function->GetJumpTable().count( static_cast< long >( label ) ) != 0; };
+
+	const size_t size = instructions.size();
+	for ( size_t ip = 0; ip < size; ++ip ) {
+		Instruction* instruction = instructions[ ip ];
+		bool is_valid = true;
+		switch ( instruction->type ) {
+		case LOAD_VAR:
+		case STOR_VAR:
+		case LOAD_ARY_VAR:
+		case STOR_ARY_VAR:
+		case LOAD_ARY_ELEM:
+		case STOR_ARY_ELEM:
+			switch ( instruction->operand1 ) {
+			case LOCL:
+				is_valid = is_local( instruction->operand2 );
+				break;
+
+			case GLOB:
+				is_valid = instruction->operand2 >= 0 && instruction->operand2 <= global_count;
+				break;
+
+			case INST:
+			case CLS:
+				is_valid = instruction->operand2 >= 0 && instruction->operand2 < field_count;
+				break;
+
+			default:
+				is_valid = false;
+				break;
+			}
+			if ( instruction->type != LOAD_VAR && instruction->type != STOR_VAR ) {
+				is_valid = is_valid && instruction->operand3 >= 1;
+			}
+			break;
+
+		case LOAD_FIELD:
+			is_valid = instruction->operand2 >= 0 && instruction->operand2 < field_count;
+			break;
+
+		case JMP:
+			is_valid = is_label( instruction->operand1 ) && ( instruction->operand2 == JMP_TRUE || instruction->operand2 == JMP_FALSE ||
+				instruction->operand2 == JMP_UNCND );
+			break;
+
+		case JMP_TBL:
+			is_valid = instruction->operand2 >= 0 && static_cast< uint64_t >( instruction->operand2 ) < size - ip && is_label( instruction->operand3 );
+			break;
+
+		case LBL:
+			is_valid = is_label( instruction->operand1 );
+			break;
+
+		case NEW_ARRAY:
+			is_valid = instruction->operand1 >= 1;
+			break;
+
+		case NEW_OBJ:
+			is_valid = program->GetClass( instruction->operand5 ) != nullptr;
+			break;
+
+		case LOCAL_OBJ: {
+			ExecutableClass* local_class = program->GetClass( instruction->operand5 );
+			is_valid = local_class && instruction->operand1 >= 0 && instruction->operand1 + local_class->GetInstanceCount() <= local_count;
+		}
+			break;
+
+		case NEW_FUNC:
+			is_valid = instruction->operand1 >= 0 && instruction->operand1 <= MAX_LOCALS && program->GetFunction( instruction->operand5 ) != nullptr;
+			break;
+
+		case CALL_FUNC:
+		case TAIL_CALL:
+			is_valid = instruction->operand1 >= 0;
+			break;
+
+		case INC_LOCAL_INT:
+			is_valid = is_local( instruction->operand1 ) && ip + 4 < size;
+			break;
+
+		case LOAD_LOCAL_PAIR:
+			is_valid = is_local( instruction->operand1 ) && is_local( instruction->operand2 ) && ip + 2 < size;
+			break;
+
+		case LOAD_INT_LOCAL:
+			is_valid = is_local( instruction->operand2 ) && ip + 2 < size;
+			break;
+
+		case KNOWN_SIZE:
+			is_valid = is_local( instruction->operand1 ) && ip + 2 < size;
+			break;
+
+		case CMP_JMP_EQL:
+		case CMP_JMP_NEQL:
+		case CMP_JMP_GTR:
+		case CMP_JMP_LES:
+		case CMP_JMP_GTR_EQL:
+		case CMP_JMP_LES_EQL:
+			is_valid = is_label( instruction->operand1 ) && ( instruction->operand2 == JMP_TRUE || instruction->operand2 == JMP_FALSE ) && ip + 2 < size;
+			break;
+
+		default:
+			break;
+		}
+
+		if ( !is_valid ) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool Bytecode::Write( std::wstring const &file_name, ExecutableProgram* program, INT_T last_label_id, uint64_t key,
+	BytecodeOptions const &options )
+{
+	BytecodeWriter writer;
+	WriteProgram( writer, program, last_label_id, key, options );
+
+	return writer.Save( file_name, MAGIC );
+}
+
+std::unique_ptr<ExecutableProgram> Bytecode::Read( std::wstring const &file_name, uint64_t key, INT_T &last_label_id,
+	BytecodeOptions &options )
+{
+	MappedFile file{ file_name };
+	if ( !file.IsOpen() || file.GetSize() < sizeof( MAGIC ) || memcmp( file.GetBytes(), MAGIC, sizeof( MAGIC ) ) ) {
+		return nullptr;
+	}
+
+	BytecodeReader reader{ file.GetBytes() + sizeof( MAGIC ), file.GetSize() - sizeof( MAGIC ) };
+	return ReadProgram( reader, key, last_label_id, options );
+}
+
+/****************************
+ * Cache
+ ****************************/
+std::wstring BytecodeCache::FileName( uint64_t key )
+{
+	wchar_t name[ 17 ];
+	for ( int i = 0; i < 16; ++i ) {
+		name[ i ] = L"0123456789abcdef"[ ( key >> ( ( 15 - i ) * 4 ) ) & 0xf ];
+	}
+	name[ 16 ] = L'\0';
+
+	return directory + L"/" + name + L".subc";
+}
+
+std::unique_ptr<ExecutableProgram> BytecodeCache::Load( uint64_t key, BytecodeOptions const &options, INT_T &last_label_id )
+{
+	BytecodeOptions file_options;
+	std::unique_ptr<ExecutableProgram> program = Bytecode::Read( FileName( key ), key, last_label_id, file_options );
+	if ( program && ( file_options.optimize_level != options.optimize_level || file_options.for_registers != options.for_registers ) ) {
+		return nullptr;
+	}
+	TRACE( TRACE_VM, TRACE_EVENTS, VM_CACHE, static_cast< int64_t >( key ), program != nullptr );
+
+	return program;
+}
+
+// a cache that can't be written is only slower
+void BytecodeCache::Store( uint64_t key, BytecodeOptions const &options, ExecutableProgram* program, INT_T last_label_id )
+{
+	const std::wstring file_name = FileName( key );
+#ifdef _WIN32
+	_wmkdir( directory.c_str() );
+	const std::wstring part_name = file_name + L"." + IntToString( _getpid() ) + L".part";
+	if ( !Bytecode::Write( part_name, program, last_label_id, key, options ) ||
+		!MoveFileExW( part_name.c_str(), file_name.c_str(), MOVEFILE_REPLACE_EXISTING ) ) {
+		DeleteFileW( part_name.c_str() );
+	}
+#else
+	mkdir( UnicodeToBytes( directory ).c_str(), 0777 );
+	const std::wstring part_name = file_name + L"." + IntToString( getpid() ) + L".part";
+	if ( !Bytecode::Write( part_name, program, last_label_id, key, options ) ||
+		rename( UnicodeToBytes( part_name ).c_str(), UnicodeToBytes( file_name ).c_str() ) ) {
+		unlink( UnicodeToBytes( part_name ).c_str() );
+	}
+#endif
+}
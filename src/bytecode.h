@@ -0,0 +1,165 @@
+/***************************************************************************
+ * Bytecode files
+ *
+ * Copyright (c) 2017 Joshua Ogunyinka
+ * All rights reserved.
+*/
+
+#ifndef __BYTECODE_H__
+#define __BYTECODE_H__
+
+#include <memory>
+#include "common.h"
+
+namespace compiler {
+	// how a program was compiled; a file made one way isn't run another
+	struct BytecodeOptions {
+		int		optimize_level;
+		bool	for_registers;		// the register machine is emitted from it: no superinstructions
+	};
+
+	// integers little-endian at fixed widths; strings are their length, then their characters
+	class BytecodeWriter {
+		std::string bytes;
+
+	public:
+		void Int32( int32_t value );
+		void Int64( int64_t value );
+		void Float( FLOAT_T value );
+		void String( std::wstring const &value );
+		void Function( ExecutableFunction* function );
+		void Bytes( std::string const &value );
+
+		std::string const &GetBytes() {
+			return bytes;
+		}
+
+		// the four bytes of 'magic' naming what the file holds, then what was written
+		bool Save( std::wstring const &file_name, const char* magic );
+	};
+
+	// reads what the writer wrote; once anything is short or out of range the reader is invalid and reads zeros
+	class BytecodeReader {
+		const unsigned char* position;
+		const unsigned char* end;
+		bool is_valid;
+
+		bool Has( size_t size );
+
+	public:
+		BytecodeReader( const unsigned char* bytes, size_t size ) : position( bytes ), end( bytes + size ), is_valid( true ) {
+		}
+
+		bool IsValid() {
+			return is_valid;
+		}
+
+		// the size of what follows, then whether its bytes hash to 'checksum'; only the size is read
+		bool Checks( uint64_t checksum );
+
+		int32_t Int32();
+		int64_t Int64();
+		FLOAT_T Float();
+		std::wstring String();
+		size_t Count( size_t item_size );
+		ExecutableFunction* Function();
+	};
+
+	// a file's contents, mapped to be read
+	class MappedFile {
+		const unsigned char* bytes;
+		size_t size;
+		bool is_open;
+#ifdef _WIN32
+		HANDLE file;
+		HANDLE mapping;
+#endif
+
+	public:
+		explicit MappedFile( std::wstring const &file_name );
+		~MappedFile();
+
+		bool IsOpen() {
+			return is_open;
+		}
+
+		const unsigned char* GetBytes() {
+			return bytes;
+		}
+
+		size_t GetSize() {
+			return size;
+		}
+	};
+
+	/****************************
+	 * A compiled program on disk: its
+	 * version and a hash of the rest,
+	 * a header naming the sources it
+	 * was compiled from by their
+	 * content's hash, then the global
+	 * function, the functions and the
+	 * classes with their methods and
+	 * operators, each with its
+	 * instructions, jump table and
+	 * leaders. Files are mapped and
+	 * decoded straight into a program,
+	 * skipping the front end and the
+	 * optimizers; a program whose hash
+	 * or operands don't check out
+	 * isn't run
+	 ****************************/
+	class Bytecode {
+		static bool Validate( ExecutableProgram* program, ExecutableFunction* function, INT_T field_count );
+
+	public:
+		// files of other versions aren't read
+		static const uint32_t VERSION = 4;
+
+		// of the sources' contents and the options they are compiled with; zero if a source can't be read
+		static uint64_t Key( std::vector<std::wstring> const &source_files, BytecodeOptions const &options );
+
+		static bool IsBytecode( std::wstring const &file_name );
+
+		// every function, in the order they're written: the global function, the functions, then each class's methods and operators
+		static std::vector<ExecutableFunction*> Functions( ExecutableProgram* program );
+
+		// a program, without the file's magic; images write theirs the same way
+		static void WriteProgram( BytecodeWriter &writer, ExecutableProgram* program, INT_T last_label_id, uint64_t key,
+			BytecodeOptions const &options );
+		static std::unique_ptr<ExecutableProgram> ReadProgram( BytecodeReader &reader, uint64_t key, INT_T &last_label_id,
+			BytecodeOptions &options );
+
+		static bool Write( std::wstring const &file_name, ExecutableProgram* program, INT_T last_label_id, uint64_t key,
+			BytecodeOptions const &options );
+
+		// null if the file isn't a program this version wrote; 'key' is zero for any
+		static std::unique_ptr<ExecutableProgram> Read( std::wstring const &file_name, uint64_t key, INT_T &last_label_id,
+			BytecodeOptions &options );
+	};
+
+	/****************************
+	 * Compiled programs kept in a
+	 * directory, one file to a key,
+	 * so running the same sources
+	 * again skips compiling them. A
+	 * file is written under another
+	 * name and renamed, so a run
+	 * reading it never sees it half
+	 * written
+	 ****************************/
+	class BytecodeCache {
+		std::wstring directory;
+
+		std::wstring FileName( uint64_t key );
+
+	public:
+		explicit BytecodeCache( std::wstring const &directory ) : directory( directory ) {
+		}
+
+		std::unique_ptr<ExecutableProgram> Load( uint64_t key, BytecodeOptions const &options, INT_T &last_label_id );
+		void Store( uint64_t key, BytecodeOptions const &options, ExecutableProgram* program, INT_T last_label_id );
+	};
+}
+
+#endif
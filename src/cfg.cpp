@@ -0,0 +1,740 @@
+/***************************************************************************
+ * Control flow graph
+ *
+ * Copyright (c) 2017 Joshua Ogunyinka
+ * All rights reserved.
+*/
+
+#include <algorithm>
+
+#include "cfg.h"
+#include "emitter.h"
+
+using namespace compiler;
+
+static const size_t NO_BLOCK = static_cast< size_t >( -1 );
+
+/****************************
+ * Blocks and edges
+ ****************************/
+ControlFlowGraph::ControlFlowGraph( ExecutableFunction* function ) : function( function )
+{
+	std::vector<Instruction*> &instructions = function->GetInstructions();
+	std::set<size_t> &leaders = function->GetLeaders();
+	for ( auto leader = leaders.begin(); leader != leaders.end(); ++leader ) {
+		auto next = std::next( leader );
+		block_starts[ *leader ] = blocks.size();
+		blocks.push_back( BasicBlock{ *leader, next == leaders.end() ? instructions.size() : *next, {}, {}, NO_BLOCK, 0 } );
+	}
+
+	for ( size_t id = 0; id < blocks.size(); ++id ) {
+		const size_t end = blocks[ id ].end;
+		Instruction* last = instructions[ end - 1 ];
+		const bool has_next = end < instructions.size();
+
+		switch ( last->type ) {
+		case JMP:
+			Connect( id, BlockOfLabel( last->operand1 ) );
+			if ( last->operand2 != JMP_UNCND && has_next ) {
+				Connect( id, block_starts[ end ] );
+			}
+			break;
+
+		// the table of jumps that follows, then the default
+		case JMP_TBL:
+			for ( INT_T entry = 0; entry < last->operand2 && end + entry < instructions.size(); ++entry ) {
+				Connect( id, block_starts[ end + entry ] );
+			}
+			Connect( id, BlockOfLabel( last->operand3 ) );
+			break;
+
+		case RTRN:
+			break;
+
+		default:
+			if ( has_next ) {
+				Connect( id, block_starts[ end ] );
+			}
+			break;
+		}
+	}
+
+	ComputeOrder();
+	ComputeDominators();
+	FindLoops();
+}
+
+void ControlFlowGraph::Connect( size_t from, size_t to )
+{
+	if ( to == NO_BLOCK || std::find( blocks[ from ].successors.begin(), blocks[ from ].successors.end(), to ) != blocks[ from ].successors.end() ) {
+		return;
+	}
+	blocks[ from ].successors.push_back( to );
+	blocks[ to ].predecessors.push_back( from );
+}
+
+size_t ControlFlowGraph::BlockOfLabel( long label )
+{
+	auto offset = function->GetJumpTable().find( label );
+	if ( offset == function->GetJumpTable().end() ) {
+		return NO_BLOCK;
+	}
+	auto block = block_starts.find( offset->second );
+	return block == block_starts.end() ? NO_BLOCK : block->second;
+}
+
+// depth first from the entry; blocks it never reaches are left out
+void ControlFlowGraph::ComputeOrder()
+{
+	if ( blocks.empty() ) {
+		return;
+	}
+
+	std::vector<bool> visited( blocks.size(), false );
+	std::vector<std::pair<size_t, size_t>> work{ { 0, 0 } };
+	visited[ 0 ] = true;
+	while ( !work.empty() ) {
+		auto &top = work.back();
+		std::vector<size_t> &successors = blocks[ top.first ].successors;
+		if ( top.second < successors.size() ) {
+			const size_t next = successors[ top.second++ ];
+			if ( !visited[ next ] ) {
+				visited[ next ] = true;
+				work.push_back( { next, 0 } );
+			}
+		}
+		else {
+			order.push_back( top.first );
+			work.pop_back();
+		}
+	}
+	std::reverse( order.begin(), order.end() );
+}
+
+/****************************
+ * Immediate dominators, by the
+ * iterative algorithm of Cooper,
+ * Harvey and Kennedy over the
+ * reverse postorder
+ ****************************/
+void ControlFlowGraph::ComputeDominators()
+{
+	if ( order.empty() ) {
+		return;
+	}
+
+	std::vector<size_t> position( blocks.size(), NO_BLOCK );
+	for ( size_t i = 0; i < order.size(); ++i ) {
+		position[ order[ i ] ] = i;
+	}
+
+	blocks[ order[ 0 ] ].dominator = order[ 0 ];
+	bool changed = true;
+	while ( changed ) {
+		changed = false;
+		for ( size_t i = 1; i < order.size(); ++i ) {
+			BasicBlock &block = blocks[ order[ i ] ];
+			size_t dominator = NO_BLOCK;
+			for ( size_t predecessor : block.predecessors ) {
+				if ( blocks[ predecessor ].dominator == NO_BLOCK ) {
+					continue;
+				}
+				if ( dominator == NO_BLOCK ) {
+					dominator = predecessor;
+					continue;
+				}
+
+				// walk both up to their common dominator
+				size_t other = predecessor;
+				while ( dominator != other ) {
+					while ( position[ dominator ] > position[ other ] ) {
+						dominator = blocks[ dominator ].dominator;
+					}
+					while ( position[ other ] > position[ dominator ] ) {
+						other = blocks[ other ].dominator;
+					}
+				}
+			}
+
+			if ( block.dominator != dominator ) {
+				block.dominator = dominator;
+				changed = true;
+			}
+		}
+	}
+}
+
+bool ControlFlowGraph::Dominates( size_t dominator, size_t block )
+{
+	if ( !IsReachable( block ) ) {
+		return false;
+	}
+
+	while ( block != dominator ) {
+		if ( blocks[ block ].dominator == block ) {
+			return false;
+		}
+		block = blocks[ block ].dominator;
+	}
+	return true;
+}
+
+/****************************
+ * An edge to a block that dominates
+ * its source closes a loop; the
+ * loop's blocks are found walking
+ * back from the source to the header
+ ****************************/
+void ControlFlowGraph::FindLoops()
+{
+	for ( size_t header : order ) {
+		Loop loop{ header, {}, {} };
+		for ( size_t predecessor : blocks[ header ].predecessors ) {
+			if ( Dominates( header, predecessor ) ) {
+				loop.latches.push_back( predecessor );
+			}
+		}
+		if ( loop.latches.empty() ) {
+			continue;
+		}
+
+		std::vector<bool> in_loop( blocks.size(), false );
+		std::vector<size_t> work( loop.latches );
+		in_loop[ header ] = true;
+		while ( !work.empty() ) {
+			const size_t block = work.back();
+			work.pop_back();
+			if ( in_loop[ block ] ) {
+				continue;
+			}
+			in_loop[ block ] = true;
+			for ( size_t predecessor : blocks[ block ].predecessors ) {
+				if ( IsReachable( predecessor ) ) {
+					work.push_back( predecessor );
+				}
+			}
+		}
+
+		for ( size_t block = 0; block < blocks.size(); ++block ) {
+			if ( in_loop[ block ] ) {
+				loop.blocks.push_back( block );
+				blocks[ block ].loop_depth++;
+			}
+		}
+		loops.push_back( std::move( loop ) );
+	}
+}
+
+void ControlFlowGraph::TraceBlocks()
+{
+	TraceLog::Log( EMIT_BLOCKS, function->GetName(), blocks.size(), loops.size() );
+}
+
+/****************************
+ * Clean-ups, repeated until none
+ * applies
+ ****************************/
+void FlowOptimizer::Optimize( ExecutableProgram* program )
+{
+	for ( ExecutableFunction* function : program->GetAllFunctions() ) {
+		FlowOptimizer optimizer{ function, function == program->GetGlobal() };
+		bool changed = true;
+		while ( changed ) {
+			changed = optimizer.ThreadJumps();
+			changed = optimizer.RemoveUnreachable() || changed;
+			changed = optimizer.RemoveJumpsToNext() || changed;
+			changed = optimizer.RemoveDeadStores() || changed;
+			changed = optimizer.RemoveUnusedValues() || changed;
+			changed = optimizer.RemoveUnusedLabels() || changed;
+		}
+		if ( TRACE_IS_ON( TRACE_EMIT, TRACE_EVENTS ) ) {
+			ControlFlowGraph( function ).TraceBlocks();
+		}
+	}
+}
+
+void FlowOptimizer::Remove( std::vector<bool> const &removed )
+{
+	std::vector<Instruction*> &instructions = function->GetInstructions();
+	std::vector<Instruction*> kept;
+	for ( size_t i = 0; i < instructions.size(); ++i ) {
+		if ( !removed[ i ] ) {
+			kept.push_back( instructions[ i ] );
+		}
+	}
+	function->SetInstructions( std::move( kept ) );
+}
+
+// the label a jump to 'label' ends up at after unconditional jumps
+long FlowOptimizer::Thread( long label )
+{
+	std::vector<Instruction*> &instructions = function->GetInstructions();
+	std::set<long> seen{ label };
+	while ( true ) {
+		auto offset = function->GetJumpTable().find( label );
+		if ( offset == function->GetJumpTable().end() ) {
+			return label;
+		}
+
+		size_t ip = offset->second;
+		while ( ip < instructions.size() && instructions[ ip ]->type == LBL ) {
+			++ip;
+		}
+		if ( ip == instructions.size() || instructions[ ip ]->type != JMP || instructions[ ip ]->operand2 != JMP_UNCND
+			|| !seen.insert( instructions[ ip ]->operand1 ).second ) {
+			return label;
+		}
+		label = instructions[ ip ]->operand1;
+	}
+}
+
+bool FlowOptimizer::ThreadJumps()
+{
+	bool changed = false;
+	for ( Instruction* instruction : function->GetInstructions() ) {
+		INT_T* label = instruction->type == JMP ? &instruction->operand1 : instruction->type == JMP_TBL ? &instruction->operand3 : nullptr;
+		if ( label ) {
+			const long target = Thread( *label );
+			if ( target != *label ) {
+				*label = target;
+				changed = true;
+			}
+		}
+	}
+	return changed;
+}
+
+bool FlowOptimizer::RemoveUnreachable()
+{
+	ControlFlowGraph graph( function );
+	std::vector<bool> removed( function->GetInstructions().size(), false );
+	bool changed = false;
+	for ( size_t id = 0; id < graph.GetBlocks().size(); ++id ) {
+		if ( !graph.IsReachable( id ) ) {
+			BasicBlock &block = graph.GetBlocks()[ id ];
+			std::fill( removed.begin() + block.start, removed.begin() + block.end, true );
+			changed = true;
+		}
+	}
+
+	if ( changed ) {
+		Remove( removed );
+	}
+	return changed;
+}
+
+// an unconditional jump over nothing but labels; the entries of a jump table keep their places
+bool FlowOptimizer::RemoveJumpsToNext()
+{
+	std::vector<Instruction*> &instructions = function->GetInstructions();
+	std::vector<bool> removed( instructions.size(), false );
+	bool changed = false;
+	for ( size_t i = 0; i < instructions.size(); ++i ) {
+		Instruction* instruction = instructions[ i ];
+		if ( instruction->type == JMP_TBL ) {
+			i += instruction->operand2;
+			continue;
+		}
+		if ( instruction->type != JMP || instruction->operand2 != JMP_UNCND ) {
+			continue;
+		}
+
+		auto offset = function->GetJumpTable().find( instruction->operand1 );
+		if ( offset == function->GetJumpTable().end() || offset->second <= i ) {
+			continue;
+		}
+		size_t ip = i + 1;
+		while ( ip < offset->second && instructions[ ip ]->type == LBL ) {
+			++ip;
+		}
+		if ( ip == offset->second ) {
+			removed[ i ] = changed = true;
+		}
+	}
+
+	if ( changed ) {
+		Remove( removed );
+	}
+	return changed;
+}
+
+// stores to locals nothing loads become pops; the global function's locals are the program's globals
+bool FlowOptimizer::RemoveDeadStores()
+{
+	if ( is_global ) {
+		return false;
+	}
+
+	std::vector<Instruction*> &instructions = function->GetInstructions();
+	std::set<INT_T> loaded;
+	for ( Instruction* instruction : instructions ) {
+		switch ( instruction->type ) {
+		case LOAD_VAR:
+		case LOAD_ARY_VAR:
+		case STOR_ARY_VAR:
+		case LOAD_ARY_ELEM:
+		case STOR_ARY_ELEM:
+			if ( instruction->operand1 == LOCL ) {
+				loaded.insert( instruction->operand2 );
+			}
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	bool changed = false;
+	for ( Instruction* instruction : instructions ) {
+		if ( instruction->type == STOR_VAR && instruction->operand1 == LOCL && instruction->operand2 != 0 && !loaded.count( instruction->operand2 ) ) {
+			instruction->type = POP;
+			changed = true;
+		}
+	}
+	return changed;
+}
+
+// a literal or variable pushed and popped straight away
+bool FlowOptimizer::RemoveUnusedValues()
+{
+	std::vector<Instruction*> &instructions = function->GetInstructions();
+	std::vector<bool> removed( instructions.size(), false );
+	bool changed = false;
+	for ( size_t i = 0; i + 1 < instructions.size(); ++i ) {
+		if ( instructions[ i + 1 ]->type != POP ) {
+			continue;
+		}
+
+		switch ( instructions[ i ]->type ) {
+		case LOAD_VAR:
+			if ( instructions[ i ]->operand1 != LOCL && instructions[ i ]->operand1 != GLOB ) {
+				break;
+			}
+			// fall through
+		case LOAD_TRUE_LIT:
+		case LOAD_FALSE_LIT:
+		case LOAD_INT_LIT:
+		case LOAD_FLOAT_LIT:
+		case LOAD_CHAR_LIT:
+		case LOAD_NIL_LIT:
+			removed[ i ] = removed[ i + 1 ] = changed = true;
+			++i;
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	if ( changed ) {
+		Remove( removed );
+	}
+	return changed;
+}
+
+bool FlowOptimizer::RemoveUnusedLabels()
+{
+	std::vector<Instruction*> &instructions = function->GetInstructions();
+	std::set<INT_T> targets;
+	for ( Instruction* instruction : instructions ) {
+		if ( instruction->type == JMP ) {
+			targets.insert( instruction->operand1 );
+		}
+		else if ( instruction->type == JMP_TBL ) {
+			targets.insert( instruction->operand3 );
+		}
+	}
+
+	std::vector<bool> removed( instructions.size(), false );
+	bool changed = false;
+	for ( size_t i = 0; i < instructions.size(); ++i ) {
+		if ( instructions[ i ]->type == LBL && !targets.count( instructions[ i ]->operand1 ) ) {
+			removed[ i ] = changed = true;
+		}
+	}
+
+	if ( changed ) {
+		Remove( removed );
+	}
+	return changed;
+}
+
+/****************************
+ * Innermost loops first; what
+ * leaves an inner loop may leave
+ * the one around it next time
+ ****************************/
+void LoopOptimizer::Optimize( ExecutableProgram* program )
+{
+	for ( ExecutableFunction* function : program->GetAllFunctions() ) {
+		LoopOptimizer optimizer{ function, function == program->GetGlobal() };
+		optimizer.OrderSteps();
+		while ( optimizer.Hoist() ) {
+		}
+	}
+}
+
+// 'i = 1 + i' pushes the literal last; inferred integers add the same either way
+void LoopOptimizer::OrderSteps()
+{
+	ControlFlowGraph graph( function );
+	std::vector<Instruction*> &instructions = function->GetInstructions();
+	for ( BasicBlock &block : graph.GetBlocks() ) {
+		if ( !block.loop_depth ) {
+			continue;
+		}
+		for ( size_t i = block.start; i + 3 < block.end; ++i ) {
+			if ( instructions[ i ]->type == LOAD_VAR && instructions[ i ]->operand1 == LOCL && instructions[ i + 1 ]->type == LOAD_INT_LIT
+				&& instructions[ i + 2 ]->type == ADD_INT && instructions[ i + 3 ]->type == STOR_VAR && instructions[ i + 3 ]->operand1 == LOCL
+				&& instructions[ i + 3 ]->operand2 == instructions[ i ]->operand2 ) {
+				std::swap( instructions[ i ], instructions[ i + 1 ] );
+			}
+		}
+	}
+}
+
+bool LoopOptimizer::Hoist()
+{
+	ControlFlowGraph graph( function );
+	std::vector<Loop> &loops = graph.GetLoops();
+	for ( auto loop = loops.rbegin(); loop != loops.rend(); ++loop ) {
+		if ( Hoist( graph, *loop ) ) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool LoopOptimizer::Hoist( ControlFlowGraph &graph, Loop &loop )
+{
+	std::vector<Instruction*> &instructions = function->GetInstructions();
+	std::vector<BasicBlock> &blocks = graph.GetBlocks();
+	std::vector<bool> in_loop( blocks.size(), false );
+	for ( size_t block : loop.blocks ) {
+		in_loop[ block ] = true;
+	}
+
+	// where the moved code goes: ahead of the jump into the loop, or of the header a block runs into
+	std::vector<size_t> entries;
+	if ( blocks[ loop.header ].start == 0 ) {
+		entries.push_back( 0 );
+	}
+	for ( size_t predecessor : blocks[ loop.header ].predecessors ) {
+		BasicBlock &block = blocks[ predecessor ];
+		if ( in_loop[ predecessor ] || !graph.IsReachable( predecessor ) ) {
+			continue;
+		}
+		// the entries of a jump table keep their places
+		const bool is_table_entry = block.predecessors.size() == 1 && instructions[ blocks[ block.predecessors[ 0 ] ].end - 1 ]->type == JMP_TBL;
+		if ( block.successors.size() != 1 || is_table_entry ) {
+			return false;
+		}
+		entries.push_back( instructions[ block.end - 1 ]->type == JMP ? block.end - 1 : block.end );
+	}
+	if ( entries.empty() ) {
+		return false;
+	}
+
+	std::set<std::pair<INT_T, INT_T>> stores;
+	bool calls = false;
+	for ( size_t block : loop.blocks ) {
+		for ( size_t i = blocks[ block ].start; i < blocks[ block ].end; ++i ) {
+			if ( instructions[ i ]->type == STOR_VAR ) {
+				stores.insert( { instructions[ i ]->operand1, instructions[ i ]->operand2 } );
+			}
+			calls = calls || IsCall( instructions[ i ]->type );
+		}
+	}
+
+	// the stack within each block; a value is invariant when all the code that pushed it is
+	std::vector<std::pair<size_t, size_t>> invariants;
+	std::vector<size_t> sizes;
+	for ( size_t block : loop.blocks ) {
+		std::vector<StackValue> stack;
+		for ( size_t i = blocks[ block ].start; i < blocks[ block ].end; ++i ) {
+			Instruction* instruction = instructions[ i ];
+			switch ( instruction->type ) {
+			case LOAD_TRUE_LIT:
+			case LOAD_FALSE_LIT:
+			case LOAD_INT_LIT:
+			case LOAD_FLOAT_LIT:
+			case LOAD_CHAR_LIT:
+			case LOAD_NIL_LIT:
+				stack.push_back( StackValue{ i, i + 1, true, false } );
+				break;
+
+			// fields and the program's variables from a function are worth keeping in a local too
+			case LOAD_VAR:
+			case LOAD_FIELD:
+				stack.push_back( StackValue{ i, i + 1, IsInvariant( instruction, stores, calls ), instruction->operand1 != LOCL } );
+				break;
+
+			default: {
+				// 'size()' of a function's own variable may be of an array, whose size is kept on the way in
+				Instruction* receiver = i > blocks[ block ].start ? instructions[ i - 1 ] : nullptr;
+				if ( instruction->type == CALL_FUNC && !instruction->operand1 && instruction->operand2 && instruction->operand5 == L"size:0"
+					&& receiver && receiver->type == LOAD_VAR && receiver->operand1 == LOCL && IsInvariant( receiver, stores, calls )
+					&& ( i - 1 == blocks[ block ].start || instructions[ i - 2 ]->type != KNOWN_SIZE ) ) {
+					sizes.push_back( i - 1 );
+				}
+
+				const size_t count = instruction->type == ARY_SIZE ? 1 : 2;
+				if ( !IsPure( instruction->type ) || stack.size() < count ) {
+					Flush( stack, invariants );
+					break;
+				}
+
+				const size_t first = stack.size() - count;
+				StackValue value{ stack[ first ].start, i + 1, stack.back().end == i, true };
+				for ( size_t operand = first; operand < stack.size(); ++operand ) {
+					value.is_invariant = value.is_invariant && stack[ operand ].is_invariant
+						&& ( operand + 1 == stack.size() || stack[ operand ].end == stack[ operand + 1 ].start );
+				}
+				if ( !value.is_invariant ) {
+					std::vector<StackValue> operands( stack.begin() + first, stack.end() );
+					Flush( operands, invariants );
+				}
+				stack.resize( first );
+				stack.push_back( value );
+			}
+				break;
+			}
+		}
+		Flush( stack, invariants );
+	}
+	if ( invariants.empty() && sizes.empty() ) {
+		return false;
+	}
+
+	// a value computed the same way more than once shares its local
+	struct Moved {
+		size_t start;
+		size_t end;
+		INT_T local;
+	};
+	std::vector<Moved> moved;
+	std::map<size_t, std::vector<Instruction*>> inserted;
+	std::map<size_t, Moved> replaced;
+	for ( auto const &invariant : invariants ) {
+		const size_t length = invariant.second - invariant.first;
+		auto same = std::find_if( moved.begin(), moved.end(), [&]( Moved const &other ) {
+			if ( other.end - other.start != length ) {
+				return false;
+			}
+			for ( size_t i = 0; i < length; ++i ) {
+				Instruction* a = instructions[ other.start + i ];
+				Instruction* b = instructions[ invariant.first + i ];
+				if ( a->type != b->type || a->operand1 != b->operand1 || a->operand2 != b->operand2 || a->operand3 != b->operand3
+					|| a->operand4 != b->operand4 || a->operand5 != b->operand5 ) {
+					return false;
+				}
+			}
+			return true;
+		} );
+
+		Moved value{ invariant.first, invariant.second, same != moved.end() ? same->local : 0 };
+		if ( same == moved.end() ) {
+			value.local = function->AddLocal();
+			moved.push_back( value );
+			for ( size_t entry : entries ) {
+				std::vector<Instruction*> &code = inserted[ entry ];
+				for ( size_t i = invariant.first; i < invariant.second; ++i ) {
+					Instruction* copy = Emitter::MakeInstruction( instructions[ i ]->type );
+					*copy = *instructions[ i ];
+					code.push_back( copy );
+				}
+				code.push_back( Emitter::MakeInstruction( STOR_VAR, static_cast< INT_T >( LOCL ), value.local ) );
+				code.back()->line = instructions[ invariant.first ]->line;
+			}
+		}
+		replaced[ invariant.first ] = value;
+	}
+
+	std::map<INT_T, INT_T> size_locals;
+	std::map<size_t, INT_T> guarded;
+	for ( size_t load : sizes ) {
+		const INT_T variable = instructions[ load ]->operand2;
+		auto size = size_locals.find( variable );
+		if ( size == size_locals.end() ) {
+			size = size_locals.insert( { variable, function->AddLocal() } ).first;
+			for ( size_t entry : entries ) {
+				std::vector<Instruction*> &code = inserted[ entry ];
+				code.push_back( Emitter::MakeInstruction( LOAD_VAR, static_cast< INT_T >( LOCL ), variable ) );
+				code.push_back( Emitter::MakeInstruction( TRY_ARY_SIZE ) );
+				code.push_back( Emitter::MakeInstruction( STOR_VAR, static_cast< INT_T >( LOCL ), size->second ) );
+				for ( size_t j = code.size() - 3; j < code.size(); ++j ) {
+					code[ j ]->line = instructions[ load ]->line;
+				}
+			}
+		}
+		guarded[ load ] = size->second;
+	}
+
+	std::vector<Instruction*> code;
+	for ( size_t i = 0; i < instructions.size(); ++i ) {
+		auto insert = inserted.find( i );
+		if ( insert != inserted.end() ) {
+			code.insert( code.end(), insert->second.begin(), insert->second.end() );
+		}
+
+		auto guard = guarded.find( i );
+		if ( guard != guarded.end() ) {
+			code.push_back( Emitter::MakeInstruction( KNOWN_SIZE, guard->second ) );
+			code.back()->line = instructions[ i ]->line;
+		}
+
+		auto replace = replaced.find( i );
+		if ( replace != replaced.end() ) {
+			code.push_back( Emitter::MakeInstruction( LOAD_VAR, static_cast< INT_T >( LOCL ), replace->second.local ) );
+			code.back()->line = instructions[ i ]->line;
+			i = replace->second.end - 1;
+		}
+		else {
+			code.push_back( instructions[ i ] );
+		}
+	}
+	function->SetInstructions( std::move( code ) );
+	return true;
+}
+
+bool LoopOptimizer::IsInvariant( Instruction* instruction, std::set<std::pair<INT_T, INT_T>> const &stores, bool calls )
+{
+	if ( stores.count( { instruction->operand1, instruction->operand2 } ) ) {
+		return false;
+	}
+
+	switch ( instruction->operand1 ) {
+	case LOCL:
+		return !is_global || !calls;
+
+	case GLOB:
+	case INST:
+		return !calls;
+
+	default:
+		return false;
+	}
+}
+
+// what may run an object's method or operator
+bool LoopOptimizer::IsCall( InstructionType type )
+{
+	return ( type >= EQL && type <= BIT_OR ) || type == NEW_OBJ || type == CALL_FUNC || type == TAIL_CALL;
+}
+
+// operations on inferred types, and sizes: a 'foreach' stores what it sizes, so any other size is of an array, which never changes
+bool LoopOptimizer::IsPure( InstructionType type )
+{
+	return ( type >= EQL_INT && type <= DIV_FLOAT ) || type == ARY_SIZE;
+}
+
+// values still on the stack are moved unless just a literal or a local
+void LoopOptimizer::Flush( std::vector<StackValue> &stack, std::vector<std::pair<size_t, size_t>> &invariants )
+{
+	for ( StackValue const &value : stack ) {
+		if ( value.is_invariant && value.has_operation ) {
+			invariants.push_back( { value.start, value.end } );
+		}
+	}
+	stack.clear();
+}
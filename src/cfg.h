@@ -0,0 +1,159 @@
+/***************************************************************************
+ * Control flow graph
+ *
+ * Copyright (c) 2017 Joshua Ogunyinka
+ * All rights reserved.
+*/
+
+#ifndef __CFG_H__
+#define __CFG_H__
+
+#include "common.h"
+
+namespace compiler {
+	/****************************
+	 * Instructions [start, end) of a
+	 * function; only the last one may
+	 * jump or return
+	 ****************************/
+	struct BasicBlock {
+		size_t				start;
+		size_t				end;
+		std::vector<size_t>	successors;
+		std::vector<size_t>	predecessors;
+		size_t				dominator;		// immediate dominator; the entry's is itself, an unreachable block's is -1
+		int					loop_depth;
+	};
+
+	/****************************
+	 * A natural loop: its header and
+	 * the blocks that reach a jump
+	 * back to it without passing
+	 * through it
+	 ****************************/
+	struct Loop {
+		size_t				header;
+		std::vector<size_t>	latches;		// sources of the back edges
+		std::vector<size_t>	blocks;			// in order, header included
+	};
+
+	/****************************
+	 * Blocks of a function, split at
+	 * the leaders the emitter found,
+	 * with their dominators and loops
+	 ****************************/
+	class ControlFlowGraph {
+		ExecutableFunction* function;
+		std::vector<BasicBlock> blocks;
+		std::vector<size_t> order;								// reachable blocks in reverse postorder
+		std::vector<Loop> loops;
+		std::unordered_map<size_t, size_t> block_starts;		// first instruction to block
+
+		void Connect( size_t from, size_t to );
+		void ComputeOrder();
+		void ComputeDominators();
+		void FindLoops();
+
+	public:
+		explicit ControlFlowGraph( ExecutableFunction* function );
+
+		std::vector<BasicBlock>& GetBlocks() {
+			return blocks;
+		}
+
+		std::vector<size_t>& GetOrder() {
+			return order;
+		}
+
+		std::vector<Loop>& GetLoops() {
+			return loops;
+		}
+
+		bool IsReachable( size_t block ) {
+			return blocks[ block ].dominator != static_cast< size_t >( -1 );
+		}
+
+		// -1 for a label the function doesn't define
+		size_t BlockOfLabel( long label );
+		bool Dominates( size_t dominator, size_t block );
+
+		void TraceBlocks();
+	};
+
+	/****************************
+	 * Clean-ups on the stack code of
+	 * every function: jumps to jumps
+	 * are threaded, unreachable blocks,
+	 * jumps to the next instruction,
+	 * unused labels, dead local stores
+	 * and values pushed only to be
+	 * popped are removed
+	 ****************************/
+	class FlowOptimizer {
+		ExecutableFunction* function;
+		bool is_global;
+
+		FlowOptimizer( ExecutableFunction* function, bool is_global ) : function( function ), is_global( is_global ) {
+		}
+
+		bool ThreadJumps();
+		bool RemoveUnreachable();
+		bool RemoveJumpsToNext();
+		bool RemoveDeadStores();
+		bool RemoveUnusedValues();
+		bool RemoveUnusedLabels();
+		long Thread( long label );
+		void Remove( std::vector<bool> const &removed );
+
+	public:
+		static void Optimize( ExecutableProgram* program );
+	};
+
+	/****************************
+	 * Loop-invariant code motion.
+	 * Values a loop computes from
+	 * literals and variables it never
+	 * stores to, and the fields and
+	 * program variables it only reads,
+	 * are computed once, at the end of
+	 * each block that enters it, into
+	 * new locals. Called code
+	 * may store to the program's
+	 * variables and fields, so those
+	 * stay only in loops without calls.
+	 * A local's 'size()' is kept too,
+	 * if it is an array's, and used
+	 * only while it still is one.
+	 * Counters stepped as 'i = 1 + i'
+	 * are put in the 'i + 1' order the
+	 * peephole optimizer fuses
+	 ****************************/
+	class LoopOptimizer {
+		// a value on the stack and the code [start, end) that pushed it
+		struct StackValue {
+			size_t	start;
+			size_t	end;
+			bool	is_invariant;
+			bool	has_operation;
+		};
+
+		ExecutableFunction* function;
+		bool is_global;
+
+		LoopOptimizer( ExecutableFunction* function, bool is_global ) : function( function ), is_global( is_global ) {
+		}
+
+		void OrderSteps();
+		bool Hoist();
+		bool Hoist( ControlFlowGraph &graph, Loop &loop );
+		bool IsInvariant( Instruction* instruction, std::set<std::pair<INT_T, INT_T>> const &stores, bool calls );
+		static bool IsCall( InstructionType type );
+		static bool IsPure( InstructionType type );
+		static void Flush( std::vector<StackValue> &stack, std::vector<std::pair<size_t, size_t>> &invariants );
+
+	public:
+		static void Optimize( ExecutableProgram* program );
+	};
+}
+
+#endif
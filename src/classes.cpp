@@ -1,4 +1,5 @@
 #include "classes.h"
+#include "memory.h"
 
 /**
 	Copyright (c) 2017 Joshua Ogunyinka
@@ -11,6 +12,7 @@ BooleanClass* BooleanClass::instance;
 
 void BooleanClass::Equal( Value &left, Value &right, Value &result ) {
 	switch ( right.type ) {
+	case BOOL_TYPE:
 	case INT_TYPE:
 		result.type = BOOL_TYPE;
 		result.sys_klass = BooleanClass::Instance();
@@ -26,6 +28,7 @@ void BooleanClass::Equal( Value &left, Value &right, Value &result ) {
 
 void BooleanClass::NotEqual( Value &left, Value &right, Value &result ) {
 	switch ( right.type ) {
+	case BOOL_TYPE:
 	case INT_TYPE:
 		result.type = BOOL_TYPE;
 		result.sys_klass = BooleanClass::Instance();
@@ -39,6 +42,26 @@ void BooleanClass::NotEqual( Value &left, Value &right, Value &result ) {
 	}
 }
 
+void BooleanClass::BitAnd( Value &left, Value &right, Value &result ) {
+	if ( right.type != BOOL_TYPE ) {
+		wcerr << L">>> invalid logical operation <<<" << endl;
+		exit( 1 );
+	}
+	result.type = BOOL_TYPE;
+	result.sys_klass = BooleanClass::Instance();
+	result.value.int_value = left.value.int_value & right.value.int_value;
+}
+
+void BooleanClass::BitOr( Value &left, Value &right, Value &result ) {
+	if ( right.type != BOOL_TYPE ) {
+		wcerr << L">>> invalid logical operation <<<" << endl;
+		exit( 1 );
+	}
+	result.type = BOOL_TYPE;
+	result.sys_klass = BooleanClass::Instance();
+	result.value.int_value = left.value.int_value | right.value.int_value;
+}
+
 /****************************
  * Integer class
  ****************************/
@@ -110,6 +133,10 @@ void IntegerClass::Multiply( Value &left, Value &right, Value &result ) {
 void IntegerClass::Divide( Value &left, Value &right, Value &result ) {
 	switch ( right.type ) {
 	case INT_TYPE:
+		if ( !right.value.int_value ) {
+			wcerr << L">>> division by zero <<<" << endl;
+			exit( 1 );
+		}
 		result.type = INT_TYPE;
 		result.sys_klass = right.sys_klass;
 		result.value.int_value = left.value.int_value / right.value.int_value;
@@ -131,6 +158,10 @@ void IntegerClass::Divide( Value &left, Value &right, Value &result ) {
 void IntegerClass::Modulo( Value &left, Value &right, Value &result ) {
 	switch ( right.type ) {
 	case INT_TYPE:
+		if ( !right.value.int_value ) {
+			wcerr << L">>> division by zero <<<" << endl;
+			exit( 1 );
+		}
 		result.type = INT_TYPE;
 		result.sys_klass = right.sys_klass;
 		result.value.int_value = left.value.int_value % right.value.int_value;
@@ -269,6 +300,26 @@ void IntegerClass::GreaterEqual( Value &left, Value &right, Value &result ) {
 	}
 }
 
+void IntegerClass::BitAnd( Value &left, Value &right, Value &result ) {
+	if ( right.type != INT_TYPE ) {
+		wcerr << L">>> invalid mathematical operation <<<" << endl;
+		exit( 1 );
+	}
+	result.type = INT_TYPE;
+	result.sys_klass = IntegerClass::Instance();
+	result.value.int_value = left.value.int_value & right.value.int_value;
+}
+
+void IntegerClass::BitOr( Value &left, Value &right, Value &result ) {
+	if ( right.type != INT_TYPE ) {
+		wcerr << L">>> invalid mathematical operation <<<" << endl;
+		exit( 1 );
+	}
+	result.type = INT_TYPE;
+	result.sys_klass = IntegerClass::Instance();
+	result.value.int_value = left.value.int_value | right.value.int_value;
+}
+
 // methods
 void IntegerClass::Abs( Value &self, Value* execution_stack, size_t &execution_stack_pos, INT_T arg_count ) {
 	if ( self.type != INT_TYPE || arg_count != 0 ) {
@@ -277,6 +328,7 @@ void IntegerClass::Abs( Value &self, Value* execution_stack, size_t &execution_s
 	}
 
 	Value value( INT_TYPE );
+	value.sys_klass = IntegerClass::Instance();
 	value.value.int_value = labs( self.value.int_value );
 	PushValue( value, execution_stack, execution_stack_pos );
 }
@@ -347,12 +399,12 @@ void FloatClass::Divide( Value &left, Value &right, Value &result ) {
 	switch ( right.type ) {
 	case INT_TYPE:
 		result.type = FLOAT_TYPE;
-		result.value.float_value = left.value.float_value - right.value.int_value;
+		result.value.float_value = left.value.float_value / right.value.int_value;
 		break;
 
 	case FLOAT_TYPE:
 		result.type = FLOAT_TYPE;
-		result.value.float_value = left.value.float_value - right.value.float_value;
+		result.value.float_value = left.value.float_value / right.value.float_value;
 		break;
 
 	default:
@@ -498,9 +550,6 @@ void FloatClass::ToInteger( Value &self, Value* execution_stack, size_t &executi
 	left.type = INT_TYPE;
 	left.sys_klass = IntegerClass::Instance();
 	left.value.int_value = ( INT_T ) self.value.float_value;
-#ifdef _DEBUG
-	wcout << L"Integer->ToInteger()" << endl;
-#endif
 	execution_stack[ execution_stack_pos++ ] = left;
 }
 
@@ -551,9 +600,6 @@ void ArrayClass::New( Value &self, Value* execution_stack, size_t &execution_sta
 	for ( size_t i = 0; i < dimensions.size(); i++ ) {
 		meta_ptr[ i + 2 ] = ( INT_T ) dimensions[ i ];
 	}
-#ifdef _DEBUG
-	wcout << L"  Array->New" << L"[" << array_size << L"], address=" << memory << endl;
-#endif
 
 	// set value
 	Value left;
@@ -563,6 +609,20 @@ void ArrayClass::New( Value &self, Value* execution_stack, size_t &execution_sta
 	execution_stack[ execution_stack_pos++ ] = left;
 }
 
+void ArrayClass::Size( Value &self, Value* execution_stack, size_t &execution_stack_pos, INT_T arg_count )
+{
+	if ( self.type != ARRAY_TYPE || arg_count != 0 ) {
+		wcerr << L">>> expected array type <<<" << endl;
+		exit( 1 );
+	}
+
+	Value* array = static_cast< Value* >( self.value.ptr_value );
+	Value value( INT_TYPE );
+	value.sys_klass = IntegerClass::Instance();
+	value.value.int_value = static_cast< INT_T >( static_cast< Mark* >( array[ -1 ].value.ptr_value )->array_size );
+	PushValue( value, execution_stack, execution_stack_pos );
+}
+
 /****************************
 * String class
 ****************************/
@@ -576,9 +636,6 @@ void StringClass::Add( Value &left, Value &right, Value &result ) {
 		Value* left_value = static_cast< Value* >( left.value.ptr_value );
 		static_cast< wstring* >( left_value->value.ptr_value )->append( std::to_wstring( right.value.int_value ) );
 		result.value.ptr_value = left.value.ptr_value;
-#ifdef _DEBUG
-		wcout << L"=== DWACK_INT: " << *static_cast< wstring* >( left_value->value.ptr_value ) << L" ===" << endl;
-#endif
 	}
 				   break;
 
@@ -588,9 +645,6 @@ void StringClass::Add( Value &left, Value &right, Value &result ) {
 		Value* left_value = static_cast< Value* >( left.value.ptr_value );
 		static_cast< wstring* >( left_value->value.ptr_value )->append( std::to_wstring( right.value.float_value ) );
 		result.value.ptr_value = left.value.ptr_value;
-#ifdef _DEBUG
-		wcout << L"=== DWACK_FLOAT: " << *static_cast< wstring* >( left_value->value.ptr_value ) << L" ===" << endl;
-#endif
 	}
 					 break;
 
@@ -601,9 +655,6 @@ void StringClass::Add( Value &left, Value &right, Value &result ) {
 		Value* right_value = static_cast< Value* >( right.value.ptr_value );
 		static_cast< wstring* >( left_value->value.ptr_value )->append( *static_cast< wstring* >( right_value->value.ptr_value ) );
 		result.value.ptr_value = left.value.ptr_value;
-#ifdef _DEBUG
-		wcout << L"=== DWACK_STRING: " << *static_cast< wstring* >( left_value->value.ptr_value ) << L" ===" << endl;
-#endif
 	}
 		break;
 
@@ -624,6 +675,106 @@ void StringClass::Size( Value &self, Value* execution_stack, size_t &execution_s
 	Value* self_value = static_cast< Value* >( self.value.ptr_value );
 
 	Value value( INT_TYPE );
+	value.sys_klass = IntegerClass::Instance();
 	value.value.int_value = ( long )static_cast< wstring* >( self_value->value.ptr_value )->size();
 	PushValue( value, execution_stack, execution_stack_pos );
 }
+
+
+/****************************
+* Hash class
+****************************/
+HashClass* HashClass::instance;
+
+size_t HashTable::KeyHash::operator()( Value const &key ) const
+{
+	switch ( key.type ) {
+	case BOOL_TYPE:
+	case INT_TYPE:
+		return std::hash<INT_T>()( key.value.int_value );
+
+	case CHAR_TYPE:
+		return std::hash<CHAR_T>()( key.value.char_value );
+
+	case FLOAT_TYPE:
+		return std::hash<FLOAT_T>()( key.value.float_value );
+
+	case STRING_TYPE:
+		return std::hash<wstring>()( *static_cast< wstring* >( static_cast< Value* >( key.value.ptr_value )->value.ptr_value ) );
+
+	case UNINIT_TYPE:
+		return 0;
+
+	default:
+		return std::hash<void*>()( key.value.ptr_value );
+	}
+}
+
+bool HashTable::KeyEqual::operator()( Value const &left, Value const &right ) const
+{
+	if ( left.type != right.type ) {
+		return false;
+	}
+
+	switch ( left.type ) {
+	case BOOL_TYPE:
+	case INT_TYPE:
+		return left.value.int_value == right.value.int_value;
+
+	case CHAR_TYPE:
+		return left.value.char_value == right.value.char_value;
+
+	case FLOAT_TYPE:
+		return left.value.float_value == right.value.float_value;
+
+	case STRING_TYPE:
+		return *static_cast< wstring* >( static_cast< Value* >( left.value.ptr_value )->value.ptr_value ) ==
+			*static_cast< wstring* >( static_cast< Value* >( right.value.ptr_value )->value.ptr_value );
+
+	case UNINIT_TYPE:
+		return true;
+
+	default:
+		return left.value.ptr_value == right.value.ptr_value;
+	}
+}
+
+void HashClass::Size( Value &self, Value* execution_stack, size_t &execution_stack_pos, INT_T arg_count )
+{
+	if ( self.type != HASH_TYPE || arg_count != 0 ) {
+		wcerr << L">>> expected hash type <<<" << endl;
+		exit( 1 );
+	}
+
+	Value* self_value = static_cast< Value* >( self.value.ptr_value );
+
+	Value value( INT_TYPE );
+	value.sys_klass = IntegerClass::Instance();
+	value.value.int_value = static_cast< INT_T >( static_cast< HashTable* >( self_value->value.ptr_value )->Size() );
+	PushValue( value, execution_stack, execution_stack_pos );
+}
+
+/****************************
+* Hash entry class
+****************************/
+HashEntryClass* HashEntryClass::instance;
+
+void HashEntryClass::Key( Value &self, Value* execution_stack, size_t &execution_stack_pos, INT_T arg_count )
+{
+	if ( self.type != ARRAY_TYPE || arg_count != 0 ) {
+		wcerr << L">>> expected hash entry type <<<" << endl;
+		exit( 1 );
+	}
+
+	PushValue( static_cast< Value* >( self.value.ptr_value )[ 0 ], execution_stack, execution_stack_pos );
+}
+
+void HashEntryClass::GetValue( Value &self, Value* execution_stack, size_t &execution_stack_pos, INT_T arg_count )
+{
+	if ( self.type != ARRAY_TYPE || arg_count != 0 ) {
+		wcerr << L">>> expected hash entry type <<<" << endl;
+		exit( 1 );
+	}
+
+	PushValue( static_cast< Value* >( self.value.ptr_value )[ 1 ], execution_stack, execution_stack_pos );
+}
@@ -10,6 +10,7 @@
 #define __CLASS_H__
 
 #include "common.h"
+#include "trace.h"
 
 /****************************
 * Runtime support structures
@@ -48,38 +49,7 @@ protected:
 			exit( 1 );
 		}
 
-#ifdef _DEBUG
-		wcout << L"  push: type=";
-		switch ( value.type ) {
-		case BOOL_TYPE:
-			wcout << L"boolean; value=" << ( value.value.int_value ? L"true" : L"false" ) << L"; stack_pos=" << execution_stack_pos << endl;
-			break;
-
-		case INT_TYPE:
-			wcout << L"integer; value=" << value.value.int_value << L"; stack_pos=" << execution_stack_pos << endl;
-			break;
-
-		case FLOAT_TYPE:
-			wcout << L"float; value=" << value.value.float_value << L"; stack_pos=" << execution_stack_pos << endl;
-			break;
-
-		case CLS_TYPE:
-			wcout << L"system object; address=" << value.value.ptr_value << L"; stack_pos=" << execution_stack_pos << endl;
-			break;
-
-		case ARRAY_TYPE:
-			wcout << L"array; address=" << value.value.ptr_value << "; stack_pos=" << execution_stack_pos << endl;
-			break;
-
-		case UNINIT_TYPE:
-			wcout << L"uninitialized" << endl;
-			break;
-
-			// TODO:
-		default:
-			break;
-		}
-#endif
+		TRACE_VALUE( TRACE_VM, TRACE_ALL, VM_PUSH, value, execution_stack_pos );
 
 		execution_stack[ execution_stack_pos++ ] = value;
 	}
@@ -90,39 +60,7 @@ protected:
 			exit( 1 );
 		}
 
-#ifdef _DEBUG
-		Value &value = execution_stack[ execution_stack_pos - 1 ];
-		wcout << L"  pop: type=";
-		switch ( value.type ) {
-		case BOOL_TYPE:
-			wcout << L"boolean; value=" << ( value.value.int_value ? L"true" : L"false" ) << L"; stack_pos=" << ( execution_stack_pos - 1 ) << endl;
-			break;
-
-		case INT_TYPE:
-			wcout << L"integer; value=" << value.value.int_value << L"; stack_pos=" << ( execution_stack_pos - 1 ) << endl;
-			break;
-
-		case FLOAT_TYPE:
-			wcout << L"float; value=" << value.value.float_value << L"; stack_pos=" << ( execution_stack_pos - 1 ) << endl;
-			break;
-
-		case CLS_TYPE:
-			wcout << L"system object; address=" << value.value.ptr_value << L"; stack_pos=" << ( execution_stack_pos - 1 ) << endl;
-			break;
-
-		case ARRAY_TYPE:
-			wcout << L"array; address=" << value.value.ptr_value << L"; stack_pos=" << ( execution_stack_pos - 1 ) << endl;
-			break;
-
-		case UNINIT_TYPE:
-			wcout << L"uninitialized" << endl;
-			break;
-
-			// TODO:
-		default:
-			break;
-		}
-#endif
+		TRACE_VALUE( TRACE_VM, TRACE_ALL, VM_POP, execution_stack[ execution_stack_pos - 1 ], execution_stack_pos - 1 );
 
 		return execution_stack[ --execution_stack_pos ];
 	}
@@ -173,6 +111,12 @@ public:
 		case NEQL:
 			return NotEqual;
 
+		case BIT_AND:
+			return BitAnd;
+
+		case BIT_OR:
+			return BitOr;
+
 		default:
 			return NULL;
 		}
@@ -180,6 +124,8 @@ public:
 
 	static void Equal( Value &left, Value &right, Value &result );
 	static void NotEqual( Value &left, Value &right, Value &result );
+	static void BitAnd( Value &left, Value &right, Value &result );
+	static void BitOr( Value &left, Value &right, Value &result );
 };
 
 /****************************
@@ -239,6 +185,12 @@ public:
 		case MOD:
 			return Modulo;
 
+		case BIT_AND:
+			return BitAnd;
+
+		case BIT_OR:
+			return BitOr;
+
 		default:
 			return NULL;
 		}
@@ -256,6 +208,8 @@ public:
 	static void Greater( Value &left, Value &right, Value &result );
 	static void LessEqual( Value &left, Value &right, Value &result );
 	static void GreaterEqual( Value &left, Value &right, Value &result );
+	static void BitAnd( Value &left, Value &right, Value &result );
+	static void BitOr( Value &left, Value &right, Value &result );
 
 	// methods
 	static void Abs( Value &self, Value* execution_stack, size_t &execution_stack_pos, INT_T arg_count );
@@ -346,6 +300,7 @@ class ArrayClass : public RuntimeClass {
 
 public:
 	ArrayClass( const wstring &name ) : RuntimeClass( name ) {
+		AddFunction( L"size:0", Size );
 	}
 
 	~ArrayClass() {
@@ -363,8 +318,60 @@ public:
 		return NULL;
 	}
 
+	//
+	// Number of dimensions of an array; its header runs back
+	// from the mark through the dimensions and their count,
+	// so the first header met is the array's own
+	//
+	static int Dimensions( Value* array ) {
+		int dimensions = 1;
+		while ( array[ -( dimensions + 3 ) ].type != META_TYPE ) {
+			++dimensions;
+		}
+
+		return dimensions;
+	}
+
+	//
+	// Offset of an element of an array of 'dimensions'
+	// dimensions, all its indices integers; the first
+	// index is at 'indices' and the others are below it.
+	// False for anything else, out of bounds included,
+	// which is left to the checks that report it
+	//
+	template<int dimensions>
+	static bool Index( Value* indices, Value* array, INT_T &index ) {
+		// a header nearer the mark is an array of fewer dimensions
+		for ( int i = 1; i < dimensions; ++i ) {
+			if ( array[ -( i + 3 ) ].type == META_TYPE ) {
+				return false;
+			}
+		}
+
+		Value* meta = array - ( dimensions + 2 + 1 );
+		if ( meta[ 0 ].type != META_TYPE || indices[ 0 ].type != INT_TYPE ) {
+			return false;
+		}
+
+		index = indices[ 0 ].value.int_value;
+		if ( index < 0 || index >= meta[ 2 ].value.int_value ) {
+			return false;
+		}
+
+		for ( int i = 1; i < dimensions; ++i ) {
+			if ( indices[ -i ].type != INT_TYPE || indices[ -i ].value.int_value < 0 ||
+				indices[ -i ].value.int_value >= meta[ 2 + i ].value.int_value ) {
+				return false;
+			}
+			index = index * meta[ 2 + i ].value.int_value + indices[ -i ].value.int_value;
+		}
+
+		return true;
+	}
+
 	// methods
 	static void New( Value &self, Value* execution_stack, size_t &execution_stack_pos, INT_T arg_count );
+	static void Size( Value &self, Value* execution_stack, size_t &execution_stack_pos, INT_T arg_count );
 };
 
 /****************************
@@ -404,4 +411,118 @@ public:
 	static void Size( Value &self, Value* execution_stack, size_t &execution_stack_pos, INT_T arg_count );
 };
 
+/****************************
+* Hash table storage; entries
+* keep their insertion order.
+* String keys hash by content,
+* so mutating a string after
+* using it as a key loses it
+****************************/
+class HashTable {
+	struct KeyHash {
+		size_t operator()( Value const &key ) const;
+	};
+
+	struct KeyEqual {
+		bool operator()( Value const &left, Value const &right ) const;
+	};
+
+	std::vector<std::pair<Value, Value>> entries;
+	std::unordered_map<Value, size_t, KeyHash, KeyEqual> index;
+
+public:
+	Value* Find( Value const &key ) {
+		auto const result = index.find( key );
+		if ( result != index.end() ) {
+			return &entries[ result->second ].second;
+		}
+
+		return nullptr;
+	}
+
+	void Insert( Value const &key, Value const &value ) {
+		auto const result = index.find( key );
+		if ( result != index.end() ) {
+			entries[ result->second ].second = value;
+		}
+		else {
+			index.insert( { key, entries.size() } );
+			entries.push_back( { key, value } );
+		}
+	}
+
+	size_t Size() const {
+		return entries.size();
+	}
+
+	std::vector<std::pair<Value, Value>>& GetEntries() {
+		return entries;
+	}
+};
+
+/****************************
+* Hash class
+****************************/
+class HashClass : public RuntimeClass {
+	static HashClass* instance;
+
+public:
+	HashClass( const wstring &name ) : RuntimeClass( name ) {
+		AddFunction( L"size:0", Size );
+	}
+
+	~HashClass() {
+	}
+
+	static HashClass* Instance() {
+		if ( !instance ) {
+			instance = new HashClass( L"Hash" );
+		}
+
+		return instance;
+	}
+
+	virtual Operation GetOperation( InstructionType oper ) {
+		return NULL;
+	}
+
+	// methods
+	static void Size( Value &self, Value* execution_stack, size_t &execution_stack_pos, INT_T arg_count );
+};
+
+/****************************
+* Hash entry class; an entry is
+* a two element array of its
+* key and value, made for each
+* entry when foreach walks a hash
+****************************/
+class HashEntryClass : public RuntimeClass {
+	static HashEntryClass* instance;
+
+public:
+	HashEntryClass( const wstring &name ) : RuntimeClass( name ) {
+		AddFunction( L"key:0", Key );
+		AddFunction( L"value:0", GetValue );
+	}
+
+	~HashEntryClass() {
+	}
+
+	static HashEntryClass* Instance() {
+		if ( !instance ) {
+			instance = new HashEntryClass( L"HashEntry" );
+		}
+
+		return instance;
+	}
+
+	virtual Operation GetOperation( InstructionType oper ) {
+		return NULL;
+	}
+
+	// methods
+	static void Key( Value &self, Value* execution_stack, size_t &execution_stack_pos, INT_T arg_count );
+	static void GetValue( Value &self, Value* execution_stack, size_t &execution_stack_pos, INT_T arg_count );
+};
+
 #endif
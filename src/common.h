@@ -42,6 +42,9 @@ using namespace stdext;
 class RuntimeClass;
 class ExecutableClass;
 struct _Value;
+namespace runtime {
+	struct Method;
+}
 
 // basic datatypes
 #define INT_T long
@@ -59,7 +62,7 @@ struct _Value;
 ****************************/
 #include <string>
 
-inline std::wstring IntToString( int v ) {
+inline std::wstring IntToString( INT_T v ) {
 	return std::to_wstring( v );
 }
 
@@ -72,10 +75,15 @@ enum InstructionType {
 	LOAD_FALSE_LIT,
 	LOAD_INT_LIT,
 	LOAD_FLOAT_LIT,
+	LOAD_CHAR_LIT,
+	LOAD_NIL_LIT,
 	// variables
 	LOAD_VAR,
+	LOAD_FIELD,
 	LOAD_CLS,
 	STOR_VAR,
+	POP,
+	MOV,
 	// logical operations
 	EQL,
 	NEQL,
@@ -92,8 +100,27 @@ enum InstructionType {
 	// bitwise operations
 	BIT_AND,
 	BIT_OR,
+	// operations on operands inferred to be integers or floats
+	EQL_INT,
+	NEQL_INT,
+	GTR_INT,
+	LES_INT,
+	GTR_EQL_INT,
+	LES_EQL_INT,
+	ADD_INT,
+	SUB_INT,
+	MUL_INT,
+	GTR_FLOAT,
+	LES_FLOAT,
+	GTR_EQL_FLOAT,
+	LES_EQL_FLOAT,
+	ADD_FLOAT,
+	SUB_FLOAT,
+	MUL_FLOAT,
+	DIV_FLOAT,
 	// conditionals
 	JMP,
+	JMP_TBL,
 	LBL,
 	// arrays
 	NEW_ARRAY,
@@ -101,21 +128,65 @@ enum InstructionType {
 	NEW_HASH,
 	STOR_ARY_VAR,
 	LOAD_ARY_VAR,
+	// a one-dimensional array at an index known to be within it
+	STOR_ARY_ELEM,
+	LOAD_ARY_ELEM,
 	ARY_SIZE,
+	// the size of an array, nil for anything else
+	TRY_ARY_SIZE,
+	// what foreach walks: an array as it is, a hash as an array of its entries
+	ARY_ENTRIES,
 	// objects
 	NEW_OBJ,
+	// an instance that never leaves the function, kept in its frame
+	LOCAL_OBJ,
 	// functions
+	NEW_FUNC,
 	CALL_FUNC,
+	TAIL_CALL,
 	RTRN,
+	// superinstructions; each is followed by the sequence it stands for
+	INC_LOCAL_INT,
+	LOAD_LOCAL_PAIR,
+	LOAD_INT_LOCAL,
+	CMP_JMP_EQL,
+	CMP_JMP_NEQL,
+	CMP_JMP_GTR,
+	CMP_JMP_LES,
+	CMP_JMP_GTR_EQL,
+	CMP_JMP_LES_EQL,
+	KNOWN_SIZE,
 	// misc
 	SHOW_TYPE,
 	NO_OP
 };
 
+inline const wchar_t* InstructionName( InstructionType type ) {
+	static const wchar_t* names[] = {
+		L"LOAD_TRUE_LIT", L"LOAD_FALSE_LIT", L"LOAD_INT_LIT", L"LOAD_FLOAT_LIT", L"LOAD_CHAR_LIT", L"LOAD_NIL_LIT",
+		L"LOAD_VAR", L"LOAD_FIELD", L"LOAD_CLS", L"STOR_VAR", L"POP", L"MOV",
+		L"EQL", L"NEQL", L"GTR", L"LES", L"GTR_EQL", L"LES_EQL",
+		L"ADD", L"SUB", L"MUL", L"DIV", L"MOD",
+		L"BIT_AND", L"BIT_OR",
+		L"EQL_INT", L"NEQL_INT", L"GTR_INT", L"LES_INT", L"GTR_EQL_INT", L"LES_EQL_INT", L"ADD_INT", L"SUB_INT", L"MUL_INT",
+		L"GTR_FLOAT", L"LES_FLOAT", L"GTR_EQL_FLOAT", L"LES_EQL_FLOAT", L"ADD_FLOAT", L"SUB_FLOAT", L"MUL_FLOAT", L"DIV_FLOAT",
+		L"JMP", L"JMP_TBL", L"LBL",
+		L"NEW_ARRAY", L"NEW_STRING", L"NEW_HASH", L"STOR_ARY_VAR", L"LOAD_ARY_VAR", L"STOR_ARY_ELEM", L"LOAD_ARY_ELEM", L"ARY_SIZE", L"TRY_ARY_SIZE", L"ARY_ENTRIES",
+		L"NEW_OBJ", L"LOCAL_OBJ",
+		L"NEW_FUNC", L"CALL_FUNC", L"TAIL_CALL", L"RTRN",
+		L"INC_LOCAL_INT", L"LOAD_LOCAL_PAIR", L"LOAD_INT_LOCAL", L"CMP_JMP_EQL", L"CMP_JMP_NEQL", L"CMP_JMP_GTR", L"CMP_JMP_LES", L"CMP_JMP_GTR_EQL", L"CMP_JMP_LES_EQL", L"KNOWN_SIZE",
+		L"SHOW_TYPE", L"NO_OP"
+	};
+	static_assert( sizeof( names ) / sizeof( names[ 0 ] ) == NO_OP - LOAD_TRUE_LIT + 1, "every instruction needs a name" );
+
+	return names[ type - LOAD_TRUE_LIT ];
+}
+
 enum VScope {
 	LOCL = -512,
 	INST,
-	CLS
+	CLS,
+	GLOB
 };
 
 typedef struct _Instruction {
@@ -126,8 +197,25 @@ typedef struct _Instruction {
 	FLOAT_T operand4;
 	std::wstring operand5;
 	std::wstring operand6;
+	int line;				// of the statement it was emitted for; 0 if unknown
 } Instruction;
 
+/****************************
+* Register machine instruction;
+* non-negative operands name
+* frame slots and negative ones
+* the function's constants
+****************************/
+typedef struct _RegisterInstruction {
+	InstructionType type;
+	INT_T operand1;
+	INT_T operand2;
+	INT_T operand3;
+	INT_T operand4;
+	std::wstring operand5;
+	int line;
+} RegisterInstruction;
+
 /****************************
 * Runtime types and values
 ****************************/
@@ -139,6 +227,7 @@ enum RuntimeType {
 	ARRAY_TYPE,
 	STRING_TYPE,
 	HASH_TYPE,
+	FUNC_TYPE, // closure
 	// basic
 	FLOAT_TYPE,
 	BOOL_TYPE,
@@ -146,12 +235,21 @@ enum RuntimeType {
 	CHAR_TYPE
 };
 
+inline const wchar_t* RuntimeTypeName( RuntimeType type ) {
+	static const wchar_t* names[] = {
+		L"nil", L"meta", L"object", L"array", L"string", L"hash", L"function", L"float", L"boolean", L"integer", L"char"
+	};
+	static_assert( sizeof( names ) / sizeof( names[ 0 ] ) == CHAR_TYPE - UNINIT_TYPE + 1, "every type needs a name" );
+
+	return type >= UNINIT_TYPE && type <= CHAR_TYPE ? names[ type - UNINIT_TYPE ] : L"unknown";
+}
+
 /****************************
  * 'Abstract' value type
  ****************************/
 class Value {
 public:
-	Value(): sys_klass( nullptr ), user_klass( nullptr ) {
+	Value(): type( UNINIT_TYPE ), sys_klass( nullptr ), user_klass( nullptr ) {
 	}
 
 	Value( RuntimeType t ): type( t ), sys_klass( nullptr ), user_klass( nullptr ) {
@@ -182,6 +280,13 @@ class ExecutableFunction {
 	std::unordered_map<long, size_t> jump_table;
 	bool returns_value;
 	std::set<size_t> leaders;
+	// register machine form
+	std::vector<RegisterInstruction> register_instructions;
+	std::vector<Value> constants;
+	int register_count;
+	// calls made to it, and the machine code it's compiled to once they're many
+	size_t call_count;
+	runtime::Method* method;
 
 public:
 	explicit ExecutableFunction( const std::wstring &name, InstructionType operation, int local_count, int parameter_count,
@@ -195,6 +300,9 @@ public:
 		this->jump_table = std::move( jump_table );
 		this->leaders = leaders;
 		this->returns_value = returns_value;
+		this->register_count = 0;
+		this->call_count = 0;
+		this->method = nullptr;
 	}
 
 	~ExecutableFunction() = default;
@@ -219,6 +327,11 @@ public:
 		return local_count;
 	}
 
+	// a slot after the others, for values the optimizers keep
+	inline INT_T AddLocal() {
+		return ++local_count;
+	}
+
 	inline bool ReturnsValue() {
 		return returns_value;
 	}
@@ -230,6 +343,78 @@ public:
 	inline std::unordered_map<long, size_t>& GetJumpTable() {
 		return jump_table;
 	}
+
+	// basic blocks start at labels and after jumps and returns
+	static std::set<size_t> FindLeaders( std::vector<Instruction*> &instructions ) {
+		std::set<size_t> leaders;
+		leaders.insert( 0 );
+		for ( size_t i = 0; i < instructions.size(); ++i ) {
+			switch ( instructions[ i ]->type ) {
+			case LBL:
+				leaders.insert( i );
+				break;
+
+			case JMP:
+			case JMP_TBL:
+			case RTRN:
+				leaders.insert( i + 1 );
+				break;
+
+			default:
+				break;
+			}
+		}
+		leaders.erase( instructions.size() );
+
+		return leaders;
+	}
+
+	inline std::set<size_t>& GetLeaders() {
+		return leaders;
+	}
+
+	// rewritten code; labels and leaders are found again
+	void SetInstructions( std::vector<Instruction*> && instructions ) {
+		block_instructions = std::move( instructions );
+		jump_table.clear();
+		for ( size_t i = 0; i < block_instructions.size(); ++i ) {
+			if ( block_instructions[ i ]->type == LBL ) {
+				jump_table.insert( { block_instructions[ i ]->operand1, i } );
+			}
+		}
+		leaders = FindLeaders( block_instructions );
+	}
+
+	void SetRegisterCode( std::vector<RegisterInstruction> && instructions, std::vector<Value> && constants, int register_count ) {
+		this->register_instructions = std::move( instructions );
+		this->constants = std::move( constants );
+		this->register_count = register_count;
+	}
+
+	inline std::vector<RegisterInstruction>& GetRegisterInstructions() {
+		return register_instructions;
+	}
+
+	inline std::vector<Value>& GetConstants() {
+		return constants;
+	}
+
+	// frame size: 'self', locals and operand slots
+	inline int GetRegisterCount() {
+		return register_count;
+	}
+
+	inline size_t CountCall() {
+		return ++call_count;
+	}
+
+	inline runtime::Method* GetMethod() {
+		return method;
+	}
+
+	inline void SetMethod( runtime::Method* method ) {
+		this->method = method;
+	}
 };
 
 typedef void( *Operation )( Value &left, Value &right, Value &result );
@@ -255,6 +440,11 @@ public:
 			tmp = nullptr;
 		}
 		functions.clear();
+
+		for ( auto & iter : operations ) {
+			delete iter.second;
+		}
+		operations.clear();
 	}
 
 	const std::wstring GetName() {
@@ -294,6 +484,14 @@ public:
 
 		return nullptr;
 	}
+
+	std::unordered_map<std::wstring, ExecutableFunction*>& GetFunctions() {
+		return functions;
+	}
+
+	std::unordered_map<long, ExecutableFunction*>& GetOperations() {
+		return operations;
+	}
 };
 
 /****************************
@@ -305,7 +503,7 @@ class ExecutableProgram {
 	std::unordered_map<std::wstring, ExecutableClass*> classes;
 
 public:
-	ExecutableProgram() {
+	ExecutableProgram(): main_function( nullptr ) {
 	}
 
 	~ExecutableProgram() {
@@ -319,6 +517,10 @@ public:
 			delete tmp;
 			tmp = nullptr;
 		}
+
+		for ( auto & klass_iter : classes ) {
+			delete klass_iter.second;
+		}
 	}
 
 	void SetMain( ExecutableFunction* main_function ) {
@@ -357,6 +559,32 @@ public:
 
 		return nullptr;
 	}
+
+	std::unordered_map<std::wstring, ExecutableFunction*>& GetFunctions() {
+		return functions;
+	}
+
+	std::unordered_map<std::wstring, ExecutableClass*>& GetClasses() {
+		return classes;
+	}
+
+	// the global function first, then functions, methods and operators
+	std::vector<ExecutableFunction*> GetAllFunctions() {
+		std::vector<ExecutableFunction*> all_functions{ main_function };
+		for ( auto &entry : functions ) {
+			all_functions.push_back( entry.second );
+		}
+		for ( auto &klass : classes ) {
+			for ( auto &entry : klass.second->GetFunctions() ) {
+				all_functions.push_back( entry.second );
+			}
+			for ( auto &entry : klass.second->GetOperations() ) {
+				all_functions.push_back( entry.second );
+			}
+		}
+
+		return all_functions;
+	}
 };
 
 /****************************
@@ -566,7 +794,7 @@ static wchar_t* LoadFileBuffer( const std::wstring &name, size_t& buffer_size )
 	size_t wsize = mbstowcs(NULL, buffer, buffer_size);
 	if(wsize == (size_t)-1) {
 		delete buffer;
-		wcerr << L"Unable to open source file: " << name << endl;
+		std::wcerr << L"Unable to open source file: " << name << std::endl;
 		exit(1);
 	}
 	wchar_t* wbuffer = new wchar_t[wsize + 1];
@@ -574,7 +802,7 @@ static wchar_t* LoadFileBuffer( const std::wstring &name, size_t& buffer_size )
 	if(check == (size_t)-1) {
 		delete buffer;
 		delete[] wbuffer;
-		wcerr << L"Unable to open source file: " << name << endl;
+		std::wcerr << L"Unable to open source file: " << name << std::endl;
 		exit(1);
 	}
 	wbuffer[wsize] = L'\0';
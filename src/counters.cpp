@@ -0,0 +1,198 @@
+/***************************************************************************
+ * Execution counters
+ *
+ * Copyright (c) 2017 Joshua Ogunyinka
+ * All rights reserved.
+*/
+
+#include <algorithm>
+#include "counters.h"
+
+using namespace runtime;
+
+Counters* Counters::pending;
+
+Counters::Counters( std::wstring const &file_name, std::vector<size_t> const &opcode_pairs ) : file_name( file_name ), opcode_pairs( opcode_pairs ),
+	lookups()
+{
+	static bool is_registered = false;
+	if ( !is_registered ) {
+		std::atexit( WriteAtExit );
+		is_registered = true;
+	}
+	pending = this;
+}
+
+Counters::~Counters()
+{
+	if ( pending == this ) {
+		pending = nullptr;
+	}
+}
+
+void Counters::WriteAtExit()
+{
+	if ( pending ) {
+		pending->Write();
+	}
+}
+
+void Counters::Call( Instruction* site, ExecutableFunction* caller, size_t ip, Lookup lookup, const void* target, bool is_found )
+{
+	++lookups[ lookup ][ is_found ? 0 : 1 ];
+	if ( !is_found ) {
+		return;
+	}
+
+	auto result = sites.find( site );
+	if ( result == sites.end() ) {
+		result = sites.insert( { site, CallSite{ caller, ip, lookup, 0, 0, nullptr, {} } } ).first;
+	}
+	CallSite &call_site = result->second;
+	++call_site.calls;
+	if ( call_site.last == target ) {
+		++call_site.repeats;
+	}
+	call_site.last = target;
+	call_site.targets.insert( target );
+}
+
+std::wstring Counters::Quote( std::wstring const &text )
+{
+	std::wstring quoted = L"\"";
+	for ( wchar_t character : text ) {
+		if ( character == L'"' || character == L'\\' ) {
+			quoted += L'\\';
+			quoted += character;
+		}
+		else if ( character < 0x20 ) {
+			static const wchar_t digits[] = L"0123456789abcdef";
+			quoted += L"\\u00";
+			quoted += digits[ character >> 4 ];
+			quoted += digits[ character & 0xf ];
+		}
+		else {
+			quoted += character;
+		}
+	}
+	quoted += L'"';
+
+	return quoted;
+}
+
+/****************************
+ * Everything counted, each list
+ * most frequent first. An
+ * instruction's executions are
+ * those of the pairs it ends; the
+ * first instruction run pairs with
+ * NO_OP
+ ****************************/
+bool Counters::Write()
+{
+	pending = nullptr;
+
+	const size_t type_count = NO_OP - LOAD_TRUE_LIT + 1;
+	std::vector<std::pair<size_t, size_t>> opcodes;
+	std::vector<std::pair<size_t, size_t>> pairs;
+	size_t total = 0;
+	for ( size_t second = 0; second < type_count; ++second ) {
+		size_t count = 0;
+		for ( size_t first = 0; first < type_count; ++first ) {
+			const size_t pair_count = opcode_pairs[ first * type_count + second ];
+			if ( pair_count ) {
+				pairs.push_back( { pair_count, first * type_count + second } );
+				count += pair_count;
+			}
+		}
+		if ( count ) {
+			opcodes.push_back( { count, second } );
+			total += count;
+		}
+	}
+	const auto by_count = []( std::pair<size_t, size_t> const &a, std::pair<size_t, size_t> const &b ) {
+		return a.first != b.first ? a.first > b.first : a.second < b.second;
+	};
+	std::sort( opcodes.begin(), opcodes.end(), by_count );
+	std::sort( pairs.begin(), pairs.end(), by_count );
+
+#ifdef _WIN32
+	std::wofstream out( file_name.c_str() );
+#else
+	std::wofstream out( UnicodeToBytes( file_name ) );
+#endif
+	out << L"{" << std::endl;
+	out << L"  \"instructions\": " << total << L"," << std::endl;
+
+	out << L"  \"opcodes\": {";
+	for ( size_t i = 0; i < opcodes.size(); ++i ) {
+		out << ( i ? L"," : L"" ) << std::endl << L"    " << Quote( InstructionName( static_cast< InstructionType >( opcodes[ i ].second + LOAD_TRUE_LIT ) ) )
+			<< L": " << opcodes[ i ].first;
+	}
+	out << std::endl << L"  }," << std::endl;
+
+	out << L"  \"pairs\": [";
+	for ( size_t i = 0; i < pairs.size(); ++i ) {
+		const InstructionType first = static_cast< InstructionType >( pairs[ i ].second / type_count + LOAD_TRUE_LIT );
+		const InstructionType second = static_cast< InstructionType >( pairs[ i ].second % type_count + LOAD_TRUE_LIT );
+		out << ( i ? L"," : L"" ) << std::endl << L"    { \"first\": " << Quote( InstructionName( first ) ) << L", \"second\": "
+			<< Quote( InstructionName( second ) ) << L", \"count\": " << pairs[ i ].first << L" }";
+	}
+	out << std::endl << L"  ]," << std::endl;
+
+	typedef std::pair<size_t, std::pair<InstructionType, std::pair<RuntimeType, RuntimeType>>> OperandCount;
+	std::vector<OperandCount> operand_counts;
+	for ( auto &operand : operands ) {
+		operand_counts.push_back( { operand.second, operand.first } );
+	}
+	std::sort( operand_counts.begin(), operand_counts.end(), []( OperandCount const &a, OperandCount const &b ) {
+		return a.first != b.first ? a.first > b.first : a.second < b.second;
+	} );
+	out << L"  \"operands\": [";
+	for ( size_t i = 0; i < operand_counts.size(); ++i ) {
+		out << ( i ? L"," : L"" ) << std::endl << L"    { \"instruction\": " << Quote( InstructionName( operand_counts[ i ].second.first ) )
+			<< L", \"left\": " << Quote( RuntimeTypeName( operand_counts[ i ].second.second.first ) ) << L", \"right\": "
+			<< Quote( RuntimeTypeName( operand_counts[ i ].second.second.second ) ) << L", \"count\": " << operand_counts[ i ].first << L" }";
+	}
+	out << std::endl << L"  ]," << std::endl;
+
+	static const wchar_t* lookup_names[ LOOKUP_KINDS ] = { L"closure", L"method", L"function", L"builtin" };
+	out << L"  \"lookups\": {";
+	for ( int i = 0; i < LOOKUP_KINDS; ++i ) {
+		out << ( i ? L"," : L"" ) << std::endl << L"    " << Quote( lookup_names[ i ] ) << L": { \"found\": " << lookups[ i ][ 0 ]
+			<< L", \"missing\": " << lookups[ i ][ 1 ] << L" }";
+	}
+	out << std::endl << L"  }," << std::endl;
+
+	std::vector<std::pair<Instruction*, CallSite*>> call_sites;
+	for ( auto &site : sites ) {
+		call_sites.push_back( { site.first, &site.second } );
+	}
+	std::sort( call_sites.begin(), call_sites.end(), []( std::pair<Instruction*, CallSite*> const &a, std::pair<Instruction*, CallSite*> const &b ) {
+		if ( a.second->calls != b.second->calls ) {
+			return a.second->calls > b.second->calls;
+		}
+		if ( a.second->caller->GetName() != b.second->caller->GetName() ) {
+			return a.second->caller->GetName() < b.second->caller->GetName();
+		}
+		return a.second->ip < b.second->ip;
+	} );
+	out << L"  \"call_sites\": [";
+	for ( size_t i = 0; i < call_sites.size(); ++i ) {
+		Instruction* site = call_sites[ i ].first;
+		CallSite* call_site = call_sites[ i ].second;
+		out << ( i ? L"," : L"" ) << std::endl << L"    { \"function\": " << Quote( call_site->caller->GetName() ) << L", \"line\": " << site->line
+			<< L", \"ip\": " << call_site->ip << L", \"callee\": " << Quote( site->operand5 ) << L", \"lookup\": " << Quote( lookup_names[ call_site->lookup ] )
+			<< L", \"calls\": " << call_site->calls << L", \"repeats\": " << call_site->repeats << L", \"targets\": " << call_site->targets.size() << L" }";
+	}
+	out << std::endl << L"  ]" << std::endl;
+	out << L"}" << std::endl;
+	out.close();
+
+	if ( out.fail() ) {
+		std::wcerr << L"Unable to write counters file: " << file_name << std::endl;
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,81 @@
+/***************************************************************************
+ * Execution counters
+ *
+ * Copyright (c) 2017 Joshua Ogunyinka
+ * All rights reserved.
+*/
+
+#ifndef __COUNTERS_H__
+#define __COUNTERS_H__
+
+#include "common.h"
+
+namespace runtime {
+	/****************************
+	 * What the stack machine did, for
+	 * deciding which instructions to
+	 * specialize or fuse: executions of
+	 * each instruction and each pair,
+	 * the types of the operands the
+	 * untyped operations saw, how calls
+	 * found what they called and, for
+	 * each call site, how often a cache
+	 * keyed on the last receiver's class
+	 * would have held. Written as JSON
+	 * when the program ends, even when
+	 * it ends in an error
+	 ****************************/
+	class Counters {
+	public:
+		// how a call finds what it calls
+		enum Lookup {
+			CLOSURE,
+			METHOD,
+			FUNCTION,
+			BUILTIN,
+			LOOKUP_KINDS
+		};
+
+	private:
+		struct CallSite {
+			ExecutableFunction* caller;
+			size_t ip;
+			Lookup lookup;
+			size_t calls;
+			size_t repeats;						// calls to the same target as the one before
+			const void* last;
+			std::set<const void*> targets;
+		};
+
+		// the one written at exit, if the program doesn't end normally
+		static Counters* pending;
+
+		std::wstring file_name;
+		std::vector<size_t> const &opcode_pairs;
+		std::unordered_map<Instruction*, CallSite> sites;
+		std::map<std::pair<InstructionType, std::pair<RuntimeType, RuntimeType>>, size_t> operands;
+		size_t lookups[ LOOKUP_KINDS ][ 2 ];
+
+		static void WriteAtExit();
+		static std::wstring Quote( std::wstring const &text );
+
+	public:
+		// 'opcode_pairs' are counted by the runtime, which has them to hand
+		Counters( std::wstring const &file_name, std::vector<size_t> const &opcode_pairs );
+		~Counters();
+
+		// before 'instruction' runs; the left operand is on top
+		void Execute( Instruction* instruction, Value* stack, size_t stack_pos ) {
+			if ( instruction->type >= EQL && instruction->type <= BIT_OR && stack_pos >= 2 ) {
+				++operands[ { instruction->type, { stack[ stack_pos - 1 ].type, stack[ stack_pos - 2 ].type } } ];
+			}
+		}
+
+		// 'target' is what a cache at the site would be keyed on: the receiver's class, or the function called
+		void Call( Instruction* site, ExecutableFunction* caller, size_t ip, Lookup lookup, const void* target, bool is_found );
+
+		bool Write();
+	};
+}
+
+#endif
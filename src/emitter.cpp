@@ -6,7 +6,10 @@
  * All rights reserved.
 */
 
+#include <algorithm>
+
 #include "emitter.h"
+#include "types.hpp"
 
 using namespace compiler;
 using std::wcout;
@@ -15,17 +18,26 @@ using std::endl;
 
 vector<Instruction*> Emitter::instruction_factory;
 
+/****************************
+ * Releases every instruction made
+ ****************************/
+void Emitter::ClearInstructions()
+{
+	for ( Instruction* instruction : instruction_factory ) {
+		delete instruction;
+	}
+	instruction_factory.clear();
+}
+
 /****************************
  * Emits an error
  ****************************/
 void Emitter::ProcessError( ParseNode* node, const wstring &msg )
 {
-#ifdef _DEBUG
-	wcout << L"\tError: " << node->GetFileName() << L":" << node->GetLineNumber() << L": " << msg << endl;
-#endif
+	TRACE( TRACE_EMIT, TRACE_EVENTS, EMIT_ERROR, msg, node->GetLineNumber() );
 
 	const wstring &str_line_num = IntToString( node->GetLineNumber() );
-	errors.insert( pair<int, wstring>( node->GetLineNumber(), node->GetFileName() + L":" + str_line_num + L": " + msg ) );
+	errors.insert( { { node->GetFileName(), node->GetLineNumber() }, node->GetFileName() + L":" + str_line_num + L": " + msg } );
 }
 
 /****************************
@@ -33,24 +45,21 @@ void Emitter::ProcessError( ParseNode* node, const wstring &msg )
  ****************************/
 void Emitter::ProcessError( const wstring &msg )
 {
-#ifdef _DEBUG
-	wcout << L"\tError: " << msg << endl;
-#endif
+	TRACE( TRACE_EMIT, TRACE_EVENTS, EMIT_ERROR, msg, 0 );
 
-	errors.insert( pair<int, wstring>( 0, msg ) );
+	errors.insert( { { wstring(), 0 }, msg } );
 }
 
 /****************************
  * Check for errors detected
- * during the contextual
- * analysis process.
+ * while emitting
  ****************************/
 bool Emitter::NoErrors()
 {
 	// check and process errors
 	if ( errors.size() ) {
 		for ( auto error = errors.begin(); error != errors.end(); ++error ) {
-			wcerr << error->second << endl;
+			wcerr << L"Error: " << error->second << endl;
 		}
 
 		return false;
@@ -64,1006 +73,1963 @@ bool Emitter::NoErrors()
  ****************************/
 std::unique_ptr<ExecutableProgram> Emitter::Emit()
 {
-	std::unique_ptr<ExecutableProgram> executable_program{ new ExecutableProgram };
-
-	// emit classes
-	vector<ParsedClass*> klasses = parsed_program->GetClasss();
-	for ( size_t i = 0; i < klasses.size(); ++i ) {
-		ParsedClass* klass = klasses[ i ];
-		SymbolTable* klass_table = klass->GetSymbolTable();
-		klass_table->SetIds();
-
-		executable_program->AddClass( EmitClass( klass ) );
-	}
-
-	// emit global statements
-	vector<Instruction*> block_instructions{}; // = new vector<Instruction*>;
-	unordered_map<long, size_t> jump_table{};// = new unordered_map<long, size_t>;
-
-	SymbolTable* global_table = parsed_program->GetGlobalSymbolTable();
-	global_table->SetIds();
-
-#ifdef _DEBUG
-	wcout << L"---------- Emitting Global Statements ---------" << endl;
-#endif
-	std::set<size_t> leaders;
-	EmitFunction( parsed_program->GetGlobal(), block_instructions, jump_table, leaders );
-#ifdef _DEBUG
-	wcout << ( block_instructions.size() + 1 ) << L": " << L"return" << endl;
-#endif
-	block_instructions.push_back( MakeInstruction( RTRN ) );
-
-	const int local_count = parsed_program->GetLocalCount();
-	ExecutableFunction* global = new ExecutableFunction( L"#GLOBAL#", NO_OP, local_count, 0, 
-		std::move( block_instructions ), std::move( jump_table ), leaders, false );
-	executable_program->SetMain( global );
-
-	// emit functions
-	vector<ParsedFunction*> functions = parsed_program->GetFunctions();
-	for ( size_t i = 0; i < functions.size(); i++ ) {
-		ParsedFunction* parsed_function = functions[ i ];
-		SymbolTable* function_table = parsed_function->GetSymbolTable();
-		function_table->SetIds();
-		executable_program->AddFunction( EmitFunction( parsed_function ) );
-	}
-	
+	std::unique_ptr<ExecutableProgram> program{ new ExecutableProgram };
+	executable_program = program.get();
+
+	Scope* global_scope = parsed_program->GetGlobalScope();
+	FunctionContext global_context{ nullptr, nullptr, false };
+	global = function = &global_context;
+	current_scope = global_scope;
+
+	TRACE( TRACE_EMIT, TRACE_EVENTS, EMIT_PROGRAM );
+	// classes are known everywhere, whatever their place in the source
+	RegisterClasses( global_scope );
+	EnterScope( global_scope );
+	EmitStatements( global_scope );
+	EmitInstruction( MakeInstruction( RTRN ) );
+	executable_program->SetMain( MakeFunction( L"#GLOBAL#", NO_OP, 0, false ) );
+
+	function = global = nullptr;
+	current_scope = nullptr;
+	executable_program = nullptr;
+
 	// free the parsed_program
 	parsed_program.reset();
 
 	// check for errors
 	if ( NoErrors() ) {
-		return executable_program;
+		return program;
 	}
 	return nullptr;
 }
 
-ExecutableClass* Emitter::EmitClass( ParsedClass* parsed_klass )
+/****************************
+ * Instruction stream of the
+ * current function
+ ****************************/
+void Emitter::EmitInstruction( Instruction* instruction )
 {
-#ifdef _DEBUG
-	wcout << L"\n========== Emitting Class: name='" << parsed_klass->GetName() << L"' ==========" << endl;
-#endif
-
-	// TODO: emit instance statements
-	vector<Statement*> instance_stmts = parsed_klass->GetDeclarations()->GetStatements();
-	for ( size_t i = 0; i < instance_stmts.size(); ++i ) {
-	}
-
-	const int inst_count = static_cast< int >( parsed_klass->GetDeclarations()->GetStatements().size() );
-	ExecutableClass* klass = new ExecutableClass( parsed_klass->GetName(), inst_count );
+	instruction->line = line;
+	function->instructions.push_back( instruction );
+}
 
-	// emit functions
-	vector<ParsedFunction*> functions = parsed_klass->GetFunctions();
-	for ( size_t i = 0; i < functions.size(); ++i ) {
-		klass->AddFunction( EmitFunction( functions[ i ] ) );
-	}
+void Emitter::EmitLabel( INT_T label )
+{
+	function->jump_table.insert( { label, function->instructions.size() } );
+	EmitInstruction( MakeInstruction( LBL, label, 0L ) );
+}
 
-	return klass;
+void Emitter::EmitJump( INT_T label, INT_T condition )
+{
+	EmitInstruction( MakeInstruction( JMP, label, condition ) );
 }
 
-ExecutableFunction* Emitter::EmitFunction( ParsedFunction* parsed_function )
+// fields and captures of 'self' skip the scope dispatch
+void Emitter::EmitLoad( Slot const &slot )
 {
-#ifdef _DEBUG
-	wcout << L"\n---------- Emitting Function: name='" << parsed_function->GetName() << L"' ---------" << endl;
-#endif
+	EmitInstruction( MakeInstruction( slot.scope == INST ? LOAD_FIELD : LOAD_VAR, static_cast< INT_T >( slot.scope ), slot.id ) );
+}
 
-	// create holders
-	returns_value = -1;
-	vector<Instruction*> block_instructions{};
-	unordered_map<long, size_t> jump_table{};
-	std::set<size_t> leaders;
+void Emitter::EmitStore( Slot const &slot )
+{
+	EmitInstruction( MakeInstruction( STOR_VAR, static_cast< INT_T >( slot.scope ), slot.id ) );
+}
 
-	vector<Expression*> parameters = parsed_function->GetParameters()->GetExpressions();
-	for ( size_t i = 0; i < parameters.size(); ++i ) {
-		Reference* reference = static_cast< Reference* >( parameters[ i ] );
-#ifdef _DEBUG
-		wcout << ( block_instructions.size() + 1 ) << L": " << L"store: name='" << reference->GetName()
-			<< L"', id=" << reference->GetDeclaration()->GetId() << endl;
-#endif
-		block_instructions.push_back( MakeInstruction( STOR_VAR, LOCL, reference->GetDeclaration()->GetId() ) );
+// scratch locals for values that must outlive an expression
+INT_T Emitter::NewTemporary()
+{
+	if ( function->free_temporaries.size() ) {
+		INT_T id = function->free_temporaries.back();
+		function->free_temporaries.pop_back();
+		return id;
 	}
+	return ++function->local_count;
+}
 
-	// emit function
-	StatementList* statement_list = parsed_function->GetStatements();
-	EmitFunction( statement_list, block_instructions, jump_table, leaders );
-
-	// new call
-	if ( parsed_function->IsNew() ) {
-#ifdef _DEBUG
-		wcout << ( block_instructions.size() + 1 ) << L": " << L"load local, name='self', id=0" << endl;
-#endif
-		block_instructions.push_back( MakeInstruction( LOAD_VAR, LOCL, 0 ) );
-	}
+void Emitter::ReleaseTemporary( INT_T id )
+{
+	function->free_temporaries.push_back( id );
+}
 
-	// check return type
-	if ( block_instructions.size() == 0 || block_instructions.back()->type != RTRN ) {
-#ifdef _DEBUG
-		wcout << ( block_instructions.size() + 1 ) << L": " << L"return" << endl;
-#endif
-		block_instructions.push_back( MakeInstruction( RTRN ) );
+/****************************
+ * Packages the instructions of
+ * the current function
+ ****************************/
+ExecutableFunction* Emitter::MakeFunction( wstring const &name, InstructionType operation, INT_T parameter_count, bool returns_value )
+{
+	vector<Instruction*> &block_instructions = function->instructions;
+	std::set<size_t> leaders = ExecutableFunction::FindLeaders( block_instructions );
 
-		if ( returns_value == 1 ) {
-			ProcessError( statement_list->GetStatements().back(), L"Last statement must return a value" );
-		}
-	}
-	else {
-		if ( !static_cast< Return* >( statement_list->GetStatements().back() )->GetExpression() && returns_value == 1 ) {
-			ProcessError( statement_list->GetStatements().back(), L"Last statement must return a value" );
-		}
+	ExecutableFunction* executable = new ExecutableFunction( name, operation, static_cast< int >( function->local_count ),
+		static_cast< int >( parameter_count ), std::move( block_instructions ), std::move( function->jump_table ), leaders, returns_value );
+	if ( TRACE_IS_ON( TRACE_EMIT, TRACE_EVENTS ) ) {
+		TraceFunction( executable );
 	}
+	return executable;
+}
 
-#ifdef _DEBUG
-	wcout << L"Leaders" << endl;
-	for ( auto iter = leaders.begin(); iter != leaders.end(); ++iter ) {
-		wcout << L"  " << *iter << endl;
+void Emitter::AddFunction( ExecutableFunction* executable, ParseNode* node )
+{
+	const wstring key = executable->GetName() + L":" + IntToString( executable->GetParameterCount() );
+	if ( executable_program->GetFunction( key ) ) {
+		ProcessError( node, L"function '" + executable->GetName() + L"' taking " + IntToString( executable->GetParameterCount() )
+			+ L" argument(s) is already defined" );
+		delete executable;
+		return;
 	}
-#endif
-
-	const int local_count = parsed_function->GetLocalCount();
-	return new ExecutableFunction( parsed_function->GetName(), parsed_function->GetOperation(), local_count, static_cast< int >( parameters.size() ),
-		std::move( block_instructions ), std::move( jump_table ), leaders, returns_value > 0 );
+	executable_program->AddFunction( executable );
 }
 
 /****************************
- * Emit code for a function
+ * Classes are registered before
+ * any code is emitted: field ids,
+ * static slots and owners
  ****************************/
-void Emitter::EmitFunction( StatementList* block_statements, vector<Instruction*> & block_instructions,
-	unordered_map<long, size_t>& jump_table, std::set<size_t> &leaders )
+void Emitter::RegisterClasses( Scope* scope )
 {
-	EmitBlock( block_statements, block_instructions, jump_table );
-
-	// create CFG
-	leaders.insert( 0 );
-	for ( size_t i = 0; i < block_instructions.size(); ++i ) {
-		if ( block_instructions.at( i )->type == LBL ) {
-			leaders.insert( i );
-		}
-		else if ( block_instructions.at( i )->type == JMP ) {
-			leaders.insert( i + 1 );
+	vector<ClassDeclaration*> registered;
+	for ( Statement* statement : scope->GetStatements() ) {
+		if ( ClassDeclaration* klass = NodeCast<ClassDeclaration>( statement ) ) {
+			RegisterClass( klass, registered );
 		}
 	}
+
+	// static variables start out with their initial values
+	for ( ClassDeclaration* klass : registered ) {
+		EmitStaticInitializers( klass );
+	}
 }
 
-/****************************
- * Emit code for a statement block
- ****************************/
-void Emitter::EmitBlock( StatementList* block_statements, vector<Instruction*>& block_instructions,
-	unordered_map<long, size_t>& jump_table )
+void Emitter::RegisterClass( ClassDeclaration* klass, vector<ClassDeclaration*> &registered )
 {
-	vector<Statement*> statements = block_statements->GetStatements();
-	for ( size_t i = 0; i < statements.size(); i++ ) {
-		Statement* statement = statements[ i ];
-		switch ( statement->GetStatementType() ) {
-		case ASSIGNMENT_STATEMENT:
-			EmitAssignment( static_cast< Assignment* >( statement ), block_instructions, jump_table );
-			break;
+	if ( instance_counts.count( klass ) ) {
+		return;
+	}
 
-		case DECLARATION_STATEMENT:
-			break;
+	if ( !klass->GetBaseClassName().empty() ) {
+		ProcessError( klass, L"base classes are not supported yet" );
+	}
 
-		case RETURN_STATEMENT:
-			if ( static_cast< Return* >( statement )->GetExpression() ) {
-				EmitExpression( static_cast< Return* >( statement )->GetExpression(), block_instructions, jump_table );
-				if ( returns_value == 0 ) {
-					ProcessError( statement, L"Not all statements return a value" );
-				}
-				else {
-					returns_value = 1;
-				}
-			}
-			else {
-				if ( returns_value == 1 ) {
-					ProcessError( statement, L"Not all statements return a value" );
-				}
-				else {
-					returns_value = 0;
-				}
+	INT_T instance_count = 0;
+	auto register_variable = [ & ] ( Declaration* decl ) {
+		owners[ decl ] = klass;
+		if ( decl->GetStorageType() == StorageType::STATIC_STORAGE ) {
+			global->locals[ decl ] = ++global->local_count;
+		}
+		else {
+			fields[ decl ] = instance_count++;
+		}
+	};
+
+	for ( Declaration* decl : klass->GetDeclList() ) {
+		switch ( decl->GetStatementType() ) {
+		case StatementType::VDECL_LIST_STMT:
+			for ( auto &list_decl : static_cast< DeclarationList* >( decl )->GetDeclarations() ) {
+				register_variable( list_decl.second );
 			}
-#ifdef _DEBUG
-			wcout << ( block_instructions.size() + 1 ) << L": " << L"return" << endl;
-#endif
-			block_instructions.push_back( MakeInstruction( RTRN ) );
 			break;
 
-		case FUNCTION_CALL_STATEMENT:
-			EmitFunctionCall( static_cast< FunctionCall* >( statement ), block_instructions, jump_table );
+		case StatementType::VARIABLE_DECL_STMT:
+			register_variable( decl );
 			break;
 
-		case IF_ELSE_STATEMENT:
-			EmitIfElse( static_cast< IfElse* >( statement ), block_instructions, jump_table );
+		case StatementType::CLASS_DECL_STMT:
+			owners[ decl ] = klass;
+			RegisterClass( static_cast< ClassDeclaration* >( decl ), registered );
 			break;
 
-		case WHILE_STATEMENT:
-			EmitWhile( static_cast< While* >( statement ), block_instructions, jump_table );
+		default:
+			owners[ decl ] = klass;
 			break;
+		}
+	}
 
-		case SHOW_STATEMENT: {
-			// emit expression
-			Expression* expression = static_cast< Dump* >( statement )->GetExpression();
-			if ( expression->GetExpressionType() == FUNCTION_CALL_EXPR ) {
-				FunctionCall* function_call = static_cast< FunctionCall* >( expression );
-				function_call->ReturnsValue( true );
-			}
-			EmitExpression( expression, block_instructions, jump_table );
-
-#ifdef _DEBUG
-			wcout << ( block_instructions.size() + 1 ) << L": " << L"show value" << endl;
-#endif
+	instance_counts[ klass ] = instance_count;
+	classes[ klass->GetName() ] = klass;
+	registered.push_back( klass );
+}
 
-			block_instructions.push_back( MakeInstruction( SHOW_TYPE ) );
+void Emitter::EmitStaticInitializers( ClassDeclaration* klass )
+{
+	Scope* saved_scope = current_scope;
+	current_scope = klass->GetClassScope();
+	auto initialize = [ & ] ( Declaration* decl ) {
+		auto slot = global->locals.find( decl );
+		Expression* expression = static_cast< VariableDeclaration* >( decl )->GetExpression();
+		if ( slot != global->locals.end() && expression ) {
+			Dispatch( expression );
+			EmitStore( Slot{ function == global ? LOCL : GLOB, slot->second } );
 		}
-							 break;
+	};
 
-		default:
-			// TODO: report error
-			break;
+	for ( Declaration* decl : klass->GetDeclList() ) {
+		if ( DeclarationList* decl_list = NodeCast<DeclarationList>( static_cast< Statement* >( decl ) ) ) {
+			for ( auto &list_decl : decl_list->GetDeclarations() ) {
+				initialize( list_decl.second );
+			}
+		}
+		else if ( NodeCast<VariableDeclaration>( static_cast< Statement* >( decl ) ) ) {
+			initialize( decl );
 		}
 	}
+	current_scope = saved_scope;
 }
 
 /****************************
-* Emit parameters for a method call
-****************************/
-void Emitter::EmitFunctionCallParameters( Reference* reference, vector<Instruction*>& block_instructions,
-	unordered_map<long, size_t>& jump_table )
-{
-	Reference* last = reference;
-	while ( last->GetReference() ) {
-		last->GetReference()->SetPerviousReference( last );
-		last = last->GetReference();
-	}
-
-	// emit calling parameters
-	while ( last ) {
-		if ( last->GetCallingParameters() ) {
-			vector<Expression*> parameters = last->GetCallingParameters()->GetExpressions();
-			for ( std::vector<Expression*>::reverse_iterator iter = parameters.rbegin(); iter != parameters.rend(); ++iter ) {
-				EmitExpression( *iter, block_instructions, jump_table );
-			}
+ * Gives every variable declared
+ * in a scope a local slot. Sorted,
+ * so the numbering doesn't depend
+ * on the symbol table's hashing
+ ****************************/
+void Emitter::EnterScope( Scope* scope )
+{
+	for ( Declaration* decl : ScopeVariables( scope ) ) {
+		function->locals[ decl ] = ++function->local_count;
+	}
+}
+
+// variables of a scope that have no slot yet, in source order
+vector<Declaration*> Emitter::ScopeVariables( Scope* scope )
+{
+	vector<Declaration*> variables;
+	for ( auto &symbol : scope->GetSymbols() ) {
+		Declaration* decl = symbol.second;
+		if ( decl->GetStatementType() == StatementType::VARIABLE_DECL_STMT && !function->locals.count( decl ) ) {
+			variables.push_back( decl );
+		}
+	}
+
+	std::sort( variables.begin(), variables.end(), [] ( Declaration* a, Declaration* b ) {
+		return a->GetLineNumber() != b->GetLineNumber() ? a->GetLineNumber() < b->GetLineNumber() : a->GetName() < b->GetName();
+	} );
+	return variables;
+}
+
+// parameters are the first locals; arguments arrive first-on-top
+INT_T Emitter::DeclareParameters( ExpressionList* parameters )
+{
+	const INT_T parameter_count = parameters ? static_cast< INT_T >( parameters->Length() ) : 0;
+	for ( INT_T i = 0; i < parameter_count; ++i ) {
+		Variable* parameter = NodeCast<Variable>( parameters->GetExpressionAt( static_cast< unsigned int >( i ) ) );
+		if ( parameter && parameter->GetDeclaration() ) {
+			function->locals[ parameter->GetDeclaration() ] = i + 1;
 		}
-		// update
-		last = last->GetPerviousReference();
 	}
+	function->local_count = parameter_count;
+
+	for ( INT_T i = 1; i <= parameter_count; ++i ) {
+		EmitStore( Slot{ LOCL, i } );
+	}
+	return parameter_count;
 }
 
 /****************************
- * Emit code for a method call
+ * Name lookups
  ****************************/
-void Emitter::EmitFunctionCall( FunctionCall* function_call, vector<Instruction*>& block_instructions, unordered_map<long, size_t>& jump_table )
+Declaration* Emitter::Lookup( Variable* variable )
 {
-	Reference* reference = function_call->GetReference();
+	if ( !variable->GetDeclaration() && current_scope ) {
+		// used before its declaration; the declaration is in place by now
+		return current_scope->FindDeclaration( variable->GetName() );
+	}
+	return variable->GetDeclaration();
+}
 
-	// emit calling parameters
-	EmitFunctionCallParameters( reference, block_instructions, jump_table );
+ClassDeclaration* Emitter::ClassOf( Expression* expression )
+{
+	Variable* variable = NodeCast<Variable>( expression );
+	if ( !variable ) {
+		return nullptr;
+	}
 
-	// array indices
-	if ( reference->GetIndices() ) {
-		vector<Expression*> indices = reference->GetIndices()->GetExpressions();
-		for ( size_t i = 0; i < indices.size(); i++ ) {
-			EmitExpression( indices[ i ], block_instructions, jump_table );
-		}
+	// inside a class its name finds the constructor first; a variable still hides the class
+	Declaration* decl = Lookup( variable );
+	if ( decl && !NodeCast<FunctionDeclaration>( static_cast< Statement* >( decl ) ) ) {
+		return NodeCast<ClassDeclaration>( static_cast< Statement* >( decl ) );
 	}
+	auto klass = classes.find( variable->GetName() );
+	return klass != classes.end() ? klass->second : nullptr;
+}
 
-	// new instance
-	vector<Expression*> parameters;
-	if ( function_call->IsNew() ) {
-		parameters = reference->GetReference()->GetCallingParameters()->GetExpressions();
+// the callee a name refers to with the given number of arguments; variables shadow outer functions
+Declaration* Emitter::FindCallee( wstring const &name, size_t arity )
+{
+	if ( !current_scope ) {
+		return nullptr;
+	}
+	Name const interned = current_scope->GetNames().Find( name );
+	if ( !interned ) {
+		return nullptr;
+	}
 
-		// new string
-		if ( reference->GetName() == L"String" && reference->GetReference() && reference->GetReference()->GetName() == L"new" ) {
-#ifdef _DEBUG
-			wcout << ( block_instructions.size() + 1 ) << L": " << L"new string" << endl;
-#endif
-			block_instructions.push_back( MakeInstruction( NEW_STRING ) );
-		}
-		// TODO: new hash
-		else if ( reference->GetName() == L"Hash" && reference->GetReference() && reference->GetReference()->GetName() == L"new" ) {
-#ifdef _DEBUG
-			wcout << ( block_instructions.size() + 1 ) << L": " << L"new hash" << endl;
-#endif
-			block_instructions.push_back( MakeInstruction( NEW_HASH ) );
-		}
-		else {
-#ifdef _DEBUG
-			wcout << ( block_instructions.size() + 1 ) << L": " << L"new instance: name='" << reference->GetName() << L"'" << endl;
-#endif
-			block_instructions.push_back( MakeInstruction( NEW_OBJ, static_cast< int >( parameters.size() ), 1, reference->GetName() ) );
-
-#ifdef _DEBUG
-			wcout << ( block_instructions.size() + 1 ) << L": " << L"function call: class='"
-				<< function_call->GetReference()->GetName() << L"', method='" << function_call->GetCallerName( 0 ) << L"'" << endl;
-#endif      
-			block_instructions.push_back( MakeInstruction( CALL_FUNC, static_cast< int >( parameters.size() ), function_call->ReturnsValue() ? 1 : 0, function_call->GetCallerName( 0 ) ) );
-		}
-
-		// nested call
-		if ( reference->GetReference() && reference->GetReference()->GetReference() ) {
-			EmitNestedFunctionCall( reference->GetReference()->GetReference(), block_instructions, jump_table );
-		}
-	}
-	else if ( reference->GetReference() ) {
-		if ( reference->GetExpressionType() == REF_EXPR ) {
-#ifdef _DEBUG
-			wcout << ( block_instructions.size() + 1 ) << L": " << L"load local, name='" << reference->GetName() << L"', id=" << reference->GetDeclaration()->GetId() << endl;
-#endif
-			block_instructions.push_back( MakeInstruction( LOAD_VAR, LOCL, reference->GetDeclaration()->GetId() ) );
-
-#ifdef _DEBUG
-			wcout << ( block_instructions.size() + 1 ) << L": " << L"function call: name='" << function_call->GetCallerName( 0 ) << L"'" << endl;
-#endif
-			parameters = reference->GetReference()->GetCallingParameters()->GetExpressions();
-			block_instructions.push_back( MakeInstruction( CALL_FUNC, static_cast< int >( parameters.size() ), function_call->ReturnsValue() ? 1 : 0, function_call->GetCallerName( 0 ) ) );
-
-			// nested call
-			if ( reference->GetReference()->GetReference() ) {
-				EmitNestedFunctionCall( reference->GetReference()->GetReference(), block_instructions, jump_table );
+	for ( Scope* scope = current_scope; scope; scope = scope->GetParentScope() ) {
+		auto range = scope->GetSymbols().FindAll( interned );
+		for ( auto symbol = range.first; symbol != range.second; ++symbol ) {
+			Declaration* decl = symbol->second;
+			if ( FunctionDeclaration* function_decl = NodeCast<FunctionDeclaration>( static_cast< Statement* >( decl ) ) ) {
+				if ( ( function_decl->GetParameters() ? function_decl->GetParameters()->Length() : 0 ) == arity ) {
+					return decl;
+				}
+			}
+			else {
+				return decl;
 			}
 		}
-		else {
-			// TODO: finish
-			// literal function calls
-			switch ( reference->GetExpressionType() ) {
-			case NIL_LIT_EXPR:
-				break;
+	}
+	return nullptr;
+}
 
-			case CHAR_LIT_EXPR:
-				break;
+FunctionDeclaration* Emitter::FindMember( ClassDeclaration* klass, wstring const &name, size_t arity )
+{
+	Name const interned = klass->GetClassScope()->GetNames().Find( name );
+	if ( !interned ) {
+		return nullptr;
+	}
 
-			case INT_LIT_EXPR: {
-#ifdef _DEBUG
-				wcout << ( block_instructions.size() + 1 ) << L": " << L"load literal: type=integer, value="
-					<< static_cast< IntegerLiteral* >( reference )->GetValue() << endl;
-#endif
-				block_instructions.push_back( MakeInstruction( LOAD_INT_LIT, static_cast< int >( static_cast< IntegerLiteral* >( reference )->GetValue() ) ) );
-				block_instructions.push_back( MakeInstruction( CALL_FUNC, static_cast< int >( parameters.size() ), function_call->ReturnsValue() ? 1 : 0, function_call->GetCallerName( 0 ) ) );
+	auto range = klass->GetDeclarations().FindAll( interned );
+	for ( auto symbol = range.first; symbol != range.second; ++symbol ) {
+		if ( FunctionDeclaration* decl = NodeCast<FunctionDeclaration>( static_cast< Statement* >( symbol->second ) ) ) {
+			if ( ( decl->GetParameters() ? decl->GetParameters()->Length() : 0 ) == arity ) {
+				return decl;
 			}
-							   break;
+		}
+	}
+	return nullptr;
+}
 
-			case FLOAT_LIT_EXPR:
-				break;
+FunctionDeclaration* Emitter::FindConstructor( ClassDeclaration* klass, size_t arity )
+{
+	for ( Declaration* decl : klass->GetDeclList() ) {
+		FunctionDeclaration* function_decl = NodeCast<FunctionDeclaration>( static_cast< Statement* >( decl ) );
+		if ( function_decl && function_decl->GetFunctionType() == FunctionType::CONSTRUCTOR &&
+			( function_decl->GetParameters() ? function_decl->GetParameters()->Length() : 0 ) == arity ) {
+			return function_decl;
+		}
+	}
+	return nullptr;
+}
 
-			default:
-				break;
-			}
+bool Emitter::HasConstructors( ClassDeclaration* klass )
+{
+	for ( Declaration* decl : klass->GetDeclList() ) {
+		FunctionDeclaration* function_decl = NodeCast<FunctionDeclaration>( static_cast< Statement* >( decl ) );
+		if ( function_decl && function_decl->GetFunctionType() == FunctionType::CONSTRUCTOR ) {
+			return true;
 		}
 	}
-	// emit function
-	else {
-#ifdef _DEBUG
-		wcout << ( block_instructions.size() + 1 ) << L": " << L"function call: name='" << reference->GetName() << L"'" << endl;
-#endif
-		parameters = reference->GetCallingParameters()->GetExpressions();
-		block_instructions.push_back( MakeInstruction( LOAD_INT_LIT, 0 ) ); // instance
-		block_instructions.push_back( MakeInstruction( CALL_FUNC, static_cast< int >( parameters.size() ), function_call->ReturnsValue() ? 1 : 0, function_call->GetCallerName( 0 ) ) );
+	return false;
+}
+
+// a class without constructors still needs one to run its field initializers
+bool Emitter::NeedsDefaultConstructor( ClassDeclaration* klass )
+{
+	if ( HasConstructors( klass ) ) {
+		return false;
+	}
+	for ( auto &field : fields ) {
+		if ( owners[ field.first ] == klass && static_cast< VariableDeclaration* >( field.first )->GetExpression() ) {
+			return true;
+		}
 	}
+	return false;
 }
 
-void Emitter::EmitNestedFunctionCall( Reference* reference, vector<Instruction*>& block_instructions, unordered_map<long, size_t>& jump_table )
+/****************************
+ * Where a variable lives, as seen
+ * from the current function
+ ****************************/
+bool Emitter::Resolve( Declaration* decl, ParseNode* node, Slot &slot )
 {
-	while ( reference ) {
-		vector<Expression*> parameters = reference->GetCallingParameters()->GetExpressions();
-		wstring function_name = reference->GetName() + L':' + IntToString( static_cast< int >( parameters.size() ) );
+	auto local = function->locals.find( decl );
+	if ( local != function->locals.end() ) {
+		slot = Slot{ LOCL, local->second };
+		return true;
+	}
+
+	// lambdas copy the locals of the functions around them into their environment
+	if ( function->is_lambda ) {
+		for ( FunctionContext* outer = function->enclosing; outer && outer != global; outer = outer->enclosing ) {
+			if ( outer->locals.count( decl ) ) {
+				FailInline();
+				auto capture = std::find( function->captures.begin(), function->captures.end(), decl );
+				if ( capture == function->captures.end() ) {
+					function->captures.push_back( decl );
+					capture = function->captures.end() - 1;
+				}
+				slot = Slot{ INST, static_cast< INT_T >( capture - function->captures.begin() ) + 1 };
+				return true;
+			}
+			if ( !outer->is_lambda ) {
+				break;
+			}
+		}
+	}
 
-#ifdef _DEBUG
-		wcout << ( block_instructions.size() + 1 ) << L": " << L"function call: method='" << function_name << L"'" << endl;
-#endif
-		block_instructions.push_back( MakeInstruction( CALL_FUNC, static_cast< int >( parameters.size() ), 1, function_name ) );
+	auto field = fields.find( decl );
+	if ( field != fields.end() ) {
+		FailInline();
+		ClassDeclaration* owner = owners[ decl ];
+		if ( function->klass != owner || function->is_static || function->is_lambda ) {
+			ProcessError( node, L"instance variable '" + decl->GetName() + L"' of '" + owner->GetName()
+				+ L"' can only be used in its methods" );
+			return false;
+		}
+		slot = Slot{ INST, field->second };
+		return true;
+	}
 
-		// next
-		reference = reference->GetReference();
+	auto global_variable = global->locals.find( decl );
+	if ( global_variable != global->locals.end() ) {
+		slot = Slot{ function == global ? LOCL : GLOB, global_variable->second };
+		return true;
 	}
+
+	ProcessError( node, L"variable '" + decl->GetName() + L"' is not accessible here" );
+	return false;
 }
+
 /****************************
- * Emit 'if/else' code
+ * Classes and functions
  ****************************/
-void Emitter::EmitIfElse( IfElse* if_else, vector<Instruction*>& block_instructions, unordered_map<long, size_t>& jump_table )
+void Emitter::EmitClass( ClassDeclaration* klass )
 {
-	const long end_label = NextEndId();
-	long next_label = NextStartId();
+	TRACE( TRACE_EMIT, TRACE_EVENTS, EMIT_CLASS, klass->GetName() );
+	ExecutableClass* executable_klass = new ExecutableClass( klass->GetName(), static_cast< int >( instance_counts[ klass ] ) );
+
+	for ( Declaration* decl : klass->GetDeclList() ) {
+		switch ( decl->GetStatementType() ) {
+		case StatementType::FUNCTION_DECL_STMT: {
+			FunctionDeclaration* function_decl = static_cast< FunctionDeclaration* >( decl );
+			ExecutableFunction* executable = EmitFunction( function_decl, klass );
+			if ( function_decl->GetStorageType() == StorageType::STATIC_STORAGE ) {
+				AddFunction( executable, function_decl );
+			}
+			else {
+				executable_klass->AddFunction( executable );
+			}
+		}
+			break;
 
-	// emit test
+		case StatementType::CLASS_DECL_STMT:
+			EmitClass( static_cast< ClassDeclaration* >( decl ) );
+			break;
 
-	// emit expression
-	if ( if_else->GetExpression()->GetExpressionType() == FUNCTION_CALL_EXPR ) {
-		FunctionCall* function_call = static_cast< FunctionCall* >( if_else->GetExpression() );
-		function_call->ReturnsValue( true );
+		default:
+			break;
+		}
 	}
-	EmitExpression( if_else->GetExpression(), block_instructions, jump_table );
 
-	// basic 'if' statement
-	vector<IfElse*> else_ifs = if_else->GetElseIfs();
-	StatementList* else_block = if_else->GetElseBlock();
-	if ( else_ifs.size() == 0 && !else_block ) {
-#ifdef _DEBUG
-		wcout << ( block_instructions.size() + 1 ) << L": " << L"jump false: id=" << end_label << endl;
-#endif
-		block_instructions.push_back( MakeInstruction( JMP, static_cast< int >( end_label ), JMP_FALSE ) );
-		// emit 'if' block
-		EmitBlock( if_else->GetIfBlock(), block_instructions, jump_table );
+	if ( NeedsDefaultConstructor( klass ) ) {
+		FunctionContext context{ nullptr, klass, false };
+		context.is_constructor = true;
+		FunctionContext* saved = function;
+		Scope* saved_scope = current_scope;
+		function = &context;
+		current_scope = klass->GetClassScope();
+
+		EmitFieldInitializers( klass );
+		EmitReturn();
+		executable_klass->AddFunction( MakeFunction( klass->GetName(), NO_OP, 0, true ) );
+
+		function = saved;
+		current_scope = saved_scope;
 	}
-	else {
-#ifdef _DEBUG
-		wcout << ( block_instructions.size() + 1 ) << L": " << L"jump false: id=" << next_label << endl;
-#endif
-		block_instructions.push_back( MakeInstruction( JMP, static_cast< int >( next_label ), JMP_FALSE ) );
-		// emit 'if' block
-		EmitBlock( if_else->GetIfBlock(), block_instructions, jump_table );
-#ifdef _DEBUG
-		wcout << ( block_instructions.size() + 1 ) << L": " << L"jump: id=" << end_label << endl;
-#endif
-		block_instructions.push_back( MakeInstruction( JMP, static_cast< int >( end_label ), -1 ) );
-	}
-
-	// 'if-else' blocks
-	if ( else_ifs.size() > 0 ) {
-#ifdef _DEBUG
-		wcout << ( block_instructions.size() + 1 ) << L": " << L"label: id=" << next_label
-			<< L", pos=" << block_instructions.size() << endl;
-#endif
-		block_instructions.push_back( MakeInstruction( LBL, static_cast< int >( next_label ), 0 ) );
-		jump_table.insert( pair<long, size_t>( next_label, block_instructions.size() - 1 ) );
-
-		for ( size_t i = 0; i < else_ifs.size(); i++ ) {
-			IfElse* else_if = else_ifs[ i ];
-			// emit test
-			EmitExpression( else_if->GetExpression(), block_instructions, jump_table );
-#ifdef _DEBUG
-			wcout << ( block_instructions.size() + 1 ) << L": " << L"jump false: id=" << ( next_label + 1 ) << endl;
-#endif
-			block_instructions.push_back( MakeInstruction( JMP, static_cast< int >( next_label + 1 ), JMP_FALSE ) );
-
-			// emit 'if' block
-			EmitBlock( else_if->GetIfBlock(), block_instructions, jump_table );
-#ifdef _DEBUG
-			wcout << ( block_instructions.size() + 1 ) << L": " << L"jump: id=" << end_label << endl;
-#endif
-			// jump to end
-			block_instructions.push_back( MakeInstruction( JMP, static_cast< int >( end_label ), -1 ) );
-
-			next_label = NextStartId();
-#ifdef _DEBUG
-			wcout << ( block_instructions.size() + 1 ) << L": " << L"label: id=" << next_label
-				<< L", pos=" << block_instructions.size() << endl;
-#endif
-			block_instructions.push_back( MakeInstruction( LBL, static_cast< int >( next_label ), 0 ) );
-			jump_table.insert( pair<long, size_t>( next_label, block_instructions.size() - 1 ) );
-		}
-	}
-
-	// 'else' blocks
-	if ( else_block ) {
-		if ( else_ifs.size() == 0 ) {
-#ifdef _DEBUG
-			wcout << ( block_instructions.size() + 1 ) << L": " << L"label: id=" << next_label
-				<< L", pos=" << block_instructions.size() << endl;
-#endif
-			block_instructions.push_back( MakeInstruction( LBL, static_cast< int >( next_label ), 0 ) );
-			jump_table.insert( pair<long, size_t>( next_label, block_instructions.size() - 1 ) );
-		}
-		// 'else' block
-		EmitBlock( if_else->GetElseBlock(), block_instructions, jump_table );
-	}
-
-	// end label
-#ifdef _DEBUG
-	wcout << ( block_instructions.size() + 1 ) << L": " << L"label: id=" << end_label
-		<< L", pos=" << block_instructions.size() << endl;
-#endif
-	block_instructions.push_back( MakeInstruction( LBL, static_cast< int >( end_label ), 0 ) );
-	jump_table.insert( pair<long, size_t>( end_label, block_instructions.size() - 1 ) );
+
+	executable_program->AddClass( executable_klass );
 }
 
-/****************************
- * TODO: doc
- ****************************/
-void Emitter::EmitWhile( While* if_while, vector<Instruction*>& block_instructions, unordered_map<long, size_t>& jump_table )
+ExecutableFunction* Emitter::EmitFunction( FunctionDeclaration* decl, ClassDeclaration* klass )
+{
+	FunctionContext context{ nullptr, klass, false };
+	context.is_static = klass && decl->GetStorageType() == StorageType::STATIC_STORAGE;
+	context.is_constructor = klass && decl->GetFunctionType() == FunctionType::CONSTRUCTOR;
+
+	FunctionContext* saved = function;
+	Scope* saved_scope = current_scope;
+	function = &context;
+	current_scope = decl->GetFunctionBody()->GetScope();
+
+	const INT_T parameter_count = DeclareParameters( decl->GetParameters() );
+	if ( context.is_constructor ) {
+		EmitFieldInitializers( klass );
+	}
+	EnterScope( current_scope );
+	EmitStatements( current_scope );
+	EmitReturn();
+
+	// operators are one-argument methods named after the operation
+	static const std::unordered_map<wstring, InstructionType> operators = {
+		{ L"Add", ADD }, { L"Subtract", SUB }, { L"Multiply", MUL }, { L"Divide", DIV }, { L"Modulo", MOD },
+		{ L"Equal", EQL }, { L"NotEqual", NEQL }, { L"Less", LES }, { L"Greater", GTR },
+		{ L"LessEqual", LES_EQL }, { L"GreaterEqual", GTR_EQL }
+	};
+	InstructionType operation = NO_OP;
+	wstring name = decl->GetName();
+	if ( context.is_constructor ) {
+		name = klass->GetName();
+	}
+	else if ( context.is_static ) {
+		name = klass->GetName() + L"::" + name;
+	}
+	else if ( klass && parameter_count == 1 ) {
+		auto oper = operators.find( name );
+		if ( oper != operators.end() ) {
+			operation = oper->second;
+		}
+	}
+
+	ExecutableFunction* executable = MakeFunction( name, operation, parameter_count, true );
+	function = saved;
+	current_scope = saved_scope;
+
+	return executable;
+}
+
+void Emitter::EmitFieldInitializers( ClassDeclaration* klass )
 {
-	const long top_label = NextStartId();
-	const long end_label = NextEndId();
+	for ( Declaration* decl : klass->GetDeclList() ) {
+		auto initialize = [ & ] ( Declaration* field ) {
+			auto id = fields.find( field );
+			Expression* expression = static_cast< VariableDeclaration* >( field )->GetExpression();
+			if ( id != fields.end() && expression ) {
+				Dispatch( expression );
+				EmitStore( Slot{ INST, id->second } );
+			}
+		};
 
-	// top label
-#ifdef _DEBUG
-	wcout << ( block_instructions.size() + 1 ) << L": " << L"label: id=" << top_label
-		<< L", pos=" << block_instructions.size() << endl;
-#endif
-	block_instructions.push_back( MakeInstruction( LBL, static_cast< int >( top_label ), 0 ) );
-	jump_table.insert( pair<long, size_t>( top_label, block_instructions.size() - 1 ) );
+		if ( DeclarationList* decl_list = NodeCast<DeclarationList>( static_cast< Statement* >( decl ) ) ) {
+			for ( auto &list_decl : decl_list->GetDeclarations() ) {
+				initialize( list_decl.second );
+			}
+		}
+		else if ( NodeCast<VariableDeclaration>( static_cast< Statement* >( decl ) ) ) {
+			initialize( decl );
+		}
+	}
+}
 
-	// emit test
-	EmitExpression( if_while->GetExpression(), block_instructions, jump_table );
+// falling off the end returns nil, or the new instance from a constructor
+void Emitter::EmitReturn()
+{
+	if ( function->instructions.size() && function->instructions.back()->type == RTRN ) {
+		return;
+	}
 
-	// jump end
-#ifdef _DEBUG
-	wcout << ( block_instructions.size() + 1 ) << L": " << L"jump false: id=" << end_label << endl;
-#endif
-	block_instructions.push_back( MakeInstruction( JMP, static_cast< int >( end_label ), JMP_FALSE ) );
+	if ( function->is_constructor ) {
+		EmitLoad( Slot{ LOCL, 0 } );
+	}
+	else {
+		EmitInstruction( MakeInstruction( LOAD_NIL_LIT ) );
+	}
+	EmitInstruction( MakeInstruction( RTRN ) );
+}
 
-	// emit block
-	EmitBlock( if_while->GetBlock(), block_instructions, jump_table );
+// what closes a block belongs to the statement it's part of
+void Emitter::EmitStatements( Scope* scope )
+{
+	const int enclosing_line = line;
+	for ( Statement* statement : scope->GetStatements() ) {
+		line = statement->GetLineNumber();
+		Dispatch( statement );
+	}
+	line = enclosing_line;
+}
 
-#ifdef _DEBUG
-	wcout << ( block_instructions.size() + 1 ) << L": " << L"jump: id=" << top_label << endl;
-#endif
-	block_instructions.push_back( MakeInstruction( JMP, static_cast< int >( top_label ), JMP_UNCND ) );
+void Emitter::EmitVariable( VariableDeclaration* decl )
+{
+	if ( decl->GetExpression() ) {
+		Dispatch( decl->GetExpression() );
+	}
+	else {
+		EmitInstruction( MakeInstruction( LOAD_NIL_LIT ) );
+	}
 
-	// end label
-#ifdef _DEBUG
-	wcout << ( block_instructions.size() + 1 ) << L": " << L"label: id=" << end_label
-		<< L", pos=" << block_instructions.size() << endl;
-#endif
-	block_instructions.push_back( MakeInstruction( LBL, static_cast< int >( end_label ), 0 ) );
-	jump_table.insert( pair<long, size_t>( end_label, block_instructions.size() - 1 ) );
+	Slot slot;
+	if ( Resolve( decl, decl, slot ) ) {
+		EmitStore( slot );
+	}
 }
 
 /****************************
- * Emit assignment code
+ * Statements
  ****************************/
-void Emitter::EmitAssignment( Assignment* assignment, vector<Instruction*>& block_instructions, unordered_map<long, size_t>& jump_table )
+void Emitter::VisitStatement( Statement* statement )
+{
+	ProcessError( statement, L"statement not supported" );
+}
+
+void Emitter::VisitExpressionStatement( ExpressionStatement* statement )
 {
-	// emit expression
-	if ( assignment->GetExpression()->GetExpressionType() == FUNCTION_CALL_EXPR ) {
-		FunctionCall* function_call = static_cast< FunctionCall* >( assignment->GetExpression() );
-		function_call->ReturnsValue( true );
+	Expression* expression = statement->GetExpression();
+	if ( !expression ) {
+		return;
 	}
-	EmitExpression( assignment->GetExpression(), block_instructions, jump_table );
 
-	switch ( assignment->GetAssignmentType() ) {
-	case ScannerTokenType::TOKEN_ADD_EQL:
-		EmitReference( assignment->GetReference(), false, block_instructions, jump_table );
-#ifdef _DEBUG
-		wcout << ( block_instructions.size() + 1 ) << L": " << L"operator: '+'" << endl;
-#endif
-		block_instructions.push_back( MakeInstruction( ADD ) );
+	// no value is left behind
+	switch ( expression->GetExpressionType() ) {
+	case ExpressionType::ASSIGNMENT_EXPR:
+		EmitAssignment( static_cast< AssignmentExpression* >( expression ), false );
+		break;
+
+	case ExpressionType::PRE_INCR_EXPR:
+		EmitIncrement( static_cast< PreIncrExpression* >( expression )->GetExpression(), ADD, true, false );
+		break;
+
+	case ExpressionType::PRE_DECR_EXPR:
+		EmitIncrement( static_cast< PreDecrExpression* >( expression )->GetExpression(), SUB, true, false );
 		break;
 
-	case ScannerTokenType::TOKEN_SUB_EQL:
-		EmitReference( assignment->GetReference(), false, block_instructions, jump_table );
-#ifdef _DEBUG
-		wcout << ( block_instructions.size() + 1 ) << L": " << L"operator: '-'" << endl;
-#endif
-		block_instructions.push_back( MakeInstruction( SUB ) );
+	case ExpressionType::POST_INCR_EXPR:
+		EmitIncrement( static_cast< PostIncrExpression* >( expression )->GetExpression(), ADD, false, false );
 		break;
 
-	case ScannerTokenType::TOKEN_MUL_EQL:
-		EmitReference( assignment->GetReference(), false, block_instructions, jump_table );
-#ifdef _DEBUG
-		wcout << ( block_instructions.size() + 1 ) << L": " << L"operator: '*'" << endl;
-#endif
-		block_instructions.push_back( MakeInstruction( MUL ) );
+	case ExpressionType::POST_DECR_EXPR:
+		EmitIncrement( static_cast< PostDecrExpression* >( expression )->GetExpression(), SUB, false, false );
 		break;
 
-	case ScannerTokenType::TOKEN_DIV_EQL:
-		EmitReference( assignment->GetReference(), false, block_instructions, jump_table );
-#ifdef _DEBUG
-		wcout << ( block_instructions.size() + 1 ) << L": " << L"operator: '/'" << endl;
-#endif
-		block_instructions.push_back( MakeInstruction( DIV ) );
+	case ExpressionType::FUNCTION_CALL_EXPR:
+		EmitCall( static_cast< FunctionCall* >( expression ), false );
 		break;
 
 	default:
+		Dispatch( expression );
+		EmitInstruction( MakeInstruction( POP ) );
 		break;
 	}
+}
 
-	// emit reference
-	EmitReference( assignment->GetReference(), true, block_instructions, jump_table );
+void Emitter::VisitDumpStatement( DumpStatement* statement )
+{
+	Dispatch( statement->GetExpression() );
+	EmitInstruction( MakeInstruction( SHOW_TYPE ) );
 }
 
-/****************************
- * Emit variable reference
- ****************************/
-void Emitter::EmitReference( Reference* reference, bool is_store, vector<Instruction*>& block_instructions, unordered_map<long, size_t>& jump_table )
-{
-	switch ( reference->GetReferenceType() ) {
-	case SELF_TYPE:
-#ifdef _DEBUG
-		wcout << ( block_instructions.size() + 1 ) << L": " << L"load local, name='self', id=0" << endl;
-#endif
-		block_instructions.push_back( MakeInstruction( LOAD_VAR, LOCL, 0 ) );
-		break;
+void Emitter::VisitCompoundStatement( CompoundStatement* statement )
+{
+	Scope* saved_scope = current_scope;
+	current_scope = statement->GetScope();
+	EnterScope( current_scope );
+	EmitStatements( current_scope );
+	current_scope = saved_scope;
+}
 
-	case NEW_LIST_TYPE:
-		break;
+void Emitter::VisitIfStatement( IfStatement* statement )
+{
+	const INT_T else_label = NextLabel();
+	EmitBranch( statement->GetExpression(), else_label, false );
+	Dispatch( statement->GetIfBlock() );
+
+	if ( statement->GetElseBlock() ) {
+		const INT_T end_label = NextLabel();
+		EmitJump( end_label, JMP_UNCND );
+		EmitLabel( else_label );
+		Dispatch( statement->GetElseBlock() );
+		EmitLabel( end_label );
+	}
+	else {
+		EmitLabel( else_label );
+	}
+}
 
-	case NEW_HASH_TYPE:
-		break;
+// the test sits at the bottom, so each iteration takes a single jump
+void Emitter::VisitWhileStatement( WhileStatement* statement )
+{
+	const INT_T top_label = NextLabel();
+	const INT_T continue_label = NextLabel();
+	const INT_T end_label = NextLabel();
+
+	EmitJump( continue_label, JMP_UNCND );
+	EmitLabel( top_label );
+	function->jump_targets.push_back( JumpTargets{ end_label, continue_label } );
+	Dispatch( statement->GetStatement() );
+	function->jump_targets.pop_back();
+	EmitLabel( continue_label );
+	EmitBranch( statement->GetExpression(), top_label, true );
+	EmitLabel( end_label );
+}
 
-	case NEW_OBJ_TYPE:
-		break;
+void Emitter::VisitDoWhileStatement( DoWhileStatement* statement )
+{
+	const INT_T top_label = NextLabel();
+	const INT_T continue_label = NextLabel();
+	const INT_T end_label = NextLabel();
+
+	EmitLabel( top_label );
+	function->jump_targets.push_back( JumpTargets{ end_label, continue_label } );
+	Dispatch( statement->GetStatement() );
+	function->jump_targets.pop_back();
+	EmitLabel( continue_label );
+	EmitBranch( statement->GetExpression(), top_label, true );
+	EmitLabel( end_label );
+}
 
-		// reference
-	case REF_TYPE: {
-		// store
-		if ( is_store ) {
-			// array element
-			if ( reference->GetIndices() ) {
-				vector<Expression*> indices = reference->GetIndices()->GetExpressions();
-				for ( size_t i = 0; i < indices.size(); ++i ) {
-					EmitExpression( indices[ i ], block_instructions, jump_table );
-				}
+void Emitter::VisitLoopStatement( LoopStatement* statement )
+{
+	const INT_T top_label = NextLabel();
+	const INT_T end_label = NextLabel();
+
+	EmitLabel( top_label );
+	function->jump_targets.push_back( JumpTargets{ end_label, top_label } );
+	VisitCompoundStatement( statement->GetLoopBody() );
+	function->jump_targets.pop_back();
+	EmitJump( top_label, JMP_UNCND );
+	EmitLabel( end_label );
+}
 
-				switch ( reference->GetDeclaration()->GetType() ) {
-				case LOCL_DCLR:
-#ifdef _DEBUG
-					wcout << ( block_instructions.size() + 1 ) << L": " << L"store array element, local, name='" << reference->GetName() << L"', id=" << reference->GetDeclaration()->GetId() << endl;
-#endif
-					block_instructions.push_back( MakeInstruction( STOR_ARY_VAR, LOCL, reference->GetDeclaration()->GetId(), static_cast< int >( indices.size() ) ) );
-					break;
-
-				case INST_DCLR:
-#ifdef _DEBUG
-					wcout << ( block_instructions.size() + 1 ) << L": " << L"store array element, instance, name='" << reference->GetName() << L"', id=" << reference->GetDeclaration()->GetId() << endl;
-#endif
-					block_instructions.push_back( MakeInstruction( STOR_ARY_VAR, INST, reference->GetDeclaration()->GetId(), static_cast< int >( indices.size() ) ) );
-					break;
-
-				case CLS_DCLR:
-#ifdef _DEBUG
-					wcout << ( block_instructions.size() + 1 ) << L": " << L"store array element, class, name='" << reference->GetName() << L"', id=" << reference->GetDeclaration()->GetId() << endl;
-#endif
-					// TODO: load class memory
-					block_instructions.push_back( MakeInstruction( STOR_ARY_VAR, CLS, reference->GetDeclaration()->GetId(), static_cast< int >( indices.size() ) ) );
-					break;
-				}
-			}
-			// element
-			else {
-				switch ( reference->GetDeclaration()->GetType() ) {
-				case LOCL_DCLR:
-#ifdef _DEBUG
-					wcout << ( block_instructions.size() + 1 ) << L": " << L"store element, local, name='" << reference->GetName() << L"', id=" << reference->GetDeclaration()->GetId() << endl;
-#endif
-					block_instructions.push_back( MakeInstruction( STOR_VAR, LOCL, reference->GetDeclaration()->GetId() ) );
-					break;
-
-				case INST_DCLR:
-#ifdef _DEBUG
-					wcout << ( block_instructions.size() + 1 ) << L": " << L"store element, instance, name='" << reference->GetName() << L"', id=" << reference->GetDeclaration()->GetId() << endl;
-#endif
-					block_instructions.push_back( MakeInstruction( STOR_VAR, INST, reference->GetDeclaration()->GetId() ) );
-					break;
-
-				case CLS_DCLR:
-#ifdef _DEBUG
-					wcout << ( block_instructions.size() + 1 ) << L": " << L"store element, class, name='" << reference->GetName() << L"', id=" << reference->GetDeclaration()->GetId() << endl;
-#endif
-					// TODO: load class memory
-					block_instructions.push_back( MakeInstruction( STOR_VAR, CLS, reference->GetDeclaration()->GetId() ) );
-					break;
-				}
-			}
+// walks an array by index, or a hash's entries as an array made when the loop starts;
+// the array, index and size are kept in temporaries
+void Emitter::VisitForEachStatement( ForEachStatement* statement )
+{
+	BinaryExpression* in_expression = NodeCast<BinaryExpression>( statement->GetExpression() );
+	CompoundStatement* body = NodeCast<CompoundStatement>( statement->GetStatement() );
+	if ( !in_expression || !body || !statement->decl ) {
+		ProcessError( statement, L"malformed foreach statement" );
+		return;
+	}
+
+	const INT_T array_id = NewTemporary();
+	const INT_T index_id = NewTemporary();
+	const INT_T size_id = NewTemporary();
+	const INT_T top_label = NextLabel();
+	const INT_T step_label = NextLabel();
+	const INT_T test_label = NextLabel();
+	const INT_T end_label = NextLabel();
+
+	Dispatch( in_expression->GetRHSExpression() );
+	if ( !NodeCast<ListExpression>( in_expression->GetRHSExpression() ) ) {
+		EmitInstruction( MakeInstruction( ARY_ENTRIES ) );
+	}
+	EmitStore( Slot{ LOCL, array_id } );
+	EmitLoad( Slot{ LOCL, array_id } );
+	EmitInstruction( MakeInstruction( ARY_SIZE ) );
+	EmitStore( Slot{ LOCL, size_id } );
+	EmitInstruction( MakeInstruction( LOAD_INT_LIT, 0L ) );
+	EmitStore( Slot{ LOCL, index_id } );
+	EmitJump( test_label, JMP_UNCND );
+
+	Scope* saved_scope = current_scope;
+	current_scope = body->GetScope();
+	EnterScope( current_scope );
+
+	// element = array[ index ], where the index runs below the size
+	EmitLabel( top_label );
+	EmitLoad( Slot{ LOCL, index_id } );
+	EmitInstruction( MakeInstruction( LOAD_ARY_ELEM, static_cast< INT_T >( LOCL ), array_id, 1L ) );
+	Slot element;
+	if ( Resolve( statement->decl, statement, element ) ) {
+		EmitStore( element );
+	}
+
+	function->jump_targets.push_back( JumpTargets{ end_label, step_label } );
+	EmitStatements( current_scope );
+	function->jump_targets.pop_back();
+	current_scope = saved_scope;
+
+	// ++index
+	EmitLabel( step_label );
+	EmitInstruction( MakeInstruction( LOAD_INT_LIT, 1L ) );
+	EmitLoad( Slot{ LOCL, index_id } );
+	EmitInstruction( MakeInstruction( ADD ) );
+	EmitStore( Slot{ LOCL, index_id } );
+
+	// index < size
+	EmitLabel( test_label );
+	EmitLoad( Slot{ LOCL, size_id } );
+	EmitLoad( Slot{ LOCL, index_id } );
+	EmitInstruction( MakeInstruction( LES ) );
+	EmitJump( top_label, JMP_TRUE );
+	EmitLabel( end_label );
+
+	ReleaseTemporary( size_id );
+	ReleaseTemporary( index_id );
+	ReleaseTemporary( array_id );
+}
+
+// 'case' and 'else' labels, in the order written; a statement may carry several
+static void CollectCaseLabels( Statement* statement, vector<Statement*> &labels )
+{
+	while ( statement ) {
+		if ( CaseStatement* case_statement = NodeCast<CaseStatement>( statement ) ) {
+			labels.push_back( case_statement );
+			statement = case_statement->GetStatement();
+		}
+		else if ( LabelledStatement* labelled = NodeCast<LabelledStatement>( statement ) ) {
+			labels.push_back( labelled );
+			statement = labelled->GetStatement();
 		}
-		// load
 		else {
-			// array element
-			if ( reference->GetIndices() ) {
-				vector<Expression*> indices = reference->GetIndices()->GetExpressions();
-				for ( size_t i = 0; i < indices.size(); ++i ) {
-					EmitExpression( indices[ i ], block_instructions, jump_table );
-				}
-
-				switch ( reference->GetDeclaration()->GetType() ) {
-				case LOCL_DCLR:
-#ifdef _DEBUG
-					wcout << ( block_instructions.size() + 1 ) << L": " << L"load local variable, name='" << reference->GetName() << L"', id=" << reference->GetDeclaration()->GetId() << endl;
-#endif
-					block_instructions.push_back( MakeInstruction( LOAD_ARY_VAR, LOCL, reference->GetDeclaration()->GetId(), static_cast< int >( indices.size() ) ) );
-
-					break;
-
-				case INST_DCLR:
-#ifdef _DEBUG
-					wcout << ( block_instructions.size() + 1 ) << L": " << L"load instance variable: name='" << reference->GetName() << L"', id=" << reference->GetDeclaration()->GetId() << endl;
-#endif
-					block_instructions.push_back( MakeInstruction( LOAD_ARY_VAR, INST, reference->GetDeclaration()->GetId(), static_cast< int >( indices.size() ) ) );
-					break;
-
-				case CLS_DCLR:
-#ifdef _DEBUG
-					wcout << ( block_instructions.size() + 1 ) << L": " << L"load class variable: name='" << reference->GetName() << L"', id=" << reference->GetDeclaration()->GetId() << endl;
-#endif
-					// TODO: local class memory
-					block_instructions.push_back( MakeInstruction( LOAD_ARY_VAR, CLS, reference->GetDeclaration()->GetId(), static_cast< int >( indices.size() ) ) );
-					break;
-				}
-			}
-			// new array
-			else if ( reference->GetName() == L"Array" && reference->GetReference() && reference->GetReference()->GetName() == L"new" ) {
-				vector<Expression*> dimensions = reference->GetReference()->GetIndices()->GetExpressions();
-				if ( dimensions.size() > 0 ) {
-					EmitExpression( dimensions[ 0 ], block_instructions, jump_table );
-					for ( size_t i = 1; i < dimensions.size(); ++i ) {
-						EmitExpression( dimensions[ i ], block_instructions, jump_table );
-					}
-
-#ifdef _DEBUG
-					wcout << ( block_instructions.size() + 1 ) << L": " << L"new array: dimensions=" << dimensions.size() << endl;
-#endif
-					block_instructions.push_back( MakeInstruction( NEW_ARRAY, static_cast< int >( dimensions.size() ) ) );
-				}
-				else {
-					ProcessError( reference->GetReference(), L"Array size not specified" );
-				}
-			}
-			// element
-			else {
-				switch ( reference->GetDeclaration()->GetType() ) {
-				case LOCL_DCLR:
-#ifdef _DEBUG
-					wcout << ( block_instructions.size() + 1 ) << L": " << L"load local variable, name='" << reference->GetName() << L"', id=" << reference->GetDeclaration()->GetId() << endl;
-#endif
-					block_instructions.push_back( MakeInstruction( LOAD_VAR, LOCL, reference->GetDeclaration()->GetId() ) );
-					break;
-
-				case INST_DCLR:
-#ifdef _DEBUG
-					wcout << ( block_instructions.size() + 1 ) << L": " << L"load variable, instance, name='" << reference->GetName() << L"', id=" << reference->GetDeclaration()->GetId() << endl;
-#endif
-					block_instructions.push_back( MakeInstruction( LOAD_VAR, INST, reference->GetDeclaration()->GetId() ) );
-					break;
-
-				case CLS_DCLR:
-#ifdef _DEBUG
-					wcout << ( block_instructions.size() + 1 ) << L": " << L"load variable, class, name='" << reference->GetName() << L"', id=" << reference->GetDeclaration()->GetId() << endl;
-#endif
-					// TODO: local class memory
-					block_instructions.push_back( MakeInstruction( LOAD_VAR, CLS, reference->GetDeclaration()->GetId() ) );
-					break;
-				}
-			}
+			break;
 		}
-	}
-				   break;
 	}
 }
 
 /****************************
- * Emit expression
+ * Dense integer cases dispatch
+ * through a jump table; anything
+ * else compares case by case
  ****************************/
-void Emitter::EmitExpression( Expression* expression, vector<Instruction*>& block_instructions,
-	unordered_map<long, size_t>& jump_table )
+void Emitter::VisitSwitchStatement( SwitchStatement* statement )
 {
-	switch ( expression->GetExpressionType() ) {
-	case REF_EXPR:
-		EmitReference( static_cast< Reference* >( expression ), false, block_instructions, jump_table );
-		break;
+	CompoundStatement* block = NodeCast<CompoundStatement>( statement->GetSwitchBlock() );
+	if ( !block ) {
+		ProcessError( statement, L"a switch statement expects a block" );
+		return;
+	}
 
-	case FUNCTION_CALL_EXPR:
-		EmitFunctionCall( static_cast< FunctionCall* >( expression ), block_instructions, jump_table );
-		break;
+	const INT_T end_label = NextLabel();
+	INT_T default_label = end_label;
+	vector<Statement*> labels;
+	for ( Statement* block_statement : block->GetStatementList() ) {
+		CollectCaseLabels( block_statement, labels );
+	}
 
-	case BOOLEAN_LIT_EXPR:
-#ifdef _DEBUG
-		wcout << ( block_instructions.size() + 1 ) << L": " << L"load literal: type=boolean, value="
-			<< ( static_cast< BooleanLiteral* >( expression )->GetValue() ? L"true" : L"false" ) << endl;
-#endif     
-		if ( static_cast< BooleanLiteral* >( expression )->GetValue() ) {
-			block_instructions.push_back( MakeInstruction( LOAD_TRUE_LIT ) );
+	vector<std::pair<CaseStatement*, INT_T>> cases;
+	bool is_dense = true;
+	std::set<INT_T> values;
+	for ( Statement* label : labels ) {
+		const INT_T id = NextLabel();
+		case_labels[ label ] = id;
+		if ( CaseStatement* case_statement = NodeCast<CaseStatement>( label ) ) {
+			cases.push_back( { case_statement, id } );
+			if ( IntegerLiteral* value = NodeCast<IntegerLiteral>( case_statement->GetExpression() ) ) {
+				if ( !values.insert( value->GetValue() ).second ) {
+					ProcessError( case_statement, L"duplicate case value " + IntToString( value->GetValue() ) );
+				}
+			}
+			else {
+				is_dense = false;
+			}
 		}
 		else {
-			block_instructions.push_back( MakeInstruction( LOAD_FALSE_LIT ) );
+			default_label = id;
 		}
-		break;
+	}
 
-	case CHAR_LIT_EXPR:
-		// TODO: implement
-		break;
+	const INT_T low = values.size() ? *values.begin() : 0;
+	const INT_T range = values.size() ? *values.rbegin() - low + 1 : 0;
+	is_dense = is_dense && cases.size() >= 4 && range <= 2 * static_cast< INT_T >( cases.size() );
 
-	case INT_LIT_EXPR:
-#ifdef _DEBUG
-		wcout << ( block_instructions.size() + 1 ) << L": " << L"load literal: type=integer, value="
-			<< static_cast< IntegerLiteral* >( expression )->GetValue() << endl;
-#endif
-		block_instructions.push_back( MakeInstruction( LOAD_INT_LIT, static_cast< int >( static_cast< IntegerLiteral* >( expression )->GetValue() ) ) );
+	if ( is_dense ) {
+		Dispatch( statement->GetExpression() );
+		EmitInstruction( MakeInstruction( JMP_TBL, low, range, default_label ) );
+		std::unordered_map<INT_T, INT_T> targets;
+		for ( auto &entry : cases ) {
+			targets[ static_cast< IntegerLiteral* >( entry.first->GetExpression() )->GetValue() ] = entry.second;
+		}
+		for ( INT_T value = low; value < low + range; ++value ) {
+			auto target = targets.find( value );
+			EmitJump( target != targets.end() ? target->second : default_label, JMP_UNCND );
+		}
+	}
+	else {
+		const INT_T value_id = NewTemporary();
+		Dispatch( statement->GetExpression() );
+		EmitStore( Slot{ LOCL, value_id } );
+		for ( auto &entry : cases ) {
+			Dispatch( entry.first->GetExpression() );
+			EmitLoad( Slot{ LOCL, value_id } );
+			EmitInstruction( MakeInstruction( EQL ) );
+			EmitJump( entry.second, JMP_TRUE );
+		}
+		EmitJump( default_label, JMP_UNCND );
+		ReleaseTemporary( value_id );
+	}
+
+	// 'break' leaves the switch, 'continue' still belongs to the loop around it
+	const INT_T continue_label = function->jump_targets.size() ? function->jump_targets.back().continue_label : -1;
+	function->jump_targets.push_back( JumpTargets{ end_label, continue_label } );
+	VisitCompoundStatement( block );
+	function->jump_targets.pop_back();
+	EmitLabel( end_label );
+}
+
+void Emitter::VisitCaseStatement( CaseStatement* statement )
+{
+	auto label = case_labels.find( statement );
+	if ( label == case_labels.end() ) {
+		ProcessError( statement, L"a case label is only expected directly in a switch block" );
+		return;
+	}
+	EmitLabel( label->second );
+	Dispatch( statement->GetStatement() );
+}
+
+void Emitter::VisitLabelledStatement( LabelledStatement* statement )
+{
+	auto label = case_labels.find( statement );
+	if ( label == case_labels.end() ) {
+		ProcessError( statement, L"an 'else' label is only expected directly in a switch block" );
+		return;
+	}
+	EmitLabel( label->second );
+	Dispatch( statement->GetStatement() );
+}
+
+void Emitter::VisitReturnStatement( ReturnStatement* statement )
+{
+	if ( function == global ) {
+		ProcessError( statement, L"a return statement is not expected outside of a function" );
+		return;
+	}
+
+	if ( function->is_constructor ) {
+		if ( statement->GetExpression() ) {
+			ProcessError( statement, L"a constructor cannot return a value" );
+		}
+		EmitLoad( Slot{ LOCL, 0 } );
+	}
+	else if ( statement->GetExpression() ) {
+		Dispatch( statement->GetExpression() );
+		// the callee returns straight to our caller; the return stays for built-ins
+		if ( NodeCast<FunctionCall>( statement->GetExpression() ) && !function->instructions.empty()
+			&& function->instructions.back()->type == CALL_FUNC ) {
+			function->instructions.back()->type = TAIL_CALL;
+		}
+	}
+	else {
+		EmitInstruction( MakeInstruction( LOAD_NIL_LIT ) );
+	}
+	EmitInstruction( MakeInstruction( RTRN ) );
+}
+
+void Emitter::VisitBreakStatement( BreakStatement* statement )
+{
+	if ( function->jump_targets.empty() ) {
+		ProcessError( statement, L"a break statement is not expected outside of a loop or switch" );
+		return;
+	}
+	EmitJump( function->jump_targets.back().break_label, JMP_UNCND );
+}
+
+void Emitter::VisitContinueStatement( ContinueStatement* statement )
+{
+	if ( function->jump_targets.empty() || function->jump_targets.back().continue_label < 0 ) {
+		ProcessError( statement, L"a continue statement is not expected outside of a loop" );
+		return;
+	}
+	EmitJump( function->jump_targets.back().continue_label, JMP_UNCND );
+}
+
+void Emitter::VisitEmptyStatement( EmptyStatement* statement )
+{
+}
+
+/****************************
+ * Declarations
+ ****************************/
+void Emitter::VisitDeclarationList( DeclarationList* decl_list )
+{
+	for ( auto &decl : decl_list->GetDeclarations() ) {
+		EmitVariable( static_cast< VariableDeclaration* >( decl.second ) );
+	}
+}
+
+void Emitter::VisitVariableDeclaration( VariableDeclaration* decl )
+{
+	EmitVariable( decl );
+}
+
+void Emitter::VisitFunctionDeclaration( FunctionDeclaration* decl )
+{
+	AddFunction( EmitFunction( decl, nullptr ), decl );
+}
+
+void Emitter::VisitClassDeclaration( ClassDeclaration* decl )
+{
+	// classes local to a function are only known from here on
+	if ( !instance_counts.count( decl ) ) {
+		vector<ClassDeclaration*> registered;
+		RegisterClass( decl, registered );
+		for ( ClassDeclaration* klass : registered ) {
+			EmitStaticInitializers( klass );
+		}
+	}
+	EmitClass( decl );
+}
+
+/****************************
+ * Expressions; each leaves
+ * exactly one value behind
+ ****************************/
+void Emitter::VisitExpression( Expression* expression )
+{
+	ProcessError( expression, L"expression not supported" );
+	EmitInstruction( MakeInstruction( LOAD_NIL_LIT ) );
+}
+
+void Emitter::VisitNullLiteral( NullLiteral* expression )
+{
+	EmitInstruction( MakeInstruction( LOAD_NIL_LIT ) );
+}
+
+void Emitter::VisitCharacterLiteral( CharacterLiteral* expression )
+{
+	EmitInstruction( MakeInstruction( LOAD_CHAR_LIT, static_cast< INT_T >( expression->GetValue() ) ) );
+}
+
+void Emitter::VisitIntegerLiteral( IntegerLiteral* expression )
+{
+	EmitInstruction( MakeInstruction( LOAD_INT_LIT, expression->GetValue() ) );
+}
+
+void Emitter::VisitFloatLiteral( FloatLiteral* expression )
+{
+	EmitInstruction( MakeInstruction( LOAD_FLOAT_LIT, expression->GetValue() ) );
+}
+
+void Emitter::VisitBooleanLiteral( BooleanLiteral* expression )
+{
+	EmitInstruction( MakeInstruction( expression->GetValue() ? LOAD_TRUE_LIT : LOAD_FALSE_LIT ) );
+}
+
+void Emitter::VisitCharacterString( CharacterString* expression )
+{
+	EmitInstruction( MakeInstruction( NEW_STRING, 0L, 0L, expression->GetString() ) );
+}
+
+void Emitter::VisitVariable( Variable* expression )
+{
+	Declaration* decl = Lookup( expression );
+	if ( !decl ) {
+		ProcessError( expression, L"undefined variable '" + expression->GetName() + L"'" );
+		EmitInstruction( MakeInstruction( LOAD_NIL_LIT ) );
+		return;
+	}
+
+	switch ( decl->GetStatementType() ) {
+	case StatementType::FUNCTION_DECL_STMT:
+		EmitFunctionValue( static_cast< FunctionDeclaration* >( decl ), expression );
 		break;
 
-	case FLOAT_LIT_EXPR:
-#ifdef _DEBUG
-		wcout << ( block_instructions.size() + 1 ) << L": " << L"load literal: type=float, value="
-			<< static_cast< FloatLiteral* >( expression )->GetValue() << endl;
-#endif
-		block_instructions.push_back( MakeInstruction( LOAD_FLOAT_LIT, ( FLOAT_T )static_cast< FloatLiteral* >( expression )->GetValue() ) );
+	case StatementType::CLASS_DECL_STMT:
+		ProcessError( expression, L"class '" + decl->GetName() + L"' cannot be used as a value" );
+		EmitInstruction( MakeInstruction( LOAD_NIL_LIT ) );
 		break;
 
-	case AND_EXPR: {
-		EmitExpression( static_cast< CalculatedExpression* >( expression )->GetRight(), block_instructions, jump_table );
-		const long next_label = NextEndId();
-		const long end_label = NextEndId();
-#ifdef _DEBUG
-		wcout << ( block_instructions.size() + 1 ) << L": " << L"jump true: id=" << next_label << endl;
-#endif
-		block_instructions.push_back( MakeInstruction( JMP, static_cast< int >( next_label ), JMP_TRUE ) );
-#ifdef _DEBUG
-		wcout << ( block_instructions.size() + 1 ) << L": " << L"load literal: type=boolean, value=false" << endl;
-#endif
-		block_instructions.push_back( MakeInstruction( LOAD_FALSE_LIT ) );
-#ifdef _DEBUG
-		wcout << ( block_instructions.size() + 1 ) << L": " << L"jump: id=" << end_label << endl;
-#endif
-		block_instructions.push_back( MakeInstruction( JMP, static_cast< int >( end_label ), JMP_UNCND ) );
-
-#ifdef _DEBUG
-		wcout << ( block_instructions.size() + 1 ) << L": " << L"label: id=" << next_label
-			<< L", pos=" << block_instructions.size() << endl;
-#endif
-		block_instructions.push_back( MakeInstruction( LBL, static_cast< int >( next_label ), JMP_FALSE ) );
-		jump_table.insert( pair<long, size_t>( next_label, block_instructions.size() - 1 ) );
-		EmitExpression( static_cast< CalculatedExpression* >( expression )->GetLeft(), block_instructions, jump_table );
-
-#ifdef _DEBUG
-		wcout << ( block_instructions.size() + 1 ) << L": " << L"label: id=" << end_label
-			<< L", pos=" << block_instructions.size() << endl;
-#endif
-		block_instructions.push_back( MakeInstruction( LBL, static_cast< int >( end_label ), 0 ) );
-		jump_table.insert( pair<long, size_t>( end_label, block_instructions.size() - 1 ) );
-
-#ifdef _DEBUG
-		wcout << ( block_instructions.size() + 1 ) << L": " << L"operator: '&'" << endl;
-#endif
-	}
-				   break;
-
-	case OR_EXPR: {
-		EmitExpression( static_cast< CalculatedExpression* >( expression )->GetRight(), block_instructions, jump_table );
-		const long next_label = NextEndId();
-		const long end_label = NextEndId();
-#ifdef _DEBUG
-		wcout << ( block_instructions.size() + 1 ) << L": " << L"jump false: id=" << next_label << endl;
-#endif
-		block_instructions.push_back( MakeInstruction( JMP, static_cast< int >( next_label ), JMP_FALSE ) );
-#ifdef _DEBUG
-		wcout << ( block_instructions.size() + 1 ) << L": " << L"load literal: type=boolean, value=false" << endl;
-#endif
-		block_instructions.push_back( MakeInstruction( LOAD_FALSE_LIT ) );
-#ifdef _DEBUG
-		wcout << ( block_instructions.size() + 1 ) << L": " << L"jump: id=" << end_label << endl;
-#endif
-		block_instructions.push_back( MakeInstruction( JMP, static_cast< int >( end_label ), JMP_UNCND ) );
-
-#ifdef _DEBUG
-		wcout << ( block_instructions.size() + 1 ) << L": " << L"label: id=" << next_label
-			<< L", pos=" << block_instructions.size() << endl;
-#endif
-		block_instructions.push_back( MakeInstruction( LBL, static_cast< int >( next_label ), JMP_FALSE ) );
-		jump_table.insert( pair<long, size_t>( next_label, block_instructions.size() - 1 ) );
-		EmitExpression( static_cast< CalculatedExpression* >( expression )->GetLeft(), block_instructions, jump_table );
-
-#ifdef _DEBUG
-		wcout << ( block_instructions.size() + 1 ) << L": " << L"label: id=" << end_label
-			<< L", pos=" << block_instructions.size() << endl;
-#endif
-		block_instructions.push_back( MakeInstruction( LBL, static_cast< int >( end_label ), 0 ) );
-		jump_table.insert( pair<long, size_t>( end_label, block_instructions.size() - 1 ) );
-
-#ifdef _DEBUG
-		wcout << ( block_instructions.size() + 1 ) << L": " << L"operator: '|'" << endl;
-#endif
-	}
-				  break;
-
-	case EQL_EXPR: {
-		EmitExpression( static_cast< CalculatedExpression* >( expression )->GetRight(), block_instructions, jump_table );
-		EmitExpression( static_cast< CalculatedExpression* >( expression )->GetLeft(), block_instructions, jump_table );
-#ifdef _DEBUG
-		wcout << ( block_instructions.size() + 1 ) << L": " << L"operator: '=='" << endl;
-#endif
-		block_instructions.push_back( MakeInstruction( EQL ) );
-	}
-				   break;
-
-	case NEQL_EXPR: {
-		EmitExpression( static_cast< CalculatedExpression* >( expression )->GetRight(), block_instructions, jump_table );
-		EmitExpression( static_cast< CalculatedExpression* >( expression )->GetLeft(), block_instructions, jump_table );
-#ifdef _DEBUG
-		wcout << ( block_instructions.size() + 1 ) << L": " << L"operator: '!='" << endl;
-#endif
-		block_instructions.push_back( MakeInstruction( NEQL ) );
-	}
-					break;
-
-	case LES_EXPR: {
-		EmitExpression( static_cast< CalculatedExpression* >( expression )->GetRight(), block_instructions, jump_table );
-		EmitExpression( static_cast< CalculatedExpression* >( expression )->GetLeft(), block_instructions, jump_table );
-#ifdef _DEBUG
-		wcout << ( block_instructions.size() + 1 ) << L": " << L"operator: '<'" << endl;
-#endif
-		block_instructions.push_back( MakeInstruction( LES ) );
-	}
-				   break;
-
-	case GTR_EQL_EXPR: {
-		EmitExpression( static_cast< CalculatedExpression* >( expression )->GetRight(), block_instructions, jump_table );
-		EmitExpression( static_cast< CalculatedExpression* >( expression )->GetLeft(), block_instructions, jump_table );
-#ifdef _DEBUG
-		wcout << ( block_instructions.size() + 1 ) << L": " << L"operator: '>='" << endl;
-#endif
-		block_instructions.push_back( MakeInstruction( GTR_EQL ) );
-	}
-					   break;
-
-	case LES_EQL_EXPR: {
-		EmitExpression( static_cast< CalculatedExpression* >( expression )->GetRight(), block_instructions, jump_table );
-		EmitExpression( static_cast< CalculatedExpression* >( expression )->GetLeft(), block_instructions, jump_table );
-#ifdef _DEBUG
-		wcout << ( block_instructions.size() + 1 ) << L": " << L"operator: '<='" << endl;
-#endif
-		block_instructions.push_back( MakeInstruction( LES_EQL ) );
-	}
-					   break;
-
-	case GTR_EXPR: {
-		EmitExpression( static_cast< CalculatedExpression* >( expression )->GetRight(), block_instructions, jump_table );
-		EmitExpression( static_cast< CalculatedExpression* >( expression )->GetLeft(), block_instructions, jump_table );
-#ifdef _DEBUG
-		wcout << ( block_instructions.size() + 1 ) << L": " << block_instructions.size() << L": " << L"operator: '>'" << endl;
-#endif
-		block_instructions.push_back( MakeInstruction( GTR ) );
-	}
-				   break;
-
-	case ADD_EXPR: {
-		EmitExpression( static_cast< CalculatedExpression* >( expression )->GetRight(), block_instructions, jump_table );
-		EmitExpression( static_cast< CalculatedExpression* >( expression )->GetLeft(), block_instructions, jump_table );
-#ifdef _DEBUG
-		wcout << ( block_instructions.size() + 1 ) << L": " << L"operator: '+'" << endl;
-#endif
-		block_instructions.push_back( MakeInstruction( ADD ) );
-	}
-				   break;
-
-	case SUB_EXPR: {
-		EmitExpression( static_cast< CalculatedExpression* >( expression )->GetRight(), block_instructions, jump_table );
-		EmitExpression( static_cast< CalculatedExpression* >( expression )->GetLeft(), block_instructions, jump_table );
-#ifdef _DEBUG
-		wcout << ( block_instructions.size() + 1 ) << L": " << L"operator: '-'" << endl;
-#endif
-		block_instructions.push_back( MakeInstruction( SUB ) );
-	}
-				   break;
-
-	case MUL_EXPR: {
-		EmitExpression( static_cast< CalculatedExpression* >( expression )->GetRight(), block_instructions, jump_table );
-		EmitExpression( static_cast< CalculatedExpression* >( expression )->GetLeft(), block_instructions, jump_table );
-#ifdef _DEBUG
-		wcout << ( block_instructions.size() + 1 ) << L": " << L"operator: '*'" << endl;
-#endif
-		block_instructions.push_back( MakeInstruction( MUL ) );
-	}
-				   break;
-
-	case DIV_EXPR: {
-		EmitExpression( static_cast< CalculatedExpression* >( expression )->GetRight(), block_instructions, jump_table );
-		EmitExpression( static_cast< CalculatedExpression* >( expression )->GetLeft(), block_instructions, jump_table );
-#ifdef _DEBUG
-		wcout << ( block_instructions.size() + 1 ) << L": " << L"operator: '/'" << endl;
-#endif
-		block_instructions.push_back( MakeInstruction( DIV ) );
-	}
-				   break;
-
-	case MOD_EXPR: {
-		EmitExpression( static_cast< CalculatedExpression* >( expression )->GetRight(), block_instructions, jump_table );
-		EmitExpression( static_cast< CalculatedExpression* >( expression )->GetLeft(), block_instructions, jump_table );
-#ifdef _DEBUG
-		wcout << ( block_instructions.size() + 1 ) << L": " << L"operator: '%'" << endl;
-#endif
-		block_instructions.push_back( MakeInstruction( MOD ) );
-	}
-				   break;
+	default: {
+		Slot slot;
+		if ( Resolve( decl, expression, slot ) ) {
+			EmitLoad( slot );
+		}
+		else {
+			EmitInstruction( MakeInstruction( LOAD_NIL_LIT ) );
+		}
+	}
+		break;
+	}
+}
+
+// a named function used as a value is a closure over nothing
+void Emitter::EmitFunctionValue( FunctionDeclaration* decl, ParseNode* node )
+{
+	const INT_T arity = decl->GetParameters() ? static_cast< INT_T >( decl->GetParameters()->Length() ) : 0;
+	wstring name = decl->GetName();
+
+	auto owner = owners.find( decl );
+	if ( owner != owners.end() ) {
+		if ( decl->GetStorageType() != StorageType::STATIC_STORAGE ) {
+			ProcessError( node, L"method '" + name + L"' can only be called" );
+			EmitInstruction( MakeInstruction( LOAD_NIL_LIT ) );
+			return;
+		}
+		name = owner->second->GetName() + L"::" + name;
+	}
+	EmitInstruction( MakeInstruction( NEW_FUNC, 0L, 0L, name + L":" + IntToString( arity ) ) );
+}
+
+/****************************
+ * The form of an operation that
+ * skips the type dispatch, when
+ * inference proved both operands
+ * integers or both floats
+ ****************************/
+static InstructionType TypedOperation( InstructionType operation, Expression* left, Expression* right )
+{
+	if ( !left->type || left->type != right->type ) {
+		return operation;
+	}
+
+	if ( left->type == SemaType::GetInteger() ) {
+		switch ( operation ) {
+		case ADD: return ADD_INT;
+		case SUB: return SUB_INT;
+		case MUL: return MUL_INT;
+		case EQL: return EQL_INT;
+		case NEQL: return NEQL_INT;
+		case LES: return LES_INT;
+		case GTR: return GTR_INT;
+		case LES_EQL: return LES_EQL_INT;
+		case GTR_EQL: return GTR_EQL_INT;
+		default: return operation;
+		}
+	}
+
+	if ( left->type == SemaType::GetFloat() ) {
+		switch ( operation ) {
+		case ADD: return ADD_FLOAT;
+		case SUB: return SUB_FLOAT;
+		case MUL: return MUL_FLOAT;
+		case DIV: return DIV_FLOAT;
+		case LES: return LES_FLOAT;
+		case GTR: return GTR_FLOAT;
+		case LES_EQL: return LES_EQL_FLOAT;
+		case GTR_EQL: return GTR_EQL_FLOAT;
+		default: return operation;
+		}
+	}
+	return operation;
+}
+
+void Emitter::VisitBinaryExpression( BinaryExpression* expression )
+{
+	InstructionType operation;
+	switch ( expression->GetToken().GetType() ) {
+	case ScannerTokenType::TOKEN_LAND:
+	case ScannerTokenType::TOKEN_LOR:
+		EmitCondition( expression );
+		return;
+
+	case ScannerTokenType::TOKEN_ADD: operation = ADD; break;
+	case ScannerTokenType::TOKEN_SUB: operation = SUB; break;
+	case ScannerTokenType::TOKEN_MUL: operation = MUL; break;
+	case ScannerTokenType::TOKEN_DIV: operation = DIV; break;
+	case ScannerTokenType::TOKEN_MOD: operation = MOD; break;
+	case ScannerTokenType::TOKEN_EQL: operation = EQL; break;
+	case ScannerTokenType::TOKEN_NEQL: operation = NEQL; break;
+	case ScannerTokenType::TOKEN_LES: operation = LES; break;
+	case ScannerTokenType::TOKEN_GTR: operation = GTR; break;
+	case ScannerTokenType::TOKEN_LEQL: operation = LES_EQL; break;
+	case ScannerTokenType::TOKEN_GEQL: operation = GTR_EQL; break;
+	case ScannerTokenType::TOKEN_AND: operation = BIT_AND; break;
+	case ScannerTokenType::TOKEN_OR: operation = BIT_OR; break;
 
 	default:
-		// TODO: error
+		ProcessError( expression, L"operator not supported yet" );
+		EmitInstruction( MakeInstruction( LOAD_NIL_LIT ) );
+		return;
+	}
+
+	// the left operand ends up on top
+	Dispatch( expression->GetRHSExpression() );
+	Dispatch( expression->GetLHSExpression() );
+	EmitInstruction( MakeInstruction( TypedOperation( operation, expression->GetLHSExpression(), expression->GetRHSExpression() ) ) );
+}
+
+void Emitter::VisitUnaryOperation( UnaryOperation* expression )
+{
+	if ( expression->OperationType() == ScannerTokenType::TOKEN_NOT ) {
+		EmitCondition( expression );
+		return;
+	}
+
+	// negative literals are folded
+	if ( IntegerLiteral* integer = NodeCast<IntegerLiteral>( expression->GetExpression() ) ) {
+		EmitInstruction( MakeInstruction( LOAD_INT_LIT, -integer->GetValue() ) );
+	}
+	else if ( FloatLiteral* real = NodeCast<FloatLiteral>( expression->GetExpression() ) ) {
+		EmitInstruction( MakeInstruction( LOAD_FLOAT_LIT, -real->GetValue() ) );
+	}
+	else {
+		EmitInstruction( MakeInstruction( LOAD_INT_LIT, -1L ) );
+		Dispatch( expression->GetExpression() );
+		EmitInstruction( MakeInstruction( expression->GetExpression()->type == SemaType::GetInteger() ? MUL_INT : MUL ) );
+	}
+}
+
+// boolean value of a logical expression
+void Emitter::EmitCondition( Expression* expression )
+{
+	const INT_T true_label = NextLabel();
+	const INT_T end_label = NextLabel();
+
+	EmitBranch( expression, true_label, true );
+	EmitInstruction( MakeInstruction( LOAD_FALSE_LIT ) );
+	EmitJump( end_label, JMP_UNCND );
+	EmitLabel( true_label );
+	EmitInstruction( MakeInstruction( LOAD_TRUE_LIT ) );
+	EmitLabel( end_label );
+}
+
+/****************************
+ * Jumps to 'label' when the
+ * expression is 'jump_if'; &&, ||
+ * and ! short-circuit without
+ * building booleans
+ ****************************/
+void Emitter::EmitBranch( Expression* expression, INT_T label, bool jump_if )
+{
+	if ( UnaryOperation* unary = NodeCast<UnaryOperation>( expression ) ) {
+		if ( unary->OperationType() == ScannerTokenType::TOKEN_NOT ) {
+			EmitBranch( unary->GetExpression(), label, !jump_if );
+			return;
+		}
+	}
+	else if ( BinaryExpression* binary = NodeCast<BinaryExpression>( expression ) ) {
+		const ScannerTokenType type = binary->GetToken().GetType();
+		if ( type == ScannerTokenType::TOKEN_LAND || type == ScannerTokenType::TOKEN_LOR ) {
+			// both operands must agree to take the jump
+			if ( ( type == ScannerTokenType::TOKEN_LAND ) == jump_if ) {
+				const INT_T skip_label = NextLabel();
+				EmitBranch( binary->GetLHSExpression(), skip_label, !jump_if );
+				EmitBranch( binary->GetRHSExpression(), label, jump_if );
+				EmitLabel( skip_label );
+			}
+			else {
+				EmitBranch( binary->GetLHSExpression(), label, jump_if );
+				EmitBranch( binary->GetRHSExpression(), label, jump_if );
+			}
+			return;
+		}
+	}
+	else if ( BooleanLiteral* literal = NodeCast<BooleanLiteral>( expression ) ) {
+		if ( literal->GetValue() == jump_if ) {
+			EmitJump( label, JMP_UNCND );
+		}
+		return;
+	}
+
+	Dispatch( expression );
+	EmitJump( label, jump_if ? JMP_TRUE : JMP_FALSE );
+}
+
+void Emitter::VisitConditionalExpression( ConditionalExpression* expression )
+{
+	const INT_T else_label = NextLabel();
+	const INT_T end_label = NextLabel();
+
+	EmitBranch( expression->GetConditionalExpression(), else_label, false );
+	Dispatch( expression->GetLhsExpression() );
+	EmitJump( end_label, JMP_UNCND );
+	EmitLabel( else_label );
+	Dispatch( expression->GetRhsExpression() );
+	EmitLabel( end_label );
+}
+
+/****************************
+ * Assignment targets: variables,
+ * array or hash elements and static
+ * variables. Indices that would be
+ * evaluated twice are kept in
+ * temporaries
+ ****************************/
+bool Emitter::PrepareTarget( Expression* expression, Target &target, bool reuse )
+{
+	target.base_temp = -1;
+	target.indices.clear();
+	target.index_temps.clear();
+	SubscriptExpression* element = NodeCast<SubscriptExpression>( expression );
+	target.in_bounds = element && element->in_bounds;
+
+	Expression* base = expression;
+	while ( SubscriptExpression* subscript = NodeCast<SubscriptExpression>( base ) ) {
+		target.indices.insert( target.indices.begin(), subscript->GetIndex() );
+		base = subscript->GetExpression();
+	}
+
+	Variable* variable = NodeCast<Variable>( base );
+	DotExpression* dot = NodeCast<DotExpression>( base );
+	Declaration* decl = variable ? Lookup( variable ) : nullptr;
+
+	if ( variable && decl && decl->GetStatementType() == StatementType::VARIABLE_DECL_STMT ) {
+		if ( !Resolve( decl, variable, target.slot ) ) {
+			return false;
+		}
+	}
+	else if ( variable && target.indices.empty() ) {
+		ProcessError( expression, L"'" + variable->GetName() + L"' cannot be assigned to" );
+		return false;
+	}
+	else if ( dot && ClassOf( dot->GetExpression() ) ) {
+		// Class.static_variable
+		ClassDeclaration* klass = ClassOf( dot->GetExpression() );
+		Name const name = klass->GetClassScope()->GetNames().Find( dot->GetIdentifier() );
+		Declaration* field = name ? klass->GetDeclarations().Find( name ) : nullptr;
+		auto slot = field ? global->locals.find( field ) : global->locals.end();
+		if ( slot == global->locals.end() ) {
+			ProcessError( expression, L"'" + klass->GetName() + L"' has no static variable '" + dot->GetIdentifier() + L"'" );
+			return false;
+		}
+		target.slot = Slot{ function == global ? LOCL : GLOB, slot->second };
+	}
+	else if ( target.indices.size() ) {
+		// an element of a computed array
+		Dispatch( base );
+		target.base_temp = NewTemporary();
+		target.slot = Slot{ LOCL, target.base_temp };
+		EmitStore( target.slot );
+	}
+	else {
+		ProcessError( expression, L"invalid assignment target" );
+		return false;
+	}
+
+	for ( Expression* index : target.indices ) {
+		const bool is_simple = NodeCast<IntegerLiteral>( index ) || NodeCast<Variable>( index );
+		if ( reuse && !is_simple ) {
+			Dispatch( index );
+			target.index_temps.push_back( NewTemporary() );
+			EmitStore( Slot{ LOCL, target.index_temps.back() } );
+		}
+		else {
+			target.index_temps.push_back( -1 );
+		}
+	}
+	return true;
+}
+
+// the first index ends up on top
+void Emitter::EmitIndices( Target const &target )
+{
+	for ( size_t i = target.indices.size(); i > 0; --i ) {
+		if ( target.index_temps[ i - 1 ] >= 0 ) {
+			EmitLoad( Slot{ LOCL, target.index_temps[ i - 1 ] } );
+		}
+		else {
+			Dispatch( target.indices[ i - 1 ] );
+		}
+	}
+}
+
+void Emitter::LoadTarget( Target const &target )
+{
+	if ( target.indices.empty() ) {
+		EmitLoad( target.slot );
+		return;
+	}
+	EmitIndices( target );
+	EmitInstruction( MakeInstruction( target.in_bounds ? LOAD_ARY_ELEM : LOAD_ARY_VAR, static_cast< INT_T >( target.slot.scope ), target.slot.id,
+		static_cast< INT_T >( target.indices.size() ) ) );
+}
+
+void Emitter::StoreTarget( Target const &target )
+{
+	if ( target.indices.empty() ) {
+		EmitStore( target.slot );
+		return;
+	}
+	EmitIndices( target );
+	EmitInstruction( MakeInstruction( target.in_bounds ? STOR_ARY_ELEM : STOR_ARY_VAR, static_cast< INT_T >( target.slot.scope ), target.slot.id,
+		static_cast< INT_T >( target.indices.size() ) ) );
+}
+
+void Emitter::ReleaseTarget( Target const &target )
+{
+	for ( INT_T id : target.index_temps ) {
+		if ( id >= 0 ) {
+			ReleaseTemporary( id );
+		}
+	}
+	if ( target.base_temp >= 0 ) {
+		ReleaseTemporary( target.base_temp );
+	}
+}
+
+void Emitter::EmitAssignment( AssignmentExpression* assignment, bool want_value )
+{
+	InstructionType operation = NO_OP;
+	switch ( assignment->GetAssignmentType() ) {
+	case ScannerTokenType::TOKEN_ASSIGN: break;
+	case ScannerTokenType::TOKEN_ADD_EQL: operation = ADD; break;
+	case ScannerTokenType::TOKEN_SUB_EQL: operation = SUB; break;
+	case ScannerTokenType::TOKEN_MUL_EQL: operation = MUL; break;
+	case ScannerTokenType::TOKEN_DIV_EQL: operation = DIV; break;
+
+	default:
+		ProcessError( assignment, L"assignment operator not supported yet" );
 		break;
 	}
+
+	Target target;
+	if ( !PrepareTarget( assignment->GetLHSExpression(), target, operation != NO_OP || want_value ) ) {
+		if ( want_value ) {
+			EmitInstruction( MakeInstruction( LOAD_NIL_LIT ) );
+		}
+		return;
+	}
+
+	Dispatch( assignment->GetRHSExpression() );
+	if ( operation != NO_OP ) {
+		LoadTarget( target );
+		EmitInstruction( MakeInstruction( TypedOperation( operation, assignment->GetLHSExpression(), assignment->GetRHSExpression() ) ) );
+	}
+	StoreTarget( target );
+	if ( want_value ) {
+		LoadTarget( target );
+	}
+	ReleaseTarget( target );
+}
+
+void Emitter::EmitIncrement( Expression* operand, InstructionType operation, bool is_prefix, bool want_value )
+{
+	Target target;
+	if ( !PrepareTarget( operand, target, true ) ) {
+		if ( want_value ) {
+			EmitInstruction( MakeInstruction( LOAD_NIL_LIT ) );
+		}
+		return;
+	}
+
+	// a postfix expression yields the old value
+	if ( want_value && !is_prefix ) {
+		LoadTarget( target );
+	}
+	EmitInstruction( MakeInstruction( LOAD_INT_LIT, 1L ) );
+	LoadTarget( target );
+	if ( operand->type == SemaType::GetInteger() ) {
+		operation = operation == ADD ? ADD_INT : SUB_INT;
+	}
+	EmitInstruction( MakeInstruction( operation ) );
+	StoreTarget( target );
+	if ( want_value && is_prefix ) {
+		LoadTarget( target );
+	}
+	ReleaseTarget( target );
+}
+
+void Emitter::VisitAssignmentExpression( AssignmentExpression* expression )
+{
+	EmitAssignment( expression, true );
+}
+
+void Emitter::VisitPreIncrExpression( PreIncrExpression* expression )
+{
+	EmitIncrement( expression->GetExpression(), ADD, true, true );
+}
+
+void Emitter::VisitPreDecrExpression( PreDecrExpression* expression )
+{
+	EmitIncrement( expression->GetExpression(), SUB, true, true );
+}
+
+void Emitter::VisitPostIncrExpression( PostIncrExpression* expression )
+{
+	EmitIncrement( expression->GetExpression(), ADD, false, true );
+}
+
+void Emitter::VisitPostDecrExpression( PostDecrExpression* expression )
+{
+	EmitIncrement( expression->GetExpression(), SUB, false, true );
+}
+
+void Emitter::VisitSubscriptExpression( SubscriptExpression* expression )
+{
+	vector<Expression*> indices;
+	Expression* base = expression;
+	while ( SubscriptExpression* subscript = NodeCast<SubscriptExpression>( base ) ) {
+		indices.insert( indices.begin(), subscript->GetIndex() );
+		base = subscript->GetExpression();
+	}
+
+	// Array.new_[ d0 ][ d1 ]...
+	if ( DotExpression* dot = NodeCast<DotExpression>( base ) ) {
+		if ( dot->GetIdentifier() == L"new_" ) {
+			Variable* type_name = NodeCast<Variable>( dot->GetExpression() );
+			if ( !type_name || type_name->GetName() != L"Array" ) {
+				ProcessError( expression, L"only arrays are created with a size" );
+				EmitInstruction( MakeInstruction( LOAD_NIL_LIT ) );
+				return;
+			}
+			EmitNewArray( indices );
+			return;
+		}
+	}
+
+	Target target;
+	if ( PrepareTarget( expression, target, false ) ) {
+		LoadTarget( target );
+		ReleaseTarget( target );
+	}
+	else {
+		EmitInstruction( MakeInstruction( LOAD_NIL_LIT ) );
+	}
+}
+
+void Emitter::EmitNewArray( vector<Expression*> const &dimensions )
+{
+	// the first dimension ends up on top
+	for ( size_t i = dimensions.size(); i > 0; --i ) {
+		Dispatch( dimensions[ i - 1 ] );
+	}
+	EmitInstruction( MakeInstruction( NEW_ARRAY, static_cast< INT_T >( dimensions.size() ) ) );
+}
+
+void Emitter::VisitDotExpression( DotExpression* expression )
+{
+	if ( ClassOf( expression->GetExpression() ) ) {
+		Target target;
+		if ( PrepareTarget( expression, target, false ) ) {
+			LoadTarget( target );
+			return;
+		}
+	}
+	else {
+		ProcessError( expression, L"'" + expression->GetIdentifier() + L"' can only be reached through a method call" );
+	}
+	EmitInstruction( MakeInstruction( LOAD_NIL_LIT ) );
+}
+
+/****************************
+ * Calls. Arguments are pushed last
+ * to first, then the receiver: an
+ * object, nil for plain functions or
+ * a closure
+ ****************************/
+void Emitter::VisitFunctionCall( FunctionCall* expression )
+{
+	EmitCall( expression, true );
+}
+
+void Emitter::EmitArguments( ExpressionList* arguments )
+{
+	if ( !arguments ) {
+		return;
+	}
+	auto &expressions = arguments->GetExpressions();
+	for ( auto argument = expressions.rbegin(); argument != expressions.rend(); ++argument ) {
+		Dispatch( *argument );
+	}
+}
+
+void Emitter::EmitCall( FunctionCall* call, bool want_value )
+{
+	ExpressionList* arguments = call->GetArgumentList();
+	const size_t arity = arguments ? arguments->Length() : 0;
+	const INT_T argument_count = static_cast< INT_T >( arity );
+	const INT_T has_return = want_value ? 1 : 0;
+	const wstring signature = L":" + IntToString( argument_count );
+	Expression* callee = call->GetFunctionExpression();
+
+	if ( DotExpression* dot = NodeCast<DotExpression>( callee ) ) {
+		const wstring name = dot->GetIdentifier();
+		ClassDeclaration* klass = ClassOf( dot->GetExpression() );
+
+		// Class.new_( ... )
+		if ( name == L"new_" ) {
+			Variable* type_name = NodeCast<Variable>( dot->GetExpression() );
+			if ( klass ) {
+				EmitNew( klass, arguments, want_value, call );
+			}
+			else if ( !type_name || !EmitBuiltinNew( type_name->GetName(), arguments, call ) ) {
+				ProcessError( call, L"'" + ( type_name ? type_name->GetName() : wstring( L"expression" ) ) + L"' is not a class" );
+			}
+			else if ( !want_value ) {
+				EmitInstruction( MakeInstruction( POP ) );
+			}
+			return;
+		}
+
+		// Class.function( ... )
+		if ( klass ) {
+			FunctionDeclaration* decl = FindMember( klass, name, arity );
+			if ( !decl || decl->GetStorageType() != StorageType::STATIC_STORAGE ) {
+				ProcessError( call, L"'" + klass->GetName() + L"' has no static function '" + name + L"' taking "
+					+ IntToString( argument_count ) + L" argument(s)" );
+				return;
+			}
+			EmitStaticCall( decl, klass->GetName() + L"::" + name, arguments, want_value );
+			return;
+		}
+
+		// the size of a value inference proved an array
+		if ( name == L"size" && !arity && dot->GetExpression()->type == SemaType::GetList() ) {
+			Dispatch( dot->GetExpression() );
+			EmitInstruction( MakeInstruction( want_value ? ARY_SIZE : POP ) );
+			return;
+		}
+
+		// object.method( ... )
+		EmitArguments( arguments );
+		Dispatch( dot->GetExpression() );
+		EmitInstruction( MakeInstruction( CALL_FUNC, argument_count, has_return, name + signature ) );
+		return;
+	}
+
+	if ( Variable* variable = NodeCast<Variable>( callee ) ) {
+		const wstring name = variable->GetName();
+		Declaration* decl = FindCallee( name, arity );
+		if ( !decl ) {
+			auto klass = classes.find( name );
+			if ( klass != classes.end() ) {
+				EmitNew( klass->second, arguments, want_value, call );
+			}
+			else {
+				ProcessError( call, L"undefined function '" + name + L"' taking " + IntToString( argument_count ) + L" argument(s)" );
+			}
+			return;
+		}
+
+		switch ( decl->GetStatementType() ) {
+		case StatementType::CLASS_DECL_STMT:
+			EmitNew( static_cast< ClassDeclaration* >( decl ), arguments, want_value, call );
+			return;
+
+		case StatementType::FUNCTION_DECL_STMT: {
+			FunctionDeclaration* function_decl = static_cast< FunctionDeclaration* >( decl );
+			auto owner = owners.find( decl );
+			if ( owner == owners.end() ) {
+				EmitStaticCall( function_decl, name, arguments, want_value );
+			}
+			else if ( function_decl->GetFunctionType() == FunctionType::CONSTRUCTOR ) {
+				EmitNew( owner->second, arguments, want_value, call );
+			}
+			else if ( function_decl->GetStorageType() == StorageType::STATIC_STORAGE ) {
+				EmitStaticCall( function_decl, owner->second->GetName() + L"::" + name, arguments, want_value );
+			}
+			else if ( function->klass != owner->second || function->is_static || function->is_lambda ) {
+				ProcessError( call, L"method '" + name + L"' of '" + owner->second->GetName() + L"' can only be called from its methods" );
+			}
+			else {
+				FailInline();
+				EmitArguments( arguments );
+				EmitLoad( Slot{ LOCL, 0 } );
+				EmitInstruction( MakeInstruction( CALL_FUNC, argument_count, has_return, name + signature ) );
+			}
+			return;
+		}
+
+		default:
+			break;
+		}
+	}
+
+	// a closure value
+	EmitArguments( arguments );
+	Dispatch( callee );
+	EmitInstruction( MakeInstruction( CALL_FUNC, argument_count, has_return, wstring() ) );
+}
+
+// a free or static function, known by name
+void Emitter::EmitStaticCall( FunctionDeclaration* decl, wstring const &name, ExpressionList* arguments, bool want_value )
+{
+	const INT_T argument_count = arguments ? static_cast< INT_T >( arguments->Length() ) : 0;
+	EmitArguments( arguments );
+	if ( !EmitInline( decl, want_value ) ) {
+		EmitInstruction( MakeInstruction( LOAD_NIL_LIT ) );
+		EmitInstruction( MakeInstruction( CALL_FUNC, argument_count, want_value ? 1L : 0L, name + L":" + IntToString( argument_count ) ) );
+	}
+}
+
+/****************************
+ * Inlining. A function made of
+ * declarations, expression
+ * statements and a final return
+ * is emitted where it's called,
+ * its parameters and variables in
+ * temporaries of the caller. The
+ * code is dropped again, leaving
+ * the arguments for a real call,
+ * if it grows past INLINE_SIZE or
+ * the body turns out to need its
+ * own frame: it recurses, makes a
+ * lambda or reaches fields
+ ****************************/
+static const size_t INLINE_SIZE = 32;
+static const size_t INLINE_DEPTH = 4;
+
+bool Emitter::EmitInline( FunctionDeclaration* decl, bool want_value )
+{
+	if ( !inline_calls || inlined_calls.size() >= INLINE_DEPTH || !IsInlineCandidate( decl ) ) {
+		return false;
+	}
+	for ( size_t i = 0; i < inlined_calls.size(); ++i ) {
+		if ( inlined_calls[ i ].decl == decl ) {
+			// recursive; neither this call nor the ones it's nested in are expanded
+			for ( ; i < inlined_calls.size(); ++i ) {
+				inlined_calls[ i ].failed = true;
+			}
+			return false;
+		}
+	}
+
+	// called from its own body
+	ExpressionList* parameters = decl->GetParameters();
+	for ( unsigned int i = 0; parameters && i < parameters->Length(); ++i ) {
+		Variable* parameter = NodeCast<Variable>( parameters->GetExpressionAt( i ) );
+		if ( parameter && function->locals.count( parameter->GetDeclaration() ) ) {
+			return false;
+		}
+	}
+	for ( auto &symbol : decl->GetFunctionBody()->GetScope()->GetSymbols() ) {
+		if ( function->locals.count( symbol.second ) ) {
+			return false;
+		}
+	}
+
+	const size_t start = function->instructions.size();
+	const std::multimap<std::pair<wstring, int>, wstring> saved_errors = errors;
+	Scope* saved_scope = current_scope;
+	current_scope = decl->GetFunctionBody()->GetScope();
+	inlined_calls.push_back( InlinedCall{ decl, false } );
+
+	// the arguments are on the stack, the first on top
+	vector<Declaration*> variables;
+	vector<INT_T> temporaries;
+	for ( unsigned int i = 0; parameters && i < parameters->Length(); ++i ) {
+		Variable* parameter = NodeCast<Variable>( parameters->GetExpressionAt( i ) );
+		const INT_T id = NewTemporary();
+		if ( parameter && parameter->GetDeclaration() ) {
+			function->locals[ parameter->GetDeclaration() ] = id;
+			variables.push_back( parameter->GetDeclaration() );
+		}
+		temporaries.push_back( id );
+		EmitStore( Slot{ LOCL, id } );
+	}
+
+	// temporaries may hold anything; a new frame starts out nil
+	for ( Declaration* variable : ScopeVariables( current_scope ) ) {
+		const INT_T id = NewTemporary();
+		function->locals[ variable ] = id;
+		variables.push_back( variable );
+		temporaries.push_back( id );
+		EmitInstruction( MakeInstruction( LOAD_NIL_LIT ) );
+		EmitStore( Slot{ LOCL, id } );
+	}
+
+	Expression* result = nullptr;
+	for ( Statement* statement : current_scope->GetStatements() ) {
+		if ( ReturnStatement* rtrn = NodeCast<ReturnStatement>( statement ) ) {
+			result = rtrn->GetExpression();
+		}
+		else {
+			Dispatch( statement );
+		}
+	}
+	if ( result ) {
+		Dispatch( result );
+	}
+	else {
+		EmitInstruction( MakeInstruction( LOAD_NIL_LIT ) );
+	}
+	if ( !want_value ) {
+		EmitInstruction( MakeInstruction( POP ) );
+	}
+
+	for ( Declaration* variable : variables ) {
+		function->locals.erase( variable );
+	}
+	for ( INT_T id : temporaries ) {
+		ReleaseTemporary( id );
+	}
+	current_scope = saved_scope;
+
+	const bool failed = inlined_calls.back().failed || errors.size() != saved_errors.size()
+		|| function->instructions.size() - start > INLINE_SIZE;
+	inlined_calls.pop_back();
+	if ( !failed ) {
+		return true;
+	}
+
+	// the body is emitted again as a function of its own, errors and all
+	function->instructions.resize( start );
+	for ( auto label = function->jump_table.begin(); label != function->jump_table.end(); ) {
+		label = label->second >= start ? function->jump_table.erase( label ) : std::next( label );
+	}
+	errors = saved_errors;
+	return false;
+}
+
+bool Emitter::IsInlineCandidate( FunctionDeclaration* decl )
+{
+	auto &statements = decl->GetStatements();
+	size_t position = 0;
+	for ( Statement* statement : statements ) {
+		++position;
+		switch ( statement->GetStatementType() ) {
+		case StatementType::VARIABLE_DECL_STMT:
+		case StatementType::VDECL_LIST_STMT:
+		case StatementType::EXPR_STATEMENT:
+		case StatementType::SHOW_STATEMENT:
+		case StatementType::EMPTY_STMT:
+			break;
+
+		case StatementType::RETURN_STATEMENT:
+			if ( position != statements.size() ) {
+				return false;
+			}
+			break;
+
+		default:
+			return false;
+		}
+	}
+	return true;
+}
+
+// the body being inlined can't be emitted in the caller's frame
+void Emitter::FailInline()
+{
+	if ( !inlined_calls.empty() ) {
+		inlined_calls.back().failed = true;
+	}
+}
+
+void Emitter::EmitNew( ClassDeclaration* klass, ExpressionList* arguments, bool want_value, ParseNode* node )
+{
+	const size_t arity = arguments ? arguments->Length() : 0;
+	const INT_T argument_count = static_cast< INT_T >( arity );
+	const bool has_constructor = FindConstructor( klass, arity ) || ( !arity && NeedsDefaultConstructor( klass ) );
+	if ( !has_constructor && ( arity || HasConstructors( klass ) ) ) {
+		ProcessError( node, L"'" + klass->GetName() + L"' has no constructor taking " + IntToString( argument_count ) + L" argument(s)" );
+		return;
+	}
+
+	EmitArguments( arguments );
+	EmitInstruction( MakeInstruction( NEW_OBJ, argument_count, 1L, klass->GetName() ) );
+	if ( has_constructor ) {
+		// constructors hand back the new instance
+		EmitInstruction( MakeInstruction( CALL_FUNC, argument_count, want_value ? 1L : 0L,
+			klass->GetName() + L":" + IntToString( argument_count ) ) );
+	}
+	else if ( !want_value ) {
+		EmitInstruction( MakeInstruction( POP ) );
+	}
+}
+
+bool Emitter::EmitBuiltinNew( wstring const &class_name, ExpressionList* arguments, ParseNode* node )
+{
+	const bool has_arguments = arguments && arguments->Length();
+	if ( class_name == L"String" ) {
+		EmitInstruction( MakeInstruction( NEW_STRING ) );
+	}
+	else if ( class_name == L"Hash" ) {
+		EmitInstruction( MakeInstruction( NEW_HASH ) );
+	}
+	else if ( class_name == L"Array" ) {
+		ProcessError( node, L"arrays are created with a size, as in Array.new_[ size ]" );
+		EmitInstruction( MakeInstruction( LOAD_NIL_LIT ) );
+	}
+	else {
+		return false;
+	}
+
+	if ( has_arguments ) {
+		ProcessError( node, L"'" + class_name + L"' takes no constructor arguments" );
+	}
+	return true;
+}
+
+void Emitter::VisitNewExpression( NewExpression* expression )
+{
+	Expression* inner = expression->GetExpression();
+	FunctionCall* call = NodeCast<FunctionCall>( inner );
+	ExpressionList* arguments = call ? call->GetArgumentList() : nullptr;
+	Variable* type_name = NodeCast<Variable>( call ? call->GetFunctionExpression() : inner );
+
+	if ( !type_name ) {
+		ProcessError( expression, L"'new' expects a class name" );
+		EmitInstruction( MakeInstruction( LOAD_NIL_LIT ) );
+		return;
+	}
+
+	if ( ClassDeclaration* klass = ClassOf( type_name ) ) {
+		EmitNew( klass, arguments, true, expression );
+	}
+	else if ( !EmitBuiltinNew( type_name->GetName(), arguments, expression ) ) {
+		ProcessError( expression, L"undefined class '" + type_name->GetName() + L"'" );
+		EmitInstruction( MakeInstruction( LOAD_NIL_LIT ) );
+	}
 }
 
 /****************************
- * Clear parse tree nodes
+ * Lambdas are program functions;
+ * the closure carries copies of the
+ * outer locals they use
  ****************************/
-void Emitter::ClearInstructions() {
-	while ( !instruction_factory.empty() ) {
-		Instruction* tmp = instruction_factory.front();
-		instruction_factory.erase( instruction_factory.begin() );
-		// delete
-		delete tmp;
-		tmp = NULL;
+void Emitter::VisitLambdaExpression( LambdaExpression* expression )
+{
+	CompoundStatement* body = NodeCast<CompoundStatement>( expression->GetLambdaBody() );
+	if ( !body ) {
+		ProcessError( expression, L"a lambda expects a block" );
+		EmitInstruction( MakeInstruction( LOAD_NIL_LIT ) );
+		return;
+	}
+
+	// functions made while inlining would be made again for the real call
+	if ( !inlined_calls.empty() ) {
+		FailInline();
+		EmitInstruction( MakeInstruction( LOAD_NIL_LIT ) );
+		return;
+	}
+
+	const wstring name = L"#lambda#" + IntToString( lambda_id++ );
+	FunctionContext context{ function, function->klass, true };
+	FunctionContext* saved = function;
+	Scope* saved_scope = current_scope;
+	function = &context;
+	current_scope = body->GetScope();
+
+	const INT_T parameter_count = DeclareParameters( expression->GetParamaters() );
+	EnterScope( current_scope );
+	EmitStatements( current_scope );
+	EmitReturn();
+	ExecutableFunction* executable = MakeFunction( name, NO_OP, parameter_count, true );
+
+	function = saved;
+	current_scope = saved_scope;
+	AddFunction( executable, expression );
+
+	for ( Declaration* capture : context.captures ) {
+		Slot slot;
+		if ( Resolve( capture, expression, slot ) ) {
+			EmitLoad( slot );
+		}
+		else {
+			EmitInstruction( MakeInstruction( LOAD_NIL_LIT ) );
+		}
+	}
+	EmitInstruction( MakeInstruction( NEW_FUNC, static_cast< INT_T >( context.captures.size() ), 0L,
+		name + L":" + IntToString( parameter_count ) ) );
+}
+
+void Emitter::VisitListExpression( ListExpression* expression )
+{
+	ExpressionList* elements = expression->GetExpressionList();
+	const INT_T count = elements ? static_cast< INT_T >( elements->Length() ) : 0;
+	const INT_T list_id = NewTemporary();
+
+	EmitInstruction( MakeInstruction( LOAD_INT_LIT, count ) );
+	EmitInstruction( MakeInstruction( NEW_ARRAY, 1L ) );
+	EmitStore( Slot{ LOCL, list_id } );
+	for ( INT_T i = 0; i < count; ++i ) {
+		Dispatch( elements->GetExpressionAt( static_cast< unsigned int >( i ) ) );
+		EmitInstruction( MakeInstruction( LOAD_INT_LIT, i ) );
+		EmitInstruction( MakeInstruction( STOR_ARY_VAR, static_cast< INT_T >( LOCL ), list_id, 1L ) );
+	}
+	EmitLoad( Slot{ LOCL, list_id } );
+	ReleaseTemporary( list_id );
+}
+
+void Emitter::VisitMapExpression( MapExpression* expression )
+{
+	const INT_T map_id = NewTemporary();
+
+	EmitInstruction( MakeInstruction( NEW_HASH ) );
+	EmitStore( Slot{ LOCL, map_id } );
+	for ( auto &key_value : *expression ) {
+		Dispatch( key_value.second );
+		Dispatch( key_value.first );
+		EmitInstruction( MakeInstruction( STOR_ARY_VAR, static_cast< INT_T >( LOCL ), map_id, 1L ) );
+	}
+	EmitLoad( Slot{ LOCL, map_id } );
+	ReleaseTemporary( map_id );
+}
+
+// the instructions as emitted, before they're optimized
+void Emitter::TraceFunction( ExecutableFunction* executable )
+{
+	vector<Instruction*> &instructions = executable->GetInstructions();
+	TraceLog::Log( EMIT_FUNCTION, executable->GetName(), executable->GetParameterCount(), executable->GetLocalCount(), instructions.size() );
+	if ( !TRACE_IS_ON( TRACE_EMIT, TRACE_ALL ) ) {
+		return;
+	}
+
+	for ( size_t i = 0; i < instructions.size(); ++i ) {
+		Instruction* instruction = instructions[ i ];
+		if ( instruction->operand5.empty() ) {
+			TraceLog::Log( EMIT_INSTRUCTION, i, instruction->type, instruction->operand1, instruction->operand2 );
+		}
+		else {
+			TraceLog::Log( EMIT_INSTRUCTION, instruction->operand5, i, instruction->type, instruction->operand1, instruction->operand2 );
+		}
 	}
 }
@@ -13,52 +13,214 @@
 #include <memory>
 
 #include "common.h"
-#include "tree.h"
+#include "trace.h"
+#include "visitor.h"
 
 /****************************
  * Translate trees to instructions
  ****************************/
 
 using std::set;
+using std::vector;
+using std::wstring;
+using std::unordered_map;
 
 namespace compiler {
-	class Emitter {
-		std::map<int, wstring> errors;
+	class Emitter : public TreeVisitor<Emitter>
+	{
+		friend class TreeVisitor<Emitter>;
+
+		// where a variable lives at runtime
+		struct Slot {
+			VScope	scope;
+			INT_T	id;
+		};
+
+		// an assignable expression; elements keep their (possibly spilled) indices
+		struct Target {
+			Slot					slot;
+			vector<Expression*>		indices;		// empty for plain variables
+			vector<INT_T>			index_temps;	// -1 where the index is re-emitted
+			INT_T					base_temp;		// holds a computed array, or -1
+			bool					in_bounds;		// the one index is proven to be within the array
+		};
+
+		// a call whose callee body is being emitted in place
+		struct InlinedCall {
+			FunctionDeclaration*	decl;
+			bool					failed;			// the body needs a frame of its own after all
+		};
+
+		// where break and continue go in the innermost loop or switch
+		struct JumpTargets {
+			INT_T break_label;
+			INT_T continue_label;	// -1 in a switch outside any loop
+		};
+
+		/****************************
+		 * Instructions and slots of the
+		 * function being emitted. Locals
+		 * are numbered from 1; slot 0 is
+		 * 'self'. The global function's
+		 * locals are the program globals
+		 ****************************/
+		struct FunctionContext {
+			FunctionContext*					enclosing;
+			ClassDeclaration*					klass;			// owner of a method or static function
+			bool								is_lambda;
+			bool								is_static;
+			bool								is_constructor;
+			vector<Instruction*>				instructions;
+			unordered_map<long, size_t>			jump_table;
+			unordered_map<Declaration*, INT_T>	locals;
+			vector<Declaration*>				captures;		// a lambda's free variables, by value
+			vector<JumpTargets>					jump_targets;
+			vector<INT_T>						free_temporaries;
+			INT_T								local_count;
+
+			FunctionContext( FunctionContext* outer, ClassDeclaration* owner, bool lambda ) : enclosing( outer ), klass( owner ),
+				is_lambda( lambda ), is_static( false ), is_constructor( false ), local_count( 0 ) {
+			}
+		};
+
+		std::multimap<std::pair<wstring, int>, wstring> errors;		// by file and line
 		std::unique_ptr<ParsedProgram> parsed_program;
 		static vector<Instruction*> instruction_factory;
-		INT_T start_label_id;
-		INT_T end_label_id;
-		int returns_value;
-
-		INT_T NextEndId() {
-			return end_label_id++;
-		}
+		ExecutableProgram* executable_program;
+		FunctionContext* function;
+		FunctionContext* global;
+		Scope* current_scope;										// for names used before their declaration
+		unordered_map<wstring, ClassDeclaration*> classes;			// every class, by name
+		unordered_map<ClassDeclaration*, INT_T> instance_counts;
+		unordered_map<Declaration*, INT_T> fields;					// instance variables
+		unordered_map<Declaration*, ClassDeclaration*> owners;		// class of each member
+		unordered_map<Statement*, INT_T> case_labels;				// case and default labels of switches
+		INT_T label_id;
+		INT_T lambda_id;
+		bool inline_calls;
+		int line;													// of the statement being emitted
+		vector<InlinedCall> inlined_calls;							// innermost last
 
-		INT_T NextStartId() {
-			return start_label_id++;
+		INT_T NextLabel() {
+			return label_id++;
 		}
 
 		void ProcessError( ParseNode* node, const wstring &msg );
 		void ProcessError( const wstring &msg );
 		bool NoErrors();
 
-		ExecutableClass* EmitClass( ParsedClass* parsed_klass );
-		ExecutableFunction* EmitFunction( ParsedFunction* parsed_function );
-		void EmitFunction( StatementList* block_statements, vector<Instruction*> & block_instructions, unordered_map<long, size_t>& jump_table, set<size_t> &leaders );
-		void EmitBlock( StatementList* block_statements, vector<Instruction*>& block_instructions, unordered_map<long, size_t>& jump_table );
-		void EmitFunctionCallParameters( Reference* reference, vector<Instruction*>& block_instructions, unordered_map<long, size_t>& jump_table );
-		void EmitFunctionCall( FunctionCall* function_call, vector<Instruction*>& block_instructions, unordered_map<long, size_t>& jump_table );
-		void EmitNestedFunctionCall( Reference* reference, vector<Instruction*>& block_instructions, unordered_map<long, size_t>& jump_table );
-		void EmitIfElse( IfElse* if_else, vector<Instruction*>& block_instructions, unordered_map<long, size_t>& jump_table );
-		void EmitWhile( While* if_while, vector<Instruction*>& block_instructions, unordered_map<long, size_t>& jump_table );
-		void EmitAssignment( Assignment* assignment, vector<Instruction*>& block_instructions, unordered_map<long, size_t>& jump_table );
-		void EmitReference( Reference* reference, bool is_store, vector<Instruction*>& block_instructions, unordered_map<long, size_t>& jump_table );
-		void EmitExpression( Expression* expression, vector<Instruction*>& block_instructions, unordered_map<long, size_t>& jump_table );
+		// instruction stream
+		void EmitInstruction( Instruction* instruction );
+		void EmitLabel( INT_T label );
+		void EmitJump( INT_T label, INT_T condition );
+		void EmitLoad( Slot const &slot );
+		void EmitStore( Slot const &slot );
+		INT_T NewTemporary();
+		void ReleaseTemporary( INT_T id );
+		ExecutableFunction* MakeFunction( wstring const &name, InstructionType operation, INT_T parameter_count, bool returns_value );
+		void AddFunction( ExecutableFunction* executable, ParseNode* node );
+
+		// declarations and slots
+		void RegisterClasses( Scope* scope );
+		void RegisterClass( ClassDeclaration* klass, vector<ClassDeclaration*> &registered );
+		void EmitStaticInitializers( ClassDeclaration* klass );
+		void EnterScope( Scope* scope );
+		vector<Declaration*> ScopeVariables( Scope* scope );
+		INT_T DeclareParameters( ExpressionList* parameters );
+		Declaration* Lookup( Variable* variable );
+		ClassDeclaration* ClassOf( Expression* expression );
+		bool Resolve( Declaration* decl, ParseNode* node, Slot &slot );
+		Declaration* FindCallee( wstring const &name, size_t arity );
+		FunctionDeclaration* FindMember( ClassDeclaration* klass, wstring const &name, size_t arity );
+		FunctionDeclaration* FindConstructor( ClassDeclaration* klass, size_t arity );
+		bool HasConstructors( ClassDeclaration* klass );
+		bool NeedsDefaultConstructor( ClassDeclaration* klass );
+
+		// functions and classes
+		void EmitClass( ClassDeclaration* klass );
+		ExecutableFunction* EmitFunction( FunctionDeclaration* decl, ClassDeclaration* klass );
+		void EmitFieldInitializers( ClassDeclaration* klass );
+		void EmitReturn();
+		void EmitStatements( Scope* scope );
+		void EmitVariable( VariableDeclaration* decl );
+
+		// expressions
+		void EmitBranch( Expression* expression, INT_T label, bool jump_if );
+		void EmitCondition( Expression* expression );
+		void EmitArguments( ExpressionList* arguments );
+		void EmitCall( FunctionCall* call, bool want_value );
+		void EmitStaticCall( FunctionDeclaration* decl, wstring const &name, ExpressionList* arguments, bool want_value );
+		bool EmitInline( FunctionDeclaration* decl, bool want_value );
+		static bool IsInlineCandidate( FunctionDeclaration* decl );
+		void FailInline();
+		void EmitNew( ClassDeclaration* klass, ExpressionList* arguments, bool want_value, ParseNode* node );
+		bool EmitBuiltinNew( wstring const &class_name, ExpressionList* arguments, ParseNode* node );
+		void EmitNewArray( vector<Expression*> const &dimensions );
+		void EmitFunctionValue( FunctionDeclaration* decl, ParseNode* node );
+		void EmitAssignment( AssignmentExpression* assignment, bool want_value );
+		void EmitIncrement( Expression* operand, InstructionType operation, bool is_prefix, bool want_value );
+		bool PrepareTarget( Expression* expression, Target &target, bool reuse );
+		void EmitIndices( Target const &target );
+		void LoadTarget( Target const &target );
+		void StoreTarget( Target const &target );
+		void ReleaseTarget( Target const &target );
+
+		// statements
+		void VisitStatement( Statement* statement );
+		void VisitExpressionStatement( ExpressionStatement* statement );
+		void VisitDumpStatement( DumpStatement* statement );
+		void VisitCompoundStatement( CompoundStatement* statement );
+		void VisitIfStatement( IfStatement* statement );
+		void VisitWhileStatement( WhileStatement* statement );
+		void VisitDoWhileStatement( DoWhileStatement* statement );
+		void VisitLoopStatement( LoopStatement* statement );
+		void VisitForEachStatement( ForEachStatement* statement );
+		void VisitSwitchStatement( SwitchStatement* statement );
+		void VisitCaseStatement( CaseStatement* statement );
+		void VisitLabelledStatement( LabelledStatement* statement );
+		void VisitReturnStatement( ReturnStatement* statement );
+		void VisitBreakStatement( BreakStatement* statement );
+		void VisitContinueStatement( ContinueStatement* statement );
+		void VisitEmptyStatement( EmptyStatement* statement );
+
+		// declarations
+		void VisitDeclarationList( DeclarationList* decl_list );
+		void VisitVariableDeclaration( VariableDeclaration* decl );
+		void VisitFunctionDeclaration( FunctionDeclaration* decl );
+		void VisitClassDeclaration( ClassDeclaration* decl );
+
+		// expressions
+		void VisitExpression( Expression* expression );
+		void VisitNullLiteral( NullLiteral* expression );
+		void VisitCharacterLiteral( CharacterLiteral* expression );
+		void VisitIntegerLiteral( IntegerLiteral* expression );
+		void VisitFloatLiteral( FloatLiteral* expression );
+		void VisitBooleanLiteral( BooleanLiteral* expression );
+		void VisitCharacterString( CharacterString* expression );
+		void VisitVariable( Variable* expression );
+		void VisitBinaryExpression( BinaryExpression* expression );
+		void VisitAssignmentExpression( AssignmentExpression* expression );
+		void VisitUnaryOperation( UnaryOperation* expression );
+		void VisitConditionalExpression( ConditionalExpression* expression );
+		void VisitFunctionCall( FunctionCall* expression );
+		void VisitSubscriptExpression( SubscriptExpression* expression );
+		void VisitDotExpression( DotExpression* expression );
+		void VisitPreIncrExpression( PreIncrExpression* expression );
+		void VisitPreDecrExpression( PreDecrExpression* expression );
+		void VisitPostIncrExpression( PostIncrExpression* expression );
+		void VisitPostDecrExpression( PostDecrExpression* expression );
+		void VisitLambdaExpression( LambdaExpression* expression );
+		void VisitListExpression( ListExpression* expression );
+		void VisitMapExpression( MapExpression* expression );
+		void VisitNewExpression( NewExpression* expression );
+
+		static void TraceFunction( ExecutableFunction* executable );
 
 	public:
-		Emitter( std::unique_ptr<ParsedProgram> && parsed_program ): parsed_program( std::move( parsed_program )) {
-			start_label_id = 0;
-			end_label_id = INT_MIN;
+		// 'inline_calls' emits small free and static functions in place of their calls
+		Emitter( std::unique_ptr<ParsedProgram> && parsed_program, bool inline_calls = false ): parsed_program( std::move( parsed_program ) ),
+			executable_program( nullptr ), function( nullptr ), global( nullptr ), current_scope( nullptr ), label_id( 0 ), lambda_id( 0 ),
+			inline_calls( inline_calls ), line( 0 ) {
 		}
 
 		~Emitter() {
@@ -67,76 +229,66 @@ namespace compiler {
 		static Instruction* MakeInstruction( InstructionType type ) {
 			Instruction* instruction = new Instruction;
 			instruction->type = type;
+			instruction->operand1 = instruction->operand2 = instruction->operand3 = 0;
+			instruction->operand4 = 0.0;
+			instruction->line = 0;
 			instruction_factory.push_back( instruction );
 
 			return instruction;
 		}
 
-		static Instruction* MakeInstruction( InstructionType type, int operand ) {
-			Instruction* instruction = new Instruction;
-			instruction->type = type;
+		static Instruction* MakeInstruction( InstructionType type, INT_T operand ) {
+			Instruction* instruction = MakeInstruction( type );
 			instruction->operand1 = operand;
-			instruction_factory.push_back( instruction );
 
 			return instruction;
 		}
 
-		static Instruction* MakeInstruction( InstructionType type, int operand1, int operand2 ) {
-			Instruction* instruction = new Instruction;
-			instruction->type = type;
+		static Instruction* MakeInstruction( InstructionType type, INT_T operand1, INT_T operand2 ) {
+			Instruction* instruction = MakeInstruction( type );
 			instruction->operand1 = operand1;
 			instruction->operand2 = operand2;
-			instruction_factory.push_back( instruction );
 
 			return instruction;
-
 		}
 
-		static Instruction* MakeInstruction( InstructionType type, double operand ) {
-			Instruction* instruction = new Instruction;
-			instruction->type = type;
+		static Instruction* MakeInstruction( InstructionType type, FLOAT_T operand ) {
+			Instruction* instruction = MakeInstruction( type );
 			instruction->operand4 = operand;
-			instruction_factory.push_back( instruction );
 
 			return instruction;
 		}
 
-		static Instruction* MakeInstruction( InstructionType type, int operand1, int operand2, const wstring &operand5 ) {
-			Instruction* instruction = new Instruction;
-			instruction->type = type;
+		static Instruction* MakeInstruction( InstructionType type, INT_T operand1, INT_T operand2, const wstring &operand5 ) {
+			Instruction* instruction = MakeInstruction( type );
 			instruction->operand1 = operand1;
 			instruction->operand2 = operand2;
 			instruction->operand5 = operand5;
-			instruction_factory.push_back( instruction );
 
 			return instruction;
 		}
 
-		static Instruction* MakeInstruction( InstructionType type, int operand1, int operand2, int operand3 ) {
-			Instruction* instruction = new Instruction;
-			instruction->type = type;
+		static Instruction* MakeInstruction( InstructionType type, INT_T operand1, INT_T operand2, INT_T operand3 ) {
+			Instruction* instruction = MakeInstruction( type );
 			instruction->operand1 = operand1;
 			instruction->operand2 = operand2;
 			instruction->operand3 = operand3;
-			instruction_factory.push_back( instruction );
 
 			return instruction;
 		}
 
-		static Instruction* MakeInstruction( InstructionType type, int operand1, int operand2, const wstring &operand5, const wstring &operand6 ) {
-			Instruction* instruction = new Instruction;
-			instruction->type = type;
+		static Instruction* MakeInstruction( InstructionType type, INT_T operand1, INT_T operand2, const wstring &operand5, const wstring &operand6 ) {
+			Instruction* instruction = MakeInstruction( type );
 			instruction->operand1 = operand1;
 			instruction->operand2 = operand2;
 			instruction->operand5 = operand5;
 			instruction->operand6 = operand6;
-			instruction_factory.push_back( instruction );
 
 			return instruction;
 		}
 
 		INT_T GetLastLabelId() {
-			return 0;
+			return label_id;
 		}
 
 		static void ClearInstructions();
@@ -0,0 +1,520 @@
+/***************************************************************************
+ * Escape analysis
+ *
+ * Copyright (c) 2017 Joshua Ogunyinka
+ * All rights reserved.
+*/
+
+#include "escape.h"
+#include "cfg.h"
+#include "emitter.h"
+
+using namespace compiler;
+
+// larger arrays stay with the memory manager
+static const INT_T MAX_ELEMENTS = 8;
+
+void EscapeOptimizer::Optimize( ExecutableProgram* program )
+{
+	// the program's variables that functions use
+	ExecutableFunction* global = program->GetGlobal();
+	std::vector<ExecutableFunction*> functions = program->GetAllFunctions();
+	std::vector<bool> shared( global->GetLocalCount() + 1, false );
+	for ( ExecutableFunction* function : functions ) {
+		if ( function == global ) {
+			continue;
+		}
+		for ( Instruction* instruction : function->GetInstructions() ) {
+			if ( HasScope( instruction->type ) && instruction->operand1 == GLOB && instruction->operand2 >= 0
+				&& instruction->operand2 < static_cast< INT_T >( shared.size() ) ) {
+				shared[ instruction->operand2 ] = true;
+			}
+		}
+	}
+
+	// no method keeps 'self' until one it calls on it does
+	std::unordered_map<ExecutableFunction*, Summary> summaries;
+	for ( auto &klass : program->GetClasses() ) {
+		for ( auto &method : klass.second->GetFunctions() ) {
+			summaries[ method.second ] = Summary{ false, false };
+		}
+	}
+	bool changed = true;
+	while ( changed ) {
+		changed = false;
+		for ( auto &klass : program->GetClasses() ) {
+			for ( auto &method : klass.second->GetFunctions() ) {
+				const Summary summary = Summarize( klass.second, method.second, summaries );
+				Summary &known = summaries[ method.second ];
+				if ( summary.escapes != known.escapes || summary.is_returned != known.is_returned ) {
+					known = summary;
+					changed = true;
+				}
+			}
+		}
+	}
+
+	for ( ExecutableFunction* function : functions ) {
+		EscapeOptimizer optimizer{ program, function, function == global, shared, summaries };
+		optimizer.ReplaceArrays();
+		optimizer.PlaceObjects();
+	}
+}
+
+// 'self' may only be returned or have methods of its class called on it
+EscapeOptimizer::Summary EscapeOptimizer::Summarize( ExecutableClass* klass, ExecutableFunction* method,
+	std::unordered_map<ExecutableFunction*, Summary> &summaries )
+{
+	Summary summary{ false, false };
+	std::vector<Instruction*> &instructions = method->GetInstructions();
+	for ( size_t i = 0; i < instructions.size(); ++i ) {
+		Instruction* instruction = instructions[ i ];
+		if ( !HasScope( instruction->type ) || instruction->operand1 != LOCL || instruction->operand2 != 0 ) {
+			continue;
+		}
+
+		Instruction* next = i + 1 < instructions.size() ? instructions[ i + 1 ] : nullptr;
+		ExecutableFunction* callee = next && ( next->type == CALL_FUNC || next->type == TAIL_CALL ) ? klass->GetFunction( next->operand5 ) : nullptr;
+		if ( instruction->type != LOAD_VAR || !next ) {
+			summary.escapes = true;
+		}
+		else if ( next->type == RTRN ) {
+			summary.is_returned = true;
+		}
+		else if ( callee ) {
+			// the receiver is pushed last
+			Summary const &called = summaries[ callee ];
+			summary.escapes = summary.escapes || called.escapes || ( next->type == CALL_FUNC && next->operand2 && called.is_returned );
+			summary.is_returned = summary.is_returned || ( next->type == TAIL_CALL && called.is_returned );
+		}
+		else {
+			summary.escapes = true;
+		}
+	}
+
+	return summary;
+}
+
+/****************************
+ * Arrays
+ ****************************/
+bool EscapeOptimizer::ReplaceArrays()
+{
+	std::vector<Instruction*> &instructions = function->GetInstructions();
+	std::map<INT_T, ArrayLocal> arrays;
+	for ( size_t i = 0; i < instructions.size(); ++i ) {
+		Instruction* instruction = instructions[ i ];
+		if ( !IsLocal( instruction ) || !IsCandidate( instruction->operand2 ) ) {
+			continue;
+		}
+
+		const INT_T slot = instruction->operand2;
+		ArrayLocal &array = arrays.insert( { slot, ArrayLocal{ 0, true, {}, {} } } ).first->second;
+		Instruction* previous = i > 0 ? instructions[ i - 1 ] : nullptr;
+		Instruction* next = i + 1 < instructions.size() ? instructions[ i + 1 ] : nullptr;
+		switch ( instruction->type ) {
+		case STOR_VAR:
+			if ( previous && previous->type == NEW_ARRAY && previous->operand1 == 1 && i > 1 && instructions[ i - 2 ]->type == LOAD_INT_LIT ) {
+				const INT_T size = instructions[ i - 2 ]->operand1;
+				array.is_scalar = array.is_scalar && size > 0 && size <= MAX_ELEMENTS && ( !array.size || array.size == size );
+				array.size = size;
+			}
+			else if ( previous && previous->type == LOAD_VAR && IsLocal( previous ) && previous->operand2 != slot ) {
+				array.copies.push_back( previous->operand2 );
+				array.is_scalar = array.is_scalar && IsDeadAfter( i, previous->operand2 );
+			}
+			else if ( !previous || previous->type != LOAD_NIL_LIT ) {
+				array.is_scalar = false;
+			}
+			break;
+
+		// copied, or sized
+		case LOAD_VAR:
+			array.is_scalar = array.is_scalar && next && ( ( next->type == STOR_VAR && IsLocal( next ) && next->operand2 != slot
+				&& IsCandidate( next->operand2 ) ) || next->type == ARY_SIZE || ( next->type == CALL_FUNC && !next->operand1
+				&& next->operand5 == L"size:0" ) );
+			break;
+
+		case LOAD_ARY_VAR:
+		case LOAD_ARY_ELEM:
+		case STOR_ARY_VAR:
+		case STOR_ARY_ELEM:
+			array.is_scalar = array.is_scalar && instruction->operand3 == 1 && previous && previous->type == LOAD_INT_LIT && previous->operand1 >= 0;
+			break;
+
+		default:
+			array.is_scalar = false;
+			break;
+		}
+	}
+
+	// a local only ever copied into holds arrays of the size of those it's copied from
+	bool is_sized = false;
+	while ( !is_sized ) {
+		is_sized = true;
+		for ( auto &array : arrays ) {
+			for ( INT_T copy : array.second.copies ) {
+				auto source = arrays.find( copy );
+				if ( !array.second.size && source != arrays.end() && source->second.size ) {
+					array.second.size = source->second.size;
+					is_sized = false;
+				}
+			}
+		}
+	}
+
+	// literal indices within the array
+	for ( size_t i = 1; i < instructions.size(); ++i ) {
+		auto array = IsLocal( instructions[ i ] ) ? arrays.find( instructions[ i ]->operand2 ) : arrays.end();
+		if ( array != arrays.end() && instructions[ i ]->type != STOR_VAR && instructions[ i ]->type != LOAD_VAR
+			&& instructions[ i - 1 ]->operand1 >= array->second.size ) {
+			array->second.is_scalar = false;
+		}
+	}
+	for ( auto &array : arrays ) {
+		array.second.is_scalar = array.second.is_scalar && array.second.size;
+	}
+	CheckAllocated( arrays );
+
+	// a copy is an array local only if what it's copied from and into are too, of the same size
+	bool changed = true;
+	while ( changed ) {
+		changed = false;
+		for ( auto &array : arrays ) {
+			for ( INT_T copy : array.second.copies ) {
+				auto source = arrays.find( copy );
+				const bool is_scalar = source != arrays.end() && source->second.is_scalar;
+				if ( array.second.is_scalar && !( is_scalar && source->second.size == array.second.size ) ) {
+					array.second.is_scalar = false;
+					changed = true;
+				}
+				else if ( !array.second.is_scalar && is_scalar ) {
+					source->second.is_scalar = false;
+					changed = true;
+				}
+			}
+		}
+	}
+
+	bool replaced = false;
+	for ( auto &array : arrays ) {
+		for ( INT_T i = 0; array.second.is_scalar && i < array.second.size; ++i ) {
+			array.second.elements.push_back( function->AddLocal() );
+			replaced = true;
+		}
+	}
+	if ( !replaced ) {
+		return false;
+	}
+
+	auto scalar = [&]( Instruction* instruction ) -> ArrayLocal* {
+		if ( !instruction || !IsLocal( instruction ) ) {
+			return nullptr;
+		}
+		auto array = arrays.find( instruction->operand2 );
+		return array != arrays.end() && array->second.is_scalar ? &array->second : nullptr;
+	};
+
+	std::vector<Instruction*> code;
+	for ( size_t i = 0; i < instructions.size(); ++i ) {
+		Instruction* instruction = instructions[ i ];
+		Instruction* next = i + 1 < instructions.size() ? instructions[ i + 1 ] : nullptr;
+		const size_t emitted = code.size();
+		ArrayLocal* array = scalar( next );
+		ArrayLocal* source = scalar( instruction );
+
+		// a new array's elements are nil
+		if ( instruction->type == LOAD_INT_LIT && next && next->type == NEW_ARRAY && i + 2 < instructions.size()
+			&& scalar( instructions[ i + 2 ] ) ) {
+			for ( INT_T element : scalar( instructions[ i + 2 ] )->elements ) {
+				code.push_back( Emitter::MakeInstruction( LOAD_NIL_LIT ) );
+				code.push_back( Emitter::MakeInstruction( STOR_VAR, static_cast< INT_T >( LOCL ), element ) );
+			}
+			i += 2;
+		}
+		else if ( instruction->type == LOAD_NIL_LIT && array && next->type == STOR_VAR ) {
+			++i;
+		}
+		else if ( source && array ) {
+			for ( size_t element = 0; element < array->elements.size(); ++element ) {
+				code.push_back( Emitter::MakeInstruction( LOAD_VAR, static_cast< INT_T >( LOCL ), source->elements[ element ] ) );
+				code.push_back( Emitter::MakeInstruction( STOR_VAR, static_cast< INT_T >( LOCL ), array->elements[ element ] ) );
+			}
+			++i;
+		}
+		else if ( source ) {
+			if ( next->type == ARY_SIZE || next->operand2 ) {
+				code.push_back( Emitter::MakeInstruction( LOAD_INT_LIT, source->size ) );
+			}
+			++i;
+		}
+		else if ( instruction->type == LOAD_INT_LIT && array ) {
+			const INT_T element = array->elements[ instruction->operand1 ];
+			const bool is_load = next->type == LOAD_ARY_VAR || next->type == LOAD_ARY_ELEM;
+			code.push_back( Emitter::MakeInstruction( is_load ? LOAD_VAR : STOR_VAR, static_cast< INT_T >( LOCL ), element ) );
+			++i;
+		}
+		else {
+			code.push_back( instruction );
+		}
+
+		// what replaces an instruction is on its line
+		for ( size_t j = emitted; j < code.size(); ++j ) {
+			code[ j ]->line = instruction->line;
+		}
+	}
+	function->SetInstructions( std::move( code ) );
+
+	return true;
+}
+
+// every use of an array local must find it holding one of its arrays
+void EscapeOptimizer::CheckAllocated( std::map<INT_T, ArrayLocal> &arrays )
+{
+	ControlFlowGraph graph( function );
+	std::vector<BasicBlock> &blocks = graph.GetBlocks();
+	std::vector<Instruction*> &instructions = function->GetInstructions();
+	const size_t count = static_cast< size_t >( function->GetLocalCount() ) + 1;
+
+	auto run = [&]( size_t id, std::vector<bool> &allocated, bool check ) {
+		for ( size_t i = blocks[ id ].start; i < blocks[ id ].end; ++i ) {
+			Instruction* instruction = instructions[ i ];
+			auto array = IsLocal( instruction ) ? arrays.find( instruction->operand2 ) : arrays.end();
+			if ( array == arrays.end() || !array->second.is_scalar ) {
+				continue;
+			}
+
+			if ( instruction->type == STOR_VAR ) {
+				Instruction* previous = instructions[ i - 1 ];
+				allocated[ array->first ] = previous->type == NEW_ARRAY || ( previous->type == LOAD_VAR && allocated[ previous->operand2 ] );
+			}
+			else if ( check && !allocated[ array->first ] ) {
+				array->second.is_scalar = false;
+			}
+		}
+	};
+
+	// what holds an array at the end of each block; nothing does on the way in
+	std::vector<std::vector<bool>> outs( blocks.size(), std::vector<bool>( count, true ) );
+	auto in = [&]( size_t id ) {
+		std::vector<bool> allocated( count, blocks[ id ].start != 0 );
+		for ( size_t predecessor : blocks[ id ].predecessors ) {
+			for ( size_t slot = 0; graph.IsReachable( predecessor ) && slot < count; ++slot ) {
+				allocated[ slot ] = allocated[ slot ] && outs[ predecessor ][ slot ];
+			}
+		}
+		return allocated;
+	};
+
+	bool changed = true;
+	while ( changed ) {
+		changed = false;
+		for ( size_t id : graph.GetOrder() ) {
+			std::vector<bool> allocated = in( id );
+			run( id, allocated, false );
+			if ( allocated != outs[ id ] ) {
+				outs[ id ] = allocated;
+				changed = true;
+			}
+		}
+	}
+
+	for ( size_t id : graph.GetOrder() ) {
+		std::vector<bool> allocated = in( id );
+		run( id, allocated, true );
+	}
+}
+
+// no path on from 'ip' reads the local before storing to it
+bool EscapeOptimizer::IsDeadAfter( size_t ip, INT_T slot )
+{
+	std::vector<Instruction*> &instructions = function->GetInstructions();
+	std::vector<bool> visited( instructions.size(), false );
+	std::vector<size_t> work = Successors( ip );
+	while ( !work.empty() ) {
+		const size_t next = work.back();
+		work.pop_back();
+		if ( next >= instructions.size() || visited[ next ] ) {
+			continue;
+		}
+		visited[ next ] = true;
+
+		Instruction* instruction = instructions[ next ];
+		if ( IsLocal( instruction ) && instruction->operand2 == slot ) {
+			if ( instruction->type != STOR_VAR ) {
+				return false;
+			}
+			continue;
+		}
+		for ( size_t successor : Successors( next ) ) {
+			work.push_back( successor );
+		}
+	}
+
+	return true;
+}
+
+std::vector<size_t> EscapeOptimizer::Successors( size_t ip )
+{
+	Instruction* instruction = function->GetInstructions()[ ip ];
+	std::unordered_map<long, size_t> &labels = function->GetJumpTable();
+	std::vector<size_t> successors;
+	switch ( instruction->type ) {
+	case JMP: {
+		auto label = labels.find( instruction->operand1 );
+		if ( label != labels.end() ) {
+			successors.push_back( label->second );
+		}
+		if ( instruction->operand2 != JMP_UNCND ) {
+			successors.push_back( ip + 1 );
+		}
+	}
+		break;
+
+	// the table of jumps that follows, then the default
+	case JMP_TBL: {
+		for ( INT_T entry = 1; entry <= instruction->operand2; ++entry ) {
+			successors.push_back( ip + entry );
+		}
+		auto label = labels.find( instruction->operand3 );
+		if ( label != labels.end() ) {
+			successors.push_back( label->second );
+		}
+	}
+		break;
+
+	case RTRN:
+		break;
+
+	default:
+		successors.push_back( ip + 1 );
+		break;
+	}
+
+	return successors;
+}
+
+/****************************
+ * Instances
+ ****************************/
+bool EscapeOptimizer::PlaceObjects()
+{
+	std::vector<Instruction*> &instructions = function->GetInstructions();
+	std::map<INT_T, ObjectLocal> objects;
+	for ( size_t i = 0; i < instructions.size(); ++i ) {
+		Instruction* instruction = instructions[ i ];
+		if ( !IsLocal( instruction ) || !IsCandidate( instruction->operand2 ) ) {
+			continue;
+		}
+
+		ObjectLocal &object = objects.insert( { instruction->operand2, ObjectLocal{ true, {}, {} } } ).first->second;
+		Instruction* previous = i > 0 ? instructions[ i - 1 ] : nullptr;
+		Instruction* next = i + 1 < instructions.size() ? instructions[ i + 1 ] : nullptr;
+		switch ( instruction->type ) {
+		case STOR_VAR:
+			if ( previous && previous->type == NEW_OBJ ) {
+				object.sites.push_back( i - 1 );
+			}
+			// the constructor, called on the new instance
+			else if ( previous && previous->type == CALL_FUNC && previous->operand2 && i > 1 && instructions[ i - 2 ]->type == NEW_OBJ
+				&& previous->operand5 == instructions[ i - 2 ]->operand5 + L":" + IntToString( instructions[ i - 2 ]->operand1 ) ) {
+				object.sites.push_back( i - 2 );
+			}
+			else if ( !previous || previous->type != LOAD_NIL_LIT ) {
+				object.is_local = false;
+			}
+			break;
+
+		case LOAD_VAR:
+			if ( next && ( next->type == CALL_FUNC || next->type == TAIL_CALL ) && !next->operand5.empty() ) {
+				object.calls.push_back( next );
+			}
+			else {
+				object.is_local = false;
+			}
+			break;
+
+		default:
+			object.is_local = false;
+			break;
+		}
+	}
+
+	bool placed = false;
+	for ( auto &object : objects ) {
+		bool is_local = object.second.is_local && !object.second.sites.empty();
+		for ( size_t site : object.second.sites ) {
+			ExecutableClass* klass = program->GetClass( instructions[ site ]->operand5 );
+			if ( !klass ) {
+				is_local = false;
+				break;
+			}
+
+			if ( instructions[ site + 1 ]->type == CALL_FUNC ) {
+				ExecutableFunction* constructor = klass->GetFunction( instructions[ site + 1 ]->operand5 );
+				is_local = is_local && constructor && !summaries[ constructor ].escapes;
+			}
+			for ( Instruction* call : object.second.calls ) {
+				ExecutableFunction* method = klass->GetFunction( call->operand5 );
+				is_local = is_local && method && !summaries[ method ].escapes && !( call->operand2 && summaries[ method ].is_returned );
+			}
+		}
+		if ( !is_local ) {
+			continue;
+		}
+
+		// the frame holding the instance stays until its methods return
+		for ( Instruction* call : object.second.calls ) {
+			if ( call->type == TAIL_CALL ) {
+				call->type = CALL_FUNC;
+			}
+		}
+
+		// each creation has a header and the fields of its own
+		for ( size_t site : object.second.sites ) {
+			const std::wstring name = instructions[ site ]->operand5;
+			const INT_T base = function->AddLocal();
+			for ( int field = program->GetClass( name )->GetInstanceCount(); field > 0; --field ) {
+				function->AddLocal();
+			}
+			const int line = instructions[ site ]->line;
+			instructions[ site ] = Emitter::MakeInstruction( LOCAL_OBJ, base, 0L, name );
+			instructions[ site ]->line = line;
+			placed = true;
+		}
+	}
+
+	return placed;
+}
+
+/****************************
+ * Operands
+ ****************************/
+bool EscapeOptimizer::HasScope( InstructionType type )
+{
+	switch ( type ) {
+	case LOAD_VAR:
+	case LOAD_FIELD:
+	case STOR_VAR:
+	case LOAD_ARY_VAR:
+	case STOR_ARY_VAR:
+	case LOAD_ARY_ELEM:
+	case STOR_ARY_ELEM:
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+// a variable of the function's own frame; the global function's are the program's too
+bool EscapeOptimizer::IsLocal( Instruction* instruction )
+{
+	return HasScope( instruction->type ) && ( instruction->operand1 == LOCL || ( is_global && instruction->operand1 == GLOB ) );
+}
+
+// neither 'self', a parameter nor a program variable a function uses
+bool EscapeOptimizer::IsCandidate( INT_T slot )
+{
+	return slot > function->GetParameterCount() && ( !is_global || slot >= static_cast< INT_T >( shared.size() ) || !shared[ slot ] );
+}
@@ -0,0 +1,103 @@
+/***************************************************************************
+ * Escape analysis
+ *
+ * Copyright (c) 2017 Joshua Ogunyinka
+ * All rights reserved.
+*/
+
+#ifndef __ESCAPE_H__
+#define __ESCAPE_H__
+
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+#include "common.h"
+
+/****************************
+ * Arrays and instances a function
+ * creates and never lets go of
+ * skip the memory manager.
+ *
+ * A local only ever set to a new
+ * array of a few elements, and
+ * used just at literal indices,
+ * for its size or copied into
+ * another such local, has each
+ * element in a local of its own:
+ *
+ *   p = [ a, b ]; p[ 1 ] ...
+ *
+ * Every use must find it holding
+ * an array, and a copied local
+ * must not be read again before
+ * it's set anew.
+ *
+ * A local only ever set to a new
+ * instance, or nil, and used only
+ * to call methods that neither
+ * keep 'self' nor hand it back to
+ * the caller, has the instance laid
+ * out in the frame: a header and
+ * the fields, in locals of their
+ * own. Each place that creates one
+ * has its own; it's created anew
+ * only when the local is set
+ * again, so the old one is gone by
+ * then. A call in tail position
+ * gives the frame away, so the
+ * instance isn't the receiver of
+ * one
+ ****************************/
+
+namespace compiler {
+	class EscapeOptimizer {
+		// what a method does with 'self'
+		struct Summary {
+			bool	escapes;
+			bool	is_returned;
+		};
+
+		// how an array local is used
+		struct ArrayLocal {
+			INT_T				size;
+			bool				is_scalar;
+			std::vector<INT_T>	copies;		// locals copied into this one
+			std::vector<INT_T>	elements;
+		};
+
+		// how an object local is used
+		struct ObjectLocal {
+			bool						is_local;
+			std::vector<size_t>			sites;		// where its instances are created
+			std::vector<Instruction*>	calls;		// of methods on it
+		};
+
+		ExecutableProgram* program;
+		ExecutableFunction* function;
+		bool is_global;
+		std::vector<bool> const &shared;								// locals of the global function other functions use
+		std::unordered_map<ExecutableFunction*, Summary> &summaries;
+
+		EscapeOptimizer( ExecutableProgram* program, ExecutableFunction* function, bool is_global, std::vector<bool> const &shared,
+			std::unordered_map<ExecutableFunction*, Summary> &summaries ) : program( program ), function( function ), is_global( is_global ),
+			shared( shared ), summaries( summaries ) {
+		}
+
+		bool ReplaceArrays();
+		bool PlaceObjects();
+		bool IsLocal( Instruction* instruction );
+		bool IsCandidate( INT_T slot );
+		bool IsDeadAfter( size_t ip, INT_T slot );
+		void CheckAllocated( std::map<INT_T, ArrayLocal> &arrays );
+		std::vector<size_t> Successors( size_t ip );
+
+		static bool HasScope( InstructionType type );
+		static Summary Summarize( ExecutableClass* klass, ExecutableFunction* method, std::unordered_map<ExecutableFunction*, Summary> &summaries );
+
+	public:
+		static void Optimize( ExecutableProgram* program );
+	};
+}
+
+#endif
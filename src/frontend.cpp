@@ -0,0 +1,70 @@
+/***************************************************************************
+ * Multi-file front end
+ *
+ * Copyright (c) 2017 Joshua Ogunyinka
+ * All rights reserved.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "frontend.h"
+
+using namespace compiler;
+
+FrontEnd::FrontEnd( std::vector<std::wstring> const &source_files, unsigned int workers ) : files( source_files ),
+	worker_count( workers )
+{
+	if ( !worker_count ) {
+		worker_count = std::max( std::thread::hardware_concurrency(), 1u );
+	}
+	worker_count = std::min( worker_count, static_cast< unsigned int >( files.size() ) );
+}
+
+std::unique_ptr<ParsedProgram> FrontEnd::Parse()
+{
+	if ( files.empty() ) {
+		return nullptr;
+	}
+
+	if ( files.size() == 1 ) {
+		Parser parser{ files[ 0 ] };
+		return parser.Parse();
+	}
+
+	// names are only interned during semantic analysis, after linking, so sharing the table is safe
+	std::shared_ptr<NameTable> names = std::make_shared<NameTable>();
+	std::vector<std::unique_ptr<ParsedProgram>> units( files.size() );
+	std::atomic<size_t> next_file{ 0 };
+
+	auto parse_files = [ & ] () {
+		for ( size_t index = next_file++; index < files.size(); index = next_file++ ) {
+			Parser parser{ files[ index ], names };
+			units[ index ] = parser.Parse();
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for ( unsigned int i = 1; i < worker_count; ++i ) {
+		workers.emplace_back( parse_files );
+	}
+	parse_files(); // the calling thread takes its share
+	for ( std::thread &worker : workers ) {
+		worker.join();
+	}
+
+	// every file has reported its errors by now
+	for ( std::unique_ptr<ParsedProgram> const &unit : units ) {
+		if ( !unit ) {
+			return nullptr;
+		}
+	}
+
+	std::unique_ptr<ParsedProgram> program{ new ParsedProgram( names ) };
+	for ( std::unique_ptr<ParsedProgram> &unit : units ) {
+		program->AddUnit( std::move( unit ) );
+	}
+
+	return program;
+}
@@ -0,0 +1,38 @@
+/***************************************************************************
+ * Multi-file front end
+ *
+ * Copyright (c) 2017 Joshua Ogunyinka
+ * All rights reserved.
+ */
+
+#ifndef __FRONTEND_H__
+#define __FRONTEND_H__
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "parser.h"
+
+namespace compiler {
+	/****************************
+	 * Scans and parses source files on a
+	 * pool of worker threads, each file into
+	 * its own ParsedProgram and arena, then
+	 * links them in command-line order so
+	 * global declarations resolve across files
+	 ****************************/
+	class FrontEnd {
+		std::vector<std::wstring>	files;
+		unsigned int				worker_count;
+
+	public:
+		// workers == 0 picks one per hardware thread
+		FrontEnd( std::vector<std::wstring> const &source_files, unsigned int workers = 0 );
+		~FrontEnd() = default;
+
+		std::unique_ptr<ParsedProgram> Parse();
+	};
+}
+
+#endif
@@ -0,0 +1,181 @@
+/***************************************************************************
+ * Heap statistics
+ *
+ * Copyright (c) 2017 Joshua Ogunyinka
+ * All rights reserved.
+*/
+
+#include <algorithm>
+#include "heapstats.h"
+
+using namespace runtime;
+
+HeapStats* HeapStats::pending;
+volatile sig_atomic_t HeapStats::is_dump_due;
+
+HeapStats::HeapStats( size_t sample_every ) : for_registers( false ), sample_every( sample_every ? sample_every : 1 ), function( nullptr ), ip( 0 ),
+	start( std::chrono::steady_clock::now() ), objects( 0 ), bytes( 0 ), peak_bytes( 0 ), allocated_objects( 0 ), allocated_bytes( 0 )
+{
+	until_sample = this->sample_every;
+
+	static bool is_registered = false;
+	if ( !is_registered ) {
+		std::atexit( ReportAtExit );
+		is_registered = true;
+	}
+	pending = this;
+}
+
+// a report asked for after the program is done is ignored: by default the signal ends the process
+HeapStats::~HeapStats()
+{
+#ifndef _WIN32
+	signal( SIGUSR1, SIG_IGN );
+#endif
+	is_dump_due = 0;
+	if ( pending == this ) {
+		pending = nullptr;
+	}
+}
+
+void HeapStats::OnSignal( int signal )
+{
+	is_dump_due = 1;
+}
+
+void HeapStats::ReportAtExit()
+{
+	if ( pending ) {
+		pending->Report();
+	}
+}
+
+void HeapStats::Start( bool for_registers )
+{
+	this->for_registers = for_registers;
+#ifndef _WIN32
+	struct sigaction action;
+	memset( &action, 0, sizeof( action ) );
+	action.sa_handler = OnSignal;
+	sigemptyset( &action.sa_mask );
+	action.sa_flags = SA_RESTART;
+	sigaction( SIGUSR1, &action, NULL );
+#endif
+}
+
+int HeapStats::LineOf( ExecutableFunction* function, size_t ip )
+{
+	if ( for_registers ) {
+		std::vector<RegisterInstruction> &instructions = function->GetRegisterInstructions();
+		return ip < instructions.size() ? instructions[ ip ].line : 0;
+	}
+
+	std::vector<Instruction*> &instructions = function->GetInstructions();
+	return ip < instructions.size() ? instructions[ ip ]->line : 0;
+}
+
+void HeapStats::Collected( std::chrono::steady_clock::time_point mark_start, std::chrono::steady_clock::time_point sweep_start,
+	std::chrono::steady_clock::time_point sweep_end, size_t objects_freed, size_t bytes_freed )
+{
+	Collection collection;
+	collection.time = Nanoseconds( start, mark_start );
+	collection.mark_time = Nanoseconds( mark_start, sweep_start );
+	collection.sweep_time = Nanoseconds( sweep_start, sweep_end );
+	collection.objects_freed = objects_freed;
+	collection.bytes_freed = bytes_freed;
+	collection.heap_before = bytes;
+
+	objects -= std::min( objects, objects_freed );
+	bytes -= std::min( bytes, bytes_freed );
+	collection.heap_after = bytes;
+	collection.objects_after = objects;
+	collections.push_back( collection );
+}
+
+/****************************
+ * Totals first, then how long
+ * the pauses were, the heap at
+ * up to 20 of the collections,
+ * evenly spaced, and the sites
+ * that allocated most. A site's
+ * counts are its samples times
+ * 'sample_every'
+ ****************************/
+void HeapStats::Report( bool is_final )
+{
+	if ( is_final ) {
+		pending = nullptr;
+	}
+
+	uint64_t mark_time = 0;
+	uint64_t sweep_time = 0;
+	uint64_t longest = 0;
+	size_t objects_freed = 0;
+	size_t bytes_freed = 0;
+	// pauses under 1us, 10us, ... 100ms, and longer
+	size_t pauses[ 7 ] = {};
+	for ( Collection const &collection : collections ) {
+		const uint64_t pause = collection.mark_time + collection.sweep_time;
+		mark_time += collection.mark_time;
+		sweep_time += collection.sweep_time;
+		longest = std::max( longest, pause );
+		objects_freed += collection.objects_freed;
+		bytes_freed += collection.bytes_freed;
+
+		size_t bucket = 0;
+		for ( uint64_t limit = 1000; bucket < 6 && pause >= limit; limit *= 10 ) {
+			++bucket;
+		}
+		++pauses[ bucket ];
+	}
+
+	std::wcerr << L"---------- heap: " << collections.size() << L" collections, " << allocated_objects << L" objects of " << allocated_bytes
+		<< L" bytes allocated, peak " << peak_bytes << L" bytes ----------" << std::endl;
+	std::wcerr << L"now\t" << objects << L" objects, " << bytes << L" bytes" << std::endl;
+	std::wcerr << L"freed\t" << objects_freed << L" objects, " << bytes_freed << L" bytes" << std::endl;
+	if ( !collections.empty() ) {
+		std::wcerr << L"pauses\t" << ( mark_time + sweep_time ) / 1000.0 << L"us: mark " << mark_time / 1000.0 << L"us, sweep " << sweep_time / 1000.0
+			<< L"us, longest " << longest / 1000.0 << L"us" << std::endl;
+
+		static const wchar_t* bucket_names[] = { L"<1us", L"<10us", L"<100us", L"<1ms", L"<10ms", L"<100ms", L">=100ms" };
+		std::wcerr << L"pause\tcollections" << std::endl;
+		for ( size_t i = 0; i < 7; ++i ) {
+			if ( pauses[ i ] ) {
+				std::wcerr << bucket_names[ i ] << L"\t" << pauses[ i ] << std::endl;
+			}
+		}
+
+		const size_t rows = std::min( collections.size(), static_cast< size_t >( 20 ) );
+		std::wcerr << L"time\tpause\tbefore\tafter\tobjects" << std::endl;
+		for ( size_t i = 0; i < rows; ++i ) {
+			Collection const &collection = collections[ rows > 1 ? i * ( collections.size() - 1 ) / ( rows - 1 ) : 0 ];
+			std::wcerr << collection.time / 1000000.0 << L"ms\t" << ( collection.mark_time + collection.sweep_time ) / 1000.0 << L"us\t"
+				<< collection.heap_before << L"\t" << collection.heap_after << L"\t" << collection.objects_after << std::endl;
+		}
+	}
+
+	if ( sites.empty() ) {
+		return;
+	}
+
+	std::vector<std::pair<std::pair<size_t, size_t>, Site>> rows;
+	for ( auto &site : sites ) {
+		rows.push_back( { site.second, site.first } );
+	}
+	std::sort( rows.begin(), rows.end(), []( std::pair<std::pair<size_t, size_t>, Site> const &a, std::pair<std::pair<size_t, size_t>, Site> const &b ) {
+		return a.first.second != b.first.second ? a.first.second > b.first.second : a.first.first > b.first.first;
+	} );
+
+	std::wcerr << L"objects\tbytes\ttype\tsite, one allocation in " << sample_every << L" sampled" << std::endl;
+	for ( size_t i = 0; i < rows.size() && i < 24; ++i ) {
+		ExecutableFunction* site_function = rows[ i ].second.first.first;
+		std::wcerr << rows[ i ].first.first * sample_every << L"\t" << rows[ i ].first.second * sample_every << L"\t"
+			<< RuntimeTypeName( rows[ i ].second.second ) << L"\t";
+		if ( site_function ) {
+			std::wcerr << site_function->GetName() << L":" << LineOf( site_function, rows[ i ].second.first.second ) << std::endl;
+		}
+		else {
+			std::wcerr << L"(before the program ran)" << std::endl;
+		}
+	}
+}
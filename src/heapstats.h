@@ -0,0 +1,125 @@
+/***************************************************************************
+ * Heap statistics
+ *
+ * Copyright (c) 2017 Joshua Ogunyinka
+ * All rights reserved.
+*/
+
+#ifndef __HEAPSTATS_H__
+#define __HEAPSTATS_H__
+
+#include <chrono>
+#include <csignal>
+#include "common.h"
+
+namespace runtime {
+	/****************************
+	 * What the collector does and
+	 * what the program allocates:
+	 * each collection's mark and sweep
+	 * times, what it freed and the
+	 * heap before and after it, and
+	 * for one allocation in every
+	 * 'sample_every', the function,
+	 * instruction and type that made
+	 * it. Reported to the error stream
+	 * when the program ends, even in
+	 * an error, and whenever the
+	 * process gets SIGUSR1. Sizes are
+	 * of an object's cells, mark and
+	 * string or hash header; the
+	 * characters and entries they hold
+	 * aren't counted
+	 ****************************/
+	class HeapStats {
+		struct Collection {
+			uint64_t time;						// nanoseconds since the program started
+			uint64_t mark_time;
+			uint64_t sweep_time;
+			size_t objects_freed;
+			size_t bytes_freed;
+			size_t heap_before;
+			size_t heap_after;
+			size_t objects_after;
+		};
+
+		// a function, the instruction in it and the type allocated
+		typedef std::pair<std::pair<ExecutableFunction*, size_t>, RuntimeType> Site;
+
+		// the one reported at exit, if the program doesn't end normally
+		static HeapStats* pending;
+		static volatile sig_atomic_t is_dump_due;
+
+		bool for_registers;
+		size_t sample_every;
+		size_t until_sample;
+		ExecutableFunction* function;
+		size_t ip;
+		std::chrono::steady_clock::time_point start;
+		std::vector<Collection> collections;
+		std::map<Site, std::pair<size_t, size_t>> sites;	// sampled allocations and their bytes
+		size_t objects;
+		size_t bytes;
+		size_t peak_bytes;
+		size_t allocated_objects;
+		size_t allocated_bytes;
+
+		static void OnSignal( int signal );
+		static void ReportAtExit();
+		int LineOf( ExecutableFunction* function, size_t ip );
+
+	public:
+		HeapStats( size_t sample_every );
+		~HeapStats();
+
+		// where SIGUSR1 can be caught, it asks for a report before the next instruction
+		void Start( bool for_registers );
+
+		static uint64_t Nanoseconds( std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to ) {
+			return std::chrono::duration_cast< std::chrono::nanoseconds >( to - from ).count();
+		}
+
+		// where the program is; set before each instruction, a report asked for is made here
+		void At( ExecutableFunction* function, size_t ip ) {
+			this->function = function;
+			this->ip = ip;
+			if ( is_dump_due ) {
+				is_dump_due = 0;
+				Report( false );
+			}
+		}
+
+		// what the heap held before counting began, an image's objects
+		void Holds( size_t objects, size_t bytes ) {
+			this->objects += objects;
+			this->bytes += bytes;
+			if ( this->bytes > peak_bytes ) {
+				peak_bytes = this->bytes;
+			}
+		}
+
+		void Allocated( RuntimeType type, size_t size ) {
+			++objects;
+			bytes += size;
+			++allocated_objects;
+			allocated_bytes += size;
+			if ( bytes > peak_bytes ) {
+				peak_bytes = bytes;
+			}
+			if ( --until_sample == 0 ) {
+				until_sample = sample_every;
+				std::pair<size_t, size_t> &site = sites[ { { function, ip }, type } ];
+				++site.first;
+				site.second += size;
+			}
+		}
+
+		void Collected( std::chrono::steady_clock::time_point mark_start, std::chrono::steady_clock::time_point sweep_start,
+			std::chrono::steady_clock::time_point sweep_end, size_t objects_freed, size_t bytes_freed );
+
+		// the final report isn't made again at exit
+		void Report( bool is_final = true );
+	};
+}
+
+#endif
@@ -0,0 +1,2192 @@
+/***************************************************************************
+ * Just-in-time compiler
+ *
+ * Copyright (c) 2017 Joshua Ogunyinka
+ * All rights reserved.
+*/
+
+#include <cstddef>
+#include <algorithm>
+#include <memory>
+
+#include "jit.h"
+#include "classes.h"
+
+using namespace runtime;
+
+// longest trace recorded, and how often a loop may be recorded again along another way
+static const size_t MAX_TRACE_LENGTH = 512;
+static const int MAX_RETRACES = 3;
+
+// integers are as wide as INT_T
+static const bool WIDE = sizeof( INT_T ) == 8;
+
+// a trace's arguments, kept where calls it doesn't make would preserve them
+static const Register LOCALS = RBX;
+static const Register STACK = R12;
+static const Register GLOBALS = R13;
+
+static const int32_t VALUE_SIZE = sizeof( Value );
+static const int32_t TYPE_OFFSET = offsetof( Value, type );
+static const int32_t SYS_KLASS_OFFSET = offsetof( Value, sys_klass );
+static const int32_t USER_KLASS_OFFSET = offsetof( Value, user_klass );
+static const int32_t VALUE_OFFSET = offsetof( Value, value );
+
+// an element's offset is its index shifted by as many bits
+static constexpr int Log2( int32_t value )
+{
+	return value > 1 ? 1 + Log2( value / 2 ) : 0;
+}
+static_assert( ( VALUE_SIZE & ( VALUE_SIZE - 1 ) ) == 0, "a value's size is a power of two" );
+static const int VALUE_SHIFT = Log2( VALUE_SIZE );
+
+// a value's type and classes, written ahead of its value
+static void WriteHeader( Assembler &assembler, Register base, int32_t displacement, RuntimeType type, RuntimeClass* klass )
+{
+	assembler.StoreImmediate( base, displacement + TYPE_OFFSET, type, false );
+	if ( klass ) {
+		assembler.MoveImmediate( RAX, reinterpret_cast< intptr_t >( klass ), true );
+		assembler.Store( base, displacement + SYS_KLASS_OFFSET, RAX, true );
+	}
+	else {
+		assembler.StoreImmediate( base, displacement + SYS_KLASS_OFFSET, 0, true );
+	}
+	assembler.StoreImmediate( base, displacement + USER_KLASS_OFFSET, 0, true );
+}
+
+/****************************
+ * Recording
+ ****************************/
+TraceRecorder::~TraceRecorder()
+{
+	for ( Trace* trace : traces ) {
+		Assembler::Release( reinterpret_cast< void* >( trace->code ), trace->size );
+		delete trace;
+	}
+}
+
+void TraceRecorder::Start( ExecutableFunction* function, size_t ip, bool is_global )
+{
+	this->function = function;
+	this->is_global = is_global;
+	head = function->GetInstructions()[ ip ];
+	head_ip = ip;
+	steps.clear();
+}
+
+// the element of up to three dimensions the indices, the first at 'indices', name
+static bool ElementIndex( Value* indices, Value* array, INT_T dimensions, INT_T &index )
+{
+	switch ( dimensions ) {
+	case 1:
+		return ArrayClass::Index<1>( indices, array, index );
+
+	case 2:
+		return ArrayClass::Index<2>( indices, array, index );
+
+	case 3:
+		return ArrayClass::Index<3>( indices, array, index );
+
+	default:
+		return false;
+	}
+}
+
+// runs before the interpreter executes 'instruction', with the stack ending before 'top'
+void TraceRecorder::Record( size_t ip, Instruction* instruction, Value* locals, Value* globals, Value* top )
+{
+	if ( ip == head_ip ) {
+		return;
+	}
+
+	// a jump back to anything but the head is an inner loop's
+	if ( !IsTraceable( instruction->type ) || steps.size() >= MAX_TRACE_LENGTH || ip <= ( steps.empty() ? head_ip : steps.back().ip ) ) {
+		Abort();
+		return;
+	}
+
+	TraceStep step{ ip, instruction, { UNINIT_TYPE, UNINIT_TYPE } };
+	switch ( instruction->type ) {
+	case LOAD_VAR:
+	case STOR_VAR:
+		if ( instruction->operand1 != LOCL && instruction->operand1 != GLOB ) {
+			Abort();
+			return;
+		}
+		if ( instruction->type == LOAD_VAR ) {
+			step.types[ 0 ] = ( instruction->operand1 == LOCL ? locals : globals )[ instruction->operand2 ].type;
+		}
+		break;
+
+	// an array variable's, and the type of the element loaded
+	case LOAD_ARY_VAR:
+	case LOAD_ARY_ELEM:
+	case STOR_ARY_VAR:
+	case STOR_ARY_ELEM: {
+		if ( instruction->operand1 != LOCL && instruction->operand1 != GLOB ) {
+			Abort();
+			return;
+		}
+		Value &variable = ( instruction->operand1 == LOCL ? locals : globals )[ instruction->operand2 ];
+		Value* array = static_cast< Value* >( variable.value.ptr_value );
+		INT_T index;
+		if ( variable.type != ARRAY_TYPE || !ElementIndex( top - 1, array, instruction->operand3, index ) ) {
+			Abort();
+			return;
+		}
+		step.types[ 0 ] = ARRAY_TYPE;
+		if ( instruction->type == LOAD_ARY_VAR || instruction->type == LOAD_ARY_ELEM ) {
+			step.types[ 1 ] = array[ index ].type;
+		}
+	}
+		break;
+
+	case INC_LOCAL_INT:
+		step.types[ 0 ] = locals[ instruction->operand1 ].type;
+		break;
+
+	case LOAD_LOCAL_PAIR:
+		step.types[ 0 ] = locals[ instruction->operand1 ].type;
+		step.types[ 1 ] = locals[ instruction->operand2 ].type;
+		break;
+
+	case LOAD_INT_LOCAL:
+		step.types[ 0 ] = locals[ instruction->operand2 ].type;
+		break;
+
+	default:
+		break;
+	}
+	steps.push_back( step );
+}
+
+void TraceRecorder::Finish()
+{
+	TraceCompiler compiler{ steps, head_ip, is_global };
+	Trace* trace = compiler.Compile( function );
+	if ( !trace ) {
+		Abort();
+		return;
+	}
+
+	traces.push_back( trace );
+	head->operand3 = static_cast< INT_T >( traces.size() );
+	TRACE( TRACE_EMIT, TRACE_EVENTS, EMIT_TRACE, function->GetName(), head->operand1, steps.size(), trace->exits.size() );
+	head = nullptr;
+	steps.clear();
+}
+
+// a trace that keeps leaving the same way no longer follows the loop, unless it has been given up on
+void TraceRecorder::Retrace( Instruction* label )
+{
+	if ( retraces[ label ] + 1 < MAX_RETRACES ) {
+		++retraces[ label ];
+		label->operand2 = 0;
+		label->operand3 = 0;
+	}
+}
+
+// a loop that ran what traces can't, or didn't compile, would do the same again; it's left to the interpreter
+void TraceRecorder::Abort()
+{
+	head->operand3 = -1;
+	head = nullptr;
+	steps.clear();
+}
+
+bool TraceRecorder::IsTraceable( InstructionType type )
+{
+	switch ( type ) {
+	case LOAD_TRUE_LIT:
+	case LOAD_FALSE_LIT:
+	case LOAD_INT_LIT:
+	case LOAD_FLOAT_LIT:
+	case LOAD_VAR:
+	case STOR_VAR:
+	case POP:
+	case MOV:
+	case EQL:
+	case NEQL:
+	case GTR:
+	case LES:
+	case GTR_EQL:
+	case LES_EQL:
+	case ADD:
+	case SUB:
+	case MUL:
+	case DIV:
+	case EQL_INT:
+	case NEQL_INT:
+	case GTR_INT:
+	case LES_INT:
+	case GTR_EQL_INT:
+	case LES_EQL_INT:
+	case ADD_INT:
+	case SUB_INT:
+	case MUL_INT:
+	case GTR_FLOAT:
+	case LES_FLOAT:
+	case GTR_EQL_FLOAT:
+	case LES_EQL_FLOAT:
+	case ADD_FLOAT:
+	case SUB_FLOAT:
+	case MUL_FLOAT:
+	case DIV_FLOAT:
+	case JMP:
+	case LBL:
+	case INC_LOCAL_INT:
+	case LOAD_LOCAL_PAIR:
+	case LOAD_INT_LOCAL:
+	case LOAD_ARY_VAR:
+	case LOAD_ARY_ELEM:
+	case STOR_ARY_VAR:
+	case STOR_ARY_ELEM:
+	case CMP_JMP_EQL:
+	case CMP_JMP_NEQL:
+	case CMP_JMP_GTR:
+	case CMP_JMP_LES:
+	case CMP_JMP_GTR_EQL:
+	case CMP_JMP_LES_EQL:
+	case NO_OP:
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+/****************************
+ * Compiling
+ ****************************/
+Trace* TraceCompiler::Compile( ExecutableFunction* function )
+{
+	// the variables to check on the way in
+	std::map<Variable, RuntimeType> entry;
+	std::set<Variable> stored;
+	bool is_known = true;
+	auto read = [&]( Variable variable, RuntimeType type ) {
+		Kind kind;
+		is_known = is_known && KindOf( type, kind );
+		if ( !stored.count( variable ) && !entry.count( variable ) ) {
+			entry[ variable ] = type;
+		}
+	};
+	for ( TraceStep &step : steps ) {
+		Instruction* instruction = step.instruction;
+		switch ( instruction->type ) {
+		case LOAD_VAR:
+			read( GetVariable( instruction ), step.types[ 0 ] );
+			break;
+
+		case STOR_VAR:
+			stored.insert( GetVariable( instruction ) );
+			break;
+
+		case INC_LOCAL_INT:
+			if ( step.types[ 0 ] == INT_TYPE ) {
+				read( Variable( LOCL, instruction->operand1 ), INT_TYPE );
+			}
+			break;
+
+		case LOAD_LOCAL_PAIR:
+			read( Variable( LOCL, instruction->operand1 ), step.types[ 0 ] );
+			read( Variable( LOCL, instruction->operand2 ), step.types[ 1 ] );
+			break;
+
+		case LOAD_INT_LOCAL:
+			read( Variable( LOCL, instruction->operand2 ), step.types[ 0 ] );
+			break;
+
+		default:
+			break;
+		}
+	}
+	if ( !is_known ) {
+		return nullptr;
+	}
+
+	assembler.Push( LOCALS );
+	assembler.Push( STACK );
+	assembler.Push( GLOBALS );
+#ifdef _WIN32
+	assembler.Move( LOCALS, RCX );
+	assembler.Move( STACK, RDX );
+	assembler.Move( GLOBALS, R8 );
+#else
+	assembler.Move( LOCALS, RDI );
+	assembler.Move( STACK, RSI );
+	assembler.Move( GLOBALS, RDX );
+#endif
+
+	const size_t checks = assembler.Position();
+	for ( auto &variable : entry ) {
+		assembler.CompareImmediate( variable.first.first == LOCL ? LOCALS : GLOBALS,
+			static_cast< int32_t >( variable.first.second ) * VALUE_SIZE + TYPE_OFFSET, variable.second );
+		Exit( CC_NE, head_ip + 1 );
+	}
+	known = entry;
+
+	const size_t loop = assembler.Position();
+	std::unordered_map<long, size_t> &labels = function->GetJumpTable();
+	for ( size_t i = 0; i < steps.size(); ++i ) {
+		is_closing = i + 1 == steps.size();
+		if ( !Compile( i, labels ) ) {
+			return nullptr;
+		}
+	}
+	if ( !stack.empty() ) {
+		return nullptr;
+	}
+
+	// the checks are made again only if the loop may have changed a type
+	bool is_stable = true;
+	for ( auto &variable : entry ) {
+		is_stable = is_stable && known[ variable.first ] == variable.second;
+	}
+	assembler.JumpTo( is_stable ? loop : checks );
+
+	Trace* trace = new Trace;
+	std::vector<size_t> returns;
+	for ( PendingExit &exit : exits ) {
+		assembler.Patch( exit.jump, assembler.Position() );
+		for ( size_t slot = 0; slot < exit.stack.size(); ++slot ) {
+			WriteValue( STACK, static_cast< int32_t >( slot ) * VALUE_SIZE, exit.stack[ slot ].kind, slot, true );
+		}
+		assembler.MoveImmediate( RAX, static_cast< int64_t >( trace->exits.size() ), false );
+		trace->exits.push_back( TraceExit{ exit.ip, exit.stack.size(), exit.is_side, 0 } );
+		returns.push_back( assembler.Jump() );
+	}
+	for ( size_t jump : returns ) {
+		assembler.Patch( jump, assembler.Position() );
+	}
+	assembler.Pop( GLOBALS );
+	assembler.Pop( STACK );
+	assembler.Pop( LOCALS );
+	assembler.Return();
+
+	trace->code = reinterpret_cast< TraceCode >( assembler.Finish( trace->size ) );
+	if ( !trace->code ) {
+		delete trace;
+		return nullptr;
+	}
+
+	return trace;
+}
+
+// step 'i'; the one after it tells which way its branch went
+bool TraceCompiler::Compile( size_t i, std::unordered_map<long, size_t> &labels )
+{
+	TraceStep &step = steps[ i ];
+	Instruction* instruction = step.instruction;
+	const size_t next_ip = i + 1 < steps.size() ? steps[ i + 1 ].ip : head_ip;
+	if ( instruction->type != JMP || instruction->operand2 == JMP_UNCND ) {
+		Materialize();
+	}
+
+	switch ( instruction->type ) {
+	case LOAD_INT_LIT:
+		if ( !Push( INT_VALUE ) ) {
+			return false;
+		}
+		assembler.MoveImmediate( IntRegister( stack.size() - 1 ), instruction->operand1, WIDE );
+		break;
+
+	case LOAD_FLOAT_LIT: {
+		if ( !Push( FLOAT_VALUE ) ) {
+			return false;
+		}
+		int64_t bits;
+		memcpy( &bits, &instruction->operand4, sizeof( bits ) );
+		assembler.MoveImmediate( RAX, bits, true );
+		assembler.MoveToFloat( FloatRegisterOf( stack.size() - 1 ), RAX );
+	}
+		break;
+
+	case LOAD_TRUE_LIT:
+	case LOAD_FALSE_LIT:
+		if ( !Push( BOOL_VALUE ) ) {
+			return false;
+		}
+		assembler.MoveImmediate( IntRegister( stack.size() - 1 ), instruction->type == LOAD_TRUE_LIT ? 1 : 0, WIDE );
+		break;
+
+	case LOAD_VAR:
+		if ( stack.size() >= TRACE_STACK_SIZE ) {
+			return false;
+		}
+		if ( !Load( GetVariable( instruction ), known[ GetVariable( instruction ) ] ) ) {
+			return false;
+		}
+		break;
+
+	case STOR_VAR:
+		if ( stack.empty() ) {
+			return false;
+		}
+		Store( GetVariable( instruction ), stack.back().kind );
+		stack.pop_back();
+		break;
+
+	case POP:
+		if ( stack.empty() ) {
+			return false;
+		}
+		stack.pop_back();
+		break;
+
+	case LOAD_ARY_VAR:
+	case LOAD_ARY_ELEM:
+		return Element( step, false );
+
+	case STOR_ARY_VAR:
+	case STOR_ARY_ELEM:
+		return Element( step, true );
+
+	case ADD:
+	case SUB:
+	case MUL:
+	case DIV:
+	case ADD_INT:
+	case SUB_INT:
+	case MUL_INT:
+	case ADD_FLOAT:
+	case SUB_FLOAT:
+	case MUL_FLOAT:
+	case DIV_FLOAT:
+		return Arithmetic( instruction->type );
+
+	case EQL:
+	case NEQL:
+	case GTR:
+	case LES:
+	case GTR_EQL:
+	case LES_EQL:
+	case EQL_INT:
+	case NEQL_INT:
+	case GTR_INT:
+	case LES_INT:
+	case GTR_EQL_INT:
+	case LES_EQL_INT:
+	case GTR_FLOAT:
+	case LES_FLOAT:
+	case GTR_EQL_FLOAT:
+	case LES_EQL_FLOAT: {
+		Condition condition;
+		if ( !Compare( instruction->type, condition ) ) {
+			return false;
+		}
+		stack.pop_back();
+		stack.back().kind = CONDITION;
+		stack.back().condition = condition;
+	}
+		break;
+
+	case JMP: {
+		if ( instruction->operand2 == JMP_UNCND ) {
+			break;
+		}
+
+		auto label = labels.find( instruction->operand1 );
+		if ( stack.empty() || label == labels.end() ) {
+			return false;
+		}
+
+		Condition condition = stack.back().condition;
+		if ( stack.back().kind == BOOL_VALUE ) {
+			assembler.Test( IntRegister( stack.size() - 1 ), IntRegister( stack.size() - 1 ), WIDE );
+			condition = CC_NE;
+		}
+		else if ( stack.back().kind != CONDITION ) {
+			return false;
+		}
+		stack.pop_back();
+
+		return Branch( instruction->operand2 == JMP_TRUE ? condition : Negate( condition ), label->second, step.ip + 1, next_ip );
+	}
+
+	// numbers are compared here; anything else by the sequence that follows
+	case CMP_JMP_EQL:
+	case CMP_JMP_NEQL:
+	case CMP_JMP_GTR:
+	case CMP_JMP_LES:
+	case CMP_JMP_GTR_EQL:
+	case CMP_JMP_LES_EQL: {
+		auto label = labels.find( instruction->operand1 );
+		if ( stack.size() < 2 || label == labels.end() ) {
+			return false;
+		}
+
+		const Kind left = stack.back().kind;
+		const Kind right = stack[ stack.size() - 2 ].kind;
+		if ( left == BOOL_VALUE || right == BOOL_VALUE ) {
+			return next_ip == step.ip + 1;
+		}
+
+		Condition condition;
+		if ( !Compare( instruction->type, condition ) ) {
+			return false;
+		}
+		stack.pop_back();
+		stack.pop_back();
+
+		return Branch( instruction->operand2 == JMP_TRUE ? condition : Negate( condition ), label->second, step.ip + 3, next_ip );
+	}
+
+	// an integer is stepped here; anything else by the sequence that follows
+	case INC_LOCAL_INT:
+		if ( step.types[ 0 ] == INT_TYPE ) {
+			if ( instruction->operand2 < INT32_MIN || instruction->operand2 > INT32_MAX ) {
+				return false;
+			}
+			assembler.AddImmediate( LOCALS, static_cast< int32_t >( instruction->operand1 ) * VALUE_SIZE + VALUE_OFFSET,
+				static_cast< int32_t >( instruction->operand2 ), WIDE );
+		}
+		break;
+
+	case LOAD_LOCAL_PAIR:
+		if ( stack.size() + 2 > TRACE_STACK_SIZE ) {
+			return false;
+		}
+		if ( !Load( Variable( LOCL, instruction->operand1 ), known[ Variable( LOCL, instruction->operand1 ) ] )
+			|| !Load( Variable( LOCL, instruction->operand2 ), known[ Variable( LOCL, instruction->operand2 ) ] ) ) {
+			return false;
+		}
+		break;
+
+	case LOAD_INT_LOCAL:
+		if ( stack.size() + 2 > TRACE_STACK_SIZE ) {
+			return false;
+		}
+		Push( INT_VALUE );
+		assembler.MoveImmediate( IntRegister( stack.size() - 1 ), instruction->operand1, WIDE );
+		if ( !Load( Variable( LOCL, instruction->operand2 ), known[ Variable( LOCL, instruction->operand2 ) ] ) ) {
+			return false;
+		}
+		break;
+
+	case LBL:
+	case MOV:
+	case NO_OP:
+		break;
+
+	default:
+		return false;
+	}
+
+	return true;
+}
+
+// the left operand is on top and the result replaces the right one; integers divide only in the interpreter
+bool TraceCompiler::Arithmetic( InstructionType type )
+{
+	if ( stack.size() < 2 ) {
+		return false;
+	}
+
+	const size_t left = stack.size() - 1;
+	const size_t right = stack.size() - 2;
+	const bool is_int = stack[ left ].kind == INT_VALUE && stack[ right ].kind == INT_VALUE;
+	const bool is_number = ( stack[ left ].kind == INT_VALUE || stack[ left ].kind == FLOAT_VALUE )
+		&& ( stack[ right ].kind == INT_VALUE || stack[ right ].kind == FLOAT_VALUE );
+	if ( !is_number || ( ( type == ADD_INT || type == SUB_INT || type == MUL_INT ) && !is_int ) ) {
+		return false;
+	}
+
+	if ( is_int && type != DIV ) {
+		switch ( type ) {
+		case ADD:
+		case ADD_INT:
+			assembler.Add( IntRegister( right ), IntRegister( left ), WIDE );
+			break;
+
+		case SUB:
+		case SUB_INT:
+			assembler.Subtract( IntRegister( left ), IntRegister( right ), WIDE );
+			assembler.Move( IntRegister( right ), IntRegister( left ) );
+			break;
+
+		default:
+			assembler.Multiply( IntRegister( right ), IntRegister( left ), WIDE );
+			break;
+		}
+		stack.pop_back();
+		return true;
+	}
+	else if ( is_int ) {
+		return false;
+	}
+
+	ToFloat( left );
+	ToFloat( right );
+	switch ( type ) {
+	case ADD:
+	case ADD_FLOAT:
+		assembler.AddFloat( FloatRegisterOf( right ), FloatRegisterOf( left ) );
+		break;
+
+	case SUB:
+	case SUB_FLOAT:
+		assembler.SubtractFloat( FloatRegisterOf( left ), FloatRegisterOf( right ) );
+		assembler.MoveFloat( FloatRegisterOf( right ), FloatRegisterOf( left ) );
+		break;
+
+	case MUL:
+	case MUL_FLOAT:
+		assembler.MultiplyFloat( FloatRegisterOf( right ), FloatRegisterOf( left ) );
+		break;
+
+	default:
+		assembler.DivideFloat( FloatRegisterOf( left ), FloatRegisterOf( right ) );
+		assembler.MoveFloat( FloatRegisterOf( right ), FloatRegisterOf( left ) );
+		break;
+	}
+	stack.pop_back();
+
+	return true;
+}
+
+// sets the flags for the top two values; 'condition' holds when the comparison does
+bool TraceCompiler::Compare( InstructionType type, Condition &condition )
+{
+	if ( stack.size() < 2 ) {
+		return false;
+	}
+
+	const size_t left = stack.size() - 1;
+	const size_t right = stack.size() - 2;
+	const Kind left_kind = stack[ left ].kind;
+	const Kind right_kind = stack[ right ].kind;
+	bool is_equality = false;
+	switch ( type ) {
+	case EQL:
+	case EQL_INT:
+	case CMP_JMP_EQL:
+		condition = CC_E;
+		is_equality = true;
+		break;
+
+	case NEQL:
+	case NEQL_INT:
+	case CMP_JMP_NEQL:
+		condition = CC_NE;
+		is_equality = true;
+		break;
+
+	case GTR:
+	case GTR_INT:
+	case GTR_FLOAT:
+	case CMP_JMP_GTR:
+		condition = CC_G;
+		break;
+
+	case LES:
+	case LES_INT:
+	case LES_FLOAT:
+	case CMP_JMP_LES:
+		condition = CC_L;
+		break;
+
+	case GTR_EQL:
+	case GTR_EQL_INT:
+	case GTR_EQL_FLOAT:
+	case CMP_JMP_GTR_EQL:
+		condition = CC_GE;
+		break;
+
+	default:
+		condition = CC_LE;
+		break;
+	}
+
+	if ( ( left_kind == INT_VALUE && right_kind == INT_VALUE ) || ( is_equality && left_kind == BOOL_VALUE && right_kind == BOOL_VALUE ) ) {
+		assembler.Compare( IntRegister( left ), IntRegister( right ), WIDE );
+		return true;
+	}
+
+	// floats compare unordered as false
+	if ( is_equality || left_kind == BOOL_VALUE || right_kind == BOOL_VALUE ) {
+		return false;
+	}
+	ToFloat( left );
+	ToFloat( right );
+	switch ( condition ) {
+	case CC_G:
+	case CC_GE:
+		assembler.CompareFloat( FloatRegisterOf( left ), FloatRegisterOf( right ) );
+		condition = condition == CC_G ? CC_A : CC_AE;
+		break;
+
+	default:
+		assembler.CompareFloat( FloatRegisterOf( right ), FloatRegisterOf( left ) );
+		condition = condition == CC_L ? CC_A : CC_AE;
+		break;
+	}
+
+	return true;
+}
+
+// the trace goes the way the recording did and leaves when 'jump' says otherwise
+bool TraceCompiler::Branch( Condition jump, size_t taken_ip, size_t fallthrough_ip, size_t next_ip )
+{
+	if ( next_ip == taken_ip ) {
+		Exit( Negate( jump ), fallthrough_ip );
+	}
+	else if ( next_ip == fallthrough_ip ) {
+		Exit( jump, taken_ip );
+	}
+	else {
+		return false;
+	}
+
+	return true;
+}
+
+// an array element found as the interpreter finds it, its indices on top of the stack and the first of them last;
+// a variable that no longer holds the array, or an index out of its dimension, leaves for the interpreter to tell
+bool TraceCompiler::Element( TraceStep &step, bool is_store )
+{
+	Instruction* instruction = step.instruction;
+	const size_t dimensions = static_cast< size_t >( instruction->operand3 );
+	Kind kind;
+	if ( stack.size() < dimensions + ( is_store ? 1 : 0 ) || stack.size() + 2 > TRACE_STACK_SIZE ||
+		( !is_store && !KindOf( step.types[ 1 ], kind ) ) ) {
+		return false;
+	}
+	const size_t first = stack.size() - 1;
+	for ( size_t i = 0; i < dimensions; ++i ) {
+		if ( stack[ first - i ].kind != INT_VALUE ) {
+			return false;
+		}
+	}
+
+	// the registers above the stack's
+	const Register extent = IntRegister( stack.size() );
+	const Register element = IntRegister( stack.size() + 1 );
+
+	const Variable variable = GetVariable( instruction );
+	const Register base = variable.first == LOCL ? LOCALS : GLOBALS;
+	const int32_t displacement = static_cast< int32_t >( variable.second ) * VALUE_SIZE;
+	assembler.CompareImmediate( base, displacement + TYPE_OFFSET, ARRAY_TYPE );
+	Exit( CC_NE, step.ip );
+	assembler.Load( RAX, base, displacement + VALUE_OFFSET, true );
+
+	// the header nearest the mark is the array's dimensions
+	for ( size_t i = 1; i <= dimensions; ++i ) {
+		assembler.CompareImmediate( RAX, -static_cast< int32_t >( i + 3 ) * VALUE_SIZE + TYPE_OFFSET, META_TYPE );
+		Exit( i < dimensions ? CC_E : CC_NE, step.ip );
+	}
+
+	// compared unsigned, a negative index is out of bounds as well
+	const int32_t extents = -static_cast< int32_t >( dimensions + 1 ) * VALUE_SIZE + VALUE_OFFSET;
+	for ( size_t i = 0; i < dimensions; ++i ) {
+		const Register index = IntRegister( first - i );
+		assembler.Load( extent, RAX, extents + static_cast< int32_t >( i ) * VALUE_SIZE, WIDE );
+		assembler.Compare( index, extent, WIDE );
+		Exit( CC_AE, step.ip );
+		if ( i == 0 ) {
+			assembler.Move( element, index );
+		}
+		else {
+			assembler.Multiply( element, extent, WIDE );
+			assembler.Add( element, index, WIDE );
+		}
+	}
+	assembler.ShiftLeft( element, VALUE_SHIFT, true );
+	assembler.Add( element, RAX, true );
+
+	if ( is_store ) {
+		const size_t value = first - dimensions;
+		WriteValue( element, 0, stack[ value ].kind, value, true );
+		stack.resize( value );
+		return true;
+	}
+
+	// an element of another type than it held leaves as well
+	assembler.CompareImmediate( element, TYPE_OFFSET, step.types[ 1 ] );
+	Exit( CC_NE, step.ip );
+	stack.resize( stack.size() - dimensions );
+	Push( kind );
+	if ( kind == FLOAT_VALUE ) {
+		assembler.LoadFloat( FloatRegisterOf( stack.size() - 1 ), element, VALUE_OFFSET );
+	}
+	else {
+		assembler.Load( IntRegister( stack.size() - 1 ), element, VALUE_OFFSET, WIDE );
+	}
+
+	return true;
+}
+
+bool TraceCompiler::Push( Kind kind )
+{
+	if ( stack.size() >= TRACE_STACK_SIZE ) {
+		return false;
+	}
+
+	stack.push_back( StackValue{ kind, CC_E } );
+	return true;
+}
+
+// false for a variable of a type traces don't keep in registers, or a full stack
+bool TraceCompiler::Load( Variable variable, RuntimeType type )
+{
+	Kind kind;
+	if ( !KindOf( type, kind ) || !Push( kind ) ) {
+		return false;
+	}
+
+	const Register base = variable.first == LOCL ? LOCALS : GLOBALS;
+	const int32_t displacement = static_cast< int32_t >( variable.second ) * VALUE_SIZE + VALUE_OFFSET;
+	if ( kind == FLOAT_VALUE ) {
+		assembler.LoadFloat( FloatRegisterOf( stack.size() - 1 ), base, displacement );
+	}
+	else {
+		assembler.Load( IntRegister( stack.size() - 1 ), base, displacement, WIDE );
+	}
+
+	return true;
+}
+
+// a variable known to hold the type already keeps its type and class
+void TraceCompiler::Store( Variable variable, Kind kind )
+{
+	auto type = known.find( variable );
+	const bool with_type = type == known.end() || type->second != TypeOf( kind );
+	WriteValue( variable.first == LOCL ? LOCALS : GLOBALS, static_cast< int32_t >( variable.second ) * VALUE_SIZE, kind, stack.size() - 1, with_type );
+	known[ variable ] = TypeOf( kind );
+}
+
+// boxes the value of stack 'slot' into the value at [base + displacement]
+void TraceCompiler::WriteValue( Register base, int32_t displacement, Kind kind, size_t slot, bool with_type )
+{
+	if ( with_type ) {
+		RuntimeClass* klass;
+		switch ( kind ) {
+		case INT_VALUE:
+			klass = IntegerClass::Instance();
+			break;
+
+		case FLOAT_VALUE:
+			klass = FloatClass::Instance();
+			break;
+
+		default:
+			klass = BooleanClass::Instance();
+			break;
+		}
+		WriteHeader( assembler, base, displacement, TypeOf( kind ), klass );
+	}
+
+	if ( kind == FLOAT_VALUE ) {
+		assembler.StoreFloat( base, displacement + VALUE_OFFSET, FloatRegisterOf( slot ) );
+	}
+	else {
+		assembler.Store( base, displacement + VALUE_OFFSET, IntRegister( slot ), WIDE );
+	}
+}
+
+// a comparison on top of the stack becomes a boolean
+void TraceCompiler::Materialize()
+{
+	if ( !stack.empty() && stack.back().kind == CONDITION ) {
+		assembler.SetCondition( stack.back().condition, IntRegister( stack.size() - 1 ) );
+		stack.back().kind = BOOL_VALUE;
+	}
+}
+
+void TraceCompiler::ToFloat( size_t slot )
+{
+	if ( stack[ slot ].kind == INT_VALUE ) {
+		assembler.ConvertToFloat( FloatRegisterOf( slot ), IntRegister( slot ), WIDE );
+		stack[ slot ].kind = FLOAT_VALUE;
+	}
+}
+
+// leaves for 'ip' when 'condition' holds, with the stack as it is now
+void TraceCompiler::Exit( Condition condition, size_t ip )
+{
+	exits.push_back( PendingExit{ assembler.JumpIf( condition ), ip, !is_closing, stack } );
+}
+
+// the global function's variables are the program's
+TraceCompiler::Variable TraceCompiler::GetVariable( Instruction* instruction )
+{
+	return Variable( is_global && instruction->operand1 == GLOB ? static_cast< INT_T >( LOCL ) : instruction->operand1, instruction->operand2 );
+}
+
+bool TraceCompiler::KindOf( RuntimeType type, Kind &kind )
+{
+	switch ( type ) {
+	case INT_TYPE:
+		kind = INT_VALUE;
+		return true;
+
+	case FLOAT_TYPE:
+		kind = FLOAT_VALUE;
+		return true;
+
+	case BOOL_TYPE:
+		kind = BOOL_VALUE;
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+RuntimeType TraceCompiler::TypeOf( Kind kind )
+{
+	switch ( kind ) {
+	case INT_VALUE:
+		return INT_TYPE;
+
+	case FLOAT_VALUE:
+		return FLOAT_TYPE;
+
+	default:
+		return BOOL_TYPE;
+	}
+}
+
+// none of them is kept across calls, which traces don't make
+Register TraceCompiler::IntRegister( size_t slot )
+{
+	static const Register registers[ TRACE_STACK_SIZE ] = { RCX, RDX, R8, R9, R10, R11 };
+	return registers[ slot ];
+}
+
+FloatRegister TraceCompiler::FloatRegisterOf( size_t slot )
+{
+	return static_cast< FloatRegister >( XMM0 + slot );
+}
+
+/****************************
+ * Methods
+ ****************************/
+// a compiled function keeps the stack's limit, and where it returns its top, with its arguments; rbp is scratch
+static const Register LIMIT = R14;
+static const Register NATIVE_STACK = R15;
+static const Register SCRATCH = RBP;
+
+#ifdef _WIN32
+static const Register ARGUMENTS[] = { RCX, RDX, R8, R9 };
+#else
+static const Register ARGUMENTS[] = { RDI, RSI, RDX, RCX };
+#endif
+
+// room for a call's shadow space that keeps the stack aligned under the six saved registers
+static const int32_t FRAME_SIZE = 40;
+
+// values waiting on the stack; calls don't keep them
+static const Register INT_REGISTERS[] = { RCX, RDX, R8, R9, R10, R11 };
+
+// a generic operation left to the left operand's class, as the interpreter would; false for anything else
+static INT_T Calculate( Value* left, INT_T type )
+{
+	if ( !left->sys_klass ) {
+		return 0;
+	}
+
+	Operation call = left->sys_klass->GetOperation( static_cast< InstructionType >( type ) );
+	if ( !call ) {
+		return 0;
+	}
+
+	Value result = *left;
+	( *call )( result, left[ -1 ], result );
+	left[ -1 ] = result;
+	return 1;
+}
+
+// an element of an array at integer indices, the first of them under 'top'; false for anything else, which the interpreter
+// then handles or reports
+template<int dimensions>
+static INT_T LoadElement( Value* variable, Value* top )
+{
+	Value* array = static_cast< Value* >( variable->value.ptr_value );
+	INT_T index;
+	if ( variable->type != ARRAY_TYPE || !ArrayClass::Index<dimensions>( top - 1, array, index ) ) {
+		return 0;
+	}
+
+	top[ -dimensions ] = array[ index ];
+	return 1;
+}
+
+// the value stored is under the indices
+template<int dimensions>
+static INT_T StoreElement( Value* variable, Value* top )
+{
+	Value* array = static_cast< Value* >( variable->value.ptr_value );
+	INT_T index;
+	if ( variable->type != ARRAY_TYPE || !ArrayClass::Index<dimensions>( top - 1, array, index ) ) {
+		return 0;
+	}
+
+	array[ index ] = top[ -dimensions - 1 ];
+	return 1;
+}
+
+typedef INT_T( *ElementCall )( Value* variable, Value* top );
+static const ElementCall LOAD_ELEMENT[] = { &LoadElement<1>, &LoadElement<2>, &LoadElement<3> };
+static const ElementCall STORE_ELEMENT[] = { &StoreElement<1>, &StoreElement<2>, &StoreElement<3> };
+
+NativeMethods::~NativeMethods()
+{
+	for ( Method* method : methods ) {
+		Assembler::Release( reinterpret_cast< void* >( method->code ), method->size );
+		delete method;
+	}
+}
+
+Method* NativeMethods::Compile( ExecutableFunction* function )
+{
+	MethodCompiler compiler{ function };
+	Method* method = compiler.Compile();
+	if ( method ) {
+		methods.push_back( method );
+	}
+	TRACE( TRACE_EMIT, TRACE_EVENTS, EMIT_METHOD, function->GetName(), method != nullptr );
+
+	return method;
+}
+
+Method* MethodCompiler::Compile()
+{
+	std::vector<Instruction*> &instructions = function->GetInstructions();
+	if ( !Assembler::IsAvailable() || instructions.empty() ) {
+		return nullptr;
+	}
+
+	// blocks start where jumps land and where the interpreter may hand the function back
+	starts.insert( 0 );
+	for ( auto &label : function->GetJumpTable() ) {
+		starts.insert( label.second );
+	}
+	for ( size_t i = 0; i < instructions.size(); ++i ) {
+		switch ( instructions[ i ]->type ) {
+		case LBL:
+			starts.insert( i );
+			break;
+
+		case INC_LOCAL_INT:
+			starts.insert( i + 5 );
+			break;
+
+		case KNOWN_SIZE:
+		case CMP_JMP_EQL:
+		case CMP_JMP_NEQL:
+		case CMP_JMP_GTR:
+		case CMP_JMP_LES:
+		case CMP_JMP_GTR_EQL:
+		case CMP_JMP_LES_EQL:
+			starts.insert( i + 3 );
+			break;
+
+		default:
+			if ( instructions[ i ]->type == JMP || !IsCompiled( instructions[ i ] ) ) {
+				starts.insert( i + 1 );
+			}
+			break;
+		}
+	}
+	starts.erase( starts.lower_bound( instructions.size() ), starts.end() );
+
+	std::unique_ptr<Method> method( new Method );
+	method->entries.resize( instructions.size() );
+
+	assembler.Push( LOCALS );
+	assembler.Push( SCRATCH );
+	assembler.Push( STACK );
+	assembler.Push( GLOBALS );
+	assembler.Push( LIMIT );
+	assembler.Push( NATIVE_STACK );
+	assembler.LoadAddress( RSP, RSP, -FRAME_SIZE );
+	assembler.Move( LOCALS, ARGUMENTS[ 0 ] );
+	assembler.Move( GLOBALS, ARGUMENTS[ 1 ] );
+	assembler.Move( NATIVE_STACK, ARGUMENTS[ 2 ] );
+	assembler.Move( RAX, ARGUMENTS[ 3 ] );
+	assembler.Load( STACK, NATIVE_STACK, offsetof( NativeStack, top ), true );
+	assembler.Load( LIMIT, NATIVE_STACK, offsetof( NativeStack, limit ), true );
+
+	// the interpreter's position picks the block; anywhere else it's handed straight back
+	assembler.MoveImmediate( RDX, reinterpret_cast< intptr_t >( method->entries.data() ), true );
+	assembler.JumpIndirect( RDX, RAX );
+	const size_t declined = assembler.Position();
+	returns.push_back( assembler.Jump() );
+
+	for ( size_t ip = 0; ip < instructions.size(); ++ip ) {
+		if ( starts.count( ip ) ) {
+			if ( is_reachable ) {
+				Normalize();
+			}
+			if ( !offsets.empty() ) {
+				EndBlock();
+			}
+			StartBlock( ip );
+		}
+		if ( is_reachable && ( !Compile( ip ) || is_failed ) ) {
+			return nullptr;
+		}
+	}
+	if ( is_reachable ) {
+		return nullptr;
+	}
+	EndBlock();
+
+	for ( PendingExit &exit : exits ) {
+		for ( size_t jump : exit.jumps ) {
+			assembler.Patch( jump, assembler.Position() );
+		}
+		for ( StackValue &value : exit.values ) {
+			Write( value, STACK, value.slot * VALUE_SIZE );
+		}
+		if ( exit.top ) {
+			assembler.LoadAddress( STACK, STACK, exit.top * VALUE_SIZE );
+		}
+		assembler.MoveImmediate( RAX, static_cast< int64_t >( exit.ip ), true );
+		returns.push_back( assembler.Jump() );
+	}
+	for ( size_t jump : returns ) {
+		assembler.Patch( jump, assembler.Position() );
+	}
+	assembler.Store( NATIVE_STACK, offsetof( NativeStack, top ), STACK, true );
+	assembler.LoadAddress( RSP, RSP, FRAME_SIZE );
+	assembler.Pop( NATIVE_STACK );
+	assembler.Pop( LIMIT );
+	assembler.Pop( GLOBALS );
+	assembler.Pop( STACK );
+	assembler.Pop( SCRATCH );
+	assembler.Pop( LOCALS );
+	assembler.Return();
+
+	for ( auto &jump : jumps ) {
+		auto offset = offsets.find( jump.second );
+		if ( offset == offsets.end() ) {
+			return nullptr;
+		}
+		assembler.Patch( jump.first, offset->second );
+	}
+
+	method->code = reinterpret_cast< MethodCode >( assembler.Finish( method->size ) );
+	if ( !method->code ) {
+		return nullptr;
+	}
+	unsigned char* code = reinterpret_cast< unsigned char* >( method->code );
+	for ( size_t ip = 0; ip < instructions.size(); ++ip ) {
+		auto offset = offsets.find( ip );
+		method->entries[ ip ] = code + ( offset == offsets.end() ? declined : offset->second );
+	}
+
+	return method.release();
+}
+
+bool MethodCompiler::Compile( size_t ip )
+{
+	Instruction* instruction = function->GetInstructions()[ ip ];
+	switch ( instruction->type ) {
+	case LOAD_TRUE_LIT:
+	case LOAD_FALSE_LIT:
+	case LOAD_INT_LIT:
+	case LOAD_FLOAT_LIT:
+	case LOAD_CHAR_LIT:
+	case LOAD_NIL_LIT:
+		Push( StackValue{ CONSTANT, 0, instruction, -1 } );
+		break;
+
+	case LOAD_VAR:
+		if ( instruction->operand1 == LOCL || instruction->operand1 == GLOB ) {
+			Push( StackValue{ VARIABLE, 0, instruction, -1 } );
+			break;
+		}
+		// fall through
+	case LOAD_FIELD:
+		// fields are copied at once
+		Push( StackValue{ STACKED, 0, nullptr, -1 } );
+		assembler.Load( SCRATCH, LOCALS, VALUE_OFFSET, true );
+		Copy( SCRATCH, static_cast< int32_t >( instruction->operand2 ) * VALUE_SIZE, STACK, stack.back().slot * VALUE_SIZE );
+		break;
+
+	case STOR_VAR: {
+		StackValue value = Pop();
+		if ( instruction->operand1 == LOCL || instruction->operand1 == GLOB ) {
+			FlushVariable( instruction );
+			Write( value, instruction->operand1 == LOCL ? LOCALS : GLOBALS, static_cast< int32_t >( instruction->operand2 ) * VALUE_SIZE );
+		}
+		else {
+			assembler.Load( SCRATCH, LOCALS, VALUE_OFFSET, true );
+			Write( value, SCRATCH, static_cast< int32_t >( instruction->operand2 ) * VALUE_SIZE );
+		}
+		Release( value );
+	}
+		break;
+
+	case POP: {
+		StackValue value = Pop();
+		Release( value );
+	}
+		break;
+
+	case EQL:
+	case NEQL:
+	case GTR:
+	case LES:
+	case GTR_EQL:
+	case LES_EQL:
+	case ADD:
+	case SUB:
+	case MUL:
+	case DIV:
+	case MOD:
+	case BIT_AND:
+	case BIT_OR:
+	case EQL_INT:
+	case NEQL_INT:
+	case GTR_INT:
+	case LES_INT:
+	case GTR_EQL_INT:
+	case LES_EQL_INT:
+	case ADD_INT:
+	case SUB_INT:
+	case MUL_INT:
+	case GTR_FLOAT:
+	case LES_FLOAT:
+	case GTR_EQL_FLOAT:
+	case LES_EQL_FLOAT:
+	case ADD_FLOAT:
+	case SUB_FLOAT:
+	case MUL_FLOAT:
+	case DIV_FLOAT:
+		return Arithmetic( ip, instruction->type );
+
+	case JMP:
+		return Branch( ip, instruction );
+
+	case CMP_JMP_EQL:
+	case CMP_JMP_NEQL:
+	case CMP_JMP_GTR:
+	case CMP_JMP_LES:
+	case CMP_JMP_GTR_EQL:
+	case CMP_JMP_LES_EQL:
+		return CompareJump( ip, instruction );
+
+	// an integer is stepped here; anything else by the sequence that follows
+	case INC_LOCAL_INT: {
+		if ( instruction->operand2 < INT32_MIN || instruction->operand2 > INT32_MAX ) {
+			break;
+		}
+		Normalize();
+		const int32_t displacement = static_cast< int32_t >( instruction->operand1 ) * VALUE_SIZE;
+		assembler.CompareImmediate( LOCALS, displacement + TYPE_OFFSET, INT_TYPE );
+		const size_t other = assembler.JumpIf( CC_NE );
+		assembler.AddImmediate( LOCALS, displacement + VALUE_OFFSET, static_cast< int32_t >( instruction->operand2 ), WIDE );
+		JumpTo( ip + 5 );
+		assembler.Patch( other, assembler.Position() );
+	}
+		break;
+
+	case NEW_ARRAY:
+		NewArray( instruction );
+		break;
+
+	case LOAD_ARY_ELEM:
+	case LOAD_ARY_VAR:
+		if ( !IsCompiled( instruction ) ) {
+			Decline( ip );
+			break;
+		}
+		Element( ip, instruction, false );
+		break;
+
+	case STOR_ARY_ELEM:
+	case STOR_ARY_VAR:
+		if ( !IsCompiled( instruction ) ) {
+			Decline( ip );
+			break;
+		}
+		Element( ip, instruction, true );
+		break;
+
+	case KNOWN_SIZE: {
+		Normalize();
+		const int32_t displacement = static_cast< int32_t >( instruction->operand1 ) * VALUE_SIZE;
+		assembler.CompareImmediate( LOCALS, displacement + TYPE_OFFSET, INT_TYPE );
+		const size_t other = assembler.JumpIf( CC_NE );
+		Copy( LOCALS, displacement, STACK, 0 );
+		assembler.LoadAddress( STACK, STACK, VALUE_SIZE );
+		peak = std::max( peak, moved + 1 );
+		JumpTo( ip + 3 );
+		assembler.Patch( other, assembler.Position() );
+	}
+		break;
+
+	// the instructions after them load the same values
+	case LOAD_LOCAL_PAIR:
+	case LOAD_INT_LOCAL:
+	case LOAD_CLS:
+	case LBL:
+	case MOV:
+	case NO_OP:
+		break;
+
+	default:
+		Decline( ip );
+		break;
+	}
+
+	return true;
+}
+
+// the left operand is on top and the result replaces the right one
+bool MethodCompiler::Arithmetic( size_t ip, InstructionType type )
+{
+	StackValue left = Pop();
+	StackValue right = Pop();
+	const RuntimeType left_type = TypeOf( left );
+	const RuntimeType right_type = TypeOf( right );
+	const bool is_int = left_type == INT_TYPE && right_type == INT_TYPE;
+	const bool is_number = ( left_type == INT_TYPE || left_type == FLOAT_TYPE ) && ( right_type == INT_TYPE || right_type == FLOAT_TYPE );
+
+	bool is_typed;
+	bool is_fast = false;
+	switch ( type ) {
+	case ADD:
+	case SUB:
+	case MUL:
+	case GTR:
+	case LES:
+	case GTR_EQL:
+	case LES_EQL:
+		is_typed = is_number;
+		is_fast = true;
+		break;
+
+	// floats compare unordered as false
+	case EQL:
+	case NEQL:
+		is_typed = is_int;
+		is_fast = true;
+		break;
+
+	// integers divide by zero in their class
+	case DIV:
+		is_typed = is_number && !is_int;
+		break;
+
+	case MOD:
+	case BIT_AND:
+	case BIT_OR:
+		is_typed = false;
+		break;
+
+	default:
+		is_typed = true;
+		break;
+	}
+	if ( is_typed ) {
+		TypedArithmetic( type, left, right );
+		return true;
+	}
+
+	// left to the operand's class, after a check for two integers where they may be
+	is_fast = is_fast && ( left_type == INT_TYPE || left_type == UNINIT_TYPE ) && ( right_type == INT_TYPE || right_type == UNINIT_TYPE );
+	FlushRegisters();
+	std::vector<size_t> slow;
+	size_t done = 0;
+	if ( is_fast ) {
+		CheckType( left, INT_TYPE, slow );
+		CheckType( right, INT_TYPE, slow );
+		StackValue left_value = left;
+		StackValue right_value = right;
+		TypedArithmetic( type, left_value, right_value );
+		StackValue result = Pop();
+		Write( result, STACK, result.slot * VALUE_SIZE );
+		Release( result );
+		done = assembler.Jump();
+	}
+	for ( size_t jump : slow ) {
+		assembler.Patch( jump, assembler.Position() );
+	}
+
+	Write( left, STACK, left.slot * VALUE_SIZE );
+	Write( right, STACK, right.slot * VALUE_SIZE );
+	assembler.LoadAddress( ARGUMENTS[ 0 ], STACK, left.slot * VALUE_SIZE );
+	assembler.MoveImmediate( ARGUMENTS[ 1 ], type, true );
+	assembler.MoveImmediate( RAX, reinterpret_cast< intptr_t >( &Calculate ), true );
+	assembler.Call( RAX );
+	assembler.Test( RAX, RAX, true );
+	Exit( { assembler.JumpIf( CC_E ) }, ip, left.slot + 1, stack );
+	if ( is_fast ) {
+		assembler.Patch( done, assembler.Position() );
+	}
+
+	Release( left );
+	Release( right );
+	Push( StackValue{ STACKED, 0, nullptr, -1 } );
+
+	return true;
+}
+
+// operands of a typed instruction, or of a generic one known to be numbers
+void MethodCompiler::TypedArithmetic( InstructionType type, StackValue &left, StackValue &right )
+{
+	bool is_float;
+	switch ( type ) {
+	case EQL_INT:
+	case NEQL_INT:
+	case GTR_INT:
+	case LES_INT:
+	case GTR_EQL_INT:
+	case LES_EQL_INT:
+	case ADD_INT:
+	case SUB_INT:
+	case MUL_INT:
+		is_float = false;
+		break;
+
+	case GTR_FLOAT:
+	case LES_FLOAT:
+	case GTR_EQL_FLOAT:
+	case LES_EQL_FLOAT:
+	case ADD_FLOAT:
+	case SUB_FLOAT:
+	case MUL_FLOAT:
+	case DIV_FLOAT:
+		is_float = true;
+		break;
+
+	default:
+		is_float = TypeOf( left ) == FLOAT_TYPE || TypeOf( right ) == FLOAT_TYPE || type == DIV;
+		break;
+	}
+
+	Condition condition = CC_E;
+	bool is_compare = true;
+	switch ( type ) {
+	case EQL:
+	case EQL_INT:
+		condition = CC_E;
+		break;
+
+	case NEQL:
+	case NEQL_INT:
+		condition = CC_NE;
+		break;
+
+	case GTR:
+	case GTR_INT:
+	case GTR_FLOAT:
+		condition = CC_G;
+		break;
+
+	case LES:
+	case LES_INT:
+	case LES_FLOAT:
+		condition = CC_L;
+		break;
+
+	case GTR_EQL:
+	case GTR_EQL_INT:
+	case GTR_EQL_FLOAT:
+		condition = CC_GE;
+		break;
+
+	case LES_EQL:
+	case LES_EQL_INT:
+	case LES_EQL_FLOAT:
+		condition = CC_LE;
+		break;
+
+	default:
+		is_compare = false;
+		break;
+	}
+
+	if ( !is_float ) {
+		const Register left_register = IntOperand( left, INT_VALUE );
+		const Register right_register = IntOperand( right, INT_VALUE );
+		if ( is_compare ) {
+			assembler.Compare( left_register, right_register, WIDE );
+			assembler.SetCondition( condition, right_register );
+			right.kind = BOOL_VALUE;
+		}
+		else {
+			switch ( type ) {
+			case ADD:
+			case ADD_INT:
+				assembler.Add( right_register, left_register, WIDE );
+				break;
+
+			case SUB:
+			case SUB_INT:
+				assembler.Subtract( left_register, right_register, WIDE );
+				assembler.Move( right_register, left_register );
+				break;
+
+			default:
+				assembler.Multiply( right_register, left_register, WIDE );
+				break;
+			}
+		}
+		Release( left );
+		Push( right );
+		return;
+	}
+
+	const FloatRegister left_register = FloatOperand( left );
+	const FloatRegister right_register = FloatOperand( right );
+	if ( is_compare ) {
+		StackValue result{ BOOL_VALUE, 0, nullptr, AllocateInt() };
+		switch ( condition ) {
+		case CC_G:
+		case CC_GE:
+			assembler.CompareFloat( left_register, right_register );
+			condition = condition == CC_G ? CC_A : CC_AE;
+			break;
+
+		default:
+			assembler.CompareFloat( right_register, left_register );
+			condition = condition == CC_L ? CC_A : CC_AE;
+			break;
+		}
+		assembler.SetCondition( condition, INT_REGISTERS[ result.reg ] );
+		Release( left );
+		Release( right );
+		Push( result );
+		return;
+	}
+
+	switch ( type ) {
+	case ADD:
+	case ADD_FLOAT:
+		assembler.AddFloat( right_register, left_register );
+		break;
+
+	case SUB:
+	case SUB_FLOAT:
+		assembler.SubtractFloat( left_register, right_register );
+		assembler.MoveFloat( right_register, left_register );
+		break;
+
+	case MUL:
+	case MUL_FLOAT:
+		assembler.MultiplyFloat( right_register, left_register );
+		break;
+
+	default:
+		assembler.DivideFloat( left_register, right_register );
+		assembler.MoveFloat( right_register, left_register );
+		break;
+	}
+	Release( left );
+	Push( right );
+}
+
+// a boolean that isn't known to be one is checked; the interpreter reports anything else
+bool MethodCompiler::Branch( size_t ip, Instruction* instruction )
+{
+	auto label = function->GetJumpTable().find( instruction->operand1 );
+	if ( label == function->GetJumpTable().end() ) {
+		return false;
+	}
+
+	if ( instruction->operand2 == JMP_UNCND ) {
+		Normalize();
+		JumpTo( label->second );
+		is_reachable = false;
+		return true;
+	}
+
+	StackValue condition = Pop();
+	if ( TypeOf( condition ) == BOOL_TYPE ) {
+		const Register value = IntOperand( condition, BOOL_VALUE );
+		Normalize();
+		assembler.Test( value, value, WIDE );
+		Release( condition );
+	}
+	else {
+		Push( condition );
+		Normalize();
+		assembler.CompareImmediate( STACK, -VALUE_SIZE + TYPE_OFFSET, BOOL_TYPE );
+		Exit( { assembler.JumpIf( CC_NE ) }, ip, 0, {} );
+		assembler.Load( RAX, STACK, -VALUE_SIZE + VALUE_OFFSET, WIDE );
+		assembler.LoadAddress( STACK, STACK, -VALUE_SIZE );
+		--moved;
+		assembler.Test( RAX, RAX, WIDE );
+	}
+	jumps.push_back( { assembler.JumpIf( instruction->operand2 == JMP_TRUE ? CC_NE : CC_E ), label->second } );
+
+	return true;
+}
+
+// numbers are compared here; anything but two integers not known to be numbers by the interpreter
+bool MethodCompiler::CompareJump( size_t ip, Instruction* instruction )
+{
+	auto label = function->GetJumpTable().find( instruction->operand1 );
+	if ( label == function->GetJumpTable().end() ) {
+		return false;
+	}
+
+	Condition condition;
+	bool is_equality = false;
+	switch ( instruction->type ) {
+	case CMP_JMP_EQL:
+		condition = CC_E;
+		is_equality = true;
+		break;
+
+	case CMP_JMP_NEQL:
+		condition = CC_NE;
+		is_equality = true;
+		break;
+
+	case CMP_JMP_GTR:
+		condition = CC_G;
+		break;
+
+	case CMP_JMP_LES:
+		condition = CC_L;
+		break;
+
+	case CMP_JMP_GTR_EQL:
+		condition = CC_GE;
+		break;
+
+	default:
+		condition = CC_LE;
+		break;
+	}
+
+	StackValue left = Pop();
+	StackValue right = Pop();
+	const RuntimeType left_type = TypeOf( left );
+	const RuntimeType right_type = TypeOf( right );
+	const bool is_number = ( left_type == INT_TYPE || left_type == FLOAT_TYPE ) && ( right_type == INT_TYPE || right_type == FLOAT_TYPE );
+	if ( is_number && ( left_type == FLOAT_TYPE || right_type == FLOAT_TYPE ) && !is_equality ) {
+		const FloatRegister left_register = FloatOperand( left );
+		const FloatRegister right_register = FloatOperand( right );
+		if ( condition == CC_G || condition == CC_GE ) {
+			assembler.CompareFloat( left_register, right_register );
+			condition = condition == CC_G ? CC_A : CC_AE;
+		}
+		else {
+			assembler.CompareFloat( right_register, left_register );
+			condition = condition == CC_L ? CC_A : CC_AE;
+		}
+	}
+	else {
+		if ( left_type != INT_TYPE || right_type != INT_TYPE ) {
+			std::vector<StackValue> values = stack;
+			values.push_back( right );
+			values.push_back( left );
+			std::vector<size_t> other;
+			CheckType( left, INT_TYPE, other );
+			CheckType( right, INT_TYPE, other );
+			Exit( other, ip, left.slot + 1, values );
+		}
+		assembler.Compare( IntOperand( left, INT_VALUE ), IntOperand( right, INT_VALUE ), WIDE );
+	}
+	Release( left );
+	Release( right );
+
+	// only moves follow, which leave the flags alone
+	Normalize();
+	jumps.push_back( { assembler.JumpIf( instruction->operand2 == JMP_TRUE ? condition : Negate( condition ) ), label->second } );
+	JumpTo( ip + 3 );
+	is_reachable = false;
+
+	return true;
+}
+
+// the allocator may collect, so every value goes to its slot first; the runtime sees the stack's top there
+void MethodCompiler::NewArray( Instruction* instruction )
+{
+	Normalize();
+	assembler.Move( ARGUMENTS[ 0 ], NATIVE_STACK );
+	assembler.Move( ARGUMENTS[ 1 ], STACK );
+	assembler.MoveImmediate( ARGUMENTS[ 2 ], instruction->operand1, true );
+	assembler.Load( RAX, NATIVE_STACK, offsetof( NativeStack, calls ), true );
+	assembler.Load( RAX, RAX, offsetof( NativeCalls, new_array ), true );
+	assembler.Call( RAX );
+
+	for ( INT_T i = 0; i < instruction->operand1; ++i ) {
+		Pop();
+	}
+	Push( StackValue{ STACKED, 0, nullptr, -1 } );
+}
+
+// the indices, and a value stored, go to their slots for a call that finds the element; when it can't, the interpreter
+// runs the instruction
+void MethodCompiler::Element( size_t ip, Instruction* instruction, bool is_store )
+{
+	const int dimensions = static_cast< int >( instruction->operand3 );
+	std::vector<StackValue> operands;
+	for ( int i = 0; i < dimensions + ( is_store ? 1 : 0 ); ++i ) {
+		operands.push_back( Pop() );
+	}
+	FlushRegisters();
+	for ( StackValue &value : operands ) {
+		Write( value, STACK, value.slot * VALUE_SIZE );
+	}
+
+	const int top = operands.front().slot + 1;
+	assembler.LoadAddress( ARGUMENTS[ 0 ], instruction->operand1 == LOCL ? LOCALS : GLOBALS, static_cast< int32_t >( instruction->operand2 ) * VALUE_SIZE );
+	assembler.LoadAddress( ARGUMENTS[ 1 ], STACK, top * VALUE_SIZE );
+	assembler.MoveImmediate( RAX, reinterpret_cast< intptr_t >( ( is_store ? STORE_ELEMENT : LOAD_ELEMENT )[ dimensions - 1 ] ), true );
+	assembler.Call( RAX );
+	assembler.Test( RAX, RAX, true );
+	Exit( { assembler.JumpIf( CC_E ) }, ip, top, stack );
+
+	for ( StackValue &value : operands ) {
+		Release( value );
+	}
+	if ( !is_store ) {
+		Push( StackValue{ STACKED, 0, nullptr, -1 } );
+	}
+}
+
+// the stack's top is checked to leave room for the most the block pushes
+void MethodCompiler::StartBlock( size_t ip )
+{
+	offsets[ ip ] = assembler.Position();
+	stack.clear();
+	base = 0;
+	moved = 0;
+	peak = 0;
+	is_reachable = true;
+
+	assembler.LoadAddress( RAX, STACK, 0 );
+	check = assembler.Position() - 4;
+	assembler.Compare( RAX, LIMIT, true );
+	Exit( { assembler.JumpIf( CC_A ) }, ip, 0, {} );
+}
+
+void MethodCompiler::EndBlock()
+{
+	assembler.Fill( check, peak * VALUE_SIZE );
+}
+
+void MethodCompiler::Push( StackValue value )
+{
+	value.slot = base + static_cast< int >( stack.size() );
+	peak = std::max( peak, moved + value.slot + 1 );
+	stack.push_back( value );
+}
+
+// a value pushed before the block is in its slot
+MethodCompiler::StackValue MethodCompiler::Pop()
+{
+	if ( stack.empty() ) {
+		return StackValue{ STACKED, --base, nullptr, -1 };
+	}
+
+	StackValue value = stack.back();
+	stack.pop_back();
+	return value;
+}
+
+void MethodCompiler::Copy( Register from, int32_t from_displacement, Register to, int32_t displacement )
+{
+	for ( int32_t i = 0; i < VALUE_SIZE; i += 8 ) {
+		assembler.Load( RAX, from, from_displacement + i, true );
+		assembler.Store( to, displacement + i, RAX, true );
+	}
+}
+
+// writes the whole value to [base + displacement] with moves only
+void MethodCompiler::Write( StackValue &value, Register base, int32_t displacement )
+{
+	switch ( value.kind ) {
+	case STACKED:
+	case VARIABLE: {
+		Register from;
+		int32_t from_displacement;
+		Home( value, from, from_displacement );
+		if ( from != base || from_displacement != displacement ) {
+			Copy( from, from_displacement, base, displacement );
+		}
+	}
+		break;
+
+	case CONSTANT: {
+		Instruction* literal = value.source;
+		int64_t bits = 0;
+		switch ( literal->type ) {
+		case LOAD_INT_LIT:
+			WriteHeader( assembler, base, displacement, INT_TYPE, IntegerClass::Instance() );
+			bits = literal->operand1;
+			break;
+
+		case LOAD_FLOAT_LIT:
+			WriteHeader( assembler, base, displacement, FLOAT_TYPE, FloatClass::Instance() );
+			memcpy( &bits, &literal->operand4, sizeof( bits ) );
+			break;
+
+		case LOAD_TRUE_LIT:
+		case LOAD_FALSE_LIT:
+			WriteHeader( assembler, base, displacement, BOOL_TYPE, BooleanClass::Instance() );
+			bits = literal->type == LOAD_TRUE_LIT ? 1 : 0;
+			break;
+
+		case LOAD_CHAR_LIT:
+			WriteHeader( assembler, base, displacement, CHAR_TYPE, nullptr );
+			bits = static_cast< CHAR_T >( literal->operand1 );
+			break;
+
+		default:
+			WriteHeader( assembler, base, displacement, UNINIT_TYPE, nullptr );
+			break;
+		}
+		if ( bits >= INT32_MIN && bits <= INT32_MAX ) {
+			assembler.StoreImmediate( base, displacement + VALUE_OFFSET, static_cast< int32_t >( bits ), true );
+		}
+		else {
+			assembler.MoveImmediate( RAX, bits, true );
+			assembler.Store( base, displacement + VALUE_OFFSET, RAX, true );
+		}
+	}
+		break;
+
+	case INT_VALUE:
+		WriteHeader( assembler, base, displacement, INT_TYPE, IntegerClass::Instance() );
+		assembler.Store( base, displacement + VALUE_OFFSET, INT_REGISTERS[ value.reg ], WIDE );
+		break;
+
+	case BOOL_VALUE:
+		WriteHeader( assembler, base, displacement, BOOL_TYPE, BooleanClass::Instance() );
+		assembler.Store( base, displacement + VALUE_OFFSET, INT_REGISTERS[ value.reg ], WIDE );
+		break;
+
+	case FLOAT_VALUE:
+		WriteHeader( assembler, base, displacement, FLOAT_TYPE, FloatClass::Instance() );
+		assembler.StoreFloat( base, displacement + VALUE_OFFSET, static_cast< FloatRegister >( value.reg ) );
+		break;
+	}
+}
+
+void MethodCompiler::Flush( StackValue &value )
+{
+	if ( value.kind != STACKED ) {
+		Write( value, STACK, value.slot * VALUE_SIZE );
+		Release( value );
+		value.kind = STACKED;
+	}
+}
+
+// before a call, which keeps none of them
+void MethodCompiler::FlushRegisters()
+{
+	for ( StackValue &value : stack ) {
+		if ( value.kind == INT_VALUE || value.kind == FLOAT_VALUE || value.kind == BOOL_VALUE ) {
+			Flush( value );
+		}
+	}
+}
+
+// copies of a variable about to be stored to are taken first
+void MethodCompiler::FlushVariable( Instruction* instruction )
+{
+	for ( StackValue &value : stack ) {
+		if ( value.kind == VARIABLE && value.source->operand1 == instruction->operand1 && value.source->operand2 == instruction->operand2 ) {
+			Flush( value );
+		}
+	}
+}
+
+// all values in their slots and the top past them, as the interpreter and other blocks expect
+void MethodCompiler::Normalize()
+{
+	for ( StackValue &value : stack ) {
+		Flush( value );
+	}
+
+	const int top = base + static_cast< int >( stack.size() );
+	if ( top ) {
+		assembler.LoadAddress( STACK, STACK, top * VALUE_SIZE );
+		moved += top;
+	}
+	stack.clear();
+	base = 0;
+}
+
+void MethodCompiler::Release( StackValue &value )
+{
+	switch ( value.kind ) {
+	case INT_VALUE:
+	case BOOL_VALUE:
+		int_used[ value.reg ] = false;
+		break;
+
+	case FLOAT_VALUE:
+		float_used[ value.reg ] = false;
+		break;
+
+	default:
+		break;
+	}
+}
+
+// the value's integer or boolean, in a register of its own; failing the method if it has no home
+Register MethodCompiler::IntOperand( StackValue &value, Kind kind )
+{
+	if ( value.kind == INT_VALUE || value.kind == BOOL_VALUE ) {
+		return INT_REGISTERS[ value.reg ];
+	}
+
+	const int reg = AllocateInt();
+	if ( value.kind == CONSTANT ) {
+		assembler.MoveImmediate( INT_REGISTERS[ reg ], value.source->type == LOAD_INT_LIT ? value.source->operand1 :
+			( value.source->type == LOAD_TRUE_LIT ? 1 : 0 ), WIDE );
+	}
+	else {
+		Register base;
+		int32_t displacement;
+		if ( !Home( value, base, displacement ) ) {
+			is_failed = true;
+			return INT_REGISTERS[ reg ];
+		}
+		assembler.Load( INT_REGISTERS[ reg ], base, displacement + VALUE_OFFSET, WIDE );
+	}
+	value.kind = kind;
+	value.reg = reg;
+
+	return INT_REGISTERS[ reg ];
+}
+
+// the value as a float, in a register of its own; failing the method if it has no home
+FloatRegister MethodCompiler::FloatOperand( StackValue &value )
+{
+	if ( value.kind == FLOAT_VALUE ) {
+		return static_cast< FloatRegister >( value.reg );
+	}
+
+	const int reg = AllocateFloat();
+	const FloatRegister to = static_cast< FloatRegister >( reg );
+	if ( value.kind == INT_VALUE ) {
+		assembler.ConvertToFloat( to, INT_REGISTERS[ value.reg ], WIDE );
+		Release( value );
+	}
+	else if ( value.kind == CONSTANT && value.source->type == LOAD_INT_LIT ) {
+		assembler.MoveImmediate( RAX, value.source->operand1, true );
+		assembler.ConvertToFloat( to, RAX, true );
+	}
+	else if ( value.kind == CONSTANT ) {
+		int64_t bits;
+		memcpy( &bits, &value.source->operand4, sizeof( bits ) );
+		assembler.MoveImmediate( RAX, bits, true );
+		assembler.MoveToFloat( to, RAX );
+	}
+	else {
+		Register base;
+		int32_t displacement;
+		if ( !Home( value, base, displacement ) ) {
+			is_failed = true;
+			return to;
+		}
+		assembler.LoadFloat( to, base, displacement + VALUE_OFFSET );
+	}
+	value.kind = FLOAT_VALUE;
+	value.reg = reg;
+
+	return to;
+}
+
+// when all are taken, the value lowest on the stack goes to its slot
+int MethodCompiler::AllocateInt()
+{
+	for ( ;; ) {
+		for ( int i = 0; i < 6; ++i ) {
+			if ( !int_used[ i ] ) {
+				int_used[ i ] = true;
+				return i;
+			}
+		}
+		for ( StackValue &value : stack ) {
+			if ( value.kind == INT_VALUE || value.kind == BOOL_VALUE ) {
+				Flush( value );
+				break;
+			}
+		}
+	}
+}
+
+int MethodCompiler::AllocateFloat()
+{
+	for ( ;; ) {
+		for ( int i = 0; i < 6; ++i ) {
+			if ( !float_used[ i ] ) {
+				float_used[ i ] = true;
+				return i;
+			}
+		}
+		for ( StackValue &value : stack ) {
+			if ( value.kind == FLOAT_VALUE ) {
+				Flush( value );
+				break;
+			}
+		}
+	}
+}
+
+// jumps to 'fails' unless the value holds 'type'
+void MethodCompiler::CheckType( StackValue &value, RuntimeType type, std::vector<size_t> &fails )
+{
+	const RuntimeType known = TypeOf( value );
+	if ( known == type ) {
+		return;
+	}
+
+	Register base;
+	int32_t displacement;
+	if ( !Home( value, base, displacement ) ) {
+		fails.push_back( assembler.Jump() );
+		return;
+	}
+	assembler.CompareImmediate( base, displacement + TYPE_OFFSET, type );
+	fails.push_back( assembler.JumpIf( CC_NE ) );
+}
+
+// 'top' counts the slots past the stack's top the interpreter gets, 'values' those to be written first
+void MethodCompiler::Exit( std::vector<size_t> const &jumps, size_t ip, int top, std::vector<StackValue> const &values )
+{
+	exits.push_back( PendingExit{ jumps, ip, top, values } );
+}
+
+// the interpreter runs the instruction
+void MethodCompiler::Decline( size_t ip )
+{
+	Normalize();
+	assembler.MoveImmediate( RAX, static_cast< int64_t >( ip ), true );
+	returns.push_back( assembler.Jump() );
+	is_reachable = false;
+}
+
+void MethodCompiler::JumpTo( size_t ip )
+{
+	jumps.push_back( { assembler.Jump(), ip } );
+}
+
+// where a value in memory lives
+bool MethodCompiler::Home( StackValue &value, Register &base, int32_t &displacement )
+{
+	switch ( value.kind ) {
+	case STACKED:
+		base = STACK;
+		displacement = value.slot * VALUE_SIZE;
+		return true;
+
+	case VARIABLE:
+		base = value.source->operand1 == LOCL ? LOCALS : GLOBALS;
+		displacement = static_cast< int32_t >( value.source->operand2 ) * VALUE_SIZE;
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+// the type of a value known while compiling; UNINIT_TYPE if it isn't
+RuntimeType MethodCompiler::TypeOf( StackValue const &value )
+{
+	switch ( value.kind ) {
+	case INT_VALUE:
+		return INT_TYPE;
+
+	case FLOAT_VALUE:
+		return FLOAT_TYPE;
+
+	case BOOL_VALUE:
+		return BOOL_TYPE;
+
+	case CONSTANT:
+		switch ( value.source->type ) {
+		case LOAD_INT_LIT:
+			return INT_TYPE;
+
+		case LOAD_FLOAT_LIT:
+			return FLOAT_TYPE;
+
+		case LOAD_TRUE_LIT:
+		case LOAD_FALSE_LIT:
+			return BOOL_TYPE;
+
+		default:
+			return UNINIT_TYPE;
+		}
+
+	default:
+		return UNINIT_TYPE;
+	}
+}
+
+bool MethodCompiler::IsCompiled( Instruction* instruction )
+{
+	switch ( instruction->type ) {
+	case LOAD_TRUE_LIT:
+	case LOAD_FALSE_LIT:
+	case LOAD_INT_LIT:
+	case LOAD_FLOAT_LIT:
+	case LOAD_CHAR_LIT:
+	case LOAD_NIL_LIT:
+	case LOAD_VAR:
+	case LOAD_FIELD:
+	case LOAD_CLS:
+	case STOR_VAR:
+	case POP:
+	case MOV:
+	case EQL:
+	case NEQL:
+	case GTR:
+	case LES:
+	case GTR_EQL:
+	case LES_EQL:
+	case ADD:
+	case SUB:
+	case MUL:
+	case DIV:
+	case MOD:
+	case BIT_AND:
+	case BIT_OR:
+	case EQL_INT:
+	case NEQL_INT:
+	case GTR_INT:
+	case LES_INT:
+	case GTR_EQL_INT:
+	case LES_EQL_INT:
+	case ADD_INT:
+	case SUB_INT:
+	case MUL_INT:
+	case GTR_FLOAT:
+	case LES_FLOAT:
+	case GTR_EQL_FLOAT:
+	case LES_EQL_FLOAT:
+	case ADD_FLOAT:
+	case SUB_FLOAT:
+	case MUL_FLOAT:
+	case DIV_FLOAT:
+	case JMP:
+	case LBL:
+	case INC_LOCAL_INT:
+	case LOAD_LOCAL_PAIR:
+	case LOAD_INT_LOCAL:
+	case KNOWN_SIZE:
+	case CMP_JMP_EQL:
+	case CMP_JMP_NEQL:
+	case CMP_JMP_GTR:
+	case CMP_JMP_LES:
+	case CMP_JMP_GTR_EQL:
+	case CMP_JMP_LES_EQL:
+	case NEW_ARRAY:
+	case NO_OP:
+		return true;
+
+	// elements of variables, in up to three dimensions
+	case LOAD_ARY_ELEM:
+	case LOAD_ARY_VAR:
+	case STOR_ARY_ELEM:
+	case STOR_ARY_VAR:
+		return ( instruction->operand1 == LOCL || instruction->operand1 == GLOB ) && instruction->operand3 >= 1 && instruction->operand3 <= 3;
+
+	default:
+		return false;
+	}
+}
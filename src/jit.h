@@ -0,0 +1,301 @@
+/***************************************************************************
+ * Just-in-time compiler
+ *
+ * Copyright (c) 2017 Joshua Ogunyinka
+ * All rights reserved.
+*/
+
+#ifndef __JIT_H__
+#define __JIT_H__
+
+#include "assembler.h"
+
+namespace runtime {
+	/****************************
+	 * An instruction a trace ran and
+	 * the types of the variables it
+	 * read, in the order it read them
+	 ****************************/
+	struct TraceStep {
+		size_t			ip;
+		Instruction*	instruction;
+		RuntimeType		types[ 2 ];
+	};
+
+	// where the interpreter picks up after a trace, and the values the trace left on the stack;
+	// a side exit leaves the loop's path in the middle, not when the loop ends
+	struct TraceExit {
+		size_t	ip;
+		size_t	stack_count;
+		bool	is_side;
+		size_t	hits;
+	};
+
+	// side exits taken before a loop is recorded again, along the way it now goes
+	static const size_t HOT_EXIT = 16;
+
+	// most values a trace keeps on the stack, one to a register
+	static const size_t TRACE_STACK_SIZE = 6;
+
+	// returns the exit taken; values left on the stack are written from 'stack' on
+	typedef INT_T( *TraceCode )( Value* locals, Value* stack, Value* globals );
+
+	struct Trace {
+		TraceCode				code;
+		size_t					size;
+		std::vector<TraceExit>	exits;
+	};
+
+	/****************************
+	 * Compiles a loop's trace to
+	 * machine code. Variables read
+	 * before the trace stores to them
+	 * are checked once, on the way in,
+	 * to hold the types they held when
+	 * it was recorded; values then stay
+	 * unboxed in registers. A branch
+	 * that goes the other way, or a
+	 * check that fails, leaves the
+	 * trace for the interpreter
+	 ****************************/
+	class TraceCompiler {
+		// what a value on the stack is; a condition is a comparison not yet made a boolean
+		enum Kind {
+			INT_VALUE,
+			FLOAT_VALUE,
+			BOOL_VALUE,
+			CONDITION
+		};
+
+		struct StackValue {
+			Kind		kind;
+			Condition	condition;
+		};
+
+		struct PendingExit {
+			size_t					jump;
+			size_t					ip;
+			bool					is_side;
+			std::vector<StackValue>	stack;
+		};
+
+		typedef std::pair<INT_T, INT_T> Variable;
+
+		std::vector<TraceStep> &steps;
+		size_t head_ip;
+		bool is_global;
+		Assembler assembler;
+		std::vector<StackValue> stack;
+		std::map<Variable, RuntimeType> known;						// types variables hold at this point of the trace
+		std::vector<PendingExit> exits;
+		bool is_closing;											// compiling the jump back to the head
+
+		bool Compile( size_t i, std::unordered_map<long, size_t> &labels );
+		bool Arithmetic( InstructionType type );
+		bool Compare( InstructionType type, Condition &condition );
+		bool Branch( Condition jump, size_t taken_ip, size_t fallthrough_ip, size_t next_ip );
+		bool Element( TraceStep &step, bool is_store );
+		bool Push( Kind kind );
+		bool Load( Variable variable, RuntimeType type );
+		void Store( Variable variable, Kind kind );
+		void WriteValue( Register base, int32_t displacement, Kind kind, size_t slot, bool with_type );
+		void Materialize();
+		void ToFloat( size_t slot );
+		void Exit( Condition condition, size_t ip );
+		Variable GetVariable( Instruction* instruction );
+
+		static bool KindOf( RuntimeType type, Kind &kind );
+		static RuntimeType TypeOf( Kind kind );
+		static Register IntRegister( size_t slot );
+		static FloatRegister FloatRegisterOf( size_t slot );
+
+	public:
+		TraceCompiler( std::vector<TraceStep> &steps, size_t head_ip, bool is_global ) : steps( steps ), head_ip( head_ip ), is_global( is_global ),
+			is_closing( false ) {
+		}
+
+		Trace* Compile( ExecutableFunction* function );
+	};
+
+	/****************************
+	 * Records the instructions one
+	 * run of a hot loop executes, from
+	 * its label until the jump back
+	 * to it. Calls, returns, inner loops
+	 * and operations on anything but
+	 * numbers, booleans and elements of
+	 * arrays stop the recording, and a
+	 * loop that stops one or doesn't
+	 * compile isn't recorded again
+	 ****************************/
+	class TraceRecorder {
+		std::vector<Trace*> traces;
+		std::unordered_map<Instruction*, int> retraces;
+		std::vector<TraceStep> steps;
+		ExecutableFunction* function;
+		Instruction* head;
+		size_t head_ip;
+		bool is_global;
+
+		void Abort();
+		static bool IsTraceable( InstructionType type );
+
+	public:
+		TraceRecorder() : function( nullptr ), head( nullptr ), head_ip( 0 ), is_global( false ) {
+		}
+
+		~TraceRecorder();
+
+		bool IsRecording() {
+			return head != nullptr;
+		}
+
+		bool IsHead( Instruction* instruction ) {
+			return instruction == head;
+		}
+
+		// a label's third operand numbers its trace from 1; -1 marks one given up on
+		Trace* GetTrace( Instruction* label ) {
+			return traces[ label->operand3 - 1 ];
+		}
+
+		void Start( ExecutableFunction* function, size_t ip, bool is_global );
+		void Retrace( Instruction* label );
+		void Record( size_t ip, Instruction* instruction, Value* locals, Value* globals, Value* top );
+		void Finish();
+	};
+
+	// calls a function takes to be compiled
+	static const size_t CALL_THRESHOLD = 10;
+
+	struct NativeStack;
+
+	// what compiled code calls back to the runtime for; the stack's top is where it left it
+	struct NativeCalls {
+		// replaces the dimensions under 'top', the first last, with a new array
+		void( *new_array )( NativeStack* stack, Value* top, INT_T dimensions );
+	};
+
+	// the execution stack as a compiled function sees it: its top, how far it may grow, and the way back to the runtime
+	struct NativeStack {
+		Value* top;
+		Value* limit;
+		NativeCalls const* calls;
+	};
+
+	// runs from 'ip' on; returns where the interpreter takes over
+	typedef size_t( *MethodCode )( Value* locals, Value* globals, NativeStack* stack, size_t ip );
+
+	struct Method {
+		MethodCode			code;
+		size_t				size;
+		std::vector<void*>	entries;		// where the code for each instruction starts
+	};
+
+	/****************************
+	 * Compiles a whole function to
+	 * machine code, instruction by
+	 * instruction. Constants, copies
+	 * of variables and results of
+	 * known type wait in registers
+	 * until a block ends or an operation
+	 * needs them on the stack. Calls,
+	 * returns, allocation and anything
+	 * a class decides are left to the
+	 * interpreter, which enters the
+	 * code again at the next block
+	 ****************************/
+	class MethodCompiler {
+		// where a value on the stack is: in its slot, still a literal or variable, or in a register
+		enum Kind {
+			STACKED,
+			CONSTANT,
+			VARIABLE,
+			INT_VALUE,
+			FLOAT_VALUE,
+			BOOL_VALUE
+		};
+
+		struct StackValue {
+			Kind			kind;
+			int				slot;				// from the stack's top on entry to the block
+			Instruction*	source;				// the literal or the variable load
+			int				reg;
+		};
+
+		// leaves for the interpreter at 'ip' once 'values' are written to their slots
+		struct PendingExit {
+			std::vector<size_t>		jumps;
+			size_t					ip;
+			int						top;
+			std::vector<StackValue>	values;
+		};
+
+		ExecutableFunction* function;
+		Assembler assembler;
+		std::set<size_t> starts;					// instructions a block starts at
+		std::map<size_t, size_t> offsets;			// where their code starts
+		std::vector<std::pair<size_t, size_t>> jumps;	// to the blocks at instructions
+		std::vector<size_t> returns;
+		std::vector<PendingExit> exits;
+		std::vector<StackValue> stack;
+		int base;									// slot under the lowest value kept
+		int moved;									// slots the top moved since the block started
+		int peak;									// most slots the block used
+		size_t check;								// displacement of the block's stack check
+		bool is_reachable;
+		bool is_failed;								// an operand had no home to load it from
+		bool int_used[ 6 ];
+		bool float_used[ 6 ];
+
+		bool Compile( size_t ip );
+		bool Arithmetic( size_t ip, InstructionType type );
+		void TypedArithmetic( InstructionType type, StackValue &left, StackValue &right );
+		bool Branch( size_t ip, Instruction* instruction );
+		bool CompareJump( size_t ip, Instruction* instruction );
+		void NewArray( Instruction* instruction );
+		void Element( size_t ip, Instruction* instruction, bool is_store );
+		void StartBlock( size_t ip );
+		void EndBlock();
+		void Push( StackValue value );
+		StackValue Pop();
+		void Copy( Register from, int32_t from_displacement, Register to, int32_t displacement );
+		void Write( StackValue &value, Register base, int32_t displacement );
+		void Flush( StackValue &value );
+		void FlushRegisters();
+		void FlushVariable( Instruction* instruction );
+		void Normalize();
+		void Release( StackValue &value );
+		Register IntOperand( StackValue &value, Kind kind );
+		FloatRegister FloatOperand( StackValue &value );
+		int AllocateInt();
+		int AllocateFloat();
+		void CheckType( StackValue &value, RuntimeType type, std::vector<size_t> &fails );
+		void Exit( std::vector<size_t> const &jumps, size_t ip, int top, std::vector<StackValue> const &values );
+		void Decline( size_t ip );
+		void JumpTo( size_t ip );
+		bool Home( StackValue &value, Register &base, int32_t &displacement );
+		static RuntimeType TypeOf( StackValue const &value );
+		static bool IsCompiled( Instruction* instruction );
+
+	public:
+		MethodCompiler( ExecutableFunction* function ) : function( function ), base( 0 ), moved( 0 ), peak( 0 ), check( 0 ), is_reachable( false ),
+			is_failed( false ), int_used(), float_used() {
+		}
+
+		Method* Compile();
+	};
+
+	// the functions compiled so far
+	class NativeMethods {
+		std::vector<Method*> methods;
+
+	public:
+		~NativeMethods();
+
+		// null if the function can't be compiled; the interpreter keeps running it
+		Method* Compile( ExecutableFunction* function );
+	};
+}
+
+#endif
@@ -8,16 +8,78 @@
 #include "memory.h"
 
 MemoryManager* MemoryManager::instance;
-using std::wcout;
-using std::endl;
+
+// values holding a pointer into the heap
+static inline bool IsReference( RuntimeType type )
+{
+	switch ( type ) {
+	case CLS_TYPE:
+	case ARRAY_TYPE:
+	case STRING_TYPE:
+	case HASH_TYPE:
+	case FUNC_TYPE:
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+// the cells from an object's pointer on
+static inline size_t ElementCount( Mark* mark )
+{
+	switch ( mark->type ) {
+	case CLS_TYPE:
+		return mark->klass->GetInstanceCount();
+
+	case STRING_TYPE:
+	case HASH_TYPE:
+		return 1;
+
+	default:
+		return mark->array_size;
+	}
+}
+
+// an object's cells and mark, and a string's or hash's own record; not the characters or entries they hold
+size_t MemoryManager::ObjectBytes( RuntimeType type, size_t cells )
+{
+	size_t bytes = cells * sizeof( Value ) + sizeof( Mark );
+	if ( type == STRING_TYPE ) {
+		bytes += sizeof( std::wstring );
+	}
+	else if ( type == HASH_TYPE ) {
+		bytes += sizeof( HashTable );
+	}
+
+	return bytes;
+}
+
+void MemoryManager::SetStats( HeapStats* stats )
+{
+	this->stats = stats;
+	if ( !stats ) {
+		return;
+	}
+
+	size_t bytes = 0;
+	for ( Value* values : allocated ) {
+		Mark* mark = static_cast< Mark* >( values[ -1 ].value.ptr_value );
+		Value* start = values - 1;
+		while ( start->type != META_TYPE ) {
+			--start;
+		}
+		bytes += ObjectBytes( mark->type, values - start + ElementCount( mark ) );
+	}
+	stats->Holds( allocated.size(), bytes );
+}
 
 Value* MemoryManager::AllocateString( Value* locals, const size_t local_size, Frame** call_stack, size_t call_stack_pos )
 {
 	// type
 	Value* values = new Value[ 2 ];
 	values[ 0 ].type = META_TYPE;
-	Mark* mark = new Mark( 1 );
-	mark->is_marked = true;
+	Mark* mark = new Mark( 1, STRING_TYPE );
 	values[ 0 ].value.ptr_value = mark;
 	++values;
 
@@ -26,6 +88,9 @@ Value* MemoryManager::AllocateString( Value* locals, const size_t local_size, Fr
 	values[ 0 ].value.ptr_value = new std::wstring;
 
 	allocated.push_back( values );
+	if ( stats ) {
+		stats->Allocated( STRING_TYPE, ObjectBytes( STRING_TYPE, 2 ) );
+	}
 
 	/*
 	MarkMemory(locals, local_size, call_stack, call_stack_pos);
@@ -40,16 +105,18 @@ Value* MemoryManager::AllocateHash( Value* locals, const size_t local_size, Fram
 	// type
 	Value* values = new Value[ 2 ];
 	values[ 0 ].type = META_TYPE;
-	Mark* mark = new Mark( 1 );
-	mark->is_marked = true;
+	Mark* mark = new Mark( 1, HASH_TYPE );
 	values[ 0 ].value.ptr_value = mark;
 	++values;
 
-	// TODO: set hash
+	// set hash
 	values[ 0 ].type = HASH_TYPE;
-	values[ 0 ].value.ptr_value = NULL;
+	values[ 0 ].value.ptr_value = new HashTable;
 
 	allocated.push_back( values );
+	if ( stats ) {
+		stats->Allocated( HASH_TYPE, ObjectBytes( HASH_TYPE, 2 ) );
+	}
 
 	/*
 	MarkMemory(locals, local_size, call_stack, call_stack_pos);
@@ -65,7 +132,6 @@ Value* MemoryManager::AllocateClass( ExecutableClass* klass, Value* locals, cons
 	Value* inst_values = new Value[ klass->GetInstanceCount() + 1 ];
 	inst_values[ 0 ].type = META_TYPE;
 	Mark* mark = new Mark( klass );
-	mark->is_marked = true;
 	inst_values[ 0 ].value.ptr_value = mark;
 	++inst_values;
 
@@ -75,6 +141,9 @@ Value* MemoryManager::AllocateClass( ExecutableClass* klass, Value* locals, cons
 	}
 
 	allocated.push_back( inst_values );
+	if ( stats ) {
+		stats->Allocated( CLS_TYPE, ObjectBytes( CLS_TYPE, inst_count + 1 ) );
+	}
 
 	/*
 	MarkMemory(locals, local_size, call_stack, call_stack_pos);
@@ -84,10 +153,65 @@ Value* MemoryManager::AllocateClass( ExecutableClass* klass, Value* locals, cons
 	return inst_values;
 }
 
-Value* MemoryManager::AllocateArray( INT_T array_size, std::vector<Value> &dimensions, Value* locals,
+// instances kept in a frame share a record that is always marked: their fields are
+// the frame's own slots, already roots, and the frame frees them
+Mark* MemoryManager::FrameMark( ExecutableClass* klass )
+{
+	auto result = frame_marks.find( klass );
+	if ( result != frame_marks.end() ) {
+		return result->second;
+	}
+
+	Mark* mark = new Mark( klass );
+	mark->is_marked = true;
+	frame_marks.insert( { klass, mark } );
+
+	return mark;
+}
+
+Value* MemoryManager::AllocateFunction( ExecutableFunction* function, size_t capture_count, Value* locals, const size_t local_size,
+	Frame** call_stack, size_t call_stack_pos )
+{
+	// layout: [mark][function][captures...]
+	Value* values = new Value[ capture_count + 2 ];
+	values[ 0 ].type = META_TYPE;
+	Mark* mark = new Mark( capture_count + 1, FUNC_TYPE );
+	values[ 0 ].value.ptr_value = mark;
+	++values;
+
+	values[ 0 ].value.ptr_value = function;
+
+	allocated.push_back( values );
+	if ( stats ) {
+		stats->Allocated( FUNC_TYPE, ObjectBytes( FUNC_TYPE, capture_count + 2 ) );
+	}
+
+	return values;
+}
+
+// the first dimension is last, as they were pushed
+Value* MemoryManager::AllocateArray( INT_T array_size, Value* dimensions, const int dimensions_size, Value* locals,
 	const size_t local_size, Frame** call_stack, size_t call_stack_pos )
 {
-	const int dimensions_size = static_cast< int >( dimensions.size() );
+	// collect first, so the new array isn't taken for garbage
+	if ( stats ) {
+		const size_t objects_before = allocated.size();
+		const std::chrono::steady_clock::time_point mark_start = std::chrono::steady_clock::now();
+		MarkMemory( locals, local_size, call_stack, call_stack_pos );
+		const std::chrono::steady_clock::time_point sweep_start = std::chrono::steady_clock::now();
+		const size_t bytes_freed = SweepMemory();
+		stats->Collected( mark_start, sweep_start, std::chrono::steady_clock::now(), objects_before - allocated.size(), bytes_freed );
+	}
+	else {
+		MarkMemory( locals, local_size, call_stack, call_stack_pos );
+		SweepMemory();
+	}
+
+	return AllocateArray( array_size, dimensions, dimensions_size );
+}
+
+Value* MemoryManager::AllocateArray( INT_T array_size, Value* dimensions, const int dimensions_size )
+{
 	const int meta_size = dimensions_size + 2;
 
 	// type
@@ -99,13 +223,12 @@ Value* MemoryManager::AllocateArray( INT_T array_size, std::vector<Value> &dimen
 	array_values[ 1 ].value.int_value = dimensions_size;
 
 	for ( int i = 0; i < dimensions_size; ++i ) {
-		array_values[ i + 2 ] = dimensions[ i ];
+		array_values[ i + 2 ] = dimensions[ dimensions_size - 1 - i ];
 	}
 	array_values += meta_size;
 
 	// mark record
 	Mark* mark = new Mark( array_size );
-	mark->is_marked = true;
 	array_values[ 0 ].value.ptr_value = mark;
 	++array_values;
 
@@ -115,71 +238,51 @@ Value* MemoryManager::AllocateArray( INT_T array_size, std::vector<Value> &dimen
 	}
 
 	allocated.push_back( array_values );
-
-	MarkMemory( locals, local_size, call_stack, call_stack_pos );
-	SweepMemory();
+	if ( stats ) {
+		stats->Allocated( ARRAY_TYPE, ObjectBytes( ARRAY_TYPE, array_size + meta_size + 1 ) );
+	}
 
 	return array_values;
 }
 
 void MemoryManager::MarkMemory( Value* global_locals, const size_t global_local_size, Frame** call_stack, size_t call_stack_pos )
 {
-#ifdef _DEBUG
-	std::wcout << L"\n======================================" << std::endl;
-	std::wcout << L"======== Start Marking Memory ========" << std::endl;
-	std::wcout << L"======================================" << std::endl;
+	TRACE( TRACE_GC, TRACE_EVENTS, GC_MARK, allocated.size() );
+	marked.clear();
 
-#endif
 	for ( size_t i = 0; i < global_local_size; ++i ) {
 		Value local = global_locals[ i ];
-		switch ( local.type ) {
-			// follow
-		case CLS_TYPE:
-		case ARRAY_TYPE:
-		case STRING_TYPE:
-		case HASH_TYPE:
+		if ( IsReference( local.type ) ) {
 			MarkMemory( static_cast< Value* >( local.value.ptr_value ), local.type, 0 );
-			break;
+		}
+	}
 
-		default:
-			break;
+	// operands
+	if ( execution_stack ) {
+		for ( size_t i = 0; i < *execution_stack_pos; ++i ) {
+			Value operand = execution_stack[ i ];
+			if ( IsReference( operand.type ) ) {
+				MarkMemory( static_cast< Value* >( operand.value.ptr_value ), operand.type, 0 );
+			}
 		}
 	}
 
 	// stack
 	while ( call_stack_pos-- ) {
 		Frame* frame = call_stack[ call_stack_pos ];
-#ifdef _DEBUG
-		std::wcout << L"------------------------------------" << std::endl;
-		std::wcout << L"Function: name='" << frame->function->GetName() << "'" << std::endl;
-		std::wcout << L"------------------------------------" << std::endl;
-#endif
+		TRACE( TRACE_GC, TRACE_ALL, GC_MARK_FRAME, frame->function->GetName() );
 
 		Value* fun_locals = frame->locals;
 		const size_t fun_local_size = frame->local_size;
 		for ( size_t i = 0; i < fun_local_size; ++i ) {
 			Value local = fun_locals[ i ];
-			switch ( local.type ) {
-				// follow
-			case CLS_TYPE:
-			case ARRAY_TYPE:
-			case STRING_TYPE:
-			case HASH_TYPE:
+			if ( IsReference( local.type ) ) {
 				MarkMemory( static_cast< Value* >( local.value.ptr_value ), local.type, 0 );
-				break;
-
-			default:
-				break;
 			}
 		}
 	}
 
-#ifdef _DEBUG
-	wcout << L"marked: count=" << marked.size() << endl;
-	wcout << L"======================================" << endl;
-	wcout << L"========= End Marking Memory =========" << endl;
-	wcout << L"======================================\n" << endl;
-#endif
+	TRACE( TRACE_GC, TRACE_EVENTS, GC_MARKED, marked.size() );
 }
 
 void MemoryManager::MarkMemory( Value* values, RuntimeType type, int depth )
@@ -192,61 +295,56 @@ void MemoryManager::MarkMemory( Value* values, RuntimeType type, int depth )
 
 		// determine type
 		size_t value_size;
-
-#ifdef _DEBUG
-		for ( int i = 0; i < depth; ++i ) {
-			wcout << " ";
-		}
-#endif
-
 		switch ( type ) {
 		case CLS_TYPE:
 			value_size = mark->klass->GetInstanceCount();
-#ifdef _DEBUG
-			wcout << L"type=CLS_TYPE, size=" << value_size << L", address=" << values << endl;
-#endif
 			break;
 
 		case STRING_TYPE:
-			value_size = 1;
-#ifdef _DEBUG
-			wcout << L"type=STRING_TYPE, address=" << values << endl;
-#endif
+			value_size = 0;
 			break;
 
 		case HASH_TYPE:
-			value_size = 1;
-#ifdef _DEBUG
-			wcout << L"type=HASH_TYPE, address=" << values << endl;
-#endif
+			value_size = 0;
+			for ( auto &entry : static_cast< HashTable* >( values->value.ptr_value )->GetEntries() ) {
+				if ( IsReference( entry.first.type ) ) {
+					MarkMemory( static_cast< Value* >( entry.first.value.ptr_value ), entry.first.type, depth + 1 );
+				}
+				if ( IsReference( entry.second.type ) ) {
+					MarkMemory( static_cast< Value* >( entry.second.value.ptr_value ), entry.second.type, depth + 1 );
+				}
+			}
+			break;
+
+		case FUNC_TYPE:
+			value_size = mark->array_size;
 			break;
 
 		case ARRAY_TYPE:
 			value_size = mark->array_size;
-#ifdef _DEBUG
-			wcout << L"type=ARRAY_TYPE, size=" << value_size << L", address=" << values << endl;
-#endif
+			break;
+
+		default:
+			value_size = 0;
 			break;
 		}
+		TRACE( TRACE_GC, TRACE_ALL, GC_MARK_OBJECT, type, value_size, reinterpret_cast< intptr_t >( values ), depth );
 
 		for ( size_t i = 0; i < value_size; ++i ) {
 			Value local = values[ i ];
-			switch ( local.type ) {
-				// follow
-			case CLS_TYPE:
-			case ARRAY_TYPE:
+			if ( IsReference( local.type ) ) {
 				MarkMemory( static_cast< Value* >( local.value.ptr_value ), local.type, depth + 1 );
-				break;
-
-			default:
-				break;
 			}
 		}
 	}
 }
 
-void MemoryManager::SweepMemory()
+size_t MemoryManager::SweepMemory()
 {
+#ifdef _TRACE
+	const size_t objects_before = allocated.size();
+#endif
+	size_t bytes_freed = 0;
 	std::list<Value*>::iterator iter = allocated.begin();
 	while ( iter != allocated.end() ) {
 		Value* values = *iter;
@@ -258,20 +356,27 @@ void MemoryManager::SweepMemory()
 			++iter;
 		}
 		else {
-			// find meta start
+			// delete string or hash
+			if ( mark->type == STRING_TYPE ) {
+				delete static_cast< std::wstring* >( values->value.ptr_value );
+				values->value.ptr_value = NULL;
+			}
+			else if ( mark->type == HASH_TYPE ) {
+				delete static_cast< HashTable* >( values->value.ptr_value );
+				values->value.ptr_value = NULL;
+			}
+
+			// find meta start; arrays keep their dimensions ahead of the mark
+			Value* elements = values;
+			--values;
 			while ( values->type != META_TYPE ) {
 				--values;
 			}
+			bytes_freed += ObjectBytes( mark->type, elements - values + ElementCount( mark ) );
 			// delete mark
 			delete mark;
 			mark = NULL;
 
-			// delete string or hash
-			if ( values->type == STRING_TYPE || values->type == HASH_TYPE ) {
-				delete values->value.ptr_value;
-				values->value.ptr_value = NULL;
-			}
-
 			// delete value array
 			delete [] values;
 			values = NULL;
@@ -280,4 +385,7 @@ void MemoryManager::SweepMemory()
 			iter = allocated.erase( iter );
 		}
 	}
+	TRACE( TRACE_GC, TRACE_EVENTS, GC_SWEPT, objects_before - allocated.size(), bytes_freed, allocated.size() );
+
+	return bytes_freed;
 }
@@ -22,17 +22,20 @@ public:
 	bool is_marked;
 	size_t array_size;
 	ExecutableClass* klass;
+	RuntimeType type;
 
 	Mark( ExecutableClass* k ) {
 		is_marked = false;
 		klass = k;
 		array_size = 0;
+		type = CLS_TYPE;
 	}
 
-	Mark( size_t s ) {
+	Mark( size_t s, RuntimeType t = ARRAY_TYPE ) {
 		is_marked = false;
 		array_size = s;
 		klass = NULL;
+		type = t;
 	}
 
 	~Mark() {
@@ -43,9 +46,17 @@ class MemoryManager {
 	static MemoryManager* instance;
 	list<Value*> allocated;
 	std::set<Value*> marked;
+	std::unordered_map<ExecutableClass*, Mark*> frame_marks;
+	// operands of the running frame are roots too
+	Value* execution_stack;
+	size_t* execution_stack_pos;
+	// told of each allocation and collection, when asked to
+	HeapStats* stats;
+
+	static size_t ObjectBytes( RuntimeType type, size_t cells );
 
 public:
-	MemoryManager() {
+	MemoryManager(): execution_stack( nullptr ), execution_stack_pos( nullptr ), stats( nullptr ) {
 	}
 
 	~MemoryManager() {
@@ -63,13 +74,26 @@ public:
 
 	Value* AllocateString( Value* locals, const size_t local_size, Frame** call_stack, size_t call_stack_pos );
 	Value* AllocateHash( Value* locals, const size_t local_size, Frame** call_stack, size_t call_stack_pos );
-	Value* AllocateArray( INT_T array_size, vector<Value> &dimensions, Value* locals, const size_t local_size, Frame** call_stack, size_t call_stack_pos );
+	Value* AllocateArray( INT_T array_size, Value* dimensions, const int dimensions_size, Value* locals, const size_t local_size, Frame** call_stack, size_t call_stack_pos );
+	// without collecting first, for objects that aren't reachable from any root yet
+	Value* AllocateArray( INT_T array_size, Value* dimensions, const int dimensions_size );
 	Value* AllocateClass( ExecutableClass* klass, Value* locals, const size_t local_size, Frame** call_stack, size_t call_stack_pos );
+	Value* AllocateFunction( ExecutableFunction* function, size_t capture_count, Value* locals, const size_t local_size, Frame** call_stack, size_t call_stack_pos );
+	Mark* FrameMark( ExecutableClass* klass );
+
+	void SetExecutionStack( Value* stack, size_t* stack_pos ) {
+		execution_stack = stack;
+		execution_stack_pos = stack_pos;
+	}
+
+	// the objects already allocated are counted as held
+	void SetStats( HeapStats* stats );
 
 	void MarkMemory( Value* locals, const size_t local_size, Frame** call_stack, size_t call_stack_pos );
 	void MarkMemory( Value* values, RuntimeType type, int depth );
 
-	void SweepMemory();
+	// the bytes freed
+	size_t SweepMemory();
 };
 
 #endif
@@ -0,0 +1,650 @@
+/***************************************************************************
+ * Tree optimizer
+ *
+ * Copyright (c) 2017 Joshua Ogunyinka
+ * All rights reserved.
+*/
+
+#include <limits.h>
+#include "optimizer.h"
+
+using namespace compiler;
+
+/****************************
+ * The first walk folds and counts
+ * the stores to every variable; the
+ * second, at level 2, substitutes
+ * the variables stored once and
+ * folds what that exposes
+ ****************************/
+bool TreeOptimizer::Visit( ParsedProgram* program )
+{
+	arena = &program->GetArena();
+	propagate = false;
+	SimplifyBody( program->GetGlobalScope() );
+
+	if ( level > 1 ) {
+		propagate = true;
+		SimplifyBody( program->GetGlobalScope() );
+	}
+
+	return true;
+}
+
+Expression* TreeOptimizer::Fold( Expression* expression )
+{
+	return expression ? static_cast< Expression* >( Dispatch( expression ) ) : nullptr;
+}
+
+Statement* TreeOptimizer::Simplify( Statement* statement )
+{
+	return statement ? static_cast< Statement* >( Dispatch( statement ) ) : nullptr;
+}
+
+void TreeOptimizer::SimplifyScope( Scope* scope )
+{
+	for ( Statement* &statement : scope->GetStatements() ) {
+		statement = Simplify( statement );
+	}
+}
+
+/****************************
+ * The statements of a function or
+ * of the program. A variable set to
+ * a literal by one of them holds it
+ * from there on if nothing else
+ * stores to it: the statement isn't
+ * in a loop, and closures made later
+ * capture the literal too
+ ****************************/
+void TreeOptimizer::SimplifyBody( Scope* scope )
+{
+	std::unordered_map<Declaration*, Expression*> saved_constants;
+	saved_constants.swap( constants );
+
+	for ( Statement* &statement : scope->GetStatements() ) {
+		statement = Simplify( statement );
+		if ( !propagate ) {
+			continue;
+		}
+
+		if ( ExpressionStatement* expression_statement = NodeCast<ExpressionStatement>( statement ) ) {
+			AssignmentExpression* assignment = NodeCast<AssignmentExpression>( expression_statement->GetExpression() );
+			if ( assignment && assignment->GetAssignmentType() == ScannerTokenType::TOKEN_ASSIGN ) {
+				if ( Variable* variable = NodeCast<Variable>( assignment->GetLHSExpression() ) ) {
+					RecordConstant( variable->GetDeclaration(), assignment->GetRHSExpression() );
+				}
+			}
+		}
+		else if ( VariableDeclaration* decl = NodeCast<VariableDeclaration>( statement ) ) {
+			RecordConstant( decl, decl->GetExpression() );
+		}
+		else if ( DeclarationList* decl_list = NodeCast<DeclarationList>( statement ) ) {
+			for ( auto &list_decl : decl_list->GetDeclarations() ) {
+				if ( list_decl.second->GetStatementType() == StatementType::VARIABLE_DECL_STMT ) {
+					RecordConstant( list_decl.second, static_cast< VariableDeclaration* >( list_decl.second )->GetExpression() );
+				}
+			}
+		}
+	}
+
+	constants.swap( saved_constants );
+}
+
+void TreeOptimizer::RecordConstant( Declaration* decl, Expression* value )
+{
+	Value constant;
+	if ( !decl || decl->GetStatementType() != StatementType::VARIABLE_DECL_STMT || !IsConstant( value, constant ) ) {
+		return;
+	}
+
+	auto count = stores.find( decl );
+	if ( count != stores.end() && count->second == 1 && !fields.count( decl ) && !unresolved_stores.count( decl->GetName() ) ) {
+		constants[ decl ] = value;
+	}
+}
+
+// counted on the first walk only; names not resolved yet may be any variable of that name
+void TreeOptimizer::CountStore( Expression* target )
+{
+	Variable* variable = NodeCast<Variable>( target );
+	if ( propagate || !variable ) {
+		return;
+	}
+
+	if ( variable->GetDeclaration() ) {
+		stores[ variable->GetDeclaration() ]++;
+	}
+	else {
+		unresolved_stores.insert( variable->GetName() );
+	}
+}
+
+// only the indices of an assignment target are values
+void TreeOptimizer::FoldTarget( Expression* target )
+{
+	while ( true ) {
+		if ( SubscriptExpression* subscript = NodeCast<SubscriptExpression>( target ) ) {
+			subscript->SetIndex( Fold( subscript->GetIndex() ) );
+			target = subscript->GetExpression();
+		}
+		else if ( DotExpression* dot = NodeCast<DotExpression>( target ) ) {
+			target = dot->GetExpression();
+		}
+		else {
+			return;
+		}
+	}
+}
+
+/****************************
+ * Literals
+ ****************************/
+bool TreeOptimizer::IsConstant( Expression* expression, Value &value )
+{
+	if ( IntegerLiteral* integer = NodeCast<IntegerLiteral>( expression ) ) {
+		value.type = INT_TYPE;
+		value.value.int_value = integer->GetValue();
+	}
+	else if ( FloatLiteral* real = NodeCast<FloatLiteral>( expression ) ) {
+		value.type = FLOAT_TYPE;
+		value.value.float_value = real->GetValue();
+	}
+	else if ( BooleanLiteral* boolean = NodeCast<BooleanLiteral>( expression ) ) {
+		value.type = BOOL_TYPE;
+		value.value.int_value = boolean->GetValue() ? 1 : 0;
+	}
+	else {
+		return false;
+	}
+
+	return true;
+}
+
+Expression* TreeOptimizer::MakeLiteral( Value const &value, unsigned int line_number )
+{
+	switch ( value.type ) {
+	case INT_TYPE:
+		return arena->Make<IntegerLiteral>( line_number, value.value.int_value );
+
+	case FLOAT_TYPE:
+		return arena->Make<FloatLiteral>( line_number, value.value.float_value );
+
+	default:
+		return arena->Make<BooleanLiteral>( line_number, value.value.int_value != 0 );
+	}
+}
+
+/****************************
+ * Mirrors the operations of the
+ * integer, float and boolean classes;
+ * false where the runtime would
+ * report an error, which is left to
+ * happen at runtime
+ ****************************/
+bool TreeOptimizer::Evaluate( ScannerTokenType operation, Value const &left, Value const &right, Value &result )
+{
+	const bool is_bool = left.type == BOOL_TYPE;
+	const bool is_float = left.type == FLOAT_TYPE || right.type == FLOAT_TYPE;
+	if ( is_bool ) {
+		if ( right.type == FLOAT_TYPE ) {
+			return false;
+		}
+	}
+	else if ( right.type == BOOL_TYPE ) {
+		return false;
+	}
+
+	const INT_T l = left.value.int_value;
+	const INT_T r = right.value.int_value;
+	const FLOAT_T lf = left.type == FLOAT_TYPE ? left.value.float_value : static_cast< FLOAT_T >( l );
+	const FLOAT_T rf = right.type == FLOAT_TYPE ? right.value.float_value : static_cast< FLOAT_T >( r );
+
+	result.type = BOOL_TYPE;
+	switch ( operation ) {
+	case ScannerTokenType::TOKEN_EQL:
+		result.value.int_value = is_float ? lf == rf : l == r;
+		return true;
+
+	case ScannerTokenType::TOKEN_NEQL:
+		result.value.int_value = is_float ? lf != rf : l != r;
+		return true;
+
+	case ScannerTokenType::TOKEN_AND:
+	case ScannerTokenType::TOKEN_OR:
+		if ( is_float || ( is_bool && right.type != BOOL_TYPE ) ) {
+			return false;
+		}
+		result.type = is_bool ? BOOL_TYPE : INT_TYPE;
+		result.value.int_value = operation == ScannerTokenType::TOKEN_AND ? l & r : l | r;
+		return true;
+
+	default:
+		break;
+	}
+
+	if ( is_bool ) {
+		return false;
+	}
+
+	switch ( operation ) {
+	case ScannerTokenType::TOKEN_LES:
+		result.value.int_value = is_float ? lf < rf : l < r;
+		return true;
+
+	case ScannerTokenType::TOKEN_GTR:
+		result.value.int_value = is_float ? lf > rf : l > r;
+		return true;
+
+	case ScannerTokenType::TOKEN_LEQL:
+		result.value.int_value = is_float ? lf <= rf : l <= r;
+		return true;
+
+	case ScannerTokenType::TOKEN_GEQL:
+		result.value.int_value = is_float ? lf >= rf : l >= r;
+		return true;
+
+	default:
+		break;
+	}
+
+	result.type = is_float ? FLOAT_TYPE : INT_TYPE;
+	switch ( operation ) {
+	case ScannerTokenType::TOKEN_ADD:
+		if ( is_float ) {
+			result.value.float_value = lf + rf;
+		}
+		else {
+			result.value.int_value = static_cast< INT_T >( static_cast< unsigned long >( l ) + static_cast< unsigned long >( r ) );
+		}
+		return true;
+
+	case ScannerTokenType::TOKEN_SUB:
+		if ( is_float ) {
+			result.value.float_value = lf - rf;
+		}
+		else {
+			result.value.int_value = static_cast< INT_T >( static_cast< unsigned long >( l ) - static_cast< unsigned long >( r ) );
+		}
+		return true;
+
+	case ScannerTokenType::TOKEN_MUL:
+		if ( is_float ) {
+			result.value.float_value = lf * rf;
+		}
+		else {
+			result.value.int_value = static_cast< INT_T >( static_cast< unsigned long >( l ) * static_cast< unsigned long >( r ) );
+		}
+		return true;
+
+	case ScannerTokenType::TOKEN_DIV:
+		if ( is_float ) {
+			result.value.float_value = lf / rf;
+			return true;
+		}
+		if ( !r || ( l == LONG_MIN && r == -1 ) ) {
+			return false;
+		}
+		result.value.int_value = l / r;
+		return true;
+
+	case ScannerTokenType::TOKEN_MOD:
+		if ( is_float || !r || ( l == LONG_MIN && r == -1 ) ) {
+			return false;
+		}
+		result.value.int_value = l % r;
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+/****************************
+ * Statements; each returns the
+ * statement to put in its place
+ ****************************/
+ParseNode* TreeOptimizer::VisitStatement( Statement* statement )
+{
+	return statement;
+}
+
+ParseNode* TreeOptimizer::VisitExpressionStatement( ExpressionStatement* statement )
+{
+	statement->SetExpression( Fold( statement->GetExpression() ) );
+	return statement;
+}
+
+ParseNode* TreeOptimizer::VisitDumpStatement( DumpStatement* statement )
+{
+	statement->SetExpression( Fold( statement->GetExpression() ) );
+	return statement;
+}
+
+ParseNode* TreeOptimizer::VisitReturnStatement( ReturnStatement* statement )
+{
+	statement->SetExpression( Fold( statement->GetExpression() ) );
+	return statement;
+}
+
+ParseNode* TreeOptimizer::VisitCompoundStatement( CompoundStatement* statement )
+{
+	SimplifyScope( statement->GetScope() );
+	return statement;
+}
+
+ParseNode* TreeOptimizer::VisitIfStatement( IfStatement* statement )
+{
+	statement->SetExpression( Fold( statement->GetExpression() ) );
+	statement->SetIfBlock( Simplify( statement->GetIfBlock() ) );
+	statement->SetElseBlock( Simplify( statement->GetElseBlock() ) );
+
+	if ( BooleanLiteral* condition = NodeCast<BooleanLiteral>( statement->GetExpression() ) ) {
+		Statement* taken = condition->GetValue() ? statement->GetIfBlock() : statement->GetElseBlock();
+		return taken ? taken : arena->Make<EmptyStatement>( statement->GetLineNumber() );
+	}
+	return statement;
+}
+
+ParseNode* TreeOptimizer::VisitWhileStatement( WhileStatement* statement )
+{
+	statement->SetExpression( Fold( statement->GetExpression() ) );
+	statement->SetStatement( Simplify( statement->GetStatement() ) );
+
+	BooleanLiteral* condition = NodeCast<BooleanLiteral>( statement->GetExpression() );
+	if ( condition && !condition->GetValue() ) {
+		return arena->Make<EmptyStatement>( statement->GetLineNumber() );
+	}
+	return statement;
+}
+
+// the body runs once even if the condition is false, and may 'continue'
+ParseNode* TreeOptimizer::VisitDoWhileStatement( DoWhileStatement* statement )
+{
+	statement->SetStatement( Simplify( statement->GetStatement() ) );
+	statement->SetExpression( Fold( statement->GetExpression() ) );
+	return statement;
+}
+
+ParseNode* TreeOptimizer::VisitLoopStatement( LoopStatement* statement )
+{
+	SimplifyScope( statement->GetLoopBody()->GetScope() );
+	return statement;
+}
+
+ParseNode* TreeOptimizer::VisitForEachStatement( ForEachStatement* statement )
+{
+	if ( BinaryExpression* in_expression = NodeCast<BinaryExpression>( statement->GetExpression() ) ) {
+		in_expression->SetRHSExpression( Fold( in_expression->GetRHSExpression() ) );
+	}
+	Simplify( statement->GetStatement() );
+	return statement;
+}
+
+ParseNode* TreeOptimizer::VisitSwitchStatement( SwitchStatement* statement )
+{
+	statement->SetExpression( Fold( statement->GetExpression() ) );
+	Simplify( statement->GetSwitchBlock() );
+	return statement;
+}
+
+ParseNode* TreeOptimizer::VisitCaseStatement( CaseStatement* statement )
+{
+	statement->SetExpression( Fold( statement->GetExpression() ) );
+	statement->SetStatement( Simplify( statement->GetStatement() ) );
+	return statement;
+}
+
+ParseNode* TreeOptimizer::VisitLabelledStatement( LabelledStatement* statement )
+{
+	statement->SetStatement( Simplify( statement->GetStatement() ) );
+	return statement;
+}
+
+/****************************
+ * Declarations
+ ****************************/
+ParseNode* TreeOptimizer::VisitDeclarationList( DeclarationList* decl_list )
+{
+	for ( auto &list_decl : decl_list->GetDeclarations() ) {
+		Simplify( list_decl.second );
+	}
+	return decl_list;
+}
+
+ParseNode* TreeOptimizer::VisitVariableDeclaration( VariableDeclaration* decl )
+{
+	if ( decl->GetExpression() && !propagate ) {
+		stores[ decl ]++;
+	}
+	decl->SetExpression( Fold( decl->GetExpression() ) );
+	return decl;
+}
+
+ParseNode* TreeOptimizer::VisitFunctionDeclaration( FunctionDeclaration* decl )
+{
+	if ( decl->GetFunctionBody() ) {
+		SimplifyBody( decl->GetFunctionBody()->GetScope() );
+	}
+	return decl;
+}
+
+// initializers may run before any statement of the enclosing body
+ParseNode* TreeOptimizer::VisitClassDeclaration( ClassDeclaration* decl )
+{
+	std::unordered_map<Declaration*, Expression*> saved_constants;
+	saved_constants.swap( constants );
+
+	for ( Declaration* member : decl->GetDeclList() ) {
+		if ( member->GetStatementType() == StatementType::VARIABLE_DECL_STMT ) {
+			fields.insert( member );
+		}
+		else if ( DeclarationList* decl_list = NodeCast<DeclarationList>( static_cast< Statement* >( member ) ) ) {
+			for ( auto &list_decl : decl_list->GetDeclarations() ) {
+				fields.insert( list_decl.second );
+			}
+		}
+		Simplify( member );
+	}
+
+	constants.swap( saved_constants );
+	return decl;
+}
+
+/****************************
+ * Expressions; each returns the
+ * expression to put in its place
+ ****************************/
+ParseNode* TreeOptimizer::VisitExpression( Expression* expression )
+{
+	return expression;
+}
+
+ParseNode* TreeOptimizer::VisitVariable( Variable* expression )
+{
+	auto constant = constants.find( expression->GetDeclaration() );
+	Value value;
+	if ( constant != constants.end() && IsConstant( constant->second, value ) ) {
+		return MakeLiteral( value, expression->GetLineNumber() );
+	}
+	return expression;
+}
+
+ParseNode* TreeOptimizer::VisitBinaryExpression( BinaryExpression* expression )
+{
+	expression->SetLHSExpression( Fold( expression->GetLHSExpression() ) );
+	expression->SetRHSExpression( Fold( expression->GetRHSExpression() ) );
+
+	const ScannerTokenType operation = expression->GetToken().GetType();
+	Value left, right, result;
+	const bool is_left_constant = IsConstant( expression->GetLHSExpression(), left );
+	const bool is_right_constant = IsConstant( expression->GetRHSExpression(), right );
+
+	// a boolean on the left decides '&&' and '||' alone, or leaves the right operand if that's a boolean too
+	if ( operation == ScannerTokenType::TOKEN_LAND || operation == ScannerTokenType::TOKEN_LOR ) {
+		if ( !is_left_constant || left.type != BOOL_TYPE ) {
+			return expression;
+		}
+		if ( ( left.value.int_value != 0 ) == ( operation == ScannerTokenType::TOKEN_LOR ) ) {
+			return expression->GetLHSExpression();
+		}
+		return is_right_constant && right.type == BOOL_TYPE ? expression->GetRHSExpression() : expression;
+	}
+
+	if ( is_left_constant && is_right_constant && Evaluate( operation, left, right, result ) ) {
+		return MakeLiteral( result, expression->GetLineNumber() );
+	}
+	return expression;
+}
+
+ParseNode* TreeOptimizer::VisitAssignmentExpression( AssignmentExpression* expression )
+{
+	Expression* value = expression->GetRHSExpression();
+	expression->SetRHSExpression( Fold( value ) );
+	FoldTarget( expression->GetLHSExpression() );
+	CountStore( expression->GetLHSExpression() );
+
+	// an implicit declaration shares the value of the assignment that made it
+	if ( Variable* variable = NodeCast<Variable>( expression->GetLHSExpression() ) ) {
+		Declaration* decl = variable->GetDeclaration();
+		if ( decl && decl->GetStatementType() == StatementType::VARIABLE_DECL_STMT
+			&& static_cast< VariableDeclaration* >( decl )->GetExpression() == value ) {
+			static_cast< VariableDeclaration* >( decl )->SetExpression( expression->GetRHSExpression() );
+		}
+	}
+	return expression;
+}
+
+ParseNode* TreeOptimizer::VisitUnaryOperation( UnaryOperation* expression )
+{
+	expression->SetExpression( Fold( expression->GetExpression() ) );
+
+	Value value;
+	if ( !IsConstant( expression->GetExpression(), value ) ) {
+		return expression;
+	}
+
+	if ( expression->OperationType() == ScannerTokenType::TOKEN_NOT ) {
+		if ( value.type == BOOL_TYPE ) {
+			value.value.int_value = !value.value.int_value;
+			return MakeLiteral( value, expression->GetLineNumber() );
+		}
+	}
+	else if ( value.type == INT_TYPE ) {
+		value.value.int_value = static_cast< INT_T >( 0UL - static_cast< unsigned long >( value.value.int_value ) );
+		return MakeLiteral( value, expression->GetLineNumber() );
+	}
+	else if ( value.type == FLOAT_TYPE ) {
+		value.value.float_value = -value.value.float_value;
+		return MakeLiteral( value, expression->GetLineNumber() );
+	}
+	return expression;
+}
+
+ParseNode* TreeOptimizer::VisitConditionalExpression( ConditionalExpression* expression )
+{
+	expression->SetConditionalExpression( Fold( expression->GetConditionalExpression() ) );
+	expression->SetLhsExpression( Fold( expression->GetLhsExpression() ) );
+	expression->SetRhsExpression( Fold( expression->GetRhsExpression() ) );
+
+	if ( BooleanLiteral* condition = NodeCast<BooleanLiteral>( expression->GetConditionalExpression() ) ) {
+		return condition->GetValue() ? expression->GetLhsExpression() : expression->GetRhsExpression();
+	}
+	return expression;
+}
+
+// a named callee is resolved by the emitter and kept as it is
+ParseNode* TreeOptimizer::VisitFunctionCall( FunctionCall* expression )
+{
+	if ( ExpressionList* arguments = expression->GetArgumentList() ) {
+		for ( Expression* &argument : arguments->GetExpressions() ) {
+			argument = Fold( argument );
+		}
+	}
+
+	DotExpression* dot = NodeCast<DotExpression>( expression->GetFunctionExpression() );
+	if ( !dot ) {
+		return expression;
+	}
+	dot->SetExpression( Fold( dot->GetExpression() ) );
+
+	// Integer.abs()
+	IntegerLiteral* integer = NodeCast<IntegerLiteral>( dot->GetExpression() );
+	const bool has_arguments = expression->GetArgumentList() && expression->GetArgumentList()->Length();
+	if ( integer && !has_arguments && dot->GetIdentifier() == L"abs" && integer->GetValue() != LONG_MIN ) {
+		return arena->Make<IntegerLiteral>( expression->GetLineNumber(), labs( integer->GetValue() ) );
+	}
+	return expression;
+}
+
+ParseNode* TreeOptimizer::VisitSubscriptExpression( SubscriptExpression* expression )
+{
+	expression->SetExpression( Fold( expression->GetExpression() ) );
+	expression->SetIndex( Fold( expression->GetIndex() ) );
+	return expression;
+}
+
+ParseNode* TreeOptimizer::VisitDotExpression( DotExpression* expression )
+{
+	expression->SetExpression( Fold( expression->GetExpression() ) );
+	return expression;
+}
+
+ParseNode* TreeOptimizer::VisitPreIncrExpression( PreIncrExpression* expression )
+{
+	FoldTarget( expression->GetExpression() );
+	CountStore( expression->GetExpression() );
+	return expression;
+}
+
+ParseNode* TreeOptimizer::VisitPreDecrExpression( PreDecrExpression* expression )
+{
+	FoldTarget( expression->GetExpression() );
+	CountStore( expression->GetExpression() );
+	return expression;
+}
+
+ParseNode* TreeOptimizer::VisitPostIncrExpression( PostIncrExpression* expression )
+{
+	FoldTarget( expression->GetExpression() );
+	CountStore( expression->GetExpression() );
+	return expression;
+}
+
+ParseNode* TreeOptimizer::VisitPostDecrExpression( PostDecrExpression* expression )
+{
+	FoldTarget( expression->GetExpression() );
+	CountStore( expression->GetExpression() );
+	return expression;
+}
+
+ParseNode* TreeOptimizer::VisitLambdaExpression( LambdaExpression* expression )
+{
+	Simplify( expression->GetLambdaBody() );
+	return expression;
+}
+
+ParseNode* TreeOptimizer::VisitListExpression( ListExpression* expression )
+{
+	if ( ExpressionList* elements = expression->GetExpressionList() ) {
+		for ( Expression* &element : elements->GetExpressions() ) {
+			element = Fold( element );
+		}
+	}
+	return expression;
+}
+
+ParseNode* TreeOptimizer::VisitMapExpression( MapExpression* expression )
+{
+	for ( auto &pair : *expression ) {
+		pair.first = Fold( pair.first );
+		pair.second = Fold( pair.second );
+	}
+	return expression;
+}
+
+ParseNode* TreeOptimizer::VisitNewExpression( NewExpression* expression )
+{
+	expression->SetExpression( Fold( expression->GetExpression() ) );
+	return expression;
+}
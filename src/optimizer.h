@@ -0,0 +1,104 @@
+/***************************************************************************
+ * Tree optimizer
+ *
+ * Copyright (c) 2017 Joshua Ogunyinka
+ * All rights reserved.
+*/
+
+#ifndef __OPTIMIZER_H__
+#define __OPTIMIZER_H__
+
+#include <unordered_map>
+#include <unordered_set>
+
+#include "common.h"
+#include "visitor.h"
+
+/****************************
+ * Rewrites checked trees before
+ * they are emitted. Level 1 folds
+ * operators on literals and prunes
+ * 'if', 'while' and '?:' on constant
+ * conditions; level 2 also replaces
+ * reads of variables that are only
+ * ever set once, by a top-level
+ * statement of their function, to a
+ * literal. Nothing that could fail
+ * at runtime is folded
+ ****************************/
+
+namespace compiler {
+	class TreeOptimizer : public TreeVisitor<TreeOptimizer, ParseNode*>
+	{
+		friend class TreeVisitor<TreeOptimizer, ParseNode*>;
+
+		ParseArena* arena;
+		int level;
+		bool propagate;													// second walk: substitute 'constants'
+		std::unordered_map<Declaration*, int> stores;					// assignments to each variable
+		std::unordered_set<std::wstring> unresolved_stores;				// names assigned before their declaration
+		std::unordered_set<Declaration*> fields;
+		std::unordered_map<Declaration*, Expression*> constants;		// literal held by each variable of the body being walked
+
+		Expression* Fold( Expression* expression );
+		Statement* Simplify( Statement* statement );
+		void SimplifyScope( Scope* scope );
+		void SimplifyBody( Scope* scope );
+		void SimplifyDeclaration( VariableDeclaration* decl );
+		void FoldTarget( Expression* target );
+		void CountStore( Expression* target );
+		void RecordConstant( Declaration* decl, Expression* value );
+
+		static bool IsConstant( Expression* expression, Value &value );
+		Expression* MakeLiteral( Value const &value, unsigned int line_number );
+		static bool Evaluate( ScannerTokenType operation, Value const &left, Value const &right, Value &result );
+
+		// statements
+		ParseNode* VisitStatement( Statement* statement );
+		ParseNode* VisitExpressionStatement( ExpressionStatement* statement );
+		ParseNode* VisitDumpStatement( DumpStatement* statement );
+		ParseNode* VisitReturnStatement( ReturnStatement* statement );
+		ParseNode* VisitCompoundStatement( CompoundStatement* statement );
+		ParseNode* VisitIfStatement( IfStatement* statement );
+		ParseNode* VisitWhileStatement( WhileStatement* statement );
+		ParseNode* VisitDoWhileStatement( DoWhileStatement* statement );
+		ParseNode* VisitLoopStatement( LoopStatement* statement );
+		ParseNode* VisitForEachStatement( ForEachStatement* statement );
+		ParseNode* VisitSwitchStatement( SwitchStatement* statement );
+		ParseNode* VisitCaseStatement( CaseStatement* statement );
+		ParseNode* VisitLabelledStatement( LabelledStatement* statement );
+
+		// declarations
+		ParseNode* VisitDeclarationList( DeclarationList* decl_list );
+		ParseNode* VisitVariableDeclaration( VariableDeclaration* decl );
+		ParseNode* VisitFunctionDeclaration( FunctionDeclaration* decl );
+		ParseNode* VisitClassDeclaration( ClassDeclaration* decl );
+
+		// expressions
+		ParseNode* VisitExpression( Expression* expression );
+		ParseNode* VisitVariable( Variable* expression );
+		ParseNode* VisitBinaryExpression( BinaryExpression* expression );
+		ParseNode* VisitAssignmentExpression( AssignmentExpression* expression );
+		ParseNode* VisitUnaryOperation( UnaryOperation* expression );
+		ParseNode* VisitConditionalExpression( ConditionalExpression* expression );
+		ParseNode* VisitFunctionCall( FunctionCall* expression );
+		ParseNode* VisitSubscriptExpression( SubscriptExpression* expression );
+		ParseNode* VisitDotExpression( DotExpression* expression );
+		ParseNode* VisitPreIncrExpression( PreIncrExpression* expression );
+		ParseNode* VisitPreDecrExpression( PreDecrExpression* expression );
+		ParseNode* VisitPostIncrExpression( PostIncrExpression* expression );
+		ParseNode* VisitPostDecrExpression( PostDecrExpression* expression );
+		ParseNode* VisitLambdaExpression( LambdaExpression* expression );
+		ParseNode* VisitListExpression( ListExpression* expression );
+		ParseNode* VisitMapExpression( MapExpression* expression );
+		ParseNode* VisitNewExpression( NewExpression* expression );
+
+	public:
+		explicit TreeOptimizer( int level ) : arena( nullptr ), level( level ), propagate( false ) {
+		}
+
+		bool Visit( ParsedProgram* program );
+	};
+}
+
+#endif
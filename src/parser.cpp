@@ -6,10 +6,13 @@
  */
 
 #include <memory>
+#include <mutex>
 #include "parser.h"
 
 using namespace compiler;
 
+static std::mutex error_output_lock;
+
 /****************************
  * Loads parsing error codes
  ****************************/
@@ -41,10 +44,7 @@ void Parser::LoadErrorCodes()
 void Parser::ProcessError( ScannerTokenType type )
 {
 	wstring msg = error_msgs[ type ];
-#ifdef _DEBUG
-	wcout << L"\tError: " << GetFileName() << L":" << GetLineNumber() << L": "
-		<< msg << endl;
-#endif
+	TRACE( TRACE_PARSE, TRACE_EVENTS, PARSE_ERROR, msg, GetLineNumber() );
 
 	const wstring &str_line_num = ToString( GetLineNumber() );
 	errors.insert( { GetLineNumber(), GetFileName() + L":" + str_line_num + L": " + msg } );
@@ -55,9 +55,7 @@ void Parser::ProcessError( ScannerTokenType type )
  ****************************/
 void Parser::ProcessError( const wstring &msg )
 {
-#ifdef _DEBUG
-	wcout << L"\tError: " << GetFileName() << L":" << GetLineNumber() << L": " << msg << endl;
-#endif
+	TRACE( TRACE_PARSE, TRACE_EVENTS, PARSE_ERROR, msg, GetLineNumber() );
 
 	const wstring &str_line_num = ToString( GetLineNumber() );
 	errors.insert( { GetLineNumber(), GetFileName() + L":" + str_line_num + L": " + msg } );
@@ -68,10 +66,7 @@ void Parser::ProcessError( const wstring &msg )
  ****************************/
 void Parser::ProcessError( const wstring &msg, ScannerTokenType sync )
 {
-#ifdef _DEBUG
-	wcout << L"\tError: " << GetFileName() << L":" << GetLineNumber() << L": "
-		<< msg << endl;
-#endif
+	TRACE( TRACE_PARSE, TRACE_EVENTS, PARSE_ERROR, msg, GetLineNumber() );
 
 	const wstring &str_line_num = ToString( GetLineNumber() );
 	errors.insert( { GetLineNumber(), GetFileName() + L":" + str_line_num + L": " + msg } );
@@ -87,9 +82,7 @@ void Parser::ProcessError( const wstring &msg, ScannerTokenType sync )
  ****************************/
 void Parser::ProcessError( const wstring &msg, unsigned int const line_number )
 {
-#ifdef _DEBUG
-	wcout << L"\tError: " << GetFileName() << L":" << line_number << L": " << msg << endl;
-#endif
+	TRACE( TRACE_PARSE, TRACE_EVENTS, PARSE_ERROR, msg, line_number );
 
 	const wstring &str_line_num = ToString( line_number );
 	errors.insert( { line_number, GetFileName() + L":" + str_line_num + L": " + msg } );
@@ -103,8 +96,10 @@ bool Parser::NoErrors()
 {
 	// check and process errors
 	if ( errors.size() ) {
-		for ( size_t i = 0; i < errors.size(); i++ ) {
-			wcerr << errors[ i ] << endl;
+		// files may be parsed concurrently; keep each file's report in one piece
+		std::lock_guard<std::mutex> lock( error_output_lock );
+		for ( auto const & error : errors ) {
+			wcerr << error.second << endl;
 		}
 		// clean up
 		return false;
@@ -164,13 +159,12 @@ int Parser::GetTokenPrecedence()
  ****************************/
 std::unique_ptr<ParsedProgram> Parser::Parse()
 {
-#ifdef _DEBUG
-	std::wcout << L"\n========== Scanning/Parsing =========" << std::endl;
-#endif
-
 	NextToken();
 
-	std::unique_ptr<ParsedProgram> program{ new ParsedProgram };
+	std::unique_ptr<ParsedProgram> program{ shared_names ? new ParsedProgram( shared_names ) : new ParsedProgram };
+	program->SetFileName( GetFileName() );
+	arena = &program->GetArena();
+	names = &program->GetNames();
 	auto program_scope = ParseScope( program->GetGlobalScope() );
 	if ( !program_scope ){
 		return nullptr;
@@ -196,11 +190,10 @@ Declaration* Parser::ParseClass( Scope *parent_scope, AccessType access_type, St
 		return nullptr;
 	}
 
-#ifdef _DEBUG
-	std::wcout << L"Class: name='" + scanner->GetToken()->GetIdentifier() + L"'\n";
-#endif
+	TRACE( TRACE_PARSE, TRACE_EVENTS, PARSE_CLASS, CurrentToken().GetIdentifier(), line_num );
 
-	ClassDeclaration *klass = new ClassDeclaration( line_num, CurrentToken().GetIdentifier(), parent_scope, is_struct );
+	ClassDeclaration *klass = arena->Make<ClassDeclaration>( line_num, CurrentToken().GetIdentifier(),
+		arena->Make<Scope>( *arena, *names, parent_scope ), is_struct );
 	NextToken(); // consume class name
 
 	// we have a base/super class
@@ -217,8 +210,6 @@ Declaration* Parser::ParseClass( Scope *parent_scope, AccessType access_type, St
 
 	if ( !Match( ScannerTokenType::TOKEN_OPEN_BRACE ) ) {
 		ProcessError( ScannerTokenType::TOKEN_OPEN_BRACE );
-		delete klass;
-		klass = nullptr;
 
 		return nullptr;
 	}
@@ -226,17 +217,13 @@ Declaration* Parser::ParseClass( Scope *parent_scope, AccessType access_type, St
 	while ( !Match( ScannerTokenType::TOKEN_CLOSED_BRACE ) && !Match( ScannerTokenType::TOKEN_END_OF_STREAM ) ){
 		Declaration *decl = ParseDeclaration( parent_scope );
 		if ( !decl ){
-			delete klass;
-			klass = nullptr;
-			return klass;
+			return nullptr;
 		}
 		klass->AddStatement( decl );
 	}
 	if ( !Match( ScannerTokenType::TOKEN_CLOSED_BRACE ) ){
 		ProcessError( L"Expected a closing brace at the end of class declaration." );
-		delete klass;
-		klass = nullptr;
-		return klass; // klass is nullptr
+		return nullptr;
 	}
 	NextToken(); // consume '}'
 	klass->SetStorageType( storage_type );
@@ -286,9 +273,7 @@ Declaration* Parser::ParseFunction( Scope *parent_scope, FunctionType function_t
 	std::wstring const function_name = scanner->GetToken()->GetIdentifier();
 	NextToken();
 
-#ifdef _DEBUG
-	std::wcout << stype + L": name='" + function_name + L"'\n";
-#endif
+	TRACE( TRACE_PARSE, TRACE_EVENTS, PARSE_FUNCTION, stype + L" " + function_name, GetLineNumber() );
 
 	ExpressionList* parameters{};
 
@@ -298,13 +283,11 @@ Declaration* Parser::ParseFunction( Scope *parent_scope, FunctionType function_t
 	}
 	NextToken(); // consume '('
 	if ( !Match( ScannerTokenType::TOKEN_CLOSED_PAREN ) ){
-		parameters = new ExpressionList( line_num );
+		parameters = arena->Make<ExpressionList>( *arena, line_num );
 	}
 	while ( !Match( ScannerTokenType::TOKEN_END_OF_STREAM ) && !Match( ScannerTokenType::TOKEN_CLOSED_PAREN ) ){
 		Expression* expr{ ParseExpression() };
 		if ( !expr ){
-			delete parameters;
-			parameters = nullptr;
 
 			ProcessError( L"Could not process parameters to functions." );
 			return nullptr;
@@ -320,9 +303,6 @@ Declaration* Parser::ParseFunction( Scope *parent_scope, FunctionType function_t
 	if ( !Match( ScannerTokenType::TOKEN_CLOSED_PAREN ) ){
 		ProcessError( ScannerTokenType::TOKEN_CLOSED_PAREN );
 
-		delete parameters;
-		parameters = nullptr;
-
 		return nullptr;
 	}
 	NextToken(); // consume ')'
@@ -330,14 +310,12 @@ Declaration* Parser::ParseFunction( Scope *parent_scope, FunctionType function_t
 	// let's parse the function body
 	CompoundStatement* function_body = ParseCompoundStatement( parent_scope, ScopeType::FUNCTION_SCOPE );
 	if ( !function_body ){
-		delete parameters;
-		parameters = nullptr;
 
 		return nullptr;
 	}
 
 	function_body->GetScope()->SetScopeType( ScopeType::FUNCTION_SCOPE );
-	FunctionDeclaration* function{ new FunctionDeclaration( line_num, function_name, std::move( parameters ) ) };
+	FunctionDeclaration* function{ arena->Make<FunctionDeclaration>( line_num, function_name, std::move( parameters ) ) };
 	function->SetFunctionBody( function_body );
 	function->SetFunctionType( function_type );
 	function->SetAccess( access );
@@ -360,24 +338,20 @@ CompoundStatement* Parser::ParseCompoundStatement( Scope *parent, ScopeType scop
 	if ( !Match( ScannerTokenType::TOKEN_CLOSED_BRACE ) ){
 		ProcessError( ScannerTokenType::TOKEN_CLOSED_BRACE );
 
-		delete statement_scope;
-		statement_scope = nullptr;
 		return nullptr;
 	}
 	NextToken(); // consume '}'
 
-	return new CompoundStatement( line_num, statement_scope );
+	return arena->Make<CompoundStatement>( line_num, statement_scope );
 }
 
 Scope* Parser::ParseScope( Scope *parent_scope )
 {
-	Scope* scope{ new Scope( parent_scope ) };
+	Scope* scope{ arena->Make<Scope>( *arena, *names, parent_scope ) };
 	while ( !Match( ScannerTokenType::TOKEN_END_OF_STREAM ) && !Match( ScannerTokenType::TOKEN_CLOSED_BRACE ) ) {
 		Statement* statement = ParseStatement( parent_scope );
 		if ( !statement ) {
-			delete scope;
-			scope = nullptr;
-			return scope;
+			return nullptr;
 		}
 		scope->AddStatement( statement );
 	}
@@ -462,13 +436,10 @@ Statement* Parser::ParseShowStatement( Scope *parent_scope )
 	if ( !Match( ScannerTokenType::TOKEN_SEMI_COLON ) ){
 		ProcessError( ScannerTokenType::TOKEN_SEMI_COLON );
 
-		delete expr;
-		expr = nullptr;
-
 		return nullptr;
 	}
 	NextToken(); // consume ';'
-	return TreeFactory::MakeShowExpressionStatement( tok, expr );
+	return TreeFactory::MakeShowExpressionStatement( *arena, tok, expr );
 }
 
 Statement* Parser::ParseIfStatement( Scope *parent_scope )
@@ -492,8 +463,6 @@ Statement* Parser::ParseIfStatement( Scope *parent_scope )
 	if ( !Match( ScannerTokenType::TOKEN_CLOSED_PAREN ) ) {
 		ProcessError( ScannerTokenType::TOKEN_CLOSED_PAREN );
 
-		delete logical_expression;
-		logical_expression = nullptr;
 		return nullptr;
 	}
 	NextToken();
@@ -503,9 +472,6 @@ Statement* Parser::ParseIfStatement( Scope *parent_scope )
 	if ( !then_statement ){
 		ProcessError( L"Unable to parse the statement in the IF statement." );
 
-		delete logical_expression;
-		logical_expression = nullptr;
-
 		return  nullptr;
 	}
 	// let's see if there's an else part
@@ -517,16 +483,11 @@ Statement* Parser::ParseIfStatement( Scope *parent_scope )
 		if ( !else_statement ){
 			ProcessError( L"Error while processing the else part of the if statement." );
 
-			delete logical_expression;
-			delete then_statement;
-			logical_expression = nullptr;
-			then_statement = nullptr;
-
 			return nullptr;
 		}
 	}
 
-	IfStatement* if_statement{ new IfStatement( line_num, logical_expression, then_statement, else_statement ) };
+	IfStatement* if_statement{ arena->Make<IfStatement>( line_num, logical_expression, then_statement, else_statement ) };
 	return if_statement;
 }
 
@@ -542,7 +503,7 @@ Statement* Parser::ParseIterationStatement( Scope *parent_scope )
 		NextToken(); // consume 'loop'
 		CompoundStatement* loop_body{ ParseCompoundStatement( parent_scope, ScopeType::TEMP_SCOPE ) };
 		if ( !loop_body ) return nullptr;
-		return new LoopStatement( token.GetLineNumber(), loop_body );
+		return arena->Make<LoopStatement>( token.GetLineNumber(), loop_body );
 	}
 	else if ( tk == ScannerTokenType::TOKEN_DO_ID ){
 		NextToken(); // consume 'do'
@@ -550,40 +511,28 @@ Statement* Parser::ParseIterationStatement( Scope *parent_scope )
 		if ( !Match( ScannerTokenType::TOKEN_WHILE_ID ) ){
 			ProcessError( ScannerTokenType::TOKEN_WHILE_ID );
 
-			delete do_body;
-			do_body = nullptr;
 			return nullptr;
 		}
 		NextToken(); // consume token 'while'
 		if ( !Match( ScannerTokenType::TOKEN_OPEN_PAREN ) ){
 			ProcessError( L"Expected an open parenthesis after the `while` keyword" );
 
-			delete do_body;
-			do_body = nullptr;
 			return nullptr;
 		}
 		NextToken(); // consume '('
 		Expression* expression{ ParseExpression() };
 		if ( !Match( ScannerTokenType::TOKEN_CLOSED_PAREN ) ){
-			delete expression;
-			delete do_body;
-			expression = nullptr;
-			do_body = nullptr;
 			ProcessError( L"Expected a closing parenthesis after the expression" );
 			return nullptr;
 		}
 		NextToken(); // consume ')'
 		if ( !Match( ScannerTokenType::TOKEN_SEMI_COLON ) ){
 			ProcessError( L"Expected a semi-colon after the closing parenthesis" );
-			delete expression;
-			delete do_body;
-			expression = nullptr;
-			do_body = nullptr;
 
 			return nullptr;
 		}
 		NextToken(); // consume ';'
-		return new DoWhileStatement( line_num, do_body, expression );
+		return arena->Make<DoWhileStatement>( line_num, do_body, expression );
 	}
 	else if ( tk == ScannerTokenType::TOKEN_WHILE_ID ){
 		NextToken(); // consume 'while'
@@ -595,17 +544,13 @@ Statement* Parser::ParseIterationStatement( Scope *parent_scope )
 		Expression* expression{ ParseExpression() };
 		if ( !Match( ScannerTokenType::TOKEN_CLOSED_PAREN ) ){
 			ProcessError( ScannerTokenType::TOKEN_CLOSED_PAREN );
-			delete expression;
-			expression = nullptr;
 			return nullptr;
 		}
 		NextToken(); //consume ')'
 		Statement* statement{ ParseCompoundStatement( parent_scope, ScopeType::TEMP_SCOPE ) };
 		if ( expression && statement ){
-			return new WhileStatement( line_num, expression, statement );
+			return arena->Make<WhileStatement>( line_num, expression, statement );
 		}
-		delete expression;
-		expression = nullptr;
 		return nullptr;
 	}
 	// for_each statement, MAY be written( note the space ) as for each( ... ) or foreach( ... )
@@ -625,14 +570,9 @@ Statement* Parser::ParseIterationStatement( Scope *parent_scope )
 	Statement* for_each_body_statement{ ParseCompoundStatement( parent_scope, ScopeType::TEMP_SCOPE ) };
 
 	if ( for_each_expr && for_each_body_statement ){
-		return new ForEachStatement( line_num, for_each_expr, for_each_body_statement );
+		return arena->Make<ForEachStatement>( line_num, for_each_expr, for_each_body_statement );
 	}
 
-	delete for_each_expr;
-	delete for_each_body_statement;
-	for_each_expr = nullptr;
-	for_each_body_statement = nullptr;
-
 	return nullptr;
 }
 
@@ -658,18 +598,14 @@ Statement* Parser::ParseLabelledStatement( Scope *parent )
 		}
 		if ( !Match( ScannerTokenType::TOKEN_COLON ) ){
 			ProcessError( ScannerTokenType::TOKEN_COLON );
-			delete expr;
-			expr = nullptr;
 			return nullptr;
 		}
 		NextToken(); // consume ':'
 		Statement* statement{ ParseStatement( parent ) };
 		if ( !statement ){
-			delete expr;
-			expr = nullptr;
 			return nullptr;
 		}
-		return new CaseStatement( tok.GetLineNumber(), expr, statement );
+		return arena->Make<CaseStatement>( tok.GetLineNumber(), expr, statement );
 	}
 	default:
 		ProcessError( L"Identifier allowed in this scope is 'else' and 'case'" );
@@ -679,7 +615,7 @@ Statement* Parser::ParseLabelledStatement( Scope *parent )
 	if ( !statement ){
 		return nullptr;
 	}
-	return new LabelledStatement( tok.GetLineNumber(), tok.GetIdentifier(), statement );
+	return arena->Make<LabelledStatement>( tok.GetLineNumber(), tok.GetIdentifier(), statement );
 }
 
 Statement* Parser::ParseSwitchStatement( Scope *parent_scope )
@@ -696,17 +632,14 @@ Statement* Parser::ParseSwitchStatement( Scope *parent_scope )
 
 	if ( !Match( ScannerTokenType::TOKEN_CLOSED_PAREN ) ){
 		ProcessError( ScannerTokenType::TOKEN_CLOSED_PAREN );
-		delete switch_expression;
-		switch_expression = nullptr;
 		return nullptr;
 	}
 	NextToken(); // consume ')'
 	Statement* switch_body{ ParseCompoundStatement( parent_scope, ScopeType::TEMP_SCOPE ) };
 	if ( !switch_body ) {
-		delete switch_expression;
 		return nullptr;
 	}
-	return new SwitchStatement( tok.GetLineNumber(), switch_expression, switch_body );
+	return arena->Make<SwitchStatement>( tok.GetLineNumber(), switch_expression, switch_body );
 }
 
 Statement* Parser::ParseJumpStatement( Scope *parent )
@@ -720,7 +653,7 @@ Statement* Parser::ParseJumpStatement( Scope *parent )
 			return nullptr;
 		}
 		NextToken(); // consume ';'
-		return TreeFactory::MakeContinueStatement( tok.GetLineNumber() );
+		return TreeFactory::MakeContinueStatement( *arena, tok.GetLineNumber() );
 	case ScannerTokenType::TOKEN_BREAK_ID:
 		NextToken(); // consume 'break'
 		if ( !Match( ScannerTokenType::TOKEN_SEMI_COLON ) ){
@@ -728,7 +661,7 @@ Statement* Parser::ParseJumpStatement( Scope *parent )
 			return nullptr;
 		}
 		NextToken(); // consume ';'
-		return TreeFactory::MakeBreakStatement( tok.GetLineNumber() );
+		return TreeFactory::MakeBreakStatement( *arena, tok.GetLineNumber() );
 	case ScannerTokenType::TOKEN_RETURN_ID:
 	{
 		NextToken(); // consume 'return'
@@ -738,12 +671,10 @@ Statement* Parser::ParseJumpStatement( Scope *parent )
 		}
 		if ( !Match( ScannerTokenType::TOKEN_SEMI_COLON ) ){
 			ProcessError( ScannerTokenType::TOKEN_SEMI_COLON );
-			delete expression;
-			expression = nullptr;
 			return nullptr;
 		}
 		NextToken(); // consume ';'
-		return TreeFactory::MakeReturnStatement( tok.GetLineNumber(), expression );
+		return TreeFactory::MakeReturnStatement( *arena, tok.GetLineNumber(), expression );
 	}
 	default:
 		ProcessError( L"Unexpected statement" );
@@ -758,12 +689,10 @@ Statement* Parser::ParseExpressionStatement()
 
 	if ( !Match( ScannerTokenType::TOKEN_SEMI_COLON ) ){
 		ProcessError( ScannerTokenType::TOKEN_SEMI_COLON );
-		delete expression;
-		expression = nullptr;
 		return nullptr;
 	}
 	NextToken(); // consume ';'
-	return TreeFactory::MakeExpressionStatement( tok.GetLineNumber(), expression );
+	return TreeFactory::MakeExpressionStatement( *arena, tok.GetLineNumber(), expression );
 }
 
 Expression* Parser::ParseExpression()
@@ -784,7 +713,7 @@ Expression* Parser::ParseAssignmentExpression()
 	{
 		auto const tok = CurrentToken();
 		NextToken();
-		return TreeFactory::MakeAssignmentExpression( tok, expr, ParseAssignmentExpression() );
+		return TreeFactory::MakeAssignmentExpression( *arena, tok, expr, ParseAssignmentExpression() );
 	}
 	default:;
 	}
@@ -805,23 +734,13 @@ Expression*	Parser::ParseConditionalExpression()
 		if ( !Match( ScannerTokenType::TOKEN_COLON ) ){
 			ProcessError( ScannerTokenType::TOKEN_COLON );
 
-			delete expression;
-			delete lhs_expression;
-			expression = nullptr;
-			lhs_expression = nullptr;
 			return nullptr;
 		}
 		NextToken(); // consume ':'
 		Expression* rhs_expression{ ParseExpression() };
 		if ( lhs_expression && rhs_expression ){
-			return new ConditionalExpression( tok.GetLineNumber(), expression, lhs_expression, rhs_expression );
+			return arena->Make<ConditionalExpression>( tok.GetLineNumber(), expression, lhs_expression, rhs_expression );
 		}
-		delete expression;
-		delete lhs_expression;
-		delete rhs_expression;
-		expression = nullptr;
-		lhs_expression = nullptr;
-		rhs_expression = nullptr;
 		return nullptr;
 	}
 	return expression;
@@ -842,37 +761,19 @@ Expression* Parser::ParseDictionaryExpression()
 		return nullptr;
 	}
 
-	auto clear_vector = [] ( std::vector<MapExpression::expression_ptr_pair_t> & vec ){
-		if ( !vec.empty() ){
-			for ( MapExpression::expression_ptr_pair_t &key_value : vec ){
-				delete key_value.first;
-				delete key_value.second;
-				key_value.first = nullptr;
-				key_value.second = nullptr;
-			}
-		}
-	};
 	Token const token = CurrentToken();
 	NextToken(); // consume '{'
-	std::vector<MapExpression::expression_ptr_pair_t> key_datum_list{};
+	MapExpression::expression_pair_list_t key_datum_list{ ArenaAllocator<MapExpression::expression_ptr_pair_t>( *arena ) };
 	while ( !Match( ScannerTokenType::TOKEN_END_OF_STREAM ) && !Match( ScannerTokenType::TOKEN_CLOSED_BRACE ) ){
 		auto key_expression = ParseExpression();
 		if ( !Match( ScannerTokenType::TOKEN_COLON ) ){
 			ProcessError( L"Expects a colon as a map separator" );
-			delete key_expression;
-			key_expression = nullptr;
-			clear_vector( key_datum_list );
 			return nullptr;
 		}
 		NextToken(); // consume ':'
 		auto value_expression = ParseExpression();
 		if ( !( key_expression && value_expression ) ){
 			ProcessError( L"Unable to parse key/value expression for map" );
-			delete key_expression;
-			delete value_expression;
-			key_expression = nullptr;
-			value_expression = nullptr;
-			clear_vector( key_datum_list );
 			return nullptr;
 		}
 		key_datum_list.push_back( { std::move( key_expression ), std::move( value_expression ) } );
@@ -884,7 +785,7 @@ Expression* Parser::ParseDictionaryExpression()
 		ProcessError( L"Expected a closing brace before expression", CurrentToken().GetType() );
 	}
 	NextToken(); // consume '}' preferably or any encounterred token
-	return TreeFactory::MakeMapExpression( token, std::move( key_datum_list ) );
+	return TreeFactory::MakeMapExpression( *arena, token, std::move( key_datum_list ) );
 }
 
 Expression* Parser::ParseListExpression()
@@ -897,7 +798,7 @@ Expression* Parser::ParseListExpression()
 	NextToken(); // consume '['
 	ExpressionList* list_params{};
 	if ( !Match( ScannerTokenType::TOKEN_CLOSED_BRACKET ) ){
-		list_params = new ExpressionList( CurrentToken().GetLineNumber() );
+		list_params = arena->Make<ExpressionList>( *arena, CurrentToken().GetLineNumber() );
 	}
 	while ( !Match( ScannerTokenType::TOKEN_END_OF_STREAM ) && !Match( ScannerTokenType::TOKEN_CLOSED_BRACKET ) ){
 		list_params->AddExpression( ParseExpression() );
@@ -906,14 +807,10 @@ Expression* Parser::ParseListExpression()
 	}
 	if ( !Match( ScannerTokenType::TOKEN_CLOSED_BRACKET ) ){
 		ProcessError( ScannerTokenType::TOKEN_CLOSED_BRACKET );
-		if ( list_params ){
-			delete list_params;
-			list_params = nullptr;
-		}
 		return nullptr;
 	}
 	NextToken(); // consume ']'
-	return TreeFactory::MakeListExpression( tok, list_params );
+	return TreeFactory::MakeListExpression( *arena, tok, list_params );
 }
 
 Expression* Parser::ParseUnaryExpression()
@@ -922,14 +819,14 @@ Expression* Parser::ParseUnaryExpression()
 	switch ( token.GetType() ){
 	case ScannerTokenType::TOKEN_INCR:
 		NextToken(); // consume ++
-		return TreeFactory::MakePreIncrExpression( token, ParseUnaryExpression() );
+		return TreeFactory::MakePreIncrExpression( *arena, token, ParseUnaryExpression() );
 	case ScannerTokenType::TOKEN_DECR:
 		NextToken(); // consume --
-		return TreeFactory::MakePreDecrExpression( token, ParseUnaryExpression() );
+		return TreeFactory::MakePreDecrExpression( *arena, token, ParseUnaryExpression() );
 	case ScannerTokenType::TOKEN_NOT:
 	case ScannerTokenType::TOKEN_SUB:
 		NextToken(); // consume operator not '!' or unary minus '-'
-		return TreeFactory::MakeUnaryOperation( token, ParseUnaryExpression() );
+		return TreeFactory::MakeUnaryOperation( *arena, token, ParseUnaryExpression() );
 	default:;
 	}
 
@@ -944,32 +841,32 @@ Expression* Parser::ParsePrimaryExpression()
 	case ScannerTokenType::TOKEN_NEW:
 	{
 		NextToken();
-		return TreeFactory::MakeNewExpression( tok, ParseExpression() );
+		return TreeFactory::MakeNewExpression( *arena, tok, ParseExpression() );
 	}
 	case ScannerTokenType::TOKEN_NULL:
 		NextToken();
-		return TreeFactory::MakeNullLitExpression( tok );
+		return TreeFactory::MakeNullLitExpression( *arena, tok );
 	case ScannerTokenType::TOKEN_IDENT:
 		NextToken();
-		return TreeFactory::MakeVariable( tok );
+		return TreeFactory::MakeVariable( *arena, tok );
 	case ScannerTokenType::TOKEN_INT_LIT:
 		NextToken();
-		return TreeFactory::MakeIntegerLiteral( tok );
+		return TreeFactory::MakeIntegerLiteral( *arena, tok );
 	case ScannerTokenType::TOKEN_FLOAT_LIT:
 		NextToken();
-		return TreeFactory::MakeFloatLiteral( tok );
+		return TreeFactory::MakeFloatLiteral( *arena, tok );
 
 	case ScannerTokenType::TOKEN_CHAR_STRING_LIT:
 		NextToken();
-		return TreeFactory::MakeStringLiteral( tok );
+		return TreeFactory::MakeStringLiteral( *arena, tok );
 
 	case ScannerTokenType::TOKEN_CHAR_LIT:
 		NextToken();
-		return TreeFactory::MakeCharLiteral( tok );
+		return TreeFactory::MakeCharLiteral( *arena, tok );
 	case ScannerTokenType::TOKEN_TRUE_LIT:
 	case ScannerTokenType::TOKEN_FALSE_LIT:
 		NextToken();
-		return TreeFactory::MakeBooleanLiteral( tok );
+		return TreeFactory::MakeBooleanLiteral( *arena, tok );
 	case ScannerTokenType::TOKEN_AT:
 		return ParseLambdaExpression();
 	case ScannerTokenType::TOKEN_OPEN_BRACE:
@@ -982,8 +879,6 @@ Expression* Parser::ParsePrimaryExpression()
 		Expression* expr{ ParseExpression() };
 		if ( !Match( ScannerTokenType::TOKEN_CLOSED_PAREN ) ){
 			ProcessError( L"Expected a closing parenthesis before", scanner->GetToken( SECOND_INDEX )->GetType() );
-			delete expr;
-			expr = nullptr;
 			return nullptr;
 		}
 		NextToken(); // consume ')'
@@ -999,12 +894,10 @@ ExpressionList* Parser::ParseArgumentExpressionList()
 {
 	ExpressionList* argList{};
 	if ( !Match( ScannerTokenType::TOKEN_CLOSED_PAREN ) ){
-		argList = new ExpressionList( CurrentToken().GetLineNumber() );
+		argList = arena->Make<ExpressionList>( *arena, CurrentToken().GetLineNumber() );
 		while ( !Match( ScannerTokenType::TOKEN_CLOSED_PAREN ) ){
 			Expression* expr{ ParseAssignmentExpression() };
 			if ( !expr ) {
-				delete argList;
-				argList = nullptr;
 
 				return nullptr;
 			}
@@ -1030,7 +923,7 @@ Expression* Parser::ParseLambdaExpression()
 	if ( Match( ScannerTokenType::TOKEN_OPEN_PAREN ) ){
 		NextToken(); // consume '('
 		if ( !Match( ScannerTokenType::TOKEN_CLOSED_PAREN ) ){
-			lambda_parameters = new ExpressionList( token.GetLineNumber() );
+			lambda_parameters = arena->Make<ExpressionList>( *arena, token.GetLineNumber() );
 		}
 		while ( !Match( ScannerTokenType::TOKEN_END_OF_STREAM ) && !Match( ScannerTokenType::TOKEN_CLOSED_PAREN ) ){
 			lambda_parameters->AddExpression( ParseExpression() );
@@ -1043,7 +936,7 @@ Expression* Parser::ParseLambdaExpression()
 		NextToken(); // consume ')'
 	}
 
-	return new LambdaExpression( token, lambda_parameters, ParseCompoundStatement( nullptr, ScopeType::TEMP_SCOPE ) );
+	return arena->Make<LambdaExpression>( token, lambda_parameters, ParseCompoundStatement( nullptr, ScopeType::TEMP_SCOPE ) );
 }
 
 Expression* Parser::ParsePostfixExpression()
@@ -1061,15 +954,11 @@ Expression* Parser::ParsePostfixExpression()
 			ExpressionList* argExprList{ ParseArgumentExpressionList() };
 			if ( !Match( ScannerTokenType::TOKEN_CLOSED_PAREN ) ) {
 				ProcessError( L"Expects a closing parenthesis before the next token." );
-				delete expr;
-				delete argExprList;
-				expr = nullptr;
-				argExprList = nullptr;
 				return nullptr;
 			}
 			NextToken(); // consume ')'
 
-			expr = new FunctionCall( token.GetLineNumber(), expr, argExprList );
+			expr = arena->Make<FunctionCall>( token.GetLineNumber(), expr, argExprList );
 			break;
 		}
 		case ScannerTokenType::TOKEN_OPEN_BRACKET: // array subscript
@@ -1078,12 +967,10 @@ Expression* Parser::ParsePostfixExpression()
 			Expression* subscript_expression{ ParseExpression() };
 			if ( !Match( ScannerTokenType::TOKEN_CLOSED_BRACKET ) ){
 				ProcessError( ScannerTokenType::TOKEN_CLOSED_BRACKET );
-				delete expr;
-				expr = nullptr;
 				return nullptr;
 			}
 			NextToken(); // consume ']'
-			expr = new SubscriptExpression( CurrentToken().GetLineNumber(), expr, subscript_expression );
+			expr = arena->Make<SubscriptExpression>( CurrentToken().GetLineNumber(), expr, subscript_expression );
 			break;
 		}
 		case ScannerTokenType::TOKEN_PERIOD:
@@ -1092,26 +979,24 @@ Expression* Parser::ParsePostfixExpression()
 			Token const curr_token = CurrentToken();
 			if ( !Match( ScannerTokenType::TOKEN_IDENT ) ){
 				ProcessError( L"Expected an identifier after the dot operator." );
-				delete expr;
-				expr = nullptr;
 				return nullptr;
 			}
 			NextToken(); // consume identifier
-			expr = new DotExpression( curr_token.GetLineNumber(), curr_token, expr );
+			expr = arena->Make<DotExpression>( curr_token.GetLineNumber(), curr_token, expr );
 			break;
 		}
 		case ScannerTokenType::TOKEN_INCR:
 		{
 			NextToken(); // consume '++'
 			auto curr_token = CurrentToken();
-			expr = new PostIncrExpression( curr_token.GetLineNumber(), expr );
+			expr = arena->Make<PostIncrExpression>( curr_token.GetLineNumber(), expr );
 			break;
 		}
 		case ScannerTokenType::TOKEN_DECR:
 		{
 			NextToken(); // consume '--'
 			auto curr_token = CurrentToken();
-			expr = new PostDecrExpression( curr_token.GetLineNumber(), expr );
+			expr = arena->Make<PostDecrExpression>( curr_token.GetLineNumber(), expr );
 			break;
 		}
 		default:
@@ -1138,7 +1023,7 @@ Expression* Parser::ParseBinaryOpExpression( int const precedence, Expression* u
 		if ( currentPrecedence < nextPrecedence ){
 			second_expr = ParseBinaryOpExpression( currentPrecedence + 1, second_expr );
 		}
-		unary_expr = new BinaryExpression( tok, unary_expr, second_expr );
+		unary_expr = arena->Make<BinaryExpression>( tok, unary_expr, second_expr );
 	}
 }
 
@@ -1203,23 +1088,12 @@ Declaration* Parser::ParseVariableDeclaration( Scope *parent_scope, AccessType a
 	bool const is_const = CurrentToken().GetType() == ScannerTokenType::TOKEN_CONST_ID;
 	Token const token = CurrentToken();
 	NextToken(); // consume 'var' or 'const'
-	DeclarationList::declaration_list_t decl_list{};
-#ifdef _DEBUG
-	std::wcout << L"\n===========Declaration of variable==============\n\t" << std::endl;
-#endif
-
-	auto clear_list = [] ( DeclarationList::declaration_list_t & list ){
-		for ( auto &element : list ){
-			delete element.second;
-			element.second = nullptr;
-		}
-		list.clear();
-	};
+	DeclarationList::declaration_list_t decl_list{ ArenaAllocator<DeclarationList::declaration_list_t::value_type>( *arena ) };
+
 	do {
 		if ( !Match( ScannerTokenType::TOKEN_IDENT ) ){
 			ProcessError( L"expected an valid identifier" );
-			clear_list( decl_list );
-			return nullptr;
+				return nullptr;
 		}
 		Token curr_token = CurrentToken();
 
@@ -1230,39 +1104,32 @@ Declaration* Parser::ParseVariableDeclaration( Scope *parent_scope, AccessType a
 			NextToken(); // consume '='
 			assignment_expr = ParseExpression();
 			if ( !assignment_expr ){
-				clear_list( decl_list );
-				return nullptr;
+						return nullptr;
 			}
 		}
 
-		VariableDeclaration* decl{ new VariableDeclaration( curr_token.GetLineNumber(),
+		VariableDeclaration* decl{ arena->Make<VariableDeclaration>( curr_token.GetLineNumber(),
 			curr_token.GetIdentifier(), assignment_expr, is_const ) };
 		decl->SetAccessType( access_type );
 		decl->SetStorageType( storage_type );
-#ifdef _DEBUG
-		std::wcout << curr_token.GetIdentifier() << ", " << std::endl;
-#endif
+		TRACE( TRACE_PARSE, TRACE_ALL, PARSE_VARIABLE, curr_token.GetIdentifier(), curr_token.GetLineNumber() );
 
-		decl_list.insert( { curr_token.GetIdentifier(), decl } );
+		decl_list.emplace_back( curr_token.GetIdentifier(), decl );
 		if ( Match( ScannerTokenType::TOKEN_COMMA ) ){
 			NextToken(); // consume ','
 		}
 	} while ( !Match( ScannerTokenType::TOKEN_END_OF_STREAM ) && !Match( ScannerTokenType::TOKEN_SEMI_COLON ) );
-#ifdef _DEBUG
-	std::wcout << L"\n========== End of variable declaration =========" << std::endl;
-#endif
 	if ( !Match( ScannerTokenType::TOKEN_SEMI_COLON ) ){
 		ProcessError( L"Expected a semi-colon(;) at the end of variable/constant declaration." );
-		clear_list( decl_list );
 		return nullptr;
 	}
 	NextToken(); // consume ';'
-	return new DeclarationList( token.GetLineNumber(), access_type, storage_type, std::move( decl_list ) );
+	return arena->Make<DeclarationList>( token.GetLineNumber(), access_type, storage_type, std::move( decl_list ) );
 }
 
 Statement* Parser::ParseEmptyStatement( Scope * )
 {
 	auto token = CurrentToken();
 	NextToken(); // consume ';'
-	return new EmptyStatement( token.GetLineNumber() );
+	return arena->Make<EmptyStatement>( token.GetLineNumber() );
 }
\ No newline at end of file
@@ -9,6 +9,8 @@
 #ifndef __PARSER_H__
 #define __PARSER_H__
 
+#include <memory>
+
 #include "scanner.h"
 #include "tree.h"
 
@@ -31,6 +33,9 @@ namespace compiler {
 		std::map<size_t, std::wstring>		errors;
 		int									local_count;
 		Token								*current_token;
+		ParseArena							*arena;
+		NameTable							*names;
+		std::shared_ptr<NameTable>			shared_names;
 
 	private:
 		inline void NextToken() {
@@ -104,8 +109,9 @@ namespace compiler {
 		Expression*		ParseListExpression();
 		Expression*		ParseDictionaryExpression();
 	public:
-		explicit Parser( std::wstring const &in ): input( in ), scanner( new Scanner( input )), local_count( - 1 ), 
-			current_token( nullptr ){
+		explicit Parser( std::wstring const &in, std::shared_ptr<NameTable> program_names = nullptr ): input( in ),
+			scanner( new Scanner( input )), local_count( - 1 ), current_token( nullptr ), arena( nullptr ), names( nullptr ),
+			shared_names( std::move( program_names ) ){
 			LoadErrorCodes();
 		}
 
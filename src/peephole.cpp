@@ -0,0 +1,202 @@
+/***************************************************************************
+ * Peephole optimizer
+ *
+ * Copyright (c) 2017 Joshua Ogunyinka
+ * All rights reserved.
+*/
+
+#include <climits>
+
+#include "peephole.h"
+#include "emitter.h"
+
+using namespace compiler;
+
+void PeepholeOptimizer::Optimize( ExecutableProgram* program )
+{
+	for ( ExecutableFunction* function : program->GetAllFunctions() ) {
+		PeepholeOptimizer optimizer{ function };
+		optimizer.Fuse();
+		optimizer.RemoveForwardLabels();
+	}
+}
+
+/****************************
+ * Sequences picked from the pairs
+ * '--count-pairs' runs report most:
+ *   'i++', 'i -= 2':		LOAD_INT_LIT LOAD_VAR ADD|SUB STOR_VAR
+ *   'i < 3', 'i % 7':		LOAD_INT_LIT LOAD_VAR
+ *   'a + b':				LOAD_VAR LOAD_VAR
+ *   loop and 'if' tests:	LES|GTR|... JMP
+ ****************************/
+void PeepholeOptimizer::Fuse()
+{
+	std::vector<Instruction*> &instructions = function->GetInstructions();
+	std::vector<Instruction*> fused;
+	for ( size_t i = 0; i < instructions.size(); ++i ) {
+		Instruction* instruction = instructions[ i ];
+		const size_t left = instructions.size() - i;
+
+		if ( instruction->type == JMP && instruction->operand2 == JMP_UNCND ) {
+			Instruction* rtrn = ReturnAt( instruction->operand1 );
+			fused.push_back( rtrn ? rtrn : instruction );
+			continue;
+		}
+
+		// local = local + literal and local = local - literal
+		if ( left >= 4 && instruction->type == LOAD_INT_LIT && IsLocalLoad( instructions[ i + 1 ] )
+			&& ( IsAdd( instructions[ i + 2 ] ) || ( IsSubtract( instructions[ i + 2 ] ) && instruction->operand1 != LONG_MIN ) )
+			&& instructions[ i + 3 ]->type == STOR_VAR && instructions[ i + 3 ]->operand1 == LOCL
+			&& instructions[ i + 3 ]->operand2 == instructions[ i + 1 ]->operand2 ) {
+			const INT_T step = IsAdd( instructions[ i + 2 ] ) ? instruction->operand1 : -instruction->operand1;
+			fused.push_back( Emitter::MakeInstruction( INC_LOCAL_INT, instructions[ i + 1 ]->operand2, step ) );
+			fused.back()->line = instruction->line;
+			fused.insert( fused.end(), instructions.begin() + i, instructions.begin() + i + 4 );
+			i += 3;
+			continue;
+		}
+
+		if ( left >= 2 && IsLocalLoad( instruction ) && IsLocalLoad( instructions[ i + 1 ] ) ) {
+			fused.push_back( Emitter::MakeInstruction( LOAD_LOCAL_PAIR, instruction->operand2, instructions[ i + 1 ]->operand2 ) );
+			fused.back()->line = instruction->line;
+			fused.push_back( instruction );
+			fused.push_back( instructions[ ++i ] );
+			continue;
+		}
+
+		// operands of 'local < literal', 'local % literal', ...
+		if ( left >= 2 && instruction->type == LOAD_INT_LIT && IsLocalLoad( instructions[ i + 1 ] ) ) {
+			fused.push_back( Emitter::MakeInstruction( LOAD_INT_LOCAL, instruction->operand1, instructions[ i + 1 ]->operand2 ) );
+			fused.back()->line = instruction->line;
+			fused.push_back( instruction );
+			fused.push_back( instructions[ ++i ] );
+			continue;
+		}
+
+		// comparison feeding a conditional jump
+		if ( left >= 2 && instructions[ i + 1 ]->type == JMP && instructions[ i + 1 ]->operand2 != JMP_UNCND ) {
+			InstructionType type = NO_OP;
+			switch ( instruction->type ) {
+			case EQL:
+			case EQL_INT:
+				type = CMP_JMP_EQL;
+				break;
+
+			case NEQL:
+			case NEQL_INT:
+				type = CMP_JMP_NEQL;
+				break;
+
+			case GTR:
+			case GTR_INT:
+			case GTR_FLOAT:
+				type = CMP_JMP_GTR;
+				break;
+
+			case LES:
+			case LES_INT:
+			case LES_FLOAT:
+				type = CMP_JMP_LES;
+				break;
+
+			case GTR_EQL:
+			case GTR_EQL_INT:
+			case GTR_EQL_FLOAT:
+				type = CMP_JMP_GTR_EQL;
+				break;
+
+			case LES_EQL:
+			case LES_EQL_INT:
+			case LES_EQL_FLOAT:
+				type = CMP_JMP_LES_EQL;
+				break;
+
+			default:
+				break;
+			}
+
+			if ( type != NO_OP ) {
+				fused.push_back( Emitter::MakeInstruction( type, instructions[ i + 1 ]->operand1, instructions[ i + 1 ]->operand2 ) );
+				fused.back()->line = instruction->line;
+				fused.push_back( instruction );
+				fused.push_back( instructions[ ++i ] );
+				continue;
+			}
+		}
+
+		fused.push_back( instruction );
+	}
+	function->SetInstructions( std::move( fused ) );
+}
+
+// the return a jump to 'label' reaches without doing anything else
+Instruction* PeepholeOptimizer::ReturnAt( INT_T label )
+{
+	std::vector<Instruction*> &instructions = function->GetInstructions();
+	auto offset = function->GetJumpTable().find( label );
+	if ( offset == function->GetJumpTable().end() ) {
+		return nullptr;
+	}
+
+	size_t ip = offset->second;
+	while ( ip < instructions.size() && instructions[ ip ]->type == LBL ) {
+		++ip;
+	}
+	return ip < instructions.size() && instructions[ ip ]->type == RTRN ? instructions[ ip ] : nullptr;
+}
+
+/****************************
+ * Labels reached only by forward
+ * jumps cost a dispatch each time
+ * they are passed; their offsets
+ * stay in the jump table. Targets
+ * of backward jumps keep their
+ * hit counts
+ ****************************/
+void PeepholeOptimizer::RemoveForwardLabels()
+{
+	std::vector<Instruction*> &instructions = function->GetInstructions();
+	std::unordered_map<long, size_t> &jump_table = function->GetJumpTable();
+	std::set<INT_T> backward;
+	for ( size_t i = 0; i < instructions.size(); ++i ) {
+		switch ( instructions[ i ]->type ) {
+		case JMP:
+		case CMP_JMP_EQL:
+		case CMP_JMP_NEQL:
+		case CMP_JMP_GTR:
+		case CMP_JMP_LES:
+		case CMP_JMP_GTR_EQL:
+		case CMP_JMP_LES_EQL: {
+			auto offset = jump_table.find( instructions[ i ]->operand1 );
+			if ( offset != jump_table.end() && offset->second <= i ) {
+				backward.insert( instructions[ i ]->operand1 );
+			}
+		}
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	std::vector<Instruction*> kept;
+	std::vector<INT_T> pending;
+	std::unordered_map<long, size_t> offsets;
+	for ( Instruction* instruction : instructions ) {
+		if ( instruction->type == LBL && !backward.count( instruction->operand1 ) ) {
+			pending.push_back( instruction->operand1 );
+			continue;
+		}
+		for ( INT_T label : pending ) {
+			offsets[ label ] = kept.size();
+		}
+		pending.clear();
+		kept.push_back( instruction );
+	}
+	for ( INT_T label : pending ) {
+		offsets[ label ] = kept.size();
+	}
+
+	function->SetInstructions( std::move( kept ) );
+	function->GetJumpTable().insert( offsets.begin(), offsets.end() );
+}
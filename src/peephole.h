@@ -0,0 +1,53 @@
+/***************************************************************************
+ * Peephole optimizer
+ *
+ * Copyright (c) 2017 Joshua Ogunyinka
+ * All rights reserved.
+*/
+
+#ifndef __PEEPHOLE_H__
+#define __PEEPHOLE_H__
+
+#include "common.h"
+
+namespace compiler {
+	/****************************
+	 * Last pass over the stack code.
+	 * Superinstructions are put in
+	 * front of the sequences they
+	 * stand for: when the operands are
+	 * the types one handles it does the
+	 * work and skips the sequence,
+	 * otherwise the sequence runs as
+	 * before. Jumps to a return become
+	 * the return, and labels only
+	 * jumped to forward are dropped
+	 ****************************/
+	class PeepholeOptimizer {
+		ExecutableFunction* function;
+
+		explicit PeepholeOptimizer( ExecutableFunction* function ) : function( function ) {
+		}
+
+		void Fuse();
+		void RemoveForwardLabels();
+		Instruction* ReturnAt( INT_T label );
+
+		static bool IsLocalLoad( Instruction* instruction ) {
+			return instruction->type == LOAD_VAR && instruction->operand1 == LOCL;
+		}
+
+		static bool IsAdd( Instruction* instruction ) {
+			return instruction->type == ADD || instruction->type == ADD_INT;
+		}
+
+		static bool IsSubtract( Instruction* instruction ) {
+			return instruction->type == SUB || instruction->type == SUB_INT;
+		}
+
+	public:
+		static void Optimize( ExecutableProgram* program );
+	};
+}
+
+#endif
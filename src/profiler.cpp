@@ -0,0 +1,194 @@
+/***************************************************************************
+ * Sampling profiler
+ *
+ * Copyright (c) 2017 Joshua Ogunyinka
+ * All rights reserved.
+*/
+
+#include <algorithm>
+#include "profiler.h"
+#include "runtime.h"
+
+#ifndef _WIN32
+#include <sys/time.h>
+#endif
+
+using namespace runtime;
+
+volatile sig_atomic_t Profiler::is_due;
+
+Profiler::Profiler( ExecutableProgram* program, std::wstring const &file_name, int interval ) : file_name( file_name ), interval( interval ),
+	for_registers( false ), is_running( false ), samples( 0 )
+{
+	// methods are named for their class: a method's own name is the same in every class
+	for ( auto &klass : program->GetClasses() ) {
+		for ( auto &method : klass.second->GetFunctions() ) {
+			names.insert( { method.second, klass.first + L"." + method.second->GetName() } );
+		}
+		for ( auto &operation : klass.second->GetOperations() ) {
+			names.insert( { operation.second, klass.first + L"." + operation.second->GetName() } );
+		}
+	}
+}
+
+Profiler::~Profiler()
+{
+	Stop();
+}
+
+void Profiler::OnSignal( int signal )
+{
+	is_due = 1;
+}
+
+bool Profiler::Start( bool for_registers )
+{
+	this->for_registers = for_registers;
+#ifdef _WIN32
+	return false;
+#else
+	struct sigaction action;
+	memset( &action, 0, sizeof( action ) );
+	action.sa_handler = OnSignal;
+	sigemptyset( &action.sa_mask );
+	action.sa_flags = SA_RESTART;
+	if ( sigaction( SIGPROF, &action, NULL ) ) {
+		return false;
+	}
+
+	struct itimerval timer;
+	timer.it_interval.tv_sec = timer.it_value.tv_sec = interval / 1000000;
+	timer.it_interval.tv_usec = timer.it_value.tv_usec = interval % 1000000;
+	if ( setitimer( ITIMER_PROF, &timer, NULL ) ) {
+		return false;
+	}
+	is_running = true;
+
+	return true;
+#endif
+}
+
+// a signal already raised is ignored: by default it ends the process
+void Profiler::Stop()
+{
+#ifndef _WIN32
+	if ( is_running ) {
+		struct itimerval timer;
+		memset( &timer, 0, sizeof( timer ) );
+		setitimer( ITIMER_PROF, &timer, NULL );
+		signal( SIGPROF, SIG_IGN );
+		is_running = false;
+	}
+#endif
+	is_due = 0;
+}
+
+int Profiler::LineOf( ExecutableFunction* function, size_t ip )
+{
+	if ( for_registers ) {
+		std::vector<RegisterInstruction> &instructions = function->GetRegisterInstructions();
+		return ip < instructions.size() ? instructions[ ip ].line : 0;
+	}
+
+	std::vector<Instruction*> &instructions = function->GetInstructions();
+	return ip < instructions.size() ? instructions[ ip ]->line : 0;
+}
+
+std::wstring const &Profiler::NameOf( ExecutableFunction* function )
+{
+	auto name = names.find( function );
+	if ( name == names.end() ) {
+		name = names.insert( { function, function->GetName() } ).first;
+	}
+
+	return name->second;
+}
+
+void Profiler::Sample( ExecutableFunction* function, size_t ip, Frame** call_stack, size_t call_stack_pos )
+{
+	is_due = 0;
+
+	std::vector<Site> stack;
+	stack.reserve( call_stack_pos + 1 );
+	for ( size_t i = 0; i < call_stack_pos; ++i ) {
+		stack.push_back( { call_stack[ i ]->function, LineOf( call_stack[ i ]->function, call_stack[ i ]->ip - 1 ) } );
+	}
+	stack.push_back( { function, LineOf( function, ip ) } );
+
+	++stacks[ stack ];
+	++samples;
+}
+
+/****************************
+ * Folded stacks go to the file,
+ * as flame graph tools read them;
+ * the shares go to the error
+ * stream. A function's self share
+ * counts the samples it was
+ * running in, its total share
+ * those it was anywhere on the
+ * stack, once each however deep
+ * it recursed
+ ****************************/
+void Profiler::Report()
+{
+	std::map<std::wstring, size_t> folded;
+	std::map<std::wstring, std::pair<size_t, size_t>> functions;
+	std::map<std::wstring, std::pair<size_t, size_t>> lines;
+	for ( auto &stack : stacks ) {
+		std::wstring frames;
+		std::set<std::wstring> seen_functions;
+		std::set<std::wstring> seen_lines;
+		for ( Site const &site : stack.first ) {
+			const std::wstring &name = NameOf( site.first );
+			const std::wstring line = name + L":" + IntToString( site.second );
+			frames += frames.empty() ? name : L";" + name;
+			if ( seen_functions.insert( name ).second ) {
+				functions[ name ].second += stack.second;
+			}
+			if ( seen_lines.insert( line ).second ) {
+				lines[ line ].second += stack.second;
+			}
+		}
+		folded[ frames ] += stack.second;
+
+		Site const &top = stack.first.back();
+		functions[ NameOf( top.first ) ].first += stack.second;
+		lines[ NameOf( top.first ) + L":" + IntToString( top.second ) ].first += stack.second;
+	}
+
+#ifdef _WIN32
+	std::wofstream out( file_name.c_str() );
+#else
+	std::wofstream out( UnicodeToBytes( file_name ) );
+#endif
+	for ( auto &stack : folded ) {
+		out << stack.first << L" " << stack.second << std::endl;
+	}
+	out.close();
+	if ( out.fail() ) {
+		std::wcerr << L"Unable to write profile file: " << file_name << std::endl;
+	}
+
+	std::wcerr << L"---------- profile: " << samples << L" samples, one every " << interval << L"us of CPU time ----------" << std::endl;
+	if ( !samples ) {
+		return;
+	}
+
+	const std::pair<std::wstring, std::map<std::wstring, std::pair<size_t, size_t>>*> tables[] = {
+		{ L"function", &functions }, { L"line", &lines }
+	};
+	for ( auto &table : tables ) {
+		std::vector<std::pair<std::wstring, std::pair<size_t, size_t>>> rows( table.second->begin(), table.second->end() );
+		std::sort( rows.begin(), rows.end(), []( std::pair<std::wstring, std::pair<size_t, size_t>> const &a,
+			std::pair<std::wstring, std::pair<size_t, size_t>> const &b ) {
+			return a.second != b.second ? a.second > b.second : a.first < b.first;
+		} );
+
+		std::wcerr << L"self\ttotal\t" << table.first << std::endl;
+		for ( size_t i = 0; i < rows.size() && i < 24; ++i ) {
+			std::wcerr << ( rows[ i ].second.first * 100.0 / samples ) << L"%\t" << ( rows[ i ].second.second * 100.0 / samples ) << L"%\t"
+				<< rows[ i ].first << std::endl;
+		}
+	}
+}
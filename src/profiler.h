@@ -0,0 +1,72 @@
+/***************************************************************************
+ * Sampling profiler
+ *
+ * Copyright (c) 2017 Joshua Ogunyinka
+ * All rights reserved.
+*/
+
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+
+#include <csignal>
+#include "common.h"
+
+namespace runtime {
+	struct _Frame;
+	typedef struct _Frame Frame;
+
+	/****************************
+	 * Samples where a program spends
+	 * its time. A timer counting the
+	 * CPU time the process uses raises
+	 * SIGPROF; the handler only notes
+	 * that a sample is due, and the
+	 * interpreter takes it before its
+	 * next instruction: the function
+	 * and instruction it's at and
+	 * those of each frame under it.
+	 * When the program ends the
+	 * samples are written as folded
+	 * stacks, one line to a stack, and
+	 * each function's and line's share
+	 * of them is reported
+	 ****************************/
+	class Profiler {
+		// a function and the line of the instruction it's at
+		typedef std::pair<ExecutableFunction*, int> Site;
+
+		// set by the signal, cleared once the sample is taken
+		static volatile sig_atomic_t is_due;
+
+		std::wstring file_name;
+		int interval;										// microseconds of CPU time between samples
+		bool for_registers;
+		bool is_running;
+		std::unordered_map<ExecutableFunction*, std::wstring> names;
+		std::map<std::vector<Site>, size_t> stacks;			// outermost frame first
+		size_t samples;
+
+		static void OnSignal( int signal );
+		int LineOf( ExecutableFunction* function, size_t ip );
+		std::wstring const &NameOf( ExecutableFunction* function );
+
+	public:
+		// folded stacks are written to 'file_name'
+		Profiler( ExecutableProgram* program, std::wstring const &file_name, int interval = 1000 );
+		~Profiler();
+
+		static bool IsDue() {
+			return is_due != 0;
+		}
+
+		// false if CPU time can't be sampled here
+		bool Start( bool for_registers );
+		void Stop();
+
+		// 'ip' is the instruction about to run; each frame's is the one after its call
+		void Sample( ExecutableFunction* function, size_t ip, Frame** call_stack, size_t call_stack_pos );
+		void Report();
+	};
+}
+
+#endif
@@ -0,0 +1,637 @@
+/***************************************************************************
+ * Register machine emitter
+ *
+ * Copyright (c) 2017 Joshua Ogunyinka
+ * All rights reserved.
+*/
+
+#include <algorithm>
+
+#include "registers.h"
+#include "classes.h"
+
+using namespace compiler;
+
+/****************************
+ * Lower every function of a
+ * program
+ ****************************/
+bool RegisterEmitter::Emit( ExecutableProgram* program )
+{
+	for ( ExecutableFunction* function : program->GetAllFunctions() ) {
+		RegisterEmitter emitter{ function, function == program->GetGlobal() };
+		if ( !emitter.EmitFunction() ) {
+			wcerr << L"Error: unbalanced operand stack in function '" << function->GetName() << L"'" << endl;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/****************************
+ * Operand stack depths
+ ****************************/
+void RegisterEmitter::StackEffect( Instruction* instruction, bool is_global, int &pops, int &pushes )
+{
+	pops = pushes = 0;
+	switch ( instruction->type ) {
+	case LOAD_TRUE_LIT:
+	case LOAD_FALSE_LIT:
+	case LOAD_INT_LIT:
+	case LOAD_FLOAT_LIT:
+	case LOAD_CHAR_LIT:
+	case LOAD_NIL_LIT:
+	case LOAD_VAR:
+	case LOAD_FIELD:
+	case NEW_STRING:
+	case NEW_HASH:
+	case NEW_OBJ:
+	case LOCAL_OBJ:
+		pushes = 1;
+		break;
+
+	case STOR_VAR:
+	case POP:
+	case JMP_TBL:
+	case SHOW_TYPE:
+		pops = 1;
+		break;
+
+	case EQL:
+	case NEQL:
+	case GTR:
+	case LES:
+	case GTR_EQL:
+	case LES_EQL:
+	case ADD:
+	case SUB:
+	case MUL:
+	case DIV:
+	case MOD:
+	case BIT_AND:
+	case BIT_OR:
+	case EQL_INT:
+	case NEQL_INT:
+	case GTR_INT:
+	case LES_INT:
+	case GTR_EQL_INT:
+	case LES_EQL_INT:
+	case ADD_INT:
+	case SUB_INT:
+	case MUL_INT:
+	case GTR_FLOAT:
+	case LES_FLOAT:
+	case GTR_EQL_FLOAT:
+	case LES_EQL_FLOAT:
+	case ADD_FLOAT:
+	case SUB_FLOAT:
+	case MUL_FLOAT:
+	case DIV_FLOAT:
+		pops = 2;
+		pushes = 1;
+		break;
+
+	case JMP:
+		pops = instruction->operand2 == JMP_UNCND ? 0 : 1;
+		break;
+
+	case NEW_ARRAY:
+	case NEW_FUNC:
+		pops = static_cast< int >( instruction->operand1 );
+		pushes = 1;
+		break;
+
+	case LOAD_ARY_VAR:
+	case LOAD_ARY_ELEM:
+		pops = static_cast< int >( instruction->operand3 );
+		pushes = 1;
+		break;
+
+	case STOR_ARY_VAR:
+	case STOR_ARY_ELEM:
+		pops = static_cast< int >( instruction->operand3 ) + 1;
+		break;
+
+	case ARY_SIZE:
+	case TRY_ARY_SIZE:
+	case ARY_ENTRIES:
+		pops = pushes = 1;
+		break;
+
+	case CALL_FUNC:
+	case TAIL_CALL:
+		pops = static_cast< int >( instruction->operand1 ) + 1;
+		pushes = instruction->operand2 ? 1 : 0;
+		break;
+
+	case RTRN:
+		pops = is_global ? 0 : 1;
+		break;
+
+	default:
+		break;
+	}
+}
+
+bool RegisterEmitter::Flow( size_t ip, int depth, std::vector<size_t> &work )
+{
+	if ( ip >= depths.size() ) {
+		return false;
+	}
+
+	if ( depths[ ip ] < 0 ) {
+		depths[ ip ] = depth;
+		work.push_back( ip );
+		return true;
+	}
+
+	return depths[ ip ] == depth;
+}
+
+bool RegisterEmitter::ComputeDepths()
+{
+	std::vector<Instruction*> &code = function->GetInstructions();
+	depths.assign( code.size(), -1 );
+
+	// arguments are on the stack when a function starts
+	std::vector<size_t> work;
+	if ( !Flow( 0, is_global ? 0 : function->GetParameterCount(), work ) ) {
+		return code.empty();
+	}
+
+	while ( !work.empty() ) {
+		const size_t ip = work.back();
+		work.pop_back();
+
+		Instruction* instruction = code[ ip ];
+		int pops, pushes;
+		StackEffect( instruction, is_global, pops, pushes );
+		const int depth = depths[ ip ];
+		if ( depth < pops ) {
+			return false;
+		}
+		const int next = depth - pops + pushes;
+		max_depth = std::max( max_depth, std::max( depth, next ) );
+
+		bool valid = true;
+		switch ( instruction->type ) {
+		case JMP: {
+			auto label = function->GetJumpTable().find( instruction->operand1 );
+			valid = label != function->GetJumpTable().end() && Flow( label->second, next, work );
+			if ( instruction->operand2 != JMP_UNCND ) {
+				valid = valid && Flow( ip + 1, next, work );
+			}
+		}
+			break;
+
+		case JMP_TBL: {
+			auto label = function->GetJumpTable().find( instruction->operand3 );
+			valid = label != function->GetJumpTable().end() && Flow( label->second, next, work );
+			for ( INT_T i = 1; valid && i <= instruction->operand2; ++i ) {
+				valid = Flow( ip + i, next, work );
+			}
+		}
+			break;
+
+		case RTRN:
+			break;
+
+		default:
+			valid = Flow( ip + 1, next, work );
+			break;
+		}
+
+		if ( !valid ) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/****************************
+ * Operands
+ ****************************/
+INT_T RegisterEmitter::Constant( Value const &value )
+{
+	constants.push_back( value );
+	return -static_cast< INT_T >( constants.size() );
+}
+
+void RegisterEmitter::Emit( InstructionType type, INT_T operand1, INT_T operand2, INT_T operand3, INT_T operand4 )
+{
+	RegisterInstruction instruction;
+	instruction.type = type;
+	instruction.operand1 = operand1;
+	instruction.operand2 = operand2;
+	instruction.operand3 = operand3;
+	instruction.operand4 = operand4;
+	instruction.line = line;
+	instructions.push_back( instruction );
+}
+
+// the last instruction left its result in the next stack slot
+void RegisterEmitter::PushResult( INT_T slot )
+{
+	stack.push_back( slot );
+	result = instructions.size() - 1;
+}
+
+INT_T RegisterEmitter::Pop()
+{
+	const INT_T operand = stack.back();
+	stack.pop_back();
+	return operand;
+}
+
+// moves a deferred local or constant into the entry's own slot
+void RegisterEmitter::Materialize( size_t entry )
+{
+	if ( stack[ entry ] != Slot( entry ) ) {
+		Emit( MOV, Slot( entry ), stack[ entry ] );
+		stack[ entry ] = Slot( entry );
+	}
+}
+
+void RegisterEmitter::MaterializeTop( size_t count )
+{
+	for ( size_t i = stack.size() - count; i < stack.size(); ++i ) {
+		Materialize( i );
+	}
+}
+
+// control flow merges expect every entry in its slot
+void RegisterEmitter::MaterializeAll()
+{
+	for ( size_t i = 0; i < stack.size(); ++i ) {
+		Materialize( i );
+	}
+}
+
+// entries still reading a local must keep its old value
+void RegisterEmitter::SpillLocal( INT_T slot )
+{
+	for ( size_t i = 0; i < stack.size(); ++i ) {
+		if ( stack[ i ] == slot ) {
+			Materialize( i );
+		}
+	}
+}
+
+// calls and operators may store to globals, which are the locals of the global function
+void RegisterEmitter::SpillLocals()
+{
+	if ( is_global ) {
+		for ( size_t i = 0; i < stack.size(); ++i ) {
+			if ( stack[ i ] >= 0 && stack[ i ] < stack_base ) {
+				Materialize( i );
+			}
+		}
+	}
+}
+
+void RegisterEmitter::Reset( int depth )
+{
+	stack.clear();
+	for ( int i = 0; i < depth; ++i ) {
+		stack.push_back( Slot( i ) );
+	}
+}
+
+/****************************
+ * Variables and arrays
+ ****************************/
+void RegisterEmitter::EmitLoad( Instruction* instruction )
+{
+	if ( instruction->operand1 == LOCL || ( is_global && instruction->operand1 == GLOB ) ) {
+		stack.push_back( instruction->operand2 );
+		return;
+	}
+
+	const INT_T slot = Slot( stack.size() );
+	Emit( LOAD_VAR, slot, instruction->operand1, instruction->operand2 );
+	PushResult( slot );
+}
+
+void RegisterEmitter::EmitStore( Instruction* instruction )
+{
+	const INT_T value = Pop();
+	if ( instruction->operand1 != LOCL && !( is_global && instruction->operand1 == GLOB ) ) {
+		Emit( STOR_VAR, value, instruction->operand1, instruction->operand2 );
+		return;
+	}
+
+	// retarget the instruction that computed the value
+	const INT_T local = instruction->operand2;
+	if ( value == Slot( stack.size() ) && !instructions.empty() && result == instructions.size() - 1 &&
+		std::find( stack.begin(), stack.end(), local ) == stack.end() ) {
+		instructions.back().operand1 = local;
+		return;
+	}
+
+	SpillLocal( local );
+	if ( value != local ) {
+		Emit( MOV, local, value );
+	}
+}
+
+// operand naming the array of an element access
+INT_T RegisterEmitter::EmitArray( Instruction* instruction )
+{
+	if ( instruction->operand1 == LOCL || ( is_global && instruction->operand1 == GLOB ) ) {
+		return instruction->operand2;
+	}
+
+	Emit( LOAD_VAR, Scratch(), instruction->operand1, instruction->operand2 );
+	return Scratch();
+}
+
+// pops element indices; one index may be any operand, several sit in consecutive slots
+INT_T RegisterEmitter::EmitIndex( INT_T dimensions )
+{
+	if ( dimensions == 1 ) {
+		return Pop();
+	}
+
+	MaterializeTop( static_cast< size_t >( dimensions ) );
+	stack.resize( stack.size() - static_cast< size_t >( dimensions ) );
+	return Slot( stack.size() );
+}
+
+/****************************
+ * Lower a function
+ ****************************/
+bool RegisterEmitter::EmitFunction()
+{
+	if ( !ComputeDepths() ) {
+		return false;
+	}
+
+	// parameters arrive in their locals, the first on top
+	std::vector<Instruction*> &code = function->GetInstructions();
+	if ( !is_global ) {
+		for ( INT_T i = function->GetParameterCount(); i > 0; --i ) {
+			stack.push_back( i );
+		}
+	}
+
+	bool falls_through = true;
+	for ( size_t ip = 0; ip < code.size(); ++ip ) {
+		if ( depths[ ip ] < 0 ) {
+			falls_through = false;
+			continue;
+		}
+
+		if ( !falls_through ) {
+			Reset( depths[ ip ] );
+		}
+		falls_through = true;
+
+		Instruction* instruction = code[ ip ];
+		const size_t emitted = instructions.size();
+		line = instruction->line;
+		switch ( instruction->type ) {
+		case LOAD_TRUE_LIT:
+		case LOAD_FALSE_LIT: {
+			Value value( BOOL_TYPE );
+			value.sys_klass = BooleanClass::Instance();
+			value.value.int_value = instruction->type == LOAD_TRUE_LIT ? 1 : 0;
+			stack.push_back( Constant( value ) );
+		}
+			break;
+
+		case LOAD_INT_LIT: {
+			Value value( INT_TYPE );
+			value.sys_klass = IntegerClass::Instance();
+			value.value.int_value = instruction->operand1;
+			stack.push_back( Constant( value ) );
+		}
+			break;
+
+		case LOAD_FLOAT_LIT: {
+			Value value( FLOAT_TYPE );
+			value.sys_klass = FloatClass::Instance();
+			value.value.float_value = instruction->operand4;
+			stack.push_back( Constant( value ) );
+		}
+			break;
+
+		case LOAD_CHAR_LIT: {
+			Value value( CHAR_TYPE );
+			value.value.char_value = static_cast< CHAR_T >( instruction->operand1 );
+			stack.push_back( Constant( value ) );
+		}
+			break;
+
+		case LOAD_NIL_LIT:
+			stack.push_back( Constant( Value() ) );
+			break;
+
+		case LOAD_VAR:
+		case LOAD_FIELD:
+			EmitLoad( instruction );
+			break;
+
+		case STOR_VAR:
+			EmitStore( instruction );
+			break;
+
+		case POP:
+			Pop();
+			break;
+
+		case EQL:
+		case NEQL:
+		case GTR:
+		case LES:
+		case GTR_EQL:
+		case LES_EQL:
+		case ADD:
+		case SUB:
+		case MUL:
+		case DIV:
+		case MOD:
+		case BIT_AND:
+		case BIT_OR:
+		case EQL_INT:
+		case NEQL_INT:
+		case GTR_INT:
+		case LES_INT:
+		case GTR_EQL_INT:
+		case LES_EQL_INT:
+		case ADD_INT:
+		case SUB_INT:
+		case MUL_INT:
+		case GTR_FLOAT:
+		case LES_FLOAT:
+		case GTR_EQL_FLOAT:
+		case LES_EQL_FLOAT:
+		case ADD_FLOAT:
+		case SUB_FLOAT:
+		case MUL_FLOAT:
+		case DIV_FLOAT: {
+			// the left operand is on top
+			const INT_T left = Pop();
+			const INT_T right = Pop();
+			SpillLocals();
+			const INT_T slot = Slot( stack.size() );
+			Emit( instruction->type, slot, left, right );
+			PushResult( slot );
+		}
+			break;
+
+		case JMP:
+			if ( instruction->operand2 == JMP_UNCND ) {
+				MaterializeAll();
+				Emit( JMP, instruction->operand1, JMP_UNCND );
+				falls_through = false;
+			}
+			else {
+				const INT_T condition = Pop();
+				MaterializeAll();
+				Emit( JMP, instruction->operand1, instruction->operand2, condition );
+			}
+			break;
+
+		case JMP_TBL: {
+			const INT_T value = Pop();
+			MaterializeAll();
+			Emit( JMP_TBL, value, instruction->operand1, instruction->operand2, instruction->operand3 );
+			falls_through = false;
+		}
+			break;
+
+		case LBL:
+			MaterializeAll();
+			labels[ instruction->operand1 ] = instructions.size();
+			result = -1;
+			break;
+
+		case NEW_ARRAY:
+		case NEW_FUNC: {
+			const size_t count = static_cast< size_t >( instruction->operand1 );
+			MaterializeTop( count );
+			stack.resize( stack.size() - count );
+			const INT_T slot = Slot( stack.size() );
+			Emit( instruction->type, slot, slot, instruction->operand1 );
+			instructions.back().operand5 = instruction->operand5;
+			PushResult( slot );
+		}
+			break;
+
+		case NEW_STRING:
+		case NEW_HASH:
+		case NEW_OBJ: {
+			const INT_T slot = Slot( stack.size() );
+			Emit( instruction->type, slot );
+			instructions.back().operand5 = instruction->operand5;
+			PushResult( slot );
+		}
+			break;
+
+		case LOCAL_OBJ: {
+			const INT_T slot = Slot( stack.size() );
+			Emit( LOCAL_OBJ, slot, instruction->operand1 );
+			instructions.back().operand5 = instruction->operand5;
+			PushResult( slot );
+		}
+			break;
+
+		case LOAD_ARY_VAR:
+		case LOAD_ARY_ELEM: {
+			const INT_T index = EmitIndex( instruction->operand3 );
+			const INT_T array = EmitArray( instruction );
+			const INT_T slot = Slot( stack.size() );
+			Emit( instruction->type, slot, array, index, instruction->operand3 );
+			PushResult( slot );
+		}
+			break;
+
+		case STOR_ARY_VAR:
+		case STOR_ARY_ELEM: {
+			const INT_T index = EmitIndex( instruction->operand3 );
+			const INT_T value = Pop();
+			const INT_T array = EmitArray( instruction );
+			Emit( instruction->type, value, array, index, instruction->operand3 );
+		}
+			break;
+
+		case ARY_SIZE:
+		case TRY_ARY_SIZE:
+		case ARY_ENTRIES: {
+			const INT_T value = Pop();
+			const INT_T slot = Slot( stack.size() );
+			Emit( instruction->type, slot, value );
+			PushResult( slot );
+		}
+			break;
+
+		// ahead of a local's 'size()' in a function, whose call then neither spills nor moves arguments;
+		// both leave the size in the same slot, so the call's isn't retargeted
+		case KNOWN_SIZE: {
+			Instruction* call = code[ ip + 2 ];
+			const INT_T slot = Slot( stack.size() );
+			Emit( KNOWN_SIZE, slot, instruction->operand1 );
+			Emit( CALL_FUNC, slot, code[ ip + 1 ]->operand2, slot, call->operand1 );
+			instructions.back().operand5 = call->operand5;
+			stack.push_back( slot );
+			result = -1;
+			ip += 2;
+		}
+			break;
+
+		case CALL_FUNC:
+		case TAIL_CALL: {
+			const INT_T receiver = Pop();
+			const size_t count = static_cast< size_t >( instruction->operand1 );
+			MaterializeTop( count );
+			stack.resize( stack.size() - count );
+			SpillLocals();
+			const INT_T slot = Slot( stack.size() );
+			Emit( instruction->type, instruction->operand2 ? slot : -1, receiver, slot, instruction->operand1 );
+			instructions.back().operand5 = instruction->operand5;
+			if ( instruction->operand2 ) {
+				PushResult( slot );
+			}
+		}
+			break;
+
+		case RTRN:
+			if ( stack.empty() ) {
+				Emit( RTRN, 0, 0 );
+			}
+			else {
+				Emit( RTRN, Pop(), 1 );
+			}
+			falls_through = false;
+			break;
+
+		case SHOW_TYPE:
+			Emit( SHOW_TYPE, Pop() );
+			break;
+
+		default:
+			break;
+		}
+
+		// only a computed result just pushed may be retargeted
+		if ( instructions.size() == emitted ) {
+			result = -1;
+		}
+	}
+
+	// labels become instruction offsets
+	for ( RegisterInstruction &instruction : instructions ) {
+		if ( instruction.type == JMP ) {
+			instruction.operand1 = static_cast< INT_T >( labels[ instruction.operand1 ] );
+		}
+		else if ( instruction.type == JMP_TBL ) {
+			instruction.operand4 = static_cast< INT_T >( labels[ instruction.operand4 ] );
+		}
+	}
+
+	function->SetRegisterCode( std::move( instructions ), std::move( constants ), static_cast< int >( Scratch() ) + 1 );
+
+	return true;
+}
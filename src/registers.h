@@ -0,0 +1,106 @@
+/***************************************************************************
+ * Register machine emitter
+ *
+ * Copyright (c) 2017 Joshua Ogunyinka
+ * All rights reserved.
+*/
+
+#ifndef __REGISTERS_H__
+#define __REGISTERS_H__
+
+#include "common.h"
+
+/****************************
+ * Lowers each function's stack
+ * instructions to register form.
+ * A frame holds 'self', the locals,
+ * one slot per operand stack entry
+ * and a scratch slot. Loads of
+ * locals and literals are folded
+ * into the instructions that use
+ * them, so 'a = b + 1' becomes a
+ * single ADD.
+ *
+ * Layout, 'r' being a slot and 'o'
+ * a slot or constant:
+ *   MOV           r1 <- o2
+ *   LOAD_VAR      r1 <- variable o3 of scope o2
+ *   STOR_VAR      variable o3 of scope o2 <- o1
+ *   EQL .. BIT_OR r1 <- o2 op o3
+ *   JMP           to o1 if o3 is o2 (JMP_TRUE/JMP_FALSE), or always (JMP_UNCND)
+ *   JMP_TBL       on o1: o2 lowest case, o3 entries that follow, o4 default
+ *   NEW_ARRAY     r1 <- array of o3 dimensions in r(o2)..; the last is the first
+ *   NEW_STRING    r1 <- operand5
+ *   NEW_HASH      r1 <- empty hash
+ *   NEW_OBJ       r1 <- instance of class operand5
+ *   LOCAL_OBJ     r1 <- instance of class operand5 kept in r(o2)..
+ *   NEW_FUNC      r1 <- closure operand5 capturing o3 values r(o2)..
+ *   LOAD_ARY_VAR  r1 <- o2[ index ] over o4 dimensions; the index is o3
+ *                 for one dimension, else r(o3).. with the first index last
+ *   STOR_ARY_VAR  o2[ index ] <- o1, indexed as LOAD_ARY_VAR
+ *   LOAD_ARY_ELEM, STOR_ARY_ELEM
+ *                 as the above, with an index known to be within o2
+ *   ARY_SIZE      r1 <- size of o2
+ *   TRY_ARY_SIZE  r1 <- size of o2 if an array, else nil
+ *   ARY_ENTRIES   r1 <- o2 if an array, the entries of o2 if a hash
+ *   KNOWN_SIZE    r1 <- o2 and the next instruction skipped, if o2 is an integer
+ *   CALL_FUNC     r1 <- operand5 called on o2 with o4 arguments r(o3)..;
+ *                 the first argument is last and r1 < 0 drops the result
+ *   RTRN          returns o1 if o2 is set
+ *   SHOW_TYPE     dumps o1
+ ****************************/
+
+namespace compiler {
+	class RegisterEmitter {
+		ExecutableFunction* function;
+		bool is_global;
+		INT_T stack_base;								// slot of the bottom operand stack entry
+		int max_depth;
+		std::vector<int> depths;						// operand stack depth before each instruction; -1 if unreachable
+		std::vector<INT_T> stack;						// operand holding each stack entry
+		std::vector<RegisterInstruction> instructions;
+		std::vector<Value> constants;
+		std::unordered_map<long, size_t> labels;		// label id to register instruction
+		size_t result;									// instruction whose result is on top, or -1
+		int line;										// of the stack instruction being translated
+
+		RegisterEmitter( ExecutableFunction* function, bool is_global ) : function( function ), is_global( is_global ),
+			stack_base( function->GetLocalCount() + 1 ), max_depth( 0 ), result( -1 ), line( 0 ) {
+		}
+
+		bool ComputeDepths();
+		bool Flow( size_t ip, int depth, std::vector<size_t> &work );
+		static void StackEffect( Instruction* instruction, bool is_global, int &pops, int &pushes );
+
+		INT_T Slot( size_t depth ) {
+			return stack_base + static_cast< INT_T >( depth );
+		}
+
+		INT_T Scratch() {
+			return stack_base + max_depth;
+		}
+
+		INT_T Constant( Value const &value );
+		void Emit( InstructionType type, INT_T operand1, INT_T operand2 = 0, INT_T operand3 = 0, INT_T operand4 = 0 );
+		void PushResult( INT_T slot );
+		INT_T Pop();
+		void Materialize( size_t entry );
+		void MaterializeTop( size_t count );
+		void MaterializeAll();
+		void SpillLocal( INT_T slot );
+		void SpillLocals();
+		void Reset( int depth );
+
+		void EmitLoad( Instruction* instruction );
+		void EmitStore( Instruction* instruction );
+		INT_T EmitArray( Instruction* instruction );
+		INT_T EmitIndex( INT_T dimensions );
+		bool EmitFunction();
+
+	public:
+		// false if a function's operand stack doesn't balance
+		static bool Emit( ExecutableProgram* program );
+	};
+}
+
+#endif
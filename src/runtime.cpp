@@ -5,8 +5,11 @@
  * Copyright (c) 2013-2016 Randy Hollines
  */
 
+#include <algorithm>
+#include <utility>
 #include "runtime.h"
 #include "memory.h"
+#include "snapshot.h"
 
 using namespace runtime;
 
@@ -18,6 +21,10 @@ using namespace runtime;
   if(left.sys_klass) {                                                  \
     right = PopValue();                                                 \
     Operation call = left.sys_klass->GetOperation(oper);	              \
+    if(!call) {                                                         \
+      wcerr << L">>> Invalid operation <<<" << endl;                    \
+      exit(1);                                                          \
+    }                                                                   \
     (*call)(left, right, left);						                              \
     PushValue(left);							                                      \
     }                                                                     \
@@ -31,34 +38,169 @@ using namespace runtime;
   }                                                                     \
 }                                                                       \
 
+// operations on operands inference proved to be integers or floats: the left one is on top
+#define TYPED_CALC(FIELD, OP) {                                         \
+  const Value &left_value = execution_stack[ --execution_stack_pos ];   \
+  Value &right_value = execution_stack[ execution_stack_pos - 1 ];      \
+  right_value.value.FIELD = left_value.value.FIELD OP                   \
+    right_value.value.FIELD;                                            \
+}                                                                       \
+
+#define TYPED_COMPARE(FIELD, OP) {                                      \
+  const Value &left_value = execution_stack[ --execution_stack_pos ];   \
+  Value &right_value = execution_stack[ execution_stack_pos - 1 ];      \
+  const bool result = left_value.value.FIELD OP                         \
+    right_value.value.FIELD;                                            \
+  right_value.type = BOOL_TYPE;                                         \
+  right_value.sys_klass = BooleanClass::Instance();                     \
+  right_value.value.int_value = result;                                 \
+}                                                                       \
+
+// operand of a register instruction; negative operands index the constants
+#define OPERAND(operand) ((operand) >= 0 ? locals[operand] : constants[-(operand) - 1])
+
+// register form of CALC; the result goes to the first operand
+#define REGISTER_CALC(oper) {                                           \
+  left = OPERAND(instruction.operand2);                                 \
+  right = OPERAND(instruction.operand3);                                \
+  if(left.sys_klass) {                                                  \
+    Operation call = left.sys_klass->GetOperation(oper);                \
+    if(!call) {                                                         \
+      wcerr << L">>> Invalid operation <<<" << endl;                    \
+      exit(1);                                                          \
+    }                                                                   \
+    (*call)(left, right, left);                                         \
+    locals[instruction.operand1] = left;                                \
+  }                                                                     \
+  else if(left.user_klass) {                                            \
+    ExecutableFunction* callee = left.user_klass->GetOperation(oper);   \
+    RegisterCall(callee, left, &right, 1, instruction.operand1, ip, current_function, locals, local_size); \
+    code = current_function->GetRegisterInstructions().data();          \
+    constants = current_function->GetConstants().data();                \
+  }                                                                     \
+  else {                                                                \
+    wcerr << L">>> Invalid operation <<<" << endl;                      \
+    exit(1);                                                            \
+  }                                                                     \
+}                                                                       \
+
+// register forms of the typed operations
+#define REGISTER_TYPED_CALC(FIELD, OP) {                                \
+  left = OPERAND(instruction.operand2);                                 \
+  left.value.FIELD = left.value.FIELD OP                                \
+    OPERAND(instruction.operand3).value.FIELD;                          \
+  locals[instruction.operand1] = left;                                  \
+}                                                                       \
+
+#define REGISTER_TYPED_COMPARE(FIELD, OP) {                             \
+  left.type = BOOL_TYPE;                                                \
+  left.sys_klass = BooleanClass::Instance();                            \
+  left.user_klass = NULL;                                               \
+  left.value.int_value = OPERAND(instruction.operand2).value.FIELD OP   \
+    OPERAND(instruction.operand3).value.FIELD;                          \
+  locals[instruction.operand1] = left;                                  \
+}                                                                       \
+
+// fused compare and jump: numbers are compared here, anything else by the LES, GTR, ... that follows
+#define CMP_JMP(OP) {                                                   \
+  Value &left_value = execution_stack[ execution_stack_pos - 1 ];       \
+  Value &right_value = execution_stack[ execution_stack_pos - 2 ];      \
+  if ( left_value.type == INT_TYPE && right_value.type == INT_TYPE ) {  \
+    CompareJump( left_value.value.int_value OP                          \
+      right_value.value.int_value, instruction, ip, current_function ); \
+  }                                                                     \
+  else if ( ( left_value.type == INT_TYPE ||                            \
+              left_value.type == FLOAT_TYPE ) &&                        \
+            ( right_value.type == INT_TYPE ||                           \
+              right_value.type == FLOAT_TYPE ) ) {                      \
+    const FLOAT_T left_number = left_value.type == INT_TYPE ?           \
+      left_value.value.int_value : left_value.value.float_value;        \
+    const FLOAT_T right_number = right_value.type == INT_TYPE ?         \
+      right_value.value.int_value : right_value.value.float_value;      \
+    CompareJump( left_number OP right_number, instruction, ip,          \
+      current_function );                                               \
+  }                                                                     \
+}                                                                       \
+
 /****************************
  * TODO: doc
  ****************************/
 void Runtime::Run()
 {
-#ifdef _DEBUG
-	wcout << L"========== Executing Code =========" << endl;
-#endif
+	TRACE( TRACE_VM, TRACE_EVENTS, VM_RUN, 0 );
 
 	// set current function
 	ExecutableFunction* current_function = program->GetGlobal();
 
-	// setup locals
-	size_t local_size = program->GetGlobal()->GetLocalCount();
-	Value* locals = new Value[ local_size + 1 ];
-	for ( size_t i = 1; i < local_size; ++i ) {
-		locals[ i ].type = UNINIT_TYPE;
-	}
+	// setup locals; slot 0 is 'self' and the rest are the program's globals, unless an image restored them
+	size_t local_size = program->GetGlobal()->GetLocalCount() + 1;
+	const bool is_restored = restored_globals != nullptr;
+	Value* locals = is_restored ? restored_globals : new Value[ local_size ];
+	globals = locals;
+	restored_globals = nullptr;
 
-	// initialize 'self'
-	locals[ 0 ].type = UNINIT_TYPE;
+	MemoryManager::Instance()->SetExecutionStack( execution_stack.get(), &execution_stack_pos );
 
 	// start execution
 	Value left, right;
 	size_t ip = 0;
+
+	// an image's global scope has run: 'main' is called instead, returning to the global function's last instruction
+	if ( is_restored ) {
+		ip = current_function->GetInstructions().size() - 1;
+		ExecutableFunction* entry = program->GetFunction( L"main:0" );
+		if ( entry ) {
+			Value self;
+			FunctionCall( entry, self, 0, false, ip, current_function, locals, local_size, false );
+		}
+	}
+	if ( profiler && !profiler->Start( false ) ) {
+		wcerr << L"Profiling isn't available here" << endl;
+		profiler.reset();
+	}
+	if ( heap_stats ) {
+		heap_stats->Start( false );
+		MemoryManager::Instance()->SetStats( heap_stats.get() );
+	}
+
+	// counting pairs, sampling and tracing cost one test an instruction, and none of them is asked for most runs;
+	// a loop costs it only while it's being recorded
+	const bool is_traced = TRACE_IS_ON( TRACE_VM, TRACE_ALL );
+	const bool is_watched = !opcode_pairs.empty() || profiler || heap_stats || is_traced;
+	bool is_observed = is_watched;
+	size_t previous_type = NO_OP - LOAD_TRUE_LIT;
 	bool halt = false;
 	do {
+		// a compiled function runs until it hands an instruction back; a loop being recorded is interpreted
+		if ( methods && current_function->GetMethod() && !( tracer && tracer->IsRecording() ) ) {
+			RunMethod( current_function->GetMethod(), ip, locals, local_size );
+		}
+
 		Instruction* instruction = current_function->GetInstructions().at( ip++ );
+		if ( is_observed ) {
+			if ( Profiler::IsDue() && profiler ) {
+				profiler->Sample( current_function, ip - 1, call_stack, call_stack_pos );
+			}
+			if ( heap_stats ) {
+				heap_stats->At( current_function, ip - 1 );
+			}
+			if ( !opcode_pairs.empty() ) {
+				const size_t type = instruction->type - LOAD_TRUE_LIT;
+				opcode_pairs[ previous_type * ( NO_OP - LOAD_TRUE_LIT + 1 ) + type ]++;
+				previous_type = type;
+			}
+			if ( counters ) {
+				counters->Execute( instruction, execution_stack.get(), execution_stack_pos );
+			}
+			if ( tracer && tracer->IsRecording() ) {
+				tracer->Record( ip - 1, instruction, locals, globals, execution_stack.get() + execution_stack_pos );
+				is_observed = is_watched || tracer->IsRecording();
+			}
+			if ( is_traced ) {
+				TraceLog::Log( VM_INSTRUCTION, current_function->GetName(), ip - 1, instruction->type, instruction->operand1, instruction->operand2 );
+			}
+		}
+
 		switch ( instruction->type ) {
 		case RTRN: {
 			if ( call_stack_pos == 0 ) {
@@ -82,14 +224,13 @@ void Runtime::Run()
 
 				delete frame;
 				frame = NULL;
-#ifdef _DEBUG
-				wcout << L"=== RTRN ===" << endl;
-#endif
+				TRACE( TRACE_VM, TRACE_EVENTS, VM_RETURN, current_function->GetName(), call_stack_pos );
 			}
 		}
 				   break;
 
 		case CALL_FUNC:
+		case TAIL_CALL:
 			FunctionCall( instruction, ip, current_function, locals, local_size );
 			break;
 
@@ -98,9 +239,6 @@ void Runtime::Run()
 			left.sys_klass = BooleanClass::Instance();
 			left.user_klass = NULL;
 			left.value.int_value = 1;
-#ifdef _DEBUG
-			wcout << L"LOAD_TRUE_LIT: value=true" << endl;
-#endif
 			PushValue( left );
 			break;
 
@@ -108,24 +246,22 @@ void Runtime::Run()
 			NewArray( instruction, ip, current_function, locals, local_size );
 			break;
 
-		case NEW_STRING:
+		case NEW_STRING: {
 			left.type = STRING_TYPE;
-			left.value.ptr_value = MemoryManager::Instance()->AllocateString( locals, local_size, call_stack, call_stack_pos );
+			Value* string_value = MemoryManager::Instance()->AllocateString( locals, local_size, call_stack, call_stack_pos );
+			static_cast< wstring* >( string_value->value.ptr_value )->assign( instruction->operand5 );
+			left.value.ptr_value = string_value;
 			left.sys_klass = StringClass::Instance();
-#ifdef _DEBUG
-			wcout << L"NEW_STRING: address=" << left.value.ptr_value << endl;
-#endif
+			left.user_klass = NULL;
 			PushValue( left );
+		}
 			break;
 
 		case NEW_HASH:
 			left.type = HASH_TYPE;
 			left.value.ptr_value = MemoryManager::Instance()->AllocateHash( locals, local_size, call_stack, call_stack_pos );
-			// TODO:
-			// left.sys_klass = HashClass::Instance();
-#ifdef _DEBUG
-			wcout << L"NEW_HASH: address=" << left.value.ptr_value << endl;
-#endif
+			left.sys_klass = HashClass::Instance();
+			left.user_klass = NULL;
 			PushValue( left );
 			break;
 
@@ -138,9 +274,6 @@ void Runtime::Run()
 				// TODO: memory manager
 				Value* inst_values = MemoryManager::Instance()->AllocateClass( user_klass, locals, local_size, call_stack, call_stack_pos );
 				left.value.ptr_value = inst_values;
-#ifdef _DEBUG
-				wcout << L"NEW_OBJ: address=" << inst_values << endl;
-#endif
 				PushValue( left );
 			}
 			else {
@@ -150,14 +283,16 @@ void Runtime::Run()
 		}
 					  break;
 
+		case LOCAL_OBJ:
+			left = LocalObject( instruction->operand5, &locals[ instruction->operand1 ] );
+			PushValue( left );
+			break;
+
 		case LOAD_FALSE_LIT:
 			left.type = BOOL_TYPE;
 			left.sys_klass = BooleanClass::Instance();
 			left.user_klass = NULL;
 			left.value.int_value = 0;
-#ifdef _DEBUG
-			wcout << L"LOAD_FALSE_LIT: value=false" << endl;
-#endif
 			PushValue( left );
 			break;
 
@@ -166,9 +301,19 @@ void Runtime::Run()
 			left.sys_klass = IntegerClass::Instance();
 			left.user_klass = NULL;
 			left.value.int_value = instruction->operand1;
-#ifdef _DEBUG
-			wcout << L"LOAD_INT_LIT: value=" << left.value.int_value << endl;
-#endif
+			PushValue( left );
+			break;
+
+		case LOAD_CHAR_LIT:
+			left.type = CHAR_TYPE;
+			left.sys_klass = NULL;
+			left.user_klass = NULL;
+			left.value.char_value = static_cast< CHAR_T >( instruction->operand1 );
+			PushValue( left );
+			break;
+
+		case LOAD_NIL_LIT:
+			left = Value();
 			PushValue( left );
 			break;
 
@@ -177,76 +322,130 @@ void Runtime::Run()
 			left.sys_klass = FloatClass::Instance();
 			left.user_klass = NULL;
 			left.value.float_value = instruction->operand4;
-#ifdef _DEBUG
-			wcout << L"LOAD_FLOAT_LIT: value=" << left.value.float_value << endl;
-#endif
 			PushValue( left );
 			break;
 
 		case LOAD_VAR:
-#ifdef _DEBUG
-			wcout << L"LOAD_VAR: id=" << instruction->operand2 << endl;
-#endif
-			if ( instruction->operand1 == LOCL ) {
-				left = locals[ instruction->operand2 ];
-			}
-			else {
-				Value* instance = static_cast< Value* >( locals[ 0 ].value.ptr_value );
-				left = instance[ instruction->operand2 ];
-			}
+			PushValue( GetVariable( instruction, locals ) );
+			break;
 
-			if ( !left.sys_klass && !left.user_klass ) {
-				wcerr << L">>> Unknown variable type <<<" << endl;
-				exit( 1 );
-			}
-			PushValue( left );
+		case LOAD_FIELD:
+			PushValue( static_cast< Value* >( locals[ 0 ].value.ptr_value )[ instruction->operand2 ] );
 			break;
 
 		case STOR_VAR:
-#ifdef _DEBUG
-			wcout << L"STOR_VAR: id=" << instruction->operand2 << L", local="
-				<< ( instruction->operand1 == LOCL ? L"true" : L"false" ) << endl;
-#endif
-			left = PopValue();
-			if ( instruction->operand1 == LOCL ) {
-				locals[ instruction->operand2 ] = left;
+			GetVariable( instruction, locals ) = PopValue();
+			break;
+
+		case POP:
+			PopValue();
+			break;
+
+			// the sequence after a superinstruction runs when its operands aren't the types it handles
+		case INC_LOCAL_INT: {
+			Value &variable = locals[ instruction->operand1 ];
+			if ( variable.type == INT_TYPE ) {
+				variable.value.int_value += instruction->operand2;
+				ip += 4;
 			}
-			else {
-				Value* instance = static_cast< Value* >( locals[ 0 ].value.ptr_value );
-				instance[ instruction->operand2 ] = left;
+		}
+			break;
+
+		case LOAD_LOCAL_PAIR:
+			PushValue( locals[ instruction->operand1 ] );
+			PushValue( locals[ instruction->operand2 ] );
+			ip += 2;
+			break;
+
+		case LOAD_INT_LOCAL:
+			left.type = INT_TYPE;
+			left.sys_klass = IntegerClass::Instance();
+			left.user_klass = NULL;
+			left.value.int_value = instruction->operand1;
+			PushValue( left );
+			PushValue( locals[ instruction->operand2 ] );
+			ip += 2;
+			break;
+
+		case CMP_JMP_EQL:
+			CMP_JMP( == );
+			break;
+
+		case CMP_JMP_NEQL:
+			CMP_JMP( != );
+			break;
+
+		case CMP_JMP_GTR:
+			CMP_JMP( > );
+			break;
+
+		case CMP_JMP_LES:
+			CMP_JMP( < );
+			break;
+
+		case CMP_JMP_GTR_EQL:
+			CMP_JMP( >= );
+			break;
+
+		case CMP_JMP_LES_EQL:
+			CMP_JMP( <= );
+			break;
+
+		case KNOWN_SIZE:
+			if ( locals[ instruction->operand1 ].type == INT_TYPE ) {
+				PushValue( locals[ instruction->operand1 ] );
+				ip += 2;
 			}
 			break;
 
-		case LOAD_ARY_VAR: {
-			if ( instruction->operand1 == LOCL ) {
-				left = locals[ instruction->operand2 ];
+		// one dimension: no index to convert or check; otherwise as LOAD_ARY_VAR
+		case LOAD_ARY_ELEM:
+			left = GetVariable( instruction, locals );
+			if ( IsVector( left ) ) {
+				Value &index = execution_stack[ execution_stack_pos - 1 ];
+				index = static_cast< Value* >( left.value.ptr_value )[ index.value.int_value ];
+				break;
 			}
-			else {
-				Value* instance = static_cast< Value* >( locals[ 0 ].value.ptr_value );
-				left = instance[ instruction->operand2 ];
+			// fall through
+		case LOAD_ARY_VAR: {
+			left = GetVariable( instruction, locals );
+			if ( left.type == HASH_TYPE && instruction->operand3 == 1 ) {
+				HashTable* table = static_cast< HashTable* >( static_cast< Value* >( left.value.ptr_value )->value.ptr_value );
+				right = PopValue();
+				// a missing key reads as nil
+				Value* value = table->Find( right );
+				right = value ? *value : Value();
+				PushValue( right );
+				break;
 			}
 
 			if ( left.type != ARRAY_TYPE ) {
-				wcerr << L">>> Operation requires Integer or Float type <<<" << endl;
+				wcerr << L">>> Operation requires array type <<<" << endl;
+				exit( 1 );
 			}
 
 			Value* array = ( Value* ) left.value.ptr_value;
 			const INT_T index = ArrayIndex( instruction, array, false );
-#ifdef _DEBUG
-			wcout << L"LOAD_ARY_VAR: id=" << instruction->operand2 << L", offset=" << index
-				<< L", local=" << ( instruction->operand1 == LOCL ? L"true" : L"false" ) << endl;
-#endif
 			PushValue( array[ index ] );
 		}
 						   break;
 
-		case STOR_ARY_VAR: {
-			if ( instruction->operand1 == LOCL ) {
-				left = locals[ instruction->operand2 ];
+		case STOR_ARY_ELEM:
+			left = GetVariable( instruction, locals );
+			if ( IsVector( left ) ) {
+				const INT_T index = execution_stack[ execution_stack_pos - 1 ].value.int_value;
+				static_cast< Value* >( left.value.ptr_value )[ index ] = execution_stack[ execution_stack_pos - 2 ];
+				execution_stack_pos -= 2;
+				break;
 			}
-			else {
-				Value* instance = static_cast< Value* >( locals[ 0 ].value.ptr_value );
-				left = instance[ instruction->operand2 ];
+			// fall through
+		case STOR_ARY_VAR: {
+			left = GetVariable( instruction, locals );
+			if ( left.type == HASH_TYPE && instruction->operand3 == 1 ) {
+				HashTable* table = static_cast< HashTable* >( static_cast< Value* >( left.value.ptr_value )->value.ptr_value );
+				right = PopValue();
+				table->Insert( right, PopValue() );
+				break;
 			}
 
 			if ( left.type != ARRAY_TYPE ) {
@@ -256,32 +455,51 @@ void Runtime::Run()
 
 			Value* array = ( Value* ) left.value.ptr_value;
 			const INT_T index = ArrayIndex( instruction, array, true );
-#ifdef _DEBUG
-			wcout << L"STOR_ARY_VAR: id=" << instruction->operand2 << L", offset=" << index
-				<< L", local=" << ( instruction->operand1 == LOCL ? L"true" : L"false" ) << endl;
-#endif
 			array[ index ] = PopValue();
 		}
 						   break;
 
-						   // TODO: implement
 		case ARY_SIZE:
-#ifdef _DEBUG
-			wcout << L"ARY_SIZE" << endl;
-#endif
+			left = PopValue();
+			switch ( left.type ) {
+			case ARRAY_TYPE:
+				right.value.int_value = static_cast< INT_T >( static_cast< Mark* >( static_cast< Value* >( left.value.ptr_value )[ -1 ].value.ptr_value )->array_size );
+				break;
+
+			case HASH_TYPE:
+				right.value.int_value = static_cast< INT_T >( static_cast< HashTable* >( static_cast< Value* >( left.value.ptr_value )->value.ptr_value )->Size() );
+				break;
+
+			default:
+				wcerr << L">>> Operation requires array type <<<" << endl;
+				exit( 1 );
+			}
+			right.type = INT_TYPE;
+			right.sys_klass = IntegerClass::Instance();
+			right.user_klass = NULL;
+			PushValue( right );
+			break;
+
+		case TRY_ARY_SIZE:
+			left = SizeOrNil( PopValue() );
+			PushValue( left );
+			break;
+
+		// the collection stays on the stack while its entries are allocated
+		case ARY_ENTRIES:
+			left = Entries( execution_stack[ execution_stack_pos - 1 ], locals, local_size );
+			execution_stack[ execution_stack_pos - 1 ] = left;
 			break;
 
 			// TODO: implement
 		case LOAD_CLS:
-#ifdef _DEBUG
-			wcout << L"LOAD_CLS" << endl;
-#endif
 			break;
 
 		case LBL:
-#ifdef _DEBUG
-			wcout << L"LBL: id=" << instruction->operand1 << L", hit_count=" << instruction->operand2 << endl;
-#endif
+			if ( tracer ) {
+				EnterTrace( instruction, ip, current_function, locals );
+				is_observed = is_watched || tracer->IsRecording();
+			}
 			break;
 
 		case JMP:
@@ -289,18 +507,12 @@ void Runtime::Run()
 			switch ( instruction->operand2 ) {
 				// unconditional jump
 			case JMP_UNCND:
-#ifdef _DEBUG
-				wcout << L"JMP: unconditional, to=" << instruction->operand1 << endl;
-#endif
 				jmp_ip = GetLabelOffset( current_function, instruction->operand1 );
 				ip = jmp_ip;
 				break;
 
 				// jump true
 			case JMP_TRUE: {
-#ifdef _DEBUG
-				wcout << L"JMP: true, to=" << instruction->operand1 << endl;
-#endif
 				left = PopValue();
 				if ( left.type != BOOL_TYPE ) {
 					wcerr << L">>> Expected a boolean value <<<" << endl;
@@ -320,9 +532,6 @@ void Runtime::Run()
 
 						   // jump false
 			case JMP_FALSE: {
-#ifdef _DEBUG
-				wcout << L"JMP: false, to=" << instruction->operand1 << endl;
-#endif
 				left = PopValue();
 				if ( left.type != BOOL_TYPE ) {
 					wcerr << L">>> Expected a boolean value <<<" << endl;
@@ -342,161 +551,320 @@ void Runtime::Run()
 			}
 			break;
 
+		case JMP_TBL:
+			// operand1: lowest case, operand2: entries that follow, operand3: label taken when out of range
+			left = PopValue();
+			if ( left.type == INT_TYPE && left.value.int_value >= instruction->operand1 &&
+				left.value.int_value - instruction->operand1 < instruction->operand2 ) {
+				ip += left.value.int_value - instruction->operand1;
+			}
+			else {
+				ip = GetLabelOffset( current_function, instruction->operand3 );
+			}
+			break;
+
+		case NEW_FUNC: {
+			ExecutableFunction* function = program->GetFunction( instruction->operand5 );
+			if ( !function ) {
+				wcerr << L">>> Undefined function: name='" << instruction->operand5 << L"' <<<" << endl;
+				exit( 1 );
+			}
+			// captured values follow the function in its environment
+			const size_t capture_count = static_cast< size_t >( instruction->operand1 );
+			Value* environment = MemoryManager::Instance()->AllocateFunction( function, capture_count, locals, local_size, call_stack, call_stack_pos );
+			for ( size_t i = capture_count; i > 0; --i ) {
+				environment[ i ] = PopValue();
+			}
+			left.type = FUNC_TYPE;
+			left.sys_klass = NULL;
+			left.user_klass = NULL;
+			left.value.ptr_value = environment;
+			PushValue( left );
+		}
+			break;
+
 		case BIT_AND:
+			CALC( BIT_AND, left, right );
 			break;
 
 		case BIT_OR:
+			CALC( BIT_OR, left, right );
 			break;
 
 		case EQL:
-#ifdef _DEBUG
-			wcout << L"EQL" << endl;
-#endif
 			CALC( EQL, left, right );
 			break;
 
 		case NEQL:
-#ifdef _DEBUG
-			wcout << L"NEQL" << endl;
-#endif
 			CALC( NEQL, left, right );
 			break;
 
 		case GTR:
-#ifdef _DEBUG
-			wcout << L"GTR" << endl;
-#endif
 			CALC( GTR, left, right );
 			break;
 
 		case LES:
-#ifdef _DEBUG
-			wcout << L"LES" << endl;
-#endif
 			CALC( LES, left, right );
 			break;
 
 		case GTR_EQL:
-#ifdef _DEBUG
-			wcout << L"GTR_EQL" << endl;
-#endif
 			CALC( GTR_EQL, left, right );
 			break;
 
 		case LES_EQL:
-#ifdef _DEBUG
-			wcout << L"LES_EQL" << endl;
-#endif
 			CALC( LES_EQL, left, right );
 			break;
 
 		case ADD:
-#ifdef _DEBUG
-			wcout << L"ADD" << endl;
-#endif
 			CALC( ADD, left, right );
 			break;
 
 		case SUB:
-#ifdef _DEBUG
-			wcout << L"SUB" << endl;
-#endif
 			CALC( SUB, left, right );
 			break;
 
 		case MUL:
-#ifdef _DEBUG
-			wcout << L"MUL" << endl;
-#endif
 			CALC( MUL, left, right );
 			break;
 
 		case DIV:
-#ifdef _DEBUG
-			wcout << L"DIV" << endl;
-#endif
 			CALC( DIV, left, right );
 			break;
 
 		case MOD:
-#ifdef _DEBUG
-			wcout << L"MOD" << endl;
-#endif
 			CALC( MOD, left, right );
 			break;
 
-		case SHOW_TYPE:
-#ifdef _DEBUG
-			wcout << L"SHOW" << endl;
-#endif
-			left = PopValue();
+		case EQL_INT:
+			TYPED_COMPARE( int_value, == );
+			break;
 
-			switch ( left.type ) {
-			case BOOL_TYPE:
-				wcout << L"type=boolean, value=" << ( left.value.int_value ? L"true" : L"false" ) << endl;
-				break;
+		case NEQL_INT:
+			TYPED_COMPARE( int_value, != );
+			break;
 
-			case INT_TYPE:
-				wcout << L"type=integer, value=" << left.value.int_value << endl;
-				break;
+		case GTR_INT:
+			TYPED_COMPARE( int_value, > );
+			break;
 
-			case FLOAT_TYPE:
-				wcout << L"type=float, value=" << left.value.float_value << endl;
-				break;
+		case LES_INT:
+			TYPED_COMPARE( int_value, < );
+			break;
 
-			case UNINIT_TYPE:
-				wcout << L"type=uninit, value=Nil" << endl;
-				break;
+		case GTR_EQL_INT:
+			TYPED_COMPARE( int_value, >= );
+			break;
 
-			default:
-				wcerr << L"Invalid dump value" << endl;
-				exit( 1 );
-			}
+		case LES_EQL_INT:
+			TYPED_COMPARE( int_value, <= );
+			break;
+
+		case ADD_INT:
+			TYPED_CALC( int_value, + );
+			break;
+
+		case SUB_INT:
+			TYPED_CALC( int_value, - );
+			break;
+
+		case MUL_INT:
+			TYPED_CALC( int_value, * );
+			break;
+
+		case GTR_FLOAT:
+			TYPED_COMPARE( float_value, > );
+			break;
+
+		case LES_FLOAT:
+			TYPED_COMPARE( float_value, < );
+			break;
+
+		case GTR_EQL_FLOAT:
+			TYPED_COMPARE( float_value, >= );
+			break;
+
+		case LES_EQL_FLOAT:
+			TYPED_COMPARE( float_value, <= );
 			break;
 
+		case ADD_FLOAT:
+			TYPED_CALC( float_value, + );
+			break;
+
+		case SUB_FLOAT:
+			TYPED_CALC( float_value, - );
+			break;
+
+		case MUL_FLOAT:
+			TYPED_CALC( float_value, * );
+			break;
+
+		case DIV_FLOAT:
+			TYPED_CALC( float_value, / );
+			break;
+
+		case SHOW_TYPE:
+			left = PopValue();
+			ShowType( left );
+			break;
+
+		case MOV:
 		case NO_OP:
 			break;
 		}
 	} while ( !halt );
 
+	if ( profiler ) {
+		profiler->Stop();
+		profiler->Report();
+	}
+
+	if ( !snapshot_file.empty() && !Snapshot::Write( snapshot_file, snapshot_program, program.get(), locals, local_size ) ) {
+		wcerr << L"Unable to write image file: " << snapshot_file << endl;
+	}
+
 	delete [] locals;
 	locals = NULL;
 
-#ifdef _DEBUG
-	wcout << L"==========================" << endl;
-	wcout << L"ending stack pos=" << execution_stack_pos << endl;
-#endif
+	if ( report_pairs ) {
+		ReportOpcodePairs();
+	}
+	if ( counters ) {
+		counters->Write();
+	}
+	if ( heap_stats ) {
+		MemoryManager::Instance()->SetStats( nullptr );
+		heap_stats->Report();
+	}
+
+	TRACE( TRACE_VM, TRACE_EVENTS, VM_END, execution_stack_pos );
 }
 
-void Runtime::NewArray( Instruction* instruction, size_t &ip, ExecutableFunction* &current_function, Value* &locals, size_t &local_size )
+/****************************
+ * Most frequent pairs of
+ * consecutive instructions, with
+ * their share of all executed
+ ****************************/
+void Runtime::ReportOpcodePairs()
 {
-	FLOAT_T array_size = 0;
-	vector<Value> dimensions;
+	const size_t type_count = NO_OP - LOAD_TRUE_LIT + 1;
+	vector<std::pair<size_t, size_t>> pairs;
+	size_t total = 0;
+	for ( size_t i = 0; i < opcode_pairs.size(); ++i ) {
+		if ( opcode_pairs[ i ] ) {
+			pairs.push_back( { opcode_pairs[ i ], i } );
+			total += opcode_pairs[ i ];
+		}
+	}
+	std::sort( pairs.begin(), pairs.end(), []( std::pair<size_t, size_t> const &a, std::pair<size_t, size_t> const &b ) {
+		return a.first > b.first;
+	} );
+
+	wcerr << L"---------- instruction pairs: " << total << L" executed ----------" << endl;
+	for ( size_t i = 0; i < pairs.size() && i < 24; ++i ) {
+		const InstructionType first = static_cast< InstructionType >( pairs[ i ].second / type_count + LOAD_TRUE_LIT );
+		const InstructionType second = static_cast< InstructionType >( pairs[ i ].second % type_count + LOAD_TRUE_LIT );
+		wcerr << pairs[ i ].first << L"\t" << ( pairs[ i ].first * 100.0 / total ) << L"%\t"
+			<< InstructionName( first ) << L" " << InstructionName( second ) << endl;
+	}
+}
 
-	// calculate array size
-	Value left = PopValue();
-	dimensions.push_back( left );
-	if ( left.type == INT_TYPE ) {
-		array_size = static_cast< FLOAT_T >( left.value.int_value );
+/****************************
+ * A loop's label counts the jumps
+ * back to it. Once it's hot, the
+ * next run through the loop is
+ * recorded, and when that gets back
+ * to the label it's compiled; from
+ * then on the label runs the trace
+ * and the interpreter picks up
+ * where it leaves
+ ****************************/
+void Runtime::EnterTrace( Instruction* label, size_t &ip, ExecutableFunction* current_function, Value* locals )
+{
+	if ( tracer->IsRecording() ) {
+		if ( !tracer->IsHead( label ) ) {
+			return;
+		}
+		tracer->Finish();
 	}
-	else if ( left.type == FLOAT_TYPE ) {
-		array_size = left.value.float_value;
+	else if ( !label->operand3 && label->operand2 >= HIT_THRESHOLD ) {
+		tracer->Start( current_function, ip - 1, current_function == program->GetGlobal() );
+		return;
 	}
-	else {
-		wcerr << L">>> Array dimension size must be a numeric value <<<" << endl;
+
+	if ( label->operand3 > 0 && execution_stack_pos + TRACE_STACK_SIZE <= EXECUTION_STACK_SIZE ) {
+		Trace* trace = tracer->GetTrace( label );
+		TraceExit &exit = trace->exits[ trace->code( locals, &execution_stack[ execution_stack_pos ], globals ) ];
+		execution_stack_pos += exit.stack_count;
+		ip = exit.ip;
+		if ( exit.is_side && ++exit.hits == HOT_EXIT ) {
+			tracer->Retrace( label );
+		}
+		TRACE( TRACE_VM, TRACE_ALL, VM_TRACE_EXIT, ip );
+	}
+}
+
+/****************************
+ * Runs a compiled function from
+ * 'ip' on, with the execution
+ * stack's top and limit and what
+ * its calls back need; 'ip' is
+ * left at the instruction the
+ * interpreter runs next
+ ****************************/
+void Runtime::RunMethod( Method* method, size_t &ip, Value* locals, size_t local_size )
+{
+	NativeFrame frame;
+	frame.top = &execution_stack[ execution_stack_pos ];
+	frame.limit = &execution_stack[ EXECUTION_STACK_SIZE ];
+	frame.calls = &native_calls;
+	frame.runtime = this;
+	frame.locals = locals;
+	frame.local_size = local_size;
+	ip = method->code( locals, globals, &frame, ip );
+	execution_stack_pos = frame.top - execution_stack.get();
+}
+
+const NativeCalls Runtime::native_calls = { &Runtime::NativeNewArray };
+
+// the collector sees the stack up to the dimensions
+void Runtime::NativeNewArray( NativeStack* stack, Value* top, INT_T dimensions )
+{
+	NativeFrame* frame = static_cast< NativeFrame* >( stack );
+	Runtime* runtime = frame->runtime;
+	runtime->execution_stack_pos = top - dimensions - runtime->execution_stack.get();
+	top[ -dimensions ] = runtime->NewArray( top - dimensions, static_cast< int >( dimensions ), frame->locals, frame->local_size );
+}
+
+void Runtime::NewArray( Instruction* instruction, size_t &ip, ExecutableFunction* &current_function, Value* &locals, size_t &local_size )
+{
+	const int count = static_cast< int >( instruction->operand1 );
+	if ( execution_stack_pos < static_cast< size_t >( count ) ) {
+		wcerr << ">>> stack bounds exceeded <<<" << endl;
 		exit( 1 );
 	}
+	execution_stack_pos -= count;
 
-	int count = static_cast< int >( instruction->operand1 );
-	while ( --count ) {
-		left = PopValue();
-		dimensions.push_back( left );
+	Value array = NewArray( &execution_stack[ execution_stack_pos ], count, locals, local_size );
+	PushValue( array );
+}
 
-		if ( left.type == INT_TYPE ) {
-			array_size *= static_cast< FLOAT_T >( left.value.int_value );
+// the first dimension is last, as they were pushed
+Value Runtime::NewArray( Value* dimensions, const int count, Value* locals, size_t local_size )
+{
+	// calculate array size; in floats only if a dimension is one
+	INT_T int_size = 1;
+	FLOAT_T array_size = 1;
+	bool is_int = true;
+	for ( int i = 0; i < count; ++i ) {
+		Value &dimension = dimensions[ i ];
+		if ( dimension.type == INT_TYPE ) {
+			int_size *= dimension.value.int_value;
+			array_size *= static_cast< FLOAT_T >( dimension.value.int_value );
 		}
-		else if ( left.type == FLOAT_TYPE ) {
-			array_size *= left.value.float_value;
+		else if ( dimension.type == FLOAT_TYPE ) {
+			array_size *= dimension.value.float_value;
+			is_int = false;
 		}
 		else {
 			wcerr << L">>> Array dimension size must be a numeric value <<<" << endl;
@@ -505,88 +873,786 @@ void Runtime::NewArray( Instruction* instruction, size_t &ip, ExecutableFunction
 	}
 
 	// create array and set metadata
-	Value* array_values = MemoryManager::Instance()->AllocateArray( static_cast< INT_T >( array_size ), dimensions, locals, local_size, call_stack, call_stack_pos );
-	left.type = ARRAY_TYPE;
-	left.sys_klass = ArrayClass::Instance();
-	left.value.ptr_value = array_values;
-#ifdef _DEBUG
-	wcout << L"NEW_ARRAY: size=" << array_size << L", address=" << array_values << endl;
-#endif
-	PushValue( left );
+	if ( array_size < 0 ) {
+		wcerr << L">>> Array dimension size must not be negative <<<" << endl;
+		exit( 1 );
+	}
+
+	Value* array_values = MemoryManager::Instance()->AllocateArray( is_int ? int_size : static_cast< INT_T >( array_size ), dimensions, count, locals, local_size, call_stack, call_stack_pos );
+	Value array;
+	array.type = ARRAY_TYPE;
+	array.sys_klass = ArrayClass::Instance();
+	array.user_klass = NULL;
+	array.value.ptr_value = array_values;
+	return array;
 }
 
-void Runtime::FunctionCall( Instruction* instruction, size_t &ip, ExecutableFunction* &current_function, Value* &locals, size_t &local_size )
+Value Runtime::LocalObject( std::wstring const &name, Value* slots )
 {
-	Value left = PopValue();
-
-	if ( instruction->operand6.size() == 0 && !left.user_klass ) {
-		ExecutableFunction* callee = program->GetFunction( instruction->operand5 );
-		if ( callee ) {
-#ifdef _DEBUG
-			wcout << L"=== CALL_FUNC: function='" << instruction->operand5 << L"' ===" << endl;
-#endif
-			FunctionCall( callee, left, instruction->operand1, instruction->operand2 != 0, ip, current_function, locals, local_size );
-		}
-		else {
-#ifdef _DEBUG
-			wcout << L"=== CALL_FUNC: class='" << left.sys_klass->GetName() << L"', method='" << instruction->operand5 << L"'" << endl;
-#endif
-			Function function = left.sys_klass->GetFunction( instruction->operand5 );
-			if ( !function ) {
-				wcerr << L">>> Uninitialized function reference <<<" << endl;
-				exit( 1 );
-			}
-			function( left, execution_stack.get(), execution_stack_pos, instruction->operand1 );
-		}
-	}
-	else if ( left.type == CLS_TYPE ) {
-#ifdef _DEBUG
-		wcout << L"=== CALL_FUNC: class='" << left.user_klass->GetName() << L"', method='" << instruction->operand5 << L"'" << endl;
-#endif
-		ExecutableFunction* callee = left.user_klass->GetFunction( instruction->operand5 );
-		FunctionCall( callee, left, instruction->operand1, instruction->operand2 != 0, ip, current_function, locals, local_size );
-	}
-	else {
-		wcerr << L">>> Uninitialized function reference <<<" << endl;
+	ExecutableClass* user_klass = program->GetClass( name );
+	if ( !user_klass ) {
+		wcerr << L">>> Undefiend class: name='" << name << "' <<<" << endl;
 		exit( 1 );
 	}
+
+	slots[ 0 ] = Value();
+	slots[ 0 ].type = META_TYPE;
+	slots[ 0 ].value.ptr_value = MemoryManager::Instance()->FrameMark( user_klass );
+	const int inst_count = user_klass->GetInstanceCount();
+	for ( int i = 1; i <= inst_count; ++i ) {
+		slots[ i ] = Value();
+	}
+
+	Value object;
+	object.type = CLS_TYPE;
+	object.user_klass = user_klass;
+	object.sys_klass = NULL;
+	object.value.ptr_value = slots + 1;
+	return object;
 }
 
-void Runtime::FunctionCall( ExecutableFunction* callee, Value &left, long param_count,
-	bool has_return, size_t &ip, ExecutableFunction* &current_function, Value* &locals, size_t &local_size )
+Value Runtime::SizeOrNil( Value const &value )
 {
-	if ( !callee ) {
-		wcerr << L">>> Unknown function <<<" << endl;
-		exit( 1 );
+	Value size;
+	if ( value.type == ARRAY_TYPE ) {
+		size.type = INT_TYPE;
+		size.sys_klass = IntegerClass::Instance();
+		size.value.int_value = static_cast< INT_T >( static_cast< Mark* >( static_cast< Value* >( value.value.ptr_value )[ -1 ].value.ptr_value )->array_size );
 	}
+	return size;
+}
 
-	if ( callee->GetParameterCount() != param_count ) {
-		wcerr << L">>> Incorrect number of calling parameters <<<" << endl;
+Value Runtime::Entries( Value const &value, Value* locals, size_t local_size )
+{
+	if ( value.type == ARRAY_TYPE ) {
+		return value;
+	}
+	if ( value.type != HASH_TYPE ) {
+		wcerr << L">>> foreach requires an array or a hash <<<" << endl;
 		exit( 1 );
 	}
 
-	// push stack frame
-	Frame* frame = new Frame;
-	frame->ip = ip;
-	frame->function = current_function;
-	frame->locals = locals;
-	frame->local_size = local_size;
-
-	// function returns an orphan value
-	if ( callee->ReturnsValue() && !has_return ) {
-		frame->orphan_return = true;
-	}
-	else {
-		frame->orphan_return = false;
+	// may collect; 'value' is still rooted where the caller found it
+	std::vector<std::pair<Value, Value>> &entries = static_cast< HashTable* >( static_cast< Value* >( value.value.ptr_value )->value.ptr_value )->GetEntries();
+	Value size( INT_TYPE );
+	size.value.int_value = static_cast< INT_T >( entries.size() );
+	Value array = NewArray( &size, 1, locals, local_size );
+
+	// the new array isn't rooted, so its entries are allocated without collecting
+	Value pair_size( INT_TYPE );
+	pair_size.value.int_value = 2;
+	Value* elements = static_cast< Value* >( array.value.ptr_value );
+	for ( size_t i = 0; i < entries.size(); ++i ) {
+		Value* pair = MemoryManager::Instance()->AllocateArray( 2, &pair_size, 1 );
+		pair[ 0 ] = entries[ i ].first;
+		pair[ 1 ] = entries[ i ].second;
+		elements[ i ].type = ARRAY_TYPE;
+		elements[ i ].sys_klass = HashEntryClass::Instance();
+		elements[ i ].user_klass = NULL;
+		elements[ i ].value.ptr_value = pair;
 	}
-	PushFrame( frame );
 
-	current_function = callee;
-	const size_t size = current_function->GetLocalCount() + 1;
+	return array;
+}
+
+void Runtime::ShowType( Value &value )
+{
+	switch ( value.type ) {
+	case BOOL_TYPE:
+		wcout << L"type=boolean, value=" << ( value.value.int_value ? L"true" : L"false" ) << endl;
+		break;
+
+	case INT_TYPE:
+		wcout << L"type=integer, value=" << value.value.int_value << endl;
+		break;
+
+	case FLOAT_TYPE:
+		wcout << L"type=float, value=" << value.value.float_value << endl;
+		break;
+
+	case CHAR_TYPE:
+		wcout << L"type=char, value=" << value.value.char_value << endl;
+		break;
+
+	case STRING_TYPE:
+		wcout << L"type=string, value=" << *static_cast< wstring* >( static_cast< Value* >( value.value.ptr_value )->value.ptr_value ) << endl;
+		break;
+
+	case ARRAY_TYPE:
+		wcout << L"type=array, size=" << static_cast< Mark* >( static_cast< Value* >( value.value.ptr_value )[ -1 ].value.ptr_value )->array_size << endl;
+		break;
+
+	case HASH_TYPE:
+		wcout << L"type=hash, size=" << static_cast< HashTable* >( static_cast< Value* >( value.value.ptr_value )->value.ptr_value )->Size() << endl;
+		break;
+
+	case CLS_TYPE:
+		wcout << L"type=object, class=" << value.user_klass->GetName() << endl;
+		break;
+
+	case FUNC_TYPE:
+		wcout << L"type=function, name=" << static_cast< ExecutableFunction* >( static_cast< Value* >( value.value.ptr_value )[ 0 ].value.ptr_value )->GetName() << endl;
+		break;
+
+	case UNINIT_TYPE:
+		wcout << L"type=uninit, value=Nil" << endl;
+		break;
+
+	default:
+		wcerr << L"Invalid dump value" << endl;
+		exit( 1 );
+	}
+}
+
+void Runtime::FunctionCall( Instruction* instruction, size_t &ip, ExecutableFunction* &current_function, Value* &locals, size_t &local_size )
+{
+	Value left = PopValue();
+
+	// closures carry their function ahead of the captured values; the environment becomes 'self'
+	if ( left.type == FUNC_TYPE ) {
+		ExecutableFunction* callee = static_cast< ExecutableFunction* >( static_cast< Value* >( left.value.ptr_value )[ 0 ].value.ptr_value );
+		if ( counters ) {
+			counters->Call( instruction, current_function, ip - 1, Counters::CLOSURE, callee, true );
+		}
+		FunctionCall( callee, left, instruction->operand1, instruction->operand2 != 0, ip, current_function, locals, local_size,
+			instruction->type == TAIL_CALL );
+	}
+	else if ( instruction->operand5.empty() ) {
+		wcerr << L">>> Value is not callable <<<" << endl;
+		exit( 1 );
+	}
+	else if ( left.type == CLS_TYPE ) {
+		ExecutableFunction* callee = left.user_klass->GetFunction( instruction->operand5 );
+		if ( counters ) {
+			counters->Call( instruction, current_function, ip - 1, Counters::METHOD, left.user_klass, callee != nullptr );
+		}
+		if ( !callee ) {
+			wcerr << L">>> Undefined method: class='" << left.user_klass->GetName() << L"', name='" << instruction->operand5 << L"' <<<" << endl;
+			exit( 1 );
+		}
+		FunctionCall( callee, left, instruction->operand1, instruction->operand2 != 0, ip, current_function, locals, local_size,
+			instruction->type == TAIL_CALL );
+	}
+	else if ( !left.sys_klass ) {
+		ExecutableFunction* callee = program->GetFunction( instruction->operand5 );
+		if ( counters ) {
+			counters->Call( instruction, current_function, ip - 1, Counters::FUNCTION, callee, callee != nullptr );
+		}
+		if ( !callee ) {
+			wcerr << L">>> Undefined function: name='" << instruction->operand5 << L"' <<<" << endl;
+			exit( 1 );
+		}
+		FunctionCall( callee, left, instruction->operand1, instruction->operand2 != 0, ip, current_function, locals, local_size,
+			instruction->type == TAIL_CALL );
+	}
+	else {
+		TRACE( TRACE_VM, TRACE_EVENTS, VM_CALL, left.sys_klass->GetName() + L"." + instruction->operand5, call_stack_pos );
+		Function function = left.sys_klass->GetFunction( instruction->operand5 );
+		if ( counters ) {
+			counters->Call( instruction, current_function, ip - 1, Counters::BUILTIN, left.sys_klass, function != nullptr );
+		}
+		if ( !function ) {
+			wcerr << L">>> Undefined method: class='" << left.sys_klass->GetName() << L"', name='" << instruction->operand5 << L"' <<<" << endl;
+			exit( 1 );
+		}
+		function( left, execution_stack.get(), execution_stack_pos, instruction->operand1 );
+		// built-ins always leave a result
+		if ( !instruction->operand2 ) {
+			PopValue();
+		}
+	}
+}
+
+void Runtime::FunctionCall( ExecutableFunction* callee, Value &left, long param_count,
+	bool has_return, size_t &ip, ExecutableFunction* &current_function, Value* &locals, size_t &local_size, bool tail_call )
+{
+	if ( !callee ) {
+		wcerr << L">>> Unknown function <<<" << endl;
+		exit( 1 );
+	}
+
+	if ( callee->GetParameterCount() != param_count ) {
+		wcerr << L">>> Incorrect number of calling parameters <<<" << endl;
+		exit( 1 );
+	}
+
+	if ( methods && !callee->GetMethod() && callee->CountCall() == CALL_THRESHOLD ) {
+		callee->SetMethod( methods->Compile( callee ) );
+	}
+
+	// a call in tail position takes over the caller's frame; its locals are cleared, or grown
+	const size_t size = callee->GetLocalCount() + 1;
+	if ( tail_call && call_stack_pos > 0 ) {
+		if ( size > local_size ) {
+			delete [] locals;
+			locals = new Value[ size ];
+			local_size = size;
+		}
+		else {
+			for ( size_t i = 0; i < local_size; ++i ) {
+				locals[ i ] = Value();
+			}
+		}
+		TRACE( TRACE_VM, TRACE_EVENTS, VM_TAIL_CALL, callee->GetName(), call_stack_pos );
+		current_function = callee;
+		locals[ 0 ] = left;
+		ip = 0;
+		return;
+	}
+	TRACE( TRACE_VM, TRACE_EVENTS, VM_CALL, callee->GetName(), call_stack_pos );
+
+	// push stack frame
+	Frame* frame = new Frame;
+	frame->ip = ip;
+	frame->function = current_function;
+	frame->locals = locals;
+	frame->local_size = local_size;
+
+	frame->return_register = -1;
+
+	// function returns an orphan value
+	if ( callee->ReturnsValue() && !has_return ) {
+		frame->orphan_return = true;
+	}
+	else {
+		frame->orphan_return = false;
+	}
+	PushFrame( frame );
+
+	current_function = callee;
 	locals = new Value[ size ];
 	local_size = size;
-	locals[ 0 ].type = left.type;
-	locals[ 0 ].user_klass = left.user_klass;
-	locals[ 0 ].value.ptr_value = left.value.ptr_value;
+	locals[ 0 ] = left;
+	ip = 0;
+}
+
+/****************************
+ * Executes the register form
+ * of the program
+ ****************************/
+void Runtime::RunRegisters()
+{
+	TRACE( TRACE_VM, TRACE_EVENTS, VM_RUN, 1 );
+
+	// set current function
+	ExecutableFunction* current_function = program->GetGlobal();
+	RegisterInstruction* code = current_function->GetRegisterInstructions().data();
+	Value* constants = current_function->GetConstants().data();
+
+	// setup slots; the program's globals are those of the global function
+	size_t local_size = current_function->GetRegisterCount();
+	Value* locals = new Value[ local_size ];
+	globals = locals;
+
+	MemoryManager::Instance()->SetExecutionStack( execution_stack.get(), &execution_stack_pos );
+
+	if ( profiler && !profiler->Start( true ) ) {
+		wcerr << L"Profiling isn't available here" << endl;
+		profiler.reset();
+	}
+	if ( heap_stats ) {
+		heap_stats->Start( true );
+		MemoryManager::Instance()->SetStats( heap_stats.get() );
+	}
+
+	// start execution
+	Value left, right;
+	size_t ip = 0;
+	const bool is_observed = profiler || heap_stats || TRACE_IS_ON( TRACE_VM, TRACE_ALL );
+	bool halt = false;
+	do {
+		RegisterInstruction &instruction = code[ ip++ ];
+		if ( is_observed ) {
+			if ( profiler && Profiler::IsDue() ) {
+				profiler->Sample( current_function, ip - 1, call_stack, call_stack_pos );
+			}
+			if ( heap_stats ) {
+				heap_stats->At( current_function, ip - 1 );
+			}
+			TRACE( TRACE_VM, TRACE_ALL, VM_INSTRUCTION, current_function->GetName(), ip - 1, instruction.type, instruction.operand1, instruction.operand2 );
+		}
+		switch ( instruction.type ) {
+		case MOV:
+			locals[ instruction.operand1 ] = OPERAND( instruction.operand2 );
+			break;
+
+			// locals are slots; only globals and instance variables are loaded
+		case LOAD_VAR:
+			if ( instruction.operand2 == GLOB ) {
+				locals[ instruction.operand1 ] = globals[ instruction.operand3 ];
+			}
+			else {
+				locals[ instruction.operand1 ] = static_cast< Value* >( locals[ 0 ].value.ptr_value )[ instruction.operand3 ];
+			}
+			break;
+
+		case STOR_VAR:
+			if ( instruction.operand2 == GLOB ) {
+				globals[ instruction.operand3 ] = OPERAND( instruction.operand1 );
+			}
+			else {
+				static_cast< Value* >( locals[ 0 ].value.ptr_value )[ instruction.operand3 ] = OPERAND( instruction.operand1 );
+			}
+			break;
+
+		case RTRN: {
+			if ( call_stack_pos == 0 ) {
+				halt = true;
+				break;
+			}
+
+			Value value = instruction.operand2 ? OPERAND( instruction.operand1 ) : Value();
+			Frame* frame = PopFrame();
+			// locals
+			delete [] locals;
+			locals = frame->locals;
+			local_size = frame->local_size;
+
+			// ip
+			ip = frame->ip;
+			current_function = frame->function;
+			code = current_function->GetRegisterInstructions().data();
+			constants = current_function->GetConstants().data();
+
+			if ( frame->return_register >= 0 ) {
+				locals[ frame->return_register ] = value;
+			}
+
+			delete frame;
+			frame = NULL;
+			TRACE( TRACE_VM, TRACE_EVENTS, VM_RETURN, current_function->GetName(), call_stack_pos );
+		}
+				   break;
+
+		case CALL_FUNC:
+		case TAIL_CALL:
+			RegisterCall( instruction, ip, current_function, locals, local_size );
+			code = current_function->GetRegisterInstructions().data();
+			constants = current_function->GetConstants().data();
+			break;
+
+		// the first dimension is in the last slot
+		case NEW_ARRAY:
+			locals[ instruction.operand1 ] = NewArray( &locals[ instruction.operand2 ], static_cast< int >( instruction.operand3 ), locals, local_size );
+			break;
+
+		case NEW_STRING: {
+			left.type = STRING_TYPE;
+			Value* string_value = MemoryManager::Instance()->AllocateString( locals, local_size, call_stack, call_stack_pos );
+			static_cast< wstring* >( string_value->value.ptr_value )->assign( instruction.operand5 );
+			left.value.ptr_value = string_value;
+			left.sys_klass = StringClass::Instance();
+			left.user_klass = NULL;
+			locals[ instruction.operand1 ] = left;
+		}
+			break;
+
+		case NEW_HASH:
+			left.type = HASH_TYPE;
+			left.value.ptr_value = MemoryManager::Instance()->AllocateHash( locals, local_size, call_stack, call_stack_pos );
+			left.sys_klass = HashClass::Instance();
+			left.user_klass = NULL;
+			locals[ instruction.operand1 ] = left;
+			break;
+
+		case NEW_OBJ: {
+			ExecutableClass* user_klass = program->GetClass( instruction.operand5 );
+			if ( !user_klass ) {
+				wcerr << L">>> Undefiend class: name='" << instruction.operand5 << "' <<<" << endl;
+				exit( 1 );
+			}
+			left.type = CLS_TYPE;
+			left.user_klass = user_klass;
+			left.sys_klass = NULL;
+			left.value.ptr_value = MemoryManager::Instance()->AllocateClass( user_klass, locals, local_size, call_stack, call_stack_pos );
+			locals[ instruction.operand1 ] = left;
+		}
+			break;
+
+		case LOCAL_OBJ:
+			locals[ instruction.operand1 ] = LocalObject( instruction.operand5, &locals[ instruction.operand2 ] );
+			break;
+
+		case NEW_FUNC: {
+			ExecutableFunction* function = program->GetFunction( instruction.operand5 );
+			if ( !function ) {
+				wcerr << L">>> Undefined function: name='" << instruction.operand5 << L"' <<<" << endl;
+				exit( 1 );
+			}
+			// captured values follow the function in its environment
+			const size_t capture_count = static_cast< size_t >( instruction.operand3 );
+			Value* environment = MemoryManager::Instance()->AllocateFunction( function, capture_count, locals, local_size, call_stack, call_stack_pos );
+			for ( size_t i = 1; i <= capture_count; ++i ) {
+				environment[ i ] = locals[ instruction.operand2 + i - 1 ];
+			}
+			left.type = FUNC_TYPE;
+			left.sys_klass = NULL;
+			left.user_klass = NULL;
+			left.value.ptr_value = environment;
+			locals[ instruction.operand1 ] = left;
+		}
+			break;
+
+		case LOAD_ARY_ELEM:
+			left = OPERAND( instruction.operand2 );
+			if ( IsVector( left ) ) {
+				locals[ instruction.operand1 ] = static_cast< Value* >( left.value.ptr_value )[ OPERAND( instruction.operand3 ).value.int_value ];
+				break;
+			}
+			// fall through
+		case LOAD_ARY_VAR: {
+			left = OPERAND( instruction.operand2 );
+			if ( left.type == HASH_TYPE && instruction.operand4 == 1 ) {
+				HashTable* table = static_cast< HashTable* >( static_cast< Value* >( left.value.ptr_value )->value.ptr_value );
+				// a missing key reads as nil
+				Value* value = table->Find( OPERAND( instruction.operand3 ) );
+				locals[ instruction.operand1 ] = value ? *value : Value();
+				break;
+			}
+
+			if ( left.type != ARRAY_TYPE ) {
+				wcerr << L">>> Operation requires array type <<<" << endl;
+				exit( 1 );
+			}
+
+			Value* array = ( Value* ) left.value.ptr_value;
+			const int dimensions = static_cast< int >( instruction.operand4 );
+			Value* indices = dimensions == 1 ? &OPERAND( instruction.operand3 ) : &locals[ instruction.operand3 + dimensions - 1 ];
+			locals[ instruction.operand1 ] = array[ ArrayIndex( indices, dimensions, array ) ];
+		}
+						   break;
+
+		case STOR_ARY_ELEM:
+			left = OPERAND( instruction.operand2 );
+			if ( IsVector( left ) ) {
+				static_cast< Value* >( left.value.ptr_value )[ OPERAND( instruction.operand3 ).value.int_value ] = OPERAND( instruction.operand1 );
+				break;
+			}
+			// fall through
+		case STOR_ARY_VAR: {
+			left = OPERAND( instruction.operand2 );
+			if ( left.type == HASH_TYPE && instruction.operand4 == 1 ) {
+				HashTable* table = static_cast< HashTable* >( static_cast< Value* >( left.value.ptr_value )->value.ptr_value );
+				table->Insert( OPERAND( instruction.operand3 ), OPERAND( instruction.operand1 ) );
+				break;
+			}
+
+			if ( left.type != ARRAY_TYPE ) {
+				wcerr << L">>> Operation requires array type <<<" << endl;
+				exit( 1 );
+			}
+
+			Value* array = ( Value* ) left.value.ptr_value;
+			const int dimensions = static_cast< int >( instruction.operand4 );
+			Value* indices = dimensions == 1 ? &OPERAND( instruction.operand3 ) : &locals[ instruction.operand3 + dimensions - 1 ];
+			array[ ArrayIndex( indices, dimensions, array ) ] = OPERAND( instruction.operand1 );
+		}
+						   break;
+
+		case ARY_SIZE:
+			left = OPERAND( instruction.operand2 );
+			switch ( left.type ) {
+			case ARRAY_TYPE:
+				right.value.int_value = static_cast< INT_T >( static_cast< Mark* >( static_cast< Value* >( left.value.ptr_value )[ -1 ].value.ptr_value )->array_size );
+				break;
+
+			case HASH_TYPE:
+				right.value.int_value = static_cast< INT_T >( static_cast< HashTable* >( static_cast< Value* >( left.value.ptr_value )->value.ptr_value )->Size() );
+				break;
+
+			default:
+				wcerr << L">>> Operation requires array type <<<" << endl;
+				exit( 1 );
+			}
+			right.type = INT_TYPE;
+			right.sys_klass = IntegerClass::Instance();
+			right.user_klass = NULL;
+			locals[ instruction.operand1 ] = right;
+			break;
+
+		case TRY_ARY_SIZE:
+			locals[ instruction.operand1 ] = SizeOrNil( OPERAND( instruction.operand2 ) );
+			break;
+
+		case ARY_ENTRIES:
+			locals[ instruction.operand1 ] = Entries( OPERAND( instruction.operand2 ), locals, local_size );
+			break;
+
+		// the size a loop kept stands for the call that follows, if its array was one
+		case KNOWN_SIZE:
+			if ( locals[ instruction.operand2 ].type == INT_TYPE ) {
+				locals[ instruction.operand1 ] = locals[ instruction.operand2 ];
+				ip++;
+			}
+			break;
+
+		case JMP:
+			if ( instruction.operand2 == JMP_UNCND ) {
+				ip = instruction.operand1;
+				break;
+			}
+
+			left = OPERAND( instruction.operand3 );
+			if ( left.type != BOOL_TYPE ) {
+				wcerr << L">>> Expected a boolean value <<<" << endl;
+				exit( 1 );
+			}
+			if ( ( left.value.int_value != 0 ) == ( instruction.operand2 == JMP_TRUE ) ) {
+				ip = instruction.operand1;
+			}
+			break;
+
+		case JMP_TBL:
+			// operand2: lowest case, operand3: entries that follow, operand4: target when out of range
+			left = OPERAND( instruction.operand1 );
+			if ( left.type == INT_TYPE && left.value.int_value >= instruction.operand2 &&
+				left.value.int_value - instruction.operand2 < instruction.operand3 ) {
+				ip += left.value.int_value - instruction.operand2;
+			}
+			else {
+				ip = instruction.operand4;
+			}
+			break;
+
+		case BIT_AND:
+			REGISTER_CALC( BIT_AND );
+			break;
+
+		case BIT_OR:
+			REGISTER_CALC( BIT_OR );
+			break;
+
+		case EQL:
+			REGISTER_CALC( EQL );
+			break;
+
+		case NEQL:
+			REGISTER_CALC( NEQL );
+			break;
+
+		case GTR:
+			REGISTER_CALC( GTR );
+			break;
+
+		case LES:
+			REGISTER_CALC( LES );
+			break;
+
+		case GTR_EQL:
+			REGISTER_CALC( GTR_EQL );
+			break;
+
+		case LES_EQL:
+			REGISTER_CALC( LES_EQL );
+			break;
+
+		case ADD:
+			REGISTER_CALC( ADD );
+			break;
+
+		case SUB:
+			REGISTER_CALC( SUB );
+			break;
+
+		case MUL:
+			REGISTER_CALC( MUL );
+			break;
+
+		case DIV:
+			REGISTER_CALC( DIV );
+			break;
+
+		case MOD:
+			REGISTER_CALC( MOD );
+			break;
+
+		case EQL_INT:
+			REGISTER_TYPED_COMPARE( int_value, == );
+			break;
+
+		case NEQL_INT:
+			REGISTER_TYPED_COMPARE( int_value, != );
+			break;
+
+		case GTR_INT:
+			REGISTER_TYPED_COMPARE( int_value, > );
+			break;
+
+		case LES_INT:
+			REGISTER_TYPED_COMPARE( int_value, < );
+			break;
+
+		case GTR_EQL_INT:
+			REGISTER_TYPED_COMPARE( int_value, >= );
+			break;
+
+		case LES_EQL_INT:
+			REGISTER_TYPED_COMPARE( int_value, <= );
+			break;
+
+		case ADD_INT:
+			REGISTER_TYPED_CALC( int_value, + );
+			break;
+
+		case SUB_INT:
+			REGISTER_TYPED_CALC( int_value, - );
+			break;
+
+		case MUL_INT:
+			REGISTER_TYPED_CALC( int_value, * );
+			break;
+
+		case GTR_FLOAT:
+			REGISTER_TYPED_COMPARE( float_value, > );
+			break;
+
+		case LES_FLOAT:
+			REGISTER_TYPED_COMPARE( float_value, < );
+			break;
+
+		case GTR_EQL_FLOAT:
+			REGISTER_TYPED_COMPARE( float_value, >= );
+			break;
+
+		case LES_EQL_FLOAT:
+			REGISTER_TYPED_COMPARE( float_value, <= );
+			break;
+
+		case ADD_FLOAT:
+			REGISTER_TYPED_CALC( float_value, + );
+			break;
+
+		case SUB_FLOAT:
+			REGISTER_TYPED_CALC( float_value, - );
+			break;
+
+		case MUL_FLOAT:
+			REGISTER_TYPED_CALC( float_value, * );
+			break;
+
+		case DIV_FLOAT:
+			REGISTER_TYPED_CALC( float_value, / );
+			break;
+
+		case SHOW_TYPE:
+			left = OPERAND( instruction.operand1 );
+			ShowType( left );
+			break;
+
+			// literals, pops and labels don't survive lowering
+		default:
+			break;
+		}
+	} while ( !halt );
+
+	if ( profiler ) {
+		profiler->Stop();
+		profiler->Report();
+	}
+	if ( heap_stats ) {
+		MemoryManager::Instance()->SetStats( nullptr );
+		heap_stats->Report();
+	}
+
+	delete [] locals;
+	locals = NULL;
+
+	TRACE( TRACE_VM, TRACE_EVENTS, VM_END, 0 );
+}
+
+void Runtime::RegisterCall( RegisterInstruction &instruction, size_t &ip, ExecutableFunction* &current_function, Value* &locals, size_t &local_size )
+{
+	Value* constants = current_function->GetConstants().data();
+	Value self = OPERAND( instruction.operand2 );
+	Value* arguments = &locals[ instruction.operand3 ];
+
+	// closures carry their function ahead of the captured values; the environment becomes 'self'
+	if ( self.type == FUNC_TYPE ) {
+		ExecutableFunction* callee = static_cast< ExecutableFunction* >( static_cast< Value* >( self.value.ptr_value )[ 0 ].value.ptr_value );
+		RegisterCall( callee, self, arguments, instruction.operand4, instruction.operand1, ip, current_function, locals, local_size,
+			instruction.type == TAIL_CALL );
+	}
+	else if ( instruction.operand5.empty() ) {
+		wcerr << L">>> Value is not callable <<<" << endl;
+		exit( 1 );
+	}
+	else if ( self.type == CLS_TYPE ) {
+		ExecutableFunction* callee = self.user_klass->GetFunction( instruction.operand5 );
+		if ( !callee ) {
+			wcerr << L">>> Undefined method: class='" << self.user_klass->GetName() << L"', name='" << instruction.operand5 << L"' <<<" << endl;
+			exit( 1 );
+		}
+		RegisterCall( callee, self, arguments, instruction.operand4, instruction.operand1, ip, current_function, locals, local_size,
+			instruction.type == TAIL_CALL );
+	}
+	else if ( !self.sys_klass ) {
+		ExecutableFunction* callee = program->GetFunction( instruction.operand5 );
+		if ( !callee ) {
+			wcerr << L">>> Undefined function: name='" << instruction.operand5 << L"' <<<" << endl;
+			exit( 1 );
+		}
+		RegisterCall( callee, self, arguments, instruction.operand4, instruction.operand1, ip, current_function, locals, local_size,
+			instruction.type == TAIL_CALL );
+	}
+	else {
+		Function function = self.sys_klass->GetFunction( instruction.operand5 );
+		if ( !function ) {
+			wcerr << L">>> Undefined method: class='" << self.sys_klass->GetName() << L"', name='" << instruction.operand5 << L"' <<<" << endl;
+			exit( 1 );
+		}
+		TRACE( TRACE_VM, TRACE_EVENTS, VM_CALL, self.sys_klass->GetName() + L"." + instruction.operand5, call_stack_pos );
+		// built-ins take their arguments on the execution stack, the first on top
+		for ( INT_T i = 0; i < instruction.operand4; ++i ) {
+			PushValue( arguments[ i ] );
+		}
+		function( self, execution_stack.get(), execution_stack_pos, instruction.operand4 );
+		Value result = PopValue();
+		if ( instruction.operand1 >= 0 ) {
+			locals[ instruction.operand1 ] = result;
+		}
+	}
+}
+
+void Runtime::RegisterCall( ExecutableFunction* callee, Value &self, Value* arguments, INT_T argument_count, INT_T return_register,
+	size_t &ip, ExecutableFunction* &current_function, Value* &locals, size_t &local_size, bool tail_call )
+{
+	if ( !callee ) {
+		wcerr << L">>> Unknown function <<<" << endl;
+		exit( 1 );
+	}
+	TRACE( TRACE_VM, TRACE_EVENTS, tail_call ? VM_TAIL_CALL : VM_CALL, callee->GetName(), call_stack_pos );
+
+	if ( callee->GetParameterCount() != argument_count ) {
+		wcerr << L">>> Incorrect number of calling parameters <<<" << endl;
+		exit( 1 );
+	}
+
+	// a call in tail position returns where the caller would have; the arguments are in the caller's slots
+	const bool reuse_frame = tail_call && call_stack_pos > 0;
+	if ( !reuse_frame ) {
+		Frame* frame = new Frame;
+		frame->ip = ip;
+		frame->function = current_function;
+		frame->locals = locals;
+		frame->local_size = local_size;
+		frame->orphan_return = false;
+		frame->return_register = return_register;
+		PushFrame( frame );
+	}
+
+	// arguments go straight to the parameters; the first is last
+	const size_t size = callee->GetRegisterCount();
+	Value* callee_locals = new Value[ size ];
+	callee_locals[ 0 ] = self;
+	for ( INT_T i = 1; i <= argument_count; ++i ) {
+		callee_locals[ i ] = arguments[ argument_count - i ];
+	}
+	if ( reuse_frame ) {
+		delete [] locals;
+	}
+
+	current_function = callee;
+	locals = callee_locals;
+	local_size = size;
 	ip = 0;
 }
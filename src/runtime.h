@@ -10,6 +10,10 @@
 
 #include <memory>
 #include "classes.h"
+#include "jit.h"
+#include "profiler.h"
+#include "counters.h"
+#include "heapstats.h"
 
 namespace runtime {
 	/****************************
@@ -21,6 +25,7 @@ namespace runtime {
 		Value* locals;
 		size_t local_size;
 		bool orphan_return;
+		INT_T return_register;		// register machine slot taking the result, or -1
 	} Frame;
 
 	/****************************
@@ -35,6 +40,34 @@ namespace runtime {
 		// call stack
 		Frame** call_stack;
 		size_t call_stack_pos;
+		// locals of the global function
+		Value* globals;
+		// executions of each pair of consecutive instruction types, when counted, and whether the most frequent are reported
+		std::vector<size_t> opcode_pairs;
+		bool report_pairs;
+		// what else is counted, when asked to
+		std::unique_ptr<Counters> counters;
+		// records and compiles hot loops, when asked to
+		std::unique_ptr<TraceRecorder> tracer;
+		// compiles the functions called most, when asked to
+		std::unique_ptr<NativeMethods> methods;
+		// where the heap is written when the global scope ends, with the program as it was before it ran
+		std::wstring snapshot_file;
+		std::string snapshot_program;
+		// an image's globals, taking the place of the global scope
+		Value* restored_globals;
+		// samples where the program spends its time, when asked to
+		std::unique_ptr<Profiler> profiler;
+		// what the collector does and where the program allocates, when asked to
+		std::unique_ptr<HeapStats> heap_stats;
+
+		// a compiled function's stack, with what its calls back need of the function it runs
+		struct NativeFrame : NativeStack {
+			Runtime* runtime;
+			Value* locals;
+			size_t local_size;
+		};
+		static const NativeCalls native_calls;
 
 		//
 		// Calculation stack operations
@@ -49,42 +82,7 @@ namespace runtime {
 				exit( 1 );
 			}
 
-#ifdef _DEBUG
-			wcout << L"  push: type=";
-			switch ( value.type ) {
-			case BOOL_TYPE:
-				wcout << L"boolean; value=" << ( value.value.int_value ? L"true" : L"false" ) << L"; stack_pos=" << execution_stack_pos << endl;
-				break;
-
-			case INT_TYPE:
-				wcout << L"integer; value=" << value.value.int_value << L"; stack_pos=" << execution_stack_pos << endl;
-				break;
-
-			case FLOAT_TYPE:
-				wcout << L"float; value=" << value.value.float_value << L"; stack_pos=" << execution_stack_pos << endl;
-				break;
-
-			case CLS_TYPE:
-				wcout << L"system object; address=" << value.value.ptr_value << L"; stack_pos=" << execution_stack_pos << endl;
-				break;
-
-			case ARRAY_TYPE:
-				wcout << L"array; address=" << value.value.ptr_value << "; stack_pos=" << execution_stack_pos << endl;
-				break;
-
-			case STRING_TYPE:
-				wcout << L"string; address=" << value.value.ptr_value << "; stack_pos=" << execution_stack_pos << endl;
-				break;
-
-			case UNINIT_TYPE:
-				wcout << L"uninitialized" << endl;
-				break;
-
-				// TODO:
-			default:
-				break;
-			}
-#endif
+			TRACE_VALUE( TRACE_VM, TRACE_ALL, VM_PUSH, value, execution_stack_pos );
 
 			execution_stack[ execution_stack_pos++ ] = value;
 		}
@@ -95,54 +93,57 @@ namespace runtime {
 				exit( 1 );
 			}
 
-#ifdef _DEBUG
-			Value &value = execution_stack[ execution_stack_pos - 1 ];
-			wcout << L"  pop: type=";
-			switch ( value.type ) {
-			case BOOL_TYPE:
-				wcout << L"boolean; value=" << ( value.value.int_value ? L"true" : L"false" ) << L"; stack_pos=" << ( execution_stack_pos - 1 ) << endl;
-				break;
+			TRACE_VALUE( TRACE_VM, TRACE_ALL, VM_POP, execution_stack[ execution_stack_pos - 1 ], execution_stack_pos - 1 );
 
-			case INT_TYPE:
-				wcout << L"integer; value=" << value.value.int_value << L"; stack_pos=" << ( execution_stack_pos - 1 ) << endl;
-				break;
+			return execution_stack[ --execution_stack_pos ];
+		}
 
-			case FLOAT_TYPE:
-				wcout << L"float; value=" << value.value.float_value << L"; stack_pos=" << ( execution_stack_pos - 1 ) << endl;
-				break;
+		// only a one-dimensional array has its header right before its dimension count, size and mark
+		static bool IsVector( Value const &value ) {
+			return value.type == ARRAY_TYPE && static_cast< Value* >( value.value.ptr_value )[ -4 ].type == META_TYPE;
+		}
 
-			case CLS_TYPE:
-				wcout << L"system object; address=" << value.value.ptr_value << L"; stack_pos=" << ( execution_stack_pos - 1 ) << endl;
-				break;
+		// an array's size, nil for anything else
+		static Value SizeOrNil( Value const &value );
+		// an array as it is, a hash as a new array of its entries; anything else is an error
+		Value Entries( Value const &value, Value* locals, size_t local_size );
 
-			case ARRAY_TYPE:
-				wcout << L"array; address=" << value.value.ptr_value << L"; stack_pos=" << ( execution_stack_pos - 1 ) << endl;
-				break;
+		// an index into one dimension, of 'bound' elements
+		static void CheckBounds( INT_T index, INT_T bound ) {
+			if ( index < 0 || index >= bound ) {
+				wcerr << L">>> Array index out-of-bounds: index=" << index << L", max_bounds=" << bound << L" <<<" << endl;
+				exit( 1 );
+			}
+		}
 
-			case STRING_TYPE:
-				wcout << L"string; address=" << value.value.ptr_value << L"; stack_pos=" << ( execution_stack_pos - 1 ) << endl;
+		//
+		// Calculate array offset; the first dimension's index
+		// is at 'indices' and the others are below it
+		//
+		inline INT_T ArrayIndex( Value* indices, const int dimensions, Value* array ) {
+			INT_T index;
+			// integer indices into up to three dimensions are unrolled
+			switch ( dimensions ) {
+			case 1:
+				if ( ArrayClass::Index<1>( indices, array, index ) ) {
+					return index;
+				}
 				break;
 
-			case UNINIT_TYPE:
-				wcout << L"uninitialized" << endl;
+			case 2:
+				if ( ArrayClass::Index<2>( indices, array, index ) ) {
+					return index;
+				}
 				break;
 
-				// TODO:
-			default:
+			case 3:
+				if ( ArrayClass::Index<3>( indices, array, index ) ) {
+					return index;
+				}
 				break;
 			}
-#endif
 
-			return execution_stack[ --execution_stack_pos ];
-		}
-
-		//
-		// Calculate array offset
-		//
-		// TODO: bounds check each dimension
-		inline INT_T ArrayIndex( Instruction* instruction, Value* array, bool is_store ) {
-			INT_T index;
-			Value value = PopValue();
+			Value value = indices[ 0 ];
 			switch ( value.type ) {
 			case INT_TYPE:
 				index = value.value.int_value;
@@ -158,92 +159,97 @@ namespace runtime {
 			}
 
 			// check dimensions
-			const int dimensions = static_cast< int >( instruction->operand3 );
-			const int meta_offset = -( dimensions + 2 + 1 );
-
-			if ( array[ meta_offset + 1 ].value.int_value != dimensions ) {
+			if ( ArrayClass::Dimensions( array ) != dimensions ) {
 				wcerr << L">>> Mismatch array dimensions <<<" << endl;
 				exit( 1 );
 			}
 
-			// TODO: encode array with bounds
+			const int meta_offset = -( dimensions + 2 + 1 );
+			CheckBounds( index, array[ meta_offset + 2 ].value.int_value );
 			for ( int i = 1; i < dimensions; i++ ) {
-				index *= array[ meta_offset + 2 + i ].value.int_value;
-				Value value = PopValue();
+				const INT_T bound = array[ meta_offset + 2 + i ].value.int_value;
+				Value value = indices[ -i ];
+				INT_T sub_index;
 				switch ( value.type ) {
 				case INT_TYPE:
-					index += value.value.int_value;
+					sub_index = value.value.int_value;
 					break;
 
 				case FLOAT_TYPE:
-					index += ( INT_T ) value.value.float_value;
+					sub_index = ( INT_T ) value.value.float_value;
 					break;
 
 				default:
 					wcerr << L">>> Operation requires a numeric value <<<" << endl;
 					exit( 1 );
 				}
+				CheckBounds( sub_index, bound );
+				index = index * bound + sub_index;
 			}
 
-			if ( index >= array[ meta_offset ].value.int_value ) {
-				wcerr << L">>> Array index out-of-bounds: index=" << index << L", max_bounds=" << array[ meta_offset ].value.int_value << L" <<<" << endl;
+			return index;
+		}
+
+		// pops the indices of an element access
+		inline INT_T ArrayIndex( Instruction* instruction, Value* array, bool is_store ) {
+			const int dimensions = static_cast< int >( instruction->operand3 );
+			if ( execution_stack_pos < static_cast< size_t >( dimensions ) ) {
+				wcerr << ">>> stack bounds exceeded <<<" << endl;
 				exit( 1 );
 			}
+			execution_stack_pos -= dimensions;
 
-			return index;
+			return ArrayIndex( &execution_stack[ execution_stack_pos + dimensions - 1 ], dimensions, array );
 		}
 
 		//
 		// Stack frame operations
 		//
 		void PushFrame( Frame* frame ) {
-#ifdef _DEBUG
-			wcout << L"pushing frame: address=" << frame << endl;
-			assert( call_stack_pos < CALL_STACK_SIZE );
-#endif
+			TRACE( TRACE_VM, TRACE_ALL, VM_PUSH_FRAME, frame->function->GetName(), call_stack_pos );
+			if ( call_stack_pos >= CALL_STACK_SIZE ) {
+				wcerr << L">>> call stack bounds exceeded <<<" << endl;
+				exit( 1 );
+			}
 			call_stack[ call_stack_pos++ ] = frame;
 		}
 
 		Frame* PopFrame() {
 #ifdef _DEBUG
-			wcout << L"popping frame: address=" << call_stack[ call_stack_pos - 1 ] << endl;
 			assert( call_stack_pos - 1 >= 0 );
 #endif
+			TRACE( TRACE_VM, TRACE_ALL, VM_POP_FRAME, call_stack[ call_stack_pos - 1 ]->function->GetName(), call_stack_pos - 1 );
 			return call_stack[ --call_stack_pos ];
 		}
 
-#ifdef _DEBUG
-		void DumpValue( Value* value, bool is_push ) {
-			if ( is_push ) {
-				wcout << L"  push: ";
-			}
-			else {
-				wcout << L"  pop: ";
-			}
+		// variable slot named by a LOAD/STOR instruction
+		inline Value &GetVariable( Instruction* instruction, Value* locals ) {
+			switch ( instruction->operand1 ) {
+			case LOCL:
+				return locals[ instruction->operand2 ];
 
-			switch ( value->type ) {
-			case BOOL_TYPE:
-				wcout << L"boolean=" << ( value->value.int_value ? L"true" : L"false" ) << endl;
-				break;
-
-			case INT_TYPE:
-				wcout << L"integer=" << value->value.int_value << endl;
-				break;
-
-			case FLOAT_TYPE:
-				wcout << L"float=" << value->value.float_value << endl;
-				break;
-
-			case ARRAY_TYPE:
-				wcout << L"array: address=" << value->value.ptr_value << endl;
-				break;
+			case GLOB:
+				return globals[ instruction->operand2 ];
 
-				// TODO:
 			default:
-				break;
+				return static_cast< Value* >( locals[ 0 ].value.ptr_value )[ instruction->operand2 ];
+			}
+		}
+
+		// ends a fused compare and jump: the operands are dropped and the jump taken if the result matches
+		inline void CompareJump( bool result, Instruction* instruction, size_t &ip, ExecutableFunction* current_function ) {
+			execution_stack_pos -= 2;
+			if ( result == ( instruction->operand2 == JMP_TRUE ) ) {
+				const size_t jmp_ip = GetLabelOffset( current_function, instruction->operand1 );
+				if ( jmp_ip < ip ) {
+					current_function->GetInstructions().at( jmp_ip )->operand2++;
+				}
+				ip = jmp_ip;
+			}
+			else {
+				ip += 2;
 			}
 		}
-#endif
 
 		inline size_t GetLabelOffset( ExecutableFunction* current_function, INT_T label ) {
 			auto result = current_function->GetJumpTable().find( label );
@@ -256,10 +262,20 @@ namespace runtime {
 		}
 
 		// member operations
+		Value NewArray( Value* dimensions, const int count, Value* locals, size_t local_size );
+		// an instance laid out in a frame from 'slots' on: its header, then its fields
+		Value LocalObject( std::wstring const &name, Value* slots );
+		void ShowType( Value &value );
+		inline void EnterTrace( Instruction* label, size_t &ip, ExecutableFunction* current_function, Value* locals );
+		inline void RunMethod( Method* method, size_t &ip, Value* locals, size_t local_size );
+		static void NativeNewArray( NativeStack* stack, Value* top, INT_T dimensions );
 		inline void NewArray( Instruction* instruction, size_t &ip, ExecutableFunction* &current_function, Value* &locals, size_t &local_size );
 		inline void FunctionCall( Instruction* instruction, size_t &ip, ExecutableFunction* &current_function, Value* &locals, size_t &local_size );
 		inline void FunctionCall( ExecutableFunction* callee, Value &left, long param_count, bool has_return,
-			size_t &ip, ExecutableFunction* &current_function, Value* &locals, size_t &local_size );
+			size_t &ip, ExecutableFunction* &current_function, Value* &locals, size_t &local_size, bool tail_call = false );
+		inline void RegisterCall( RegisterInstruction &instruction, size_t &ip, ExecutableFunction* &current_function, Value* &locals, size_t &local_size );
+		inline void RegisterCall( ExecutableFunction* callee, Value &self, Value* arguments, INT_T argument_count, INT_T return_register,
+			size_t &ip, ExecutableFunction* &current_function, Value* &locals, size_t &local_size, bool tail_call = false );
 
 	public:
 		Runtime( std::unique_ptr<ExecutableProgram> p, INT_T last_label_id ): program( std::move( p ) ) {
@@ -270,10 +286,64 @@ namespace runtime {
 			// call stack
 			call_stack = new Frame*[ CALL_STACK_SIZE ];
 			call_stack_pos = 0;
+			globals = nullptr;
+			restored_globals = nullptr;
+			report_pairs = false;
+		}
+
+		~Runtime() {
+			delete [] call_stack;
+		}
+		// '--count-pairs': the stack machine reports its most frequent instruction pairs on exit
+		void CountOpcodePairs() {
+			const size_t count = NO_OP - LOAD_TRUE_LIT + 1;
+			opcode_pairs.assign( count * count, 0 );
+			report_pairs = true;
+		}
+
+		// '--counters': the stack machine counts instructions, pairs, operand types and calls, and writes them as JSON to 'file_name' when it ends
+		void Count( std::wstring const &file_name ) {
+			const size_t count = NO_OP - LOAD_TRUE_LIT + 1;
+			opcode_pairs.assign( count * count, 0 );
+			counters.reset( new Counters( file_name, opcode_pairs ) );
+		}
+
+		// '--jit': the stack machine compiles the loops it runs most, the functions it calls most, or both to machine code, where it can
+		void UseJit( bool use_traces, bool use_methods ) {
+			if ( Assembler::IsAvailable() ) {
+				if ( use_traces ) {
+					tracer.reset( new TraceRecorder );
+				}
+				if ( use_methods ) {
+					methods.reset( new NativeMethods );
+				}
+			}
+		}
+
+		// '--profile': either machine samples where the program spends its time, and writes folded stacks to 'file_name' when it ends
+		void Profile( std::wstring const &file_name ) {
+			profiler.reset( new Profiler( program.get(), file_name ) );
+		}
+
+		// '--gc-stats': either machine reports its collections and samples one allocation in 'sample_every' to the error stream when it ends
+		void KeepHeapStats( size_t sample_every ) {
+			heap_stats.reset( new HeapStats( sample_every ) );
+		}
+
+		// '--snapshot=<file>': the stack machine writes an image of the program and the heap its global scope built
+		void TakeSnapshot( std::wstring const &file_name, std::string const &program_bytes ) {
+			snapshot_file = file_name;
+			snapshot_program = program_bytes;
+		}
+
+		// an image's globals, allocated as the global function's locals; its global scope isn't run again, but 'main' is, if it's defined
+		void Restore( Value* globals ) {
+			restored_globals = globals;
 		}
 
-		~Runtime() = default;
 		void Run();
+		void RunRegisters();
+		void ReportOpcodePairs();
 	};
 }
 
@@ -101,9 +101,9 @@ void Scanner::LoadKeywords()
  ****************************/
 void Scanner::CheckIdentifier( int index )
 {
-	// copy wstring
+	// copy wstring; from a pointer, as a view of the whole buffer would be measured first
 	const int length = end_pos - start_pos;
-	wstring ident( buffer, start_pos, length );
+	wstring ident( buffer + start_pos, length );
 
 	// check wstring
 	auto ident_find = ident_map.find( ident );
@@ -130,10 +130,7 @@ void Scanner::ReadLine( const wstring &line )
 #endif
 	buffer[ line.size() ] = '\0';
 	buffer_size = line.size() + 1;
-#ifdef _DEBUG
-	std::wcout << L"---------- Source ---------" << std::endl;
-	std::wcout << buffer << std::endl;
-#endif
+	TRACE( TRACE_PARSE, TRACE_EVENTS, PARSE_SOURCE, buffer_size - 1 );
 }
 
 /****************************
@@ -144,10 +141,7 @@ void Scanner::ReadFile( const wstring &name )
 	buffer_pos = 0;
 	buffer = LoadFileBuffer( name, buffer_size );
 
-#ifdef _DEBUG
-	std::wcout << L"---------- Source ---------" << std::endl;
-	std::wcout << buffer << std::endl;
-#endif
+	TRACE( TRACE_PARSE, TRACE_EVENTS, PARSE_SOURCE, name, buffer_size );
 }
 
 /****************************
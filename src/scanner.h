@@ -9,6 +9,7 @@
 #define __SCANNER_H__
 
 #include "common.h"
+#include "trace.h"
 
 // comment
 #define COMMENT L'/'
@@ -215,7 +216,7 @@ namespace compiler {
 		inline void CheckString( int index ) {
 			// copy wstring
 			const int length = end_pos - start_pos;
-			std::wstring char_string( buffer, start_pos, length );
+			std::wstring char_string( buffer + start_pos, length );
 			// set wstring
 			tokens[ index ]->SetType( ScannerTokenType::TOKEN_CHAR_STRING_LIT );
 			tokens[ index ]->SetLineNbr( line_num );
@@ -226,7 +227,7 @@ namespace compiler {
 		inline void ParseInteger( int index, int base = 0 ) {
 			// copy wstring
 			int length = end_pos - start_pos;
-			std::wstring ident( buffer, start_pos, length );
+			std::wstring ident( buffer + start_pos, length );
 
 			// set token
 			wchar_t* end;
@@ -239,7 +240,7 @@ namespace compiler {
 		inline void ParseDouble( int index ) {
 			// copy wstring
 			const int length = end_pos - start_pos;
-			std::wstring wident( buffer, start_pos, length );
+			std::wstring wident( buffer + start_pos, length );
 			// set token
 			tokens[ index ]->SetType( ScannerTokenType::TOKEN_FLOAT_LIT );
 			tokens[ index ]->SetLineNbr( line_num );
@@ -252,7 +253,7 @@ namespace compiler {
 		inline void ParseUnicodeChar( int index ) {
 			// copy wstring
 			const int length = end_pos - start_pos;
-			std::wstring ident( buffer, start_pos, length );
+			std::wstring ident( buffer + start_pos, length );
 			// set token
 			wchar_t* end;
 			tokens[ index ]->SetType( ScannerTokenType::TOKEN_CHAR_LIT );
@@ -1,5 +1,4 @@
 #include "semacheck.h"
-#include "tree.h"
 
 /* Copyright (c) 2017 Joshua Ogunyinka */
 namespace compiler
@@ -16,399 +15,1209 @@ namespace compiler
 
 	void SemaCheck1::AnalyzeScope( Scope* scope )
 	{
-		Scope::list_of_ptrs<Statement> &statement_list = scope->GetStatements();
-		for ( Statement* statement : statement_list )
-		{
-			switch ( statement->GetStatementType() )
-			{
-				// add this declaration to the symbol table
-			case StatementType::CLASS_DECL_STMT:
-			case StatementType::FUNCTION_DECL_STMT:
-			case StatementType::VARIABLE_DECL_STMT:
-			case StatementType::VDECL_LIST_STMT:
-			{
-				AnalyzeDeclaration( statement, scope );
-				break;
-			}
-			case StatementType::BREAK_STATEMENT:
-			case StatementType::CONTINUE_STATEMENT:
-			case StatementType::RETURN_STATEMENT:
-			{
-				AnalyzeJumpStatement( statement, scope );
-				break;
-			}
-			case StatementType::FOR_EACH_IN_STATEMENT:
-			case StatementType::DO_WHILE_STATEMENT:
-			case StatementType::LOOP_STATEMENT:
-			case StatementType::WHILE_STATEMENT:
-			{
-				AnalyzeLoopingStatements( statement, scope );
-				break;
-			}
-			case StatementType::SWITCH_STATEMENT:
-			{
-				AnalyzeSwitchStatement( statement, scope );
-				break;
-			}
-			case StatementType::SHOW_STATEMENT:
-			{
-				AnalyzeShowStatement( statement, scope );
-				break;
-			}
+		for ( Statement* statement : scope->GetStatements() ){
+			Dispatch( statement, scope );
+		}
+	}
 
-			case StatementType::IF_ELSE_STATEMENT:
-			{
-				AnalyzeIfStatement( statement, scope );
-				break;
-			}
-			//case StatementType::
-			case StatementType::EXPR_STATEMENT:
-			{
-				Expression *expr = dynamic_cast< ExpressionStatement* >( statement )->GetExpression();
-				AnalyzeExpression( expr, scope );
-				break;
-			}
-			case StatementType::EMPTY_STMT:
-			default:
-				break;
-			} // end-switch
-		} // end-for
-	} //end-function
+	void SemaCheck1::AnalyzeExpression( Expression *expression, SCOPE )
+	{
+		if ( expression ){
+			Dispatch( expression, scope );
+		}
+	}
 
-	void SemaCheck1::AnalyzeIfStatement( Statement *statement, SCOPE )
+	void SemaCheck1::AppendError( ParseNode *node, std::wstring const & error )
 	{
-		IfStatement *if_statement = dynamic_cast< IfStatement* >( statement );
-		AnalyzeExpression( if_statement->GetExpression(), scope );
-		Scope *then_block = dynamic_cast< CompoundStatement* >( if_statement->GetIfBlock() )->GetScope();
-		then_block->SetParentScope( scope );
-		AnalyzeScope( then_block );
+		error_messages.push_back( node->GetFileName() + L":" + IntToString( node->GetLineNumber() ) + L": " + error );
+	}
+
+	void SemaCheck1::ReportErrors()
+	{
+		for ( auto const & error : error_messages ){
+			std::wcerr << L"Error: " << error << "\n";
+		}
+	}
 
+	/****************************
+	 * Statements
+	 ****************************/
+	void SemaCheck1::VisitIfStatement( IfStatement *if_statement, SCOPE )
+	{
+		AnalyzeExpression( if_statement->GetExpression(), scope );
+		Dispatch( if_statement->GetIfBlock(), scope );
 		if ( if_statement->GetElseBlock() ){
-			Scope *else_block = dynamic_cast< CompoundStatement* >( if_statement->GetElseBlock() )->GetScope();
-			else_block->SetParentScope( scope );
-			AnalyzeScope( else_block );
+			Dispatch( if_statement->GetElseBlock(), scope );
 		}
 	}
 
-	void SemaCheck1::AnalyzeSwitchStatement( Statement *statement, SCOPE )
+	void SemaCheck1::VisitCompoundStatement( CompoundStatement *block, SCOPE )
+	{
+		block->GetScope()->SetParentScope( scope );
+		AnalyzeScope( block->GetScope() );
+	}
+
+	void SemaCheck1::VisitSwitchStatement( SwitchStatement *switch_statement, SCOPE )
 	{
 		bool temp = is_parsing_loops;
 		is_parsing_loops = true;
-		SwitchStatement* switch_statement = dynamic_cast< SwitchStatement* >( statement );
 		AnalyzeExpression( switch_statement->GetExpression(), scope );
-		AnalyzeScope( dynamic_cast< CompoundStatement* >( switch_statement->GetSwitchBlock() )->GetScope() );
+		VisitCompoundStatement( static_cast< CompoundStatement* >( switch_statement->GetSwitchBlock() ), scope );
 		is_parsing_loops = temp;
 	}
 
-	void SemaCheck1::AnalyzeExpressionStatement( Statement *statement, SCOPE )
+	void SemaCheck1::VisitCaseStatement( CaseStatement *case_statement, SCOPE )
 	{
-		Expression *expression = dynamic_cast< ExpressionStatement* >( statement )->GetExpression();
+		AnalyzeExpression( case_statement->GetExpression(), scope );
+		Dispatch( case_statement->GetStatement(), scope );
+	}
 
-		switch ( expression->GetExpressionType() )
-		{
-		case ExpressionType::ASSIGNMENT_EXPR:
-		{
-			AssignmentExpression *assign_expr = dynamic_cast< AssignmentExpression* >( expression );
-			Expression *lhs_expr = assign_expr->GetLHSExpression();
-			if ( lhs_expr->GetExpressionType() == ExpressionType::VARIABLE_EXPR ){
-				std::wstring const variable_name = dynamic_cast< Variable* >( lhs_expr )->GetName();
-				if ( !scope->FindDeclaration( variable_name ) ){
-					auto decl = new VariableDeclaration( assign_expr->GetLineNumber(), variable_name,
+	void SemaCheck1::VisitLabelledStatement( LabelledStatement *labelled_statement, SCOPE )
+	{
+		Dispatch( labelled_statement->GetStatement(), scope );
+	}
+
+	void SemaCheck1::VisitExpressionStatement( ExpressionStatement *statement, SCOPE )
+	{
+		Expression *expression = statement->GetExpression();
+		if ( !expression ) return;
+
+		// assigning to an unknown name declares it in the current scope
+		if ( AssignmentExpression *assign_expr = NodeCast<AssignmentExpression>( expression ) ){
+			if ( Variable *variable = NodeCast<Variable>( assign_expr->GetLHSExpression() ) ){
+				if ( !scope->ResolveVariable( variable ) ){
+					auto decl = scope->GetArena().Make<VariableDeclaration>( assign_expr->GetLineNumber(), variable->GetName(),
 						assign_expr->GetRHSExpression(), false );
+					decl->SetFileName( assign_expr );
 					scope->AddDeclaration( decl );
+					variable->SetDeclaration( decl );
 				}
 			}
-			AnalyzeExpression( assign_expr->GetRHSExpression(), scope );
-			break;
-		}
-		case ExpressionType::PRE_INCR_EXPR:
-		{
-			PreIncrExpression* pre_incr_expr = dynamic_cast< PreIncrExpression* >( expression );
-			AnalyzeExpression( pre_incr_expr->GetExpression(), scope );
-			break;
 		}
-		case ExpressionType::PRE_DECR_EXPR:
-		{
-			PreDecrExpression* pre_decr_expr = dynamic_cast< PreDecrExpression* >( expression );
-			AnalyzeExpression( pre_decr_expr, scope );
-			break;
-		}
-		case ExpressionType::UNARY_EXPR:
-		{
-			AnalyzeExpression( dynamic_cast< UnaryOperation* >( expression )->GetExpression(), scope );
-			break;
-		}
-		case ExpressionType::POST_DECR_EXPR:
-			AnalyzeExpression( dynamic_cast< PostDecrExpression* >( expression )->GetExpression(), scope );
-			break;
-		case ExpressionType::POST_INCR_EXPR:
-			AnalyzeExpression( dynamic_cast< PostIncrExpression* >( expression )->GetExpression(), scope );
-			break;
-		case ExpressionType::FUNCTION_CALL_EXPR:
-		{
-			FunctionCall* function_call_expr = dynamic_cast< FunctionCall* >( expression );
+		AnalyzeExpression( expression, scope );
+	}
 
-			break;
+	void SemaCheck1::VisitReturnStatement( ReturnStatement *statement, SCOPE )
+	{
+		if ( !is_parsing_function ){
+			AppendError( statement, L"A return statement not expected outside of "
+				L"an enclosing function" );
 		}
+		else {
+			AnalyzeExpression( statement->GetExpression(), scope );
 		}
 	}
 
-	void SemaCheck1::AppendError( std::wstring const & error )
+	void SemaCheck1::VisitBreakStatement( BreakStatement *statement, SCOPE )
 	{
-		error_messages.push_back( error );
+		CheckLoopJump( statement );
 	}
 
-	void SemaCheck1::ReportErrors()
+	void SemaCheck1::VisitContinueStatement( ContinueStatement *statement, SCOPE )
 	{
-		for ( auto const & error : error_messages ){
-			std::wcerr << L"Error: " << error << "\n";
+		CheckLoopJump( statement );
+	}
+
+	void SemaCheck1::CheckLoopJump( Statement *statement )
+	{
+		if ( !is_parsing_loops ){
+			std::wstring const type_name = statement->GetStatementType() == StatementType::BREAK_STATEMENT ? L"break" : L"continue";
+			AppendError( statement, L"A " + type_name + L" statement not expected outside of a looping construct." );
 		}
 	}
 
-	void SemaCheck1::AnalyzeDeclaration( Statement *statement, Scope *scope )
+	void SemaCheck1::VisitForEachStatement( ForEachStatement *for_each_statement, SCOPE )
 	{
-		if ( statement->GetStatementType() == StatementType::VDECL_LIST_STMT )
-		{
-			DeclarationList* decl_list = dynamic_cast< DeclarationList* >( statement );
-			if ( scope->GetScopeType() != ScopeType::CLASS_SCOPE && ( decl_list->GetAccessType() != AccessType::NONE ) ){
-				AppendError( L" On line " + IntToString( decl_list->GetLineNumber() )
-					+ L": An access type is only expected in a class scope" );
-			}
+		bool temp = is_parsing_loops;
+		is_parsing_loops = true;
 
-			for ( std::pair<std::wstring const, Declaration*>& declaration : decl_list->GetDeclarations() ){
-				if ( !scope->AddDeclaration( declaration.second ) ){
-					AppendError( L"variable '" + ( declaration.second )->GetName() + L"' has already been declared in this scope." );
-				}
+		Expression *cond_expression = for_each_statement->GetExpression();
+		if ( BinaryExpression *bin_expression = NodeCast<BinaryExpression>( cond_expression ) ){
+			if ( Variable *variable = NodeCast<Variable>( bin_expression->GetLHSExpression() ) ){
+				for_each_statement->decl = scope->GetArena().Make<VariableDeclaration>( variable->GetLineNumber(), variable->GetName(), nullptr, false );
+				for_each_statement->decl->SetFileName( variable );
+				variable->SetDeclaration( for_each_statement->decl );
+			}
+			else {
+				AppendError( bin_expression, L"The left hand side of a foreach looping statement is a variable definition" );
+			}
+			if ( bin_expression->GetToken().GetType() != ScannerTokenType::TOKEN_IN_ID ){
+				AppendError( bin_expression, L"foreach looping statement should be separated by an `in` keyword" );
 			}
+			else
+				AnalyzeExpression( bin_expression->GetRHSExpression(), scope );
+		}
+		else {
+			AppendError( for_each_statement, L"A binary expression conjoined by an `in` keyword is expected in a foreach looping statement" );
+		}
+		CompoundStatement *body_statement = NodeCast<CompoundStatement>( for_each_statement->GetStatement() );
+		if ( !body_statement ){
+			AppendError( for_each_statement, L"A ( possibly empty? ) compound statement is expected as the body of a foreach looping statement" );
 		}
 		else {
-			Declaration *decl = dynamic_cast< Declaration* >( statement );
-			StatementType const type = decl->GetStatementType();
-			if ( !scope->AddDeclaration( decl ) ){
-				AppendError( L"On line " + IntToString( decl->GetLineNumber() ) + L": " + decl->GetName() + L" redeclared" );
-				return;
+			// the loop variable lives in the body
+			if ( for_each_statement->decl ){
+				DeclareName( for_each_statement->decl, body_statement->GetScope() );
 			}
+			VisitCompoundStatement( body_statement, scope );
+		}
+		is_parsing_loops = temp;
+	}
 
-			switch ( type )
-			{
-			case StatementType::CLASS_DECL_STMT:
-				AnalyzeClassDeclaration( decl, scope );
-				break;
-			case StatementType::FUNCTION_DECL_STMT:
-				AnalyzeFunctionDeclaration( decl, scope );
-				break;
-			default:
-				break;
+	void SemaCheck1::VisitDoWhileStatement( DoWhileStatement *do_while_statement, SCOPE )
+	{
+		bool temp = is_parsing_loops;
+		is_parsing_loops = true;
+		Dispatch( do_while_statement->GetStatement(), scope );
+		AnalyzeExpression( do_while_statement->GetExpression(), scope );
+		is_parsing_loops = temp;
+	}
+
+	void SemaCheck1::VisitWhileStatement( WhileStatement *while_statement, SCOPE )
+	{
+		bool temp = is_parsing_loops;
+		is_parsing_loops = true;
+		AnalyzeExpression( while_statement->GetExpression(), scope );
+		Dispatch( while_statement->GetStatement(), scope );
+		is_parsing_loops = temp;
+	}
+
+	void SemaCheck1::VisitLoopStatement( LoopStatement *infinite_loop_stmt, SCOPE )
+	{
+		bool temp = is_parsing_loops;
+		is_parsing_loops = true;
+		VisitCompoundStatement( infinite_loop_stmt->GetLoopBody(), scope );
+		is_parsing_loops = temp;
+	}
+
+	void SemaCheck1::VisitDumpStatement( DumpStatement *dump_statement, SCOPE )
+	{
+		AnalyzeExpression( dump_statement->GetExpression(), scope );
+	}
+
+	/****************************
+	 * Declarations; each is added to
+	 * the symbol table of its scope
+	 ****************************/
+	bool SemaCheck1::DeclareName( Declaration *decl, SCOPE )
+	{
+		if ( !scope->AddDeclaration( decl ) ){
+			AppendError( decl, decl->GetName() + L" redeclared" );
+			return false;
+		}
+		return true;
+	}
+
+	void SemaCheck1::VisitDeclarationList( DeclarationList *decl_list, SCOPE )
+	{
+		if ( scope->GetScopeType() != ScopeType::CLASS_SCOPE && ( decl_list->GetAccessType() != AccessType::NONE ) ){
+			AppendError( decl_list, L"An access type is only expected in a class scope" );
+		}
+
+		for ( std::pair<std::wstring const, Declaration*>& declaration : decl_list->GetDeclarations() ){
+			// the initializer is resolved before the name is visible, so `var x = x;` refers to an outer x
+			AnalyzeExpression( static_cast< VariableDeclaration* >( declaration.second )->GetExpression(), scope );
+			if ( !scope->AddDeclaration( declaration.second ) ){
+				AppendError( declaration.second, L"variable '" + ( declaration.second )->GetName() + L"' has already been declared in this scope." );
 			}
 		}
-	} // end SemaCheck1::AnalyzeDeclaration
+	}
 
-	void SemaCheck1::AnalyzeClassDeclaration( Declaration* decl, Scope *parent_scope )
+	void SemaCheck1::VisitVariableDeclaration( VariableDeclaration *decl, SCOPE )
 	{
+		AnalyzeExpression( decl->GetExpression(), scope );
+		DeclareName( decl, scope );
+	}
+
+	void SemaCheck1::VisitClassDeclaration( ClassDeclaration *class_declaration, Scope *parent_scope )
+	{
+		if ( !DeclareName( class_declaration, parent_scope ) ) return;
+
 		bool temp_parsing_class = is_parsing_class;
 		is_parsing_class = true;
 
-		ClassDeclaration* class_declaration = dynamic_cast< ClassDeclaration* >( decl );
 		Scope* class_scope = class_declaration->GetClassScope();
 		class_scope->SetScopeType( ScopeType::CLASS_SCOPE );
 		class_scope->SetParentScope( parent_scope );
 
-		auto &decl_list = class_declaration->GetDeclList();
-		for ( auto &class_elem_decl : decl_list ){ // class_elem_decl is a std::pair<std::wstring const, Declaration*> 
-			AnalyzeDeclaration( class_elem_decl, class_scope );
+		for ( Declaration *class_elem_decl : class_declaration->GetDeclList() ){
+			Dispatch( class_elem_decl, class_scope );
 		}
 		is_parsing_class = temp_parsing_class;
 	}
 
-	void SemaCheck1::AnalyzeFunctionDeclaration( Declaration* decl, Scope *parent_scope )
+	void SemaCheck1::VisitFunctionDeclaration( FunctionDeclaration *function_decl, Scope *parent_scope )
 	{
+		if ( !DeclareName( function_decl, parent_scope ) ) return;
+
 		bool temp_in_function = is_parsing_function;
+		bool temp_in_loops = is_parsing_loops;
 		is_parsing_function = true;
+		is_parsing_loops = false;
 
-		FunctionDeclaration* function_decl = dynamic_cast< FunctionDeclaration* >( decl );
 		ExpressionList *parameters = function_decl->GetParameters();
 		FunctionType const function_type = function_decl->GetFunctionType();
 
 		if ( parent_scope->GetScopeType() != ScopeType::CLASS_SCOPE && function_decl->GetAccessType() != AccessType::NONE ){
-			AppendError( L"On line " + IntToString( function_decl->GetLineNumber() ) + L": access type outside an immediate enclosing class" );
+			AppendError( function_decl, L"access type outside an immediate enclosing class" );
 		}
 		if ( parent_scope->GetScopeType() != ScopeType::CLASS_SCOPE && ( function_type == FunctionType::CONSTRUCTOR
 			|| function_type == FunctionType::METHOD ) )
 		{
-			AppendError( L"On line " + IntToString( function_decl->GetLineNumber() ) + L": " + std::wstring( L"A " )
+			AppendError( function_decl, std::wstring( L"A " )
 				+ ( function_type == FunctionType::CONSTRUCTOR ? L"constructor" : L"method" ) +
 				L" cannot be used when the enclosing scope isn't a class definition" );
 		}
 
 		// if there are no duplicates/invalid-expressions in the paramter, proceed to analyzing the body
-		if ( CheckParameterDuplicates( parameters, function_decl->GetLineNumber() ) ){
+		if ( CheckParameterDuplicates( parameters, function_decl ) ){
 			Scope *function_scope = function_decl->GetFunctionBody()->GetScope();
 			function_scope->SetScopeType( ScopeType::FUNCTION_SCOPE );
 			function_scope->SetParentScope( parent_scope );
+			DeclareParameters( parameters, function_scope );
 			AnalyzeScope( function_scope );
 		}
 
 		is_parsing_function = temp_in_function;
+		is_parsing_loops = temp_in_loops;
 	}
 
-	void SemaCheck1::AnalyzeJumpStatement( Statement * statement, SCOPE )
+	// each formal parameter becomes a variable of the function's own scope
+	void SemaCheck1::DeclareParameters( ExpressionList *parameters, Scope *function_scope )
 	{
-		StatementType const type = statement->GetStatementType();
-		if ( type == StatementType::RETURN_STATEMENT )
-		{
-			if ( !is_parsing_function ){
-				AppendError( L"On line " + IntToString( statement->GetLineNumber() ) + L": A return statement not expected outside of "
-					L"an enclosing function" );
+		if ( !parameters ) return;
+		for ( unsigned int i = 0; i < parameters->Length(); ++i ){
+			Variable *parameter = NodeCast<Variable>( parameters->GetExpressionAt( i ) );
+			if ( !parameter ){
+				AppendError( parameters->GetExpressionAt( i ), L"Formal parameters must only contain variable names" );
+				continue;
 			}
-			else {
-				Expression *ret_expression = dynamic_cast< ReturnStatement* >( statement )->GetExpression();
-				if ( ret_expression ){
-					AnalyzeExpression( ret_expression, scope );
+			auto decl = function_scope->GetArena().Make<VariableDeclaration>( parameter->GetLineNumber(), parameter->GetName(),
+				nullptr, false );
+			decl->SetFileName( parameter );
+			DeclareName( decl, function_scope );
+			parameter->SetDeclaration( decl );
+		}
+	}
+
+	/*
+	*	If there are duplicates in the parameter list or use of a non-variable as parameters
+	*	returns false, otherwise true
+	*/
+	bool SemaCheck1::CheckParameterDuplicates( ExpressionList *parameters, ParseNode *owner )
+	{
+		bool result = true;
+		if ( parameters ){
+			if ( parameters->Length() > 1 ){
+				for ( unsigned int r = 0; r < parameters->Length(); ++r ){
+					if ( Variable* var = NodeCast<Variable>( parameters->GetExpressionAt( r ) ) ){
+						for ( unsigned int c = r + 1; c < parameters->Length(); ++c ){
+							if ( Variable *next_var = NodeCast<Variable>( parameters->GetExpressionAt( c ) ) ){
+								if ( var->GetName() == next_var->GetName() ){
+									result = false;
+									AppendError( next_var, L"Duplicate name '" + next_var->GetName() + L"' found in parameter list" );
+									continue;
+								}
+							}
+							else {
+								result = false;
+								AppendError( var, L"Formal parameters must only contain variable names" );
+								continue;
+							}
+						}
+					}
+					else {
+						result = false;
+						AppendError( owner, L"Formal parameters must only contain variable names" );
+						continue;
+					}
 				}
 			}
+		}
+		return result;
+	}
+
+
+	/****************************
+	 * Expressions; every variable reached
+	 * is resolved and the declaration cached
+	 * on the node
+	 ****************************/
+	void SemaCheck1::VisitVariable( Variable *variable, SCOPE )
+	{
+		scope->ResolveVariable( variable );
+	}
+
+	void SemaCheck1::VisitBinaryExpression( BinaryExpression *binary_expression, SCOPE )
+	{
+		AnalyzeExpression( binary_expression->GetLHSExpression(), scope );
+		AnalyzeExpression( binary_expression->GetRHSExpression(), scope );
+	}
+
+	void SemaCheck1::VisitConditionalExpression( ConditionalExpression *conditional_expression, SCOPE )
+	{
+		AnalyzeExpression( conditional_expression->GetConditionalExpression(), scope );
+		AnalyzeExpression( conditional_expression->GetLhsExpression(), scope );
+		AnalyzeExpression( conditional_expression->GetRhsExpression(), scope );
+	}
+
+	void SemaCheck1::VisitFunctionCall( FunctionCall *function_call, SCOPE )
+	{
+		AnalyzeExpression( function_call->GetFunctionExpression(), scope );
+		if ( ExpressionList *arguments = function_call->GetArgumentList() ){
+			for ( unsigned int i = 0; i < arguments->Length(); ++i ){
+				AnalyzeExpression( arguments->GetExpressionAt( i ), scope );
+			}
+		}
+	}
+
+	void SemaCheck1::VisitSubscriptExpression( SubscriptExpression *subscript_expression, SCOPE )
+	{
+		AnalyzeExpression( subscript_expression->GetExpression(), scope );
+		AnalyzeExpression( subscript_expression->GetIndex(), scope );
+	}
+
+	void SemaCheck1::VisitDotExpression( DotExpression *dot_expression, SCOPE )
+	{
+		AnalyzeExpression( dot_expression->GetExpression(), scope );
+	}
+
+	void SemaCheck1::VisitUnaryOperation( UnaryOperation *unary_operation, SCOPE )
+	{
+		AnalyzeExpression( unary_operation->GetExpression(), scope );
+	}
+
+	void SemaCheck1::VisitPreIncrExpression( PreIncrExpression *pre_incr_expr, SCOPE )
+	{
+		AnalyzeExpression( pre_incr_expr->GetExpression(), scope );
+	}
+
+	void SemaCheck1::VisitPreDecrExpression( PreDecrExpression *pre_decr_expr, SCOPE )
+	{
+		AnalyzeExpression( pre_decr_expr->GetExpression(), scope );
+	}
+
+	void SemaCheck1::VisitPostIncrExpression( PostIncrExpression *post_incr_expr, SCOPE )
+	{
+		AnalyzeExpression( post_incr_expr->GetExpression(), scope );
+	}
+
+	void SemaCheck1::VisitPostDecrExpression( PostDecrExpression *post_decr_expr, SCOPE )
+	{
+		AnalyzeExpression( post_decr_expr->GetExpression(), scope );
+	}
+
+	void SemaCheck1::VisitListExpression( ListExpression *list_expression, SCOPE )
+	{
+		if ( ExpressionList *elements = list_expression->GetExpressionList() ){
+			for ( unsigned int i = 0; i < elements->Length(); ++i ){
+				AnalyzeExpression( elements->GetExpressionAt( i ), scope );
+			}
+		}
+	}
+
+	void SemaCheck1::VisitNewExpression( NewExpression *new_expression, SCOPE )
+	{
+		AnalyzeExpression( new_expression->GetExpression(), scope );
+	}
+
+	// a lambda body is parsed without a parent; it sees the names of the scope it is written in
+	void SemaCheck1::VisitLambdaExpression( LambdaExpression *lambda_expression, SCOPE )
+	{
+		CompoundStatement *body = NodeCast<CompoundStatement>( lambda_expression->GetLambdaBody() );
+		if ( !body || !CheckParameterDuplicates( lambda_expression->GetParamaters(), lambda_expression ) ){
 			return;
 		}
+		bool temp_in_function = is_parsing_function;
+		bool temp_in_loops = is_parsing_loops;
+		is_parsing_function = true;
+		is_parsing_loops = false;
 
-		if ( !is_parsing_loops ){
-			std::wstring const type_name = type == StatementType::BREAK_STATEMENT ? L"break" : L"continue";
-			AppendError( L"A " + type_name + L" statement not expected outside of a looping construct." );
+		Scope *lambda_scope = body->GetScope();
+		lambda_scope->SetScopeType( ScopeType::FUNCTION_SCOPE );
+		lambda_scope->SetParentScope( scope );
+		DeclareParameters( lambda_expression->GetParamaters(), lambda_scope );
+		AnalyzeScope( lambda_scope );
+
+		is_parsing_function = temp_in_function;
+		is_parsing_loops = temp_in_loops;
+	}
+
+	void SemaCheck1::VisitMapExpression( MapExpression *map_expression, SCOPE )
+	{
+		for ( auto &key_value : *map_expression ){
+			AnalyzeExpression( key_value.first, scope );
+			AnalyzeExpression( key_value.second, scope );
 		}
 	}
 
-	void SemaCheck1::AnalyzeLoopingStatements( Statement *statement, SCOPE )
+	/****************************
+	 * Type inference
+	 ****************************/
+	TypeInference::TypeInference() : facts{ true, {} }, in_function( false ){
+	}
+
+	bool TypeInference::Visit( ParsedProgram* program )
 	{
-		bool temp = is_parsing_loops;
-		is_parsing_loops = true;
+		facts = Facts{ true, {} };
+		AnalyzeScope( program->GetGlobalScope() );
+		return true;
+	}
 
-		switch ( statement->GetStatementType() ){
-		case StatementType::FOR_EACH_IN_STATEMENT:
-			AnalyzeForEachStatement( statement, scope );
-			break;
-		case StatementType::DO_WHILE_STATEMENT:
-			AnalyzeDoWhileStatement( statement, scope );
-			break;
-		case StatementType::WHILE_STATEMENT:
-			AnalyzeWhileStatement( statement, scope );
-			break;
-		case StatementType::LOOP_STATEMENT:
-			AnalyzeInfiniteLoopStatement( statement, scope );
-			break;
-		default:
-			assert( 0 && "we should never get to this point in the looping statements" );
+	SemaType* TypeInference::Analyze( Expression *expression )
+	{
+		if ( !expression ){
+			return nullptr;
 		}
-		is_parsing_loops = temp;
+		expression->type = Dispatch( expression );
+		return expression->type;
 	}
 
-	void SemaCheck1::AnalyzeForEachStatement( Statement *statement, SCOPE )
+	void TypeInference::Analyze( Statement *statement )
 	{
-		ForEachStatement *for_each_statement = dynamic_cast< ForEachStatement* >( statement );
-		Expression *cond_expression = for_each_statement->GetExpression();
+		if ( statement ){
+			Dispatch( statement );
+		}
+	}
 
-		if ( BinaryExpression *bin_expression = dynamic_cast< BinaryExpression* >( cond_expression ) ){
-			if ( bin_expression->GetLHSExpression()->GetExpressionType() != ExpressionType::VARIABLE_EXPR ){
-				AppendError( L"The left hand side of a foreach looping statement is a variable definition" );
+	// a function's variables can't be changed by anything it calls; the program's can
+	void TypeInference::AnalyzeScope( Scope *scope )
+	{
+		if ( in_function ){
+			for ( auto &symbol : scope->GetSymbols() ){
+				if ( symbol.second->GetStatementType() == StatementType::VARIABLE_DECL_STMT ){
+					locals.insert( symbol.second );
+				}
+			}
+		}
+		for ( Statement *statement : scope->GetStatements() ){
+			Analyze( statement );
+		}
+	}
+
+	// functions, lambdas and initializers start out knowing nothing
+	void TypeInference::AnalyzeFunction( Scope *scope )
+	{
+		Facts saved_facts{ true, {} };
+		std::vector<Exits> saved_exits;
+		std::unordered_set<Declaration*> saved_locals;
+		std::swap( facts, saved_facts );
+		saved_exits.swap( exits );
+		saved_locals.swap( locals );
+		const bool saved_in_function = in_function;
+
+		in_function = true;
+		AnalyzeScope( scope );
+
+		std::swap( facts, saved_facts );
+		saved_exits.swap( exits );
+		saved_locals.swap( locals );
+		in_function = saved_in_function;
+	}
+
+	// what a store evaluates before the value: a subscript's array and indices, an object
+	void TypeInference::AnalyzeTarget( Expression *target )
+	{
+		if ( SubscriptExpression *subscript = NodeCast<SubscriptExpression>( target ) ){
+			AnalyzeTarget( subscript->GetExpression() );
+			Analyze( subscript->GetIndex() );
+		}
+		else if ( DotExpression *dot = NodeCast<DotExpression>( target ) ){
+			Analyze( dot->GetExpression() );
+		}
+		else if ( !NodeCast<Variable>( target ) ){
+			Analyze( target );
+		}
+	}
+
+	// adding or subtracting 1 keeps a number's type; anything else may be an object's operator
+	SemaType* TypeInference::AnalyzeIncrement( Expression *operand, bool is_prefix )
+	{
+		AnalyzeTarget( operand );
+		SemaType *type = nullptr;
+		if ( Variable *variable = NodeCast<Variable>( operand ) ){
+			type = variable->type = TypeOf( variable->GetDeclaration() );
+		}
+
+		SemaType *result = type && type->IsNumeric() ? type : nullptr;
+		if ( !result ){
+			ForgetNonLocals();
+		}
+		Assign( operand, result );
+		return is_prefix ? result : type;
+	}
+
+	SemaType* TypeInference::TypeOf( Declaration *decl )
+	{
+		if ( !decl || !facts.reachable ){
+			return nullptr;
+		}
+		auto type = facts.types.find( decl );
+		return type != facts.types.end() ? type->second : nullptr;
+	}
+
+	/****************************
+	 * A store to a variable sets what
+	 * is known about it. Names resolved
+	 * only when emitted may be any
+	 * variable, and a store to an object
+	 * may be to a field this code reads
+	 ****************************/
+	void TypeInference::Assign( Expression *target, SemaType *type )
+	{
+		if ( Variable *variable = NodeCast<Variable>( target ) ){
+			Declaration *decl = variable->GetDeclaration();
+			if ( !decl ){
+				ForgetAll();
+			}
+			else if ( type ){
+				facts.types[ decl ] = type;
 			}
 			else {
-				Variable *variable = dynamic_cast< Variable* >( bin_expression->GetLHSExpression() );
-				for_each_statement->decl = new VariableDeclaration( variable->GetLineNumber(), variable->GetName(), nullptr, false );
+				facts.types.erase( decl );
 			}
-			if ( bin_expression->GetToken().GetType() != ScannerTokenType::TOKEN_IN_ID ){
-				AppendError( L"foreach looping statement should be separated by an `in` keyword" );
+		}
+		else if ( NodeCast<DotExpression>( target ) ){
+			ForgetNonLocals();
+		}
+	}
+
+	// called code may store to anything but the function's own variables
+	void TypeInference::ForgetNonLocals()
+	{
+		for ( auto type = facts.types.begin(); type != facts.types.end(); ){
+			if ( locals.count( type->first ) ){
+				++type;
 			}
-			else
-				AnalyzeExpression( bin_expression->GetRHSExpression(), scope );
+			else {
+				type = facts.types.erase( type );
+			}
+		}
+	}
+
+	void TypeInference::ForgetAll()
+	{
+		facts.types.clear();
+	}
+
+	TypeInference::Exits* TypeInference::InnermostLoop()
+	{
+		for ( auto exit = exits.rbegin(); exit != exits.rend(); ++exit ){
+			if ( !exit->is_switch ){
+				return &*exit;
+			}
+		}
+		return nullptr;
+	}
+
+	// where two paths meet only what both agree on is known
+	TypeInference::Facts TypeInference::Join( Facts const &a, Facts const &b )
+	{
+		if ( !a.reachable ){
+			return b;
+		}
+		if ( !b.reachable ){
+			return a;
+		}
+
+		Facts result{ true, {} };
+		for ( auto const &type : a.types ){
+			auto other = b.types.find( type.first );
+			if ( other != b.types.end() && other->second == type.second ){
+				result.types.insert( type );
+			}
+		}
+		return result;
+	}
+
+	bool TypeInference::Same( Facts const &a, Facts const &b )
+	{
+		return a.reachable == b.reachable && a.types == b.types;
+	}
+
+	/****************************
+	 * The type of an operation on
+	 * values of the given types, as
+	 * the Integer, Float and Boolean
+	 * classes compute it; nullptr if
+	 * it may fail or call a method
+	 ****************************/
+	SemaType* TypeInference::ResultOf( ScannerTokenType operation, SemaType *left, SemaType *right )
+	{
+		if ( !left || !right ){
+			return nullptr;
+		}
+
+		const bool numbers = left->IsNumeric() && right->IsNumeric();
+		const bool integers = left == SemaType::GetInteger() && right == SemaType::GetInteger();
+		switch ( operation ){
+		case ScannerTokenType::TOKEN_ADD:
+		case ScannerTokenType::TOKEN_SUB:
+		case ScannerTokenType::TOKEN_MUL:
+		case ScannerTokenType::TOKEN_DIV:
+		case ScannerTokenType::TOKEN_ADD_EQL:
+		case ScannerTokenType::TOKEN_SUB_EQL:
+		case ScannerTokenType::TOKEN_MUL_EQL:
+		case ScannerTokenType::TOKEN_DIV_EQL:
+			if ( integers ){
+				return SemaType::GetInteger();
+			}
+			return numbers ? SemaType::GetFloat() : nullptr;
+
+		case ScannerTokenType::TOKEN_MOD:
+			return integers ? SemaType::GetInteger() : nullptr;
+
+		case ScannerTokenType::TOKEN_EQL:
+		case ScannerTokenType::TOKEN_NEQL:
+		case ScannerTokenType::TOKEN_LES:
+		case ScannerTokenType::TOKEN_GTR:
+		case ScannerTokenType::TOKEN_LEQL:
+		case ScannerTokenType::TOKEN_GEQL:
+			return numbers ? SemaType::GetBoolean() : nullptr;
+
+		case ScannerTokenType::TOKEN_AND:
+		case ScannerTokenType::TOKEN_OR:
+			if ( integers ){
+				return SemaType::GetInteger();
+			}
+			return left == SemaType::GetBoolean() && right == SemaType::GetBoolean() ? SemaType::GetBoolean() : nullptr;
+
+		default:
+			return nullptr;
+		}
+	}
+
+	/****************************
+	 * Statements
+	 ****************************/
+	SemaType* TypeInference::VisitStatement( Statement *statement )
+	{
+		ForgetAll();
+		return nullptr;
+	}
+
+	SemaType* TypeInference::VisitExpressionStatement( ExpressionStatement *statement )
+	{
+		Analyze( statement->GetExpression() );
+		return nullptr;
+	}
+
+	SemaType* TypeInference::VisitDumpStatement( DumpStatement *statement )
+	{
+		Analyze( statement->GetExpression() );
+		return nullptr;
+	}
+
+	SemaType* TypeInference::VisitReturnStatement( ReturnStatement *statement )
+	{
+		Analyze( statement->GetExpression() );
+		facts.reachable = false;
+		return nullptr;
+	}
+
+	SemaType* TypeInference::VisitBreakStatement( BreakStatement *statement )
+	{
+		if ( exits.size() ){
+			exits.back().breaks.push_back( facts );
+		}
+		facts.reachable = false;
+		return nullptr;
+	}
+
+	SemaType* TypeInference::VisitContinueStatement( ContinueStatement *statement )
+	{
+		if ( Exits *loop = InnermostLoop() ){
+			loop->continues.push_back( facts );
+		}
+		facts.reachable = false;
+		return nullptr;
+	}
+
+	SemaType* TypeInference::VisitEmptyStatement( EmptyStatement *statement )
+	{
+		return nullptr;
+	}
+
+	SemaType* TypeInference::VisitCompoundStatement( CompoundStatement *statement )
+	{
+		AnalyzeScope( statement->GetScope() );
+		return nullptr;
+	}
+
+	SemaType* TypeInference::VisitIfStatement( IfStatement *statement )
+	{
+		Analyze( statement->GetExpression() );
+		const Facts condition = facts;
+		Analyze( statement->GetIfBlock() );
+		const Facts taken = facts;
+		facts = condition;
+		Analyze( statement->GetElseBlock() );
+		facts = Join( taken, facts );
+		return nullptr;
+	}
+
+	/****************************
+	 * A loop starts over with what
+	 * holds on entry joined with what
+	 * holds on the way back, until
+	 * that stops changing; the last
+	 * walk sets the types
+	 ****************************/
+	SemaType* TypeInference::VisitWhileStatement( WhileStatement *statement )
+	{
+		const Facts entry = facts;
+		for ( ;; ){
+			const Facts top = facts;
+			Analyze( statement->GetExpression() );
+			const Facts tested = facts;
+
+			exits.push_back( Exits{ false, {}, {}, {} } );
+			Analyze( statement->GetStatement() );
+			for ( Facts const &next : exits.back().continues ){
+				facts = Join( facts, next );
+			}
+			Exits loop = std::move( exits.back() );
+			exits.pop_back();
+
+			facts = Join( entry, facts );
+			if ( Same( facts, top ) ){
+				facts = tested;
+				for ( Facts const &exit : loop.breaks ){
+					facts = Join( facts, exit );
+				}
+				return nullptr;
+			}
+		}
+	}
+
+	SemaType* TypeInference::VisitDoWhileStatement( DoWhileStatement *statement )
+	{
+		const Facts entry = facts;
+		for ( ;; ){
+			const Facts top = facts;
+			exits.push_back( Exits{ false, {}, {}, {} } );
+			Analyze( statement->GetStatement() );
+			for ( Facts const &next : exits.back().continues ){
+				facts = Join( facts, next );
+			}
+			Exits loop = std::move( exits.back() );
+			exits.pop_back();
+
+			Analyze( statement->GetExpression() );
+			const Facts tested = facts;
+			facts = Join( entry, facts );
+			if ( Same( facts, top ) ){
+				facts = tested;
+				for ( Facts const &exit : loop.breaks ){
+					facts = Join( facts, exit );
+				}
+				return nullptr;
+			}
+		}
+	}
+
+	// only a 'break' leaves
+	SemaType* TypeInference::VisitLoopStatement( LoopStatement *statement )
+	{
+		const Facts entry = facts;
+		for ( ;; ){
+			const Facts top = facts;
+			exits.push_back( Exits{ false, {}, {}, {} } );
+			VisitCompoundStatement( statement->GetLoopBody() );
+			for ( Facts const &next : exits.back().continues ){
+				facts = Join( facts, next );
+			}
+			Exits loop = std::move( exits.back() );
+			exits.pop_back();
+
+			facts = Join( entry, facts );
+			if ( Same( facts, top ) ){
+				facts = Facts{ false, {} };
+				for ( Facts const &exit : loop.breaks ){
+					facts = Join( facts, exit );
+				}
+				return nullptr;
+			}
+		}
+	}
+
+	// the loop variable takes each element in turn, of any type
+	SemaType* TypeInference::VisitForEachStatement( ForEachStatement *statement )
+	{
+		BinaryExpression *in_expression = NodeCast<BinaryExpression>( statement->GetExpression() );
+		CompoundStatement *body = NodeCast<CompoundStatement>( statement->GetStatement() );
+		if ( !in_expression || !body ){
+			ForgetAll();
+			return nullptr;
+		}
+
+		Analyze( in_expression->GetRHSExpression() );
+		if ( in_function && statement->decl ){
+			locals.insert( statement->decl );
+		}
+
+		const Facts entry = facts;
+		for ( ;; ){
+			const Facts top = facts;
+			if ( statement->decl ){
+				facts.types.erase( statement->decl );
+			}
+			exits.push_back( Exits{ false, {}, {}, {} } );
+			VisitCompoundStatement( body );
+			for ( Facts const &next : exits.back().continues ){
+				facts = Join( facts, next );
+			}
+			Exits loop = std::move( exits.back() );
+			exits.pop_back();
+
+			facts = Join( entry, facts );
+			if ( Same( facts, top ) ){
+				for ( Facts const &exit : loop.breaks ){
+					facts = Join( facts, exit );
+				}
+				return nullptr;
+			}
+		}
+	}
+
+	/****************************
+	 * Case values are compared, in
+	 * order, before any label is
+	 * reached; each label starts from
+	 * what holds after the compares
+	 ****************************/
+	SemaType* TypeInference::VisitSwitchStatement( SwitchStatement *statement )
+	{
+		CompoundStatement *block = NodeCast<CompoundStatement>( statement->GetSwitchBlock() );
+		if ( !block ){
+			ForgetAll();
+			return nullptr;
+		}
+
+		Analyze( statement->GetExpression() );
+		for ( Statement *block_statement : block->GetStatementList() ){
+			CaseStatement *case_statement = NodeCast<CaseStatement>( block_statement );
+			while ( case_statement ){
+				Analyze( case_statement->GetExpression() );
+				Statement *next = case_statement->GetStatement();
+				while ( LabelledStatement *labelled = NodeCast<LabelledStatement>( next ) ){
+					next = labelled->GetStatement();
+				}
+				case_statement = NodeCast<CaseStatement>( next );
+			}
+		}
+
+		exits.push_back( Exits{ true, facts, {}, {} } );
+		facts.reachable = false;
+		VisitCompoundStatement( block );
+		Exits exit = std::move( exits.back() );
+		exits.pop_back();
+
+		// no label matched
+		facts = Join( facts, exit.dispatch );
+		for ( Facts const &path : exit.breaks ){
+			facts = Join( facts, path );
+		}
+		return nullptr;
+	}
+
+	SemaType* TypeInference::VisitCaseStatement( CaseStatement *statement )
+	{
+		if ( exits.size() && exits.back().is_switch ){
+			facts = Join( facts, exits.back().dispatch );
 		}
 		else {
-			AppendError( L"A binary expression conjoined by an `in` keyword is expected in a foreach looping statement" );
+			ForgetAll();
 		}
-		CompoundStatement *body_statement = dynamic_cast< CompoundStatement* >( for_each_statement->GetStatement() );
-		if ( !body_statement ){
-			AppendError( L"A ( possibly empty? ) compound statement is expected as the body of a foreach looping statement" );
+		Analyze( statement->GetStatement() );
+		return nullptr;
+	}
+
+	SemaType* TypeInference::VisitLabelledStatement( LabelledStatement *statement )
+	{
+		if ( exits.size() && exits.back().is_switch ){
+			facts = Join( facts, exits.back().dispatch );
+		}
+		else {
+			ForgetAll();
+		}
+		Analyze( statement->GetStatement() );
+		return nullptr;
+	}
+
+	/****************************
+	 * Declarations
+	 ****************************/
+	SemaType* TypeInference::VisitDeclarationList( DeclarationList *decl_list )
+	{
+		for ( auto &declaration : decl_list->GetDeclarations() ){
+			Analyze( declaration.second );
+		}
+		return nullptr;
+	}
+
+	// a variable without an initializer is set to nil
+	SemaType* TypeInference::VisitVariableDeclaration( VariableDeclaration *decl )
+	{
+		SemaType *type = Analyze( decl->GetExpression() );
+		if ( type ){
+			facts.types[ decl ] = type;
 		}
 		else {
-			body_statement->GetScope()->SetParentScope( scope );
-			AnalyzeScope( body_statement->GetScope() );
+			facts.types.erase( decl );
 		}
+		return nullptr;
 	}
 
-	void SemaCheck1::AnalyzeDoWhileStatement( Statement *statement, SCOPE )
+	SemaType* TypeInference::VisitFunctionDeclaration( FunctionDeclaration *decl )
 	{
-		DoWhileStatement *do_while_statement = dynamic_cast< DoWhileStatement* >( statement );
-		Scope *do_while_scope = dynamic_cast< CompoundStatement* >( do_while_statement->GetStatement() )->GetScope();
-		do_while_scope->SetParentScope( scope );
-		AnalyzeScope( do_while_scope );
+		if ( decl->GetFunctionBody() ){
+			AnalyzeFunction( decl->GetFunctionBody()->GetScope() );
+		}
+		return nullptr;
+	}
 
-		AnalyzeExpression( do_while_statement->GetExpression(), scope );
+	// static initializers run before the program and field initializers in constructors
+	SemaType* TypeInference::VisitClassDeclaration( ClassDeclaration *decl )
+	{
+		for ( Declaration *member : decl->GetDeclList() ){
+			switch ( member->GetStatementType() ){
+			case StatementType::FUNCTION_DECL_STMT:
+			case StatementType::CLASS_DECL_STMT:
+				Analyze( member );
+				break;
+
+			default: {
+				Facts saved_facts{ true, {} };
+				std::swap( facts, saved_facts );
+				Analyze( member );
+				std::swap( facts, saved_facts );
+			}
+				break;
+			}
+		}
+		return nullptr;
 	}
 
-	void SemaCheck1::AnalyzeWhileStatement( Statement *statement, SCOPE )
+	/****************************
+	 * Expressions, in the order the
+	 * emitter evaluates them; each
+	 * returns its type, or nullptr
+	 ****************************/
+	SemaType* TypeInference::VisitExpression( Expression *expression )
 	{
-		WhileStatement *while_statement = dynamic_cast< WhileStatement* >( statement );
-		AnalyzeExpression( while_statement->GetExpression(), scope );
-		Scope* while_scope = dynamic_cast< CompoundStatement* >( while_statement->GetStatement() )->GetScope();
-		while_scope->SetParentScope( scope );
-		AnalyzeScope( while_scope );
+		ForgetAll();
+		return nullptr;
 	}
 
-	void SemaCheck1::AnalyzeInfiniteLoopStatement( Statement *statement, SCOPE )
+	SemaType* TypeInference::VisitNullLiteral( NullLiteral *expression )
 	{
-		LoopStatement* infinite_loop_stmt = dynamic_cast< LoopStatement* >( statement );
-		infinite_loop_stmt->GetLoopBody()->GetScope()->SetParentScope( scope );
-		AnalyzeScope( infinite_loop_stmt->GetLoopBody()->GetScope() );
+		return nullptr;
 	}
 
-	void SemaCheck1::AnalyzeShowStatement( Statement* statement, SCOPE )
+	SemaType* TypeInference::VisitCharacterLiteral( CharacterLiteral *expression )
 	{
-		DumpStatement *dump_statement = dynamic_cast< DumpStatement* >( statement );
-		AnalyzeExpression( dump_statement->GetExpression(), scope );
+		return SemaType::GetCharacter();
 	}
-	/*
-	*	If there are duplicates in the parameter list or use of a non-variable as parameters
-	*	returns false, otherwise true
-	*/
-	bool SemaCheck1::CheckParameterDuplicates( ExpressionList *parameters, unsigned int const line_number )
+
+	SemaType* TypeInference::VisitIntegerLiteral( IntegerLiteral *expression )
 	{
-		bool result = true;
-		if ( parameters ){
-			if ( parameters->Length() > 1 ){
-				for ( unsigned int r = 0; r < parameters->Length(); ++r ){
-					if ( Variable* var = dynamic_cast< Variable* >( parameters->GetExpressionAt( r ) ) ){
-						for ( unsigned int c = r + 1; c < parameters->Length(); ++c ){
-							if ( Variable *next_var = dynamic_cast< Variable* >( parameters->GetExpressionAt( c ) ) ){
-								if ( var->GetName() == next_var->GetName() ){
-									result = false;
-									AppendError(L"On line " + IntToString(next_var->GetLineNumber()) + L": "
-										L"Duplicate name '" + next_var->GetName() + L"' found in parameter list" );
-									continue;
-								}
-							}
-							else {
-								result = false;
-								AppendError( L"On line " + IntToString( var->GetLineNumber() ) + L": "
-									L"Formal parameters must only contain variable names" );
-								continue;
-							}
-						}
-					}
-					else {
-						result = false;
-						AppendError( L"On line " + IntToString( line_number ) + L": "
-							L"Formal parameters must only contain variable names" );
-						continue;
-					}
-				}
+		return SemaType::GetInteger();
+	}
+
+	SemaType* TypeInference::VisitFloatLiteral( FloatLiteral *expression )
+	{
+		return SemaType::GetFloat();
+	}
+
+	SemaType* TypeInference::VisitBooleanLiteral( BooleanLiteral *expression )
+	{
+		return SemaType::GetBoolean();
+	}
+
+	SemaType* TypeInference::VisitCharacterString( CharacterString *expression )
+	{
+		return SemaType::GetString();
+	}
+
+	SemaType* TypeInference::VisitVariable( Variable *variable )
+	{
+		Declaration *decl = variable->GetDeclaration();
+		if ( decl && decl->GetStatementType() == StatementType::FUNCTION_DECL_STMT ){
+			return SemaType::GetFunction();
+		}
+		return TypeOf( decl );
+	}
+
+	// the right operand is evaluated first
+	SemaType* TypeInference::VisitBinaryExpression( BinaryExpression *expression )
+	{
+		const ScannerTokenType operation = expression->GetToken().GetType();
+		if ( operation == ScannerTokenType::TOKEN_LAND || operation == ScannerTokenType::TOKEN_LOR ){
+			Analyze( expression->GetLHSExpression() );
+			const Facts left = facts;
+			Analyze( expression->GetRHSExpression() );
+			facts = Join( left, facts );
+			return SemaType::GetBoolean();
+		}
+
+		SemaType *right = Analyze( expression->GetRHSExpression() );
+		SemaType *left = Analyze( expression->GetLHSExpression() );
+		SemaType *result = ResultOf( operation, left, right );
+		if ( !result ){
+			ForgetNonLocals();
+		}
+		return result;
+	}
+
+	SemaType* TypeInference::VisitAssignmentExpression( AssignmentExpression *expression )
+	{
+		Expression *target = expression->GetLHSExpression();
+		AnalyzeTarget( target );
+		SemaType *result = Analyze( expression->GetRHSExpression() );
+
+		if ( expression->GetAssignmentType() != ScannerTokenType::TOKEN_ASSIGN ){
+			SemaType *current = nullptr;
+			if ( Variable *variable = NodeCast<Variable>( target ) ){
+				current = variable->type = TypeOf( variable->GetDeclaration() );
+			}
+			result = ResultOf( expression->GetAssignmentType(), current, result );
+			if ( !result ){
+				ForgetNonLocals();
 			}
 		}
+
+		// an element stored to an array or map doesn't change the variable holding it
+		if ( !NodeCast<SubscriptExpression>( target ) ){
+			Assign( target, result );
+		}
 		return result;
 	}
 
-	void SemaCheck1::AnalyzeExpression( Expression *expression, SCOPE )
+	// unary minus multiplies by -1
+	SemaType* TypeInference::VisitUnaryOperation( UnaryOperation *expression )
 	{
-		switch ( expression->GetExpressionType() )
-		{
-		default:;
+		if ( expression->OperationType() == ScannerTokenType::TOKEN_NOT ){
+			Analyze( expression->GetExpression() );
+			return SemaType::GetBoolean();
+		}
+
+		SemaType *operand = Analyze( expression->GetExpression() );
+		SemaType *result = ResultOf( ScannerTokenType::TOKEN_MUL, operand, SemaType::GetInteger() );
+		if ( !result ){
+			ForgetNonLocals();
+		}
+		return result;
+	}
+
+	SemaType* TypeInference::VisitConditionalExpression( ConditionalExpression *expression )
+	{
+		Analyze( expression->GetConditionalExpression() );
+		const Facts condition = facts;
+		SemaType *left = Analyze( expression->GetLhsExpression() );
+		const Facts taken = facts;
+		facts = condition;
+		SemaType *right = Analyze( expression->GetRhsExpression() );
+		facts = Join( taken, facts );
+		return SemaType::Join( left, right );
+	}
+
+	// arguments are pushed last first, then the callee is worked out
+	SemaType* TypeInference::VisitFunctionCall( FunctionCall *expression )
+	{
+		if ( ExpressionList *arguments = expression->GetArgumentList() ){
+			auto &expressions = arguments->GetExpressions();
+			for ( auto argument = expressions.rbegin(); argument != expressions.rend(); ++argument ){
+				Analyze( *argument );
+			}
+		}
+		Analyze( expression->GetFunctionExpression() );
+
+		// an array's size is read without calling anything
+		DotExpression *dot = NodeCast<DotExpression>( expression->GetFunctionExpression() );
+		ExpressionList *arguments = expression->GetArgumentList();
+		if ( dot && dot->GetIdentifier() == L"size" && ( !arguments || !arguments->Length() ) && dot->GetExpression()->type == SemaType::GetList() ){
+			return SemaType::GetInteger();
+		}
+		ForgetNonLocals();
+		return nullptr;
+	}
+
+	// 'Array.new_[ size ]' makes an array; its elements may be anything
+	SemaType* TypeInference::VisitSubscriptExpression( SubscriptExpression *expression )
+	{
+		AnalyzeTarget( expression );
+		Expression *base = expression;
+		while ( SubscriptExpression *subscript = NodeCast<SubscriptExpression>( base ) ){
+			base = subscript->GetExpression();
+		}
+		DotExpression *dot = NodeCast<DotExpression>( base );
+		Variable *type_name = dot ? NodeCast<Variable>( dot->GetExpression() ) : nullptr;
+		if ( type_name && dot->GetIdentifier() == L"new_" && type_name->GetName() == L"Array" ){
+			return SemaType::GetList();
 		}
+		return nullptr;
+	}
+
+	SemaType* TypeInference::VisitDotExpression( DotExpression *expression )
+	{
+		Analyze( expression->GetExpression() );
+		return nullptr;
+	}
+
+	SemaType* TypeInference::VisitPreIncrExpression( PreIncrExpression *expression )
+	{
+		return AnalyzeIncrement( expression->GetExpression(), true );
+	}
+
+	SemaType* TypeInference::VisitPreDecrExpression( PreDecrExpression *expression )
+	{
+		return AnalyzeIncrement( expression->GetExpression(), true );
+	}
+
+	SemaType* TypeInference::VisitPostIncrExpression( PostIncrExpression *expression )
+	{
+		return AnalyzeIncrement( expression->GetExpression(), false );
+	}
+
+	SemaType* TypeInference::VisitPostDecrExpression( PostDecrExpression *expression )
+	{
+		return AnalyzeIncrement( expression->GetExpression(), false );
+	}
+
+	SemaType* TypeInference::VisitLambdaExpression( LambdaExpression *expression )
+	{
+		if ( CompoundStatement *body = NodeCast<CompoundStatement>( expression->GetLambdaBody() ) ){
+			AnalyzeFunction( body->GetScope() );
+		}
+		return SemaType::GetLambda();
+	}
+
+	SemaType* TypeInference::VisitListExpression( ListExpression *expression )
+	{
+		if ( ExpressionList *elements = expression->GetExpressionList() ){
+			for ( Expression *element : elements->GetExpressions() ){
+				Analyze( element );
+			}
+		}
+		return SemaType::GetList();
+	}
+
+	SemaType* TypeInference::VisitMapExpression( MapExpression *expression )
+	{
+		for ( auto &key_value : *expression ){
+			Analyze( key_value.second );
+			Analyze( key_value.first );
+		}
+		return SemaType::GetDictionary();
+	}
+
+	SemaType* TypeInference::VisitNewExpression( NewExpression *expression )
+	{
+		Analyze( expression->GetExpression() );
+		ForgetNonLocals();
+		return nullptr;
 	}
 }
 
-#undef SCOPE
\ No newline at end of file
+#undef SCOPE
@@ -1,20 +1,19 @@
 #pragma once
 
 #include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "visitor.h"
+#include "types.hpp"
 
 #define SCOPE Scope *scope
 
 namespace compiler {
-	// forward declarations
-	class Scope;
-	class Statement;
-	class Expression;
-	class ParsedProgram;
-	class Declaration;
-	class ExpressionList;
-
-	class SemaCheck1
+	class SemaCheck1 : public TreeVisitor<SemaCheck1, void, Scope*>
 	{
+		friend class TreeVisitor<SemaCheck1, void, Scope*>;
+
 		std::vector<std::wstring>	error_messages;
 
 		bool is_parsing_loops;
@@ -28,26 +27,156 @@ namespace compiler {
 
 	private:
 		void AnalyzeScope( SCOPE );
-		void AnalyzeExpressionStatement( Statement *expression_statement, SCOPE );
-		void AnalyzeJumpStatement( Statement *statement, SCOPE );
-		
-		void AnalyzeLoopingStatements( Statement * statement, SCOPE );
-		void AnalyzeForEachStatement( Statement *statement, SCOPE );
-		void AnalyzeInfiniteLoopStatement( Statement *statement, SCOPE );
-		void AnalyzeDoWhileStatement( Statement *statement, SCOPE );
-		void AnalyzeWhileStatement( Statement *statement, SCOPE );
-		void AnalyzeShowStatement( Statement *statement, SCOPE );
-		void AnalyzeIfStatement( Statement *, SCOPE );
-		void AnalyzeSwitchStatement( Statement *statement, SCOPE );
-		
-		void AnalyzeBlockStatement( Statement *statement, SCOPE );
 		void AnalyzeExpression( Expression *expr, SCOPE );
-		void AppendError( std::wstring const & );
+		void AppendError( ParseNode *node, std::wstring const & );
+		bool DeclareName( Declaration *decl, SCOPE );
+		void CheckLoopJump( Statement *statement );
+		void DeclareParameters( ExpressionList *parameters, Scope *function_scope );
+
+		// statements
+		void VisitExpressionStatement( ExpressionStatement *statement, SCOPE );
+		void VisitReturnStatement( ReturnStatement *statement, SCOPE );
+		void VisitBreakStatement( BreakStatement *statement, SCOPE );
+		void VisitContinueStatement( ContinueStatement *statement, SCOPE );
+		void VisitForEachStatement( ForEachStatement *statement, SCOPE );
+		void VisitLoopStatement( LoopStatement *statement, SCOPE );
+		void VisitDoWhileStatement( DoWhileStatement *statement, SCOPE );
+		void VisitWhileStatement( WhileStatement *statement, SCOPE );
+		void VisitDumpStatement( DumpStatement *statement, SCOPE );
+		void VisitIfStatement( IfStatement *statement, SCOPE );
+		void VisitSwitchStatement( SwitchStatement *statement, SCOPE );
+		void VisitCompoundStatement( CompoundStatement *statement, SCOPE );
+		void VisitCaseStatement( CaseStatement *statement, SCOPE );
+		void VisitLabelledStatement( LabelledStatement *statement, SCOPE );
+
+		// declarations
+		void VisitDeclarationList( DeclarationList *decl_list, SCOPE );
+		void VisitVariableDeclaration( VariableDeclaration *decl, SCOPE );
+		void VisitClassDeclaration( ClassDeclaration *decl, SCOPE );
+		void VisitFunctionDeclaration( FunctionDeclaration *decl, SCOPE );
+
+		// expressions
+		void VisitVariable( Variable *variable, SCOPE );
+		void VisitBinaryExpression( BinaryExpression *expression, SCOPE );
+		void VisitConditionalExpression( ConditionalExpression *expression, SCOPE );
+		void VisitFunctionCall( FunctionCall *expression, SCOPE );
+		void VisitSubscriptExpression( SubscriptExpression *expression, SCOPE );
+		void VisitDotExpression( DotExpression *expression, SCOPE );
+		void VisitUnaryOperation( UnaryOperation *expression, SCOPE );
+		void VisitPreIncrExpression( PreIncrExpression *expression, SCOPE );
+		void VisitPreDecrExpression( PreDecrExpression *expression, SCOPE );
+		void VisitPostIncrExpression( PostIncrExpression *expression, SCOPE );
+		void VisitPostDecrExpression( PostDecrExpression *expression, SCOPE );
+		void VisitListExpression( ListExpression *expression, SCOPE );
+		void VisitMapExpression( MapExpression *expression, SCOPE );
+		void VisitNewExpression( NewExpression *expression, SCOPE );
+		void VisitLambdaExpression( LambdaExpression *expression, SCOPE );
+	private:
+		bool CheckParameterDuplicates( ExpressionList *parameters, ParseNode *owner );
+	};
+
+	/****************************
+	 * Flow-sensitive type inference.
+	 * Walks each function in the order
+	 * its code runs and sets the type
+	 * of every expression it can prove,
+	 * so the emitter may use typed
+	 * instructions. Loops are walked
+	 * until what is known at their top
+	 * stops changing
+	 ****************************/
+	class TypeInference : public TreeVisitor<TypeInference, SemaType*>
+	{
+		friend class TreeVisitor<TypeInference, SemaType*>;
+
+		// the types variables are sure to hold at a point of the code
+		struct Facts {
+			bool reachable;
+			std::unordered_map<Declaration*, SemaType*> types;
+		};
+
+		// where 'break' and 'continue' leave from
+		struct Exits {
+			bool is_switch;
+			Facts dispatch;							// a switch's facts on the way to its labels
+			std::vector<Facts> breaks;
+			std::vector<Facts> continues;
+		};
+
+		Facts facts;
+		std::vector<Exits> exits;
+		std::unordered_set<Declaration*> locals;	// variables only the function itself can change
+		bool in_function;
+
+	public:
+		TypeInference();
+		bool Visit( ParsedProgram* program );
 
-		void AnalyzeDeclaration( Statement *decl, SCOPE );
-		void AnalyzeClassDeclaration( Declaration* decl, SCOPE );
-		void AnalyzeFunctionDeclaration( Declaration* decl, SCOPE );
 	private:
-		bool CheckParameterDuplicates( ExpressionList *parameters, unsigned int const line_number );
+		SemaType* Analyze( Expression *expression );
+		void Analyze( Statement *statement );
+		void AnalyzeScope( Scope *scope );
+		void AnalyzeFunction( Scope *scope );
+		void AnalyzeTarget( Expression *target );
+		SemaType* AnalyzeIncrement( Expression *operand, bool is_prefix );
+
+		SemaType* TypeOf( Declaration *decl );
+		void Assign( Expression *target, SemaType *type );
+		void ForgetNonLocals();
+		void ForgetAll();
+		Exits* InnermostLoop();
+
+		static Facts Join( Facts const &a, Facts const &b );
+		static bool Same( Facts const &a, Facts const &b );
+		static SemaType* ResultOf( ScannerTokenType operation, SemaType *left, SemaType *right );
+
+		// statements
+		SemaType* VisitStatement( Statement *statement );
+		SemaType* VisitExpressionStatement( ExpressionStatement *statement );
+		SemaType* VisitDumpStatement( DumpStatement *statement );
+		SemaType* VisitReturnStatement( ReturnStatement *statement );
+		SemaType* VisitBreakStatement( BreakStatement *statement );
+		SemaType* VisitContinueStatement( ContinueStatement *statement );
+		SemaType* VisitEmptyStatement( EmptyStatement *statement );
+		SemaType* VisitCompoundStatement( CompoundStatement *statement );
+		SemaType* VisitIfStatement( IfStatement *statement );
+		SemaType* VisitWhileStatement( WhileStatement *statement );
+		SemaType* VisitDoWhileStatement( DoWhileStatement *statement );
+		SemaType* VisitLoopStatement( LoopStatement *statement );
+		SemaType* VisitForEachStatement( ForEachStatement *statement );
+		SemaType* VisitSwitchStatement( SwitchStatement *statement );
+		SemaType* VisitCaseStatement( CaseStatement *statement );
+		SemaType* VisitLabelledStatement( LabelledStatement *statement );
+
+		// declarations
+		SemaType* VisitDeclarationList( DeclarationList *decl_list );
+		SemaType* VisitVariableDeclaration( VariableDeclaration *decl );
+		SemaType* VisitFunctionDeclaration( FunctionDeclaration *decl );
+		SemaType* VisitClassDeclaration( ClassDeclaration *decl );
+
+		// expressions
+		SemaType* VisitExpression( Expression *expression );
+		SemaType* VisitNullLiteral( NullLiteral *expression );
+		SemaType* VisitCharacterLiteral( CharacterLiteral *expression );
+		SemaType* VisitIntegerLiteral( IntegerLiteral *expression );
+		SemaType* VisitFloatLiteral( FloatLiteral *expression );
+		SemaType* VisitBooleanLiteral( BooleanLiteral *expression );
+		SemaType* VisitCharacterString( CharacterString *expression );
+		SemaType* VisitVariable( Variable *variable );
+		SemaType* VisitBinaryExpression( BinaryExpression *expression );
+		SemaType* VisitAssignmentExpression( AssignmentExpression *expression );
+		SemaType* VisitUnaryOperation( UnaryOperation *expression );
+		SemaType* VisitConditionalExpression( ConditionalExpression *expression );
+		SemaType* VisitFunctionCall( FunctionCall *expression );
+		SemaType* VisitSubscriptExpression( SubscriptExpression *expression );
+		SemaType* VisitDotExpression( DotExpression *expression );
+		SemaType* VisitPreIncrExpression( PreIncrExpression *expression );
+		SemaType* VisitPreDecrExpression( PreDecrExpression *expression );
+		SemaType* VisitPostIncrExpression( PostIncrExpression *expression );
+		SemaType* VisitPostDecrExpression( PostDecrExpression *expression );
+		SemaType* VisitLambdaExpression( LambdaExpression *expression );
+		SemaType* VisitListExpression( ListExpression *expression );
+		SemaType* VisitMapExpression( MapExpression *expression );
+		SemaType* VisitNewExpression( NewExpression *expression );
 	};
-}
\ No newline at end of file
+}
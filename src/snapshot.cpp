@@ -0,0 +1,487 @@
+/***************************************************************************
+ * Heap images
+ *
+ * Copyright (c) 2017 Joshua Ogunyinka
+ * All rights reserved.
+*/
+
+#include "snapshot.h"
+#include "memory.h"
+
+using namespace runtime;
+using compiler::Bytecode;
+using compiler::BytecodeOptions;
+using compiler::BytecodeReader;
+using compiler::BytecodeWriter;
+using compiler::MappedFile;
+
+static const char MAGIC[] = { 'S', 'U', 'B', 'I' };
+
+// values holding a pointer into the heap
+static inline bool IsReference( RuntimeType type )
+{
+	switch ( type ) {
+	case CLS_TYPE:
+	case ARRAY_TYPE:
+	case STRING_TYPE:
+	case HASH_TYPE:
+	case FUNC_TYPE:
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+static inline Mark* MarkOf( Value const &object )
+{
+	return static_cast< Mark* >( static_cast< Value* >( object.value.ptr_value )[ -1 ].value.ptr_value );
+}
+
+// built-in classes by number, zero being none
+int Snapshot::ClassIndex( RuntimeClass* klass )
+{
+	for ( int i = 1; ClassOf( i ); ++i ) {
+		if ( ClassOf( i ) == klass ) {
+			return i;
+		}
+	}
+
+	return 0;
+}
+
+RuntimeClass* Snapshot::ClassOf( int32_t index )
+{
+	switch ( index ) {
+	case 1:
+		return BooleanClass::Instance();
+
+	case 2:
+		return IntegerClass::Instance();
+
+	case 3:
+		return FloatClass::Instance();
+
+	case 4:
+		return ArrayClass::Instance();
+
+	case 5:
+		return StringClass::Instance();
+
+	case 6:
+		return HashClass::Instance();
+
+	default:
+		return nullptr;
+	}
+}
+
+/****************************
+ * Writing
+ ****************************/
+bool Snapshot::IsSnapshot( std::wstring const &file_name )
+{
+	MappedFile file{ file_name };
+	return file.IsOpen() && file.GetSize() >= sizeof( MAGIC ) && !memcmp( file.GetBytes(), MAGIC, sizeof( MAGIC ) );
+}
+
+bool Snapshot::Write( std::wstring const &file_name, std::string const &program_bytes, ExecutableProgram* program,
+	Value* globals, size_t global_count )
+{
+	Snapshot snapshot{ globals, global_count };
+	const std::vector<ExecutableFunction*> functions = Bytecode::Functions( program );
+	for ( size_t i = 0; i < functions.size(); ++i ) {
+		snapshot.function_ids.insert( { functions[ i ], static_cast< int64_t >( i ) } );
+	}
+
+	// objects found are appended, and searched in turn
+	for ( size_t i = 0; i < global_count; ++i ) {
+		snapshot.Find( globals[ i ] );
+	}
+	for ( size_t i = 0; i < snapshot.objects.size(); ++i ) {
+		snapshot.FindContents( snapshot.objects[ i ] );
+	}
+
+	BytecodeWriter writer;
+	writer.Int64( static_cast< int64_t >( snapshot.objects.size() ) );
+	for ( Value const &object : snapshot.objects ) {
+		snapshot.WriteShape( writer, object );
+	}
+	for ( Value const &object : snapshot.objects ) {
+		snapshot.WriteContents( writer, object );
+	}
+	writer.Int64( static_cast< int64_t >( global_count ) );
+	for ( size_t i = 0; i < global_count; ++i ) {
+		snapshot.WriteValue( writer, globals[ i ] );
+	}
+	TRACE( TRACE_VM, TRACE_EVENTS, VM_SNAPSHOT, L"write", snapshot.objects.size(), global_count );
+
+	BytecodeWriter image;
+	image.Bytes( program_bytes );
+	image.Bytes( writer.GetBytes() );
+
+	return image.Save( file_name, MAGIC );
+}
+
+// instances kept in the frame aren't objects: their fields are globals already
+void Snapshot::Find( Value const &value )
+{
+	if ( !IsReference( value.type ) ) {
+		return;
+	}
+
+	Value* values = static_cast< Value* >( value.value.ptr_value );
+	if ( values >= frame && values < frame + frame_size ) {
+		return;
+	}
+
+	if ( ids.insert( { values, static_cast< int64_t >( objects.size() ) } ).second ) {
+		objects.push_back( value );
+	}
+}
+
+void Snapshot::FindContents( Value const &object )
+{
+	Value* values = static_cast< Value* >( object.value.ptr_value );
+	switch ( object.type ) {
+	case HASH_TYPE:
+		for ( auto &entry : static_cast< HashTable* >( values->value.ptr_value )->GetEntries() ) {
+			Find( entry.first );
+			Find( entry.second );
+		}
+		break;
+
+	case CLS_TYPE:
+		for ( int i = 0; i < MarkOf( object )->klass->GetInstanceCount(); ++i ) {
+			Find( values[ i ] );
+		}
+		break;
+
+	case ARRAY_TYPE:
+		for ( size_t i = 0; i < MarkOf( object )->array_size; ++i ) {
+			Find( values[ i ] );
+		}
+		break;
+
+	case FUNC_TYPE:
+		for ( size_t i = 1; i < MarkOf( object )->array_size; ++i ) {
+			Find( values[ i ] );
+		}
+		break;
+
+	default:
+		break;
+	}
+}
+
+// a reference is an object's number, or a frame slot's counted back from -1
+void Snapshot::WriteValue( BytecodeWriter &writer, Value const &value )
+{
+	writer.Int32( value.type );
+	writer.Int32( ClassIndex( value.sys_klass ) );
+	writer.String( value.user_klass ? value.user_klass->GetName() : L"" );
+
+	if ( IsReference( value.type ) ) {
+		Value* values = static_cast< Value* >( value.value.ptr_value );
+		if ( values >= frame && values < frame + frame_size ) {
+			writer.Int64( -static_cast< int64_t >( values - frame ) - 1 );
+		}
+		else {
+			writer.Int64( ids[ values ] );
+		}
+	}
+	else if ( value.type == META_TYPE ) {
+		writer.String( static_cast< Mark* >( value.value.ptr_value )->klass->GetName() );
+	}
+	else {
+		int64_t bits = 0;
+		memcpy( &bits, &value.value, std::min( sizeof( bits ), sizeof( value.value ) ) );
+		writer.Int64( bits );
+	}
+}
+
+void Snapshot::WriteShape( BytecodeWriter &writer, Value const &object )
+{
+	Value* values = static_cast< Value* >( object.value.ptr_value );
+	writer.Int32( object.type );
+	switch ( object.type ) {
+	case STRING_TYPE:
+		writer.String( *static_cast< std::wstring* >( values->value.ptr_value ) );
+		break;
+
+	case CLS_TYPE:
+		writer.String( MarkOf( object )->klass->GetName() );
+		break;
+
+	case ARRAY_TYPE: {
+		const int dimensions = ArrayClass::Dimensions( values );
+		writer.Int64( dimensions );
+		for ( int i = 0; i < dimensions; ++i ) {
+			WriteValue( writer, values[ i - ( dimensions + 1 ) ] );
+		}
+		writer.Int64( static_cast< int64_t >( MarkOf( object )->array_size ) );
+	}
+		break;
+
+	case FUNC_TYPE:
+		writer.Int64( function_ids[ static_cast< ExecutableFunction* >( values[ 0 ].value.ptr_value ) ] );
+		writer.Int64( static_cast< int64_t >( MarkOf( object )->array_size - 1 ) );
+		break;
+
+	default:
+		break;
+	}
+}
+
+void Snapshot::WriteContents( BytecodeWriter &writer, Value const &object )
+{
+	Value* values = static_cast< Value* >( object.value.ptr_value );
+	switch ( object.type ) {
+	case HASH_TYPE: {
+		std::vector<std::pair<Value, Value>> &entries = static_cast< HashTable* >( values->value.ptr_value )->GetEntries();
+		writer.Int64( static_cast< int64_t >( entries.size() ) );
+		for ( auto &entry : entries ) {
+			WriteValue( writer, entry.first );
+			WriteValue( writer, entry.second );
+		}
+	}
+		break;
+
+	case CLS_TYPE:
+		for ( int i = 0; i < MarkOf( object )->klass->GetInstanceCount(); ++i ) {
+			WriteValue( writer, values[ i ] );
+		}
+		break;
+
+	case ARRAY_TYPE:
+		for ( size_t i = 0; i < MarkOf( object )->array_size; ++i ) {
+			WriteValue( writer, values[ i ] );
+		}
+		break;
+
+	case FUNC_TYPE:
+		for ( size_t i = 1; i < MarkOf( object )->array_size; ++i ) {
+			WriteValue( writer, values[ i ] );
+		}
+		break;
+
+	default:
+		break;
+	}
+}
+
+/****************************
+ * Reading
+ ****************************/
+std::unique_ptr<ExecutableProgram> Snapshot::Read( std::wstring const &file_name, INT_T &last_label_id, BytecodeOptions &options,
+	Value* &globals )
+{
+	MappedFile file{ file_name };
+	if ( !file.IsOpen() || file.GetSize() < sizeof( MAGIC ) || memcmp( file.GetBytes(), MAGIC, sizeof( MAGIC ) ) ) {
+		return nullptr;
+	}
+
+	BytecodeReader reader{ file.GetBytes() + sizeof( MAGIC ), file.GetSize() - sizeof( MAGIC ) };
+	std::unique_ptr<ExecutableProgram> program = Bytecode::ReadProgram( reader, 0, last_label_id, options );
+	if ( !program ) {
+		return nullptr;
+	}
+
+	// the globals are allocated first: instances kept in the frame are referred to by slot
+	const size_t global_count = static_cast< size_t >( program->GetGlobal()->GetLocalCount() + 1 );
+	Snapshot snapshot{ new Value[ global_count ], global_count };
+	std::vector<ExecutableFunction*> functions = Bytecode::Functions( program.get() );
+
+	// objects aren't rooted until the globals are set, so nothing is collected while they're read
+	bool is_valid = true;
+	const size_t object_count = reader.Count( 4 );
+	for ( size_t i = 0; is_valid && i < object_count; ++i ) {
+		is_valid = snapshot.ReadShape( reader, program.get(), functions );
+	}
+	for ( size_t i = 0; is_valid && i < object_count; ++i ) {
+		is_valid = snapshot.ReadContents( reader, program.get(), snapshot.objects[ i ] );
+	}
+	if ( is_valid && reader.Count( 1 ) != global_count ) {
+		is_valid = false;
+	}
+	for ( size_t i = 0; is_valid && i < global_count; ++i ) {
+		is_valid = snapshot.ReadValue( reader, program.get(), snapshot.frame[ i ] );
+	}
+
+	// objects read before a failure are left for the collector
+	if ( !is_valid || !reader.IsValid() ) {
+		delete [] snapshot.frame;
+		return nullptr;
+	}
+	TRACE( TRACE_VM, TRACE_EVENTS, VM_SNAPSHOT, L"read", object_count, global_count );
+
+	globals = snapshot.frame;
+	return program;
+}
+
+bool Snapshot::ReadValue( BytecodeReader &reader, ExecutableProgram* program, Value &value )
+{
+	value = Value();
+	const int32_t type = reader.Int32();
+	if ( type < UNINIT_TYPE || type > CHAR_TYPE ) {
+		return false;
+	}
+	value.type = static_cast< RuntimeType >( type );
+
+	const int32_t class_index = reader.Int32();
+	value.sys_klass = ClassOf( class_index );
+	if ( class_index && !value.sys_klass ) {
+		return false;
+	}
+	const std::wstring user_name = reader.String();
+	if ( !user_name.empty() ) {
+		value.user_klass = program->GetClass( user_name );
+		if ( !value.user_klass ) {
+			return false;
+		}
+	}
+
+	if ( IsReference( value.type ) ) {
+		const int64_t id = reader.Int64();
+		if ( id < 0 ) {
+			const uint64_t slot = static_cast< uint64_t >( -( id + 1 ) );
+			if ( value.type != CLS_TYPE || slot == 0 || slot >= frame_size ) {
+				return false;
+			}
+			value.value.ptr_value = frame + slot;
+		}
+		else {
+			if ( static_cast< uint64_t >( id ) >= objects.size() || objects[ static_cast< size_t >( id ) ].type != value.type ) {
+				return false;
+			}
+			value.value.ptr_value = objects[ static_cast< size_t >( id ) ].value.ptr_value;
+		}
+	}
+	else if ( value.type == META_TYPE ) {
+		ExecutableClass* klass = program->GetClass( reader.String() );
+		if ( !klass ) {
+			return false;
+		}
+		value.value.ptr_value = MemoryManager::Instance()->FrameMark( klass );
+	}
+	else {
+		const int64_t bits = reader.Int64();
+		memcpy( &value.value, &bits, std::min( sizeof( bits ), sizeof( value.value ) ) );
+	}
+
+	return reader.IsValid();
+}
+
+bool Snapshot::ReadShape( BytecodeReader &reader, ExecutableProgram* program, std::vector<ExecutableFunction*> &functions )
+{
+	MemoryManager* memory = MemoryManager::Instance();
+	Value object;
+	object.type = static_cast< RuntimeType >( reader.Int32() );
+	switch ( object.type ) {
+	case STRING_TYPE: {
+		Value* values = memory->AllocateString( nullptr, 0, nullptr, 0 );
+		static_cast< std::wstring* >( values->value.ptr_value )->assign( reader.String() );
+		object.value.ptr_value = values;
+	}
+		break;
+
+	case HASH_TYPE:
+		object.value.ptr_value = memory->AllocateHash( nullptr, 0, nullptr, 0 );
+		break;
+
+	case CLS_TYPE: {
+		ExecutableClass* klass = program->GetClass( reader.String() );
+		if ( !klass ) {
+			return false;
+		}
+		object.value.ptr_value = memory->AllocateClass( klass, nullptr, 0, nullptr, 0 );
+	}
+		break;
+
+	case ARRAY_TYPE: {
+		const size_t dimension_count = reader.Count( 1 );
+		if ( !dimension_count ) {
+			return false;
+		}
+		// as pushed: the first dimension last
+		std::vector<Value> dimensions( dimension_count );
+		for ( size_t i = dimension_count; i > 0; --i ) {
+			if ( !ReadValue( reader, program, dimensions[ i - 1 ] ) ) {
+				return false;
+			}
+		}
+		const size_t size = reader.Count( 1 );
+		if ( !reader.IsValid() ) {
+			return false;
+		}
+		object.value.ptr_value = memory->AllocateArray( static_cast< INT_T >( size ), dimensions.data(), static_cast< int >( dimension_count ) );
+	}
+		break;
+
+	case FUNC_TYPE: {
+		const int64_t id = reader.Int64();
+		const size_t capture_count = reader.Count( 1 );
+		if ( !reader.IsValid() || id < 0 || static_cast< uint64_t >( id ) >= functions.size() ) {
+			return false;
+		}
+		object.value.ptr_value = memory->AllocateFunction( functions[ static_cast< size_t >( id ) ], capture_count, nullptr, 0, nullptr, 0 );
+	}
+		break;
+
+	default:
+		return false;
+	}
+
+	objects.push_back( object );
+
+	return reader.IsValid();
+}
+
+// a hash's keys are complete when they're inserted: strings were read with their shapes, and other objects hash by address
+bool Snapshot::ReadContents( BytecodeReader &reader, ExecutableProgram* program, Value const &object )
+{
+	Value* values = static_cast< Value* >( object.value.ptr_value );
+	switch ( object.type ) {
+	case HASH_TYPE: {
+		HashTable* table = static_cast< HashTable* >( values->value.ptr_value );
+		const size_t entry_count = reader.Count( 1 );
+		for ( size_t i = 0; i < entry_count; ++i ) {
+			Value key, value;
+			if ( !ReadValue( reader, program, key ) || !ReadValue( reader, program, value ) ) {
+				return false;
+			}
+			table->Insert( key, value );
+		}
+	}
+		break;
+
+	case CLS_TYPE:
+		for ( int i = 0; i < MarkOf( object )->klass->GetInstanceCount(); ++i ) {
+			if ( !ReadValue( reader, program, values[ i ] ) ) {
+				return false;
+			}
+		}
+		break;
+
+	case ARRAY_TYPE:
+		for ( size_t i = 0; i < MarkOf( object )->array_size; ++i ) {
+			if ( !ReadValue( reader, program, values[ i ] ) ) {
+				return false;
+			}
+		}
+		break;
+
+	case FUNC_TYPE:
+		for ( size_t i = 1; i < MarkOf( object )->array_size; ++i ) {
+			if ( !ReadValue( reader, program, values[ i ] ) ) {
+				return false;
+			}
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	return reader.IsValid();
+}
@@ -0,0 +1,67 @@
+/***************************************************************************
+ * Heap images
+ *
+ * Copyright (c) 2017 Joshua Ogunyinka
+ * All rights reserved.
+*/
+
+#ifndef __SNAPSHOT_H__
+#define __SNAPSHOT_H__
+
+#include "bytecode.h"
+#include "runtime.h"
+
+namespace runtime {
+	/****************************
+	 * A program with the heap its
+	 * global scope built: the program
+	 * as it was before it ran, then
+	 * every object the globals reach,
+	 * numbered in the order they're
+	 * found, then the globals. Objects
+	 * are written in two passes, what
+	 * they are and then what they hold,
+	 * so they can all be allocated
+	 * before any reference between them
+	 * is read. Built-in classes and
+	 * functions are named, not written,
+	 * and linked again when an image
+	 * is read
+	 ****************************/
+	class Snapshot {
+		Value* frame;
+		size_t frame_size;
+		std::unordered_map<void*, int64_t> ids;
+		std::vector<Value> objects;
+		std::unordered_map<ExecutableFunction*, int64_t> function_ids;
+
+		Snapshot( Value* frame, size_t frame_size ) : frame( frame ), frame_size( frame_size ) {
+		}
+
+		void Find( Value const &value );
+		void FindContents( Value const &object );
+		void WriteValue( compiler::BytecodeWriter &writer, Value const &value );
+		void WriteShape( compiler::BytecodeWriter &writer, Value const &object );
+		void WriteContents( compiler::BytecodeWriter &writer, Value const &object );
+
+		bool ReadValue( compiler::BytecodeReader &reader, ExecutableProgram* program, Value &value );
+		bool ReadShape( compiler::BytecodeReader &reader, ExecutableProgram* program, std::vector<ExecutableFunction*> &functions );
+		bool ReadContents( compiler::BytecodeReader &reader, ExecutableProgram* program, Value const &object );
+
+		static int ClassIndex( RuntimeClass* klass );
+		static RuntimeClass* ClassOf( int32_t index );
+
+	public:
+		static bool IsSnapshot( std::wstring const &file_name );
+
+		// 'program_bytes' is the program as Bytecode::WriteProgram wrote it before it ran; 'globals' are the global function's locals
+		static bool Write( std::wstring const &file_name, std::string const &program_bytes, ExecutableProgram* program,
+			Value* globals, size_t global_count );
+
+		// null if the file isn't an image this version wrote; 'globals' are then the global function's locals, allocated to be its frame
+		static std::unique_ptr<ExecutableProgram> Read( std::wstring const &file_name, INT_T &last_label_id,
+			compiler::BytecodeOptions &options, Value* &globals );
+	};
+}
+
+#endif
@@ -5,47 +5,341 @@
  * All rights reserved.
  */
 
+#include <cstdlib>
 #include <memory>
-#include "parser.h"
+#include "frontend.h"
 #include "semacheck.h"
-
-/*
+#include "optimizer.h"
+#include "bounds.h"
 #include "emitter.h"
-#include "runtime.h"
-*/
+#include "cfg.h"
+#include "escape.h"
+#include "peephole.h"
+#include "registers.h"
+#include "bytecode.h"
+#include "snapshot.h"
+
+// the front end and the optimizers; null if the sources have errors
+static std::unique_ptr<ExecutableProgram> Compile( std::vector<std::wstring> const &source_files, int optimize_level, bool use_registers,
+	INT_T &last_label_id )
+{
+	using compiler::FrontEnd;
+	using compiler::ParsedProgram;
+	using compiler::SemaCheck1;
+
+	std::unique_ptr<ParsedProgram> parsed_program{};
+	{
+		FrontEnd front_end{ source_files };
+		parsed_program = front_end.Parse();
+	}
+	if ( !parsed_program ) {
+		return nullptr;
+	}
+
+	SemaCheck1 non_local_decl_sema{};
+	if ( !parsed_program->Visit( non_local_decl_sema ) ){
+		non_local_decl_sema.ReportErrors();
+		return nullptr;
+	}
+
+	if ( optimize_level > 0 ) {
+		compiler::TreeOptimizer optimizer{ optimize_level };
+		parsed_program->Visit( optimizer );
+
+		// typed instructions where operands are proven integers or floats
+		compiler::TypeInference type_inference{};
+		parsed_program->Visit( type_inference );
+
+		// unchecked element access where loop conditions keep the index in bounds
+		compiler::BoundsAnalysis bounds_analysis{};
+		parsed_program->Visit( bounds_analysis );
+	}
+
+	compiler::Emitter emitter{ std::move( parsed_program ), optimize_level > 1 };
+	std::unique_ptr<ExecutableProgram> executable_program{ emitter.Emit() };
+	last_label_id = emitter.GetLastLabelId();
+	if ( executable_program && optimize_level > 0 ) {
+		compiler::FlowOptimizer::Optimize( executable_program.get() );
+		if ( optimize_level > 1 ) {
+			// arrays and instances that never leave their function are kept out of the heap
+			compiler::EscapeOptimizer::Optimize( executable_program.get() );
+			compiler::LoopOptimizer::Optimize( executable_program.get() );
+		}
+		if ( !use_registers ) {
+			compiler::PeepholeOptimizer::Optimize( executable_program.get() );
+		}
+	}
+
+	return executable_program;
+}
+
+static void Usage()
+{
+	std::wcerr << L"Usage: subc [options] <file>...\n"
+		L"  --registers            run the register machine instead of the stack machine\n"
+		L"  -O<level>              optimize the tree and the code; -O means -O2, which also inlines small\n"
+		L"                         functions and moves invariant code out of loops\n"
+		L"  --count-pairs          report the instruction pairs the stack machine executed most\n"
+		L"  --jit[=trace|method]   compile hot loops and functions, or only one of them\n"
+		L"  --cache=<directory>    keep compiled programs there, found again by their sources' contents\n"
+		L"  --compile=<file>       write the compiled program to <file> instead of running it; such a file\n"
+		L"                         given alone is run without compiling\n"
+		L"  --snapshot=<file>      write an image of the program and the heap its global scope built; such an\n"
+		L"                         image given alone calls 'main' without running that scope again\n"
+		L"  --profile[=<file>]     sample where the program spends its time and write folded stacks to <file>,\n"
+		L"                         'substance.folded' by default\n"
+		L"  --counters[=<file>]    count instructions, their operand types and calls as JSON in <file>,\n"
+		L"                         'substance.counters.json' by default\n"
+		L"  --trace[=<categories>] record events of 'vm', 'gc', 'parse' and 'emit', each at level 1 or 2,\n"
+		L"                         as 'vm:2,gc'; all of them at level 1 by default\n"
+		L"  --trace-file=<file>    write the trace to <file> instead of 'substance.trace'\n"
+		L"  --trace-print=<file>   print a trace file and stop\n"
+		L"  --gc-stats[=<n>]       report collections and the sites that allocated most when the program\n"
+		L"                         ends or gets SIGUSR1, sampling one allocation in <n>\n"
+		L"  --parse-only           scan and parse the sources, report their errors, and stop" << std::endl;
+}
 
 int main( int argc, const char* argv [] ) {
-	if ( argc == 2 ) {
-
-		using compiler::Parser;
-		using compiler::ParsedProgram;
-		using compiler::SemaCheck1;
-		
-		std::unique_ptr<ParsedProgram> parsed_program{};
-		{
-			Parser parser{ BytesToUnicode( argv[1] ) };
-			parsed_program = parser.Parse();
-		}
-
-		if ( parsed_program ) {
-			SemaCheck1 non_local_decl_sema{};
-			if ( !parsed_program->Visit( non_local_decl_sema ) ){
-				non_local_decl_sema.ReportErrors();
+	if ( argc >= 2 ) {
+		using compiler::Bytecode;
+		using compiler::BytecodeCache;
+		using compiler::BytecodeOptions;
+
+		std::vector<std::wstring> source_files;
+		std::wstring cache_directory;
+		std::wstring bytecode_file;
+		std::wstring snapshot_file;
+		std::wstring profile_file;
+		std::wstring counters_file;
+		std::string trace_categories;
+		std::wstring trace_file = L"substance.trace";
+		size_t gc_sample_every = 0;
+		bool use_registers = false;
+		bool count_pairs = false;
+		bool parse_only = false;
+		bool use_traces = false;
+		bool use_methods = false;
+		int optimize_level = 0;
+		for ( int i = 1; i < argc; ++i ) {
+			const std::string argument = argv[ i ];
+			if ( argument == "--registers" ) {
+				use_registers = true;
+			}
+			else if ( argument == "--count-pairs" ) {
+				count_pairs = true;
+			}
+			else if ( argument == "--parse-only" ) {
+				parse_only = true;
+			}
+			else if ( argument == "--jit" || argument == "--jit=trace" || argument == "--jit=method" ) {
+				use_traces = argument != "--jit=method";
+				use_methods = argument != "--jit=trace";
+			}
+			else if ( argument.compare( 0, 2, "-O" ) == 0 ) {
+				optimize_level = argument.size() > 2 ? atoi( argument.c_str() + 2 ) : 2;
+			}
+			else if ( argument.compare( 0, 8, "--cache=" ) == 0 ) {
+				cache_directory = BytesToUnicode( argument.substr( 8 ) );
+			}
+			else if ( argument.compare( 0, 10, "--compile=" ) == 0 ) {
+				bytecode_file = BytesToUnicode( argument.substr( 10 ) );
+			}
+			else if ( argument == "--profile" ) {
+				profile_file = L"substance.folded";
+			}
+			else if ( argument.compare( 0, 10, "--profile=" ) == 0 ) {
+				profile_file = BytesToUnicode( argument.substr( 10 ) );
+			}
+			else if ( argument == "--counters" ) {
+				counters_file = L"substance.counters.json";
+			}
+			else if ( argument.compare( 0, 11, "--counters=" ) == 0 ) {
+				counters_file = BytesToUnicode( argument.substr( 11 ) );
+			}
+			else if ( argument == "--trace" ) {
+				trace_categories = "vm,gc,parse,emit";
+			}
+			else if ( argument.compare( 0, 8, "--trace=" ) == 0 ) {
+				trace_categories = argument.substr( 8 );
+			}
+			else if ( argument.compare( 0, 13, "--trace-file=" ) == 0 ) {
+				trace_file = BytesToUnicode( argument.substr( 13 ) );
+			}
+			else if ( argument.compare( 0, 14, "--trace-print=" ) == 0 ) {
+				const std::wstring file_name = BytesToUnicode( argument.substr( 14 ) );
+				if ( !TraceLog::Print( file_name ) ) {
+					std::wcerr << L"Unable to read trace file: " << file_name << std::endl;
+					return -1;
+				}
+				return 0;
+			}
+			else if ( argument == "--gc-stats" ) {
+				gc_sample_every = 1;
+			}
+			else if ( argument.compare( 0, 11, "--gc-stats=" ) == 0 ) {
+				const int sample_every = atoi( argument.c_str() + 11 );
+				if ( sample_every < 1 ) {
+					std::wcerr << L"Sample one allocation in 1 or more: " << BytesToUnicode( argument ) << std::endl;
+					return -1;
+				}
+				gc_sample_every = sample_every;
+			}
+			else if ( argument.compare( 0, 11, "--snapshot=" ) == 0 ) {
+				snapshot_file = BytesToUnicode( argument.substr( 11 ) );
+			}
+			else if ( argument.compare( 0, 1, "-" ) == 0 ) {
+				std::wcerr << L"Unknown option: " << BytesToUnicode( argument ) << std::endl;
+				Usage();
 				return -1;
 			}
+			else {
+				source_files.push_back( BytesToUnicode( argv[ i ] ) );
+			}
+		}
 
-			/*
-			compiler::Emitter emitter{ std::move( parsed_program ) };
-			std::unique_ptr<ExecutableProgram> executable_program{ emitter.Emit() };
-			if ( executable_program ) {
-				runtime::Runtime runtime{ std::move( executable_program ), emitter.GetLastLabelId() };
-				runtime.Run();
-				return 0;
+		if ( source_files.empty() ) {
+			Usage();
+			return -1;
+		}
+		if ( parse_only ) {
+			compiler::FrontEnd front_end{ source_files };
+			return front_end.Parse() ? 0 : -1;
+		}
+		if ( use_registers && !snapshot_file.empty() ) {
+			std::wcerr << L"Images are taken by the stack machine" << std::endl;
+			return -1;
+		}
+		if ( use_registers && !counters_file.empty() ) {
+			std::wcerr << L"Counters are kept by the stack machine" << std::endl;
+			return -1;
+		}
+		if ( use_registers && count_pairs ) {
+			std::wcerr << L"Instruction pairs are counted by the stack machine" << std::endl;
+			return -1;
+		}
+		if ( use_registers && ( use_traces || use_methods ) ) {
+			std::wcerr << L"The JIT compiles for the stack machine" << std::endl;
+			return -1;
+		}
+		if ( !trace_categories.empty() ) {
+#ifdef _TRACE
+			if ( !TraceLog::Start( trace_categories, trace_file ) ) {
+				std::wcerr << L"Unknown trace categories: " << BytesToUnicode( trace_categories ) << std::endl;
+				return -1;
+			}
+#else
+			std::wcerr << L"Tracing isn't built in: build with _TRACE defined" << std::endl;
+			return -1;
+#endif
+		}
+
+		const BytecodeOptions options{ optimize_level, use_registers };
+		BytecodeOptions file_options = options;
+		std::unique_ptr<ExecutableProgram> executable_program{};
+		INT_T last_label_id = 0;
+		Value* image_globals = nullptr;
+		if ( source_files.size() == 1 && runtime::Snapshot::IsSnapshot( source_files[ 0 ] ) ) {
+			executable_program = runtime::Snapshot::Read( source_files[ 0 ], last_label_id, file_options, image_globals );
+			if ( !executable_program ) {
+				std::wcerr << L"Unable to read image file: " << source_files[ 0 ] << std::endl;
+				compiler::Emitter::ClearInstructions();
+				return -1;
+			}
+			if ( use_registers ) {
+				std::wcerr << L"Images are run by the stack machine: " << source_files[ 0 ] << std::endl;
+				compiler::Emitter::ClearInstructions();
+				return -1;
+			}
+		}
+		else if ( source_files.size() == 1 && Bytecode::IsBytecode( source_files[ 0 ] ) ) {
+			executable_program = Bytecode::Read( source_files[ 0 ], 0, last_label_id, file_options );
+			if ( !executable_program ) {
+				std::wcerr << L"Unable to read bytecode file: " << source_files[ 0 ] << std::endl;
+				return -1;
+			}
+			if ( file_options.for_registers != use_registers ) {
+				std::wcerr << L"Bytecode file compiled for the " << ( file_options.for_registers ? L"register" : L"stack" ) << L" machine: "
+					<< source_files[ 0 ] << std::endl;
+				compiler::Emitter::ClearInstructions();
+				return -1;
+			}
+		}
+		else {
+			std::unique_ptr<BytecodeCache> cache{};
+			uint64_t key = 0;
+			if ( !cache_directory.empty() ) {
+				cache.reset( new BytecodeCache( cache_directory ) );
+				key = Bytecode::Key( source_files, options );
+				if ( key ) {
+					executable_program = cache->Load( key, options, last_label_id );
+				}
+			}
+
+			if ( !executable_program ) {
+				executable_program = Compile( source_files, optimize_level, use_registers, last_label_id );
+				if ( executable_program && key ) {
+					cache->Store( key, options, executable_program.get(), last_label_id );
+				}
 			}
-			*/
-			// clean up
-			//compiler::Emitter::ClearInstructions();
 		}
+
+		if ( executable_program && !bytecode_file.empty() ) {
+			const bool is_written = Bytecode::Write( bytecode_file, executable_program.get(), last_label_id, 0, options );
+			if ( !is_written ) {
+				std::wcerr << L"Unable to write bytecode file: " << bytecode_file << std::endl;
+			}
+			executable_program.reset();
+			compiler::Emitter::ClearInstructions();
+			return is_written ? 0 : -1;
+		}
+
+		if ( executable_program && ( !use_registers || compiler::RegisterEmitter::Emit( executable_program.get() ) ) ) {
+			{
+				// an image holds the program as it was before it ran: running it counts calls and numbers traces in its instructions
+				std::string program_bytes;
+				if ( !snapshot_file.empty() ) {
+					compiler::BytecodeWriter writer;
+					Bytecode::WriteProgram( writer, executable_program.get(), last_label_id, 0, file_options );
+					program_bytes = writer.GetBytes();
+				}
+
+				runtime::Runtime runtime{ std::move( executable_program ), last_label_id };
+				if ( !profile_file.empty() ) {
+					runtime.Profile( profile_file );
+				}
+				if ( gc_sample_every ) {
+					runtime.KeepHeapStats( gc_sample_every );
+				}
+				if ( use_registers ) {
+					runtime.RunRegisters();
+				}
+				else {
+					if ( !counters_file.empty() ) {
+						runtime.Count( counters_file );
+					}
+					if ( count_pairs ) {
+						runtime.CountOpcodePairs();
+					}
+					if ( use_traces || use_methods ) {
+						runtime.UseJit( use_traces, use_methods );
+					}
+					if ( image_globals ) {
+						runtime.Restore( image_globals );
+					}
+					if ( !snapshot_file.empty() ) {
+						runtime.TakeSnapshot( snapshot_file, program_bytes );
+					}
+					runtime.Run();
+				}
+			}
+			compiler::Emitter::ClearInstructions();
+			return 0;
+		}
+		// clean up
+		compiler::Emitter::ClearInstructions();
+	}
+	else {
+		Usage();
 	}
 
 	return -1;
@@ -0,0 +1,90 @@
+/***************************************************************************
+ * Symbol table
+ *
+ * Copyright (c) 2017 Joshua Ogunyinka
+ * All rights reserved.
+ */
+
+#ifndef __SYMTAB_H__
+#define __SYMTAB_H__
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "arena.h"
+
+namespace compiler {
+	class Declaration;
+
+	// interned identifier; equal names share one address, so keys compare and hash as pointers
+	using Name = std::wstring const *;
+
+	/****************************
+	 * Interned identifiers of one
+	 * program
+	 ****************************/
+	class NameTable {
+		std::unordered_set<std::wstring> names;
+
+	public:
+		Name Intern( std::wstring const & identifier ) {
+			return &*names.insert( identifier ).first;
+		}
+
+		// nullptr if the identifier was never interned, i.e. nothing can be declared with it
+		Name Find( std::wstring const & identifier ) const {
+			auto iter = names.find( identifier );
+			return iter == names.cend() ? nullptr : &*iter;
+		}
+
+		size_t Size() const {
+			return names.size();
+		}
+	};
+
+	/****************************
+	 * Flat per-scope table; overloaded
+	 * functions share one name
+	 ****************************/
+	class SymbolTable {
+	public:
+		using symbol_map_t = std::unordered_multimap<Name, Declaration*, std::hash<Name>, std::equal_to<Name>,
+			ArenaAllocator<std::pair<Name const, Declaration*>>>;
+		using iterator = symbol_map_t::iterator;
+
+	private:
+		symbol_map_t symbols;
+
+	public:
+		explicit SymbolTable( ParseArena &arena ) : symbols( ArenaAllocator<symbol_map_t::value_type>( arena ) ) {
+		}
+
+		Declaration* Find( Name name ) const {
+			auto iter = symbols.find( name );
+			return iter == symbols.cend() ? nullptr : iter->second;
+		}
+
+		std::pair<iterator, iterator> FindAll( Name name ) {
+			return symbols.equal_range( name );
+		}
+
+		void Insert( Name name, Declaration* decl ) {
+			symbols.insert( { name, decl } );
+		}
+
+		size_t Size() const {
+			return symbols.size();
+		}
+
+		iterator begin() {
+			return symbols.begin();
+		}
+
+		iterator end() {
+			return symbols.end();
+		}
+	};
+}
+
+#endif
@@ -0,0 +1,282 @@
+/***************************************************************************
+ * Tracing
+ *
+ * Copyright (c) 2017 Joshua Ogunyinka
+ * All rights reserved.
+*/
+
+#include "trace.h"
+
+static const char TRACE_MAGIC[] = "SUBT";
+static const int32_t TRACE_VERSION = 2;
+static const size_t BUFFER_SIZE = 1 << 20;
+
+int TraceLog::levels[ TRACE_CATEGORIES ];
+std::wstring TraceLog::file_name;
+FILE* TraceLog::file;
+std::string TraceLog::buffer;
+std::unordered_map<std::wstring, uint32_t> TraceLog::names;
+std::chrono::steady_clock::time_point TraceLog::start;
+std::mutex TraceLog::lock;
+
+// how each event is printed; a field named 'type' is a runtime type, and a 'value' after it is printed as one
+struct EventFormat {
+	TraceCategory category;
+	const wchar_t* name;
+	const wchar_t* fields[ 4 ];
+};
+
+static const EventFormat formats[ TRACE_EVENT_KINDS ] = {
+	{ TRACE_VM, L"name", {} },
+	{ TRACE_VM, L"run", { L"registers" } },
+	{ TRACE_VM, L"end", { L"stack_pos" } },
+	{ TRACE_VM, L"instruction", { L"ip", L"instruction", L"operand1", L"operand2" } },
+	{ TRACE_VM, L"push", { L"type", L"value", L"stack_pos" } },
+	{ TRACE_VM, L"pop", { L"type", L"value", L"stack_pos" } },
+	{ TRACE_VM, L"push_frame", { L"depth" } },
+	{ TRACE_VM, L"pop_frame", { L"depth" } },
+	{ TRACE_VM, L"call", { L"depth" } },
+	{ TRACE_VM, L"tail_call", { L"depth" } },
+	{ TRACE_VM, L"return", { L"depth" } },
+	{ TRACE_VM, L"trace_exit", { L"ip" } },
+	{ TRACE_VM, L"cache", { L"key", L"hit" } },
+	{ TRACE_VM, L"snapshot", { L"objects", L"globals" } },
+	{ TRACE_GC, L"mark", { L"allocated" } },
+	{ TRACE_GC, L"mark_frame", {} },
+	{ TRACE_GC, L"mark_object", { L"type", L"size", L"address", L"depth" } },
+	{ TRACE_GC, L"marked", { L"count" } },
+	{ TRACE_GC, L"swept", { L"freed", L"bytes", L"left" } },
+	{ TRACE_PARSE, L"source", { L"characters" } },
+	{ TRACE_PARSE, L"class", { L"line" } },
+	{ TRACE_PARSE, L"function", { L"line" } },
+	{ TRACE_PARSE, L"variable", { L"line" } },
+	{ TRACE_PARSE, L"error", { L"line" } },
+	{ TRACE_EMIT, L"program", {} },
+	{ TRACE_EMIT, L"class", {} },
+	{ TRACE_EMIT, L"function", { L"parameters", L"locals", L"instructions" } },
+	{ TRACE_EMIT, L"instruction", { L"ip", L"instruction", L"operand1", L"operand2" } },
+	{ TRACE_EMIT, L"blocks", { L"blocks", L"loops" } },
+	{ TRACE_EMIT, L"error", { L"line" } },
+	{ TRACE_EMIT, L"trace", { L"label", L"steps", L"exits" } },
+	{ TRACE_EMIT, L"method", { L"compiled" } }
+};
+
+static const wchar_t* category_names[ TRACE_CATEGORIES ] = { L"vm", L"gc", L"parse", L"emit" };
+
+bool TraceLog::Start( std::string const &categories, std::wstring const &file_name )
+{
+	size_t begin = 0;
+	while ( begin <= categories.size() ) {
+		size_t end = categories.find( ',', begin );
+		if ( end == std::string::npos ) {
+			end = categories.size();
+		}
+		const std::string item = categories.substr( begin, end - begin );
+		const size_t colon = item.find( ':' );
+		const std::wstring category = BytesToUnicode( item.substr( 0, colon ) );
+		const int level = colon == std::string::npos ? TRACE_EVENTS : atoi( item.c_str() + colon + 1 );
+		if ( level < TRACE_OFF || level > TRACE_ALL ) {
+			return false;
+		}
+
+		int i = 0;
+		while ( i < TRACE_CATEGORIES && category != category_names[ i ] ) {
+			++i;
+		}
+		if ( i == TRACE_CATEGORIES ) {
+			return false;
+		}
+		levels[ i ] = level;
+		begin = end + 1;
+	}
+
+	TraceLog::file_name = file_name;
+	buffer.reserve( BUFFER_SIZE );
+	buffer.append( TRACE_MAGIC, 4 );
+	buffer.append( reinterpret_cast< const char* >( &TRACE_VERSION ), sizeof( TRACE_VERSION ) );
+	start = std::chrono::steady_clock::now();
+
+	static bool is_registered = false;
+	if ( !is_registered ) {
+		std::atexit( FlushAtExit );
+		is_registered = true;
+	}
+
+	return true;
+}
+
+uint32_t TraceLog::NameId( std::wstring const &name )
+{
+	auto result = names.find( name );
+	if ( result != names.end() ) {
+		return result->second;
+	}
+
+	// ids start at 1: 0 is no name
+	const uint32_t id = static_cast< uint32_t >( names.size() + 1 );
+	names.insert( { name, id } );
+	const std::string bytes = UnicodeToBytes( name );
+	Append( TRACE_NAME, id, static_cast< int64_t >( bytes.size() ), 0, 0, 0 );
+	buffer += bytes;
+
+	return id;
+}
+
+void TraceLog::Write( uint32_t event, std::wstring const *name, int64_t a, int64_t b, int64_t c, int64_t d )
+{
+	std::lock_guard<std::mutex> guard( lock );
+	Append( event, name ? NameId( *name ) : 0, a, b, c, d );
+}
+
+void TraceLog::Append( uint32_t event, uint32_t name, int64_t a, int64_t b, int64_t c, int64_t d )
+{
+	if ( buffer.size() + sizeof( Record ) > BUFFER_SIZE ) {
+		WriteBuffer();
+	}
+
+	Record record;
+	record.time = std::chrono::duration_cast< std::chrono::nanoseconds >( std::chrono::steady_clock::now() - start ).count();
+	record.event = event;
+	record.name = name;
+	record.fields[ 0 ] = a;
+	record.fields[ 1 ] = b;
+	record.fields[ 2 ] = c;
+	record.fields[ 3 ] = d;
+	buffer.append( reinterpret_cast< const char* >( &record ), sizeof( record ) );
+}
+
+void TraceLog::Flush()
+{
+	std::lock_guard<std::mutex> guard( lock );
+	WriteBuffer();
+}
+
+void TraceLog::WriteBuffer()
+{
+	if ( buffer.empty() ) {
+		return;
+	}
+
+	if ( !file ) {
+		file = fopen( UnicodeToBytes( file_name ).c_str(), "wb" );
+		if ( !file ) {
+			std::wcerr << L"Unable to write trace file: " << file_name << std::endl;
+			for ( int i = 0; i < TRACE_CATEGORIES; ++i ) {
+				levels[ i ] = TRACE_OFF;
+			}
+			buffer.clear();
+			return;
+		}
+	}
+
+	fwrite( buffer.c_str(), 1, buffer.size(), file );
+	fflush( file );
+	buffer.clear();
+}
+
+// a program may end anywhere, an error exiting it as well
+void TraceLog::FlushAtExit()
+{
+	std::lock_guard<std::mutex> guard( lock );
+	WriteBuffer();
+	if ( file ) {
+		fclose( file );
+		file = nullptr;
+	}
+}
+
+/****************************
+ * One line an event: the time in
+ * nanoseconds, the category, the
+ * event, its name if it has one
+ * and its fields
+ ****************************/
+bool TraceLog::Print( std::wstring const &file_name )
+{
+	FILE* in = fopen( UnicodeToBytes( file_name ).c_str(), "rb" );
+	if ( !in ) {
+		return false;
+	}
+
+	char magic[ 4 ];
+	int32_t version = 0;
+	if ( fread( magic, 1, 4, in ) != 4 || memcmp( magic, TRACE_MAGIC, 4 ) || fread( &version, sizeof( version ), 1, in ) != 1 ||
+		version != TRACE_VERSION ) {
+		fclose( in );
+		return false;
+	}
+
+	std::unordered_map<uint32_t, std::wstring> read_names;
+	Record record;
+	bool is_valid = true;
+	while ( fread( &record, sizeof( record ), 1, in ) == 1 ) {
+		if ( record.event >= TRACE_EVENT_KINDS ) {
+			is_valid = false;
+			break;
+		}
+
+		if ( record.event == TRACE_NAME ) {
+			std::string bytes( static_cast< size_t >( record.fields[ 0 ] ), '\0' );
+			if ( !bytes.empty() && fread( &bytes[ 0 ], 1, bytes.size(), in ) != bytes.size() ) {
+				is_valid = false;
+				break;
+			}
+			read_names[ record.name ] = BytesToUnicode( bytes );
+			continue;
+		}
+
+		EventFormat const &format = formats[ record.event ];
+		std::wcout << record.time << L" " << category_names[ format.category ] << L" " << format.name;
+		if ( record.name ) {
+			std::wcout << L" '" << read_names[ record.name ] << L"'";
+		}
+
+		RuntimeType type = UNINIT_TYPE;
+		for ( int i = 0; i < 4 && format.fields[ i ]; ++i ) {
+			const std::wstring field = format.fields[ i ];
+			const int64_t value = record.fields[ i ];
+			std::wcout << L" " << field << L"=";
+			if ( field == L"type" ) {
+				type = static_cast< RuntimeType >( value );
+				std::wcout << RuntimeTypeName( type );
+			}
+			else if ( field == L"instruction" ) {
+				std::wcout << ( value >= LOAD_TRUE_LIT && value <= NO_OP ? InstructionName( static_cast< InstructionType >( value ) ) : L"?" );
+			}
+			else if ( field == L"value" ) {
+				switch ( type ) {
+				case UNINIT_TYPE:
+					std::wcout << L"nil";
+					break;
+
+				case FLOAT_TYPE: {
+					FLOAT_T float_value;
+					memcpy( &float_value, &value, sizeof( float_value ) );
+					std::wcout << float_value;
+				}
+					break;
+
+				case BOOL_TYPE:
+				case INT_TYPE:
+				case CHAR_TYPE:
+					std::wcout << static_cast< INT_T >( value );
+					break;
+
+				default:
+					std::wcout << std::hex << L"0x" << value << std::dec;
+					break;
+				}
+			}
+			else if ( field == L"address" || field == L"key" ) {
+				std::wcout << std::hex << L"0x" << value << std::dec;
+			}
+			else {
+				std::wcout << value;
+			}
+		}
+		std::wcout << std::endl;
+	}
+	fclose( in );
+
+	return is_valid;
+}
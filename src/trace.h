@@ -0,0 +1,150 @@
+/***************************************************************************
+ * Tracing
+ *
+ * Copyright (c) 2017 Joshua Ogunyinka
+ * All rights reserved.
+*/
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <chrono>
+#include <mutex>
+#include <stdio.h>
+#include "common.h"
+
+// debug builds can trace; a release build that wants to defines _TRACE
+#if defined( _DEBUG ) && !defined( _TRACE )
+#define _TRACE
+#endif
+
+enum TraceCategory {
+	TRACE_VM,
+	TRACE_GC,
+	TRACE_PARSE,
+	TRACE_EMIT,
+	TRACE_CATEGORIES
+};
+
+// a category records the events of its level and those below it
+enum TraceLevel {
+	TRACE_OFF,
+	TRACE_EVENTS,		// runs, calls, collections, classes, functions and errors
+	TRACE_ALL			// every instruction, push, pop, frame and object marked as well
+};
+
+enum TraceEvent {
+	TRACE_NAME,			// a name the records after it refer to by number
+	VM_RUN,
+	VM_END,
+	VM_INSTRUCTION,
+	VM_PUSH,
+	VM_POP,
+	VM_PUSH_FRAME,
+	VM_POP_FRAME,
+	VM_CALL,
+	VM_TAIL_CALL,
+	VM_RETURN,
+	VM_TRACE_EXIT,
+	VM_CACHE,
+	VM_SNAPSHOT,
+	GC_MARK,
+	GC_MARK_FRAME,
+	GC_MARK_OBJECT,
+	GC_MARKED,
+	GC_SWEPT,
+	PARSE_SOURCE,
+	PARSE_CLASS,
+	PARSE_FUNCTION,
+	PARSE_VARIABLE,
+	PARSE_ERROR,
+	EMIT_PROGRAM,
+	EMIT_CLASS,
+	EMIT_FUNCTION,
+	EMIT_INSTRUCTION,
+	EMIT_BLOCKS,
+	EMIT_ERROR,
+	EMIT_TRACE,
+	EMIT_METHOD,
+	TRACE_EVENT_KINDS
+};
+
+/****************************
+ * Records what the compiler and
+ * the runtime do, by category and
+ * level, chosen when the program
+ * starts. The front end's threads
+ * record together, so every record
+ * is taken under one lock. Each event is a fixed
+ * size binary record, buffered and
+ * written in blocks; names are
+ * written once, the first time an
+ * event uses them. A build without
+ * _TRACE compiles the TRACE macro
+ * out. The file is in the byte
+ * order of the machine that wrote
+ * it, which prints it
+ ****************************/
+class TraceLog {
+	struct Record {
+		uint64_t time;					// nanoseconds since tracing began
+		uint32_t event;
+		uint32_t name;					// 0, or a name recorded before
+		int64_t fields[ 4 ];
+	};
+
+	static int levels[ TRACE_CATEGORIES ];
+	static std::wstring file_name;
+	static FILE* file;
+	static std::string buffer;
+	static std::unordered_map<std::wstring, uint32_t> names;
+	static std::chrono::steady_clock::time_point start;
+	static std::mutex lock;
+
+	// these three expect the lock held
+	static uint32_t NameId( std::wstring const &name );
+	static void Append( uint32_t event, uint32_t name, int64_t a, int64_t b, int64_t c, int64_t d );
+	static void WriteBuffer();
+
+	static void Write( uint32_t event, std::wstring const *name, int64_t a, int64_t b, int64_t c, int64_t d );
+	static void FlushAtExit();
+
+public:
+	static bool IsOn( TraceCategory category, TraceLevel level ) {
+		return levels[ category ] >= level;
+	}
+
+	// 'categories' is like "vm:2,gc,parse:1", a category without a level recording its events; false if it isn't
+	static bool Start( std::string const &categories, std::wstring const &file_name );
+	static void Flush();
+
+	static void Log( TraceEvent event, int64_t a = 0, int64_t b = 0, int64_t c = 0, int64_t d = 0 ) {
+		Write( event, nullptr, a, b, c, d );
+	}
+
+	static void Log( TraceEvent event, std::wstring const &name, int64_t a = 0, int64_t b = 0, int64_t c = 0, int64_t d = 0 ) {
+		Write( event, &name, a, b, c, d );
+	}
+
+	// a value's type, its bits and where it is on the stack
+	static void LogValue( TraceEvent event, Value const &value, size_t stack_pos ) {
+		int64_t bits = 0;
+		memcpy( &bits, &value.value, sizeof( value.value ) < sizeof( bits ) ? sizeof( value.value ) : sizeof( bits ) );
+		Write( event, nullptr, value.type, bits, static_cast< int64_t >( stack_pos ), 0 );
+	}
+
+	// writes a trace file as text, one event to a line
+	static bool Print( std::wstring const &file_name );
+};
+
+#ifdef _TRACE
+#define TRACE_IS_ON( category, level ) TraceLog::IsOn( category, level )
+#define TRACE( category, level, ... ) do { if ( TraceLog::IsOn( category, level ) ) { TraceLog::Log( __VA_ARGS__ ); } } while ( false )
+#define TRACE_VALUE( category, level, ... ) do { if ( TraceLog::IsOn( category, level ) ) { TraceLog::LogValue( __VA_ARGS__ ); } } while ( false )
+#else
+#define TRACE_IS_ON( category, level ) false
+#define TRACE( category, level, ... ) do { } while ( false )
+#define TRACE_VALUE( category, level, ... ) do { } while ( false )
+#endif
+
+#endif
@@ -40,10 +40,49 @@ Scope::list_of_ptrs<Statement>& Scope::GetStatements(){
 
 bool Scope::AddDeclaration( Declaration *decl )
 {
-	if ( !declarations ){ // perhaps the first declaration, makes sense to use the filename and line number
-		declarations = new DeclarationList( decl->GetLineNumber(), AccessType::NONE, StorageType::NONE );
+	if ( !decl ) return false;
+	switch ( decl->GetStatementType() ){
+	case StatementType::VARIABLE_DECL_STMT:
+	case StatementType::CLASS_DECL_STMT:
+	{
+		Name const name = names.Intern( decl->GetName() );
+		if ( symbols.Find( name ) ){
+			return false;
+		}
+		symbols.Insert( name, decl );
+		return true;
+	}
+	case StatementType::VDECL_LIST_STMT:
+	{
+		DeclarationList *decl_list = static_cast< DeclarationList* >( decl );
+		for ( std::pair<std::wstring const, Declaration *> &list_decl : decl_list->GetDeclarations() ){
+			if ( !AddDeclaration( list_decl.second ) ){
+				return false;
+			}
+		}
+		return true;
+	}
+	case StatementType::FUNCTION_DECL_STMT:
+	{
+		// functions may be overloaded on their number of parameters
+		FunctionDeclaration const *func_decl = static_cast< FunctionDeclaration const * >( decl );
+		unsigned int const param_count = func_decl->GetParameters() ? func_decl->GetParameters()->Length() : 0;
+		Name const name = names.Intern( func_decl->GetName() );
+
+		auto overloaded_func_range_pair = symbols.FindAll( name );
+		for ( SymbolTable::iterator first = overloaded_func_range_pair.first, second = overloaded_func_range_pair.second;
+			first != second; ++first ){
+			if ( first->second->GetStatementType() != StatementType::FUNCTION_DECL_STMT ) return false;
+			auto param_expr_list = static_cast< FunctionDeclaration* >( first->second )->GetParameters();
+			unsigned int const local_param_count = param_expr_list ? param_expr_list->Length() : 0;
+			if ( local_param_count == param_count ) return false;
+		}
+		symbols.Insert( name, decl );
+		return true;
+	}
+	default:
+		return false;
 	}
-	return declarations->AddDeclaration( decl );
 }
 
 int Scope::LocalCount() const { return local_count; }
@@ -55,81 +94,50 @@ void Scope::SetLocalCount( int count )
 
 Declaration* Scope::FindDeclaration( std::wstring const & identifier )
 {
-	Scope *current_scope = this;
-	do {
-		DeclarationList *decl_list = current_scope->GetDeclarationList();
-		if ( decl_list ){
-			auto declarations = decl_list->GetDeclarations();
-			auto find_iter = declarations.equal_range( identifier );
-			if ( find_iter.first != find_iter.second ){
-				return ( find_iter.first )->second;
-			}
-		}
-		current_scope = current_scope->GetParentScope();
-	} while ( current_scope );
-	return nullptr;
+	Name const name = names.Find( identifier );
+	return name ? FindDeclaration( name ) : nullptr;
 }
 
-bool DeclarationList::AddDeclaration( Declaration * declaration ){
-	if ( !declaration ) return false;
-	if ( declaration->GetStatementType() == StatementType::VARIABLE_DECL_STMT ||
-		declaration->GetStatementType() == StatementType::CLASS_DECL_STMT ){
-		auto find_decl_iter = declarations.find( declaration->GetName() );
-		if ( find_decl_iter == declarations.cend() ){
-			declarations.insert( { declaration->GetName(), declaration } );
-			return true;
-		}
-		return false;
-	}
-	else if ( declaration->GetStatementType() == StatementType::VDECL_LIST_STMT ){
-		DeclarationList *decl_list = dynamic_cast< DeclarationList* >( declaration );
-		for ( std::pair<std::wstring const, Declaration *> &decl : decl_list->GetDeclarations() ){
-			if ( !AddDeclaration( decl.second ) ){
-				return false;
-			}
+Declaration* Scope::FindDeclaration( Name name )
+{
+	for ( Scope *current_scope = this; current_scope; current_scope = current_scope->GetParentScope() ){
+		if ( Declaration *decl = current_scope->symbols.Find( name ) ){
+			return decl;
 		}
-		return true;
 	}
-	else if ( declaration->GetStatementType() == StatementType::FUNCTION_DECL_STMT ){
-		FunctionDeclaration const *func_decl = dynamic_cast< FunctionDeclaration const * >( declaration );
-		unsigned int const param_count = func_decl->GetParameters() ? func_decl->GetParameters()->Length() : 0;
-		std::wstring const & function_name = func_decl->GetName();
+	return nullptr;
+}
 
-		auto overloaded_func_range_pair = declarations.equal_range( function_name );
-		for ( declaration_list_t::iterator first = overloaded_func_range_pair.first, second = overloaded_func_range_pair.second;
-			first != second; ++first ){
-			if ( first->second->GetStatementType() != StatementType::FUNCTION_DECL_STMT ) return false;
-			auto param_expr_list = dynamic_cast< FunctionDeclaration* >( first->second )->GetParameters();
-			unsigned int const local_param_count = param_expr_list ? param_expr_list->Length() : 0;
-			if ( local_param_count == param_count ) return false;
-		}
-		declarations.insert( { function_name, declaration } );
-		return true;
+// looks the variable up once; later passes reuse the declaration cached on the node
+Declaration* Scope::ResolveVariable( Variable *variable )
+{
+	if ( !variable->GetDeclaration() ){
+		variable->SetDeclaration( FindDeclaration( variable->GetName() ) );
 	}
-	return false;
+	return variable->GetDeclaration();
 }
 
 ScopeType Scope::GetScopeType() const { 
 	return type; 
 }
 
-DeclarationList* Scope::GetDeclarationList()
+SymbolTable& Scope::GetSymbols()
 {
-	return declarations;
+	return symbols;
 }
 
-Scope::Scope( Scope * p ) : parent( p ), declarations( nullptr ), local_count( 0 ), type( ScopeType::FUNCTION_SCOPE ){
+Scope::Scope( ParseArena &a, NameTable &n, Scope * p ) : arena( a ), names( n ), parent( p ), local_count( 0 ),
+	symbols( a ), statements( ArenaAllocator<Statement*>( a ) ), type( ScopeType::FUNCTION_SCOPE ){
 }
 
-// to-do: properly delete declarations manually added to declarations in the first sema.
-// current status: No delete taken place, thus memory leak.
-Scope::~Scope(){
-	for ( Statement *statement : statements ){
-		if ( statement ){
-			delete statement;
-			statement = nullptr;
-		}
-	}
-	statements.clear();
+// declarations added during semantic analysis are arena allocated too, so they go with the tree
+ParseArena& Scope::GetArena()
+{
+	return arena;
+}
+
+NameTable& Scope::GetNames()
+{
+	return names;
 }
 
@@ -10,17 +10,22 @@
 #define __TREE_H__
 
 #include <vector>
+#include <memory>
+#include <stdexcept>
 #include <unordered_map>
 #include <algorithm>
 #include <set>
 #include "common.h"
 #include "scanner.h"
+#include "arena.h"
+#include "symtab.h"
 
 
 namespace compiler {
 	class Declaration;
 	class ExpressionList;
 	class Scope;
+	class Variable;
 	class Declaration;
 	class DeclarationList;
 	class Statement;
@@ -38,15 +43,30 @@ namespace compiler {
 	class ParseNode {
 	protected:
 		unsigned int line_num;
+		std::wstring const* file_name;	// owned by the ParsedProgram of its file
+
+		// nodes live in a ParseArena and are never deleted through a base pointer
+		~ParseNode() = default;
 	public:
-		ParseNode( const unsigned int line_number ) : line_num( line_number ), type( nullptr ) {
+		ParseNode( const unsigned int line_number ) : line_num( line_number ), file_name( nullptr ), type( nullptr ) {
 		}
 
-		virtual ~ParseNode() = default;
-		
 		const int GetLineNumber() {
 			return line_num;
 		}
+
+		const std::wstring GetFileName() {
+			return file_name ? *file_name : std::wstring();
+		}
+
+		void SetFileName( std::wstring const* name ) {
+			file_name = name;
+		}
+
+		// for nodes made after parsing, in place of 'node'
+		void SetFileName( ParseNode* node ) {
+			file_name = node->file_name;
+		}
 		SemaType	*type;
 	};
 
@@ -85,9 +105,6 @@ namespace compiler {
 		Expression( const unsigned int line_num ) : ParseNode( line_num ) {
 		}
 
-		virtual ~Expression() {
-		}
-
 		virtual const ExpressionType GetExpressionType() = 0;
 	};
 
@@ -96,35 +113,30 @@ namespace compiler {
 		Statement( const unsigned int line_num ) : ParseNode( line_num ) {
 		}
 
-		virtual ~Statement(){}
 		virtual StatementType GetStatementType() const = 0;
 	};
 
 	class ExpressionList {
-		std::deque<Expression*> expressions;
 	public:
-		ExpressionList( const unsigned int line_num ) {
+		using expression_list_t = std::vector<Expression*, ArenaAllocator<Expression*>>;
+	private:
+		expression_list_t expressions;
+	public:
+		ExpressionList( ParseArena &arena, const unsigned int line_num ) : expressions( ArenaAllocator<Expression*>( arena ) ) {
 		}
 
-		std::deque<Expression*>& GetExpressions() {
+		expression_list_t& GetExpressions() {
 			return expressions;
 		}
 		Expression* GetExpressionAt( unsigned int i ) {
 			return expressions.at( i );
 		}
-		std::deque<Expression*>::size_type Length(){
+		expression_list_t::size_type Length(){
 			return expressions.size();
 		}
 		void AddExpression( Expression* e ) {
 			expressions.push_back( e );
 		}
-		~ExpressionList(){
-			for ( Expression *expression : expressions ){
-				delete expression;
-				expression = nullptr;
-			}
-			expressions.clear();
-		}
 	};
 
 	/****************************
@@ -134,6 +146,8 @@ namespace compiler {
 		int id;
 		std::wstring char_string;
 	public:
+		static constexpr ExpressionType KIND = ExpressionType::CHAR_STR_EXPR;
+
 		CharacterString( const unsigned int line_num, const std::wstring &orig )
 			: Expression( line_num ) {
 			int skip = 2;
@@ -193,12 +207,9 @@ namespace compiler {
 			id = -1;
 		}
 
-		~CharacterString() {
-		}
-
 	public:
 		const ExpressionType GetExpressionType() {
-			return ExpressionType::CHAR_STR_EXPR;
+			return KIND;
 		}
 
 		void SetId( int i ) {
@@ -231,16 +242,15 @@ namespace compiler {
 	class BooleanLiteral : public Expression {
 		bool value;
 	public:
+		static constexpr ExpressionType KIND = ExpressionType::BOOLEAN_LIT_EXPR;
+
 		BooleanLiteral( const unsigned int line_num, bool v )
 			: Expression( line_num ), value( v ) {
 		}
 
-		~BooleanLiteral() {
-		}
-
 	public:
 		const ExpressionType GetExpressionType() {
-			return ExpressionType::BOOLEAN_LIT_EXPR;
+			return KIND;
 		}
 
 		bool GetValue() {
@@ -253,14 +263,14 @@ namespace compiler {
 	****************************/
 	class NullLiteral : public Expression {
 	public:
+		static constexpr ExpressionType KIND = ExpressionType::NULL_LIT_EXPR;
+
 		NullLiteral( unsigned int const line_number )
 			: Expression( line_number ) {
 		}
-
-		~NullLiteral() = default;
 	public:
 		const ExpressionType GetExpressionType() {
-			return ExpressionType::NULL_LIT_EXPR;
+			return KIND;
 		}
 	};
 
@@ -269,11 +279,13 @@ namespace compiler {
 		ExpressionList* parameters;
 		Statement*		body;
 	public:
+		static constexpr ExpressionType KIND = ExpressionType::LAMBDA_EXPR;
+
 		LambdaExpression( Token const & tok, ExpressionList* params, Statement* lambda_body )
 			: Expression( tok.GetLineNumber() ), parameters( params ), body( lambda_body ){
 		}
 		ExpressionType const GetExpressionType() override {
-			return ExpressionType::LAMBDA_EXPR;
+			return KIND;
 		}
 		Statement* GetLambdaBody(){
 			return body;
@@ -281,51 +293,39 @@ namespace compiler {
 		ExpressionList* GetParamaters(){
 			return parameters;
 		}
-		~LambdaExpression(){
-			delete body;
-			delete parameters;
-
-			body = nullptr;
-			parameters = nullptr;
-		}
 	};
 
 	class MapExpression : public Expression
 	{
 	public:
+		static constexpr ExpressionType KIND = ExpressionType::MAP_EXPR;
+
 		using expression_ptr_pair_t = std::pair<Expression*, Expression*>;
+		using expression_pair_list_t = std::vector<expression_ptr_pair_t, ArenaAllocator<expression_ptr_pair_t>>;
 	private:
-		std::vector<expression_ptr_pair_t> list_of_expressions;
+		expression_pair_list_t list_of_expressions;
 	public:
-		MapExpression( unsigned int const line_number, std::vector<expression_ptr_pair_t> && list ) :
+		MapExpression( unsigned int const line_number, expression_pair_list_t && list ) :
 			Expression( line_number ), list_of_expressions( std::move( list ) ){
 		}
 		ExpressionType const GetExpressionType() override {
-			return ExpressionType::MAP_EXPR;
+			return KIND;
 		}
 
-		std::vector<expression_ptr_pair_t>::size_type GetMapSize() const {
+		expression_pair_list_t::size_type GetMapSize() const {
 			return list_of_expressions.size();
 		}
 
-		std::vector<expression_ptr_pair_t>::iterator begin(){
+		expression_pair_list_t::iterator begin(){
 			return list_of_expressions.begin();
 		}
 
-		std::vector<expression_ptr_pair_t>::iterator end(){
+		expression_pair_list_t::iterator end(){
 			return list_of_expressions.end();
 		}
 		expression_ptr_pair_t& GetKeyDataAtIndex( unsigned int const index ) {
 			return list_of_expressions.at( index );
 		}
-		~MapExpression(){
-			for ( expression_ptr_pair_t ptr_pair : list_of_expressions ){
-				delete ptr_pair.first;
-				delete ptr_pair.second;
-				ptr_pair.first = ptr_pair.second = nullptr;
-			}
-			list_of_expressions.clear();
-		}
 	};
 
 	class NewExpression : public Expression
@@ -333,16 +333,22 @@ namespace compiler {
 		Expression *expression;
 
 	public:
+		static constexpr ExpressionType KIND = ExpressionType::NEW_EXPR;
+
 		NewExpression( unsigned int const line_number, Expression* expr ) :
 			Expression( line_number ), expression( expr ){
 		}
 
-		ExpressionType const GetExpressionType() override {
-			return ExpressionType::NEW_EXPR;
+		Expression* GetExpression(){
+			return expression;
+		}
+
+		void SetExpression( Expression* expr ){
+			expression = expr;
 		}
-		~NewExpression(){
-			delete expression;
-			expression = nullptr;
+
+		ExpressionType const GetExpressionType() override {
+			return KIND;
 		}
 	};
 	/****************************
@@ -352,21 +358,20 @@ namespace compiler {
 		CHAR_T value;
 
 	public:
+		static constexpr ExpressionType KIND = ExpressionType::CHAR_LIT_EXPR;
+
 		CharacterLiteral( const unsigned int line_num, CHAR_T v )
 			: Expression( line_num ), value( v ) {
 			value = v;
 		}
 
-		~CharacterLiteral() {
-		}
-
 	public:
 		CHAR_T GetValue() {
 			return value;
 		}
 
 		const ExpressionType GetExpressionType() {
-			return ExpressionType::CHAR_LIT_EXPR;
+			return KIND;
 		}
 	};
 
@@ -376,20 +381,18 @@ namespace compiler {
 	class IntegerLiteral : public Expression {
 		INT_T value;
 	public:
+		static constexpr ExpressionType KIND = ExpressionType::INT_LIT_EXPR;
 
 		IntegerLiteral( const unsigned int line_num, INT_T v )
 			: Expression( line_num ), value( v ) {
 		}
 
-		~IntegerLiteral() {
-		}
-
 		INT_T GetValue() {
 			return value;
 		}
 
 		const ExpressionType GetExpressionType() {
-			return ExpressionType::INT_LIT_EXPR;
+			return KIND;
 		}
 	};
 
@@ -399,19 +402,18 @@ namespace compiler {
 	class FloatLiteral : public Expression {
 		FLOAT_T value;
 	public:
+		static constexpr ExpressionType KIND = ExpressionType::FLOAT_LIT_EXPR;
+
 		FloatLiteral( const unsigned int line_num, FLOAT_T v )
 			: Expression( line_num ), value( v ) {
 			value = v;
 		}
-
-		~FloatLiteral() {
-		}
 		FLOAT_T GetValue() {
 			return value;
 		}
 
 		const ExpressionType GetExpressionType() {
-			return ExpressionType::FLOAT_LIT_EXPR;
+			return KIND;
 		}
 	};
 
@@ -461,17 +463,18 @@ namespace compiler {
 	class Scope {
 	public:
 		template<typename T>
-		using list_of_ptrs = std::vector<T*>;
+		using list_of_ptrs = std::vector<T*, ArenaAllocator<T*>>;
 
 	private:
+		ParseArena&				arena;			// owner of every node in this scope
+		NameTable&				names;			// interned identifiers of the program
 		Scope*					parent;			// parent scope
 		size_t					local_count;	// number of local variables
-		DeclarationList*		declarations;	// all variable declarations for the current scope
+		SymbolTable				symbols;		// all declarations for the current scope
 		list_of_ptrs<Statement>	statements;		// statements for that scope
 		ScopeType				type;
 	public:
-		explicit Scope( Scope * );
-		~Scope();
+		Scope( ParseArena &arena, NameTable &names, Scope *parent );
 		Scope*	GetParentScope();
 		void	SetParentScope( Scope *parent_scope );
 		void	SetScopeType( ScopeType );
@@ -481,9 +484,13 @@ namespace compiler {
 		void	SetLocalCount( int count );
 
 		ScopeType					GetScopeType() const;
-		DeclarationList*			GetDeclarationList();
+		SymbolTable&				GetSymbols();
 		list_of_ptrs<Statement>&	GetStatements();
 		Declaration*				FindDeclaration( std::wstring const & identifier );
+		Declaration*				FindDeclaration( Name name );
+		Declaration*				ResolveVariable( Variable *variable );
+		ParseArena&					GetArena();
+		NameTable&					GetNames();
 	};
 
 	enum class DeclarationType {
@@ -536,53 +543,43 @@ namespace compiler {
 		std::wstring const GetName() const {
 			return name;
 		}
-		virtual ~Declaration() = default;
 	};
 
 
 	class DeclarationList : public Declaration
 	{
 	public:
-		using declaration_list_t = std::unordered_multimap<std::wstring, Declaration*>;
+		static constexpr StatementType KIND = StatementType::VDECL_LIST_STMT;
+
+		// kept in source order, so initializers run the way they were written
+		using declaration_list_t = std::vector<std::pair<std::wstring const, Declaration*>,
+			ArenaAllocator<std::pair<std::wstring const, Declaration*>>>;
 	private:
 		declaration_list_t declarations;
 	public:
 
-		DeclarationList( unsigned int const line_number, AccessType access, StorageType storage, declaration_list_t && decl_list = {} ) :
+		DeclarationList( unsigned int const line_number, AccessType access, StorageType storage, declaration_list_t && decl_list ) :
 			Declaration( line_number ), declarations( std::move( decl_list ) ){
 			SetAccessType( access );
 			SetStorageType( storage );
 		}
-		~DeclarationList(){
-			for ( std::pair< std::wstring const, Declaration*> &decl : declarations ){
-				if ( decl.second ){
-					delete decl.second;
-					decl.second = nullptr;
-				}
-			}
-			declarations.clear();
-		}
-
-		bool AddDeclaration( Declaration * decl );
 
 		declaration_list_t& GetDeclarations(){
 			return declarations;
 		}
 
 		StatementType GetStatementType() const override {
-			return StatementType::VDECL_LIST_STMT;
+			return KIND;
 		}
 	};
 
 	class CompoundStatement : public Statement {
 		Scope* scope;
 	public:
+		static constexpr StatementType KIND = StatementType::COMPOUND_STATEMENT;
+
 		CompoundStatement( unsigned int const line_num, Scope* s ) : Statement( line_num ), scope( s ){
 		}
-		~CompoundStatement(){
-			delete scope;
-			scope = nullptr;
-		}
 
 		Scope::list_of_ptrs<Statement>& GetStatementList(){
 			return scope->GetStatements();
@@ -592,7 +589,7 @@ namespace compiler {
 		}
 
 		StatementType GetStatementType() const final override {
-			return StatementType::COMPOUND_STATEMENT;
+			return KIND;
 		}
 	};
 
@@ -601,29 +598,33 @@ namespace compiler {
 		Expression* expression;
 
 	public:
+		static constexpr StatementType KIND = StatementType::EXPR_STATEMENT;
+
 		ExpressionStatement( unsigned int const line_num, Expression* expr ) : Statement( line_num ), expression( expr ){
 		}
-		~ExpressionStatement(){
-			delete expression;
-			expression = nullptr;
-		}
 
 		Expression* GetExpression(){
 			return expression;
 		}
 
+		void SetExpression( Expression* expr ){
+			expression = expr;
+		}
+
 		StatementType GetStatementType() const final override {
-			return StatementType::EXPR_STATEMENT;
+			return KIND;
 		}
 	};
 
 	class EmptyStatement : public Statement {
 	public:
+		static constexpr StatementType KIND = StatementType::EMPTY_STMT;
+
 		EmptyStatement( unsigned int line_number ) : Statement( line_number ){
 		}
 
 		StatementType GetStatementType() const final override{
-			return StatementType::EMPTY_STMT;
+			return KIND;
 		}
 	};
 
@@ -632,23 +633,25 @@ namespace compiler {
 		std::wstring const	label_name;
 
 	public:
+		static constexpr StatementType KIND = StatementType::LABELLED_STATEMENT;
+
 		LabelledStatement( unsigned int const line_num, std::wstring const & label, Statement* statement ) : Statement( line_num ),
 			label_statement( statement ), label_name( label ){
 		}
-		~LabelledStatement(){
-			delete label_statement;
-			label_statement = nullptr;
-		}
 
 		Statement* GetStatement(){
 			return label_statement;
 		}
 
+		void SetStatement( Statement* statement ){
+			label_statement = statement;
+		}
+
 		std::wstring const GetLabelName() const {
 			return label_name;
 		}
 		StatementType GetStatementType() const final override {
-			return StatementType::LABELLED_STATEMENT;
+			return KIND;
 		}
 	};
 
@@ -656,61 +659,65 @@ namespace compiler {
 		Expression* case_expression;
 		Statement*	case_statement;
 	public:
+		static constexpr StatementType KIND = StatementType::CASE_STATEMENT;
+
 		CaseStatement( unsigned int const line_number, Expression* expression, Statement* statement ) : Statement( line_number ),
 			case_expression( expression ), case_statement( statement ){
 		}
-		~CaseStatement(){
-			delete case_expression;
-			delete case_statement;
-			case_expression = nullptr;
-			case_statement = nullptr;
-		}
 
 		Expression*	GetExpression(){ return case_expression; }
 		Statement*	GetStatement() { return case_statement; }
-		StatementType GetStatementType() const final override{ return StatementType::CASE_STATEMENT; }
+		void		SetExpression( Expression* expression ){ case_expression = expression; }
+		void		SetStatement( Statement* statement ){ case_statement = statement; }
+		StatementType GetStatementType() const final override{ return KIND; }
 	};
 
 	class ReturnStatement : public Statement {
 		Expression* expression;
 
 	public:
+		static constexpr StatementType KIND = StatementType::RETURN_STATEMENT;
+
 		ReturnStatement( const unsigned int line_num, Expression* expr ) : Statement( line_num ), expression( expr ) {
 		}
-		~ReturnStatement(){
-			delete expression;
-			expression = nullptr;
-		}
 
 		Expression* GetExpression() {
 			return expression;
 		}
 
+		void SetExpression( Expression* expr ) {
+			expression = expr;
+		}
+
 		StatementType GetStatementType() const final override {
-			return StatementType::RETURN_STATEMENT;
+			return KIND;
 		}
 	};
 
 
 	class ContinueStatement : public Statement {
 	public:
+		static constexpr StatementType KIND = StatementType::CONTINUE_STATEMENT;
+
 		ContinueStatement( unsigned int const line_num )
 			: Statement( line_num ){
 		}
 
 		StatementType GetStatementType() const final override {
-			return StatementType::CONTINUE_STATEMENT;
+			return KIND;
 		}
 	};
 
 
 	class BreakStatement : public Statement {
 	public:
+		static constexpr StatementType KIND = StatementType::BREAK_STATEMENT;
+
 		BreakStatement( const unsigned int line_num ) : Statement( line_num ){
 		}
 
 		StatementType GetStatementType() const final override {
-			return StatementType::BREAK_STATEMENT;
+			return KIND;
 		}
 	};
 
@@ -721,18 +728,13 @@ namespace compiler {
 		std::wstring	caller;
 		bool			returns_value;
 	public:
+		static constexpr ExpressionType KIND = ExpressionType::FUNCTION_CALL_EXPR;
+
 		FunctionCall( const unsigned int line_num, Expression* func, ExpressionList* args ) : Expression( line_num ), 
 			function( func ), arguments( args ), caller( L"" ), returns_value( false ){
 		}
-		~FunctionCall(){
-			delete function;
-			delete arguments;
-
-			function = nullptr;
-			arguments = nullptr;
-		}
 		const ExpressionType GetExpressionType() {
-			return ExpressionType::FUNCTION_CALL_EXPR;
+			return KIND;
 		}
 
 		void SetReturnsValue( bool r ) {
@@ -757,19 +759,21 @@ namespace compiler {
 		Expression* expression;
 
 	public:
+		static constexpr StatementType KIND = StatementType::SHOW_STATEMENT;
+
 		DumpStatement( unsigned int const line_num, Expression* expr ) : Statement( line_num ), expression( expr ) {
 		}
-		~DumpStatement(){
-			delete expression;
-			expression = nullptr;
-		}
 
 		Expression* GetExpression() {
 			return expression;
 		}
 
+		void SetExpression( Expression* expr ) {
+			expression = expr;
+		}
+
 		StatementType GetStatementType() const final override {
-			return StatementType::SHOW_STATEMENT;
+			return KIND;
 		}
 	};
 
@@ -778,28 +782,27 @@ namespace compiler {
 		Statement*	switch_statement;
 
 	public:
+		static constexpr StatementType KIND = StatementType::SWITCH_STATEMENT;
+
 		SwitchStatement( unsigned int const line_num, Expression* logical_exp, Statement* body ) :
 			Statement( line_num ), conditional_expression( logical_exp ),
 			switch_statement( body ){
 		}
-		~SwitchStatement(){
-			delete conditional_expression;
-			delete switch_statement;
-
-			conditional_expression = nullptr;
-			switch_statement = nullptr;
-		}
 
 		Expression* GetExpression() {
 			return conditional_expression;
 		}
 
+		void SetExpression( Expression* expression ) {
+			conditional_expression = expression;
+		}
+
 		Statement* GetSwitchBlock() {
 			return switch_statement;
 		}
 
 		StatementType GetStatementType() const final override {
-			return StatementType::SWITCH_STATEMENT;
+			return KIND;
 		}
 	};
 
@@ -808,25 +811,26 @@ namespace compiler {
 		Statement*	do_while_body;
 		Expression* logical_expression;
 	public:
+		static constexpr StatementType KIND = StatementType::DO_WHILE_STATEMENT;
+
 		DoWhileStatement( unsigned int const line_num, Statement* body, Expression* expr ) : Statement( line_num ), 
 			do_while_body( body ), logical_expression( expr ){
 		}
-		~DoWhileStatement(){
-			delete do_while_body;
-			delete logical_expression;
-
-			do_while_body = nullptr;
-			logical_expression = nullptr;
-		}
 		Statement* GetStatement(){
 			return do_while_body;
 		}
 		Expression* GetExpression(){
 			return logical_expression;
 		}
+		void SetStatement( Statement* body ){
+			do_while_body = body;
+		}
+		void SetExpression( Expression* expr ){
+			logical_expression = expr;
+		}
 
 		StatementType GetStatementType() const final override {
-			return StatementType::DO_WHILE_STATEMENT;
+			return KIND;
 		}
 	};
 
@@ -835,16 +839,11 @@ namespace compiler {
 		Statement*	while_body;
 
 	public:
+		static constexpr StatementType KIND = StatementType::WHILE_STATEMENT;
+
 		WhileStatement( unsigned int const line_num, Expression* logical_expr, Statement* block ) : Statement( line_num ), 
 			logical_expression( logical_expr ), while_body( block ){
 		}
-		~WhileStatement(){
-			delete logical_expression;
-			delete while_body;
-
-			logical_expression = nullptr;
-			while_body = nullptr;
-		}
 
 		Expression* GetExpression() {
 			return logical_expression;
@@ -854,23 +853,29 @@ namespace compiler {
 			return while_body;
 		}
 
+		void SetExpression( Expression* logical_expr ) {
+			logical_expression = logical_expr;
+		}
+
+		void SetStatement( Statement* block ) {
+			while_body = block;
+		}
+
 		StatementType GetStatementType() const final override {
-			return StatementType::WHILE_STATEMENT;
+			return KIND;
 		}
 	};
 
 	class LoopStatement : public Statement {
 		CompoundStatement* loop_body;
 	public:
+		static constexpr StatementType KIND = StatementType::LOOP_STATEMENT;
+
 		LoopStatement( unsigned int const line_number, CompoundStatement* body ) : Statement( line_number ), loop_body( body ){
 		}
-		~LoopStatement(){
-			delete loop_body;
-			loop_body = nullptr;
-		}
 
 		StatementType GetStatementType() const final override {
-			return StatementType::LOOP_STATEMENT;
+			return KIND;
 		}
 		CompoundStatement* GetLoopBody(){
 			return loop_body;
@@ -881,26 +886,18 @@ namespace compiler {
 		Expression* expression;
 		Statement*	body_statement;
 	public:
+		static constexpr StatementType KIND = StatementType::FOR_EACH_IN_STATEMENT;
+
 		Declaration* decl;
 		ForEachStatement( unsigned int const line_number, Expression* expr, Statement* body ) : Statement( line_number ), 
 			expression( expr ), body_statement( body ), decl( nullptr ){
 		}
-		~ForEachStatement(){
-			delete expression;
-			delete body_statement;
-			if ( decl ){
-				delete decl;
-				decl = nullptr;
-			}
-			expression = nullptr;
-			body_statement = nullptr;
-		}
 
 		Expression* GetExpression() const { return expression; }
 		Statement*	GetStatement() const  { return body_statement; }
 
 		StatementType GetStatementType() const final override {
-			return StatementType::FOR_EACH_IN_STATEMENT;
+			return KIND;
 		}
 	};
 
@@ -910,19 +907,12 @@ namespace compiler {
 		Statement*	else_statement;
 
 	public:
+		static constexpr StatementType KIND = StatementType::IF_ELSE_STATEMENT;
+
 		IfStatement( const unsigned int line_num, Expression* logical_exp, Statement* then_part, Statement* else_part )
 			: Statement( line_num ), conditional_expression( logical_exp ),
 			then_statement( then_part ), else_statement( else_part ){
 		}
-		~IfStatement(){
-			delete conditional_expression;
-			delete then_statement;
-			delete else_statement;
-
-			conditional_expression = nullptr;
-			then_statement = nullptr;
-			else_statement = nullptr;
-		}
 
 		Expression* GetExpression() {
 			return conditional_expression;
@@ -936,8 +926,20 @@ namespace compiler {
 			return else_statement;
 		}
 
+		void SetExpression( Expression* logical_exp ) {
+			conditional_expression = logical_exp;
+		}
+
+		void SetIfBlock( Statement* then_part ) {
+			then_statement = then_part;
+		}
+
+		void SetElseBlock( Statement* else_part ) {
+			else_statement = else_part;
+		}
+
 		StatementType GetStatementType() const final override {
-			return StatementType::IF_ELSE_STATEMENT;
+			return KIND;
 		}
 	};
 
@@ -945,7 +947,6 @@ namespace compiler {
 	protected:
 		UnaryExpression( unsigned int const line_num ) : Expression( line_num ){
 		}
-		virtual ~UnaryExpression() = default;
 	};
 
 	class BinaryExpression : public Expression {
@@ -954,18 +955,13 @@ namespace compiler {
 		Expression*	lhs;
 		Expression* rhs;
 	public:
+		static constexpr ExpressionType KIND = ExpressionType::BINARY_EXPR;
+
 		BinaryExpression( Token const & tok, Expression* lhs_expression, Expression* rhs_expression ) :
-			Expression( token.GetLineNumber() ),
+			Expression( tok.GetLineNumber() ),
 			token( tok ), lhs( lhs_expression ), rhs( rhs_expression ){
 		}
 
-		virtual ~BinaryExpression(){
-			delete lhs;
-			delete rhs;
-
-			lhs = nullptr;
-			rhs = nullptr;
-		}
 
 		Token const GetToken() const { return token;  }
 		Expression* GetLHSExpression() {
@@ -974,8 +970,14 @@ namespace compiler {
 		Expression* GetRHSExpression() {
 			return rhs;
 		}
+		void SetLHSExpression( Expression* lhs_expression ) {
+			lhs = lhs_expression;
+		}
+		void SetRHSExpression( Expression* rhs_expression ) {
+			rhs = rhs_expression;
+		}
 		virtual ExpressionType const GetExpressionType() override {
-			return ExpressionType::BINARY_EXPR;
+			return KIND;
 		}
 	};
 
@@ -984,6 +986,8 @@ namespace compiler {
 	 ****************************/
 	class AssignmentExpression : public BinaryExpression {
 	public:
+		static constexpr ExpressionType KIND = ExpressionType::ASSIGNMENT_EXPR;
+
 		AssignmentExpression( Token const & tok, Expression* lhs_expression, Expression* rhs_expression ) :
 			BinaryExpression( tok, lhs_expression, rhs_expression ){
 		}
@@ -1001,24 +1005,35 @@ namespace compiler {
 		}
 
 		ExpressionType const GetExpressionType() override {
-			return ExpressionType::ASSIGNMENT_EXPR;
+			return KIND;
 		}
 	};
 
 	class Variable : public Expression
 	{
 		std::wstring const variable_name;
+		Declaration* declaration;	// cached by Scope::ResolveVariable
 	public:
+		static constexpr ExpressionType KIND = ExpressionType::VARIABLE_EXPR;
+
 		explicit Variable( Token const &tok ) : Expression( tok.GetLineNumber() ), 
-			variable_name( tok.GetIdentifier() ){
+			variable_name( tok.GetIdentifier() ), declaration( nullptr ){
 		}
 
 		Variable( unsigned int const line_number, std::wstring const & identifier ) :
-			Expression( line_number ), variable_name( identifier ){
+			Expression( line_number ), variable_name( identifier ), declaration( nullptr ){
+		}
+
+		Declaration* GetDeclaration(){
+			return declaration;
+		}
+
+		void SetDeclaration( Declaration* decl ){
+			declaration = decl;
 		}
 
 		ExpressionType const GetExpressionType() override {
-			return ExpressionType::VARIABLE_EXPR;
+			return KIND;
 		}
 		std::wstring const GetName(){
 			return variable_name;
@@ -1031,18 +1046,11 @@ namespace compiler {
 		Expression*	lhs_expression;
 		Expression* rhs_expression;
 	public:
+		static constexpr ExpressionType KIND = ExpressionType::CONDITIONAL_EXPR;
+
 		ConditionalExpression( unsigned int const line_num, Expression* conditional, Expression* lhs, Expression* rhs ) 
 			: Expression( line_num ), conditional_expression( conditional ), lhs_expression( lhs ), rhs_expression( rhs ){
 		}
-		~ConditionalExpression(){
-			delete conditional_expression;
-			delete lhs_expression;
-			delete rhs_expression;
-
-			conditional_expression = nullptr;
-			lhs_expression = nullptr;
-			rhs_expression = nullptr;
-		}
 
 		Expression* GetConditionalExpression(){
 			return conditional_expression;
@@ -1056,8 +1064,20 @@ namespace compiler {
 			return lhs_expression;
 		}
 
+		void SetConditionalExpression( Expression* conditional ){
+			conditional_expression = conditional;
+		}
+
+		void SetLhsExpression( Expression* lhs ){
+			lhs_expression = lhs;
+		}
+
+		void SetRhsExpression( Expression* rhs ){
+			rhs_expression = rhs;
+		}
+
 		ExpressionType const GetExpressionType() override {
-			return ExpressionType::CONDITIONAL_EXPR;
+			return KIND;
 		}
 	};
 
@@ -1065,26 +1085,28 @@ namespace compiler {
 		Expression			*expression;
 		ScannerTokenType	type;
 	public:
+		static constexpr ExpressionType KIND = ExpressionType::UNARY_EXPR;
+
 		UnaryOperation( unsigned int const line_num, ScannerTokenType t, Expression* expr ) :
 			UnaryExpression( line_num ), type( t ),
 			expression( expr ){
 		}
 
-		~UnaryOperation(){
-			delete expression;
-			expression = nullptr;
-		}
 
 		Expression* GetExpression(){
 			return expression;
 		}
 
+		void SetExpression( Expression* expr ){
+			expression = expr;
+		}
+
 		ScannerTokenType OperationType() const {
 			return type;
 		}
 
 		ExpressionType const GetExpressionType() final override {
-			return ExpressionType::UNARY_EXPR;
+			return KIND;
 		}
 	};
 
@@ -1094,7 +1116,6 @@ namespace compiler {
 		PostfixExpression( unsigned int const line_number ) :
 			UnaryExpression( line_number ){
 		}
-		virtual ~PostfixExpression() = default;
 	};
 
 	class SubscriptExpression : public PostfixExpression
@@ -1102,15 +1123,11 @@ namespace compiler {
 		Expression* expression;
 		Expression* array_index;
 	public:
-		SubscriptExpression( unsigned int const line_number, Expression* expr, Expression* index )
-			: PostfixExpression( line_number ), expression( expr ), array_index( index ){
-		}
-		~SubscriptExpression(){
-			delete expression;
-			delete array_index;
+		static constexpr ExpressionType KIND = ExpressionType::SUBSCRIPT_EXPR;
 
-			expression = nullptr;
-			array_index = nullptr;
+		bool in_bounds;		// the index is proven to be within the array
+		SubscriptExpression( unsigned int const line_number, Expression* expr, Expression* index )
+			: PostfixExpression( line_number ), expression( expr ), array_index( index ), in_bounds( false ){
 		}
 
 		Expression* GetExpression(){
@@ -1119,8 +1136,14 @@ namespace compiler {
 		Expression* GetIndex(){
 			return array_index;
 		}
+		void SetExpression( Expression* expr ){
+			expression = expr;
+		}
+		void SetIndex( Expression* index ){
+			array_index = index;
+		}
 		ExpressionType const GetExpressionType() final override {
-			return ExpressionType::SUBSCRIPT_EXPR;
+			return KIND;
 		}
 	};
 
@@ -1129,20 +1152,26 @@ namespace compiler {
 		Token const	variable_id;
 		Expression* expression;
 	public:
+		static constexpr ExpressionType KIND = ExpressionType::DOT_EXPRESSION;
+
 		DotExpression( unsigned int const line_number, Token const & id, Expression* expr )
 			: PostfixExpression( line_number ), variable_id( id ), expression( expr ){
 		}
-		~DotExpression(){
-			delete expression;
-			expression = nullptr;
-		}
 
 		Expression* GetExpression(){
 			return expression;
 		}
 
+		void SetExpression( Expression* expr ){
+			expression = expr;
+		}
+
+		std::wstring const GetIdentifier() const {
+			return variable_id.GetIdentifier();
+		}
+
 		ExpressionType const GetExpressionType() override {
-			return ExpressionType::DOT_EXPRESSION;
+			return KIND;
 		}
 	};
 
@@ -1150,20 +1179,18 @@ namespace compiler {
 	{
 		Expression* expression;
 	public:
+		static constexpr ExpressionType KIND = ExpressionType::POST_INCR_EXPR;
+
 		PostIncrExpression( unsigned int const line_number, Expression* expr ) :
 			PostfixExpression( line_number ), expression( expr ){
 		}
-		~PostIncrExpression(){
-			delete expression;
-			expression = nullptr;
-		}
 
 		Expression* GetExpression(){
 			return expression;
 		}
 
 		ExpressionType const GetExpressionType() final override {
-			return ExpressionType::POST_INCR_EXPR;
+			return KIND;
 		}
 	};
 
@@ -1171,20 +1198,18 @@ namespace compiler {
 	{
 		Expression* expression;
 	public:
+		static constexpr ExpressionType KIND = ExpressionType::POST_DECR_EXPR;
+
 		PostDecrExpression( unsigned int const line_number, Expression* expr ) :
 			PostfixExpression( line_number ), expression( expr ){
 		}
-		~PostDecrExpression(){
-			delete expression;
-			expression = nullptr;
-		}
 
 		Expression* GetExpression(){
 			return expression;
 		}
 
 		ExpressionType const GetExpressionType() final override {
-			return ExpressionType::POST_DECR_EXPR;
+			return KIND;
 		}
 	};
 
@@ -1192,19 +1217,17 @@ namespace compiler {
 	{
 		Expression* expression;
 	public:
+		static constexpr ExpressionType KIND = ExpressionType::PRE_INCR_EXPR;
+
 		PreIncrExpression( unsigned int const line_number, Expression* expr ) : UnaryExpression( line_number ), expression( expr ){
 		}
-		~PreIncrExpression(){
-			delete expression;
-			expression = nullptr;
-		}
 
 		Expression* GetExpression(){
 			return expression;
 		}
 
 		ExpressionType const GetExpressionType() final override {
-			return ExpressionType::PRE_INCR_EXPR;
+			return KIND;
 		}
 	};
 
@@ -1212,20 +1235,18 @@ namespace compiler {
 	{
 		Expression* expression;
 	public:
+		static constexpr ExpressionType KIND = ExpressionType::PRE_DECR_EXPR;
+
 		PreDecrExpression( unsigned int const line_number, Expression* expr ) :
 			UnaryExpression( line_number ), expression( expr ){
 		}
-		~PreDecrExpression(){
-			delete expression;
-			expression = nullptr;
-		}
 
 		Expression* GetExpression(){
 			return expression;
 		}
 
 		ExpressionType const GetExpressionType() final override {
-			return ExpressionType::PRE_DECR_EXPR;
+			return KIND;
 		}
 	};
 
@@ -1233,16 +1254,14 @@ namespace compiler {
 	{
 		ExpressionList* expression_list;
 	public:
+		static constexpr ExpressionType KIND = ExpressionType::LIST_EXPR;
+
 		ListExpression( Token const & token, ExpressionList* expr_list ) :
 			Expression( token.GetLineNumber() ), expression_list( expr_list ){
 		}
-		~ListExpression(){
-			delete expression_list;
-			expression_list = nullptr;
-		}
 
 		ExpressionType const GetExpressionType() override {
-			return ExpressionType::LIST_EXPR;
+			return KIND;
 		}
 
 		ExpressionList* GetExpressionList(){
@@ -1268,23 +1287,18 @@ namespace compiler {
 		unsigned int		nparams_count;
 
 	public:
+		static constexpr StatementType KIND = StatementType::FUNCTION_DECL_STMT;
+
 		FunctionDeclaration( const unsigned int line_num, const std::wstring &function_name,
 			ExpressionList* params ) : Declaration( line_num, function_name ), storage( StorageType::NONE ),
 			access( AccessType::NONE ), function_type( FunctionType::FUNCTION ), parameters( params ),
 			function_body( nullptr ), local_count( 0 ), nparams_count( 0 ){
 		}
 
-		~FunctionDeclaration(){
-			delete function_body;
-			delete parameters;
-
-			function_body = nullptr;
-			parameters = nullptr;
-		}
 
 		CompoundStatement* GetFunctionBody() const { return function_body;  }
 		StatementType GetStatementType() const final override {
-			return StatementType::FUNCTION_DECL_STMT;
+			return KIND;
 		}
 
 		ExpressionList* GetParameters() const {
@@ -1292,11 +1306,6 @@ namespace compiler {
 		}
 
 		inline void SetFunctionBody( CompoundStatement* body ){
-			if ( function_body ){
-				// who knows? I may be stupid enough to actually do this more than once
-				delete function_body;
-				function_body = nullptr;
-			}
 			function_body = body;
 		}
 
@@ -1344,21 +1353,22 @@ namespace compiler {
 		bool is_const_;
 		Expression* value_expr;
 	public:
+		static constexpr StatementType KIND = StatementType::VARIABLE_DECL_STMT;
+
 		VariableDeclaration( unsigned int const line_number, std::wstring const & id, Expression* expr, bool is_const ) : 
 			Declaration( line_number, id ), is_const_( is_const ),
 			value_expr( expr ){
 		}
-		~VariableDeclaration(){
-			delete value_expr;
-			value_expr = nullptr;
-		}
 
 		StatementType GetStatementType() const final override {
-			return StatementType::VARIABLE_DECL_STMT;
+			return KIND;
 		}
 		Expression* GetExpression(){
 			return value_expr;
 		}
+		void SetExpression( Expression* expr ){
+			value_expr = expr;
+		}
 	};
 
 	class ClassDeclaration : public Declaration {
@@ -1368,36 +1378,27 @@ namespace compiler {
 		unsigned int		instance_variable_count;
 		unsigned int		static_variable_count;
 
-		std::vector<Declaration*> decl_list;
+		Scope::list_of_ptrs<Declaration> decl_list;
 	public:
-		ClassDeclaration( const unsigned int line_num, const std::wstring &name, Scope *parent, bool is_struct ) 
+		static constexpr StatementType KIND = StatementType::CLASS_DECL_STMT;
+
+		ClassDeclaration( const unsigned int line_num, const std::wstring &name, Scope *class_scope, bool is_struct )
 			:Declaration( line_num, name ), is_struct_( is_struct ),
-			scope( new Scope( parent ) ),
-			instance_variable_count(0), static_variable_count( 0 )
+			scope( class_scope ),
+			instance_variable_count(0), static_variable_count( 0 ),
+			decl_list( ArenaAllocator<Declaration*>( class_scope->GetArena() ) )
 		{
 		}
-		~ClassDeclaration(){
-			if ( !decl_list.empty() ){
-				for ( auto & decl : decl_list ){
-					delete decl;
-					decl = nullptr;
-				}
-				decl_list.clear();
-			}
-
-			delete scope;
-			scope = nullptr;
-		}
 
 		Scope* GetClassScope(){
 			return scope;
 		}
 		
-		DeclarationList* GetDeclarations() const {
-			return scope->GetDeclarationList();
+		SymbolTable& GetDeclarations() const {
+			return scope->GetSymbols();
 		}
 
-		std::vector<Declaration*>& GetDeclList() { return decl_list; }
+		Scope::list_of_ptrs<Declaration>& GetDeclList() { return decl_list; }
 		void AddStatement( Declaration *stmt ){
 			decl_list.push_back( stmt );
 		}
@@ -1406,7 +1407,7 @@ namespace compiler {
 		}
 
 		StatementType GetStatementType() const override final {
-			return StatementType::CLASS_DECL_STMT;
+			return KIND;
 		}
 
 		bool IsStruct(){
@@ -1426,21 +1427,21 @@ namespace compiler {
 	 * Parsed program class
 	 ****************************/
 	class ParsedProgram {
-		Scope*  global_scope;
+		std::wstring	file_name;	// the source of a single file, named by its nodes
+		ParseArena	arena;	// owns the whole tree; released in one go
+		std::shared_ptr<NameTable>	names;	// shared by every file of a multi-file program
+		Scope*		global_scope;
+		std::vector<std::unique_ptr<ParsedProgram>> units;	// linked files, kept for their arenas
 
 		inline void checkAndThrow(){
 			if ( !global_scope ){
-				throw std::bad_exception( "The global scope has not been set yet." );
+				throw std::logic_error( "The global scope has not been set yet." );
 			}
 		}
 
 	public:
-		ParsedProgram(): global_scope( nullptr ){
-		}
-
-		~ParsedProgram(){
-			delete global_scope;
-			global_scope = nullptr;
+		explicit ParsedProgram( std::shared_ptr<NameTable> shared_names = std::make_shared<NameTable>() ) :
+			names( std::move( shared_names ) ), global_scope( nullptr ){
 		}
 
 		template<typename Func, typename ...Args>
@@ -1462,6 +1463,11 @@ namespace compiler {
 			return global_scope;
 		}
 
+		void SetFileName( std::wstring const &name ) {
+			file_name = name;
+			arena.SetFileName( &file_name );
+		}
+
 		int GetLocalCount() {
 			if ( !global_scope ) return 0;
 			return global_scope->LocalCount();
@@ -1473,105 +1479,121 @@ namespace compiler {
 		}
 
 		void SetConstructs( Scope* scope ){
-			if ( global_scope ){
-				delete global_scope;
-				global_scope = nullptr;
-			}
 			global_scope = scope;
 		}
+
+		ParseArena& GetArena() {
+			return arena;
+		}
+
+		NameTable& GetNames() {
+			return *names;
+		}
+
+		// links a separately parsed file; its global statements join ours, in order
+		void AddUnit( std::unique_ptr<ParsedProgram> unit ){
+			if ( !global_scope ){
+				global_scope = arena.Make<Scope>( arena, *names, nullptr );
+				global_scope->SetScopeType( ScopeType::NAMESPACE_SCOPE );
+			}
+			for ( Statement* statement : unit->GetGlobalScope()->GetStatements() ){
+				global_scope->AddStatement( statement );
+			}
+			units.push_back( std::move( unit ) );
+		}
 	};
 
 	/****************************
 	 * TreeFactory class
 	 ****************************/
 	struct TreeFactory {
-		static Statement* MakeReturnStatement( unsigned int line_num, Expression* expression ){
-			Statement* return_statement{ new ReturnStatement( line_num, expression ) };
+		static Statement* MakeReturnStatement( ParseArena &arena, unsigned int line_num, Expression* expression ){
+			Statement* return_statement{ arena.Make<ReturnStatement>( line_num, expression ) };
 			return return_statement;
 		}
 
-		static Statement* MakeContinueStatement( unsigned int line_num ){
-			Statement* continue_statement{ new ContinueStatement( line_num ) };
+		static Statement* MakeContinueStatement( ParseArena &arena, unsigned int line_num ){
+			Statement* continue_statement{ arena.Make<ContinueStatement>( line_num ) };
 			return continue_statement;
 		}
 
-		static Statement* MakeBreakStatement( unsigned int line_num ) {
-			Statement* break_statement{ new BreakStatement( line_num ) };
+		static Statement* MakeBreakStatement( ParseArena &arena, unsigned int line_num ) {
+			Statement* break_statement{ arena.Make<BreakStatement>( line_num ) };
 			return break_statement;
 		}
 
-		static Statement* MakeExpressionStatement( unsigned int line_num, Expression* expression )
+		static Statement* MakeExpressionStatement( ParseArena &arena, unsigned int line_num, Expression* expression )
 		{
-			Statement* expression_statement{ new ExpressionStatement( line_num, expression ) };
+			Statement* expression_statement{ arena.Make<ExpressionStatement>( line_num, expression ) };
 			return expression_statement;
 		}
 
-		static Expression* MakeAssignmentExpression( Token const & token, Expression* lhs_expression,
+		static Expression* MakeAssignmentExpression( ParseArena &arena, Token const & token, Expression* lhs_expression,
 			Expression* rhs_expression )
 		{
-			Expression* assign_expr{ new AssignmentExpression( token, lhs_expression, rhs_expression ) };
+			Expression* assign_expr{ arena.Make<AssignmentExpression>( token, lhs_expression, rhs_expression ) };
 			return assign_expr;
 		}
 
-		static Expression* MakePreIncrExpression( Token const & token, Expression* expr )
+		static Expression* MakePreIncrExpression( ParseArena &arena, Token const & token, Expression* expr )
 		{
-			Expression* pre_incr_expression{ new PreIncrExpression( token.GetLineNumber(), expr ) };
+			Expression* pre_incr_expression{ arena.Make<PreIncrExpression>( token.GetLineNumber(), expr ) };
 			return pre_incr_expression;
 		}
 
-		static Statement* MakeShowExpressionStatement( Token const & tok, Expression* expr )
+		static Statement* MakeShowExpressionStatement( ParseArena &arena, Token const & tok, Expression* expr )
 		{
-			Statement* dump_statement{ new DumpStatement( tok.GetLineNumber(), expr ) };
+			Statement* dump_statement{ arena.Make<DumpStatement>( tok.GetLineNumber(), expr ) };
 			return dump_statement;
 		}
 
-		static Expression* MakeVariable( Token const & tok )
+		static Expression* MakeVariable( ParseArena &arena, Token const & tok )
 		{
-			Expression* var{ new Variable( tok ) };
+			Expression* var{ arena.Make<Variable>( tok ) };
 			return var;
 		}
 
-		static Expression* MakePreDecrExpression( Token const & token, Expression* expr )
+		static Expression* MakePreDecrExpression( ParseArena &arena, Token const & token, Expression* expr )
 		{
-			Expression* pre_decr_expression{ new PreDecrExpression( token.GetLineNumber(), expr ) };
+			Expression* pre_decr_expression{ arena.Make<PreDecrExpression>( token.GetLineNumber(), expr ) };
 			return pre_decr_expression;
 		}
 
-		static Expression* MakeUnaryOperation( Token const & token, Expression* expr )
+		static Expression* MakeUnaryOperation( ParseArena &arena, Token const & token, Expression* expr )
 		{
-			Expression* unary_op{ new UnaryOperation( token.GetLineNumber(), token.GetType(), expr ) };
+			Expression* unary_op{ arena.Make<UnaryOperation>( token.GetLineNumber(), token.GetType(), expr ) };
 			return unary_op;
 		}
 
-		static Expression* MakeIntegerLiteral( Token const & tok )
+		static Expression* MakeIntegerLiteral( ParseArena &arena, Token const & tok )
 		{
-			Expression* int_expr{ new IntegerLiteral( tok.GetLineNumber(), tok.GetIntLit() ) };
+			Expression* int_expr{ arena.Make<IntegerLiteral>( tok.GetLineNumber(), tok.GetIntLit() ) };
 			return int_expr;
 		}
 
-		static Expression* MakeFloatLiteral( Token const & tok )
+		static Expression* MakeFloatLiteral( ParseArena &arena, Token const & tok )
 		{
-			Expression* float_expr{ new FloatLiteral( tok.GetLineNumber(), tok.GetFloatLit() ) };
+			Expression* float_expr{ arena.Make<FloatLiteral>( tok.GetLineNumber(), tok.GetFloatLit() ) };
 			return float_expr;
 		}
 
-		static Expression* MakeStringLiteral( Token const & tok )
+		static Expression* MakeStringLiteral( ParseArena &arena, Token const & tok )
 		{
-			Expression* string_expr{ new CharacterString( tok.GetLineNumber(),
+			Expression* string_expr{ arena.Make<CharacterString>( tok.GetLineNumber(),
 				tok.GetIdentifier() ) };
 			return string_expr;
 		}
 
-		static Expression* MakeCharLiteral( Token const & token )
+		static Expression* MakeCharLiteral( ParseArena &arena, Token const & token )
 		{
-			Expression* char_expr{ new CharacterLiteral( token.GetLineNumber(), token.GetCharLit() ) };
+			Expression* char_expr{ arena.Make<CharacterLiteral>( token.GetLineNumber(), token.GetCharLit() ) };
 			return char_expr;
 		}
 
-		static Expression* MakeBooleanLiteral( Token const & token )
+		static Expression* MakeBooleanLiteral( ParseArena &arena, Token const & token )
 		{
 			bool const value = token.GetType() == ScannerTokenType::TOKEN_FALSE_LIT ? false : true;
-			BooleanLiteral* tmp = new BooleanLiteral( token.GetLineNumber(), value );
+			BooleanLiteral* tmp = arena.Make<BooleanLiteral>( token.GetLineNumber(), value );
 			return tmp;
 		}
 
@@ -1581,28 +1603,28 @@ namespace compiler {
 			return decl_statement;
 		}
 
-		static Expression* MakeListExpression( Token const & tok, ExpressionList* expr )
+		static Expression* MakeListExpression( ParseArena &arena, Token const & tok, ExpressionList* expr )
 		{
-			Expression* list_expression{ new ListExpression( tok, expr ) };
+			Expression* list_expression{ arena.Make<ListExpression>( tok, expr ) };
 			return list_expression;
 		}
 
-		static Expression* MakeMapExpression( Token const & tok, std::vector<MapExpression::expression_ptr_pair_t> &&
+		static Expression* MakeMapExpression( ParseArena &arena, Token const & tok, MapExpression::expression_pair_list_t &&
 			list )
 		{
-			Expression* map_expression{ new MapExpression( tok.GetLineNumber(), std::move( list ) ) };
+			Expression* map_expression{ arena.Make<MapExpression>( tok.GetLineNumber(), std::move( list ) ) };
 			return map_expression;
 		}
 
-		static Expression* MakeNewExpression( Token const & tok, Expression* expr )
+		static Expression* MakeNewExpression( ParseArena &arena, Token const & tok, Expression* expr )
 		{
-			Expression* expression{ new NewExpression( tok.GetLineNumber(), expr ) };
+			Expression* expression{ arena.Make<NewExpression>( tok.GetLineNumber(), expr ) };
 			return expression;
 		}
 
-		static Expression* MakeNullLitExpression( Token const & token )
+		static Expression* MakeNullLitExpression( ParseArena &arena, Token const & token )
 		{
-			Expression* nullExpr{ new NullLiteral( token.GetLineNumber() ) };
+			Expression* nullExpr{ arena.Make<NullLiteral>( token.GetLineNumber() ) };
 			return nullExpr;
 		}
 	};
@@ -1,6 +1,23 @@
 #include "types.hpp"
 
+/* Copyright (c) 2017 Joshua Ogunyinka */
 namespace compiler
 {
+#define SEMA_TYPE( NAME, KIND ) \
+	SemaType* SemaType::Get##NAME(){ \
+		static SemaType instance{ Types::KIND }; \
+		return &instance; \
+	}
 
-}
\ No newline at end of file
+	SEMA_TYPE( Boolean, BooleanType )
+	SEMA_TYPE( Character, CharacterType )
+	SEMA_TYPE( Integer, IntegerType )
+	SEMA_TYPE( Float, FloatType )
+	SEMA_TYPE( String, StringType )
+	SEMA_TYPE( List, ListType )
+	SEMA_TYPE( Dictionary, DictionaryType )
+	SEMA_TYPE( Lambda, LambdaType )
+	SEMA_TYPE( Function, FunctionType )
+	SEMA_TYPE( UserDefined, UserDefinedType )
+#undef SEMA_TYPE
+}
@@ -1,10 +1,17 @@
 #pragma once
 
+/* Copyright (c) 2017 Joshua Ogunyinka */
 namespace compiler
 {
+	/****************************
+	 * What a value is known to be at
+	 * compile time. There is one
+	 * instance per kind, so types
+	 * compare by address; nullptr
+	 * stands for 'not known'
+	 ****************************/
 	struct SemaType
 	{
-	private:
 		enum class Types {
 			BooleanType,
 			CharacterType,
@@ -17,21 +24,36 @@ namespace compiler
 			FunctionType,
 			UserDefinedType
 		};
-		SemaType() = default;
-
-		union Value {
+	private:
+		Types kind;
 
-		};
+		explicit SemaType( Types kind ) : kind( kind ){
+		}
+		SemaType( SemaType const & ) = delete;
+		SemaType& operator=( SemaType const & ) = delete;
 	public:
+		Types GetKind() const {
+			return kind;
+		}
+
+		bool IsNumeric() const {
+			return kind == Types::IntegerType || kind == Types::FloatType;
+		}
+
 		static SemaType* GetBoolean();
+		static SemaType* GetCharacter();
 		static SemaType* GetInteger();
 		static SemaType* GetFloat();
 		static SemaType* GetString();
-	};
-
-
-	struct BooleanType : SemaType
-	{
+		static SemaType* GetList();
+		static SemaType* GetDictionary();
+		static SemaType* GetLambda();
+		static SemaType* GetFunction();
+		static SemaType* GetUserDefined();
 
+		// the type of a value that comes from either of two places
+		static SemaType* Join( SemaType* a, SemaType* b ){
+			return a == b ? a : nullptr;
+		}
 	};
-}
\ No newline at end of file
+}
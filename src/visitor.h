@@ -0,0 +1,149 @@
+/***************************************************************************
+ * Parse tree visitor
+ *
+ * Copyright (c) 2017 Joshua Ogunyinka
+ * All rights reserved.
+ */
+
+#ifndef __VISITOR_H__
+#define __VISITOR_H__
+
+#include "tree.h"
+
+/****************************
+ * Every concrete node, its kind
+ * tag and the hook it falls back to
+ ****************************/
+#define STATEMENT_NODES( NODE ) \
+	NODE( IF_ELSE_STATEMENT, IfStatement, Statement ) \
+	NODE( DO_WHILE_STATEMENT, DoWhileStatement, Statement ) \
+	NODE( WHILE_STATEMENT, WhileStatement, Statement ) \
+	NODE( FOR_EACH_IN_STATEMENT, ForEachStatement, Statement ) \
+	NODE( LOOP_STATEMENT, LoopStatement, Statement ) \
+	NODE( VARIABLE_DECL_STMT, VariableDeclaration, Declaration ) \
+	NODE( VDECL_LIST_STMT, DeclarationList, Declaration ) \
+	NODE( CLASS_DECL_STMT, ClassDeclaration, Declaration ) \
+	NODE( FUNCTION_DECL_STMT, FunctionDeclaration, Declaration ) \
+	NODE( COMPOUND_STATEMENT, CompoundStatement, Statement ) \
+	NODE( SWITCH_STATEMENT, SwitchStatement, Statement ) \
+	NODE( RETURN_STATEMENT, ReturnStatement, Statement ) \
+	NODE( CONTINUE_STATEMENT, ContinueStatement, Statement ) \
+	NODE( BREAK_STATEMENT, BreakStatement, Statement ) \
+	NODE( LABELLED_STATEMENT, LabelledStatement, Statement ) \
+	NODE( CASE_STATEMENT, CaseStatement, Statement ) \
+	NODE( SHOW_STATEMENT, DumpStatement, Statement ) \
+	NODE( EXPR_STATEMENT, ExpressionStatement, Statement ) \
+	NODE( EMPTY_STMT, EmptyStatement, Statement )
+
+#define EXPRESSION_NODES( NODE ) \
+	NODE( NULL_LIT_EXPR, NullLiteral, Expression ) \
+	NODE( CHAR_LIT_EXPR, CharacterLiteral, Expression ) \
+	NODE( INT_LIT_EXPR, IntegerLiteral, Expression ) \
+	NODE( FLOAT_LIT_EXPR, FloatLiteral, Expression ) \
+	NODE( BOOLEAN_LIT_EXPR, BooleanLiteral, Expression ) \
+	NODE( CHAR_STR_EXPR, CharacterString, Expression ) \
+	NODE( FUNCTION_CALL_EXPR, FunctionCall, Expression ) \
+	NODE( ASSIGNMENT_EXPR, AssignmentExpression, BinaryExpression ) \
+	NODE( VARIABLE_EXPR, Variable, Expression ) \
+	NODE( BINARY_EXPR, BinaryExpression, Expression ) \
+	NODE( UNARY_EXPR, UnaryOperation, Expression ) \
+	NODE( CONDITIONAL_EXPR, ConditionalExpression, Expression ) \
+	NODE( SUBSCRIPT_EXPR, SubscriptExpression, Expression ) \
+	NODE( DOT_EXPRESSION, DotExpression, Expression ) \
+	NODE( POST_INCR_EXPR, PostIncrExpression, Expression ) \
+	NODE( POST_DECR_EXPR, PostDecrExpression, Expression ) \
+	NODE( PRE_INCR_EXPR, PreIncrExpression, Expression ) \
+	NODE( PRE_DECR_EXPR, PreDecrExpression, Expression ) \
+	NODE( LAMBDA_EXPR, LambdaExpression, Expression ) \
+	NODE( LIST_EXPR, ListExpression, Expression ) \
+	NODE( MAP_EXPR, MapExpression, Expression ) \
+	NODE( NEW_EXPR, NewExpression, Expression )
+
+namespace compiler {
+	/****************************
+	 * Checked downcasts on kind tags;
+	 * nullptr if the node is of another
+	 * kind
+	 ****************************/
+	template<typename T>
+	inline T* NodeCast( Statement *node ) {
+		return node && node->GetStatementType() == T::KIND ? static_cast< T* >( node ) : nullptr;
+	}
+
+	template<typename T>
+	inline T* NodeCast( Expression *node ) {
+		return node && node->GetExpressionType() == T::KIND ? static_cast< T* >( node ) : nullptr;
+	}
+
+	/****************************
+	 * Static double dispatch. A pass derives as
+	 * class Pass : public TreeVisitor<Pass, R, Args...>
+	 * and defines the Visit* hooks it needs; the
+	 * others fall back to VisitDeclaration,
+	 * VisitBinaryExpression, VisitStatement or
+	 * VisitExpression. Extra arguments (the
+	 * enclosing scope, say) are passed through.
+	 ****************************/
+	template<typename Derived, typename Result = void, typename ...Args>
+	class TreeVisitor {
+		Derived& Self() {
+			return *static_cast< Derived* >( this );
+		}
+
+	public:
+		Result Dispatch( Statement *statement, Args... args ) {
+			switch ( statement->GetStatementType() ) {
+#define DISPATCH_NODE( TAG, NODE_CLASS, FALLBACK ) \
+			case StatementType::TAG: \
+				return Self().Visit##NODE_CLASS( static_cast< NODE_CLASS* >( statement ), args... );
+				STATEMENT_NODES( DISPATCH_NODE )
+#undef DISPATCH_NODE
+			default:
+				return Self().VisitStatement( statement, args... );
+			}
+		}
+
+		Result Dispatch( Expression *expression, Args... args ) {
+			switch ( expression->GetExpressionType() ) {
+#define DISPATCH_NODE( TAG, NODE_CLASS, FALLBACK ) \
+			case ExpressionType::TAG: \
+				return Self().Visit##NODE_CLASS( static_cast< NODE_CLASS* >( expression ), args... );
+				EXPRESSION_NODES( DISPATCH_NODE )
+#undef DISPATCH_NODE
+			default:
+				return Self().VisitExpression( expression, args... );
+			}
+		}
+
+		Result VisitStatement( Statement *, Args... ) {
+			return Result();
+		}
+
+		Result VisitExpression( Expression *, Args... ) {
+			return Result();
+		}
+
+		Result VisitDeclaration( Declaration *decl, Args... args ) {
+			return Self().VisitStatement( decl, args... );
+		}
+
+#define DEFAULT_HOOK( TAG, NODE_CLASS, FALLBACK ) \
+		Result Visit##NODE_CLASS( NODE_CLASS *node, Args... args ) { \
+			return Self().Visit##FALLBACK( node, args... ); \
+		}
+		STATEMENT_NODES( DEFAULT_HOOK )
+		EXPRESSION_NODES( DEFAULT_HOOK )
+#undef DEFAULT_HOOK
+	};
+
+#define CHECK_STATEMENT_KIND( TAG, NODE_CLASS, FALLBACK ) \
+	static_assert( NODE_CLASS::KIND == StatementType::TAG, #NODE_CLASS " is tagged with the wrong kind" );
+#define CHECK_EXPRESSION_KIND( TAG, NODE_CLASS, FALLBACK ) \
+	static_assert( NODE_CLASS::KIND == ExpressionType::TAG, #NODE_CLASS " is tagged with the wrong kind" );
+	STATEMENT_NODES( CHECK_STATEMENT_KIND )
+	EXPRESSION_NODES( CHECK_EXPRESSION_KIND )
+#undef CHECK_STATEMENT_KIND
+#undef CHECK_EXPRESSION_KIND
+}
+
+#endif